@@ -27,6 +27,7 @@
 #include <guacamole/object.h>
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
+#include <guacamole/stream.h>
 #include <libssh2.h>
 
 #include <fcntl.h>
@@ -187,11 +188,31 @@ static int guac_ssh_append_filename(char* fullpath, const char* path,
 
 }
 
+/**
+ * The state of an inbound SFTP data transfer (upload).
+ */
+typedef struct guac_common_ssh_sftp_upload {
+
+    /**
+     * The open file to which received data should be written. This will be
+     * NULL if the file could not be opened.
+     */
+    LIBSSH2_SFTP_HANDLE* file;
+
+    /**
+     * Non-zero if writing any part of the blob currently being received has
+     * failed, in which case the remainder of that blob is discarded.
+     */
+    int failed;
+
+} guac_common_ssh_sftp_upload;
+
 /**
  * Handler for blob messages which continue an inbound SFTP data transfer
  * (upload). The data associated with the given stream is expected to be a
- * pointer to an open LIBSSH2_SFTP_HANDLE for the file to which the data
- * should be written.
+ * pointer to a guac_common_ssh_sftp_upload describing the file to which the
+ * data should be written. Data is written as each chunk of a blob arrives,
+ * and the blob is acknowledged once its final chunk has been received.
  *
  * @param client
  *     The client receiving the blob message.
@@ -200,36 +221,53 @@ static int guac_ssh_append_filename(char* fullpath, const char* path,
  *     The Guacamole protocol stream associated with the received blob message.
  *
  * @param data
- *     The data received within the blob.
+ *     The data received within the current chunk of the blob.
  *
  * @param length
  *     The length of the received data, in bytes.
  *
+ * @param final
+ *     Non-zero if this is the last chunk of the blob, zero otherwise.
+ *
  * @return
  *     Zero if the blob is handled successfully, or non-zero on error.
  */
 static int guac_common_ssh_sftp_blob_handler(guac_client* client,
-        guac_stream* stream, void* data, int length) {
+        guac_stream* stream, void* data, int length, int final) {
 
-    /* Pull file from stream */
-    LIBSSH2_SFTP_HANDLE* file = (LIBSSH2_SFTP_HANDLE*) stream->data;
+    /* Pull upload state from stream */
+    guac_common_ssh_sftp_upload* upload =
+        (guac_common_ssh_sftp_upload*) stream->data;
 
-    /* Attempt write */
-    if (libssh2_sftp_write(file, data, length) == length) {
-        guac_client_log(client, GUAC_LOG_DEBUG, "%i bytes written", length);
-        guac_protocol_send_ack(client->socket, stream, "SFTP: OK",
-                GUAC_PROTOCOL_STATUS_SUCCESS);
-        guac_socket_flush(client->socket);
+    /* Attempt write, unless part of this blob has already failed */
+    if (!upload->failed && length > 0) {
+        if (upload->file == NULL
+                || libssh2_sftp_write(upload->file, data, length) != length)
+            upload->failed = 1;
+        else
+            guac_client_log(client, GUAC_LOG_DEBUG, "%i bytes written",
+                    length);
     }
 
+    /* Acknowledge only once entire blob is received */
+    if (!final)
+        return 0;
+
     /* Inform of any errors */
-    else {
+    if (upload->failed) {
+        upload->failed = 0;
         guac_client_log(client, GUAC_LOG_INFO, "Unable to write to file");
         guac_protocol_send_ack(client->socket, stream, "SFTP: Write failed",
                 GUAC_PROTOCOL_STATUS_SERVER_ERROR);
         guac_socket_flush(client->socket);
     }
 
+    else {
+        guac_protocol_send_ack(client->socket, stream, "SFTP: OK",
+                GUAC_PROTOCOL_STATUS_SUCCESS);
+        guac_socket_flush(client->socket);
+    }
+
     return 0;
 
 }
@@ -237,8 +275,8 @@ static int guac_common_ssh_sftp_blob_handler(guac_client* client,
 /**
  * Handler for end messages which terminate an inbound SFTP data transfer
  * (upload). The data associated with the given stream is expected to be a
- * pointer to an open LIBSSH2_SFTP_HANDLE for the file to which the data
- * has been written and which should now be closed.
+ * pointer to a guac_common_ssh_sftp_upload describing the file to which the
+ * data has been written and which should now be closed.
  *
  * @param client
  *     The client receiving the end message.
@@ -252,11 +290,12 @@ static int guac_common_ssh_sftp_blob_handler(guac_client* client,
 static int guac_common_ssh_sftp_end_handler(guac_client* client,
         guac_stream* stream) {
 
-    /* Pull file from stream */
-    LIBSSH2_SFTP_HANDLE* file = (LIBSSH2_SFTP_HANDLE*) stream->data;
+    /* Pull upload state from stream */
+    guac_common_ssh_sftp_upload* upload =
+        (guac_common_ssh_sftp_upload*) stream->data;
 
     /* Attempt to close file */
-    if (libssh2_sftp_close(file) == 0) {
+    if (upload->file != NULL && libssh2_sftp_close(upload->file) == 0) {
         guac_client_log(client, GUAC_LOG_DEBUG, "File closed");
         guac_protocol_send_ack(client->socket, stream, "SFTP: OK",
                 GUAC_PROTOCOL_STATUS_SUCCESS);
@@ -269,6 +308,44 @@ static int guac_common_ssh_sftp_end_handler(guac_client* client,
         guac_socket_flush(client->socket);
     }
 
+    free(upload);
+    return 0;
+
+}
+
+/**
+ * Associates the given file with the given inbound stream, such that all
+ * data received along that stream is written to the file.
+ *
+ * @param stream
+ *     The Guacamole protocol stream along which the file will be received.
+ *
+ * @param file
+ *     The open file to which received data should be written, or NULL if the
+ *     file could not be opened.
+ *
+ * @return
+ *     Zero if the stream was initialized successfully, non-zero if memory
+ *     for the upload state could not be allocated.
+ */
+static int guac_common_ssh_sftp_init_upload(guac_stream* stream,
+        LIBSSH2_SFTP_HANDLE* file) {
+
+    guac_common_ssh_sftp_upload* upload =
+        malloc(sizeof(guac_common_ssh_sftp_upload));
+
+    if (upload == NULL)
+        return 1;
+
+    upload->file = file;
+    upload->failed = 0;
+
+    /* Set handlers for file stream */
+    stream->blob_chunk_handler = guac_common_ssh_sftp_blob_handler;
+    stream->end_handler = guac_common_ssh_sftp_end_handler;
+
+    /* Store upload state within stream */
+    stream->data = upload;
     return 0;
 
 }
@@ -325,12 +402,14 @@ int guac_common_ssh_sftp_handle_file_stream(guac_object* filesystem,
         guac_socket_flush(client->socket);
     }
 
-    /* Set handlers for file stream */
-    stream->blob_handler = guac_common_ssh_sftp_blob_handler;
-    stream->end_handler = guac_common_ssh_sftp_end_handler;
-
-    /* Store file within stream */
-    stream->data = file;
+    /* Set handlers for file stream, storing file within stream */
+    if (guac_common_ssh_sftp_init_upload(stream, file)) {
+        guac_client_log(client, GUAC_LOG_ERROR,
+                "Unable to allocate upload state");
+        if (file != NULL)
+            libssh2_sftp_close(file);
+        return 1;
+    }
     return 0;
 
 }
@@ -430,6 +509,7 @@ guac_stream* guac_common_ssh_sftp_download_file(guac_object* filesystem,
     stream = guac_client_alloc_stream(client);
     stream->ack_handler = guac_common_ssh_sftp_ack_handler;
     stream->data = file;
+    stream->priority = GUAC_STREAM_PRIORITY_BULK;
 
     /* Send stream start, strip name */
     filename = basename(filename);
@@ -654,6 +734,7 @@ static int guac_common_ssh_sftp_get_handler(guac_client* client,
         guac_stream* stream = guac_client_alloc_stream(client);
         stream->ack_handler = guac_common_ssh_sftp_ack_handler;
         stream->data = file;
+        stream->priority = GUAC_STREAM_PRIORITY_BULK;
 
         /* Associate new stream with get request */
         guac_protocol_send_body(client->socket, object, stream,
@@ -717,12 +798,14 @@ static int guac_common_ssh_sftp_put_handler(guac_client* client,
                 guac_sftp_get_status(object));
     }
 
-    /* Set handlers for file stream */
-    stream->blob_handler = guac_common_ssh_sftp_blob_handler;
-    stream->end_handler = guac_common_ssh_sftp_end_handler;
-
-    /* Store file within stream */
-    stream->data = file;
+    /* Set handlers for file stream, storing file within stream */
+    if (guac_common_ssh_sftp_init_upload(stream, file)) {
+        guac_client_log(client, GUAC_LOG_ERROR,
+                "Unable to allocate upload state");
+        if (file != NULL)
+            libssh2_sftp_close(file);
+        return 1;
+    }
 
     guac_socket_flush(client->socket);
     return 0;
@@ -23,6 +23,7 @@
 #include "config.h"
 #include "guac_rect.h"
 #include "guac_surface.h"
+#include "guac_surface_row.h"
 
 #include <cairo/cairo.h>
 #include <guacamole/client.h>
@@ -31,6 +32,7 @@
 #include <guacamole/socket.h>
 #include <guacamole/timestamp.h>
 
+#include <inttypes.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
@@ -82,9 +84,10 @@
 /**
  * The JPEG image quality ('quantization') setting to use. Range 0-100 where
  * 100 is the highest quality/largest file size, and 0 is the lowest
- * quality/smallest file size.
+ * quality/smallest file size. As lossy regions are re-sent losslessly once
+ * they stop changing, this can be fairly aggressive.
  */
-#define GUAC_SURFACE_JPEG_IMAGE_QUALITY 90
+#define GUAC_SURFACE_JPEG_IMAGE_QUALITY 60
 
 /**
  * The framerate which, if exceeded, indicates that JPEG is preferred.
@@ -100,9 +103,17 @@
 /**
  * The WebP image quality ('quantization') setting to use. Range 0-100 where
  * 100 is the highest quality/largest file size, and 0 is the lowest
- * quality/smallest file size.
+ * quality/smallest file size. As with JPEG, lossy regions are later refined,
+ * so this can be fairly aggressive.
  */
-#define GUAC_SURFACE_WEBP_IMAGE_QUALITY 90
+#define GUAC_SURFACE_WEBP_IMAGE_QUALITY 60
+
+/**
+ * The lowest quality to which the JPEG and WebP image quality settings are
+ * reduced as the connection becomes congested. See
+ * __guac_common_surface_lossy_quality().
+ */
+#define GUAC_SURFACE_MIN_IMAGE_QUALITY 30
 
 /**
  * The JPEG compression min block size. This defines the optimal rectangle block
@@ -118,6 +129,195 @@
  */
 #define GUAC_SURFACE_WEBP_BLOCK_SIZE 8
 
+/**
+ * The weight given to each new measurement of the cost of a format within a
+ * heat map cell, as the reciprocal of the fraction of the average it
+ * replaces.
+ */
+#define GUAC_SURFACE_COST_SMOOTHING 4
+
+/**
+ * The number of times a format may be chosen for a heat map cell before all
+ * viable formats are measured again by trial encodes, such that changes in
+ * the nature of the cell's content are noticed.
+ */
+#define GUAC_SURFACE_TRIAL_INTERVAL 64
+
+/**
+ * The maximum number of distinct colors within a heat map cell for its
+ * content to be considered text or other synthetic imagery which must be
+ * sent losslessly, regardless of the number of edges present.
+ */
+#define GUAC_SURFACE_TILE_FEW_COLORS 64
+
+/**
+ * The maximum number of distinct colors within a heat map cell for its
+ * content to be considered text if it also contains many edges, as with
+ * antialiased text drawn over a gradient. Cells containing more colors than
+ * this are always considered photographic.
+ */
+#define GUAC_SURFACE_TILE_MAX_COLORS 256
+
+/**
+ * The base-2 logarithm of the number of slots in the hash table used to count
+ * the distinct colors within a heat map cell. There must be more slots than
+ * GUAC_SURFACE_TILE_MAX_COLORS.
+ */
+#define GUAC_SURFACE_TILE_COLOR_BITS 9
+
+/**
+ * The number of slots in the hash table used to count the distinct colors
+ * within a heat map cell.
+ */
+#define GUAC_SURFACE_TILE_COLOR_SLOTS (1 << GUAC_SURFACE_TILE_COLOR_BITS)
+
+/**
+ * The minimum difference in any color component between horizontally
+ * adjacent pixels for those pixels to be considered an edge.
+ */
+#define GUAC_SURFACE_TILE_EDGE_CONTRAST 96
+
+/**
+ * The reciprocal of the fraction of pixels within a heat map cell which must
+ * lie on an edge for its content to be considered text, if it contains more
+ * than GUAC_SURFACE_TILE_FEW_COLORS colors.
+ */
+#define GUAC_SURFACE_TILE_EDGE_RATIO 16
+
+/**
+ * The number of milliseconds that a heat map cell last sent using a lossy
+ * format must go without updates before it is re-sent losslessly.
+ */
+#define GUAC_SURFACE_REFINE_DELAY 500
+
+/**
+ * The maximum number of pixels which may be re-sent losslessly by a single
+ * flush, such that refinement never competes significantly with interactive
+ * updates for bandwidth. Cells beyond this budget are refined by later
+ * flushes.
+ */
+#define GUAC_SURFACE_REFINE_MAX_PIXELS 65536
+
+/**
+ * The fraction of GUAC_SURFACE_REFINE_MAX_PIXELS, as a percentage, which may
+ * still be re-sent losslessly by each flush while the connection is at its
+ * most congested. Refinement is slowed rather than stopped, such that a
+ * connection which is always congested is still eventually refined.
+ */
+#define GUAC_SURFACE_REFINE_MIN_PERCENT 25
+
+/**
+ * The number of bytes of output which may still be waiting to be sent on the
+ * socket of a surface when that surface is flushed. Beyond this, the client
+ * is still receiving earlier updates, and the flush is skipped, the surface
+ * accumulating all further changes until the client has caught up.
+ */
+#define GUAC_SURFACE_MAX_BACKLOG 65536
+
+/**
+ * The framerate which a heat map cell must sustain to be considered for
+ * streaming as video.
+ */
+#define GUAC_SURFACE_VIDEO_FRAMERATE 15
+
+/**
+ * The number of milliseconds after its last update that a heat map cell
+ * stops being considered for streaming as video.
+ */
+#define GUAC_SURFACE_VIDEO_TIMEOUT 1000
+
+/**
+ * The minimum area, in pixels, of a region streamed as video. Smaller
+ * regions are not worth the overhead of a separate layer and video stream.
+ */
+#define GUAC_SURFACE_VIDEO_MIN_AREA 65536
+
+/**
+ * The reciprocal of the fraction of the heat map cells within a candidate
+ * video region which must be updated frequently for that region to be
+ * streamed as video.
+ */
+#define GUAC_SURFACE_VIDEO_DENSITY 2
+
+/**
+ * The number of consecutive flushes which must identify the same region as
+ * suitable for video before that region is streamed as video.
+ */
+#define GUAC_SURFACE_VIDEO_MIN_FLUSHES 30
+
+/**
+ * The minimum number of consecutive rows or columns which must match at a
+ * shifted offset before a draw is considered to contain scrolled or moved
+ * content.
+ */
+#define GUAC_SURFACE_MOTION_MIN_RUN 16
+
+/**
+ * The maximum number of rows or columns of a draw which are sampled when
+ * searching for candidate scroll offsets.
+ */
+#define GUAC_SURFACE_MOTION_SAMPLES 16
+
+/**
+ * The maximum number of candidate offsets considered for each sampled row or
+ * column.
+ */
+#define GUAC_SURFACE_MOTION_CANDIDATES 4
+
+/**
+ * The number of evenly-spaced strips of pixels sampled from each row when
+ * hashing rows during motion detection. Sampling only part of each row keeps
+ * detection cheap, as any match found using these hashes is verified exactly
+ * before use.
+ */
+#define GUAC_SURFACE_MOTION_STRIPS 4
+
+/**
+ * The width of each strip of pixels sampled from each row when hashing rows
+ * during motion detection, in pixels.
+ */
+#define GUAC_SURFACE_MOTION_STRIP_WIDTH 16
+
+/**
+ * The number of evenly-spaced rows sampled when hashing columns during motion
+ * detection.
+ */
+#define GUAC_SURFACE_MOTION_SAMPLE_ROWS 16
+
+/**
+ * The FNV-1a prime, used to hash rows and columns of pixels during motion
+ * detection.
+ */
+#define GUAC_SURFACE_MOTION_HASH_PRIME 16777619
+
+/**
+ * The FNV-1a offset basis, used as the initial value of each row and column
+ * hash during motion detection.
+ */
+#define GUAC_SURFACE_MOTION_HASH_BASIS 2166136261
+
+/**
+ * The maximum number of solid-color rectangles that a dirty rectangle may be
+ * decomposed into before it is sent as an image instead. Each solid-color
+ * rectangle costs a "rect" and "cfill" instruction of around 70 bytes, while
+ * even the smallest image requires a stream, a PNG header, and a pass through
+ * the encoder.
+ */
+#define GUAC_SURFACE_SOLID_MAX_RECTS 8
+
+/**
+ * The largest area, in pixels, of an image update which may be packed into an
+ * atlas image with other updates. Larger updates are sent as images of their
+ * own, as the overhead of a separate image is comparatively small.
+ */
+#define GUAC_SURFACE_ATLAS_MAX_AREA 1024
+
+/**
+ * The minimum width of each atlas image, in pixels. Updates are packed into
+ * rows of this width, or of the width of the widest update if wider.
+ */
+#define GUAC_SURFACE_ATLAS_MIN_WIDTH 256
+
 /**
  * Updates the coordinates of the given rectangle to be within the bounds of
  * the given surface.
@@ -180,17 +380,27 @@ static void __guac_common_clip_rect(guac_common_surface* surface,
 
 /**
  * Returns whether the given rectangle should be combined into the existing
- * dirty rectangle, to be eventually flushed as a "png" instruction.
+ * dirty rectangle, to be eventually flushed as a "png" instruction, rather
+ * than being sent immediately. The update is assumed to contain only
+ * metainformation about the update's rectangle (such as a copy or fill), and
+ * no image data.
  *
  * @param surface The surface to be queried.
  * @param rect The update rectangle.
- * @param rect_only Non-zero if this update, by its nature, contains only
- *                  metainformation about the update's rectangle, zero if
- *                  the update also contains image data.
  * @return Non-zero if the update should be combined with any existing update,
  *         zero otherwise.
  */
-static int __guac_common_should_combine(guac_common_surface* surface, const guac_common_rect* rect, int rect_only) {
+static int __guac_common_should_combine(guac_common_surface* surface, const guac_common_rect* rect) {
+
+    /* Defer everything while the client catches up */
+    if (surface->backlogged)
+        return 1;
+
+    /* Always combine updates to regions streamed as video, as these must be
+     * sent as frames of video rather than drawn beneath the video layer */
+    if (surface->video != NULL
+            && guac_common_rect_intersects(rect, &surface->video_rect))
+        return 1;
 
     if (surface->dirty) {
 
@@ -209,9 +419,8 @@ static int __guac_common_should_combine(guac_common_surface* surface, const guac
         dirty_cost    = GUAC_SURFACE_BASE_COST + surface->dirty_rect.width * surface->dirty_rect.height;
         update_cost   = GUAC_SURFACE_BASE_COST + rect->width * rect->height;
 
-        /* Reduce cost if no image data */
-        if (rect_only)
-            update_cost /= GUAC_SURFACE_DATA_FACTOR;
+        /* Reduce cost, as there is no image data */
+        update_cost /= GUAC_SURFACE_DATA_FACTOR;
 
         /* Combine if cost estimate shows benefit */
         if (combined_cost <= update_cost + dirty_cost)
@@ -238,18 +447,53 @@ static int __guac_common_should_combine(guac_common_surface* surface, const guac
 }
 
 /**
- * Expands the dirty rect of the given surface to contain the rect described by the given
- * coordinates.
+ * Expands the dirty rect of the given surface, as well as the dirty rect of
+ * each tile intersecting the given rect, to contain the given rect.
  *
  * @param surface The surface to mark as dirty.
  * @param rect The rectangle of the update which is dirtying the surface.
  */
 static void __guac_common_mark_dirty(guac_common_surface* surface, const guac_common_rect* rect) {
 
+    int x, y;
+
     /* Ignore empty rects */
     if (rect->width <= 0 || rect->height <= 0)
         return;
 
+    /* Calculate tile grid dimensions */
+    int tiles_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
+
+    /* Calculate range of tiles intersecting given rect */
+    int min_x = rect->x / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int min_y = rect->y / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int max_x = (rect->x + rect->width  - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    int max_y = (rect->y + rect->height - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+
+    /* Expand dirty rect of each intersecting tile */
+    for (y = min_y; y <= max_y; y++) {
+        for (x = min_x; x <= max_x; x++) {
+
+            guac_common_rect* tile = &surface->dirty_tiles[y * tiles_width + x];
+
+            /* Restrict update to bounds of tile */
+            guac_common_rect part = *rect;
+            guac_common_rect bounds;
+            guac_common_rect_init(&bounds,
+                    x * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    y * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    GUAC_COMMON_SURFACE_HEAT_CELL_SIZE);
+            guac_common_rect_constrain(&part, &bounds);
+
+            if (tile->width > 0)
+                guac_common_rect_extend(tile, &part);
+            else
+                *tile = part;
+
+        }
+    }
+
     /* If already dirty, update existing rect */
     if (surface->dirty)
         guac_common_rect_extend(&surface->dirty_rect, rect);
@@ -262,6 +506,71 @@ static void __guac_common_mark_dirty(guac_common_surface* surface, const guac_co
 
 }
 
+/**
+ * Calculates the range of heat map cells which intersect the given rectangle,
+ * which must be non-empty and lie within the bounds of the given surface.
+ *
+ * @param surface The surface containing the heat map.
+ * @param rect The rectangle whose intersecting cells should be determined.
+ * @param min_x Receives the column of the first intersecting cell.
+ * @param min_y Receives the row of the first intersecting cell.
+ * @param max_x Receives the column of the last intersecting cell, inclusive.
+ * @param max_y Receives the row of the last intersecting cell, inclusive.
+ */
+static void __guac_common_surface_heat_bounds(guac_common_surface* surface,
+        const guac_common_rect* rect, int* min_x, int* min_y,
+        int* max_x, int* max_y) {
+
+    *min_x = rect->x / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    *min_y = rect->y / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+
+    *max_x = (rect->x + rect->width  - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    *max_y = (rect->y + rect->height - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+
+}
+
+/**
+ * Returns the time of the most recent update covering the given heat map
+ * cell.
+ *
+ * @param heat_cell The heat map cell to query.
+ * @return The timestamp of the most recent update covering the cell, or
+ *         zero if the cell has never been updated.
+ */
+static guac_timestamp __guac_common_surface_cell_latest(
+        const guac_common_surface_heat_cell* heat_cell) {
+
+    /* Calculate index of latest history entry */
+    int latest_entry = heat_cell->oldest_entry - 1;
+    if (latest_entry < 0)
+        latest_entry = GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE - 1;
+
+    return heat_cell->history[latest_entry];
+
+}
+
+/**
+ * Returns the framerate of the given heat map cell, as measured over its
+ * most recent updates.
+ *
+ * @param heat_cell The heat map cell to query.
+ * @return The framerate of the given cell, in frames per second.
+ */
+static unsigned int __guac_common_surface_cell_framerate(
+        const guac_common_surface_heat_cell* heat_cell) {
+
+    /* Calculate elapsed time covering entire history for this cell */
+    int elapsed_time = __guac_common_surface_cell_latest(heat_cell)
+                     - heat_cell->history[heat_cell->oldest_entry];
+
+    if (elapsed_time)
+        return GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE * 1000
+            / elapsed_time;
+
+    return 0;
+
+}
+
 /**
  * Calculate the current average framerate for a given area on the surface.
  *
@@ -279,17 +588,14 @@ static unsigned int __guac_common_surface_calculate_framerate(
         guac_common_surface* surface, const guac_common_rect* rect) {
 
     int x, y;
+    int min_x, min_y, max_x, max_y;
 
     /* Calculate heat map dimensions */
     int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
 
-    /* Calculate minimum X/Y coordinates intersecting given rect */
-    int min_x = rect->x / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
-    int min_y = rect->y / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
-
-    /* Calculate maximum X/Y coordinates intersecting given rect */
-    int max_x = min_x + (rect->width  - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
-    int max_y = min_y + (rect->height - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+    /* Calculate X/Y coordinates of cells intersecting given rect */
+    __guac_common_surface_heat_bounds(surface, rect,
+            &min_x, &min_y, &max_x, &max_y);
 
     unsigned int sum_framerate = 0;
     unsigned int count = 0;
@@ -300,28 +606,16 @@ static unsigned int __guac_common_surface_calculate_framerate(
 
     /* Iterate over all the heat map cells for the area
      * and calculate the average framerate */
-    for (y = min_y; y < max_y; y++) {
+    for (y = min_y; y <= max_y; y++) {
 
         /* Get current row of heat map */
         const guac_common_surface_heat_cell* heat_cell = heat_row;
 
         /* For each cell in subset of row */
-        for (x = min_x; x < max_x; x++) {
-
-            /* Calculate indicies for latest and oldest history entries */
-            int oldest_entry = heat_cell->oldest_entry;
-            int latest_entry = oldest_entry - 1;
-            if (latest_entry < 0)
-                latest_entry = GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE - 1;
-
-            /* Calculate elapsed time covering entire history for this cell */
-            int elapsed_time = heat_cell->history[latest_entry]
-                             - heat_cell->history[oldest_entry];
+        for (x = min_x; x <= max_x; x++) {
 
-            /* Calculate and add framerate */
-            if (elapsed_time)
-                sum_framerate += GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE
-                    * 1000 / elapsed_time;
+            /* Add framerate of cell */
+            sum_framerate += __guac_common_surface_cell_framerate(heat_cell);
 
             /* Next heat map cell */
             heat_cell++;
@@ -342,1185 +636,3359 @@ static unsigned int __guac_common_surface_calculate_framerate(
 
 }
 
- /**
- * Guesses whether a rectangle within a particular surface would be better
- * compressed as PNG or using a lossy format like JPEG. Positive values
- * indicate PNG is likely to be superior, while negative values indicate the
- * opposite.
+/**
+ * Returns the quality which should be used for lossy images drawn to the
+ * given surface, scaling the given quality setting down toward
+ * GUAC_SURFACE_MIN_IMAGE_QUALITY as the connection of the surface's client
+ * becomes congested. As lossy regions are later refined, this trades only
+ * the quality of rapidly-changing content for bandwidth.
  *
- * @param surface
- *     The surface containing the image data to check.
+ * @param surface The surface that lossy images will be drawn to.
+ * @param quality The quality setting to use if there is no congestion.
+ * @return The quality setting to use, from 0 to 100 inclusive.
+ */
+static int __guac_common_surface_lossy_quality(guac_common_surface* surface,
+        int quality) {
+
+    int congestion = surface->client->congestion;
+
+    return quality - (quality - GUAC_SURFACE_MIN_IMAGE_QUALITY) * congestion
+                   / GUAC_CLIENT_MAX_CONGESTION;
+
+}
+
+/**
+ * Returns the framerate which a region of the given surface must sustain
+ * for lossy formats to be considered. This is
+ * GUAC_COMMON_SURFACE_JPEG_FRAMERATE if the connection of the surface's
+ * client is not congested, falling to zero as congestion rises such that
+ * more content is sent lossily. Content which does not appear photographic
+ * is still sent losslessly regardless of framerate.
  *
- * @param rect
- *     The rect to check within the given surface.
+ * @param surface The surface that the region belongs to.
+ * @return The lowest framerate at which lossy formats are considered.
+ */
+static unsigned int __guac_common_surface_lossy_framerate(
+        guac_common_surface* surface) {
+
+    int congestion = surface->client->congestion;
+
+    return GUAC_COMMON_SURFACE_JPEG_FRAMERATE
+         * (GUAC_CLIENT_MAX_CONGESTION - congestion)
+         / GUAC_CLIENT_MAX_CONGESTION;
+
+}
+
+/**
+ * Records the measured cost of encoding the given rectangle of the given
+ * surface using the given format within each heat map cell intersecting that
+ * rectangle.
  *
- * @return
- *     Positive values if PNG compression is likely to perform better than
- *     lossy alternatives, or negative values if PNG is likely to perform
- *     worse.
+ * @param surface The surface containing the heat map to update.
+ * @param rect The rectangle that was encoded.
+ * @param format The format used to encode the rectangle.
+ * @param bytes The number of bytes of instructions produced by the encode.
+ * @param time The time taken by the encode, in microseconds.
  */
-static int __guac_common_surface_png_optimality(guac_common_surface* surface,
-        const guac_common_rect* rect) {
+static void __guac_common_surface_record_cost(guac_common_surface* surface,
+        const guac_common_rect* rect, guac_client_image_format format,
+        size_t bytes, int time) {
 
     int x, y;
+    int min_x, min_y, max_x, max_y;
 
-    int num_same = 0;
-    int num_different = 1;
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
+    double pixels = (double) rect->width * rect->height;
 
-    /* Get image/buffer metrics */
-    int width = rect->width;
-    int height = rect->height;
-    int stride = surface->stride;
+    /* Ignore empty rects */
+    if (pixels <= 0)
+        return;
 
-    /* Get buffer from surface */
-    unsigned char* buffer = surface->buffer + rect->y * stride + rect->x * 4;
+    /* Encodes too quick to measure still have some cost */
+    if (time < 1)
+        time = 1;
 
-    /* Image must be at least 1x1 */
-    if (width < 1 || height < 1)
-        return 0;
+    double pixel_bytes = bytes / pixels;
+    double pixel_time = time / pixels;
 
-    /* For each row */
-    for (y = 0; y < height; y++) {
+    __guac_common_surface_heat_bounds(surface, rect,
+            &min_x, &min_y, &max_x, &max_y);
 
-        uint32_t* row = (uint32_t*) buffer;
-        uint32_t last_pixel = *(row++) | 0xFF000000;
+    for (y = min_y; y <= max_y; y++) {
 
-        /* For each pixel in current row */
-        for (x = 1; x < width; x++) {
+        guac_common_surface_heat_cell* heat_cell =
+            surface->heat_map + y * heat_width + min_x;
 
-            /* Get next pixel */
-            uint32_t current_pixel = *(row++) | 0xFF000000;
+        for (x = min_x; x <= max_x; x++) {
 
-            /* Update same/different counts according to pixel value */
-            if (current_pixel == last_pixel)
-                num_same++;
-            else
-                num_different++;
+            guac_common_surface_format_cost* cost = &heat_cell->costs[format];
 
-            last_pixel = current_pixel;
+            /* The first measurement initializes the averages outright */
+            if (!cost->measured) {
+                cost->bytes = pixel_bytes;
+                cost->time = pixel_time;
+                cost->measured = 1;
+            }
 
-        }
+            /* Later measurements are blended in gradually */
+            else {
+                cost->bytes += (pixel_bytes - cost->bytes)
+                    / GUAC_SURFACE_COST_SMOOTHING;
+                cost->time += (pixel_time - cost->time)
+                    / GUAC_SURFACE_COST_SMOOTHING;
+            }
 
-        /* Advance to next row */
-        buffer += stride;
+            heat_cell++;
 
-    }
+        }
 
-    /* Return rough approximation of optimality for PNG compression */
-    return 0x100 * num_same / num_different - 0x400;
+    }
 
 }
 
 /**
- * Returns whether the given rectangle would be optimally encoded as JPEG
- * rather than PNG.
- *
- * @param surface
- *     The surface to be queried.
- *
- * @param rect
- *     The rectangle to check.
- *
- * @return
- *     Non-zero if the rectangle would be optimally encoded as JPEG, zero
- *     otherwise.
+ * Write handler for the socket receiving the output of trial encodes, which
+ * appends all data written to the buffer of the guac_common_surface_trial
+ * pointed to by the socket's data member, growing the buffer as needed.
  */
-static int __guac_common_surface_should_use_jpeg(guac_common_surface* surface,
-        const guac_common_rect* rect) {
+static ssize_t __guac_common_surface_trial_write(guac_socket* socket,
+        const void* buf, size_t count) {
 
-    /* Calculate the average framerate for the given rect */
-    int framerate = __guac_common_surface_calculate_framerate(surface, rect);
+    guac_common_surface_trial* trial =
+        (guac_common_surface_trial*) socket->data;
 
-    int rect_size = rect->width * rect->height;
+    /* Grow buffer to fit, doubling its size to avoid frequent reallocation */
+    if (trial->length + count > trial->size) {
 
-    /* JPEG is preferred if:
-     * - frame rate is high enough
-     * - image size is large enough
-     * - PNG is not more optimal based on image contents */
-    return framerate >= GUAC_COMMON_SURFACE_JPEG_FRAMERATE
-        && rect_size > GUAC_SURFACE_JPEG_MIN_BITMAP_SIZE
-        && __guac_common_surface_png_optimality(surface, rect) < 0;
+        size_t size = trial->size * 2;
+        if (size < trial->length + count)
+            size = trial->length + count;
+
+        char* buffer = realloc(trial->buffer, size);
+        if (buffer == NULL) {
+            trial->valid = 0;
+            return -1;
+        }
+
+        trial->buffer = buffer;
+        trial->size = size;
+
+    }
+
+    memcpy(trial->buffer + trial->length, buf, count);
+    trial->length += count;
+    return count;
 
 }
 
 /**
- * Returns whether the given rectangle would be optimally encoded as WebP
- * rather than PNG.
- *
- * @param surface
- *     The surface to be queried.
+ * Calculates the rectangle actually sent when the given rectangle of the
+ * given surface is sent using the given format. The rectangles of lossy
+ * formats are expanded to fit the block size of the format.
  *
- * @param rect
- *     The rectangle to check.
- *
- * @return
- *     Non-zero if the rectangle would be optimally encoded as WebP, zero
- *     otherwise.
+ * @param surface The surface containing the rectangle.
+ * @param rect The rectangle to be sent.
+ * @param format The format the rectangle will be sent with.
+ * @param image_rect Receives the rectangle actually sent.
  */
-static int __guac_common_surface_should_use_webp(guac_common_surface* surface,
-        const guac_common_rect* rect) {
+static void __guac_common_surface_image_rect(guac_common_surface* surface,
+        const guac_common_rect* rect, guac_client_image_format format,
+        guac_common_rect* image_rect) {
 
-    /* Do not use WebP if not supported */
-    if (!guac_client_supports_webp(surface->client))
-        return 0;
+    guac_common_rect max;
+    guac_common_rect_init(&max, 0, 0, surface->width, surface->height);
+
+    *image_rect = *rect;
 
-    /* Calculate the average framerate for the given rect */
-    int framerate = __guac_common_surface_calculate_framerate(surface, rect);
+    if (format == GUAC_CLIENT_IMAGE_JPEG)
+        guac_common_rect_expand_to_grid(GUAC_SURFACE_JPEG_BLOCK_SIZE,
+                image_rect, &max);
 
-    /* WebP is preferred if:
-     * - frame rate is high enough
-     * - PNG is not more optimal based on image contents */
-    return framerate >= GUAC_COMMON_SURFACE_JPEG_FRAMERATE
-        && __guac_common_surface_png_optimality(surface, rect) < 0;
+    else if (format == GUAC_CLIENT_IMAGE_WEBP)
+        guac_common_rect_expand_to_grid(GUAC_SURFACE_WEBP_BLOCK_SIZE,
+                image_rect, &max);
 
 }
 
 /**
- * Updates the heat map cells which intersect the given rectangle using the
- * given timestamp. This timestamp, along with timestamps from past updates,
- * is used to calculate the framerate of each heat cell.
- *
- * @param surface
- *     The surface containing the heat map cells to be updated.
- *
- * @param rect
- *     The rectangle containing the heat map cells to be updated.
+ * Encodes the given rectangle of the given surface using the given format,
+ * keeping the result within the trials of the surface, and records the size
+ * and duration of the encode within the heat map of the surface. If the
+ * given format is then chosen to send the rectangle, the result is sent by
+ * __guac_common_surface_flush_trial() rather than encoding the same image
+ * again.
  *
- * @param time
- *     The timestamp to use when updating the heat map cells which intersect
- *     the given rectangle.
+ * @param surface The surface containing the rectangle to encode.
+ * @param rect The rectangle to encode.
+ * @param format The format to encode the rectangle with.
  */
-static void __guac_common_surface_touch_rect(guac_common_surface* surface,
-        guac_common_rect* rect, guac_timestamp time) {
+static void __guac_common_surface_trial_encode(guac_common_surface* surface,
+        const guac_common_rect* rect, guac_client_image_format format) {
 
-    int x, y;
+    guac_common_surface_trial* trial = &surface->trials[format];
 
-    /* Calculate heat map dimensions */
-    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
+    /* Allocate socket for trial encodes on first use */
+    if (surface->trial_socket == NULL) {
 
-    /* Calculate minimum X/Y coordinates intersecting given rect */
-    int min_x = rect->x / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
-    int min_y = rect->y / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+        surface->trial_socket = guac_socket_alloc(0, NULL);
+        if (surface->trial_socket == NULL)
+            return;
 
-    /* Calculate maximum X/Y coordinates intersecting given rect */
-    int max_x = min_x + (rect->width  - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
-    int max_y = min_y + (rect->height - 1) / GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+        surface->trial_socket->write_handler =
+            __guac_common_surface_trial_write;
 
-    /* Get start of buffer at given coordinates */
-    guac_common_surface_heat_cell* heat_row =
-        surface->heat_map + min_y * heat_width + min_x;
+    }
 
-    /* Update all heat map cells which intersect with rectangle */
-    for (y = min_y; y <= max_y; y++) {
+    guac_socket* socket = surface->trial_socket;
+    socket->data = trial;
 
-        /* Get current row of heat map */
-        guac_common_surface_heat_cell* heat_cell = heat_row;
+    /* Encode exactly the rectangle that would be sent using this format.
+     * The output is complete unless a write fails. */
+    trial->length = 0;
+    trial->valid = 1;
+    __guac_common_surface_image_rect(surface, rect, format, &trial->rect);
 
-        /* For each cell in subset of row */
-        for (x = min_x; x <= max_x; x++) {
+    /* Get Cairo surface for specified rect */
+    unsigned char* buffer = surface->buffer
+        + trial->rect.y * surface->stride + trial->rect.x * 4;
 
-            /* Replace oldest entry with new timestamp */
-            heat_cell->history[heat_cell->oldest_entry] = time;
+    cairo_surface_t* image = cairo_image_surface_create_for_data(buffer,
+            CAIRO_FORMAT_RGB24, trial->rect.width, trial->rect.height,
+            surface->stride);
 
-            /* Update to next oldest entry */
-            heat_cell->oldest_entry++;
-            if (heat_cell->oldest_entry >=
-                    GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE)
-                heat_cell->oldest_entry = 0;
+    uint64_t start = guac_timestamp_current_usec();
 
-            /* Advance to next heat map cell */
-            heat_cell++;
+    switch (format) {
 
-        }
+        case GUAC_CLIENT_IMAGE_PNG:
+            guac_client_stream_png(surface->client, socket,
+                    GUAC_COMP_OVER, surface->layer, trial->rect.x,
+                    trial->rect.y, image);
+            break;
 
-        /* Next heat map row */
-        heat_row += heat_width;
+        case GUAC_CLIENT_IMAGE_JPEG:
+            guac_client_stream_jpeg(surface->client, socket,
+                    GUAC_COMP_OVER, surface->layer, trial->rect.x,
+                    trial->rect.y, image,
+                    __guac_common_surface_lossy_quality(surface,
+                        GUAC_SURFACE_JPEG_IMAGE_QUALITY));
+            break;
+
+        case GUAC_CLIENT_IMAGE_WEBP:
+            guac_client_stream_webp(surface->client, socket,
+                    GUAC_COMP_OVER, surface->layer, trial->rect.x,
+                    trial->rect.y, image,
+                    __guac_common_surface_lossy_quality(surface,
+                        GUAC_SURFACE_WEBP_IMAGE_QUALITY), 0);
+            break;
 
     }
 
-}
+    if (guac_socket_flush(socket))
+        trial->valid = 0;
 
-/**
- * Flushes the bitmap update currently described by the dirty rectangle within the
- * given surface to that surface's bitmap queue. There MUST be space within the
- * queue.
- *
- * @param surface The surface to flush.
- */
-static void __guac_common_surface_flush_to_queue(guac_common_surface* surface) {
+    trial->time = guac_timestamp_current_usec() - start;
 
-    guac_common_surface_bitmap_rect* rect;
+    socket->data = NULL;
+    cairo_surface_destroy(image);
 
-    /* Do not flush if not dirty */
-    if (!surface->dirty)
+    /* Incomplete output can be neither measured nor sent */
+    if (!trial->valid)
         return;
 
-    /* Add new rect to queue */
-    rect = &(surface->bitmap_queue[surface->bitmap_queue_length++]);
-    rect->rect = surface->dirty_rect;
-    rect->flushed = 0;
-
-    /* Surface now flushed */
-    surface->dirty = 0;
+    surface->format_stats[format].trials++;
+    __guac_common_surface_record_cost(surface, &trial->rect, format,
+            trial->length, trial->time);
 
 }
 
-void guac_common_surface_flush_deferred(guac_common_surface* surface) {
-
-    /* Do not flush if not dirty */
-    if (!surface->dirty)
-        return;
+/**
+ * Calculates the expected cost of encoding the given rectangle of the given
+ * surface using the given format, based on past measurements within the heat
+ * map cells intersecting that rectangle. The cost is the product of the
+ * expected size and the expected encode time, such that formats which are
+ * both small and fast are preferred.
+ *
+ * @param surface The surface containing the heat map to query.
+ * @param rect The rectangle whose cost should be calculated.
+ * @param format The format whose cost should be calculated.
+ * @param cost Receives the expected cost, if known.
+ * @return Non-zero if the cost is known, zero if at least one intersecting
+ *         cell has not yet been measured using the given format.
+ */
+static int __guac_common_surface_expected_cost(guac_common_surface* surface,
+        const guac_common_rect* rect, guac_client_image_format format,
+        double* cost) {
+
+    int x, y;
+    int min_x, min_y, max_x, max_y;
+
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
+
+    double bytes = 0;
+    double time = 0;
+    int count = 0;
+
+    __guac_common_surface_heat_bounds(surface, rect,
+            &min_x, &min_y, &max_x, &max_y);
+
+    for (y = min_y; y <= max_y; y++) {
+
+        const guac_common_surface_heat_cell* heat_cell =
+            surface->heat_map + y * heat_width + min_x;
+
+        for (x = min_x; x <= max_x; x++) {
+
+            const guac_common_surface_format_cost* cell_cost =
+                &heat_cell->costs[format];
+
+            if (!cell_cost->measured)
+                return 0;
+
+            bytes += cell_cost->bytes;
+            time += cell_cost->time;
+            count++;
+            heat_cell++;
+
+        }
 
-    /* Flush if queue size has reached maximum (space is reserved for the final dirty rect,
-     * as guac_common_surface_flush() MAY add an additional rect to the queue */
-    if (surface->bitmap_queue_length == GUAC_COMMON_SURFACE_QUEUE_SIZE-1)
-        guac_common_surface_flush(surface);
+    }
 
-    /* Append dirty rect to queue */
-    __guac_common_surface_flush_to_queue(surface);
+    *cost = (bytes / count) * (time / count);
+    return 1;
 
 }
 
 /**
- * Transfers a single uint32_t using the given transfer function.
+ * Chooses the format which is expected to encode the given rectangle of the
+ * given surface most cheaply, trialling any formats which have not yet been
+ * measured for the region, or which have not been measured recently. Lossy
+ * formats are only considered for regions which are updated frequently
+ * enough that any loss of quality is unlikely to be noticed.
  *
- * @param op The transfer function to use.
- * @param src The source of the uint32_t value.
- * @param dst THe destination which will hold the result of the transfer.
- * @return Non-zero if the destination value was changed, zero otherwise.
+ * @param surface The surface containing the rectangle to be encoded.
+ * @param rect The rectangle to be encoded.
+ * @return The format that should be used to encode the given rectangle.
  */
-static int __guac_common_surface_transfer_int(guac_transfer_function op, uint32_t* src, uint32_t* dst) {
+static guac_client_image_format __guac_common_surface_choose_format(
+        guac_common_surface* surface, const guac_common_rect* rect) {
 
-    uint32_t orig = *dst;
+    guac_client_image_format candidates[GUAC_COMMON_SURFACE_FORMATS];
+    int candidate_count = 0;
 
-    switch (op) {
+    guac_client_image_format best;
+    int trial_due = 0;
+    int i, x, y;
+    int min_x, min_y, max_x, max_y;
 
-        case GUAC_TRANSFER_BINARY_BLACK:
-            *dst = 0xFF000000;
-            break;
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
 
-        case GUAC_TRANSFER_BINARY_WHITE:
-            *dst = 0xFFFFFFFF;
-            break;
+    /* Output of trials for any other rectangle must not be sent */
+    for (i = 0; i < GUAC_COMMON_SURFACE_FORMATS; i++)
+        surface->trials[i].valid = 0;
 
-        case GUAC_TRANSFER_BINARY_SRC:
-            *dst = *src;
-            break;
+    /* Lossy formats are only considered if the frame rate is high enough */
+    if (__guac_common_surface_calculate_framerate(surface, rect)
+            < __guac_common_surface_lossy_framerate(surface))
+        return GUAC_CLIENT_IMAGE_PNG;
 
-        case GUAC_TRANSFER_BINARY_DEST:
-            /* NOP */
-            break;
+    candidates[candidate_count++] = GUAC_CLIENT_IMAGE_PNG;
 
-        case GUAC_TRANSFER_BINARY_NSRC:
-            *dst = ~(*src);
-            break;
+    /* JPEG is only considered if large enough to be worth the compression
+     * tax */
+    if (rect->width * rect->height > GUAC_SURFACE_JPEG_MIN_BITMAP_SIZE)
+        candidates[candidate_count++] = GUAC_CLIENT_IMAGE_JPEG;
 
-        case GUAC_TRANSFER_BINARY_NDEST:
-            *dst = ~(*dst);
-            break;
+    /* WebP is only considered if supported */
+    if (guac_client_supports_webp(surface->client))
+        candidates[candidate_count++] = GUAC_CLIENT_IMAGE_WEBP;
 
-        case GUAC_TRANSFER_BINARY_AND:
-            *dst = (*dst) & (*src);
-            break;
+    /* Lossless is the only option if nothing else is viable */
+    if (candidate_count == 1)
+        return GUAC_CLIENT_IMAGE_PNG;
 
-        case GUAC_TRANSFER_BINARY_NAND:
-            *dst = ~((*dst) & (*src));
-            break;
+    /* Note whether any covered cell is due for a trial of all formats, while
+     * counting this choice */
+    __guac_common_surface_heat_bounds(surface, rect,
+            &min_x, &min_y, &max_x, &max_y);
 
-        case GUAC_TRANSFER_BINARY_OR:
-            *dst = (*dst) | (*src);
-            break;
+    for (y = min_y; y <= max_y; y++) {
 
-        case GUAC_TRANSFER_BINARY_NOR:
-            *dst = ~((*dst) | (*src));
-            break;
+        guac_common_surface_heat_cell* heat_cell =
+            surface->heat_map + y * heat_width + min_x;
 
-        case GUAC_TRANSFER_BINARY_XOR:
-            *dst = (*dst) ^ (*src);
-            break;
+        for (x = min_x; x <= max_x; x++) {
 
-        case GUAC_TRANSFER_BINARY_XNOR:
-            *dst = ~((*dst) ^ (*src));
-            break;
+            if (++heat_cell->choices_since_trial
+                    >= GUAC_SURFACE_TRIAL_INTERVAL) {
+                heat_cell->choices_since_trial = 0;
+                trial_due = 1;
+            }
 
-        case GUAC_TRANSFER_BINARY_NSRC_AND:
-            *dst = (*dst) & ~(*src);
-            break;
+            heat_cell++;
 
-        case GUAC_TRANSFER_BINARY_NSRC_NAND:
-            *dst = ~((*dst) & ~(*src));
-            break;
+        }
 
-        case GUAC_TRANSFER_BINARY_NSRC_OR:
-            *dst = (*dst) | ~(*src);
-            break;
+    }
 
-        case GUAC_TRANSFER_BINARY_NSRC_NOR:
-            *dst = ~((*dst) | ~(*src));
-            break;
+    /* Choose the candidate with the lowest expected cost, measuring any
+     * candidates not yet measured (or all candidates, if a trial is due) */
+    double best_cost = 0;
+    int best_known = 0;
+    best = GUAC_CLIENT_IMAGE_PNG;
+
+    for (i = 0; i < candidate_count; i++) {
+
+        double cost;
+
+        if (trial_due || !__guac_common_surface_expected_cost(surface, rect,
+                    candidates[i], &cost)) {
+
+            __guac_common_surface_trial_encode(surface, rect, candidates[i]);
+
+            /* Skip candidates which could not be measured */
+            if (!__guac_common_surface_expected_cost(surface, rect,
+                        candidates[i], &cost))
+                continue;
+
+        }
+
+        if (!best_known || cost < best_cost) {
+            best = candidates[i];
+            best_cost = cost;
+            best_known = 1;
+        }
 
     }
 
-    return *dst != orig;
+    /* Only the output of a trial of the chosen format may be sent */
+    for (i = 0; i < GUAC_COMMON_SURFACE_FORMATS; i++) {
+        if (i != best)
+            surface->trials[i].valid = 0;
+    }
+
+    return best;
 
 }
 
 /**
- * Draws a rectangle of solid color within the backing surface of the
- * given destination surface.
+ * Returns whether the given rectangle of the given surface, which should be
+ * the intersection of a dirty rectangle with a single heat map cell, appears
+ * to contain photographic or video content that may be sent using a lossy
+ * format. Content which is rarely updated, contains few colors, or contains
+ * a moderate number of colors with many hard edges (such as antialiased
+ * text) is considered unsuitable for lossy compression.
  *
- * @param dst The destination surface.
- * @param rect The rectangle to draw.
- * @param red The red component of the color of the rectangle.
- * @param green The green component of the color of the rectangle.
- * @param blue The blue component of the color of the rectangle.
+ * @param surface The surface containing the content to classify.
+ * @param tile The rectangle to classify.
+ * @return Non-zero if the content may be sent using a lossy format, zero
+ *         if it should be sent losslessly.
  */
-static void __guac_common_surface_rect(guac_common_surface* dst, guac_common_rect* rect,
-                                       int red, int green, int blue) {
+static int __guac_common_surface_tile_is_lossy(guac_common_surface* surface,
+        const guac_common_rect* tile) {
 
+    uint32_t colors[GUAC_SURFACE_TILE_COLOR_SLOTS];
+    int color_count = 0;
+    int edge_count = 0;
     int x, y;
 
-    int dst_stride;
-    unsigned char* dst_buffer;
+    /* Rarely-updated content gains little from lossy compression */
+    if (__guac_common_surface_calculate_framerate(surface, tile)
+            < __guac_common_surface_lossy_framerate(surface))
+        return 0;
 
-    uint32_t color = 0xFF000000 | (red << 16) | (green << 8) | blue;
+    /* Slots are empty if zero, as colors are stored with full alpha */
+    memset(colors, 0, sizeof(colors));
 
-    int min_x = rect->width - 1;
-    int min_y = rect->height - 1;
-    int max_x = 0;
-    int max_y = 0;
+    unsigned char* buffer = surface->buffer
+        + tile->y * surface->stride + tile->x * 4;
 
-    dst_stride = dst->stride;
-    dst_buffer = dst->buffer + (dst_stride * rect->y) + (4 * rect->x);
+    for (y = 0; y < tile->height; y++) {
 
-    /* For each row */
-    for (y=0; y < rect->height; y++) {
+        uint32_t* row = (uint32_t*) buffer;
+        uint32_t last_color = 0;
+
+        for (x = 0; x < tile->width; x++) {
+
+            uint32_t color = row[x] | 0xFF000000;
+
+            /* Only new runs of color need be considered */
+            if (color == last_color)
+                continue;
+
+            /* Count hard edges between adjacent pixels */
+            if (x > 0) {
+                uint32_t a = color, b = last_color;
+                int i;
+                for (i = 0; i < 3; i++, a >>= 8, b >>= 8) {
+                    int delta = (int) (a & 0xFF) - (int) (b & 0xFF);
+                    if (delta >= GUAC_SURFACE_TILE_EDGE_CONTRAST
+                            || -delta >= GUAC_SURFACE_TILE_EDGE_CONTRAST) {
+                        edge_count++;
+                        break;
+                    }
+                }
+            }
 
-        uint32_t* dst_current = (uint32_t*) dst_buffer;
+            /* Count distinct colors, using the upper bits of the product as
+             * only these depend on every bit of the color */
+            int slot = (uint32_t) (color * GUAC_SURFACE_MOTION_HASH_PRIME)
+                >> (32 - GUAC_SURFACE_TILE_COLOR_BITS);
 
-        /* Set row */
-        for (x=0; x < rect->width; x++) {
+            while (colors[slot] != 0 && colors[slot] != color)
+                slot = (slot + 1) & (GUAC_SURFACE_TILE_COLOR_SLOTS - 1);
 
-            uint32_t old_color = *dst_current;
+            if (colors[slot] == 0) {
+
+                /* Very many colors indicate photographic content, even if
+                 * noisy */
+                if (++color_count > GUAC_SURFACE_TILE_MAX_COLORS)
+                    return 1;
+
+                colors[slot] = color;
 
-            if (old_color != color) {
-                if (x < min_x) min_x = x;
-                if (y < min_y) min_y = y;
-                if (x > max_x) max_x = x;
-                if (y > max_y) max_y = y;
-                *dst_current = color;
             }
 
-            dst_current++;
+            last_color = color;
+
         }
 
-        /* Next row */
-        dst_buffer += dst_stride;
+        buffer += surface->stride;
 
     }
 
-    /* Restrict destination rect to only updated pixels */
-    if (max_x >= min_x && max_y >= min_y) {
-        rect->x += min_x;
-        rect->y += min_y;
-        rect->width = max_x - min_x + 1;
-        rect->height = max_y - min_y + 1;
-    }
-    else {
-        rect->width = 0;
-        rect->height = 0;
-    }
+    /* Few colors, or a moderate number of colors with many hard edges,
+     * indicate synthetic content like text */
+    return color_count > GUAC_SURFACE_TILE_FEW_COLORS
+        && edge_count * GUAC_SURFACE_TILE_EDGE_RATIO
+            < tile->width * tile->height;
 
 }
 
 /**
- * Copies data from the given buffer to the surface at the given coordinates.
- * The dimensions and location of the destination rectangle will be altered
- * to remove as many unchanged pixels as possible.
+ * Updates whether the remote display may contain lossy content within the
+ * heat map cells covered by the given rectangle. Cells are marked as lossy if
+ * they intersect the rectangle at all, but are only marked as lossless if the
+ * rectangle covers the entire cell.
  *
- * @param src_buffer The buffer to copy.
- * @param src_stride The number of bytes in each row of the source buffer.
- * @param sx The X coordinate of the source rectangle.
- * @param sy The Y coordinate of the source rectangle.
- * @param dst The destination surface.
- * @param rect The destination rectangle.
- * @param opaque Non-zero if the source surface is opaque (its alpha channel
- *               should be ignored), zero otherwise.
+ * @param surface The surface containing the heat map to update.
+ * @param rect The rectangle whose cells should be updated.
+ * @param lossy Non-zero if the given rectangle was sent using a lossy
+ *              format, zero if it was sent losslessly.
  */
-static void __guac_common_surface_put(unsigned char* src_buffer, int src_stride,
-                                      int* sx, int* sy,
-                                      guac_common_surface* dst, guac_common_rect* rect,
-                                      int opaque) {
-
-    unsigned char* dst_buffer = dst->buffer;
-    int dst_stride = dst->stride;
+static void __guac_common_surface_set_lossy(guac_common_surface* surface,
+        const guac_common_rect* rect, int lossy) {
 
     int x, y;
+    int min_x, min_y, max_x, max_y;
 
-    int min_x = rect->width;
-    int min_y = rect->height;
-    int max_x = 0;
-    int max_y = 0;
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
 
-    int orig_x = rect->x;
-    int orig_y = rect->y;
+    if (rect->width <= 0 || rect->height <= 0)
+        return;
 
-    src_buffer += src_stride * (*sy) + 4 * (*sx);
-    dst_buffer += (dst_stride * rect->y) + (4 * rect->x);
+    __guac_common_surface_heat_bounds(surface, rect,
+            &min_x, &min_y, &max_x, &max_y);
 
-    /* For each row */
-    for (y=0; y < rect->height; y++) {
+    for (y = min_y; y <= max_y; y++) {
 
-        uint32_t* src_current = (uint32_t*) src_buffer;
-        uint32_t* dst_current = (uint32_t*) dst_buffer;
+        guac_common_surface_heat_cell* heat_cell =
+            surface->heat_map + y * heat_width + min_x;
 
-        /* Copy row */
-        for (x=0; x < rect->width; x++) {
+        for (x = min_x; x <= max_x; x++, heat_cell++) {
 
-            if (opaque || (*src_current & 0xFF000000)) {
+            /* Lossless updates only replace lossy content entirely if the
+             * whole cell is covered */
+            if (!lossy) {
 
-                uint32_t new_color = *src_current | 0xFF000000;
-                uint32_t old_color = *dst_current;
+                guac_common_rect cell;
+                guac_common_rect_init(&cell,
+                        x * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                        y * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                        GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                        GUAC_COMMON_SURFACE_HEAT_CELL_SIZE);
 
-                if (old_color != new_color) {
-                    if (x < min_x) min_x = x;
-                    if (y < min_y) min_y = y;
-                    if (x > max_x) max_x = x;
-                    if (y > max_y) max_y = y;
-                    *dst_current = new_color;
-                }
-            }
+                /* Cells along the edges of the surface are partial */
+                guac_common_rect bounds;
+                guac_common_rect_init(&bounds, 0, 0,
+                        surface->width, surface->height);
+                guac_common_rect_constrain(&cell, &bounds);
 
-            src_current++;
-            dst_current++;
-        }
+                if (cell.x < rect->x || cell.y < rect->y
+                        || cell.x + cell.width > rect->x + rect->width
+                        || cell.y + cell.height > rect->y + rect->height)
+                    continue;
 
-        /* Next row */
-        src_buffer += src_stride;
-        dst_buffer += dst_stride;
+            }
 
-    }
+            heat_cell->lossy = lossy;
 
-    /* Restrict destination rect to only updated pixels */
-    if (max_x >= min_x && max_y >= min_y) {
-        rect->x += min_x;
-        rect->y += min_y;
-        rect->width = max_x - min_x + 1;
-        rect->height = max_y - min_y + 1;
-    }
-    else {
-        rect->width = 0;
-        rect->height = 0;
-    }
+        }
 
-    /* Update source X/Y */
-    *sx += rect->x - orig_x;
-    *sy += rect->y - orig_y;
+    }
 
 }
 
 /**
- * Fills the given surface with color, using the given buffer as a mask. Color
- * will be added to the given surface iff the corresponding pixel within the
- * buffer is opaque.
+ * Returns whether the remote display may contain lossy content within any
+ * heat map cell intersecting the given rectangle.
  *
- * @param src_buffer The buffer to use as a mask.
- * @param src_stride The number of bytes in each row of the source buffer.
- * @param sx The X coordinate of the source rectangle.
- * @param sy The Y coordinate of the source rectangle.
- * @param dst The destination surface.
- * @param rect The destination rectangle.
- * @param red The red component of the color of the fill.
- * @param green The green component of the color of the fill.
- * @param blue The blue component of the color of the fill.
+ * @param surface The surface containing the heat map to query.
+ * @param rect The rectangle to check.
+ * @return Non-zero if any intersecting cell may contain lossy content, zero
+ *         otherwise.
  */
-static void __guac_common_surface_fill_mask(unsigned char* src_buffer, int src_stride,
-                                            int sx, int sy,
-                                            guac_common_surface* dst, guac_common_rect* rect,
-                                            int red, int green, int blue) {
-
-    unsigned char* dst_buffer = dst->buffer;
-    int dst_stride = dst->stride;
+static int __guac_common_surface_is_lossy(guac_common_surface* surface,
+        const guac_common_rect* rect) {
 
-    uint32_t color = 0xFF000000 | (red << 16) | (green << 8) | blue;
     int x, y;
+    int min_x, min_y, max_x, max_y;
 
-    src_buffer += src_stride*sy + 4*sx;
-    dst_buffer += (dst_stride * rect->y) + (4 * rect->x);
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
 
-    /* For each row */
-    for (y=0; y < rect->height; y++) {
+    if (rect->width <= 0 || rect->height <= 0)
+        return 0;
 
-        uint32_t* src_current = (uint32_t*) src_buffer;
-        uint32_t* dst_current = (uint32_t*) dst_buffer;
+    __guac_common_surface_heat_bounds(surface, rect,
+            &min_x, &min_y, &max_x, &max_y);
 
-        /* Stencil row */
-        for (x=0; x < rect->width; x++) {
+    for (y = min_y; y <= max_y; y++) {
 
-            /* Fill with color if opaque */
-            if (*src_current & 0xFF000000)
-                *dst_current = color;
+        const guac_common_surface_heat_cell* heat_cell =
+            surface->heat_map + y * heat_width + min_x;
 
-            src_current++;
-            dst_current++;
+        for (x = min_x; x <= max_x; x++, heat_cell++) {
+            if (heat_cell->lossy)
+                return 1;
         }
 
-        /* Next row */
-        src_buffer += src_stride;
-        dst_buffer += dst_stride;
-
     }
 
+    return 0;
+
 }
 
 /**
- * Copies data from the given surface to the given destination surface using
- * the specified transfer function.
+ * Returns whether the heat map cell at the given column and row lies within
+ * the region of the given surface currently streamed as video.
+ *
+ * @param surface The surface to check.
+ * @param x The column of the heat map cell.
+ * @param y The row of the heat map cell.
+ * @return Non-zero if the cell lies within the video region, zero
+ *         otherwise or if no video is being streamed.
+ */
+static int __guac_common_surface_cell_in_video(guac_common_surface* surface,
+        int x, int y) {
+
+    const guac_common_rect* video_rect = &surface->video_rect;
+
+    if (surface->video == NULL)
+        return 0;
+
+    /* The video region is always aligned with heat map cells */
+    return x * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE >= video_rect->x
+        && y * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE >= video_rect->y
+        && x * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE
+            < video_rect->x + video_rect->width
+        && y * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE
+            < video_rect->y + video_rect->height;
+
+}
+
+/**
+ * Returns whether the given heat map cell is currently being updated often
+ * enough for it to be streamed as video.
+ *
+ * @param heat_cell The heat map cell to check.
+ * @param now The current time.
+ * @return Non-zero if the cell is being updated often enough for video,
+ *         zero otherwise.
+ */
+static int __guac_common_surface_cell_is_hot(
+        const guac_common_surface_heat_cell* heat_cell, guac_timestamp now) {
+
+    return now - __guac_common_surface_cell_latest(heat_cell)
+            < GUAC_SURFACE_VIDEO_TIMEOUT
+        && __guac_common_surface_cell_framerate(heat_cell)
+            >= GUAC_SURFACE_VIDEO_FRAMERATE;
+
+}
+
+/**
+ * Searches the heat map of the given surface for a region updated often
+ * enough to be streamed as video. The region found is the bounding box of all
+ * frequently-updated cells, and is only suitable if large enough and if most
+ * of the cells within it are frequently updated.
+ *
+ * @param surface The surface to search.
+ * @param now The current time.
+ * @param rect Receives the region found, aligned with heat map cells.
+ * @return Non-zero if a region suitable for video was found, zero
+ *         otherwise.
+ */
+static int __guac_common_surface_find_video(guac_common_surface* surface,
+        guac_timestamp now, guac_common_rect* rect) {
+
+    int x, y;
+
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
+    int heat_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->height);
+
+    int min_x = heat_width, min_y = heat_height;
+    int max_x = -1, max_y = -1;
+    int hot = 0;
+
+    /* Find bounds of all frequently-updated cells */
+    for (y = 0; y < heat_height; y++) {
+
+        const guac_common_surface_heat_cell* heat_cell =
+            surface->heat_map + y * heat_width;
+
+        for (x = 0; x < heat_width; x++, heat_cell++) {
+
+            if (!__guac_common_surface_cell_is_hot(heat_cell, now))
+                continue;
+
+            if (x < min_x) min_x = x;
+            if (y < min_y) min_y = y;
+            if (x > max_x) max_x = x;
+            if (y > max_y) max_y = y;
+            hot++;
+
+        }
+
+    }
+
+    if (hot == 0)
+        return 0;
+
+    /* Most cells within the region must be hot */
+    if (hot * GUAC_SURFACE_VIDEO_DENSITY
+            < (max_x - min_x + 1) * (max_y - min_y + 1))
+        return 0;
+
+    guac_common_rect bounds;
+    guac_common_rect_init(&bounds, 0, 0, surface->width, surface->height);
+
+    guac_common_rect_init(rect,
+            min_x * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+            min_y * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+            (max_x - min_x + 1) * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+            (max_y - min_y + 1) * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE);
+    guac_common_rect_constrain(rect, &bounds);
+
+    return rect->width * rect->height >= GUAC_SURFACE_VIDEO_MIN_AREA;
+
+}
+
+/**
+ * Begins streaming the given region of the given surface as video on a new
+ * layer positioned over that region. If video cannot be streamed, this
+ * function has no effect.
+ *
+ * @param surface The surface to stream video from.
+ * @param rect The region to stream, which must be aligned with heat map
+ *             cells.
+ */
+static void __guac_common_surface_start_video(guac_common_surface* surface,
+        const guac_common_rect* rect) {
+
+    guac_layer* layer = guac_client_alloc_layer(surface->client);
+
+    /* Position video layer over region */
+    guac_protocol_send_size(surface->socket, layer,
+            rect->width, rect->height);
+    guac_protocol_send_move(surface->socket, layer, surface->layer,
+            rect->x, rect->y, 0);
+
+    guac_video_stream* video = guac_video_stream_alloc(surface->client,
+            surface->socket, layer, rect->width, rect->height);
+
+    if (video == NULL) {
+        guac_protocol_send_dispose(surface->socket, layer);
+        guac_client_free_layer(surface->client, layer);
+        return;
+    }
+
+    surface->video = video;
+    surface->video_layer = layer;
+    surface->video_rect = *rect;
+
+    /* The first frame must contain the entire region */
+    __guac_common_mark_dirty(surface, rect);
+
+    guac_client_log(surface->client, GUAC_LOG_DEBUG, "Streaming %ix%i "
+            "region at (%i, %i) as video.", rect->width, rect->height,
+            rect->x, rect->y);
+
+}
+
+/**
+ * Stops streaming video from the given surface, if any, marking the region
+ * covered by the video as dirty such that it will be sent as images by the
+ * next flush. As the video layer is removed within the same frame as that
+ * flush, the stale content beneath it is never displayed.
+ *
+ * @param surface The surface to stop streaming video from.
+ */
+static void __guac_common_surface_stop_video(guac_common_surface* surface) {
+
+    if (surface->video == NULL)
+        return;
+
+    guac_video_stream_free(surface->video);
+    guac_protocol_send_dispose(surface->socket, surface->video_layer);
+    guac_client_free_layer(surface->client, surface->video_layer);
+
+    surface->video = NULL;
+    surface->video_layer = NULL;
+    surface->video_candidate_flushes = 0;
+
+    __guac_common_mark_dirty(surface, &surface->video_rect);
+
+}
+
+/**
+ * Starts or stops streaming video from the given surface depending on which
+ * of its regions, if any, are being updated frequently. Video is only
+ * started once the same region has been consistently updated frequently, and
+ * is stopped as soon as that region stops being updated frequently.
+ *
+ * @param surface The surface to update.
+ */
+static void __guac_common_surface_update_video(guac_common_surface* surface) {
+
+    guac_common_rect rect;
+    guac_timestamp now = guac_timestamp_current();
+
+    /* Stop video once the region is no longer frequently updated */
+    if (surface->video != NULL) {
+
+        if (!__guac_common_surface_find_video(surface, now, &rect)
+                || guac_common_rect_intersects(&rect, &surface->video_rect) != 2)
+            __guac_common_surface_stop_video(surface);
+
+        return;
+
+    }
+
+    /* Video can only be played on visible layers of clients which support
+     * it */
+    if (surface->layer->index < 0
+            || !guac_client_supports_video(surface->client))
+        return;
+
+    /* Wait for the same region to be found consistently */
+    if (!__guac_common_surface_find_video(surface, now, &rect)) {
+        surface->video_candidate_flushes = 0;
+        return;
+    }
+
+    if (surface->video_candidate_flushes == 0
+            || memcmp(&rect, &surface->video_candidate, sizeof(rect)) != 0) {
+        surface->video_candidate = rect;
+        surface->video_candidate_flushes = 1;
+        return;
+    }
+
+    if (++surface->video_candidate_flushes >= GUAC_SURFACE_VIDEO_MIN_FLUSHES)
+        __guac_common_surface_start_video(surface, &rect);
+
+}
+
+/**
+ * Sends the current contents of the region of the given surface streamed as
+ * video as the next frame of that video, if that region has changed since the
+ * last frame. If the frame cannot be sent, video is stopped.
+ *
+ * @param surface The surface to send a frame of video from.
+ */
+static void __guac_common_surface_flush_video(guac_common_surface* surface) {
+
+    const guac_common_rect* rect = &surface->video_rect;
+
+    if (surface->video == NULL || !surface->video_dirty)
+        return;
+
+    unsigned char* buffer = surface->buffer
+        + rect->y * surface->stride + rect->x * 4;
+
+    cairo_surface_t* frame = cairo_image_surface_create_for_data(buffer,
+            CAIRO_FORMAT_RGB24, rect->width, rect->height, surface->stride);
+
+    if (guac_video_stream_write(surface->video, frame)) {
+        guac_client_log(surface->client, GUAC_LOG_DEBUG, "Unable to encode "
+                "frame of video. Falling back to images.");
+        __guac_common_surface_stop_video(surface);
+    }
+
+    cairo_surface_destroy(frame);
+    surface->video_dirty = 0;
+
+}
+
+/**
+ * Updates the heat map cells which intersect the given rectangle using the
+ * given timestamp. This timestamp, along with timestamps from past updates,
+ * is used to calculate the framerate of each heat cell.
+ *
+ * @param surface
+ *     The surface containing the heat map cells to be updated.
+ *
+ * @param rect
+ *     The rectangle containing the heat map cells to be updated.
+ *
+ * @param time
+ *     The timestamp to use when updating the heat map cells which intersect
+ *     the given rectangle.
+ */
+static void __guac_common_surface_touch_rect(guac_common_surface* surface,
+        guac_common_rect* rect, guac_timestamp time) {
+
+    int x, y;
+    int min_x, min_y, max_x, max_y;
+
+    /* Calculate heat map dimensions */
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
+
+    /* Calculate X/Y coordinates of cells intersecting given rect */
+    __guac_common_surface_heat_bounds(surface, rect,
+            &min_x, &min_y, &max_x, &max_y);
+
+    /* Get start of buffer at given coordinates */
+    guac_common_surface_heat_cell* heat_row =
+        surface->heat_map + min_y * heat_width + min_x;
+
+    /* Update all heat map cells which intersect with rectangle */
+    for (y = min_y; y <= max_y; y++) {
+
+        /* Get current row of heat map */
+        guac_common_surface_heat_cell* heat_cell = heat_row;
+
+        /* For each cell in subset of row */
+        for (x = min_x; x <= max_x; x++) {
+
+            /* Replace oldest entry with new timestamp */
+            heat_cell->history[heat_cell->oldest_entry] = time;
+
+            /* Update to next oldest entry */
+            heat_cell->oldest_entry++;
+            if (heat_cell->oldest_entry >=
+                    GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE)
+                heat_cell->oldest_entry = 0;
+
+            /* Advance to next heat map cell */
+            heat_cell++;
+
+        }
+
+        /* Next heat map row */
+        heat_row += heat_width;
+
+    }
+
+}
+
+/**
+ * Transfers a single uint32_t using the given transfer function.
  *
- * @param src_buffer The buffer to copy.
- * @param src_stride The number of bytes in each row of the source buffer.
- * @param sx The X coordinate of the source rectangle.
- * @param sy The Y coordinate of the source rectangle.
  * @param op The transfer function to use.
- * @param dst The destination surface.
- * @param rect The destination rectangle.
+ * @param src The source of the uint32_t value.
+ * @param dst THe destination which will hold the result of the transfer.
+ * @return Non-zero if the destination value was changed, zero otherwise.
  */
-static void __guac_common_surface_transfer(guac_common_surface* src, int* sx, int* sy,
-                                           guac_transfer_function op,
-                                           guac_common_surface* dst, guac_common_rect* rect) {
+static int __guac_common_surface_transfer_int(guac_transfer_function op, uint32_t* src, uint32_t* dst) {
+
+    uint32_t orig = *dst;
+
+    switch (op) {
+
+        case GUAC_TRANSFER_BINARY_BLACK:
+            *dst = 0xFF000000;
+            break;
+
+        case GUAC_TRANSFER_BINARY_WHITE:
+            *dst = 0xFFFFFFFF;
+            break;
+
+        case GUAC_TRANSFER_BINARY_SRC:
+            *dst = *src;
+            break;
+
+        case GUAC_TRANSFER_BINARY_DEST:
+            /* NOP */
+            break;
+
+        case GUAC_TRANSFER_BINARY_NSRC:
+            *dst = ~(*src);
+            break;
+
+        case GUAC_TRANSFER_BINARY_NDEST:
+            *dst = ~(*dst);
+            break;
+
+        case GUAC_TRANSFER_BINARY_AND:
+            *dst = (*dst) & (*src);
+            break;
+
+        case GUAC_TRANSFER_BINARY_NAND:
+            *dst = ~((*dst) & (*src));
+            break;
+
+        case GUAC_TRANSFER_BINARY_OR:
+            *dst = (*dst) | (*src);
+            break;
+
+        case GUAC_TRANSFER_BINARY_NOR:
+            *dst = ~((*dst) | (*src));
+            break;
+
+        case GUAC_TRANSFER_BINARY_XOR:
+            *dst = (*dst) ^ (*src);
+            break;
+
+        case GUAC_TRANSFER_BINARY_XNOR:
+            *dst = ~((*dst) ^ (*src));
+            break;
+
+        case GUAC_TRANSFER_BINARY_NSRC_AND:
+            *dst = (*dst) & ~(*src);
+            break;
+
+        case GUAC_TRANSFER_BINARY_NSRC_NAND:
+            *dst = ~((*dst) & ~(*src));
+            break;
+
+        case GUAC_TRANSFER_BINARY_NSRC_OR:
+            *dst = (*dst) | ~(*src);
+            break;
+
+        case GUAC_TRANSFER_BINARY_NSRC_NOR:
+            *dst = ~((*dst) | ~(*src));
+            break;
+
+    }
+
+    return *dst != orig;
+
+}
+
+/**
+ * Draws a rectangle of solid color within the backing surface of the
+ * given destination surface.
+ *
+ * @param dst The destination surface.
+ * @param rect The rectangle to draw.
+ * @param red The red component of the color of the rectangle.
+ * @param green The green component of the color of the rectangle.
+ * @param blue The blue component of the color of the rectangle.
+ */
+static void __guac_common_surface_rect(guac_common_surface* dst, guac_common_rect* rect,
+                                       int red, int green, int blue) {
+
+    int y;
+
+    int dst_stride;
+    unsigned char* dst_buffer;
+
+    uint32_t color = 0xFF000000 | (red << 16) | (green << 8) | blue;
+
+    int min_x = rect->width - 1;
+    int min_y = rect->height - 1;
+    int max_x = 0;
+    int max_y = 0;
+
+    dst_stride = dst->stride;
+    dst_buffer = dst->buffer + (dst_stride * rect->y) + (4 * rect->x);
+
+    /* For each row */
+    for (y=0; y < rect->height; y++) {
+
+        int first, last;
+
+        /* Set row, noting which pixels changed */
+        if (guac_common_surface_row_fill((uint32_t*) dst_buffer, color,
+                    rect->width, &first, &last)) {
+            if (first < min_x) min_x = first;
+            if (y < min_y) min_y = y;
+            if (last > max_x) max_x = last;
+            if (y > max_y) max_y = y;
+        }
+
+        /* Next row */
+        dst_buffer += dst_stride;
+
+    }
+
+    /* Restrict destination rect to only updated pixels */
+    if (max_x >= min_x && max_y >= min_y) {
+        rect->x += min_x;
+        rect->y += min_y;
+        rect->width = max_x - min_x + 1;
+        rect->height = max_y - min_y + 1;
+    }
+    else {
+        rect->width = 0;
+        rect->height = 0;
+    }
+
+}
+
+/**
+ * Copies data from the given buffer to the surface at the given coordinates.
+ * The dimensions and location of the destination rectangle will be altered
+ * to remove as many unchanged pixels as possible.
+ *
+ * @param src_buffer The buffer to copy.
+ * @param src_stride The number of bytes in each row of the source buffer.
+ * @param sx The X coordinate of the source rectangle.
+ * @param sy The Y coordinate of the source rectangle.
+ * @param dst The destination surface.
+ * @param rect The destination rectangle.
+ * @param opaque Non-zero if the source surface is opaque (its alpha channel
+ *               should be ignored), zero otherwise.
+ */
+static void __guac_common_surface_put(unsigned char* src_buffer, int src_stride,
+                                      int* sx, int* sy,
+                                      guac_common_surface* dst, guac_common_rect* rect,
+                                      int opaque) {
+
+    unsigned char* dst_buffer = dst->buffer;
+    int dst_stride = dst->stride;
+
+    int y;
+
+    int min_x = rect->width;
+    int min_y = rect->height;
+    int max_x = 0;
+    int max_y = 0;
+
+    int orig_x = rect->x;
+    int orig_y = rect->y;
+
+    src_buffer += src_stride * (*sy) + 4 * (*sx);
+    dst_buffer += (dst_stride * rect->y) + (4 * rect->x);
+
+    /* For each row */
+    for (y=0; y < rect->height; y++) {
+
+        int first, last;
+
+        /* Copy row, noting which pixels changed */
+        if (guac_common_surface_row_put((uint32_t*) dst_buffer,
+                    (uint32_t*) src_buffer, rect->width, opaque,
+                    &first, &last)) {
+            if (first < min_x) min_x = first;
+            if (y < min_y) min_y = y;
+            if (last > max_x) max_x = last;
+            if (y > max_y) max_y = y;
+        }
+
+        /* Next row */
+        src_buffer += src_stride;
+        dst_buffer += dst_stride;
+
+    }
+
+    /* Restrict destination rect to only updated pixels */
+    if (max_x >= min_x && max_y >= min_y) {
+        rect->x += min_x;
+        rect->y += min_y;
+        rect->width = max_x - min_x + 1;
+        rect->height = max_y - min_y + 1;
+    }
+    else {
+        rect->width = 0;
+        rect->height = 0;
+    }
+
+    /* Update source X/Y */
+    *sx += rect->x - orig_x;
+    *sy += rect->y - orig_y;
+
+}
+
+/**
+ * Fills the given surface with color, using the given buffer as a mask. Color
+ * will be added to the given surface iff the corresponding pixel within the
+ * buffer is opaque.
+ *
+ * @param src_buffer The buffer to use as a mask.
+ * @param src_stride The number of bytes in each row of the source buffer.
+ * @param sx The X coordinate of the source rectangle.
+ * @param sy The Y coordinate of the source rectangle.
+ * @param dst The destination surface.
+ * @param rect The destination rectangle.
+ * @param red The red component of the color of the fill.
+ * @param green The green component of the color of the fill.
+ * @param blue The blue component of the color of the fill.
+ */
+static void __guac_common_surface_fill_mask(unsigned char* src_buffer, int src_stride,
+                                            int sx, int sy,
+                                            guac_common_surface* dst, guac_common_rect* rect,
+                                            int red, int green, int blue) {
+
+    unsigned char* dst_buffer = dst->buffer;
+    int dst_stride = dst->stride;
+
+    uint32_t color = 0xFF000000 | (red << 16) | (green << 8) | blue;
+    int x, y;
+
+    src_buffer += src_stride*sy + 4*sx;
+    dst_buffer += (dst_stride * rect->y) + (4 * rect->x);
+
+    /* For each row */
+    for (y=0; y < rect->height; y++) {
+
+        uint32_t* src_current = (uint32_t*) src_buffer;
+        uint32_t* dst_current = (uint32_t*) dst_buffer;
+
+        /* Stencil row */
+        for (x=0; x < rect->width; x++) {
+
+            /* Fill with color if opaque */
+            if (*src_current & 0xFF000000)
+                *dst_current = color;
+
+            src_current++;
+            dst_current++;
+        }
+
+        /* Next row */
+        src_buffer += src_stride;
+        dst_buffer += dst_stride;
+
+    }
+
+}
+
+/**
+ * Copies data from the given surface to the given destination surface using
+ * the specified transfer function.
+ *
+ * @param src_buffer The buffer to copy.
+ * @param src_stride The number of bytes in each row of the source buffer.
+ * @param sx The X coordinate of the source rectangle.
+ * @param sy The Y coordinate of the source rectangle.
+ * @param op The transfer function to use.
+ * @param dst The destination surface.
+ * @param rect The destination rectangle.
+ */
+static void __guac_common_surface_transfer(guac_common_surface* src, int* sx, int* sy,
+                                           guac_transfer_function op,
+                                           guac_common_surface* dst, guac_common_rect* rect) {
+
+    int x, y;
+    int row_step = 1;
+    int backwards = 0;
+
+    int min_x = rect->width - 1;
+    int min_y = rect->height - 1;
+    int max_x = 0;
+    int max_y = 0;
+
+    int orig_x = rect->x;
+    int orig_y = rect->y;
+
+    if (src == dst) {
+
+        /* Copy rows backwards if destination is below source */
+        if (rect->y > *sy)
+            row_step = -1;
+
+        /* Copy pixels backwards if destination follows source in same rows */
+        else if (rect->y == *sy && rect->x > *sx)
+            backwards = 1;
+
+    }
+
+    /* For each row */
+    for (y = (row_step > 0) ? 0 : rect->height - 1;
+            y >= 0 && y < rect->height; y += row_step) {
+
+        uint32_t* src_row = (uint32_t*) (src->buffer
+                + src->stride * (*sy + y) + 4 * (*sx));
+
+        uint32_t* dst_row = (uint32_t*) (dst->buffer
+                + dst->stride * (rect->y + y) + 4 * rect->x);
+
+        int first = -1;
+        int last = -1;
+
+        /* Transfer overlapping pixels last to first */
+        if (backwards) {
+            for (x = rect->width - 1; x >= 0; x--) {
+                if (__guac_common_surface_transfer_int(op, &src_row[x], &dst_row[x])) {
+                    if (last < 0) last = x;
+                    first = x;
+                }
+            }
+        }
+
+        /* Transfer all other pixels first to last */
+        else
+            guac_common_surface_row_transfer(dst_row, src_row, rect->width,
+                    op, &first, &last);
+
+        /* Update bounds of changed pixels */
+        if (first >= 0) {
+            if (first < min_x) min_x = first;
+            if (y < min_y) min_y = y;
+            if (last > max_x) max_x = last;
+            if (y > max_y) max_y = y;
+        }
+
+    }
+
+    /* Restrict destination rect to only updated pixels */
+    if (max_x >= min_x && max_y >= min_y) {
+        rect->x += min_x;
+        rect->y += min_y;
+        rect->width = max_x - min_x + 1;
+        rect->height = max_y - min_y + 1;
+    }
+    else {
+        rect->width = 0;
+        rect->height = 0;
+    }
+
+    /* Update source X/Y */
+    *sx += rect->x - orig_x;
+    *sy += rect->y - orig_y;
+
+}
+
+/**
+ * Hashes each row of the given rectangle of opaque image data, ignoring the
+ * alpha channel. Only GUAC_SURFACE_MOTION_STRIPS evenly-spaced strips of
+ * pixels within each row contribute to its hash. Rows whose sampled pixels
+ * are all the same color are additionally flagged as uniform, as such rows
+ * match at nearly any offset and are useless for detecting motion.
+ *
+ * @param buffer The buffer containing the upper-left pixel of the rectangle.
+ * @param stride The number of bytes in each row of the buffer.
+ * @param width The width of the rectangle, in pixels, which must be at least
+ *              GUAC_SURFACE_MOTION_STRIP_WIDTH.
+ * @param height The height of the rectangle, in pixels.
+ * @param hashes Storage for one hash per row of the rectangle.
+ * @param uniform Storage for one uniformity flag per row.
+ */
+static void __guac_common_surface_hash_rows(const unsigned char* buffer,
+        int stride, int width, int height, uint32_t* hashes,
+        unsigned char* uniform) {
+
+    int strips[GUAC_SURFACE_MOTION_STRIPS];
+    int i, x, y;
+
+    /* Space strips evenly, with the first and last at the row edges */
+    for (i=0; i < GUAC_SURFACE_MOTION_STRIPS; i++)
+        strips[i] = (width - GUAC_SURFACE_MOTION_STRIP_WIDTH) * i
+                  / (GUAC_SURFACE_MOTION_STRIPS - 1);
+
+    /* For each row */
+    for (y=0; y < height; y++) {
+
+        const uint32_t* current = (const uint32_t*) buffer;
+        uint32_t row_color = current[0] | 0xFF000000;
+        uint32_t difference = 0;
+        uint32_t hash = GUAC_SURFACE_MOTION_HASH_BASIS;
+
+        /* Hash each strip independently, combining the results */
+        for (i=0; i < GUAC_SURFACE_MOTION_STRIPS; i++) {
+
+            const uint32_t* strip = current + strips[i];
+            uint32_t strip_hash = 0;
+
+            /* Weight each pixel by its position, such that pixels can be
+             * hashed independently of each other */
+            for (x=0; x < GUAC_SURFACE_MOTION_STRIP_WIDTH; x++) {
+                uint32_t color = strip[x] | 0xFF000000;
+                strip_hash += color * (GUAC_SURFACE_MOTION_HASH_PRIME + 2 * x);
+                difference |= color ^ row_color;
+            }
+
+            hash = (hash ^ strip_hash) * GUAC_SURFACE_MOTION_HASH_PRIME;
+
+        }
+
+        hashes[y] = hash;
+        uniform[y] = (difference == 0);
+
+        /* Next row */
+        buffer += stride;
+
+    }
+
+}
+
+/**
+ * Hashes each column of the given rectangle of opaque image data, ignoring
+ * the alpha channel. Only GUAC_SURFACE_MOTION_SAMPLE_ROWS evenly-spaced rows
+ * contribute to the hash of each column. Columns whose sampled pixels are all
+ * the same color are additionally flagged as uniform, as such columns match
+ * at nearly any offset and are useless for detecting motion.
+ *
+ * @param buffer The buffer containing the upper-left pixel of the rectangle.
+ * @param stride The number of bytes in each row of the buffer.
+ * @param width The width of the rectangle, in pixels.
+ * @param height The height of the rectangle, in pixels, which must be at
+ *               least GUAC_SURFACE_MOTION_SAMPLE_ROWS.
+ * @param hashes Storage for one hash per column of the rectangle.
+ * @param uniform Storage for one uniformity flag per column.
+ */
+static void __guac_common_surface_hash_columns(const unsigned char* buffer,
+        int stride, int width, int height, uint32_t* hashes,
+        unsigned char* uniform) {
+
+    const uint32_t* first = (const uint32_t*) buffer;
+    int i, x;
+
+    for (x=0; x < width; x++) {
+        hashes[x] = 0;
+        uniform[x] = 1;
+    }
+
+    /* Hash each sampled row into the hashes of all columns, weighting each
+     * pixel by its row such that columns can be hashed independently */
+    for (i=0; i < GUAC_SURFACE_MOTION_SAMPLE_ROWS; i++) {
+
+        int y = (height - 1) * i / (GUAC_SURFACE_MOTION_SAMPLE_ROWS - 1);
+        const uint32_t* current = (const uint32_t*) (buffer + y * stride);
+        uint32_t weight = GUAC_SURFACE_MOTION_HASH_PRIME + 2 * i;
+
+        for (x=0; x < width; x++) {
+            uint32_t color = current[x] | 0xFF000000;
+            hashes[x] += color * weight;
+            uniform[x] &= (color == (first[x] | 0xFF000000));
+        }
+
+    }
+
+}
+
+/**
+ * Searches for the offset at which the longest run of new rows (or columns)
+ * matches the old rows (or columns) of the same rectangle, as would be the
+ * case if the content of that rectangle had been scrolled. Only rows which
+ * have actually changed and are not uniform are used to choose candidate
+ * offsets.
+ *
+ * @param old_hashes The hashes of the rows or columns currently present.
+ * @param new_hashes The hashes of the rows or columns being drawn.
+ * @param uniform The uniformity flags of the rows or columns being drawn.
+ * @param length The number of rows or columns.
+ * @param start Storage for the index of the first new row or column of the
+ *              matching run.
+ * @param run Storage for the number of rows or columns in the matching run.
+ * @return The offset of the old rows or columns relative to the new rows or
+ *         columns, or zero if no sufficiently long run was found.
+ */
+static int __guac_common_surface_find_shift(const uint32_t* old_hashes,
+        const uint32_t* new_hashes, const unsigned char* uniform, int length,
+        int* start, int* run) {
+
+    int offsets[GUAC_SURFACE_MOTION_SAMPLES * GUAC_SURFACE_MOTION_CANDIDATES];
+    int votes[GUAC_SURFACE_MOTION_SAMPLES * GUAC_SURFACE_MOTION_CANDIDATES];
+    int num_offsets = 0;
+
+    int step = length / GUAC_SURFACE_MOTION_SAMPLES;
+    int best_offset = 0;
+    int best_votes = 0;
+    int i, j, k;
+
+    if (step < 1)
+        step = 1;
+
+    /* Vote for the offsets at which changed, sampled rows reappear */
+    for (i=0; i < length; i += step) {
+
+        int candidates = 0;
+
+        if (uniform[i] || new_hashes[i] == old_hashes[i])
+            continue;
+
+        for (j=0; j < length && candidates < GUAC_SURFACE_MOTION_CANDIDATES; j++) {
+
+            if (old_hashes[j] != new_hashes[i])
+                continue;
+
+            /* Tally vote for offset */
+            for (k=0; k < num_offsets; k++) {
+                if (offsets[k] == j - i)
+                    break;
+            }
+
+            if (k == num_offsets) {
+                offsets[k] = j - i;
+                votes[k] = 0;
+                num_offsets++;
+            }
+
+            votes[k]++;
+            candidates++;
+
+        }
+
+    }
+
+    /* Choose most popular offset */
+    for (k=0; k < num_offsets; k++) {
+        if (votes[k] > best_votes) {
+            best_offset = offsets[k];
+            best_votes = votes[k];
+        }
+    }
+
+    if (best_offset == 0)
+        return 0;
+
+    /* Find longest run of rows matching at that offset */
+    *run = 0;
+    int current_start = 0;
+    int current_run = 0;
+    int first = best_offset < 0 ? -best_offset : 0;
+    int last = best_offset > 0 ? length - best_offset : length;
+
+    for (i=first; i < last; i++) {
+
+        if (new_hashes[i] != old_hashes[i + best_offset]) {
+            current_run = 0;
+            continue;
+        }
+
+        if (current_run++ == 0)
+            current_start = i;
+
+        if (current_run > *run) {
+            *start = current_start;
+            *run = current_run;
+        }
+
+    }
+
+    if (*run < GUAC_SURFACE_MOTION_MIN_RUN)
+        return 0;
+
+    return best_offset;
+
+}
+
+/**
+ * Returns the number of rows or columns whose hashes differ between the
+ * given arrays of hashes.
+ *
+ * @param old_hashes The hashes of the rows or columns currently present.
+ * @param new_hashes The hashes of the rows or columns being drawn.
+ * @param length The number of rows or columns.
+ * @return The number of rows or columns which have changed.
+ */
+static int __guac_common_surface_count_changed(const uint32_t* old_hashes,
+        const uint32_t* new_hashes, int length) {
+
+    int i;
+    int changed = 0;
+
+    for (i=0; i < length; i++) {
+        if (old_hashes[i] != new_hashes[i])
+            changed++;
+    }
+
+    return changed;
+
+}
+
+/**
+ * Narrows the given run of new rows, matched by hash against the old rows at
+ * the given vertical offset, to the longest run of rows which are truly
+ * identical, ignoring the alpha channel.
+ *
+ * @param old_buffer The buffer containing the upper-left pixel of the old
+ *                   rectangle.
+ * @param old_stride The number of bytes in each row of the old buffer.
+ * @param new_buffer The buffer containing the upper-left pixel of the new
+ *                   rectangle.
+ * @param new_stride The number of bytes in each row of the new buffer.
+ * @param width The width of both rectangles, in pixels.
+ * @param offset The offset of each old row relative to the matching new row.
+ * @param start The index of the first new row of the run, which will be
+ *              updated to reflect the narrowed run.
+ * @param run The number of rows in the run, which will be updated to reflect
+ *            the narrowed run.
+ */
+static void __guac_common_surface_verify_rows(const unsigned char* old_buffer,
+        int old_stride, const unsigned char* new_buffer, int new_stride,
+        int width, int offset, int* start, int* run) {
+
+    int x, y;
+    int first = *start;
+    int end = *start + *run;
+    int current_run = 0;
+
+    *run = 0;
+
+    for (y = first; y < end; y++) {
+
+        const uint32_t* old_row = (const uint32_t*) (old_buffer + (y + offset) * old_stride);
+        const uint32_t* new_row = (const uint32_t*) (new_buffer + y * new_stride);
+
+        /* Compare entire row */
+        for (x=0; x < width; x++) {
+            if ((old_row[x] | 0xFF000000) != (new_row[x] | 0xFF000000))
+                break;
+        }
+
+        /* Restart run at any mismatch */
+        if (x < width) {
+            current_run = 0;
+            continue;
+        }
+
+        if (++current_run > *run) {
+            *run = current_run;
+            *start = y - current_run + 1;
+        }
+
+    }
+
+}
+
+/**
+ * Narrows the given run of new columns, matched by hash against the old
+ * columns at the given horizontal offset, to the longest run of columns which
+ * are truly identical, ignoring the alpha channel.
+ *
+ * @param old_buffer The buffer containing the upper-left pixel of the old
+ *                   rectangle.
+ * @param old_stride The number of bytes in each row of the old buffer.
+ * @param new_buffer The buffer containing the upper-left pixel of the new
+ *                   rectangle.
+ * @param new_stride The number of bytes in each row of the new buffer.
+ * @param height The height of both rectangles, in pixels.
+ * @param offset The offset of each old column relative to the matching new
+ *               column.
+ * @param mismatched Storage for one flag per column of the run.
+ * @param start The index of the first new column of the run, which will be
+ *              updated to reflect the narrowed run.
+ * @param run The number of columns in the run, which will be updated to
+ *            reflect the narrowed run.
+ */
+static void __guac_common_surface_verify_columns(const unsigned char* old_buffer,
+        int old_stride, const unsigned char* new_buffer, int new_stride,
+        int height, int offset, unsigned char* mismatched, int* start, int* run) {
+
+    int x, y;
+    int first = *start;
+    int length = *run;
+    int current_run = 0;
+
+    memset(mismatched, 0, length);
+
+    /* Flag each column having any differing pixel */
+    for (y=0; y < height; y++) {
+
+        const uint32_t* old_row = (const uint32_t*) (old_buffer + y * old_stride) + first + offset;
+        const uint32_t* new_row = (const uint32_t*) (new_buffer + y * new_stride) + first;
+
+        for (x=0; x < length; x++)
+            mismatched[x] |= ((old_row[x] | 0xFF000000) != (new_row[x] | 0xFF000000));
+
+    }
+
+    *run = 0;
+
+    for (x=0; x < length; x++) {
+
+        /* Restart run at any mismatch */
+        if (mismatched[x]) {
+            current_run = 0;
+            continue;
+        }
+
+        if (++current_run > *run) {
+            *run = current_run;
+            *start = first + x - current_run + 1;
+        }
+
+    }
+
+}
+
+static void __guac_common_surface_flush_dirty(guac_common_surface* surface);
+
+/**
+ * Detects whether the given opaque image data contains content which is
+ * already present within the surface at a vertically or horizontally shifted
+ * location, as happens when a window is scrolled. If such motion is found,
+ * the moved content is sent as a copy within the surface's layer, and the
+ * backing buffer is updated accordingly, such that the draw which follows
+ * need only send the newly-exposed region.
+ *
+ * @param src_buffer The buffer being drawn.
+ * @param src_stride The number of bytes in each row of the source buffer.
+ * @param sx The X coordinate of the source rectangle.
+ * @param sy The Y coordinate of the source rectangle.
+ * @param surface The surface being drawn to.
+ * @param rect The destination rectangle.
+ */
+static void __guac_common_surface_move(unsigned char* src_buffer, int src_stride,
+        int sx, int sy, guac_common_surface* surface,
+        const guac_common_rect* rect) {
+
+    int width = rect->width;
+    int height = rect->height;
+    int offset;
+    int start = 0;
+    int run = 0;
+
+    /* Content can only be moved if the client has it, and only large
+     * updates are worth the cost of detection */
+    if (!surface->realized
+            || width < GUAC_SURFACE_NEGLIGIBLE_WIDTH
+            || height < GUAC_SURFACE_NEGLIGIBLE_HEIGHT)
+        return;
+
+    /* Content streamed as video is not visible within the layer itself */
+    if (surface->video != NULL
+            && guac_common_rect_intersects(rect, &surface->video_rect))
+        return;
+
+    unsigned char* dst_buffer = surface->buffer
+        + surface->stride * rect->y + 4 * rect->x;
+
+    src_buffer += src_stride * sy + 4 * sx;
+
+    guac_common_rect moved;
+    int move_sx, move_sy;
+
+    int length = (width > height) ? width : height;
+    uint32_t* old_hashes = malloc(sizeof(uint32_t) * length);
+    uint32_t* new_hashes = malloc(sizeof(uint32_t) * length);
+    unsigned char* uniform = malloc(length);
+
+    /* Check for vertical scrolling */
+    __guac_common_surface_hash_rows(dst_buffer, surface->stride,
+            width, height, old_hashes, uniform);
+    __guac_common_surface_hash_rows(src_buffer, src_stride,
+            width, height, new_hashes, uniform);
+
+    if ((offset = __guac_common_surface_find_shift(old_hashes, new_hashes,
+                    uniform, height, &start, &run)) != 0) {
+
+        __guac_common_surface_verify_rows(dst_buffer, surface->stride,
+                src_buffer, src_stride, width, offset, &start, &run);
+
+        guac_common_rect_init(&moved, rect->x, rect->y + start, width, run);
+        move_sx = moved.x;
+        move_sy = moved.y + offset;
+
+    }
+
+    /* Otherwise, check for horizontal scrolling if enough has changed */
+    else if (__guac_common_surface_count_changed(old_hashes, new_hashes,
+                height) >= GUAC_SURFACE_MOTION_MIN_RUN) {
+
+        __guac_common_surface_hash_columns(dst_buffer, surface->stride,
+                width, height, old_hashes, uniform);
+        __guac_common_surface_hash_columns(src_buffer, src_stride,
+                width, height, new_hashes, uniform);
+
+        if ((offset = __guac_common_surface_find_shift(old_hashes, new_hashes,
+                    uniform, width, &start, &run)) != 0) {
+            __guac_common_surface_verify_columns(dst_buffer, surface->stride,
+                    src_buffer, src_stride, height, offset, uniform,
+                    &start, &run);
+        }
+
+        else
+            run = 0;
+
+        guac_common_rect_init(&moved, rect->x + start, rect->y, run, height);
+        move_sx = moved.x + offset;
+        move_sy = moved.y;
+
+    }
+
+    /* Otherwise, nothing has moved */
+    else
+        run = 0;
+
+    free(old_hashes);
+    free(new_hashes);
+    free(uniform);
+
+    /* Ignore matches too small to be worth copying */
+    if (run < GUAC_SURFACE_MOTION_MIN_RUN)
+        return;
+
+    /* Bring client up to date with backing surface before copying */
+    __guac_common_surface_flush_dirty(surface);
+    guac_protocol_send_copy(surface->socket,
+            surface->layer, move_sx, move_sy, moved.width, moved.height,
+            GUAC_COMP_OVER, surface->layer, moved.x, moved.y);
+
+    /* Moved content is only as lossless as its source */
+    guac_common_rect source;
+    guac_common_rect_init(&source, move_sx, move_sy,
+            moved.width, moved.height);
+    if (__guac_common_surface_is_lossy(surface, &source))
+        __guac_common_surface_set_lossy(surface, &moved, 1);
+
+    surface->moved_bytes += moved.width * moved.height * 4;
+
+    /* Update backing surface to match */
+    __guac_common_surface_transfer(surface, &move_sx, &move_sy,
+            GUAC_TRANSFER_BINARY_SRC, surface, &moved);
+
+}
+
+guac_common_surface* guac_common_surface_alloc(guac_client* client,
+        guac_socket* socket, const guac_layer* layer, int w, int h) {
+
+    /* Calculate heat map dimensions */
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(w);
+    int heat_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(h);
+
+    /* Init surface */
+    guac_common_surface* surface = calloc(1, sizeof(guac_common_surface));
+    surface->client = client;
+    surface->socket = socket;
+    surface->layer = layer;
+    surface->width = w;
+    surface->height = h;
+
+    /* Create corresponding Cairo surface */
+    surface->stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, w);
+    surface->buffer = calloc(h, surface->stride);
+
+    /* Create corresponding heat map */
+    surface->heat_map = calloc(heat_width * heat_height,
+            sizeof(guac_common_surface_heat_cell));
+
+    /* Create dirty tiles, sharing the grid of the heat map */
+    surface->dirty_tiles = calloc(heat_width * heat_height,
+            sizeof(guac_common_rect));
+    surface->dirty_runs = calloc(heat_width * 2,
+            sizeof(guac_common_surface_run));
+
+    /* Reset clipping rect */
+    guac_common_surface_reset_clip(surface);
+
+    /* Pack small updates together by default */
+    surface->atlas_threshold = GUAC_COMMON_SURFACE_ATLAS_THRESHOLD;
+
+    /* Layers must initially exist */
+    if (layer->index >= 0) {
+        guac_protocol_send_size(socket, layer, w, h);
+        surface->realized = 1;
+    }
+
+    /* Defer creation of buffers */
+    else
+        surface->realized = 0;
+
+    return surface;
+}
+
+/**
+ * Human-readable names of each image format, indexed by
+ * guac_client_image_format.
+ */
+static const char* __guac_common_surface_format_names[] = {
+    "PNG",
+    "JPEG",
+    "WebP"
+};
+
+void guac_common_surface_free(guac_common_surface* surface) {
+
+    int i;
+
+    /* Only dispose of surface if it exists */
+    if (surface->realized)
+        guac_protocol_send_dispose(surface->socket, surface->layer);
+
+    /* End video, if any */
+    __guac_common_surface_stop_video(surface);
+
+    if (surface->moved_bytes > 0)
+        guac_client_log(surface->client, GUAC_LOG_DEBUG,
+                "Motion detection avoided re-encoding %" PRIu64 " byte(s) "
+                "of image data.", surface->moved_bytes);
+
+    /* Free atlas buffer, if any */
+    if (surface->atlas_buffer != NULL) {
+        guac_protocol_send_dispose(surface->socket, surface->atlas_buffer);
+        guac_client_free_buffer(surface->client, surface->atlas_buffer);
+    }
+
+    /* Log per-format statistics */
+    for (i = 0; i < GUAC_COMMON_SURFACE_FORMATS; i++) {
+
+        guac_common_surface_format_stats* stats = &surface->format_stats[i];
+
+        if (stats->images > 0 || stats->trials > 0)
+            guac_client_log(surface->client, GUAC_LOG_DEBUG,
+                    "%s: %" PRIu64 " image(s) totalling %" PRIu64 " "
+                    "pixel(s) encoded as %" PRIu64 " byte(s) in %" PRIu64 " "
+                    "microsecond(s), plus %" PRIu64 " trial encode(s).",
+                    __guac_common_surface_format_names[i],
+                    stats->images, stats->pixels, stats->bytes, stats->time,
+                    stats->trials);
+
+    }
+
+    if (surface->trial_socket != NULL)
+        guac_socket_free(surface->trial_socket);
+
+    for (i = 0; i < GUAC_COMMON_SURFACE_FORMATS; i++)
+        free(surface->trials[i].buffer);
+
+    free(surface->dirty_runs);
+    free(surface->dirty_tiles);
+    free(surface->heat_map);
+    free(surface->buffer);
+    free(surface);
+
+}
+
+void guac_common_surface_resize(guac_common_surface* surface, int w, int h) {
+
+    guac_socket* socket = surface->socket;
+    const guac_layer* layer = surface->layer;
+
+    unsigned char* old_buffer;
+    int old_stride;
+    guac_common_rect old_rect;
+    guac_common_rect* old_tiles;
+    int i;
+
+    int sx = 0;
+    int sy = 0;
+
+    /* Calculate heat map dimensions */
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(w);
+    int heat_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(h);
+
+    /* Calculate old tile grid dimensions */
+    int old_tiles_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
+    int old_tiles_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->height);
+
+    /* Video dimensions are fixed, thus any video must be restarted */
+    __guac_common_surface_stop_video(surface);
+
+    /* Copy old surface data */
+    old_buffer = surface->buffer;
+    old_stride = surface->stride;
+    guac_common_rect_init(&old_rect, 0, 0, surface->width, surface->height);
+
+    /* Re-initialize at new size */
+    surface->width  = w;
+    surface->height = h;
+    surface->stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, w);
+    surface->buffer = calloc(h, surface->stride);
+    __guac_common_bound_rect(surface, &surface->clip_rect, NULL, NULL);
+
+    /* Copy relevant old data */
+    __guac_common_bound_rect(surface, &old_rect, NULL, NULL);
+    __guac_common_surface_put(old_buffer, old_stride, &sx, &sy, surface, &old_rect, 1);
+
+    /* Free old data */
+    free(old_buffer);
+
+    /* Allocate completely new heat map (can safely discard old stats) */
+    free(surface->heat_map);
+    surface->heat_map = calloc(heat_width * heat_height,
+            sizeof(guac_common_surface_heat_cell));
+
+    /* Re-mark dirty tiles within new surface dimensions */
+    old_tiles = surface->dirty_tiles;
+    surface->dirty_tiles = calloc(heat_width * heat_height,
+            sizeof(guac_common_rect));
+    surface->dirty = 0;
+
+    free(surface->dirty_runs);
+    surface->dirty_runs = calloc(heat_width * 2,
+            sizeof(guac_common_surface_run));
+
+    for (i = 0; i < old_tiles_width * old_tiles_height; i++) {
+        if (old_tiles[i].width > 0) {
+            __guac_common_bound_rect(surface, &old_tiles[i], NULL, NULL);
+            __guac_common_mark_dirty(surface, &old_tiles[i]);
+        }
+    }
+
+    free(old_tiles);
+
+    /* Update Guacamole layer */
+    if (surface->realized)
+        guac_protocol_send_size(socket, layer, w, h);
+
+}
+
+void guac_common_surface_draw(guac_common_surface* surface, int x, int y, cairo_surface_t* src) {
+
+    unsigned char* buffer = cairo_image_surface_get_data(src);
+    cairo_format_t format = cairo_image_surface_get_format(src);
+    int stride = cairo_image_surface_get_stride(src);
+    int w = cairo_image_surface_get_width(src);
+    int h = cairo_image_surface_get_height(src);
+
+    int sx = 0;
+    int sy = 0;
+
+    guac_common_rect rect;
+    guac_common_rect_init(&rect, x, y, w, h);
+
+    /* Clip operation */
+    __guac_common_clip_rect(surface, &rect, &sx, &sy);
+    if (rect.width <= 0 || rect.height <= 0)
+        return;
+
+    /* Send scrolled or moved content as a copy, if possible (the copy would
+     * otherwise force all deferred changes to be sent) */
+    if (format != CAIRO_FORMAT_ARGB32 && !surface->backlogged)
+        __guac_common_surface_move(buffer, stride, sx, sy, surface, &rect);
+
+    /* Update backing surface */
+    __guac_common_surface_put(buffer, stride, &sx, &sy, surface, &rect, format != CAIRO_FORMAT_ARGB32);
+    if (rect.width <= 0 || rect.height <= 0)
+        return;
+
+    /* Update the heat map for the update rectangle. */
+    guac_timestamp time = guac_timestamp_current();
+    __guac_common_surface_touch_rect(surface, &rect, time);
+
+    /* Always defer draws */
+    __guac_common_mark_dirty(surface, &rect);
+
+}
+
+void guac_common_surface_paint(guac_common_surface* surface, int x, int y, cairo_surface_t* src,
+                               int red, int green, int blue) {
+
+    unsigned char* buffer = cairo_image_surface_get_data(src);
+    int stride = cairo_image_surface_get_stride(src);
+    int w = cairo_image_surface_get_width(src);
+    int h = cairo_image_surface_get_height(src);
+
+    int sx = 0;
+    int sy = 0;
+
+    guac_common_rect rect;
+    guac_common_rect_init(&rect, x, y, w, h);
+
+    /* Clip operation */
+    __guac_common_clip_rect(surface, &rect, &sx, &sy);
+    if (rect.width <= 0 || rect.height <= 0)
+        return;
+
+    /* Update backing surface */
+    __guac_common_surface_fill_mask(buffer, stride, sx, sy, surface, &rect, red, green, blue);
+
+    /* Always defer draws */
+    __guac_common_mark_dirty(surface, &rect);
+
+}
+
+void guac_common_surface_copy(guac_common_surface* src, int sx, int sy, int w, int h,
+                              guac_common_surface* dst, int dx, int dy) {
+
+    guac_socket* socket = dst->socket;
+    const guac_layer* src_layer = src->layer;
+    const guac_layer* dst_layer = dst->layer;
+
+    guac_common_rect rect;
+    guac_common_rect_init(&rect, dx, dy, w, h);
+
+    /* Clip operation */
+    __guac_common_clip_rect(dst, &rect, &sx, &sy);
+    if (rect.width <= 0 || rect.height <= 0)
+        return;
+
+    /* Update backing surface first only if destination rect cannot intersect source rect */
+    if (src != dst) {
+        __guac_common_surface_transfer(src, &sx, &sy, GUAC_TRANSFER_BINARY_SRC, dst, &rect);
+        if (rect.width <= 0 || rect.height <= 0)
+            return;
+    }
+
+    /* Defer if combining */
+    if (__guac_common_should_combine(dst, &rect))
+        __guac_common_mark_dirty(dst, &rect);
+
+    /* Otherwise, flush and draw immediately */
+    else {
+        __guac_common_surface_flush_dirty(dst);
+        __guac_common_surface_flush_dirty(src);
+        guac_protocol_send_copy(socket, src_layer, sx, sy, rect.width, rect.height,
+                                GUAC_COMP_OVER, dst_layer, rect.x, rect.y);
+
+        /* Copied content is only as lossless as its source */
+        guac_common_rect source;
+        guac_common_rect_init(&source, sx, sy, rect.width, rect.height);
+        if (__guac_common_surface_is_lossy(src, &source))
+            __guac_common_surface_set_lossy(dst, &rect, 1);
+
+        dst->realized = 1;
+    }
+
+    /* Update backing surface last if destination rect can intersect source rect */
+    if (src == dst)
+        __guac_common_surface_transfer(src, &sx, &sy, GUAC_TRANSFER_BINARY_SRC, dst, &rect);
+
+}
+
+void guac_common_surface_transfer(guac_common_surface* src, int sx, int sy, int w, int h,
+                                  guac_transfer_function op, guac_common_surface* dst, int dx, int dy) {
+
+    guac_socket* socket = dst->socket;
+    const guac_layer* src_layer = src->layer;
+    const guac_layer* dst_layer = dst->layer;
+
+    guac_common_rect rect;
+    guac_common_rect_init(&rect, dx, dy, w, h);
+
+    /* Clip operation */
+    __guac_common_clip_rect(dst, &rect, &sx, &sy);
+    if (rect.width <= 0 || rect.height <= 0)
+        return;
+
+    /* Update backing surface first only if destination rect cannot intersect source rect */
+    if (src != dst) {
+        __guac_common_surface_transfer(src, &sx, &sy, op, dst, &rect);
+        if (rect.width <= 0 || rect.height <= 0)
+            return;
+    }
+
+    /* Defer if combining */
+    if (__guac_common_should_combine(dst, &rect))
+        __guac_common_mark_dirty(dst, &rect);
+
+    /* Otherwise, flush and draw immediately */
+    else {
+        __guac_common_surface_flush_dirty(dst);
+        __guac_common_surface_flush_dirty(src);
+        guac_protocol_send_transfer(socket, src_layer, sx, sy, rect.width, rect.height, op, dst_layer, rect.x, rect.y);
+
+        /* Transferred content is only as lossless as its source */
+        guac_common_rect source;
+        guac_common_rect_init(&source, sx, sy, rect.width, rect.height);
+        if (__guac_common_surface_is_lossy(src, &source))
+            __guac_common_surface_set_lossy(dst, &rect, 1);
+
+        dst->realized = 1;
+    }
+
+    /* Update backing surface last if destination rect can intersect source rect */
+    if (src == dst)
+        __guac_common_surface_transfer(src, &sx, &sy, op, dst, &rect);
+
+}
+
+void guac_common_surface_rect(guac_common_surface* surface,
+                              int x, int y, int w, int h,
+                              int red, int green, int blue) {
 
-    unsigned char* src_buffer = src->buffer;
-    unsigned char* dst_buffer = dst->buffer;
+    guac_socket* socket = surface->socket;
+    const guac_layer* layer = surface->layer;
 
-    int x, y;
-    int src_stride, dst_stride;
-    int step = 1;
+    guac_common_rect rect;
+    guac_common_rect_init(&rect, x, y, w, h);
 
-    int min_x = rect->width - 1;
-    int min_y = rect->height - 1;
-    int max_x = 0;
-    int max_y = 0;
+    /* Clip operation */
+    __guac_common_clip_rect(surface, &rect, NULL, NULL);
+    if (rect.width <= 0 || rect.height <= 0)
+        return;
 
-    int orig_x = rect->x;
-    int orig_y = rect->y;
+    /* Update backing surface */
+    __guac_common_surface_rect(surface, &rect, red, green, blue);
+    if (rect.width <= 0 || rect.height <= 0)
+        return;
 
-    /* Copy forwards only if destination is in a different surface or is before source */
-    if (src != dst || rect->y < *sy || (rect->y == *sy && rect->x < *sx)) {
-        src_buffer += src->stride * (*sy) + 4 * (*sx);
-        dst_buffer += (dst->stride * rect->y) + (4 * rect->x);
-        src_stride = src->stride;
-        dst_stride = dst->stride;
-        step = 1;
-    }
+    /* Defer if combining */
+    if (__guac_common_should_combine(surface, &rect))
+        __guac_common_mark_dirty(surface, &rect);
 
-    /* Otherwise, copy backwards */
+    /* Otherwise, flush and draw immediately */
     else {
-        src_buffer += src->stride * (*sy + rect->height - 1) + 4 * (*sx + rect->width - 1);
-        dst_buffer += dst->stride * (rect->y + rect->height - 1) + 4 * (rect->x + rect->width - 1);
-        src_stride = -src->stride;
-        dst_stride = -dst->stride;
-        step = -1;
+        __guac_common_surface_flush_dirty(surface);
+        guac_protocol_send_rect(socket, layer, rect.x, rect.y, rect.width, rect.height);
+        guac_protocol_send_cfill(socket, GUAC_COMP_OVER, layer, red, green, blue, 0xFF);
+        __guac_common_surface_set_lossy(surface, &rect, 0);
+        surface->realized = 1;
     }
 
-    /* For each row */
-    for (y=0; y < rect->height; y++) {
+}
 
-        uint32_t* src_current = (uint32_t*) src_buffer;
-        uint32_t* dst_current = (uint32_t*) dst_buffer;
+void guac_common_surface_clip(guac_common_surface* surface, int x, int y, int w, int h) {
 
-        /* Transfer each pixel in row */
-        for (x=0; x < rect->width; x++) {
+    guac_common_rect clip;
 
-            if (__guac_common_surface_transfer_int(op, src_current, dst_current)) {
-                if (x < min_x) min_x = x;
-                if (y < min_y) min_y = y;
-                if (x > max_x) max_x = x;
-                if (y > max_y) max_y = y;
-            }
+    /* Init clipping rectangle if clipping not already applied */
+    if (!surface->clipped) {
+        guac_common_rect_init(&surface->clip_rect, 0, 0, surface->width, surface->height);
+        surface->clipped = 1;
+    }
+
+    guac_common_rect_init(&clip, x, y, w, h);
+    guac_common_rect_constrain(&surface->clip_rect, &clip);
+
+}
+
+void guac_common_surface_reset_clip(guac_common_surface* surface) {
+    surface->clipped = 0;
+}
+
+/**
+ * Prepares the bitmap update currently described by the dirty rectangle
+ * within the given surface to be sent via an "img" instruction as PNG data,
+ * storing the details of the update within the given image. The image data
+ * is not copied, and must be sent via guac_client_stream_images() before the
+ * surface is next modified. The Cairo surface within the image must be
+ * destroyed once the image has been sent.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @param image
+ *     The image to populate with the details of the update.
+ */
+static void __guac_common_surface_flush_to_png(guac_common_surface* surface,
+        guac_client_image* image) {
+
+    /* Get Cairo surface for specified rect */
+    unsigned char* buffer = surface->buffer + surface->dirty_rect.y * surface->stride + surface->dirty_rect.x * 4;
+    cairo_surface_t* rect = cairo_image_surface_create_for_data(buffer, CAIRO_FORMAT_RGB24,
+                                                                surface->dirty_rect.width,
+                                                                surface->dirty_rect.height,
+                                                                surface->stride);
+
+    /* Lossless content within rect no longer needs refinement */
+    __guac_common_surface_set_lossy(surface, &surface->dirty_rect, 0);
+
+    /* Describe PNG for rect */
+    image->format = GUAC_CLIENT_IMAGE_PNG;
+    image->mode = GUAC_COMP_OVER;
+    image->layer = surface->layer;
+    image->x = surface->dirty_rect.x;
+    image->y = surface->dirty_rect.y;
+    image->surface = rect;
+    image->quality = 0;
+    surface->realized = 1;
+
+    /* Surface is no longer dirty */
+    surface->dirty = 0;
+
+}
+
+/**
+ * Prepares the bitmap update currently described by the dirty rectangle
+ * within the given surface to be sent via an "img" instruction as JPEG data,
+ * storing the details of the update within the given image. The image data
+ * is not copied, and must be sent via guac_client_stream_images() before the
+ * surface is next modified. The Cairo surface within the image must be
+ * destroyed once the image has been sent.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @param image
+ *     The image to populate with the details of the update.
+ */
+static void __guac_common_surface_flush_to_jpeg(guac_common_surface* surface,
+        guac_client_image* image) {
+
+    guac_common_rect max;
+    guac_common_rect_init(&max, 0, 0, surface->width, surface->height);
+
+    /* Expand the dirty rect size to fit in a grid with cells equal to the
+     * minimum JPEG block size */
+    guac_common_rect_expand_to_grid(GUAC_SURFACE_JPEG_BLOCK_SIZE,
+                                    &surface->dirty_rect, &max);
+
+    /* Get Cairo surface for specified rect */
+    unsigned char* buffer = surface->buffer + surface->dirty_rect.y * surface->stride + surface->dirty_rect.x * 4;
+    cairo_surface_t* rect = cairo_image_surface_create_for_data(buffer, CAIRO_FORMAT_RGB24,
+                                                                surface->dirty_rect.width,
+                                                                surface->dirty_rect.height,
+                                                                surface->stride);
+
+    /* Content within rect must eventually be refined */
+    __guac_common_surface_set_lossy(surface, &surface->dirty_rect, 1);
+
+    /* Describe JPEG for rect */
+    image->format = GUAC_CLIENT_IMAGE_JPEG;
+    image->mode = GUAC_COMP_OVER;
+    image->layer = surface->layer;
+    image->x = surface->dirty_rect.x;
+    image->y = surface->dirty_rect.y;
+    image->surface = rect;
+    image->quality = __guac_common_surface_lossy_quality(surface,
+            GUAC_SURFACE_JPEG_IMAGE_QUALITY);
+    surface->realized = 1;
+
+    /* Surface is no longer dirty */
+    surface->dirty = 0;
+
+}
+
+/**
+ * Prepares the bitmap update currently described by the dirty rectangle
+ * within the given surface to be sent via an "img" instruction as WebP data,
+ * storing the details of the update within the given image. The image data
+ * is not copied, and must be sent via guac_client_stream_images() before the
+ * surface is next modified. The Cairo surface within the image must be
+ * destroyed once the image has been sent.
+ *
+ * @param surface
+ *     The surface to flush.
+ *
+ * @param image
+ *     The image to populate with the details of the update.
+ */
+static void __guac_common_surface_flush_to_webp(guac_common_surface* surface,
+        guac_client_image* image) {
+
+    guac_common_rect max;
+    guac_common_rect_init(&max, 0, 0, surface->width, surface->height);
+
+    /* Expand the dirty rect size to fit in a grid with cells equal to the
+     * minimum WebP block size */
+    guac_common_rect_expand_to_grid(GUAC_SURFACE_WEBP_BLOCK_SIZE,
+                                    &surface->dirty_rect, &max);
+
+    /* Get Cairo surface for specified rect */
+    unsigned char* buffer = surface->buffer
+        + surface->dirty_rect.y * surface->stride
+        + surface->dirty_rect.x * 4;
+
+    cairo_surface_t* rect = cairo_image_surface_create_for_data(buffer,
+            CAIRO_FORMAT_RGB24,
+            surface->dirty_rect.width, surface->dirty_rect.height,
+            surface->stride);
+
+    /* Content within rect must eventually be refined */
+    __guac_common_surface_set_lossy(surface, &surface->dirty_rect, 1);
+
+    /* Describe WebP for rect */
+    image->format = GUAC_CLIENT_IMAGE_WEBP;
+    image->mode = GUAC_COMP_OVER;
+    image->layer = surface->layer;
+    image->x = surface->dirty_rect.x;
+    image->y = surface->dirty_rect.y;
+    image->surface = rect;
+    image->quality = __guac_common_surface_lossy_quality(surface,
+            GUAC_SURFACE_WEBP_IMAGE_QUALITY);
+    surface->realized = 1;
+
+    /* Surface is no longer dirty */
+    surface->dirty = 0;
+
+}
+
+/**
+ * Streams all of the given images, which were prepared by
+ * __guac_common_surface_flush_to_png(), __guac_common_surface_flush_to_jpeg(),
+ * or __guac_common_surface_flush_to_webp(), over the socket associated with
+ * the given surface, freeing the Cairo surface of each image once sent. The
+ * measured size and encode time of each image are recorded within the
+ * surface.
+ *
+ * @param surface
+ *     The surface that the given images were prepared from.
+ *
+ * @param images
+ *     The images to stream.
+ *
+ * @param count
+ *     The number of images to stream.
+ */
+static void __guac_common_surface_stream_images(guac_common_surface* surface,
+        guac_client_image* images, int count) {
+
+    int i;
+
+    guac_client_stream_images(surface->client, surface->socket,
+            images, count);
+
+    for (i = 0; i < count; i++) {
+
+        guac_client_image* image = &images[i];
+
+        /* Record measurements, if any were taken */
+        if (image->encoded_size > 0) {
+
+            guac_common_rect rect;
+            guac_common_rect_init(&rect, image->x, image->y,
+                    cairo_image_surface_get_width(image->surface),
+                    cairo_image_surface_get_height(image->surface));
+
+            guac_common_surface_format_stats* stats =
+                &surface->format_stats[image->format];
+
+            stats->images++;
+            stats->pixels += rect.width * rect.height;
+            stats->bytes += image->encoded_size;
+            stats->time += image->encode_time;
+
+            /* Only images drawn directly to the surface describe the cost of
+             * its heat map cells (unlike atlas images) */
+            if (image->layer == surface->layer)
+                __guac_common_surface_record_cost(surface, &rect,
+                        image->format, image->encoded_size,
+                        image->encode_time);
 
-            src_current += step;
-            dst_current += step;
         }
 
-        /* Next row */
-        src_buffer += src_stride;
-        dst_buffer += dst_stride;
+        cairo_surface_destroy(image->surface);
 
     }
 
-    /* Translate X coordinate space of moving backwards */
-    if (step < 0) {
-        int old_max_x = max_x;
-        max_x = rect->width - 1 - min_x;
-        min_x = rect->width - 1 - old_max_x;
-    }
+}
 
-    /* Translate Y coordinate space of moving backwards */
-    if (dst_stride < 0) {
-        int old_max_y = max_y;
-        max_y = rect->height - 1 - min_y;
-        min_y = rect->height - 1 - old_max_y;
-    }
 
-    /* Restrict destination rect to only updated pixels */
-    if (max_x >= min_x && max_y >= min_y) {
-        rect->x += min_x;
-        rect->y += min_y;
-        rect->width = max_x - min_x + 1;
-        rect->height = max_y - min_y + 1;
-    }
-    else {
-        rect->width = 0;
-        rect->height = 0;
-    }
+/**
+ * Returns whether the two given dirty rectangles should be merged and sent
+ * as a single image, based on the estimated cost of sending each separately
+ * versus the cost of sending both combined.
+ *
+ * @param a The first dirty rectangle.
+ * @param b The second dirty rectangle.
+ * @return Non-zero if the rectangles should be merged, zero otherwise.
+ */
+static int __guac_common_surface_should_merge(const guac_common_rect* a,
+        const guac_common_rect* b) {
 
-    /* Update source X/Y */
-    *sx += rect->x - orig_x;
-    *sy += rect->y - orig_y;
+    int combined_cost, a_cost, b_cost;
+
+    /* Simulate combination */
+    guac_common_rect combined = *a;
+    guac_common_rect_extend(&combined, b);
+
+    /* Estimate costs of each update and both combined */
+    combined_cost = GUAC_SURFACE_BASE_COST + combined.width * combined.height;
+    a_cost        = GUAC_SURFACE_BASE_COST + a->width * a->height;
+    b_cost        = GUAC_SURFACE_BASE_COST + b->width * b->height;
+
+    /* Merge if cost estimate shows benefit */
+    if (combined_cost <= a_cost + b_cost)
+        return 1;
+
+    /* Merge if increase in cost is negligible */
+    if (combined_cost - a_cost <= a_cost / GUAC_SURFACE_NEGLIGIBLE_INCREASE)
+        return 1;
+
+    if (combined_cost - b_cost <= b_cost / GUAC_SURFACE_NEGLIGIBLE_INCREASE)
+        return 1;
+
+    return 0;
 
 }
 
-guac_common_surface* guac_common_surface_alloc(guac_client* client,
-        guac_socket* socket, const guac_layer* layer, int w, int h) {
+/**
+ * A rectangle of the surface containing only a single color.
+ */
+typedef struct __guac_common_surface_solid {
 
-    /* Calculate heat map dimensions */
-    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(w);
-    int heat_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(h);
+    /**
+     * The area covered by this rectangle.
+     */
+    guac_common_rect rect;
 
-    /* Init surface */
-    guac_common_surface* surface = calloc(1, sizeof(guac_common_surface));
-    surface->client = client;
-    surface->socket = socket;
-    surface->layer = layer;
-    surface->width = w;
-    surface->height = h;
+    /**
+     * The color of every pixel within this rectangle, ignoring alpha.
+     */
+    uint32_t color;
 
-    /* Create corresponding Cairo surface */
-    surface->stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, w);
-    surface->buffer = calloc(h, surface->stride);
+} __guac_common_surface_solid;
 
-    /* Create corresponding heat map */
-    surface->heat_map = calloc(heat_width * heat_height,
-            sizeof(guac_common_surface_heat_cell));
+/**
+ * Attempts to decompose the given rectangle of the given surface into at most
+ * GUAC_SURFACE_SOLID_MAX_RECTS rectangles of solid color. Each row is split
+ * into runs of identical color, and consecutive rows having identical runs
+ * are combined. The search stops as soon as the limit is exceeded, thus
+ * image-like content is rejected after examining only a few pixels.
+ *
+ * @param surface The surface containing the rectangle.
+ * @param rect The rectangle to decompose.
+ * @param solids An array with room for GUAC_SURFACE_SOLID_MAX_RECTS
+ *               rectangles, which will receive the decomposed rectangles.
+ * @return The number of rectangles stored in the given array, or zero if the
+ *         rectangle cannot be decomposed within the limit.
+ */
+static int __guac_common_surface_find_solids(guac_common_surface* surface,
+        const guac_common_rect* rect, __guac_common_surface_solid* solids) {
 
-    /* Reset clipping rect */
-    guac_common_surface_reset_clip(surface);
+    int x, y, i;
+
+    int right = rect->x + rect->width;
+    int bottom = rect->y + rect->height;
+
+    /* Completed rectangles, followed by those still being extended */
+    int count = 0;
+    int open = 0;
+
+    for (y = rect->y; y < bottom; y++) {
+
+        __guac_common_surface_solid runs[GUAC_SURFACE_SOLID_MAX_RECTS];
+        int length = 0;
+
+        const uint32_t* row = (uint32_t*) (surface->buffer
+                + y * surface->stride);
+
+        /* Split row into runs of identical color */
+        x = rect->x;
+        while (x < right) {
+
+            uint32_t color = row[x] & 0xFFFFFF;
+            int start = x;
+
+            while (++x < right && (row[x] & 0xFFFFFF) == color);
+
+            if (length == GUAC_SURFACE_SOLID_MAX_RECTS)
+                return 0;
+
+            guac_common_rect_init(&runs[length].rect, start, y, x - start, 1);
+            runs[length].color = color;
+            length++;
+
+        }
+
+        /* Extend open rectangles if this row matches exactly */
+        if (length == open) {
+
+            for (i = 0; i < length; i++) {
+                const __guac_common_surface_solid* solid = &solids[count + i];
+                if (solid->rect.x != runs[i].rect.x
+                        || solid->rect.width != runs[i].rect.width
+                        || solid->color != runs[i].color)
+                    break;
+            }
+
+            if (i == length) {
+                for (i = 0; i < length; i++)
+                    solids[count + i].rect.height++;
+                continue;
+            }
+
+        }
+
+        /* Otherwise, close all open rectangles and start new ones */
+        count += open;
+        if (count + length > GUAC_SURFACE_SOLID_MAX_RECTS)
+            return 0;
+
+        memcpy(&solids[count], runs,
+                length * sizeof(__guac_common_surface_solid));
+        open = length;
 
-    /* Layers must initially exist */
-    if (layer->index >= 0) {
-        guac_protocol_send_size(socket, layer, w, h);
-        surface->realized = 1;
     }
 
-    /* Defer creation of buffers */
-    else
-        surface->realized = 0;
+    return count + open;
 
-    return surface;
 }
 
-void guac_common_surface_free(guac_common_surface* surface) {
+/**
+ * Sends the given dirty rectangle of the given surface as "rect" and "cfill"
+ * instructions if it consists of only a few solid-color rectangles.
+ *
+ * @param surface The surface being flushed.
+ * @param rect The dirty rectangle to flush.
+ * @return Non-zero if the rectangle was sent, zero if it must instead be sent
+ *         as an image.
+ */
+static int __guac_common_surface_flush_to_solids(guac_common_surface* surface,
+        const guac_common_rect* rect) {
 
-    /* Only dispose of surface if it exists */
-    if (surface->realized)
-        guac_protocol_send_dispose(surface->socket, surface->layer);
+    __guac_common_surface_solid solids[GUAC_SURFACE_SOLID_MAX_RECTS];
+    int i;
 
-    free(surface->heat_map);
-    free(surface->buffer);
-    free(surface);
+    int count = __guac_common_surface_find_solids(surface, rect, solids);
+    if (count == 0)
+        return 0;
+
+    for (i = 0; i < count; i++) {
+
+        const guac_common_rect* solid = &solids[i].rect;
+        uint32_t color = solids[i].color;
+
+        guac_protocol_send_rect(surface->socket, surface->layer,
+                solid->x, solid->y, solid->width, solid->height);
+
+        guac_protocol_send_cfill(surface->socket, GUAC_COMP_OVER,
+                surface->layer, (color >> 16) & 0xFF, (color >> 8) & 0xFF,
+                color & 0xFF, 0xFF);
+
+    }
+
+    surface->realized = 1;
+    return 1;
 
 }
 
-void guac_common_surface_resize(guac_common_surface* surface, int w, int h) {
+/**
+ * A small image update which will be packed into an atlas image.
+ */
+typedef struct __guac_common_surface_atlas_piece {
 
-    guac_socket* socket = surface->socket;
-    const guac_layer* layer = surface->layer;
+    /**
+     * The updated rectangle of the surface.
+     */
+    guac_common_rect rect;
 
-    unsigned char* old_buffer;
-    int old_stride;
-    guac_common_rect old_rect;
+    /**
+     * The X coordinate of this update within the atlas image.
+     */
+    int x;
 
-    int sx = 0;
-    int sy = 0;
+    /**
+     * The Y coordinate of this update within the atlas image.
+     */
+    int y;
 
-    /* Calculate heat map dimensions */
-    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(w);
-    int heat_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(h);
+} __guac_common_surface_atlas_piece;
 
-    /* Copy old surface data */
-    old_buffer = surface->buffer;
-    old_stride = surface->stride;
-    guac_common_rect_init(&old_rect, 0, 0, surface->width, surface->height);
+/**
+ * The image updates collected during a single flush of a surface.
+ */
+typedef struct __guac_common_surface_batch {
 
-    /* Re-initialize at new size */
-    surface->width  = w;
-    surface->height = h;
-    surface->stride = cairo_format_stride_for_width(CAIRO_FORMAT_RGB24, w);
-    surface->buffer = calloc(h, surface->stride);
-    __guac_common_bound_rect(surface, &surface->clip_rect, NULL, NULL);
+    /**
+     * Images which will be encoded and sent together once the array is full
+     * or the flush is complete.
+     */
+    guac_client_image images[GUAC_COMMON_SURFACE_QUEUE_SIZE];
 
-    /* Copy relevant old data */
-    __guac_common_bound_rect(surface, &old_rect, NULL, NULL);
-    __guac_common_surface_put(old_buffer, old_stride, &sx, &sy, surface, &old_rect, 1);
+    /**
+     * The number of images within the images array.
+     */
+    int image_count;
 
-    /* Free old data */
-    free(old_buffer);
+    /**
+     * Small updates which may be packed into an atlas image.
+     */
+    __guac_common_surface_atlas_piece pieces[GUAC_COMMON_SURFACE_QUEUE_SIZE];
 
-    /* Allocate completely new heat map (can safely discard old stats) */
-    free(surface->heat_map);
-    surface->heat_map = calloc(heat_width * heat_height,
-            sizeof(guac_common_surface_heat_cell));
+    /**
+     * The number of updates within the pieces array.
+     */
+    int piece_count;
 
-    /* Resize dirty rect to fit new surface dimensions */
-    if (surface->dirty) {
-        __guac_common_bound_rect(surface, &surface->dirty_rect, NULL, NULL);
-        if (surface->dirty_rect.width <= 0 || surface->dirty_rect.height <= 0)
-            surface->dirty = 0;
+} __guac_common_surface_batch;
+
+/**
+ * Returns the next available image within the given batch, first encoding
+ * and sending all pending images if no room remains.
+ *
+ * @param surface The surface being flushed.
+ * @param batch The batch of updates being flushed.
+ * @return The image which should receive the details of the next update.
+ */
+static guac_client_image* __guac_common_surface_next_image(
+        guac_common_surface* surface, __guac_common_surface_batch* batch) {
+
+    /* Stream pending images if no room remains for more */
+    if (batch->image_count == GUAC_COMMON_SURFACE_QUEUE_SIZE) {
+        __guac_common_surface_stream_images(surface, batch->images,
+                batch->image_count);
+        batch->image_count = 0;
     }
 
-    /* Update Guacamole layer */
-    if (surface->realized)
-        guac_protocol_send_size(socket, layer, w, h);
+    return &batch->images[batch->image_count++];
+
+}
+
+/**
+ * Comparator which orders atlas pieces by descending height, as required by
+ * qsort().
+ */
+static int __guac_common_surface_piece_cmp(const void* a, const void* b) {
+
+    const __guac_common_surface_atlas_piece* piece_a =
+        (const __guac_common_surface_atlas_piece*) a;
+
+    const __guac_common_surface_atlas_piece* piece_b =
+        (const __guac_common_surface_atlas_piece*) b;
+
+    return piece_b->rect.height - piece_a->rect.height;
 
 }
 
-void guac_common_surface_draw(guac_common_surface* surface, int x, int y, cairo_surface_t* src) {
+/**
+ * Sends all small updates collected within the given batch. If there are at
+ * least as many updates as the surface's atlas threshold, the updates are
+ * packed into rows of a single atlas image, which is sent to the surface's
+ * atlas buffer along with all other pending images, and each update is then
+ * copied into place. Otherwise, each update is queued as a separate PNG
+ * image.
+ *
+ * @param surface The surface being flushed.
+ * @param batch The batch of updates being flushed.
+ */
+static void __guac_common_surface_flush_atlas(guac_common_surface* surface,
+        __guac_common_surface_batch* batch) {
+
+    int i, y;
 
-    unsigned char* buffer = cairo_image_surface_get_data(src);
-    cairo_format_t format = cairo_image_surface_get_format(src);
-    int stride = cairo_image_surface_get_stride(src);
-    int w = cairo_image_surface_get_width(src);
-    int h = cairo_image_surface_get_height(src);
+    int width = GUAC_SURFACE_ATLAS_MIN_WIDTH;
+    int height = 0;
+    int row_x = 0;
+    int row_height = 0;
 
-    int sx = 0;
-    int sy = 0;
+    cairo_surface_t* atlas;
+    unsigned char* atlas_buffer;
+    int atlas_stride;
 
-    guac_common_rect rect;
-    guac_common_rect_init(&rect, x, y, w, h);
+    guac_client_image* image;
 
-    /* Clip operation */
-    __guac_common_clip_rect(surface, &rect, &sx, &sy);
-    if (rect.width <= 0 || rect.height <= 0)
+    if (batch->piece_count == 0)
         return;
 
-    /* Update backing surface */
-    __guac_common_surface_put(buffer, stride, &sx, &sy, surface, &rect, format != CAIRO_FORMAT_ARGB32);
-    if (rect.width <= 0 || rect.height <= 0)
-        return;
+    /* Send each update as its own image if too few to be worth packing */
+    if (surface->atlas_threshold <= 0
+            || batch->piece_count < surface->atlas_threshold) {
 
-    /* Update the heat map for the update rectangle. */
-    guac_timestamp time = guac_timestamp_current();
-    __guac_common_surface_touch_rect(surface, &rect, time);
+        for (i = 0; i < batch->piece_count; i++) {
+            image = __guac_common_surface_next_image(surface, batch);
+            surface->dirty_rect = batch->pieces[i].rect;
+            __guac_common_surface_flush_to_png(surface, image);
+        }
 
-    /* Flush if not combining */
-    if (!__guac_common_should_combine(surface, &rect, 0))
-        guac_common_surface_flush_deferred(surface);
+        batch->piece_count = 0;
+        return;
 
-    /* Always defer draws */
-    __guac_common_mark_dirty(surface, &rect);
+    }
 
-}
+    /* Atlas must be at least as wide as the widest update */
+    for (i = 0; i < batch->piece_count; i++) {
+        if (batch->pieces[i].rect.width > width)
+            width = batch->pieces[i].rect.width;
+    }
 
-void guac_common_surface_paint(guac_common_surface* surface, int x, int y, cairo_surface_t* src,
-                               int red, int green, int blue) {
+    /* Pack updates into rows, tallest first */
+    qsort(batch->pieces, batch->piece_count,
+            sizeof(__guac_common_surface_atlas_piece),
+            __guac_common_surface_piece_cmp);
 
-    unsigned char* buffer = cairo_image_surface_get_data(src);
-    int stride = cairo_image_surface_get_stride(src);
-    int w = cairo_image_surface_get_width(src);
-    int h = cairo_image_surface_get_height(src);
+    for (i = 0; i < batch->piece_count; i++) {
 
-    int sx = 0;
-    int sy = 0;
+        __guac_common_surface_atlas_piece* piece = &batch->pieces[i];
 
-    guac_common_rect rect;
-    guac_common_rect_init(&rect, x, y, w, h);
+        /* Start new row if current row is full */
+        if (row_x + piece->rect.width > width) {
+            height += row_height;
+            row_x = 0;
+            row_height = 0;
+        }
 
-    /* Clip operation */
-    __guac_common_clip_rect(surface, &rect, &sx, &sy);
-    if (rect.width <= 0 || rect.height <= 0)
-        return;
+        piece->x = row_x;
+        piece->y = height;
 
-    /* Update backing surface */
-    __guac_common_surface_fill_mask(buffer, stride, sx, sy, surface, &rect, red, green, blue);
+        row_x += piece->rect.width;
+        if (piece->rect.height > row_height)
+            row_height = piece->rect.height;
 
-    /* Flush if not combining */
-    if (!__guac_common_should_combine(surface, &rect, 0))
-        guac_common_surface_flush_deferred(surface);
+    }
 
-    /* Always defer draws */
-    __guac_common_mark_dirty(surface, &rect);
+    height += row_height;
 
-}
+    /* Copy all updates into atlas */
+    atlas = cairo_image_surface_create(CAIRO_FORMAT_RGB24, width, height);
+    atlas_buffer = cairo_image_surface_get_data(atlas);
+    atlas_stride = cairo_image_surface_get_stride(atlas);
 
-void guac_common_surface_copy(guac_common_surface* src, int sx, int sy, int w, int h,
-                              guac_common_surface* dst, int dx, int dy) {
+    cairo_surface_flush(atlas);
 
-    guac_socket* socket = dst->socket;
-    const guac_layer* src_layer = src->layer;
-    const guac_layer* dst_layer = dst->layer;
+    for (i = 0; i < batch->piece_count; i++) {
 
-    guac_common_rect rect;
-    guac_common_rect_init(&rect, dx, dy, w, h);
+        const __guac_common_surface_atlas_piece* piece = &batch->pieces[i];
 
-    /* Clip operation */
-    __guac_common_clip_rect(dst, &rect, &sx, &sy);
-    if (rect.width <= 0 || rect.height <= 0)
-        return;
+        for (y = 0; y < piece->rect.height; y++)
+            memcpy(atlas_buffer + (piece->y + y) * atlas_stride
+                        + piece->x * 4,
+                    surface->buffer + (piece->rect.y + y) * surface->stride
+                        + piece->rect.x * 4,
+                    piece->rect.width * 4);
 
-    /* Update backing surface first only if destination rect cannot intersect source rect */
-    if (src != dst) {
-        __guac_common_surface_transfer(src, &sx, &sy, GUAC_TRANSFER_BINARY_SRC, dst, &rect);
-        if (rect.width <= 0 || rect.height <= 0)
-            return;
     }
 
-    /* Defer if combining */
-    if (__guac_common_should_combine(dst, &rect, 1))
-        __guac_common_mark_dirty(dst, &rect);
+    cairo_surface_mark_dirty(atlas);
+
+    /* Allocate atlas buffer on first use */
+    if (surface->atlas_buffer == NULL)
+        surface->atlas_buffer = guac_client_alloc_buffer(surface->client);
+
+    /* Describe PNG for entire atlas */
+    image = __guac_common_surface_next_image(surface, batch);
+    image->format = GUAC_CLIENT_IMAGE_PNG;
+    image->mode = GUAC_COMP_OVER;
+    image->layer = surface->atlas_buffer;
+    image->x = 0;
+    image->y = 0;
+    image->surface = atlas;
+    image->quality = 0;
+
+    /* Atlas must be sent before it can be copied from */
+    __guac_common_surface_stream_images(surface, batch->images,
+            batch->image_count);
+    batch->image_count = 0;
+
+    /* Copy each update into place */
+    for (i = 0; i < batch->piece_count; i++) {
+
+        const __guac_common_surface_atlas_piece* piece = &batch->pieces[i];
+
+        guac_protocol_send_copy(surface->socket, surface->atlas_buffer,
+                piece->x, piece->y, piece->rect.width, piece->rect.height,
+                GUAC_COMP_OVER, surface->layer, piece->rect.x, piece->rect.y);
 
-    /* Otherwise, flush and draw immediately */
-    else {
-        guac_common_surface_flush(dst);
-        guac_common_surface_flush(src);
-        guac_protocol_send_copy(socket, src_layer, sx, sy, rect.width, rect.height,
-                                GUAC_COMP_OVER, dst_layer, rect.x, rect.y);
-        dst->realized = 1;
     }
 
-    /* Update backing surface last if destination rect can intersect source rect */
-    if (src == dst)
-        __guac_common_surface_transfer(src, &sx, &sy, GUAC_TRANSFER_BINARY_SRC, dst, &rect);
+    surface->realized = 1;
+    batch->piece_count = 0;
 
 }
 
-void guac_common_surface_transfer(guac_common_surface* src, int sx, int sy, int w, int h,
-                                  guac_transfer_function op, guac_common_surface* dst, int dx, int dy) {
+/**
+ * The class of each heat map cell covered by a dirty rectangle which
+ * contains lossless content, as determined by
+ * __guac_common_surface_flush_split().
+ */
+#define GUAC_SURFACE_TILE_LOSSLESS 0
 
-    guac_socket* socket = dst->socket;
-    const guac_layer* src_layer = src->layer;
-    const guac_layer* dst_layer = dst->layer;
+/**
+ * The class of each heat map cell covered by a dirty rectangle which
+ * contains lossy content.
+ */
+#define GUAC_SURFACE_TILE_LOSSY 1
 
-    guac_common_rect rect;
-    guac_common_rect_init(&rect, dx, dy, w, h);
+/**
+ * The class of each heat map cell covered by a dirty rectangle which has
+ * already been sent as part of a larger update.
+ */
+#define GUAC_SURFACE_TILE_SENT 2
 
-    /* Clip operation */
-    __guac_common_clip_rect(dst, &rect, &sx, &sy);
-    if (rect.width <= 0 || rect.height <= 0)
-        return;
+/**
+ * Prepares all heat map cells of the given class within the given grid of
+ * classified cells to be sent as images of the given format, combining
+ * adjacent cells into as few rectangles as possible. Each cell sent is
+ * marked as GUAC_SURFACE_TILE_SENT.
+ *
+ * @param surface The surface being flushed.
+ * @param rect The dirty rectangle containing all classified cells.
+ * @param classes The class of each heat map cell intersecting the dirty
+ *                rectangle, in row-major order.
+ * @param class The class of cell to send.
+ * @param format The format to send all cells of the given class in.
+ * @param batch The batch of updates being flushed.
+ */
+static void __guac_common_surface_flush_class(guac_common_surface* surface,
+        const guac_common_rect* rect, unsigned char* classes, int class,
+        guac_client_image_format format, __guac_common_surface_batch* batch) {
 
-    /* Update backing surface first only if destination rect cannot intersect source rect */
-    if (src != dst) {
-        __guac_common_surface_transfer(src, &sx, &sy, op, dst, &rect);
-        if (rect.width <= 0 || rect.height <= 0)
-            return;
-    }
+    int x, y, i, j;
+    int min_x, min_y, max_x, max_y;
 
-    /* Defer if combining */
-    if (__guac_common_should_combine(dst, &rect, 1))
-        __guac_common_mark_dirty(dst, &rect);
+    __guac_common_surface_heat_bounds(surface, rect,
+            &min_x, &min_y, &max_x, &max_y);
 
-    /* Otherwise, flush and draw immediately */
-    else {
-        guac_common_surface_flush(dst);
-        guac_common_surface_flush(src);
-        guac_protocol_send_transfer(socket, src_layer, sx, sy, rect.width, rect.height, op, dst_layer, rect.x, rect.y);
-        dst->realized = 1;
-    }
+    int columns = max_x - min_x + 1;
+    int rows = max_y - min_y + 1;
 
-    /* Update backing surface last if destination rect can intersect source rect */
-    if (src == dst)
-        __guac_common_surface_transfer(src, &sx, &sy, op, dst, &rect);
+    for (y = 0; y < rows; y++) {
+        for (x = 0; x < columns; x++) {
 
-}
+            int width, height;
 
-void guac_common_surface_rect(guac_common_surface* surface,
-                              int x, int y, int w, int h,
-                              int red, int green, int blue) {
+            if (classes[y * columns + x] != class)
+                continue;
 
-    guac_socket* socket = surface->socket;
-    const guac_layer* layer = surface->layer;
+            /* Extend rightwards as far as possible */
+            for (width = 1; x + width < columns; width++) {
+                if (classes[y * columns + x + width] != class)
+                    break;
+            }
 
-    guac_common_rect rect;
-    guac_common_rect_init(&rect, x, y, w, h);
+            /* Extend downwards while each entire row matches */
+            for (height = 1; y + height < rows; height++) {
 
-    /* Clip operation */
-    __guac_common_clip_rect(surface, &rect, NULL, NULL);
-    if (rect.width <= 0 || rect.height <= 0)
-        return;
+                for (i = 0; i < width; i++) {
+                    if (classes[(y + height) * columns + x + i] != class)
+                        break;
+                }
 
-    /* Update backing surface */
-    __guac_common_surface_rect(surface, &rect, red, green, blue);
-    if (rect.width <= 0 || rect.height <= 0)
-        return;
+                if (i < width)
+                    break;
 
-    /* Defer if combining */
-    if (__guac_common_should_combine(surface, &rect, 1))
-        __guac_common_mark_dirty(surface, &rect);
+            }
 
-    /* Otherwise, flush and draw immediately */
-    else {
-        guac_common_surface_flush(surface);
-        guac_protocol_send_rect(socket, layer, rect.x, rect.y, rect.width, rect.height);
-        guac_protocol_send_cfill(socket, GUAC_COMP_OVER, layer, red, green, blue, 0xFF);
-        surface->realized = 1;
+            /* Mark all cells as sent */
+            for (j = 0; j < height; j++)
+                memset(classes + (y + j) * columns + x,
+                        GUAC_SURFACE_TILE_SENT, width);
+
+            /* Send covered portion of dirty rect */
+            guac_common_rect part;
+            guac_common_rect_init(&part,
+                    (min_x + x) * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    (min_y + y) * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    width  * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    height * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE);
+            guac_common_rect_constrain(&part, rect);
+
+            surface->dirty_rect = part;
+            guac_client_image* image =
+                __guac_common_surface_next_image(surface, batch);
+
+            if (format == GUAC_CLIENT_IMAGE_WEBP)
+                __guac_common_surface_flush_to_webp(surface, image);
+            else if (format == GUAC_CLIENT_IMAGE_JPEG)
+                __guac_common_surface_flush_to_jpeg(surface, image);
+            else
+                __guac_common_surface_flush_to_png(surface, image);
+
+        }
     }
 
 }
 
-void guac_common_surface_clip(guac_common_surface* surface, int x, int y, int w, int h) {
+/**
+ * Classifies each heat map cell covered by the given dirty rectangle as
+ * containing lossless or lossy content. If the content is mixed, the
+ * rectangle is split along cell boundaries, which lie on both the JPEG and
+ * WebP block grids, and each part is prepared in the appropriate format.
+ *
+ * @param surface The surface being flushed.
+ * @param rect The dirty rectangle to flush.
+ * @param format The lossy format chosen for the dirty rectangle. If the
+ *               rectangle is not split, this receives the format that the
+ *               entire rectangle should be sent in.
+ * @param batch The batch of updates being flushed.
+ * @return Non-zero if the rectangle was split and flushed, zero if the
+ *         entire rectangle should be sent in the format stored in format.
+ */
+static int __guac_common_surface_flush_split(guac_common_surface* surface,
+        const guac_common_rect* rect, guac_client_image_format* format,
+        __guac_common_surface_batch* batch) {
 
-    guac_common_rect clip;
+    int x, y;
+    int min_x, min_y, max_x, max_y;
+    int lossy = 0;
 
-    /* Init clipping rectangle if clipping not already applied */
-    if (!surface->clipped) {
-        guac_common_rect_init(&surface->clip_rect, 0, 0, surface->width, surface->height);
-        surface->clipped = 1;
+    __guac_common_surface_heat_bounds(surface, rect,
+            &min_x, &min_y, &max_x, &max_y);
+
+    int columns = max_x - min_x + 1;
+    int rows = max_y - min_y + 1;
+
+    unsigned char* classes = malloc(columns * rows);
+    if (classes == NULL)
+        return 0;
+
+    /* Classify the portion of the dirty rect within each cell */
+    for (y = 0; y < rows; y++) {
+        for (x = 0; x < columns; x++) {
+
+            guac_common_rect tile;
+            guac_common_rect_init(&tile,
+                    (min_x + x) * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    (min_y + y) * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    GUAC_COMMON_SURFACE_HEAT_CELL_SIZE);
+            guac_common_rect_constrain(&tile, rect);
+
+            if (__guac_common_surface_tile_is_lossy(surface, &tile)) {
+                classes[y * columns + x] = GUAC_SURFACE_TILE_LOSSY;
+                lossy++;
+            }
+            else
+                classes[y * columns + x] = GUAC_SURFACE_TILE_LOSSLESS;
+
+        }
     }
 
-    guac_common_rect_init(&clip, x, y, w, h);
-    guac_common_rect_constrain(&surface->clip_rect, &clip);
+    /* Send uniform content as a single image */
+    if (lossy == 0 || lossy == columns * rows) {
+        if (lossy == 0)
+            *format = GUAC_CLIENT_IMAGE_PNG;
+        free(classes);
+        return 0;
+    }
 
-}
+    /* Send lossy parts first, such that any padding added to align them with
+     * the block grid is then covered by the lossless parts */
+    __guac_common_surface_flush_class(surface, rect, classes,
+            GUAC_SURFACE_TILE_LOSSY, *format, batch);
+
+    __guac_common_surface_flush_class(surface, rect, classes,
+            GUAC_SURFACE_TILE_LOSSLESS, GUAC_CLIENT_IMAGE_PNG, batch);
+
+    free(classes);
+    return 1;
 
-void guac_common_surface_reset_clip(guac_common_surface* surface) {
-    surface->clipped = 0;
 }
 
 /**
- * Flushes the bitmap update currently described by the dirty rectangle within
- * the given surface directly via an "img" instruction as PNG data. The
- * resulting instructions will be sent over the socket associated with the
- * given surface.
+ * Sends the output of the trial encode of the given format, if that trial
+ * encoded the given rectangle of the given surface during the current
+ * flush, in place of encoding the rectangle again. The rectangle is marked
+ * lossy or lossless depending on the format, and counted as an image of
+ * that format rather than a trial.
  *
- * @param surface
- *     The surface to flush.
+ * @param surface The surface being flushed.
+ * @param rect The rectangle to send.
+ * @param format The format chosen to send the rectangle.
+ * @return Non-zero if the output of the trial encode was sent, zero if the
+ *         rectangle must be encoded.
  */
-static void __guac_common_surface_flush_to_png(guac_common_surface* surface) {
+static int __guac_common_surface_flush_trial(guac_common_surface* surface,
+        const guac_common_rect* rect, guac_client_image_format format) {
 
-    if (surface->dirty) {
+    guac_common_surface_trial* trial = &surface->trials[format];
+    guac_common_surface_format_stats* stats = &surface->format_stats[format];
+    guac_common_rect image_rect;
 
-        guac_socket* socket = surface->socket;
-        const guac_layer* layer = surface->layer;
+    if (!trial->valid)
+        return 0;
 
-        /* Get Cairo surface for specified rect */
-        unsigned char* buffer = surface->buffer + surface->dirty_rect.y * surface->stride + surface->dirty_rect.x * 4;
-        cairo_surface_t* rect = cairo_image_surface_create_for_data(buffer, CAIRO_FORMAT_RGB24,
-                                                                    surface->dirty_rect.width,
-                                                                    surface->dirty_rect.height,
-                                                                    surface->stride);
+    trial->valid = 0;
 
-        /* Send PNG for rect */
-        guac_client_stream_png(surface->client, socket, GUAC_COMP_OVER,
-                layer, surface->dirty_rect.x, surface->dirty_rect.y, rect);
-        cairo_surface_destroy(rect);
-        surface->realized = 1;
+    /* The trial must have encoded exactly what would be sent */
+    __guac_common_surface_image_rect(surface, rect, format, &image_rect);
+    if (image_rect.x != trial->rect.x || image_rect.y != trial->rect.y
+            || image_rect.width != trial->rect.width
+            || image_rect.height != trial->rect.height)
+        return 0;
 
-        /* Surface is no longer dirty */
-        surface->dirty = 0;
+    /* The trial reflects the current contents of the surface, thus may be
+     * sent ahead of any pending images */
+    guac_socket_instruction_begin(surface->socket);
+    guac_socket_write(surface->socket, trial->buffer, trial->length);
+    guac_socket_instruction_end(surface->socket);
 
-    }
+    __guac_common_surface_set_lossy(surface, &trial->rect,
+            format != GUAC_CLIENT_IMAGE_PNG);
+
+    stats->trials--;
+    stats->images++;
+    stats->pixels += trial->rect.width * trial->rect.height;
+    stats->bytes += trial->length;
+    stats->time += trial->time;
+
+    surface->realized = 1;
+    return 1;
 
 }
 
 /**
- * Flushes the bitmap update currently described by the dirty rectangle within
- * the given surface directly via an "img" instruction as JPEG data. The
- * resulting instructions will be sent over the socket associated with the
- * given surface.
+ * Prepares the given dirty rectangle of the given surface to be sent as an
+ * image, choosing the format measured to be cheapest for the region using the
+ * surface's heat map. Rectangles mixing lossy and lossless content are split
+ * and sent as several images. Rectangles consisting of only a few solid
+ * colors are instead sent immediately as drawing instructions, while small
+ * rectangles which would be sent as PNG are collected for packing into an
+ * atlas image.
  *
- * @param surface
- *     The surface to flush.
+ * @param surface The surface being flushed.
+ * @param rect The dirty rectangle to flush.
+ * @param batch The batch of updates being flushed, which will receive the
+ *              update for the given rectangle.
  */
-static void __guac_common_surface_flush_to_jpeg(guac_common_surface* surface) {
+static void __guac_common_surface_flush_rect(guac_common_surface* surface,
+        const guac_common_rect* rect, __guac_common_surface_batch* batch) {
+
+    /* Send solid-color content as drawing instructions, not images. As all
+     * updates reflect the current contents of the surface, these may be sent
+     * ahead of any pending images without affecting the result. */
+    if (__guac_common_surface_flush_to_solids(surface, rect)) {
+        __guac_common_surface_set_lossy(surface, rect, 0);
+        return;
+    }
 
-    if (surface->dirty) {
+    guac_client_image_format format =
+        __guac_common_surface_choose_format(surface, rect);
 
-        guac_socket* socket = surface->socket;
-        const guac_layer* layer = surface->layer;
+    /* Send only those parts which appear photographic using lossy formats,
+     * such that text alongside images or video remains crisp */
+    if (format != GUAC_CLIENT_IMAGE_PNG
+            && __guac_common_surface_flush_split(surface, rect, &format,
+                batch))
+        return;
 
-        guac_common_rect max;
-        guac_common_rect_init(&max, 0, 0, surface->width, surface->height);
+    /* Collect small PNG updates for packing into an atlas */
+    if (format == GUAC_CLIENT_IMAGE_PNG && surface->atlas_threshold > 0
+            && rect->width * rect->height <= GUAC_SURFACE_ATLAS_MAX_AREA) {
 
-        /* Expand the dirty rect size to fit in a grid with cells equal to the
-         * minimum JPEG block size */
-        guac_common_rect_expand_to_grid(GUAC_SURFACE_JPEG_BLOCK_SIZE,
-                                        &surface->dirty_rect, &max);
-
-        /* Get Cairo surface for specified rect */
-        unsigned char* buffer = surface->buffer + surface->dirty_rect.y * surface->stride + surface->dirty_rect.x * 4;
-        cairo_surface_t* rect = cairo_image_surface_create_for_data(buffer, CAIRO_FORMAT_RGB24,
-                                                                    surface->dirty_rect.width,
-                                                                    surface->dirty_rect.height,
-                                                                    surface->stride);
-
-        /* Send JPEG for rect */
-        guac_client_stream_jpeg(surface->client, socket, GUAC_COMP_OVER, layer,
-                surface->dirty_rect.x, surface->dirty_rect.y, rect,
-                GUAC_SURFACE_JPEG_IMAGE_QUALITY);
-        cairo_surface_destroy(rect);
-        surface->realized = 1;
+        if (batch->piece_count == GUAC_COMMON_SURFACE_QUEUE_SIZE)
+            __guac_common_surface_flush_atlas(surface, batch);
 
-        /* Surface is no longer dirty */
-        surface->dirty = 0;
+        batch->pieces[batch->piece_count++].rect = *rect;
+        __guac_common_surface_set_lossy(surface, rect, 0);
+        return;
 
     }
 
+    /* Send the output of the trial encode of the chosen format, if any,
+     * rather than encoding the same image again */
+    if (__guac_common_surface_flush_trial(surface, rect, format))
+        return;
+
+    surface->dirty_rect = *rect;
+
+    /* Use WebP if measured to be cheapest */
+    if (format == GUAC_CLIENT_IMAGE_WEBP)
+        __guac_common_surface_flush_to_webp(surface,
+                __guac_common_surface_next_image(surface, batch));
+
+    /* Likewise JPEG */
+    else if (format == GUAC_CLIENT_IMAGE_JPEG)
+        __guac_common_surface_flush_to_jpeg(surface,
+                __guac_common_surface_next_image(surface, batch));
+
+    /* Otherwise use PNG */
+    else
+        __guac_common_surface_flush_to_png(surface,
+                __guac_common_surface_next_image(surface, batch));
+
 }
 
 /**
- * Flushes the bitmap update currently described by the dirty rectangle within
- * the given surface directly via an "img" instruction as WebP data. The
- * resulting instructions will be sent over the socket associated with the
- * given surface.
+ * Re-sends losslessly, as PNG, any heat map cells of the given surface which
+ * were last sent using a lossy format and have not been updated within the
+ * last GUAC_SURFACE_REFINE_DELAY milliseconds. At most
+ * GUAC_SURFACE_REFINE_MAX_PIXELS pixels are re-sent per call, falling to
+ * GUAC_SURFACE_REFINE_MIN_PERCENT of that as the connection becomes
+ * congested. The surface must not be dirty.
  *
- * @param surface
- *     The surface to flush.
+ * @param surface The surface to refine.
  */
-static void __guac_common_surface_flush_to_webp(guac_common_surface* surface) {
+static void __guac_common_surface_refine(guac_common_surface* surface) {
 
-    if (surface->dirty) {
+    int x, y;
 
-        guac_socket* socket = surface->socket;
-        const guac_layer* layer = surface->layer;
+    /* Refine less while congested */
+    int percent = 100 - (100 - GUAC_SURFACE_REFINE_MIN_PERCENT)
+                      * surface->client->congestion
+                      / GUAC_CLIENT_MAX_CONGESTION;
 
-        guac_common_rect max;
-        guac_common_rect_init(&max, 0, 0, surface->width, surface->height);
+    int budget = GUAC_SURFACE_REFINE_MAX_PIXELS / 100 * percent;
 
-        /* Expand the dirty rect size to fit in a grid with cells equal to the
-         * minimum WebP block size */
-        guac_common_rect_expand_to_grid(GUAC_SURFACE_WEBP_BLOCK_SIZE,
-                                        &surface->dirty_rect, &max);
-
-        /* Get Cairo surface for specified rect */
-        unsigned char* buffer = surface->buffer
-            + surface->dirty_rect.y * surface->stride
-            + surface->dirty_rect.x * 4;
-
-        cairo_surface_t* rect = cairo_image_surface_create_for_data(buffer,
-                CAIRO_FORMAT_RGB24,
-                surface->dirty_rect.width, surface->dirty_rect.height,
-                surface->stride);
-
-        /* Send WebP for rect */
-        guac_client_stream_webp(surface->client, socket, GUAC_COMP_OVER, layer,
-                surface->dirty_rect.x, surface->dirty_rect.y, rect,
-                GUAC_SURFACE_WEBP_IMAGE_QUALITY, 0);
-        cairo_surface_destroy(rect);
-        surface->realized = 1;
+    guac_timestamp now = guac_timestamp_current();
 
-        /* Surface is no longer dirty */
-        surface->dirty = 0;
+    /* Updates which will be sent once all refinable regions are found */
+    __guac_common_surface_batch batch;
+    batch.image_count = 0;
+    batch.piece_count = 0;
 
-    }
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
+    int heat_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->height);
 
-}
+    guac_common_rect bounds;
+    guac_common_rect_init(&bounds, 0, 0, surface->width, surface->height);
 
+    for (y = 0; y < heat_height && budget > 0; y++) {
 
-/**
- * Comparator for instances of guac_common_surface_bitmap_rect, the elements
- * which make up a surface's bitmap buffer.
- *
- * @see qsort
- */
-static int __guac_common_surface_bitmap_rect_compare(const void* a, const void* b) {
+        guac_common_surface_heat_cell* row = surface->heat_map
+            + y * heat_width;
 
-    guac_common_surface_bitmap_rect* ra = (guac_common_surface_bitmap_rect*) a;
-    guac_common_surface_bitmap_rect* rb = (guac_common_surface_bitmap_rect*) b;
+        x = 0;
+        while (x < heat_width && budget > 0) {
 
-    /* Order roughly top to bottom, left to right */
-    if (ra->rect.y != rb->rect.y) return ra->rect.y - rb->rect.y;
-    if (ra->rect.x != rb->rect.x) return ra->rect.x - rb->rect.x;
+            int start = x;
 
-    /* Wider updates should come first (more likely to intersect later) */
-    if (ra->rect.width != rb->rect.width) return rb->rect.width - ra->rect.width;
+            /* Find run of adjacent quiet cells awaiting refinement */
+            while (x < heat_width && row[x].lossy) {
 
-    /* Shorter updates should come first (less likely to increase cost) */
-    return ra->rect.height - rb->rect.height;
+                guac_common_surface_heat_cell* heat_cell = &row[x];
 
-}
+                /* Stop at cells which have changed too recently */
+                if (now - __guac_common_surface_cell_latest(heat_cell)
+                        < GUAC_SURFACE_REFINE_DELAY)
+                    break;
 
-void guac_common_surface_flush(guac_common_surface* surface) {
+                /* Stop at cells hidden by video, which will be re-sent
+                 * once the video ends */
+                if (__guac_common_surface_cell_in_video(surface, x, y))
+                    break;
 
-    /* Flush final dirty rectangle to queue. */
-    __guac_common_surface_flush_to_queue(surface);
+                heat_cell->lossy = 0;
+                budget -= GUAC_COMMON_SURFACE_HEAT_CELL_SIZE
+                        * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE;
+                x++;
 
-    guac_common_surface_bitmap_rect* current = surface->bitmap_queue;
-    int i, j;
-    int original_queue_length;
-    int flushed = 0;
+                if (budget <= 0)
+                    break;
 
-    original_queue_length = surface->bitmap_queue_length;
+            }
 
-    /* Sort updates to make combination less costly */
-    qsort(surface->bitmap_queue, surface->bitmap_queue_length, sizeof(guac_common_surface_bitmap_rect),
-          __guac_common_surface_bitmap_rect_compare);
+            /* Skip cells which need no refinement */
+            if (x == start) {
+                x++;
+                continue;
+            }
 
-    /* Flush all rects in queue */
-    for (i=0; i < surface->bitmap_queue_length; i++) {
+            /* Re-send run as PNG */
+            guac_common_rect_init(&surface->dirty_rect,
+                    start * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    y * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    (x - start) * GUAC_COMMON_SURFACE_HEAT_CELL_SIZE,
+                    GUAC_COMMON_SURFACE_HEAT_CELL_SIZE);
+            guac_common_rect_constrain(&surface->dirty_rect, &bounds);
 
-        /* Get next unflushed candidate */
-        guac_common_surface_bitmap_rect* candidate = current;
-        if (!candidate->flushed) {
+            __guac_common_surface_flush_to_png(surface,
+                    __guac_common_surface_next_image(surface, &batch));
 
-            int combined = 0;
+        }
 
-            /* Build up rect as much as possible */
-            for (j=i; j < surface->bitmap_queue_length; j++) {
+    }
 
-                if (!candidate->flushed) {
+    /* Encode and send all images, concurrently if possible */
+    __guac_common_surface_stream_images(surface, batch.images,
+            batch.image_count);
 
-                    /* Clip candidate within current bounds */
-                    __guac_common_bound_rect(surface, &candidate->rect, NULL, NULL);
-                    if (candidate->rect.width <= 0 || candidate->rect.height <= 0)
-                        candidate->flushed = 1;
+}
 
-                    /* Combine if reasonable */
-                    else if (__guac_common_should_combine(surface, &candidate->rect, 0) || !surface->dirty) {
-                        __guac_common_mark_dirty(surface, &candidate->rect);
-                        candidate->flushed = 1;
-                        combined++;
-                    }
+/**
+ * Flushes all pending operations within the given surface, drawing the
+ * current contents of all dirty regions on the remote display. Unlike
+ * guac_common_surface_flush(), lossy regions are not refined, thus this is
+ * safe to call at any point during drawing without incurring any
+ * unnecessary delay.
+ *
+ * @param surface The surface to flush.
+ */
+static void __guac_common_surface_flush_dirty(guac_common_surface* surface) {
 
-                }
+    int x, y;
+
+    /* Updates which will be sent once all dirty regions are combined */
+    __guac_common_surface_batch batch;
+
+    /* Do not flush if not dirty */
+    if (!surface->dirty)
+        return;
+
+    batch.image_count = 0;
+    batch.piece_count = 0;
+
+    /* Calculate tile grid dimensions */
+    int tiles_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
+    int tiles_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->height);
 
-                candidate++;
+    /* Send tiles streamed as video as the next frame of video. If video
+     * fails, those tiles are marked dirty again and sent as images. */
+    if (surface->video != NULL) {
 
+        for (y = 0; y < tiles_height; y++) {
+            guac_common_rect* row = surface->dirty_tiles + y * tiles_width;
+            for (x = 0; x < tiles_width; x++) {
+                if (row[x].width > 0
+                        && __guac_common_surface_cell_in_video(surface, x, y)) {
+                    row[x].width = 0;
+                    surface->video_dirty = 1;
+                }
             }
+        }
+
+        __guac_common_surface_flush_video(surface);
+
+    }
 
-            /* Re-add to queue if there's room and this update was modified or we expect others might be */
-            if ((combined > 1 || i < original_queue_length)
-                    && surface->bitmap_queue_length < GUAC_COMMON_SURFACE_QUEUE_SIZE)
-                __guac_common_surface_flush_to_queue(surface);
+    /* Runs ending at the previous row and at the current row, indexed by
+     * the column of their first tile */
+    guac_common_surface_run* runs = surface->dirty_runs;
+    memset(runs, 0, tiles_width * 2 * sizeof(guac_common_surface_run));
+    guac_common_surface_run* open = runs;
+    guac_common_surface_run* next = runs + tiles_width;
 
-            /* Flush as bitmap otherwise */
-            else if (surface->dirty) {
+    for (y = 0; y < tiles_height; y++) {
 
-                flushed++;
+        guac_common_rect* row = surface->dirty_tiles + y * tiles_width;
 
-                /* Prefer WebP when reasonable */
-                if (__guac_common_surface_should_use_webp(surface,
-                            &surface->dirty_rect))
-                    __guac_common_surface_flush_to_webp(surface);
+        x = 0;
+        while (x < tiles_width) {
 
-                /* If not WebP, JPEG is the next best (lossy) choice */
-                else if (__guac_common_surface_should_use_jpeg(surface,
-                            &surface->dirty_rect))
-                    __guac_common_surface_flush_to_jpeg(surface);
+            int start = x;
+            guac_common_rect rect;
 
-                /* Use PNG if no lossy formats are appropriate */
-                else
-                    __guac_common_surface_flush_to_png(surface);
+            /* Skip clean tiles */
+            if (row[x].width <= 0) {
+                x++;
+                continue;
+            }
 
+            /* Extend run across adjacent dirty tiles */
+            rect = row[x++];
+            while (x < tiles_width && row[x].width > 0
+                    && __guac_common_surface_should_merge(&rect, &row[x]))
+                guac_common_rect_extend(&rect, &row[x++]);
+
+            /* Continue identical run from previous row, if reasonable */
+            if (open[start].rect.width > 0 && open[start].end == x
+                    && __guac_common_surface_should_merge(&open[start].rect, &rect)) {
+                guac_common_rect_extend(&rect, &open[start].rect);
+                open[start].rect.width = 0;
             }
 
+            next[start].rect = rect;
+            next[start].end = x;
+
+        }
+
+        /* Flush all runs which were not continued */
+        for (x = 0; x < tiles_width; x++) {
+            if (open[x].rect.width > 0) {
+                __guac_common_surface_flush_rect(surface, &open[x].rect,
+                        &batch);
+                open[x].rect.width = 0;
+            }
         }
 
-        current++;
+        /* Runs of current row become the candidates for the next row */
+        open = next;
+        next = (next == runs) ? runs + tiles_width : runs;
+
+        /* Row is now clean */
+        memset(row, 0, tiles_width * sizeof(guac_common_rect));
+
+    }
 
+    /* Flush runs which reached the bottom of the surface */
+    for (x = 0; x < tiles_width; x++) {
+        if (open[x].rect.width > 0)
+            __guac_common_surface_flush_rect(surface, &open[x].rect,
+                    &batch);
     }
 
+    /* Pack small updates into an atlas, if worthwhile */
+    __guac_common_surface_flush_atlas(surface, &batch);
+
+    /* Encode and send all images, concurrently if possible */
+    __guac_common_surface_stream_images(surface, batch.images,
+            batch.image_count);
+
     /* Flush complete */
-    surface->bitmap_queue_length = 0;
+    surface->dirty = 0;
 
 }
 
+void guac_common_surface_flush(guac_common_surface* surface) {
+
+    /* Skip this frame while the client is still receiving earlier frames,
+     * such that all changes are sent as a single frame once it catches up */
+    surface->backlogged = guac_socket_get_backlog(surface->socket)
+                        > GUAC_SURFACE_MAX_BACKLOG;
+    if (surface->backlogged)
+        return;
+
+    /* Start or stop streaming frequently-updated regions as video */
+    __guac_common_surface_update_video(surface);
+
+    /* Send all pending updates first */
+    __guac_common_surface_flush_dirty(surface);
+
+    /* Refine quiet regions, within a limited budget */
+    __guac_common_surface_refine(surface);
+
+}
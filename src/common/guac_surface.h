@@ -31,12 +31,22 @@
 #include <guacamole/layer.h>
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
+#include <guacamole/video.h>
+
+#include <stdint.h>
 
 /**
- * The maximum number of updates to allow within the bitmap queue.
+ * The maximum number of image updates to collect during a flush before they
+ * are encoded and sent as a batch.
  */
 #define GUAC_COMMON_SURFACE_QUEUE_SIZE 256
 
+/**
+ * The default minimum number of small image updates which must be flushed at
+ * once for those updates to be packed together into a single atlas image.
+ */
+#define GUAC_COMMON_SURFACE_ATLAS_THRESHOLD 8
+
 /**
  * Heat map cell size in pixels. Each side of each heat map cell will consist
  * of this many pixels.
@@ -59,6 +69,116 @@
  */
 #define GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE 5
 
+/**
+ * The number of image formats which may be chosen between when flushing a
+ * surface, one for each guac_client_image_format.
+ */
+#define GUAC_COMMON_SURFACE_FORMATS 3
+
+/**
+ * The measured cost of encoding the region covered by a heat map cell using a
+ * particular image format.
+ */
+typedef struct guac_common_surface_format_cost {
+
+    /**
+     * Moving average of the size of encoded images, in bytes per pixel.
+     */
+    double bytes;
+
+    /**
+     * Moving average of the time taken to encode images, in microseconds per
+     * pixel.
+     */
+    double time;
+
+    /**
+     * Non-zero if the averages above have been initialized by at least one
+     * measurement, zero if this format has not yet been measured within the
+     * cell.
+     */
+    int measured;
+
+} guac_common_surface_format_cost;
+
+/**
+ * Statistics describing all images of a particular format prepared while
+ * flushing a surface, for the sake of tuning format selection.
+ */
+typedef struct guac_common_surface_format_stats {
+
+    /**
+     * The number of images of this format sent.
+     */
+    uint64_t images;
+
+    /**
+     * The total number of pixels within all images of this format sent.
+     */
+    uint64_t pixels;
+
+    /**
+     * The total number of bytes of instructions sent for images of this
+     * format.
+     */
+    uint64_t bytes;
+
+    /**
+     * The total time spent encoding images of this format which were sent,
+     * in microseconds.
+     */
+    uint64_t time;
+
+    /**
+     * The number of trial encodes performed using this format, the results
+     * of which were measured and then discarded. Trials whose output was
+     * sent are counted as images instead.
+     */
+    uint64_t trials;
+
+} guac_common_surface_format_stats;
+
+/**
+ * The output of a trial encode of a rectangle of a surface, kept such that
+ * the image need not be encoded again if the trialled format is chosen.
+ */
+typedef struct guac_common_surface_trial {
+
+    /**
+     * The instructions produced by the trial encode, or NULL if no trial
+     * encode has yet been performed using this format.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes of instructions within the buffer.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for the buffer.
+     */
+    size_t size;
+
+    /**
+     * The rectangle of the surface that was encoded.
+     */
+    guac_common_rect rect;
+
+    /**
+     * The time taken by the trial encode, in microseconds.
+     */
+    int time;
+
+    /**
+     * Non-zero if the buffer contains the complete output of a trial encode
+     * of the rectangle currently being flushed, such that it may be sent as
+     * is, zero otherwise.
+     */
+    int valid;
+
+} guac_common_surface_trial;
+
 /**
  * Representation of a cell in the refresh heat map. This cell is used to keep
  * track of how often an area on a surface is refreshed.
@@ -80,25 +200,46 @@ typedef struct guac_common_surface_heat_cell {
      */
     int oldest_entry;
 
+    /**
+     * The measured cost of each image format within this cell, indexed by
+     * guac_client_image_format.
+     */
+    guac_common_surface_format_cost costs[GUAC_COMMON_SURFACE_FORMATS];
+
+    /**
+     * The number of times a format has been chosen for an update covering
+     * this cell since the formats not chosen were last measured.
+     */
+    int choices_since_trial;
+
+    /**
+     * Non-zero if the remote display may contain lossy content within this
+     * cell which has not yet been refined by a lossless update, zero
+     * otherwise.
+     */
+    int lossy;
+
 } guac_common_surface_heat_cell;
 
 /**
- * Representation of a bitmap update, having a rectangle of image data (stored
- * elsewhere) and a flushed/not-flushed state.
+ * A horizontal run of adjacent dirty tiles within a single row of the tile
+ * grid, possibly merged with identical runs in the rows above.
  */
-typedef struct guac_common_surface_bitmap_rect {
+typedef struct guac_common_surface_run {
 
     /**
-     * Whether this rectangle has been flushed.
+     * The bounding rectangle of the dirty regions of all tiles in this run.
+     * If this run does not exist, the width of this rectangle is zero.
      */
-    int flushed;
+    guac_common_rect rect;
 
     /**
-     * The rectangle containing the bitmap update.
+     * The column of the tile grid immediately following the last tile in
+     * this run.
      */
-    guac_common_rect rect;
+    int end;
 
-} guac_common_surface_bitmap_rect;
+} guac_common_surface_run;
 
 /**
  * Surface which backs a Guacamole buffer or layer, automatically
@@ -147,15 +288,38 @@ typedef struct guac_common_surface {
     int dirty;
 
     /**
-     * The dirty rectangle.
+     * The bounding rectangle of all dirty regions of this surface.
      */
     guac_common_rect dirty_rect;
 
+    /**
+     * The dirty region within each tile of this surface. Tiles share the
+     * grid of the heat map, each tile covering the same pixels as the heat
+     * map cell at the same index. Tiles whose rectangle has zero width are
+     * clean.
+     */
+    guac_common_rect* dirty_tiles;
+
+    /**
+     * Storage for the runs of dirty tiles ending at the previous and current
+     * rows of the tile grid while the surface is flushed, two rows of the
+     * tile grid in length. Allocated along with dirty_tiles such that
+     * flushing need not allocate.
+     */
+    guac_common_surface_run* dirty_runs;
+
     /**
      * Whether the surface actually exists on the client.
      */
     int realized;
 
+    /**
+     * Whether output was still waiting to be sent to the client as of the
+     * last flush, in which case that flush was skipped, and all changes are
+     * deferred until a later flush finds that the client has caught up.
+     */
+    int backlogged;
+
     /**
      * Whether drawing operations are currently clipped by the clipping
      * rectangle.
@@ -168,20 +332,87 @@ typedef struct guac_common_surface {
     guac_common_rect clip_rect;
 
     /**
-     * The number of updates in the bitmap queue.
+     * A heat map keeping track of the refresh frequency of
+     * the areas of the screen.
      */
-    int bitmap_queue_length;
+    guac_common_surface_heat_cell* heat_map;
 
     /**
-     * All queued bitmap updates.
+     * The total number of bytes of raw image data which did not need to be
+     * encoded and sent because motion (such as scrolling) was detected and
+     * sent as a copy instead.
      */
-    guac_common_surface_bitmap_rect bitmap_queue[GUAC_COMMON_SURFACE_QUEUE_SIZE];
+    uint64_t moved_bytes;
 
     /**
-     * A heat map keeping track of the refresh frequency of
-     * the areas of the screen.
+     * The minimum number of small image updates which must be flushed at once
+     * for those updates to be packed together into a single atlas image, sent
+     * to an off-screen buffer and then copied into place. If zero, updates
+     * are never packed into an atlas. This is initialized to
+     * GUAC_COMMON_SURFACE_ATLAS_THRESHOLD and may be changed at any time.
      */
-    guac_common_surface_heat_cell* heat_map;
+    int atlas_threshold;
+
+    /**
+     * The off-screen buffer which receives atlas images, or NULL if no atlas
+     * image has yet been sent.
+     */
+    guac_layer* atlas_buffer;
+
+    /**
+     * Statistics describing the images of each format prepared by this
+     * surface, indexed by guac_client_image_format.
+     */
+    guac_common_surface_format_stats format_stats[GUAC_COMMON_SURFACE_FORMATS];
+
+    /**
+     * The socket which receives the output of trial encodes, writing to the
+     * guac_common_surface_trial pointed to by its data member, or NULL if no
+     * trial encode has yet been performed.
+     */
+    guac_socket* trial_socket;
+
+    /**
+     * The output of the most recent trial encode of each format, indexed by
+     * guac_client_image_format.
+     */
+    guac_common_surface_trial trials[GUAC_COMMON_SURFACE_FORMATS];
+
+    /**
+     * The video stream replacing image updates within video_rect, or NULL if
+     * no video is currently being streamed.
+     */
+    guac_video_stream* video;
+
+    /**
+     * The layer on which the current video stream is played back, positioned
+     * over video_rect, or NULL if no video is currently being streamed.
+     */
+    guac_layer* video_layer;
+
+    /**
+     * The region of this surface covered by the current video stream.
+     */
+    guac_common_rect video_rect;
+
+    /**
+     * Non-zero if the contents of video_rect have changed since the last
+     * frame of video was sent, zero otherwise.
+     */
+    int video_dirty;
+
+    /**
+     * The region most recently identified as being updated frequently enough
+     * to be sent as video. Video is only streamed once the same region has
+     * been identified by several consecutive flushes.
+     */
+    guac_common_rect video_candidate;
+
+    /**
+     * The number of consecutive flushes which have identified video_candidate
+     * as suitable for video.
+     */
+    int video_candidate_flushes;
 
 } guac_common_surface;
 
@@ -321,21 +552,14 @@ void guac_common_surface_reset_clip(guac_common_surface* surface);
 
 /**
  * Flushes the given surface, drawing any pending operations on the remote
- * display.
+ * display. Regions previously sent using lossy formats which have since
+ * stopped changing are then gradually re-sent losslessly. If the client is
+ * still receiving previously-flushed output, nothing is sent, and all pending
+ * operations remain pending until a later flush.
  *
  * @param surface The surface to flush.
  */
 void guac_common_surface_flush(guac_common_surface* surface);
 
-/**
- * Schedules a deferred flush of the given surface. This will not immediately
- * flush the surface to the client. Instead, the result of the flush is
- * added to a queue which is reinspected and combined (if possible) with other
- * deferred flushes during the call to guac_common_surface_flush().
- *
- * @param surface The surface to flush.
- */
-void guac_common_surface_flush_deferred(guac_common_surface* surface);
-
 #endif
 
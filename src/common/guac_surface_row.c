@@ -0,0 +1,701 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "config.h"
+#include "guac_surface_row.h"
+
+#include <stdint.h>
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/**
+ * Copies pixels from the given source row to the given destination row one
+ * pixel at a time, starting at the given index, as guac_common_surface_row_put().
+ */
+static void __guac_common_surface_row_put_scalar(uint32_t* dst,
+        const uint32_t* src, int start, int width, int opaque,
+        int* first, int* last) {
+
+    int x;
+
+    for (x = start; x < width; x++) {
+
+        if (opaque || (src[x] & 0xFF000000)) {
+
+            uint32_t color = src[x] | 0xFF000000;
+
+            if (dst[x] != color) {
+                if (*first < 0) *first = x;
+                *last = x;
+                dst[x] = color;
+            }
+
+        }
+
+    }
+
+}
+
+/**
+ * Fills the given row one pixel at a time, starting at the given index, as
+ * guac_common_surface_row_fill().
+ */
+static void __guac_common_surface_row_fill_scalar(uint32_t* dst,
+        uint32_t color, int start, int width, int* first, int* last) {
+
+    int x;
+
+    for (x = start; x < width; x++) {
+
+        if (dst[x] != color) {
+            if (*first < 0) *first = x;
+            *last = x;
+            dst[x] = color;
+        }
+
+    }
+
+}
+
+/**
+ * Copies pixels from the given source row to the given destination row one
+ * pixel at a time, starting at the given index, as
+ * guac_common_surface_row_copy().
+ */
+static void __guac_common_surface_row_copy_scalar(uint32_t* dst,
+        const uint32_t* src, int start, int width, int* first, int* last) {
+
+    int x;
+
+    for (x = start; x < width; x++) {
+
+        if (dst[x] != src[x]) {
+            if (*first < 0) *first = x;
+            *last = x;
+            dst[x] = src[x];
+        }
+
+    }
+
+}
+
+/**
+ * Invokes the given implementation of guac_common_surface_row_transfer(),
+ * returning its result, with the transfer function passed as a constant.
+ * As each implementation is always inlined, this produces a separate copy of
+ * that implementation for each transfer function, each reduced by the
+ * compiler to the minimal expression for that function.
+ *
+ * @param kernel The implementation to invoke.
+ * @param op The transfer function to specialize for.
+ * @param ... The remaining arguments of the implementation.
+ */
+#define __GUAC_COMMON_SURFACE_ROW_TRANSFER_SPECIALIZE(kernel, op, ...)         \
+    switch (op) {                                                              \
+        case GUAC_TRANSFER_BINARY_BLACK:                                       \
+            return kernel(GUAC_TRANSFER_BINARY_BLACK, __VA_ARGS__);            \
+        case GUAC_TRANSFER_BINARY_WHITE:                                       \
+            return kernel(GUAC_TRANSFER_BINARY_WHITE, __VA_ARGS__);            \
+        case GUAC_TRANSFER_BINARY_SRC:                                         \
+            return kernel(GUAC_TRANSFER_BINARY_SRC, __VA_ARGS__);              \
+        case GUAC_TRANSFER_BINARY_DEST:                                        \
+            return kernel(GUAC_TRANSFER_BINARY_DEST, __VA_ARGS__);             \
+        case GUAC_TRANSFER_BINARY_NSRC:                                        \
+            return kernel(GUAC_TRANSFER_BINARY_NSRC, __VA_ARGS__);             \
+        case GUAC_TRANSFER_BINARY_NDEST:                                       \
+            return kernel(GUAC_TRANSFER_BINARY_NDEST, __VA_ARGS__);            \
+        case GUAC_TRANSFER_BINARY_AND:                                         \
+            return kernel(GUAC_TRANSFER_BINARY_AND, __VA_ARGS__);              \
+        case GUAC_TRANSFER_BINARY_NAND:                                        \
+            return kernel(GUAC_TRANSFER_BINARY_NAND, __VA_ARGS__);             \
+        case GUAC_TRANSFER_BINARY_OR:                                          \
+            return kernel(GUAC_TRANSFER_BINARY_OR, __VA_ARGS__);               \
+        case GUAC_TRANSFER_BINARY_NOR:                                         \
+            return kernel(GUAC_TRANSFER_BINARY_NOR, __VA_ARGS__);              \
+        case GUAC_TRANSFER_BINARY_XOR:                                         \
+            return kernel(GUAC_TRANSFER_BINARY_XOR, __VA_ARGS__);              \
+        case GUAC_TRANSFER_BINARY_XNOR:                                        \
+            return kernel(GUAC_TRANSFER_BINARY_XNOR, __VA_ARGS__);             \
+        case GUAC_TRANSFER_BINARY_NSRC_AND:                                    \
+            return kernel(GUAC_TRANSFER_BINARY_NSRC_AND, __VA_ARGS__);         \
+        case GUAC_TRANSFER_BINARY_NSRC_NAND:                                   \
+            return kernel(GUAC_TRANSFER_BINARY_NSRC_NAND, __VA_ARGS__);        \
+        case GUAC_TRANSFER_BINARY_NSRC_OR:                                     \
+            return kernel(GUAC_TRANSFER_BINARY_NSRC_OR, __VA_ARGS__);          \
+        case GUAC_TRANSFER_BINARY_NSRC_NOR:                                    \
+            return kernel(GUAC_TRANSFER_BINARY_NSRC_NOR, __VA_ARGS__);         \
+    }
+
+/*
+ * Each bit of a guac_transfer_function defines the result of the function for
+ * one combination of source and destination bits: the lowest bit for a
+ * source and destination of 1, then source 1 and destination 0, source 0 and
+ * destination 1, and finally both 0. Any transfer function can therefore be
+ * evaluated using bitwise operations alone, as the union of the combinations
+ * it selects. When the function is known at compile time, the unselected
+ * combinations and any redundant operations are eliminated entirely. The
+ * only exception is GUAC_TRANSFER_BINARY_BLACK, which produces opaque black
+ * rather than clearing the alpha channel along with the color.
+ */
+
+/**
+ * Applies the given transfer function to a single pixel.
+ *
+ * @param op The transfer function to apply.
+ * @param src The source pixel.
+ * @param dst The destination pixel.
+ * @return The result of the transfer function.
+ */
+static inline __attribute__((always_inline))
+uint32_t __guac_common_surface_row_transfer_pixel(guac_transfer_function op,
+        uint32_t src, uint32_t dst) {
+
+    uint32_t result = 0;
+
+    /* Black is opaque, not the absence of every bit */
+    if (op == GUAC_TRANSFER_BINARY_BLACK)
+        return 0xFF000000;
+
+    if (op & 0x1) result |=  src &  dst;
+    if (op & 0x2) result |=  src & ~dst;
+    if (op & 0x4) result |= ~src &  dst;
+    if (op & 0x8) result |= ~src & ~dst;
+
+    return result;
+
+}
+
+/**
+ * Combines pixels from the given source row with the given destination row
+ * one pixel at a time, starting at the given index, as
+ * guac_common_surface_row_transfer().
+ *
+ * @return The number of pixels handled, which is always the full width.
+ */
+static inline __attribute__((always_inline))
+int __guac_common_surface_row_transfer_scalar_op(guac_transfer_function op,
+        uint32_t* dst, const uint32_t* src, int start, int width,
+        int* first, int* last) {
+
+    int x;
+
+    for (x = start; x < width; x++) {
+
+        uint32_t color =
+            __guac_common_surface_row_transfer_pixel(op, src[x], dst[x]);
+
+        if (dst[x] != color) {
+            if (*first < 0) *first = x;
+            *last = x;
+            dst[x] = color;
+        }
+
+    }
+
+    return width;
+
+}
+
+/**
+ * Combines pixels one pixel at a time, starting at the given index, using an
+ * implementation specialized for the given transfer function.
+ */
+static int __guac_common_surface_row_transfer_scalar(guac_transfer_function op,
+        uint32_t* dst, const uint32_t* src, int start, int width,
+        int* first, int* last) {
+
+    __GUAC_COMMON_SURFACE_ROW_TRANSFER_SPECIALIZE(
+            __guac_common_surface_row_transfer_scalar_op, op,
+            dst, src, start, width, first, last);
+
+    return start;
+
+}
+
+#ifdef HAVE_X86_SIMD
+
+/**
+ * Records that the pixels identified by the given bitmask have changed, where
+ * the least-significant bit of the mask corresponds to the pixel at the given
+ * index. Changes must be recorded in ascending order.
+ *
+ * @param index The index of the pixel corresponding to the lowest bit.
+ * @param mask A bitmask having one bit set for each changed pixel.
+ * @param first The index of the first changed pixel, or -1 if none.
+ * @param last The index of the last changed pixel.
+ */
+static void __guac_common_surface_row_changed(int index, unsigned int mask,
+        int* first, int* last) {
+
+    if (*first < 0)
+        *first = index + __builtin_ctz(mask);
+
+    *last = index + 31 - __builtin_clz(mask);
+
+}
+
+/*
+ * Each of the vectorized operations below handles only as many whole vectors
+ * of pixels as fit within the row, returning the number of pixels handled.
+ * The remainder is handled by the scalar implementation. Vectors of pixels
+ * which did not change are only compared, and never stored.
+ */
+
+/**
+ * Copies groups of four pixels using SSE4.1, as guac_common_surface_row_put().
+ */
+__attribute__((target("sse4.1")))
+static int __guac_common_surface_row_put_sse41(uint32_t* dst,
+        const uint32_t* src, int width, int opaque, int* first, int* last) {
+
+    __m128i alpha = _mm_set1_epi32((int) 0xFF000000);
+    __m128i zero = _mm_setzero_si128();
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4) {
+
+        __m128i pixels = _mm_loadu_si128((const __m128i*) (src + x));
+        __m128i color = _mm_or_si128(pixels, alpha);
+        __m128i old = _mm_loadu_si128((const __m128i*) (dst + x));
+
+        /* Leave unchanged and (if not opaque) transparent pixels alone */
+        __m128i skip = _mm_cmpeq_epi32(color, old);
+        if (!opaque)
+            skip = _mm_or_si128(skip,
+                    _mm_cmpeq_epi32(_mm_and_si128(pixels, alpha), zero));
+
+        unsigned int changed =
+            ~_mm_movemask_ps(_mm_castsi128_ps(skip)) & 0xF;
+
+        if (changed) {
+            _mm_storeu_si128((__m128i*) (dst + x),
+                    _mm_blendv_epi8(color, old, skip));
+            __guac_common_surface_row_changed(x, changed, first, last);
+        }
+
+    }
+
+    return x;
+
+}
+
+/**
+ * Copies groups of eight pixels using AVX2, as guac_common_surface_row_put().
+ */
+__attribute__((target("avx2")))
+static int __guac_common_surface_row_put_avx2(uint32_t* dst,
+        const uint32_t* src, int width, int opaque, int* first, int* last) {
+
+    __m256i alpha = _mm256_set1_epi32((int) 0xFF000000);
+    __m256i zero = _mm256_setzero_si256();
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+
+        __m256i pixels = _mm256_loadu_si256((const __m256i*) (src + x));
+        __m256i color = _mm256_or_si256(pixels, alpha);
+        __m256i old = _mm256_loadu_si256((const __m256i*) (dst + x));
+
+        /* Leave unchanged and (if not opaque) transparent pixels alone */
+        __m256i skip = _mm256_cmpeq_epi32(color, old);
+        if (!opaque)
+            skip = _mm256_or_si256(skip,
+                    _mm256_cmpeq_epi32(_mm256_and_si256(pixels, alpha), zero));
+
+        unsigned int changed =
+            ~_mm256_movemask_ps(_mm256_castsi256_ps(skip)) & 0xFF;
+
+        if (changed) {
+            _mm256_storeu_si256((__m256i*) (dst + x),
+                    _mm256_blendv_epi8(color, old, skip));
+            __guac_common_surface_row_changed(x, changed, first, last);
+        }
+
+    }
+
+    return x;
+
+}
+
+/**
+ * Fills groups of four pixels using SSE4.1, as guac_common_surface_row_fill().
+ */
+__attribute__((target("sse4.1")))
+static int __guac_common_surface_row_fill_sse41(uint32_t* dst,
+        uint32_t color, int width, int* first, int* last) {
+
+    __m128i fill = _mm_set1_epi32((int) color);
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4) {
+
+        __m128i old = _mm_loadu_si128((const __m128i*) (dst + x));
+
+        unsigned int changed = ~_mm_movemask_ps(_mm_castsi128_ps(
+                    _mm_cmpeq_epi32(fill, old))) & 0xF;
+
+        if (changed) {
+            _mm_storeu_si128((__m128i*) (dst + x), fill);
+            __guac_common_surface_row_changed(x, changed, first, last);
+        }
+
+    }
+
+    return x;
+
+}
+
+/**
+ * Fills groups of eight pixels using AVX2, as guac_common_surface_row_fill().
+ */
+__attribute__((target("avx2")))
+static int __guac_common_surface_row_fill_avx2(uint32_t* dst,
+        uint32_t color, int width, int* first, int* last) {
+
+    __m256i fill = _mm256_set1_epi32((int) color);
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+
+        __m256i old = _mm256_loadu_si256((const __m256i*) (dst + x));
+
+        unsigned int changed = ~_mm256_movemask_ps(_mm256_castsi256_ps(
+                    _mm256_cmpeq_epi32(fill, old))) & 0xFF;
+
+        if (changed) {
+            _mm256_storeu_si256((__m256i*) (dst + x), fill);
+            __guac_common_surface_row_changed(x, changed, first, last);
+        }
+
+    }
+
+    return x;
+
+}
+
+/**
+ * Copies groups of four pixels using SSE4.1, as guac_common_surface_row_copy().
+ */
+__attribute__((target("sse4.1")))
+static int __guac_common_surface_row_copy_sse41(uint32_t* dst,
+        const uint32_t* src, int width, int* first, int* last) {
+
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4) {
+
+        __m128i pixels = _mm_loadu_si128((const __m128i*) (src + x));
+        __m128i old = _mm_loadu_si128((const __m128i*) (dst + x));
+
+        unsigned int changed = ~_mm_movemask_ps(_mm_castsi128_ps(
+                    _mm_cmpeq_epi32(pixels, old))) & 0xF;
+
+        if (changed) {
+            _mm_storeu_si128((__m128i*) (dst + x), pixels);
+            __guac_common_surface_row_changed(x, changed, first, last);
+        }
+
+    }
+
+    return x;
+
+}
+
+/**
+ * Copies groups of eight pixels using AVX2, as guac_common_surface_row_copy().
+ */
+__attribute__((target("avx2")))
+static int __guac_common_surface_row_copy_avx2(uint32_t* dst,
+        const uint32_t* src, int width, int* first, int* last) {
+
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+
+        __m256i pixels = _mm256_loadu_si256((const __m256i*) (src + x));
+        __m256i old = _mm256_loadu_si256((const __m256i*) (dst + x));
+
+        unsigned int changed = ~_mm256_movemask_ps(_mm256_castsi256_ps(
+                    _mm256_cmpeq_epi32(pixels, old))) & 0xFF;
+
+        if (changed) {
+            _mm256_storeu_si256((__m256i*) (dst + x), pixels);
+            __guac_common_surface_row_changed(x, changed, first, last);
+        }
+
+    }
+
+    return x;
+
+}
+
+/**
+ * Applies the given transfer function to four pixels using SSE4.1, as
+ * __guac_common_surface_row_transfer_pixel().
+ */
+__attribute__((target("sse4.1"), always_inline))
+static inline __m128i __guac_common_surface_row_transfer_sse41_pixels(
+        guac_transfer_function op, __m128i src, __m128i dst) {
+
+    __m128i ones = _mm_set1_epi32(-1);
+    __m128i nsrc = _mm_xor_si128(src, ones);
+    __m128i ndst = _mm_xor_si128(dst, ones);
+    __m128i result = _mm_setzero_si128();
+
+    /* Black is opaque, not the absence of every bit */
+    if (op == GUAC_TRANSFER_BINARY_BLACK)
+        return _mm_set1_epi32((int) 0xFF000000);
+
+    if (op & 0x1) result = _mm_or_si128(result, _mm_and_si128(src,  dst));
+    if (op & 0x2) result = _mm_or_si128(result, _mm_and_si128(src,  ndst));
+    if (op & 0x4) result = _mm_or_si128(result, _mm_and_si128(nsrc, dst));
+    if (op & 0x8) result = _mm_or_si128(result, _mm_and_si128(nsrc, ndst));
+
+    return result;
+
+}
+
+/**
+ * Combines groups of four pixels using SSE4.1, as
+ * guac_common_surface_row_transfer().
+ */
+__attribute__((target("sse4.1"), always_inline))
+static inline int __guac_common_surface_row_transfer_sse41_op(
+        guac_transfer_function op, uint32_t* dst, const uint32_t* src,
+        int width, int* first, int* last) {
+
+    int x;
+
+    for (x = 0; x + 4 <= width; x += 4) {
+
+        __m128i pixels = _mm_loadu_si128((const __m128i*) (src + x));
+        __m128i old = _mm_loadu_si128((const __m128i*) (dst + x));
+        __m128i color =
+            __guac_common_surface_row_transfer_sse41_pixels(op, pixels, old);
+
+        unsigned int changed = ~_mm_movemask_ps(_mm_castsi128_ps(
+                    _mm_cmpeq_epi32(color, old))) & 0xF;
+
+        if (changed) {
+            _mm_storeu_si128((__m128i*) (dst + x), color);
+            __guac_common_surface_row_changed(x, changed, first, last);
+        }
+
+    }
+
+    return x;
+
+}
+
+/**
+ * Combines groups of four pixels using SSE4.1 and an implementation
+ * specialized for the given transfer function.
+ */
+__attribute__((target("sse4.1")))
+static int __guac_common_surface_row_transfer_sse41(guac_transfer_function op,
+        uint32_t* dst, const uint32_t* src, int width, int* first, int* last) {
+
+    __GUAC_COMMON_SURFACE_ROW_TRANSFER_SPECIALIZE(
+            __guac_common_surface_row_transfer_sse41_op, op,
+            dst, src, width, first, last);
+
+    return 0;
+
+}
+
+/**
+ * Applies the given transfer function to eight pixels using AVX2, as
+ * __guac_common_surface_row_transfer_pixel().
+ */
+__attribute__((target("avx2"), always_inline))
+static inline __m256i __guac_common_surface_row_transfer_avx2_pixels(
+        guac_transfer_function op, __m256i src, __m256i dst) {
+
+    __m256i ones = _mm256_set1_epi32(-1);
+    __m256i nsrc = _mm256_xor_si256(src, ones);
+    __m256i ndst = _mm256_xor_si256(dst, ones);
+    __m256i result = _mm256_setzero_si256();
+
+    /* Black is opaque, not the absence of every bit */
+    if (op == GUAC_TRANSFER_BINARY_BLACK)
+        return _mm256_set1_epi32((int) 0xFF000000);
+
+    if (op & 0x1) result = _mm256_or_si256(result, _mm256_and_si256(src,  dst));
+    if (op & 0x2) result = _mm256_or_si256(result, _mm256_and_si256(src,  ndst));
+    if (op & 0x4) result = _mm256_or_si256(result, _mm256_and_si256(nsrc, dst));
+    if (op & 0x8) result = _mm256_or_si256(result, _mm256_and_si256(nsrc, ndst));
+
+    return result;
+
+}
+
+/**
+ * Combines groups of eight pixels using AVX2, as
+ * guac_common_surface_row_transfer().
+ */
+__attribute__((target("avx2"), always_inline))
+static inline int __guac_common_surface_row_transfer_avx2_op(
+        guac_transfer_function op, uint32_t* dst, const uint32_t* src,
+        int width, int* first, int* last) {
+
+    int x;
+
+    for (x = 0; x + 8 <= width; x += 8) {
+
+        __m256i pixels = _mm256_loadu_si256((const __m256i*) (src + x));
+        __m256i old = _mm256_loadu_si256((const __m256i*) (dst + x));
+        __m256i color =
+            __guac_common_surface_row_transfer_avx2_pixels(op, pixels, old);
+
+        unsigned int changed = ~_mm256_movemask_ps(_mm256_castsi256_ps(
+                    _mm256_cmpeq_epi32(color, old))) & 0xFF;
+
+        if (changed) {
+            _mm256_storeu_si256((__m256i*) (dst + x), color);
+            __guac_common_surface_row_changed(x, changed, first, last);
+        }
+
+    }
+
+    return x;
+
+}
+
+/**
+ * Combines groups of eight pixels using AVX2 and an implementation
+ * specialized for the given transfer function.
+ */
+__attribute__((target("avx2")))
+static int __guac_common_surface_row_transfer_avx2(guac_transfer_function op,
+        uint32_t* dst, const uint32_t* src, int width, int* first, int* last) {
+
+    __GUAC_COMMON_SURFACE_ROW_TRANSFER_SPECIALIZE(
+            __guac_common_surface_row_transfer_avx2_op, op,
+            dst, src, width, first, last);
+
+    return 0;
+
+}
+
+#endif
+
+int guac_common_surface_row_put(uint32_t* dst, const uint32_t* src, int width,
+        int opaque, int* first, int* last) {
+
+    int x = 0;
+    *first = -1;
+
+#ifdef HAVE_X86_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        x = __guac_common_surface_row_put_avx2(dst, src, width, opaque,
+                first, last);
+
+    else if (__builtin_cpu_supports("sse4.1"))
+        x = __guac_common_surface_row_put_sse41(dst, src, width, opaque,
+                first, last);
+#endif
+
+    __guac_common_surface_row_put_scalar(dst, src, x, width, opaque,
+            first, last);
+
+    return *first >= 0;
+
+}
+
+int guac_common_surface_row_fill(uint32_t* dst, uint32_t color, int width,
+        int* first, int* last) {
+
+    int x = 0;
+    *first = -1;
+
+#ifdef HAVE_X86_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        x = __guac_common_surface_row_fill_avx2(dst, color, width,
+                first, last);
+
+    else if (__builtin_cpu_supports("sse4.1"))
+        x = __guac_common_surface_row_fill_sse41(dst, color, width,
+                first, last);
+#endif
+
+    __guac_common_surface_row_fill_scalar(dst, color, x, width, first, last);
+
+    return *first >= 0;
+
+}
+
+int guac_common_surface_row_copy(uint32_t* dst, const uint32_t* src, int width,
+        int* first, int* last) {
+
+    int x = 0;
+    *first = -1;
+
+#ifdef HAVE_X86_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        x = __guac_common_surface_row_copy_avx2(dst, src, width, first, last);
+
+    else if (__builtin_cpu_supports("sse4.1"))
+        x = __guac_common_surface_row_copy_sse41(dst, src, width, first, last);
+#endif
+
+    __guac_common_surface_row_copy_scalar(dst, src, x, width, first, last);
+
+    return *first >= 0;
+
+}
+
+
+int guac_common_surface_row_transfer(uint32_t* dst, const uint32_t* src,
+        int width, guac_transfer_function op, int* first, int* last) {
+
+    int x = 0;
+
+    /* Plain copies have a dedicated implementation */
+    if (op == GUAC_TRANSFER_BINARY_SRC)
+        return guac_common_surface_row_copy(dst, src, width, first, last);
+
+    *first = -1;
+
+    /* The destination is never changed by DEST */
+    if (op == GUAC_TRANSFER_BINARY_DEST)
+        return 0;
+
+#ifdef HAVE_X86_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        x = __guac_common_surface_row_transfer_avx2(op, dst, src, width,
+                first, last);
+
+    else if (__builtin_cpu_supports("sse4.1"))
+        x = __guac_common_surface_row_transfer_sse41(op, dst, src, width,
+                first, last);
+#endif
+
+    __guac_common_surface_row_transfer_scalar(op, dst, src, x, width,
+            first, last);
+
+    return *first >= 0;
+
+}
+
@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef __GUAC_COMMON_SURFACE_ROW_H
+#define __GUAC_COMMON_SURFACE_ROW_H
+
+#include "config.h"
+
+#include <guacamole/protocol-types.h>
+
+#include <stdint.h>
+
+/**
+ * Row-level pixel operations used by guac_common_surface. Each operation
+ * updates a single row of 32-bit pixels in place, determining which pixels
+ * actually changed such that only those pixels need be sent to the client.
+ * Where supported by the CPU, SSE4.1 or AVX2 implementations are selected at
+ * runtime, handling four or eight pixels per step.
+ */
+
+/**
+ * Copies a row of image data over a row of a surface, forcing each copied
+ * pixel to be opaque. If the source is not opaque, fully-transparent source
+ * pixels are skipped.
+ *
+ * @param dst The row of pixels to update.
+ * @param src The row of pixels to copy.
+ * @param width The number of pixels in each row.
+ * @param opaque Non-zero if the source row is opaque (its alpha channel
+ *               should be ignored), zero otherwise.
+ * @param first Storage for the index of the first changed pixel.
+ * @param last Storage for the index of the last changed pixel.
+ * @return Non-zero if any pixel changed, zero otherwise. If no pixel
+ *         changed, the values stored in first and last are undefined.
+ */
+int guac_common_surface_row_put(uint32_t* dst, const uint32_t* src, int width,
+        int opaque, int* first, int* last);
+
+/**
+ * Fills a row of a surface with the given color.
+ *
+ * @param dst The row of pixels to update.
+ * @param color The color to fill the row with, including alpha.
+ * @param width The number of pixels in the row.
+ * @param first Storage for the index of the first changed pixel.
+ * @param last Storage for the index of the last changed pixel.
+ * @return Non-zero if any pixel changed, zero otherwise. If no pixel
+ *         changed, the values stored in first and last are undefined.
+ */
+int guac_common_surface_row_fill(uint32_t* dst, uint32_t color, int width,
+        int* first, int* last);
+
+/**
+ * Copies a row of pixels exactly, including alpha. Pixels are copied in
+ * ascending order, thus the rows may overlap only if the destination does
+ * not follow the source.
+ *
+ * @param dst The row of pixels to update.
+ * @param src The row of pixels to copy.
+ * @param width The number of pixels in each row.
+ * @param first Storage for the index of the first changed pixel.
+ * @param last Storage for the index of the last changed pixel.
+ * @return Non-zero if any pixel changed, zero otherwise. If no pixel
+ *         changed, the values stored in first and last are undefined.
+ */
+int guac_common_surface_row_copy(uint32_t* dst, const uint32_t* src, int width,
+        int* first, int* last);
+
+/**
+ * Combines a row of pixels with a row of a surface using the given transfer
+ * function. The transfer function is applied to every bit of each pixel,
+ * including alpha. A separate implementation is generated for each transfer
+ * function, such that the function need not be evaluated per pixel. Pixels
+ * are processed in ascending order, thus the rows may overlap only if the
+ * destination does not follow the source.
+ *
+ * @param dst The row of pixels to update.
+ * @param src The row of pixels to combine with the destination.
+ * @param width The number of pixels in each row.
+ * @param op The transfer function to apply.
+ * @param first Storage for the index of the first changed pixel.
+ * @param last Storage for the index of the last changed pixel.
+ * @return Non-zero if any pixel changed, zero otherwise. If no pixel
+ *         changed, the values stored in first and last are undefined.
+ */
+int guac_common_surface_row_transfer(uint32_t* dst, const uint32_t* src,
+        int width, guac_transfer_function op, int* first, int* last);
+
+#endif
+
@@ -27,7 +27,7 @@
 
 #include <guacamole/client.h>
 #include <guacamole/error.h>
-#include <guacamole/instruction.h>
+#include <guacamole/parser.h>
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
 #include <guacamole/timestamp.h>
@@ -57,7 +57,6 @@ void __guacdd_sleep(int millis) {
 void* __guacd_client_output_thread(void* data) {
 
     guac_client* client = (guac_client*) data;
-    guac_socket* socket = client->socket;
 
     guac_client_log(client, GUAC_LOG_DEBUG,
             "Starting output thread.");
@@ -80,23 +79,14 @@ void* __guacd_client_output_thread(void* data) {
                     return NULL;
                 }
 
-                /* Send sync instruction */
-                client->last_sent_timestamp = guac_timestamp_current();
-                if (guac_protocol_send_sync(socket, client->last_sent_timestamp)) {
+                /* Send sync instruction, flushing all output */
+                if (guac_client_send_sync(client)) {
                     guacd_client_log_guac_error(client, GUAC_LOG_DEBUG,
                             "Error sending \"sync\" instruction");
                     guac_client_stop(client);
                     return NULL;
                 }
 
-                /* Flush */
-                if (guac_socket_flush(socket)) {
-                    guacd_client_log_guac_error(client, GUAC_LOG_DEBUG,
-                            "Error flushing output");
-                    guac_client_stop(client);
-                    return NULL;
-                }
-
             }
 
             /* Do not spin while waiting for old sync */
@@ -119,16 +109,60 @@ void* __guacd_client_output_thread(void* data) {
 
 }
 
+/**
+ * The arguments of the input thread of a client.
+ */
+typedef struct guacd_client_input_thread_params {
+
+    /**
+     * The client whose instructions should be read and handled.
+     */
+    guac_client* client;
+
+    /**
+     * The parser to use to read instructions from the client's socket.
+     */
+    guac_parser* parser;
+
+} guacd_client_input_thread_params;
+
+/**
+ * Parser blob handler which passes each chunk of received blob content to the
+ * guac_client stored within the parser's data.
+ */
+static int __guacd_client_blob_handler(guac_parser* parser, int stream_index,
+        void* data, int length, int final) {
+
+    guac_client* client = (guac_client*) parser->data;
+
+    /* Reset guac_error and guac_error_message (client handlers are not
+     * guaranteed to set these) */
+    guac_error = GUAC_STATUS_SUCCESS;
+    guac_error_message = NULL;
+
+    return guac_client_handle_blob_chunk(client, stream_index, data, length,
+            final) < 0;
+
+}
+
 void* __guacd_client_input_thread(void* data) {
 
     char keystrokes_path[2048];
     int key_ascii;
-    guac_client* client = (guac_client*) data;
+    guacd_client_input_thread_params* params =
+        (guacd_client_input_thread_params*) data;
+
+    guac_client* client = params->client;
+    guac_parser* parser = params->parser;
     guac_socket* socket = client->socket;
 
     guac_client_log(client, GUAC_LOG_DEBUG,
             "Starting input thread.");
 
+    /* Handle blob content as it arrives */
+    parser->blob_handler = __guacd_client_blob_handler;
+    parser->data = client;
+
     if (client->keystrokes_flag)
     {
         sprintf(keystrokes_path, "%s/keys_%" PRId64 ".log", client->keystrokes_path, guac_timestamp_current());
@@ -138,12 +172,8 @@ void* __guacd_client_input_thread(void* data) {
     /* Guacamole client input loop */
     while (client->state == GUAC_CLIENT_RUNNING) {
 
-        /* Read instruction */
-        guac_instruction* instruction =
-            guac_instruction_read(socket, GUACD_USEC_TIMEOUT);
-
-        /* Stop on error */
-        if (instruction == NULL) {
+        /* Read instruction, stop on error */
+        if (guac_parser_read(parser, socket, GUACD_USEC_TIMEOUT)) {
 
             if (guac_error == GUAC_STATUS_TIMEOUT)
                 guac_client_abort(client, GUAC_PROTOCOL_STATUS_CLIENT_TIMEOUT, "Client is not responding.");
@@ -164,7 +194,8 @@ void* __guacd_client_input_thread(void* data) {
         guac_error_message = NULL;
 
         /* Call handler, stop on error */
-        if (guac_client_handle_instruction(client, instruction) < 0) {
+        if (guac_client_dispatch_instruction(client, parser->opcode,
+                    parser->argc, parser->argv) < 0) {
 
             /* Log error */
             guacd_client_log_guac_error(client, GUAC_LOG_WARNING,
@@ -173,18 +204,17 @@ void* __guacd_client_input_thread(void* data) {
             /* Log handler details */
             guac_client_log(client, GUAC_LOG_DEBUG,
                     "Failing instruction handler in client was \"%s\"",
-                    instruction->opcode);
+                    parser->opcode);
 
-            guac_instruction_free(instruction);
             guac_client_stop(client);
             return NULL;
         }
 
         if (client->keystrokes_file != NULL)
         {
-            if ((!strcmp(instruction->opcode, "key")) && (atoi(instruction->argv[1])))
+            if ((!strcmp(parser->opcode, "key")) && (atoi(parser->argv[1])))
             {
-                key_ascii = atoi(instruction->argv[0]);
+                key_ascii = atoi(parser->argv[0]);
                 if ((key_ascii < 127) && (key_ascii > 31))
                 {
                     fprintf(client->keystrokes_file,
@@ -197,14 +227,11 @@ void* __guacd_client_input_thread(void* data) {
                     fprintf(client->keystrokes_file,
                        "[%" PRId64 "] {%s}\n",
                        guac_timestamp_current(),
-                       instruction->argv[0]);
+                       parser->argv[0]);
                 }
             }
         }
 
-        /* Free allocated instruction */
-        guac_instruction_free(instruction);
-
     }
 
     if (client->keystrokes_file != NULL)
@@ -217,16 +244,25 @@ void* __guacd_client_input_thread(void* data) {
 
 }
 
-int guacd_client_start(guac_client* client) {
+int guacd_client_start(guac_client* client, guac_parser* parser) {
 
     pthread_t input_thread, output_thread;
 
+    guacd_client_input_thread_params input_params = {
+        .client = client,
+        .parser = parser
+    };
+
+    /* Queue output for slow clients rather than stalling the client plugin,
+     * which must continue handling its own server's messages */
+    guac_socket_require_nonblocking(client->socket);
+
     if (pthread_create(&output_thread, NULL, __guacd_client_output_thread, (void*) client)) {
         guac_client_log(client, GUAC_LOG_ERROR, "Unable to start output thread");
         return -1;
     }
 
-    if (pthread_create(&input_thread, NULL, __guacd_client_input_thread, (void*) client)) {
+    if (pthread_create(&input_thread, NULL, __guacd_client_input_thread, (void*) &input_params)) {
         guac_client_log(client, GUAC_LOG_ERROR, "Unable to start input thread");
         guac_client_stop(client);
         pthread_join(output_thread, NULL);
@@ -237,6 +273,10 @@ int guacd_client_start(guac_client* client) {
     pthread_join(input_thread, NULL);
     pthread_join(output_thread, NULL);
 
+    guac_client_log(client, GUAC_LOG_INFO,
+            "Socket lock contended %" PRIu64 " times during connection",
+            client->socket->lock_contention);
+
     /* Done */
     return 0;
 
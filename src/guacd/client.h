@@ -27,6 +27,7 @@
 #include "config.h"
 
 #include <guacamole/client.h>
+#include <guacamole/parser-types.h>
 
 /**
  * The time to allow between sync responses in milliseconds. If a sync
@@ -73,7 +74,23 @@
  */
 #define GUACD_CLIENT_MAX_CONNECTIONS 65536
 
-int guacd_client_start(guac_client* client);
+/**
+ * Starts the input and output threads of the given client, returning only
+ * after both threads have terminated. All instructions received from the
+ * client are read using the given parser, which may already contain data
+ * buffered during the handshake.
+ *
+ * @param client
+ *     The client to start.
+ *
+ * @param parser
+ *     The parser to use to read instructions from the client's socket.
+ *
+ * @return
+ *     Zero if the client ran normally, non-zero if its threads could not be
+ *     started.
+ */
+int guacd_client_start(guac_client* client, guac_parser* parser);
 
 #endif
 
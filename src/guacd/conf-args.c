@@ -35,7 +35,7 @@ int guacd_conf_parse_args(guacd_config* config, int argc, char** argv) {
 
     /* Parse arguments */
     int opt;
-    while ((opt = getopt(argc, argv, "l:b:p:L:C:K:f:d:k:")) != -1) {
+    while ((opt = getopt(argc, argv, "l:b:p:L:C:K:f:d:k:e:m:")) != -1) {
 
         /* -l: Bind port */
         if (opt == 'l') {
@@ -86,6 +86,36 @@ int guacd_conf_parse_args(guacd_config* config, int argc, char** argv) {
 
         }
 
+        /* -e: Image encoding threads per connection */
+        else if (opt == 'e') {
+
+            /* Validate and parse number of threads */
+            int threads = guacd_parse_bounded_int(optarg, 1,
+                    GUAC_CLIENT_MAX_ENCODER_THREADS);
+            if (threads == -1) {
+                fprintf(stderr, "Invalid number of encoder threads. Valid values are between 1 and %i.\n", GUAC_CLIENT_MAX_ENCODER_THREADS);
+                return 1;
+            }
+
+            config->encoder_threads = threads;
+
+        }
+
+        /* -m: Image cache size per connection */
+        else if (opt == 'm') {
+
+            /* Validate and parse cache size */
+            int size = guacd_parse_bounded_int(optarg, 0,
+                    GUACD_MAX_IMAGE_CACHE_SIZE);
+            if (size == -1) {
+                fprintf(stderr, "Invalid image cache size. Valid sizes are between 0 and %i megabytes.\n", GUACD_MAX_IMAGE_CACHE_SIZE);
+                return 1;
+            }
+
+            config->image_cache_size = size;
+
+        }
+
 #ifdef ENABLE_SSL
         /* -C SSL certificate */
         else if (opt == 'C') {
@@ -118,6 +148,8 @@ int guacd_conf_parse_args(guacd_config* config, int argc, char** argv) {
                     " [-d DUMPDIR]"
                     " [-k KEYSTROKESDUMPDIR]"
                     " [-L LEVEL]"
+                    " [-e THREADS]"
+                    " [-m CACHE_MB]"
 #ifdef ENABLE_SSL
                     " [-C CERTIFICATE_FILE]"
                     " [-K PEM_FILE]"
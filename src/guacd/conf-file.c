@@ -91,6 +91,93 @@ static int guacd_conf_callback(const char* section, const char* param, const cha
 
         }
 
+        /* Image encoding threads per connection */
+        else if (strcmp(param, "encoder_threads") == 0) {
+
+            int threads = guacd_parse_bounded_int(value, 1,
+                    GUAC_CLIENT_MAX_ENCODER_THREADS);
+
+            /* Invalid thread count */
+            if (threads < 0) {
+                guacd_conf_parse_error = "Invalid number of encoder threads. Valid values are between 1 and 64.";
+                return 1;
+            }
+
+            /* Valid thread count */
+            config->encoder_threads = threads;
+            return 0;
+
+        }
+
+        /* Image cache size per connection */
+        else if (strcmp(param, "image_cache_size") == 0) {
+
+            int size = guacd_parse_bounded_int(value, 0,
+                    GUACD_MAX_IMAGE_CACHE_SIZE);
+
+            /* Invalid cache size */
+            if (size < 0) {
+                guacd_conf_parse_error = "Invalid image cache size. Valid sizes are between 0 and 1024 megabytes.";
+                return 1;
+            }
+
+            /* Valid cache size */
+            config->image_cache_size = size;
+            return 0;
+
+        }
+
+        /* PNG compression level */
+        else if (strcmp(param, "png_compression_level") == 0) {
+
+            int level = guacd_parse_bounded_int(value, 0, 9);
+
+            /* Invalid compression level */
+            if (level < 0) {
+                guacd_conf_parse_error = "Invalid PNG compression level. Valid levels are between 0 and 9.";
+                return 1;
+            }
+
+            /* Valid compression level */
+            config->png_compression_level = level;
+            return 0;
+
+        }
+
+        /* PNG compression strategy */
+        else if (strcmp(param, "png_compression_strategy") == 0) {
+
+            int strategy = guacd_parse_png_strategy(value);
+
+            /* Invalid strategy */
+            if (strategy < 0) {
+                guacd_conf_parse_error = "Invalid PNG compression strategy. Valid strategies are: \"default\", \"filtered\", \"huffman_only\", and \"rle\".";
+                return 1;
+            }
+
+            /* Valid strategy */
+            config->png_compression_strategy = strategy;
+            return 0;
+
+        }
+
+        /* PNG row filter */
+        else if (strcmp(param, "png_filter") == 0) {
+
+            int filter = guacd_parse_png_filter(value);
+
+            /* Invalid filter */
+            if (filter < 0) {
+                guacd_conf_parse_error = "Invalid PNG filter. Valid filters are: \"default\", \"none\", \"sub\", \"up\", and \"adaptive\".";
+                return 1;
+            }
+
+            /* Valid filter */
+            config->png_filter = filter;
+            return 0;
+
+        }
+
     }
 
     /* SSL-specific options */
@@ -187,6 +274,11 @@ guacd_config* guacd_conf_load() {
     conf->keys_path = NULL;
     conf->foreground = 0;
     conf->max_log_level = GUAC_LOG_INFO;
+    conf->encoder_threads = 1;
+    conf->image_cache_size = GUACD_DEFAULT_IMAGE_CACHE_SIZE;
+    conf->png_compression_level = -1;
+    conf->png_compression_strategy = GUAC_CLIENT_PNG_STRATEGY_DEFAULT;
+    conf->png_filter = GUAC_CLIENT_PNG_FILTER_DEFAULT;
 
 #ifdef ENABLE_SSL
     conf->cert_file = NULL;
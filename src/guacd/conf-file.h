@@ -27,6 +27,18 @@
 
 #include <guacamole/client.h>
 
+/**
+ * The default amount of client-side memory which each connection may use to
+ * cache images, in megabytes.
+ */
+#define GUACD_DEFAULT_IMAGE_CACHE_SIZE 16
+
+/**
+ * The maximum amount of client-side memory which each connection may be
+ * configured to use to cache images, in megabytes.
+ */
+#define GUACD_MAX_IMAGE_CACHE_SIZE 1024
+
 /**
  * The contents of a guacd configuration file.
  */
@@ -89,6 +101,35 @@ typedef struct guacd_config {
      */
     guac_client_log_level max_log_level;
 
+    /**
+     * The number of threads each connection may use to encode images,
+     * including the thread handling the connection itself. Image encoding is
+     * serial if this is 1.
+     */
+    int encoder_threads;
+
+    /**
+     * The amount of client-side memory each connection may use to cache
+     * images, in megabytes. Image caching is disabled if this is 0.
+     */
+    int image_cache_size;
+
+    /**
+     * The zlib compression level used for PNG images, from 0 to 9, or -1 to
+     * use zlib's default.
+     */
+    int png_compression_level;
+
+    /**
+     * The zlib compression strategy used for PNG images.
+     */
+    guac_client_png_strategy png_compression_strategy;
+
+    /**
+     * The row filter used for PNG images.
+     */
+    guac_client_png_filter png_filter;
+
 } guacd_config;
 
 /**
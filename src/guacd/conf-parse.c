@@ -536,3 +536,57 @@ int guacd_parse_log_level(const char* name) {
 
 }
 
+int guacd_parse_png_strategy(const char* name) {
+
+    /* Translate strategy name */
+    if (strcmp(name, "default")      == 0) return GUAC_CLIENT_PNG_STRATEGY_DEFAULT;
+    if (strcmp(name, "filtered")     == 0) return GUAC_CLIENT_PNG_STRATEGY_FILTERED;
+    if (strcmp(name, "huffman_only") == 0) return GUAC_CLIENT_PNG_STRATEGY_HUFFMAN_ONLY;
+    if (strcmp(name, "rle")          == 0) return GUAC_CLIENT_PNG_STRATEGY_RLE;
+
+    /* No such strategy */
+    return -1;
+
+}
+
+int guacd_parse_png_filter(const char* name) {
+
+    /* Translate filter name */
+    if (strcmp(name, "default")  == 0) return GUAC_CLIENT_PNG_FILTER_DEFAULT;
+    if (strcmp(name, "none")     == 0) return GUAC_CLIENT_PNG_FILTER_NONE;
+    if (strcmp(name, "sub")      == 0) return GUAC_CLIENT_PNG_FILTER_SUB;
+    if (strcmp(name, "up")       == 0) return GUAC_CLIENT_PNG_FILTER_UP;
+    if (strcmp(name, "adaptive") == 0) return GUAC_CLIENT_PNG_FILTER_ADAPTIVE;
+
+    /* No such filter */
+    return -1;
+
+}
+
+int guacd_parse_bounded_int(const char* value, int min, int max) {
+
+    int parsed = 0;
+
+    /* Require at least one digit */
+    if (*value == '\0')
+        return -1;
+
+    /* Parse decimal digits only, refusing anything out of range */
+    for (; *value != '\0'; value++) {
+
+        if (!isdigit((unsigned char) *value))
+            return -1;
+
+        parsed = parsed * 10 + (*value - '0');
+        if (parsed > max)
+            return -1;
+
+    }
+
+    if (parsed < min)
+        return -1;
+
+    return parsed;
+
+}
+
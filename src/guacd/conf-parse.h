@@ -56,6 +56,25 @@ int guacd_parse_conf(guacd_param_callback* callback, char* buffer, int length, v
  */
 int guacd_parse_log_level(const char* name);
 
+/**
+ * Parses the given zlib strategy name, returning the corresponding PNG
+ * compression strategy, or -1 if no such strategy exists.
+ */
+int guacd_parse_png_strategy(const char* name);
+
+/**
+ * Parses the given PNG filter name, returning the corresponding PNG filter,
+ * or -1 if no such filter exists.
+ */
+int guacd_parse_png_filter(const char* name);
+
+/**
+ * Parses the given non-negative decimal integer, returning the parsed value,
+ * or -1 if the value is not a number between the given minimum and maximum
+ * inclusive.
+ */
+int guacd_parse_bounded_int(const char* value, int min, int max);
+
 /**
  * Human-readable description of the current error, if any.
  */
@@ -30,7 +30,7 @@
 
 #include <guacamole/client.h>
 #include <guacamole/error.h>
-#include <guacamole/instruction.h>
+#include <guacamole/parser.h>
 #include <guacamole/plugin.h>
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
@@ -145,21 +145,23 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket,
 
     guac_client* client;
     guac_client_plugin* plugin;
-    guac_instruction* select;
-    guac_instruction* size;
-    guac_instruction* audio;
-    guac_instruction* video;
-    guac_instruction* image;
-    guac_instruction* connect;
+    guac_parser* parser;
     int init_result;
 
     /* Reset guac_error */
     guac_error = GUAC_STATUS_SUCCESS;
     guac_error_message = NULL;
 
+    /* Allocate parser for handshake and all further instructions */
+    parser = guac_parser_alloc();
+    if (parser == NULL) {
+        guacd_log_guac_error(GUAC_LOG_ERROR, "Unable to create parser");
+        guac_socket_free(socket);
+        return;
+    }
+
     /* Get protocol from select instruction */
-    select = guac_instruction_expect(socket, GUACD_USEC_TIMEOUT, "select");
-    if (select == NULL) {
+    if (guac_parser_expect(parser, socket, GUACD_USEC_TIMEOUT, "select")) {
 
         /* Log error */
         guacd_log_handshake_failure();
@@ -167,29 +169,30 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket,
                 "Error reading \"select\"");
 
         /* Free resources */
+        guac_parser_free(parser);
         guac_socket_free(socket);
         return;
 
     }
 
     /* Validate args to select */
-    if (select->argc != 1) {
+    if (parser->argc != 1) {
 
         /* Log error */
         guacd_log_handshake_failure();
         guacd_log(GUAC_LOG_ERROR, "Bad number of arguments to \"select\" (%i)",
-                select->argc);
+                parser->argc);
 
         /* Free resources */
+        guac_parser_free(parser);
         guac_socket_free(socket);
         return;
     }
 
-    guacd_log(GUAC_LOG_INFO, "Protocol \"%s\" selected", select->argv[0]);
+    guacd_log(GUAC_LOG_INFO, "Protocol \"%s\" selected", parser->argv[0]);
 
     /* Get plugin from protocol in select */
-    plugin = guac_client_plugin_open(select->argv[0]);
-    guac_instruction_free(select);
+    plugin = guac_client_plugin_open(parser->argv[0]);
 
     if (plugin == NULL) {
 
@@ -202,6 +205,7 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket,
                     "Unable to load client plugin");
 
         /* Free resources */
+        guac_parser_free(parser);
         guac_socket_free(socket);
         return;
     }
@@ -218,6 +222,7 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket,
             guacd_log_guac_error(GUAC_LOG_WARNING,
                     "Unable to close client plugin");
 
+        guac_parser_free(parser);
         guac_socket_free(socket);
         return;
     }
@@ -226,14 +231,13 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket,
     client = guac_client_alloc();
     if (client == NULL) {
         guacd_log_guac_error(GUAC_LOG_ERROR, "Unable to create client");
+        guac_parser_free(parser);
         guac_socket_free(socket);
         return;
     }
 
     /* Get optimal screen size */
-    size = guac_instruction_expect(
-            socket, GUACD_USEC_TIMEOUT, "size");
-    if (size == NULL) {
+    if (guac_parser_expect(parser, socket, GUACD_USEC_TIMEOUT, "size")) {
 
         /* Log error */
         guacd_log_handshake_failure();
@@ -241,28 +245,25 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket,
 
         /* Free resources */
         guac_client_free(client);
+        guac_parser_free(parser);
         guac_socket_free(socket);
         return;
     }
 
     /* Parse optimal screen dimensions from size instruction */
-    client->info.optimal_width  = atoi(size->argv[0]);
-    client->info.optimal_height = atoi(size->argv[1]);
+    client->info.optimal_width  = atoi(parser->argv[0]);
+    client->info.optimal_height = atoi(parser->argv[1]);
 
     /* If DPI given, set the client resolution */
-    if (size->argc >= 3)
-        client->info.optimal_resolution = atoi(size->argv[2]);
+    if (parser->argc >= 3)
+        client->info.optimal_resolution = atoi(parser->argv[2]);
 
     /* Otherwise, use a safe default for rough backwards compatibility */
     else
         client->info.optimal_resolution = 96;
 
-    guac_instruction_free(size);
-
     /* Get supported audio formats */
-    audio = guac_instruction_expect(
-            socket, GUACD_USEC_TIMEOUT, "audio");
-    if (audio == NULL) {
+    if (guac_parser_expect(parser, socket, GUACD_USEC_TIMEOUT, "audio")) {
 
         /* Log error */
         guacd_log_handshake_failure();
@@ -270,20 +271,17 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket,
 
         /* Free resources */
         guac_client_free(client);
+        guac_parser_free(parser);
         guac_socket_free(socket);
         return;
     }
 
     /* Store audio mimetypes */
     client->info.audio_mimetypes =
-        guacd_copy_mimetypes(audio->argv, audio->argc);
-
-    guac_instruction_free(audio);
+        guacd_copy_mimetypes(parser->argv, parser->argc);
 
     /* Get supported video formats */
-    video = guac_instruction_expect(
-            socket, GUACD_USEC_TIMEOUT, "video");
-    if (video == NULL) {
+    if (guac_parser_expect(parser, socket, GUACD_USEC_TIMEOUT, "video")) {
 
         /* Log error */
         guacd_log_handshake_failure();
@@ -291,20 +289,17 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket,
 
         /* Free resources */
         guac_client_free(client);
+        guac_parser_free(parser);
         guac_socket_free(socket);
         return;
     }
 
     /* Store video mimetypes */
     client->info.video_mimetypes =
-        guacd_copy_mimetypes(video->argv, video->argc);
-
-    guac_instruction_free(video);
+        guacd_copy_mimetypes(parser->argv, parser->argc);
 
     /* Get supported image formats */
-    image = guac_instruction_expect(
-            socket, GUACD_USEC_TIMEOUT, "image");
-    if (image == NULL) {
+    if (guac_parser_expect(parser, socket, GUACD_USEC_TIMEOUT, "image")) {
 
         /* Log error */
         guacd_log_handshake_failure();
@@ -312,20 +307,17 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket,
 
         /* Free resources */
         guac_client_free(client);
+        guac_parser_free(parser);
         guac_socket_free(socket);
         return;
     }
 
     /* Store image mimetypes */
     client->info.image_mimetypes =
-        guacd_copy_mimetypes(image->argv, image->argc);
-
-    guac_instruction_free(image);
+        guacd_copy_mimetypes(parser->argv, parser->argc);
 
     /* Get args from connect instruction */
-    connect = guac_instruction_expect(
-            socket, GUACD_USEC_TIMEOUT, "connect");
-    if (connect == NULL) {
+    if (guac_parser_expect(parser, socket, GUACD_USEC_TIMEOUT, "connect")) {
 
         /* Log error */
         guacd_log_handshake_failure();
@@ -336,6 +328,7 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket,
                     "Unable to close client plugin");
 
         guac_client_free(client);
+        guac_parser_free(parser);
         guac_socket_free(socket);
         return;
     }
@@ -347,6 +340,17 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket,
     client->keystrokes_flag = config->keys;
     client->keystrokes_path = config->keys_path;
 
+    /* Allow images to be encoded in parallel if configured */
+    client->encoder_threads = config->encoder_threads;
+
+    /* Cache repeated images within client-side buffers */
+    client->image_cache_size = config->image_cache_size * 1024 * 1024;
+
+    /* Trade PNG compression against encoding time if configured */
+    client->png_compression_level = config->png_compression_level;
+    client->png_compression_strategy = config->png_compression_strategy;
+    client->png_filter = config->png_filter;
+
     /* Store client */
     if (guacd_client_map_add(map, client))
         guacd_log(GUAC_LOG_ERROR, "Unable to add client. Internal client storage has failed");
@@ -357,9 +361,7 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket,
 
     /* Init client */
     init_result = guac_client_plugin_init_client(plugin,
-                client, connect->argc, connect->argv);
-
-    guac_instruction_free(connect);
+                client, parser->argc, parser->argv);
 
     /* If client could not be started, free everything and fail */
     if (init_result) {
@@ -372,13 +374,14 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket,
             guacd_log_guac_error(GUAC_LOG_WARNING,
                     "Unable to close client plugin");
 
+        guac_parser_free(parser);
         guac_socket_free(socket);
         return;
     }
 
     /* Start client threads */
     guacd_log(GUAC_LOG_INFO, "Starting client");
-    if (guacd_client_start(client))
+    if (guacd_client_start(client, parser))
         guacd_log(GUAC_LOG_WARNING, "Client finished abnormally");
     else
         guacd_log(GUAC_LOG_INFO, "Client disconnected");
@@ -399,6 +402,7 @@ static void guacd_handle_connection(guacd_client_map* map, guac_socket* socket,
                 "Unable to close client plugin");
 
     /* Close socket */
+    guac_parser_free(parser);
     guac_socket_free(socket);
 
 }
@@ -25,7 +25,9 @@
 #include "socket-ssl.h"
 
 #include <stdlib.h>
+#include <string.h>
 #include <sys/select.h>
+#include <sys/uio.h>
 
 #include <guacamole/error.h>
 #include <guacamole/socket.h>
@@ -69,6 +71,105 @@ static ssize_t __guac_socket_ssl_write_handler(guac_socket* socket,
 
 }
 
+/**
+ * Writes the given data in its entirety over the given SSL connection,
+ * setting guac_error appropriately if an error occurs.
+ *
+ * @param data
+ *     The SSL socket data of the guac_socket being written to.
+ *
+ * @param buf
+ *     The data to write.
+ *
+ * @param count
+ *     The number of bytes to write.
+ *
+ * @return
+ *     Zero on success, or non-zero if an error occurs.
+ */
+static int __guac_socket_ssl_write_all(guac_socket_ssl_data* data,
+        const void* buf, size_t count) {
+
+    /* Without partial writes enabled, SSL_write() writes everything or
+     * fails */
+    if (SSL_write(data->ssl, buf, count) <= 0) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Error writing data to secure socket";
+        return 1;
+    }
+
+    return 0;
+
+}
+
+static ssize_t __guac_socket_ssl_writev_handler(guac_socket* socket,
+        const struct iovec* iov, int iovcnt) {
+
+    guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
+
+    char record[GUAC_SOCKET_SSL_RECORD_SIZE];
+    size_t length = 0;
+    ssize_t written = 0;
+    int i;
+
+    for (i = 0; i < iovcnt; i++) {
+
+        const char* buf = iov[i].iov_base;
+        size_t count = iov[i].iov_len;
+
+        /* Write buffers spanning entire records directly, after any
+         * previously-coalesced data */
+        if (count >= GUAC_SOCKET_SSL_RECORD_SIZE) {
+
+            if (length > 0) {
+                if (__guac_socket_ssl_write_all(data, record, length))
+                    return -1;
+                written += length;
+                length = 0;
+            }
+
+            if (__guac_socket_ssl_write_all(data, buf, count))
+                return -1;
+
+            written += count;
+            continue;
+
+        }
+
+        /* Coalesce smaller buffers into full records */
+        while (count > 0) {
+
+            size_t available = sizeof(record) - length;
+            if (available > count)
+                available = count;
+
+            memcpy(record + length, buf, available);
+            length += available;
+            buf += available;
+            count -= available;
+
+            if (length == sizeof(record)) {
+                if (__guac_socket_ssl_write_all(data, record, length))
+                    return -1;
+                written += length;
+                length = 0;
+            }
+
+        }
+
+    }
+
+    /* Write any remaining coalesced data */
+    if (length > 0) {
+        if (__guac_socket_ssl_write_all(data, record, length))
+            return -1;
+        written += length;
+    }
+
+    return written;
+
+}
+
 static int __guac_socket_ssl_select_handler(guac_socket* socket, int usec_timeout) {
 
     guac_socket_ssl_data* data = (guac_socket_ssl_data*) socket->data;
@@ -146,6 +247,7 @@ guac_socket* guac_socket_open_secure(SSL_CTX* context, int fd, int dump_flag, ch
     /* Set read/write handlers */
     socket->read_handler   = __guac_socket_ssl_read_handler;
     socket->write_handler  = __guac_socket_ssl_write_handler;
+    socket->writev_handler = __guac_socket_ssl_writev_handler;
     socket->select_handler = __guac_socket_ssl_select_handler;
     socket->free_handler   = __guac_socket_ssl_free_handler;
 
@@ -29,6 +29,13 @@
 #include <guacamole/socket.h>
 #include <openssl/ssl.h>
 
+/**
+ * The maximum number of bytes of application data within a single SSL/TLS
+ * record. Smaller segments of output are coalesced into records of up to this
+ * size when a secure socket is flushed.
+ */
+#define GUAC_SOCKET_SSL_RECORD_SIZE 16384
+
 /**
  * SSL socket-specific data.
  */
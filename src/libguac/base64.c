@@ -0,0 +1,510 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "base64.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/**
+ * The base64 alphabet, indexed by the 6-bit value of each character.
+ */
+static const char __guac_base64_characters[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * The 6-bit value of each possible base64 character. Characters which are not
+ * part of the base64 alphabet have the value zero, consistent with the
+ * behavior of guac_protocol_decode_base64().
+ */
+static const unsigned char __guac_base64_values[256] = {
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0, 62,  0,  0,  0, 63,
+    52, 53, 54, 55, 56, 57, 58, 59, 60, 61,  0,  0,  0,  0,  0,  0,
+     0,  0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14,
+    15, 16, 17, 18, 19, 20, 21, 22, 23, 24, 25,  0,  0,  0,  0,  0,
+     0, 26, 27, 28, 29, 30, 31, 32, 33, 34, 35, 36, 37, 38, 39, 40,
+    41, 42, 43, 44, 45, 46, 47, 48, 49, 50, 51,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,
+     0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0,  0
+};
+
+/**
+ * Encodes as many whole groups of three bytes as possible using only scalar
+ * operations.
+ *
+ * @param data
+ *     The data to encode.
+ *
+ * @param length
+ *     The number of bytes of data available.
+ *
+ * @param output
+ *     The buffer which should receive the base64 characters.
+ *
+ * @return
+ *     The number of base64 characters written to the output buffer.
+ */
+static size_t __guac_base64_encode_scalar(const unsigned char* data,
+        size_t length, char* output) {
+
+    char* current = output;
+
+    while (length >= 3) {
+
+        int a = data[0];
+        int b = data[1];
+        int c = data[2];
+
+        current[0] = __guac_base64_characters[a >> 2];
+        current[1] = __guac_base64_characters[((a & 0x03) << 4) | (b >> 4)];
+        current[2] = __guac_base64_characters[((b & 0x0F) << 2) | (c >> 6)];
+        current[3] = __guac_base64_characters[c & 0x3F];
+
+        data += 3;
+        length -= 3;
+        current += 4;
+
+    }
+
+    return current - output;
+
+}
+
+/**
+ * Decodes the given base64 characters using only scalar operations. Any
+ * trailing characters which do not form a complete group of four are decoded
+ * to as many whole bytes as they describe.
+ *
+ * @param base64
+ *     The base64 characters to decode. This must not contain padding.
+ *
+ * @param length
+ *     The number of base64 characters to decode.
+ *
+ * @param output
+ *     The buffer which should receive the decoded bytes.
+ *
+ * @return
+ *     The number of bytes written to the output buffer.
+ */
+static size_t __guac_base64_decode_scalar(const unsigned char* base64,
+        size_t length, unsigned char* output) {
+
+    unsigned char* current = output;
+
+    int bits_read = 0;
+    int value = 0;
+
+    /* Decode all whole groups of four characters */
+    while (length >= 4) {
+
+        uint32_t group = (__guac_base64_values[base64[0]] << 18)
+                       | (__guac_base64_values[base64[1]] << 12)
+                       | (__guac_base64_values[base64[2]] << 6)
+                       |  __guac_base64_values[base64[3]];
+
+        current[0] = group >> 16;
+        current[1] = group >> 8;
+        current[2] = group;
+
+        base64 += 4;
+        length -= 4;
+        current += 3;
+
+    }
+
+    /* Decode any remaining partial group */
+    while (length > 0) {
+
+        value = (value << 6) | __guac_base64_values[*(base64++)];
+        bits_read += 6;
+        length--;
+
+        /* Write out the latest whole byte, if any */
+        if (bits_read >= 8) {
+            *(current++) = (value >> (bits_read - 8)) & 0xFF;
+            bits_read -= 8;
+        }
+
+    }
+
+    return current - output;
+
+}
+
+#ifdef HAVE_X86_SIMD
+
+/**
+ * Rearranges the first twelve bytes of each 128-bit lane of the given vector
+ * into sixteen 6-bit values, one per byte, in base64 character order.
+ */
+#define GUAC_BASE64_ENC_RESHUFFLE(width, vector)                              \
+    do {                                                                      \
+        __m##width##i t0, t1, t2, t3;                                         \
+        vector = GUAC_SIMD(width, shuffle_epi8)(vector, GUAC_SIMD(width,      \
+                    setr_epi8)(GUAC_BASE64_ENC_SHUFFLE));                     \
+        t0 = GUAC_SIMD(width, and_si##width)(vector,                          \
+                GUAC_SIMD(width, set1_epi32)(0x0FC0FC00));                    \
+        t1 = GUAC_SIMD(width, mulhi_epu16)(t0,                                \
+                GUAC_SIMD(width, set1_epi32)(0x04000040));                    \
+        t2 = GUAC_SIMD(width, and_si##width)(vector,                          \
+                GUAC_SIMD(width, set1_epi32)(0x003F03F0));                    \
+        t3 = GUAC_SIMD(width, mullo_epi16)(t2,                                \
+                GUAC_SIMD(width, set1_epi32)(0x01000010));                    \
+        vector = GUAC_SIMD(width, or_si##width)(t1, t3);                      \
+    } while (0)
+
+/**
+ * Translates each 6-bit value within the given vector into the corresponding
+ * base64 character.
+ */
+#define GUAC_BASE64_ENC_TRANSLATE(width, vector)                              \
+    do {                                                                      \
+        __m##width##i indices = GUAC_SIMD(width, subs_epu8)(vector,           \
+                GUAC_SIMD(width, set1_epi8)(51));                             \
+        __m##width##i mask = GUAC_SIMD(width, cmpgt_epi8)(vector,             \
+                GUAC_SIMD(width, set1_epi8)(25));                             \
+        indices = GUAC_SIMD(width, sub_epi8)(indices, mask);                  \
+        vector = GUAC_SIMD(width, add_epi8)(vector,                           \
+                GUAC_SIMD(width, shuffle_epi8)(GUAC_SIMD(width,               \
+                        setr_epi8)(GUAC_BASE64_ENC_OFFSETS), indices));       \
+    } while (0)
+
+/**
+ * Translates each base64 character within the given vector into its 6-bit
+ * value, jumping to the given label if any character is not part of the
+ * base64 alphabet.
+ */
+#define GUAC_BASE64_DEC_TRANSLATE(width, vector, invalid)                     \
+    do {                                                                      \
+        __m##width##i mask_2f = GUAC_SIMD(width, set1_epi8)(0x2F);            \
+        __m##width##i hi_nibbles = GUAC_SIMD(width, and_si##width)(           \
+                GUAC_SIMD(width, srli_epi32)(vector, 4), mask_2f);            \
+        __m##width##i lo_nibbles = GUAC_SIMD(width, and_si##width)(           \
+                vector, mask_2f);                                             \
+        __m##width##i hi = GUAC_SIMD(width, shuffle_epi8)(GUAC_SIMD(width,    \
+                    setr_epi8)(GUAC_BASE64_DEC_LUT_HI), hi_nibbles);          \
+        __m##width##i lo = GUAC_SIMD(width, shuffle_epi8)(GUAC_SIMD(width,    \
+                    setr_epi8)(GUAC_BASE64_DEC_LUT_LO), lo_nibbles);          \
+        __m##width##i eq_2f;                                                  \
+        if (GUAC_SIMD(width, movemask_epi8)(GUAC_SIMD(width, cmpeq_epi8)(     \
+                    GUAC_SIMD(width, and_si##width)(lo, hi),                  \
+                    GUAC_SIMD(width, setzero_si##width)())) != (int) mask)    \
+            goto invalid;                                                     \
+        eq_2f = GUAC_SIMD(width, cmpeq_epi8)(vector, mask_2f);                \
+        vector = GUAC_SIMD(width, add_epi8)(vector,                           \
+                GUAC_SIMD(width, shuffle_epi8)(GUAC_SIMD(width,               \
+                        setr_epi8)(GUAC_BASE64_DEC_LUT_ROLL),                 \
+                    GUAC_SIMD(width, add_epi8)(eq_2f, hi_nibbles)));          \
+    } while (0)
+
+/**
+ * Packs the sixteen 6-bit values within each 128-bit lane of the given vector
+ * into twelve bytes at the beginning of that lane.
+ */
+#define GUAC_BASE64_DEC_RESHUFFLE(width, vector)                              \
+    do {                                                                      \
+        vector = GUAC_SIMD(width, maddubs_epi16)(vector,                      \
+                GUAC_SIMD(width, set1_epi32)(0x01400140));                    \
+        vector = GUAC_SIMD(width, madd_epi16)(vector,                         \
+                GUAC_SIMD(width, set1_epi32)(0x00011000));                    \
+        vector = GUAC_SIMD(width, shuffle_epi8)(vector, GUAC_SIMD(width,      \
+                    setr_epi8)(GUAC_BASE64_DEC_SHUFFLE));                     \
+    } while (0)
+
+/**
+ * Resolves to the name of the given SSE/AVX intrinsic for the given vector
+ * width (128 or 256 bits).
+ */
+#define GUAC_SIMD(width, name) GUAC_SIMD_ ## width(name)
+#define GUAC_SIMD_128(name) _mm_ ## name
+#define GUAC_SIMD_256(name) _mm256_ ## name
+
+/*
+ * Per-lane constants for the above. Each is repeated once for every 128-bit
+ * lane of the vector used.
+ */
+
+#define GUAC_BASE64_ENC_SHUFFLE_LANE \
+    1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10
+
+#define GUAC_BASE64_ENC_OFFSETS_LANE \
+    65, 71, -4, -4, -4, -4, -4, -4, -4, -4, -4, -4, -19, -16, 0, 0
+
+#define GUAC_BASE64_DEC_LUT_HI_LANE \
+    0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, \
+    0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+
+#define GUAC_BASE64_DEC_LUT_LO_LANE \
+    0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, \
+    0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A
+
+#define GUAC_BASE64_DEC_LUT_ROLL_LANE \
+    0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+
+#define GUAC_BASE64_DEC_SHUFFLE_LANE \
+    2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+
+/**
+ * Encodes as many whole groups of three bytes as possible using SSSE3,
+ * falling back to scalar operations for the remainder.
+ */
+__attribute__((target("ssse3")))
+static size_t __guac_base64_encode_ssse3(const unsigned char* data,
+        size_t length, char* output) {
+
+#define GUAC_BASE64_ENC_SHUFFLE  GUAC_BASE64_ENC_SHUFFLE_LANE
+#define GUAC_BASE64_ENC_OFFSETS  GUAC_BASE64_ENC_OFFSETS_LANE
+
+    char* current = output;
+
+    /* Each iteration reads 16 bytes but encodes only the first 12 */
+    while (length >= 16) {
+
+        __m128i vector = _mm_loadu_si128((const __m128i*) data);
+
+        GUAC_BASE64_ENC_RESHUFFLE(128, vector);
+        GUAC_BASE64_ENC_TRANSLATE(128, vector);
+
+        _mm_storeu_si128((__m128i*) current, vector);
+
+        data += 12;
+        length -= 12;
+        current += 16;
+
+    }
+
+#undef GUAC_BASE64_ENC_SHUFFLE
+#undef GUAC_BASE64_ENC_OFFSETS
+
+    return (current - output)
+        + __guac_base64_encode_scalar(data, length, current);
+
+}
+
+/**
+ * Encodes as many whole groups of three bytes as possible using AVX2,
+ * falling back to SSSE3 for the remainder.
+ */
+__attribute__((target("avx2")))
+static size_t __guac_base64_encode_avx2(const unsigned char* data,
+        size_t length, char* output) {
+
+#define GUAC_BASE64_ENC_SHUFFLE \
+    GUAC_BASE64_ENC_SHUFFLE_LANE, GUAC_BASE64_ENC_SHUFFLE_LANE
+#define GUAC_BASE64_ENC_OFFSETS \
+    GUAC_BASE64_ENC_OFFSETS_LANE, GUAC_BASE64_ENC_OFFSETS_LANE
+
+    char* current = output;
+
+    /* Each iteration reads 28 bytes but encodes only the first 24, with the
+     * upper lane loaded from 12 bytes in */
+    while (length >= 28) {
+
+        __m256i vector = _mm256_inserti128_si256(_mm256_castsi128_si256(
+                    _mm_loadu_si128((const __m128i*) data)),
+                _mm_loadu_si128((const __m128i*) (data + 12)), 1);
+
+        GUAC_BASE64_ENC_RESHUFFLE(256, vector);
+        GUAC_BASE64_ENC_TRANSLATE(256, vector);
+
+        _mm256_storeu_si256((__m256i*) current, vector);
+
+        data += 24;
+        length -= 24;
+        current += 32;
+
+    }
+
+#undef GUAC_BASE64_ENC_SHUFFLE
+#undef GUAC_BASE64_ENC_OFFSETS
+
+    return (current - output)
+        + __guac_base64_encode_ssse3(data, length, current);
+
+}
+
+/**
+ * Decodes the given base64 characters using SSSE3, falling back to scalar
+ * operations for the remainder and for any block containing characters
+ * outside the base64 alphabet.
+ */
+__attribute__((target("ssse3")))
+static size_t __guac_base64_decode_ssse3(const unsigned char* base64,
+        size_t length, unsigned char* output) {
+
+#define GUAC_BASE64_DEC_LUT_HI   GUAC_BASE64_DEC_LUT_HI_LANE
+#define GUAC_BASE64_DEC_LUT_LO   GUAC_BASE64_DEC_LUT_LO_LANE
+#define GUAC_BASE64_DEC_LUT_ROLL GUAC_BASE64_DEC_LUT_ROLL_LANE
+#define GUAC_BASE64_DEC_SHUFFLE  GUAC_BASE64_DEC_SHUFFLE_LANE
+
+    const int mask = 0xFFFF;
+    unsigned char* current = output;
+
+    /* Each iteration decodes 16 characters into 12 bytes, but stores 16
+     * bytes. Requiring 24 characters guarantees the extra 4 bytes are
+     * within the bounds of the output buffer. */
+    while (length >= 24) {
+
+        __m128i vector = _mm_loadu_si128((const __m128i*) base64);
+
+        GUAC_BASE64_DEC_TRANSLATE(128, vector, invalid);
+        GUAC_BASE64_DEC_RESHUFFLE(128, vector);
+
+        _mm_storeu_si128((__m128i*) current, vector);
+        current += 12;
+        goto next;
+
+        /* Decode blocks containing invalid characters one at a time */
+invalid:
+        current += __guac_base64_decode_scalar(base64, 16, current);
+
+next:
+        base64 += 16;
+        length -= 16;
+
+    }
+
+#undef GUAC_BASE64_DEC_LUT_HI
+#undef GUAC_BASE64_DEC_LUT_LO
+#undef GUAC_BASE64_DEC_LUT_ROLL
+#undef GUAC_BASE64_DEC_SHUFFLE
+
+    return (current - output)
+        + __guac_base64_decode_scalar(base64, length, current);
+
+}
+
+/**
+ * Decodes the given base64 characters using AVX2, falling back to SSSE3 for
+ * the remainder and to scalar operations for any block containing characters
+ * outside the base64 alphabet.
+ */
+__attribute__((target("avx2")))
+static size_t __guac_base64_decode_avx2(const unsigned char* base64,
+        size_t length, unsigned char* output) {
+
+#define GUAC_BASE64_DEC_LUT_HI \
+    GUAC_BASE64_DEC_LUT_HI_LANE, GUAC_BASE64_DEC_LUT_HI_LANE
+#define GUAC_BASE64_DEC_LUT_LO \
+    GUAC_BASE64_DEC_LUT_LO_LANE, GUAC_BASE64_DEC_LUT_LO_LANE
+#define GUAC_BASE64_DEC_LUT_ROLL \
+    GUAC_BASE64_DEC_LUT_ROLL_LANE, GUAC_BASE64_DEC_LUT_ROLL_LANE
+#define GUAC_BASE64_DEC_SHUFFLE \
+    GUAC_BASE64_DEC_SHUFFLE_LANE, GUAC_BASE64_DEC_SHUFFLE_LANE
+
+    const int mask = -1;
+    unsigned char* current = output;
+
+    /* Each iteration decodes 32 characters into 24 bytes, but stores 32
+     * bytes. Requiring 44 characters guarantees the extra 8 bytes are
+     * within the bounds of the output buffer. */
+    while (length >= 44) {
+
+        __m256i vector = _mm256_loadu_si256((const __m256i*) base64);
+
+        GUAC_BASE64_DEC_TRANSLATE(256, vector, invalid);
+        GUAC_BASE64_DEC_RESHUFFLE(256, vector);
+
+        /* Pack the 12 bytes of each lane together */
+        vector = _mm256_permutevar8x32_epi32(vector,
+                _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+
+        _mm256_storeu_si256((__m256i*) current, vector);
+        current += 24;
+        goto next;
+
+        /* Decode blocks containing invalid characters one at a time */
+invalid:
+        current += __guac_base64_decode_scalar(base64, 32, current);
+
+next:
+        base64 += 32;
+        length -= 32;
+
+    }
+
+#undef GUAC_BASE64_DEC_LUT_HI
+#undef GUAC_BASE64_DEC_LUT_LO
+#undef GUAC_BASE64_DEC_LUT_ROLL
+#undef GUAC_BASE64_DEC_SHUFFLE
+
+    return (current - output)
+        + __guac_base64_decode_ssse3(base64, length, current);
+
+}
+
+#endif
+
+size_t guac_base64_encode(const unsigned char* data, size_t length,
+        char* output) {
+
+#ifdef HAVE_X86_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        return __guac_base64_encode_avx2(data, length, output);
+
+    if (__builtin_cpu_supports("ssse3"))
+        return __guac_base64_encode_ssse3(data, length, output);
+#endif
+
+    return __guac_base64_encode_scalar(data, length, output);
+
+}
+
+size_t guac_base64_decode(const char* base64, size_t length,
+        unsigned char* output) {
+
+    /* Padding marks the end of the data */
+    const char* padding = memchr(base64, '=', length);
+    if (padding != NULL)
+        length = padding - base64;
+
+#ifdef HAVE_X86_SIMD
+    if (__builtin_cpu_supports("avx2"))
+        return __guac_base64_decode_avx2((const unsigned char*) base64,
+                length, output);
+
+    if (__builtin_cpu_supports("ssse3"))
+        return __guac_base64_decode_ssse3((const unsigned char*) base64,
+                length, output);
+#endif
+
+    return __guac_base64_decode_scalar((const unsigned char*) base64,
+            length, output);
+
+}
+
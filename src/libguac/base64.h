@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GUAC_BASE64_H
+#define GUAC_BASE64_H
+
+#include "config.h"
+
+#include <stddef.h>
+
+/**
+ * Encodes the given data as base64, writing the resulting characters to the
+ * given buffer. Only whole groups of three bytes are encoded; any trailing
+ * bytes beyond the last whole group are ignored and must be handled (and
+ * padded) by the caller. Vectorized implementations are used automatically
+ * if supported by the current CPU.
+ *
+ * @param data
+ *     The data to encode.
+ *
+ * @param length
+ *     The number of bytes of data available. Only the largest multiple of
+ *     three not exceeding this value will actually be encoded.
+ *
+ * @param output
+ *     The buffer which should receive the base64 characters. This buffer must
+ *     have space for at least (length / 3) * 4 characters. No null terminator
+ *     is written.
+ *
+ * @return
+ *     The number of base64 characters written to the output buffer.
+ */
+size_t guac_base64_encode(const unsigned char* data, size_t length,
+        char* output);
+
+/**
+ * Decodes the given base64 characters, writing the resulting bytes to the
+ * given buffer. Decoding stops at the first '=' or once the given number of
+ * characters has been read. As with guac_protocol_decode_base64(), characters
+ * which are not part of the base64 alphabet are interpreted as zero.
+ * Vectorized implementations are used automatically if supported by the
+ * current CPU.
+ *
+ * @param base64
+ *     The base64 characters to decode.
+ *
+ * @param length
+ *     The number of base64 characters available.
+ *
+ * @param output
+ *     The buffer which should receive the decoded bytes. This buffer must
+ *     have space for at least (length * 3) / 4 bytes, and may be the same as
+ *     the buffer containing the base64 characters, in which case the data is
+ *     decoded in-place.
+ *
+ * @return
+ *     The number of bytes written to the output buffer.
+ */
+size_t guac_base64_decode(const char* base64, size_t length,
+        unsigned char* output);
+
+#endif
+
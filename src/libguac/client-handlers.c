@@ -24,35 +24,71 @@
 
 #include "client.h"
 #include "client-handlers.h"
-#include "instruction.h"
+#include "congestion.h"
+#include "error.h"
 #include "object.h"
 #include "protocol.h"
 #include "stream.h"
 #include "timestamp.h"
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
 
-/* Guacamole instruction handler map */
-
-__guac_instruction_handler_mapping __guac_instruction_handler_map[] = {
-   {"sync",       __guac_handle_sync},
-   {"mouse",      __guac_handle_mouse},
-   {"key",        __guac_handle_key},
-   {"clipboard",  __guac_handle_clipboard},
-   {"disconnect", __guac_handle_disconnect},
-   {"size",       __guac_handle_size},
-   {"file",       __guac_handle_file},
-   {"pipe",       __guac_handle_pipe},
-   {"ack",        __guac_handle_ack},
-   {"blob",       __guac_handle_blob},
-   {"end",        __guac_handle_end},
-   {"get",        __guac_handle_get},
-   {"put",        __guac_handle_put},
-   {NULL,         NULL}
+/*
+ * Guacamole instruction handler map. Each mapping is stored at the slot given
+ * by __guac_instruction_handler_hash() for its opcode.
+ */
+
+__guac_instruction_handler_mapping
+    __guac_instruction_handler_map[GUAC_INSTRUCTION_HANDLER_MAP_SIZE] = {
+   [0]  = {"size",       __guac_handle_size},
+   [2]  = {"file",       __guac_handle_file},
+   [3]  = {"clipboard",  __guac_handle_clipboard},
+   [4]  = {"blob",       __guac_handle_blob},
+   [5]  = {"get",        __guac_handle_get},
+   [7]  = {"key",        __guac_handle_key},
+   [9]  = {"end",        __guac_handle_end},
+   [10] = {"disconnect", __guac_handle_disconnect},
+   [11] = {"put",        __guac_handle_put},
+   [12] = {"sync",       __guac_handle_sync},
+   [13] = {"mouse",      __guac_handle_mouse},
+   [14] = {"pipe",       __guac_handle_pipe},
+   [15] = {"ack",        __guac_handle_ack}
 };
 
+unsigned int __guac_instruction_handler_hash(const char* opcode, int length) {
+
+    unsigned char first = (unsigned char) opcode[0];
+    unsigned char last  = (unsigned char) opcode[length - 1];
+
+    return (length + first * 6 + last * 2)
+         & (GUAC_INSTRUCTION_HANDLER_MAP_SIZE - 1);
+
+}
+
+__guac_instruction_handler* __guac_get_instruction_handler(const char* opcode) {
+
+    __guac_instruction_handler_mapping* mapping;
+
+    /* Empty opcodes never have handlers */
+    int length = strlen(opcode);
+    if (length == 0)
+        return NULL;
+
+    /* Only the opcode stored at the hashed slot can possibly match */
+    mapping = &__guac_instruction_handler_map[
+        __guac_instruction_handler_hash(opcode, length)];
+
+    if (mapping->opcode != NULL && strcmp(mapping->opcode, opcode) == 0)
+        return mapping->handler;
+
+    return NULL;
+
+}
+
 int64_t __guac_parse_int(const char* str) {
 
     int sign = 1;
@@ -73,34 +109,63 @@ int64_t __guac_parse_int(const char* str) {
 
 /* Guacamole instruction handlers */
 
-int __guac_handle_sync(guac_client* client, guac_instruction* instruction) {
-    guac_timestamp timestamp = __guac_parse_int(instruction->argv[0]);
+int __guac_handle_sync(guac_client* client, int argc, char** argv) {
+    guac_timestamp timestamp = __guac_parse_int(argv[0]);
 
     /* Error if timestamp is in future */
     if (timestamp > client->last_sent_timestamp)
         return -1;
 
     client->last_received_timestamp = timestamp;
+
+    /* Update estimated congestion with the round trip of the sync */
+    if (client->__congestion != NULL) {
+
+        guac_congestion* congestion = client->__congestion;
+        int was_congested = client->congestion > 0;
+
+        guac_congestion_acknowledged(congestion, timestamp,
+                guac_timestamp_current());
+
+        /* Copy estimates while the output thread cannot update them */
+        pthread_mutex_lock(&(congestion->lock));
+        client->rtt = congestion->rtt;
+        client->throughput = congestion->throughput;
+        client->congestion = congestion->level;
+        pthread_mutex_unlock(&(congestion->lock));
+
+        /* Note changes in congestion */
+        if (!was_congested && client->congestion > 0)
+            guac_client_log(client, GUAC_LOG_DEBUG, "Connection congested "
+                    "(RTT %i ms, %i bytes/second). Reducing image quality "
+                    "and frame rate.", client->rtt, client->throughput);
+        else if (was_congested && client->congestion == 0)
+            guac_client_log(client, GUAC_LOG_DEBUG, "Connection no longer "
+                    "congested (RTT %i ms, %i bytes/second).", client->rtt,
+                    client->throughput);
+
+    }
+
     return 0;
 }
 
-int __guac_handle_mouse(guac_client* client, guac_instruction* instruction) {
+int __guac_handle_mouse(guac_client* client, int argc, char** argv) {
     if (client->mouse_handler)
         return client->mouse_handler(
             client,
-            atoi(instruction->argv[0]), /* x */
-            atoi(instruction->argv[1]), /* y */
-            atoi(instruction->argv[2])  /* mask */
+            atoi(argv[0]), /* x */
+            atoi(argv[1]), /* y */
+            atoi(argv[2])  /* mask */
         );
     return 0;
 }
 
-int __guac_handle_key(guac_client* client, guac_instruction* instruction) {
+int __guac_handle_key(guac_client* client, int argc, char** argv) {
     if (client->key_handler)
         return client->key_handler(
             client,
-            atoi(instruction->argv[0]), /* keysym */
-            atoi(instruction->argv[1])  /* pressed */
+            atoi(argv[0]), /* keysym */
+            atoi(argv[1])  /* pressed */
         );
     return 0;
 }
@@ -158,16 +223,17 @@ static guac_stream* __init_input_stream(guac_client* client, int stream_index) {
     stream->data = NULL;
     stream->ack_handler = NULL;
     stream->blob_handler = NULL;
+    stream->blob_chunk_handler = NULL;
     stream->end_handler = NULL;
 
     return stream;
 
 }
 
-int __guac_handle_clipboard(guac_client* client, guac_instruction* instruction) {
+int __guac_handle_clipboard(guac_client* client, int argc, char** argv) {
 
     /* Pull corresponding stream */
-    int stream_index = atoi(instruction->argv[0]);
+    int stream_index = atoi(argv[0]);
     guac_stream* stream = __init_input_stream(client, stream_index);
     if (stream == NULL)
         return 0;
@@ -177,7 +243,7 @@ int __guac_handle_clipboard(guac_client* client, guac_instruction* instruction)
         return client->clipboard_handler(
             client,
             stream,
-            instruction->argv[1] /* mimetype */
+            argv[1] /* mimetype */
         );
 
     /* Otherwise, abort */
@@ -187,20 +253,20 @@ int __guac_handle_clipboard(guac_client* client, guac_instruction* instruction)
 
 }
 
-int __guac_handle_size(guac_client* client, guac_instruction* instruction) {
+int __guac_handle_size(guac_client* client, int argc, char** argv) {
     if (client->size_handler)
         return client->size_handler(
             client,
-            atoi(instruction->argv[0]), /* width */
-            atoi(instruction->argv[1])  /* height */
+            atoi(argv[0]), /* width */
+            atoi(argv[1])  /* height */
         );
     return 0;
 }
 
-int __guac_handle_file(guac_client* client, guac_instruction* instruction) {
+int __guac_handle_file(guac_client* client, int argc, char** argv) {
 
     /* Pull corresponding stream */
-    int stream_index = atoi(instruction->argv[0]);
+    int stream_index = atoi(argv[0]);
     guac_stream* stream = __init_input_stream(client, stream_index);
     if (stream == NULL)
         return 0;
@@ -210,8 +276,8 @@ int __guac_handle_file(guac_client* client, guac_instruction* instruction) {
         return client->file_handler(
             client,
             stream,
-            instruction->argv[1], /* mimetype */
-            instruction->argv[2]  /* filename */
+            argv[1], /* mimetype */
+            argv[2]  /* filename */
         );
 
     /* Otherwise, abort */
@@ -220,10 +286,10 @@ int __guac_handle_file(guac_client* client, guac_instruction* instruction) {
     return 0;
 }
 
-int __guac_handle_pipe(guac_client* client, guac_instruction* instruction) {
+int __guac_handle_pipe(guac_client* client, int argc, char** argv) {
 
     /* Pull corresponding stream */
-    int stream_index = atoi(instruction->argv[0]);
+    int stream_index = atoi(argv[0]);
     guac_stream* stream = __init_input_stream(client, stream_index);
     if (stream == NULL)
         return 0;
@@ -233,8 +299,8 @@ int __guac_handle_pipe(guac_client* client, guac_instruction* instruction) {
         return client->pipe_handler(
             client,
             stream,
-            instruction->argv[1], /* mimetype */
-            instruction->argv[2]  /* name */
+            argv[1], /* mimetype */
+            argv[2]  /* name */
         );
 
     /* Otherwise, abort */
@@ -243,12 +309,12 @@ int __guac_handle_pipe(guac_client* client, guac_instruction* instruction) {
     return 0;
 }
 
-int __guac_handle_ack(guac_client* client, guac_instruction* instruction) {
+int __guac_handle_ack(guac_client* client, int argc, char** argv) {
 
     guac_stream* stream;
 
     /* Validate stream index */
-    int stream_index = atoi(instruction->argv[0]);
+    int stream_index = atoi(argv[0]);
     if (stream_index < 0 || stream_index >= GUAC_CLIENT_MAX_STREAMS)
         return 0;
 
@@ -260,49 +326,144 @@ int __guac_handle_ack(guac_client* client, guac_instruction* instruction) {
 
     /* Call stream handler if defined */
     if (stream->ack_handler)
-        return stream->ack_handler(client, stream, instruction->argv[1],
-                atoi(instruction->argv[2]));
+        return stream->ack_handler(client, stream, argv[1],
+                atoi(argv[2]));
 
     /* Fall back to global handler if defined */
     if (client->ack_handler)
-        return client->ack_handler(client, stream, instruction->argv[1],
-                atoi(instruction->argv[2]));
+        return client->ack_handler(client, stream, argv[1],
+                atoi(argv[2]));
+
+    return 0;
+}
+
+/**
+ * Passes the given complete, decoded blob to the most specific handler
+ * defined for the given stream, acknowledging the blob with an error if no
+ * such handler exists.
+ */
+static int __guac_handle_complete_blob(guac_client* client,
+        guac_stream* stream, void* data, int length) {
+
+    /* Call stream handler if defined */
+    if (stream->blob_chunk_handler)
+        return stream->blob_chunk_handler(client, stream, data, length, 1);
+
+    if (stream->blob_handler)
+        return stream->blob_handler(client, stream, data, length);
+
+    /* Fall back to global handler if defined */
+    if (client->blob_handler)
+        return client->blob_handler(client, stream, data, length);
+
+    guac_protocol_send_ack(client->socket, stream,
+            "File transfer unsupported", GUAC_PROTOCOL_STATUS_UNSUPPORTED);
+    return 0;
+
+}
+
+/**
+ * Appends the given chunk of blob content to the blob being reassembled
+ * within the given client, expanding the reassembly buffer as necessary.
+ * Returns zero on success, or non-zero if the buffer could not be expanded,
+ * in which case guac_error is set appropriately.
+ */
+static int __guac_append_blob_chunk(guac_client* client, void* data,
+        int length) {
+
+    int required = client->__blob_length + length;
+
+    /* Expand buffer if necessary */
+    if (required > client->__blob_size) {
+
+        int size = client->__blob_size ? client->__blob_size : 1024;
+        char* buffer;
+
+        while (size < required)
+            size *= 2;
 
+        buffer = realloc(client->__blob_buffer, size);
+        if (buffer == NULL) {
+            guac_error = GUAC_STATUS_NO_MEMORY;
+            guac_error_message = "Insufficient memory to reassemble blob";
+            return 1;
+        }
+
+        client->__blob_buffer = buffer;
+        client->__blob_size = size;
+
+    }
+
+    memcpy(client->__blob_buffer + client->__blob_length, data, length);
+    client->__blob_length = required;
     return 0;
+
 }
 
-int __guac_handle_blob(guac_client* client, guac_instruction* instruction) {
+int __guac_handle_blob(guac_client* client, int argc, char** argv) {
+
+    int stream_index = atoi(argv[0]);
+    int length;
 
-    int stream_index = atoi(instruction->argv[0]);
     guac_stream* stream = __get_open_input_stream(client, stream_index);
 
     /* Fail if no such stream */
     if (stream == NULL)
         return 0;
 
-    /* Call stream handler if defined */
-    if (stream->blob_handler) {
-        int length = guac_protocol_decode_base64(instruction->argv[1]);
-        return stream->blob_handler(client, stream, instruction->argv[1],
-            length);
+    length = guac_protocol_decode_base64(argv[1]);
+    return __guac_handle_complete_blob(client, stream, argv[1], length);
+
+}
+
+int __guac_handle_blob_chunk(guac_client* client, int stream_index,
+        void* data, int length, int final) {
+
+    guac_stream* stream;
+
+    /* Look up stream, acknowledging invalid streams only once per blob */
+    if (final)
+        stream = __get_open_input_stream(client, stream_index);
+
+    else if (stream_index >= 0 && stream_index < GUAC_CLIENT_MAX_STREAMS
+            && client->__input_streams[stream_index].index
+                    != GUAC_CLIENT_CLOSED_STREAM_INDEX)
+        stream = &(client->__input_streams[stream_index]);
+
+    else
+        stream = NULL;
+
+    /* Discard chunks for nonexistent streams */
+    if (stream == NULL) {
+        client->__blob_length = 0;
+        return 0;
     }
 
-    /* Fall back to global handler if defined */
-    if (client->blob_handler) {
-        int length = guac_protocol_decode_base64(instruction->argv[1]);
-        return client->blob_handler(client, stream, instruction->argv[1],
-            length);
+    /* Pass chunk directly to handler if supported */
+    if (stream->blob_chunk_handler)
+        return stream->blob_chunk_handler(client, stream, data, length, final);
+
+    /* Otherwise, reassemble entire blob */
+    if (__guac_append_blob_chunk(client, data, length)) {
+        client->__blob_length = 0;
+        return -1;
     }
 
-    guac_protocol_send_ack(client->socket, stream,
-            "File transfer unsupported", GUAC_PROTOCOL_STATUS_UNSUPPORTED);
-    return 0;
+    if (!final)
+        return 0;
+
+    length = client->__blob_length;
+    client->__blob_length = 0;
+
+    return __guac_handle_complete_blob(client, stream,
+            client->__blob_buffer, length);
+
 }
 
-int __guac_handle_end(guac_client* client, guac_instruction* instruction) {
+int __guac_handle_end(guac_client* client, int argc, char** argv) {
 
     int result = 0;
-    int stream_index = atoi(instruction->argv[0]);
+    int stream_index = atoi(argv[0]);
     guac_stream* stream = __get_open_input_stream(client, stream_index);
 
     /* Fail if no such stream */
@@ -322,12 +483,12 @@ int __guac_handle_end(guac_client* client, guac_instruction* instruction) {
     return result;
 }
 
-int __guac_handle_get(guac_client* client, guac_instruction* instruction) {
+int __guac_handle_get(guac_client* client, int argc, char** argv) {
 
     guac_object* object;
 
     /* Validate object index */
-    int object_index = atoi(instruction->argv[0]);
+    int object_index = atoi(argv[0]);
     if (object_index < 0 || object_index >= GUAC_CLIENT_MAX_OBJECTS)
         return 0;
 
@@ -340,24 +501,24 @@ int __guac_handle_get(guac_client* client, guac_instruction* instruction) {
     /* Call object handler if defined */
     if (object->get_handler)
         return object->get_handler(client, object,
-            instruction->argv[1] /* name */
+            argv[1] /* name */
         );
 
     /* Fall back to global handler if defined */
     if (client->get_handler)
         return client->get_handler(client, object,
-            instruction->argv[1] /* name */
+            argv[1] /* name */
         );
 
     return 0;
 }
 
-int __guac_handle_put(guac_client* client, guac_instruction* instruction) {
+int __guac_handle_put(guac_client* client, int argc, char** argv) {
 
     guac_object* object;
 
     /* Validate object index */
-    int object_index = atoi(instruction->argv[0]);
+    int object_index = atoi(argv[0]);
     if (object_index < 0 || object_index >= GUAC_CLIENT_MAX_OBJECTS)
         return 0;
 
@@ -368,7 +529,7 @@ int __guac_handle_put(guac_client* client, guac_instruction* instruction) {
         return 0;
 
     /* Pull corresponding stream */
-    int stream_index = atoi(instruction->argv[1]);
+    int stream_index = atoi(argv[1]);
     guac_stream* stream = __init_input_stream(client, stream_index);
     if (stream == NULL)
         return 0;
@@ -376,15 +537,15 @@ int __guac_handle_put(guac_client* client, guac_instruction* instruction) {
     /* Call object handler if defined */
     if (object->put_handler)
         return object->put_handler(client, object, stream,
-            instruction->argv[2], /* mimetype */
-            instruction->argv[3]  /* name */
+            argv[2], /* mimetype */
+            argv[3]  /* name */
         );
 
     /* Fall back to global handler if defined */
     if (client->put_handler)
         return client->put_handler(client, object, stream,
-            instruction->argv[2], /* mimetype */
-            instruction->argv[3]  /* name */
+            argv[2], /* mimetype */
+            argv[3]  /* name */
         );
 
     /* Otherwise, abort */
@@ -393,7 +554,7 @@ int __guac_handle_put(guac_client* client, guac_instruction* instruction) {
     return 0;
 }
 
-int __guac_handle_disconnect(guac_client* client, guac_instruction* instruction) {
+int __guac_handle_disconnect(guac_client* client, int argc, char** argv) {
     guac_client_stop(client);
     return 0;
 }
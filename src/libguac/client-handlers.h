@@ -35,12 +35,11 @@
 #include "config.h"
 
 #include "client.h"
-#include "instruction.h"
 
 /**
  * Internal handler for Guacamole instructions.
  */
-typedef int __guac_instruction_handler(guac_client* client, guac_instruction* copied);
+typedef int __guac_instruction_handler(guac_client* client, int argc, char** argv);
 
 /**
  * Structure mapping an instruction opcode to an instruction handler.
@@ -64,99 +63,149 @@ typedef struct __guac_instruction_handler_mapping {
  * is received, this handler will be called. Sync instructions are automatically
  * handled, thus there is no client handler for sync instruction.
  */
-int __guac_handle_sync(guac_client* client, guac_instruction* instruction);
+int __guac_handle_sync(guac_client* client, int argc, char** argv);
 
 /**
  * Internal initial handler for the mouse instruction. When a mouse instruction
  * is received, this handler will be called. The client's mouse handler will
  * be invoked if defined.
  */
-int __guac_handle_mouse(guac_client* client, guac_instruction* instruction);
+int __guac_handle_mouse(guac_client* client, int argc, char** argv);
 
 /**
  * Internal initial handler for the key instruction. When a key instruction
  * is received, this handler will be called. The client's key handler will
  * be invoked if defined.
  */
-int __guac_handle_key(guac_client* client, guac_instruction* instruction);
+int __guac_handle_key(guac_client* client, int argc, char** argv);
 
 /**
  * Internal initial handler for the clipboard instruction. When a clipboard instruction
  * is received, this handler will be called. The client's clipboard handler will
  * be invoked if defined.
  */
-int __guac_handle_clipboard(guac_client* client, guac_instruction* instruction);
+int __guac_handle_clipboard(guac_client* client, int argc, char** argv);
 
 /**
  * Internal initial handler for the file instruction. When a file instruction
  * is received, this handler will be called. The client's file handler will
  * be invoked if defined.
  */
-int __guac_handle_file(guac_client* client, guac_instruction* instruction);
+int __guac_handle_file(guac_client* client, int argc, char** argv);
 
 /**
  * Internal initial handler for the pipe instruction. When a pipe instruction
  * is received, this handler will be called. The client's pipe handler will
  * be invoked if defined.
  */
-int __guac_handle_pipe(guac_client* client, guac_instruction* instruction);
+int __guac_handle_pipe(guac_client* client, int argc, char** argv);
 
 /**
  * Internal initial handler for the ack instruction. When a ack instruction
  * is received, this handler will be called. The client's ack handler will
  * be invoked if defined.
  */
-int __guac_handle_ack(guac_client* client, guac_instruction* instruction);
+int __guac_handle_ack(guac_client* client, int argc, char** argv);
 
 /**
  * Internal initial handler for the blob instruction. When a blob instruction
  * is received, this handler will be called. The client's blob handler will
  * be invoked if defined.
  */
-int __guac_handle_blob(guac_client* client, guac_instruction* instruction);
+int __guac_handle_blob(guac_client* client, int argc, char** argv);
+
+/**
+ * Internal handler for chunks of blob content received as that content
+ * arrives, rather than as a complete blob instruction. Chunks are passed to
+ * the stream's blob_chunk_handler if defined, and are otherwise reassembled
+ * within the client and handled as a complete blob once the final chunk is
+ * received.
+ */
+int __guac_handle_blob_chunk(guac_client* client, int stream_index,
+        void* data, int length, int final);
 
 /**
  * Internal initial handler for the end instruction. When a end instruction
  * is received, this handler will be called. The client's end handler will
  * be invoked if defined.
  */
-int __guac_handle_end(guac_client* client, guac_instruction* instruction);
+int __guac_handle_end(guac_client* client, int argc, char** argv);
 
 /**
  * Internal initial handler for the get instruction. When a get instruction
  * is received, this handler will be called. The client's get handler will
  * be invoked if defined.
  */
-int __guac_handle_get(guac_client* client, guac_instruction* instruction);
+int __guac_handle_get(guac_client* client, int argc, char** argv);
 
 /**
  * Internal initial handler for the put instruction. When a put instruction
  * is received, this handler will be called. The client's put handler will
  * be invoked if defined.
  */
-int __guac_handle_put(guac_client* client, guac_instruction* instruction);
+int __guac_handle_put(guac_client* client, int argc, char** argv);
 
 /**
  * Internal initial handler for the size instruction. When a size instruction
  * is received, this handler will be called. The client's size handler will
  * be invoked if defined.
  */
-int __guac_handle_size(guac_client* client, guac_instruction* instruction);
+int __guac_handle_size(guac_client* client, int argc, char** argv);
 
 /**
  * Internal initial handler for the disconnect instruction. When a disconnect instruction
  * is received, this handler will be called. Disconnect instructions are automatically
  * handled, thus there is no client handler for disconnect instruction.
  */
-int __guac_handle_disconnect(guac_client* client, guac_instruction* instruction);
+int __guac_handle_disconnect(guac_client* client, int argc, char** argv);
+
+/**
+ * The number of slots within __guac_instruction_handler_map. This must be a
+ * power of two, as the hash of an opcode is reduced to a slot index by
+ * masking.
+ */
+#define GUAC_INSTRUCTION_HANDLER_MAP_SIZE 16
+
+/**
+ * Instruction handler mapping table, indexed by the hash of each opcode as
+ * returned by __guac_instruction_handler_hash(). The hash is perfect over
+ * the set of opcodes handled by libguac, thus each mapping occupies its own
+ * slot and no probing is required. Unused slots have their opcode set to
+ * NULL. Any opcode added to this table must be placed at the slot given by
+ * its hash, and the hash adjusted if that slot is already in use.
+ */
+extern __guac_instruction_handler_mapping
+    __guac_instruction_handler_map[GUAC_INSTRUCTION_HANDLER_MAP_SIZE];
 
 /**
- * Instruction handler mapping table. This is a NULL-terminated array of
- * __guac_instruction_handler_mapping structures, each mapping an opcode
- * to a __guac_instruction_handler. The end of the array must be marked
- * with a __guac_instruction_handler_mapping with the opcode set to
- * NULL (the NULL terminator).
+ * Returns the slot within __guac_instruction_handler_map at which the handler
+ * for the given opcode would be stored. The hash depends only on the length,
+ * first character, and last character of the opcode, and thus is computed in
+ * constant time regardless of opcode length.
+ *
+ * @param opcode
+ *     The opcode to hash. This must not be an empty string.
+ *
+ * @param length
+ *     The length of the opcode, in bytes.
+ *
+ * @return
+ *     The slot within __guac_instruction_handler_map at which the handler
+ *     for the given opcode would be stored.
+ */
+unsigned int __guac_instruction_handler_hash(const char* opcode, int length);
+
+/**
+ * Returns the handler for the given opcode, if any. The opcode is hashed
+ * with __guac_instruction_handler_hash() and compared only against the
+ * opcode stored in the resulting slot.
+ *
+ * @param opcode
+ *     The opcode of the instruction to look up.
+ *
+ * @return
+ *     The handler for the given opcode, or NULL if no handler is defined.
  */
-extern __guac_instruction_handler_mapping __guac_instruction_handler_map[];
+__guac_instruction_handler* __guac_get_instruction_handler(const char* opcode);
 
 #endif
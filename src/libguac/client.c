@@ -24,9 +24,13 @@
 
 #include "client.h"
 #include "client-handlers.h"
+#include "congestion.h"
 #include "encode-jpeg.h"
 #include "encode-png.h"
+#include "encode-pool.h"
 #include "error.h"
+#include "hash.h"
+#include "image-cache.h"
 #include "instruction.h"
 #include "layer.h"
 #include "object.h"
@@ -35,6 +39,7 @@
 #include "socket.h"
 #include "stream.h"
 #include "timestamp.h"
+#include "video.h"
 
 #ifdef ENABLE_WEBP
 #include "encode-webp.h"
@@ -57,6 +62,14 @@ guac_layer __GUAC_DEFAULT_LAYER = {
 
 const guac_layer* GUAC_DEFAULT_LAYER = &__GUAC_DEFAULT_LAYER;
 
+/**
+ * The maximum number of images encoded concurrently by any one call to
+ * guac_client_stream_images(). Each image requires its own stream until all
+ * images of the batch have been sent, thus this must be well below
+ * GUAC_CLIENT_MAX_STREAMS.
+ */
+#define GUAC_CLIENT_MAX_IMAGE_BATCH 16
+
 guac_layer* guac_client_alloc_layer(guac_client* client) {
 
     /* Init new layer */
@@ -115,7 +128,9 @@ guac_stream* guac_client_alloc_stream(guac_client* client) {
     allocd_stream->data = NULL;
     allocd_stream->ack_handler = NULL;
     allocd_stream->blob_handler = NULL;
+    allocd_stream->blob_chunk_handler = NULL;
     allocd_stream->end_handler = NULL;
+    allocd_stream->priority = GUAC_STREAM_PRIORITY_INTERACTIVE;
 
     return allocd_stream;
 
@@ -249,6 +264,9 @@ guac_client* guac_client_alloc() {
         return NULL;
     }
 
+    /* Track congestion from acknowledgements of sent syncs, if possible */
+    client->__congestion = guac_congestion_alloc();
+
     /* Allocate buffer and layer pools */
     client->__buffer_pool = guac_pool_alloc(GUAC_BUFFER_POOL_INITIAL_SIZE);
     client->__layer_pool = guac_pool_alloc(GUAC_BUFFER_POOL_INITIAL_SIZE);
@@ -277,6 +295,17 @@ guac_client* guac_client_alloc() {
     client->keystrokes_flag = 0;
     client->keystrokes_path = NULL;
 
+    /* Encode images serially unless configured otherwise */
+    client->encoder_threads = 1;
+    client->png_compression_level = GUAC_PNG_DEFAULT_COMPRESSION_LEVEL;
+    client->png_compression_strategy = GUAC_PNG_DEFAULT_STRATEGY;
+    client->png_filter = GUAC_PNG_DEFAULT_FILTER;
+    client->__encode_pool = NULL;
+
+    /* Do not cache images unless configured otherwise */
+    client->image_cache_size = 0;
+    client->__image_cache = NULL;
+
     return client;
 
 }
@@ -290,6 +319,18 @@ void guac_client_free(guac_client* client) {
 
     }
 
+    /* Free image cache, returning its buffers to the pool */
+    if (client->__image_cache != NULL) {
+
+        guac_image_cache* cache = client->__image_cache;
+        guac_client_log(client, GUAC_LOG_DEBUG, "Image cache: %i hit(s), "
+                "%i miss(es), %i eviction(s).", cache->hits, cache->misses,
+                cache->evictions);
+
+        guac_image_cache_free(cache);
+
+    }
+
     /* Free layer pools */
     guac_pool_free(client->__buffer_pool);
     guac_pool_free(client->__layer_pool);
@@ -304,30 +345,71 @@ void guac_client_free(guac_client* client) {
     /* Free objects */
     free(client->__objects);
 
+    /* Free blob reassembly buffer */
+    free(client->__blob_buffer);
+
     /* Free object pool */
     guac_pool_free(client->__object_pool);
 
+    /* Stop image encoding threads, if any */
+    if (client->__encode_pool != NULL)
+        guac_encode_pool_free(client->__encode_pool);
+
+    if (client->__congestion != NULL)
+        guac_congestion_free(client->__congestion);
+
     free(client);
 }
 
+int guac_client_dispatch_instruction(guac_client* client, const char* opcode,
+        int argc, char** argv) {
+
+    /* If recognized, call handler */
+    __guac_instruction_handler* handler = __guac_get_instruction_handler(opcode);
+    if (handler != NULL)
+        return handler(client, argc, argv);
+
+    /* If unrecognized, ignore */
+    return 0;
+
+}
+
+int guac_client_handle_blob_chunk(guac_client* client, int stream_index,
+        void* data, int length, int final) {
+    return __guac_handle_blob_chunk(client, stream_index, data, length, final);
+}
+
 int guac_client_handle_instruction(guac_client* client, guac_instruction* instruction) {
+    return guac_client_dispatch_instruction(client, instruction->opcode,
+            instruction->argc, instruction->argv);
+}
 
-    /* For each defined instruction */
-    __guac_instruction_handler_mapping* current = __guac_instruction_handler_map;
-    while (current->opcode != NULL) {
+int guac_client_send_sync(guac_client* client) {
 
-        /* If recognized, call handler */
-        if (strcmp(instruction->opcode, current->opcode) == 0)
-            return current->handler(client, instruction);
+    guac_socket* socket = client->socket;
+    guac_timestamp timestamp = guac_timestamp_current();
 
-        current++;
-    }
+    client->last_sent_timestamp = timestamp;
+
+    /* Send sync along with all pending output */
+    if (guac_protocol_send_sync(socket, timestamp)
+            || guac_socket_flush(socket))
+        return 1;
+
+    /* Await acknowledgement of everything sent thus far */
+    if (client->__congestion != NULL)
+        guac_congestion_sent(client->__congestion, timestamp,
+                guac_socket_get_flushed(socket));
 
-    /* If unrecognized, ignore */
     return 0;
 
 }
 
+int guac_client_get_frame_duration(guac_client* client, int duration) {
+    return duration + duration * 2 * client->congestion
+                    / GUAC_CLIENT_MAX_CONGESTION;
+}
+
 void vguac_client_log(guac_client* client, guac_client_log_level level,
         const char* format, va_list ap) {
 
@@ -452,6 +534,336 @@ void guac_client_stream_webp(guac_client* client, guac_socket* socket,
 
 }
 
+/**
+ * The state of a single image passed to guac_client_stream_images().
+ */
+typedef struct guac_client_image_state {
+
+    /**
+     * The image being streamed.
+     */
+    guac_client_image* image;
+
+    /**
+     * Non-zero if the image may be stored within the image cache.
+     */
+    int cacheable;
+
+    /**
+     * The hash of the image, if cacheable.
+     */
+    unsigned int hash;
+
+    /**
+     * The cache entry already containing an identical image, or NULL if the
+     * image must be encoded.
+     */
+    guac_image_cache_entry* cached;
+
+    /**
+     * The job encoding the image, or NULL if the image is cached or cannot
+     * be encoded.
+     */
+    guac_encode_job* job;
+
+} guac_client_image_state;
+
+/**
+ * Streams the given image immediately within the current thread using
+ * guac_client_stream_png(), guac_client_stream_jpeg(), or
+ * guac_client_stream_webp(), depending on the image format.
+ */
+static void guac_client_stream_image(guac_client* client, guac_socket* socket,
+        const guac_client_image* image) {
+
+    switch (image->format) {
+
+        case GUAC_CLIENT_IMAGE_JPEG:
+            guac_client_stream_jpeg(client, socket, image->mode, image->layer,
+                    image->x, image->y, image->surface, image->quality);
+            break;
+
+        case GUAC_CLIENT_IMAGE_WEBP:
+            guac_client_stream_webp(client, socket, image->mode, image->layer,
+                    image->x, image->y, image->surface, image->quality, 0);
+            break;
+
+        default:
+            guac_client_stream_png(client, socket, image->mode, image->layer,
+                    image->x, image->y, image->surface);
+
+    }
+
+}
+
+/**
+ * Initializes the given state for the given image, searching the image cache
+ * of the given client for an identical image. Only opaque images drawn
+ * losslessly with GUAC_COMP_OVER are cached, as only then will the contents
+ * of the destination layer match the image exactly once drawn.
+ */
+static void guac_client_image_lookup(guac_client* client,
+        guac_client_image_state* state, guac_client_image* image) {
+
+    guac_image_cache* cache = client->__image_cache;
+
+    state->image = image;
+    state->cacheable = 0;
+    state->cached = NULL;
+    state->job = NULL;
+
+    image->encoded_size = 0;
+    image->encode_time = 0;
+
+    if (cache != NULL
+            && image->format == GUAC_CLIENT_IMAGE_PNG
+            && image->mode == GUAC_COMP_OVER
+            && cairo_image_surface_get_format(image->surface)
+                   == CAIRO_FORMAT_RGB24
+            && guac_image_cache_accepts(cache, image->surface)) {
+
+        state->cacheable = 1;
+        state->hash = guac_hash_surface(image->surface);
+        state->cached = guac_image_cache_lookup(cache, image->surface,
+                state->hash);
+
+    }
+
+}
+
+/**
+ * Draws the cached copy of the image described by the given state, which
+ * must have been found within the image cache, via a "copy" instruction.
+ */
+static void guac_client_image_send_cached(guac_socket* socket,
+        guac_client_image_state* state) {
+
+    const guac_client_image* image = state->image;
+    guac_image_cache_entry* entry = state->cached;
+
+    guac_protocol_send_copy(socket, entry->buffer, 0, 0,
+            entry->width, entry->height, image->mode, image->layer,
+            image->x, image->y);
+
+}
+
+/**
+ * Adds the image described by the given state to the image cache of the
+ * given client, if cacheable, copying the image from its destination layer
+ * into the buffer of the new cache entry. The image must already have been
+ * sent.
+ */
+static void guac_client_image_store(guac_client* client, guac_socket* socket,
+        guac_client_image_state* state) {
+
+    const guac_client_image* image = state->image;
+    guac_image_cache_entry* entry;
+    int created;
+
+    if (!state->cacheable)
+        return;
+
+    entry = guac_image_cache_add(client->__image_cache, socket,
+            image->surface, state->hash, &created);
+
+    if (entry != NULL && created)
+        guac_protocol_send_copy(socket, image->layer, image->x, image->y,
+                entry->width, entry->height, GUAC_COMP_SRC, entry->buffer,
+                0, 0);
+
+}
+
+/**
+ * Writes the instructions encoded by the job of the given state to the given
+ * socket, freeing the job's buffer once written and recording the size and
+ * encoding time of the image. Returns non-zero if the job failed or produced
+ * no output, in which case nothing is written.
+ */
+static int guac_client_image_send_encoded(guac_client* client,
+        guac_socket* socket, guac_client_image_state* state) {
+
+    guac_encode_job* job = state->job;
+
+    if (job->error) {
+        guac_client_log(client, GUAC_LOG_WARNING, "Unable to encode image "
+                "for stream %i. Image dropped.", job->stream->index);
+        free(job->buffer);
+        return 1;
+    }
+
+    /* Skip images which produced no output */
+    if (job->buffer == NULL)
+        return 1;
+
+    state->image->encoded_size = job->length;
+    state->image->encode_time = job->encode_time;
+
+    /* Buffer is freed once written */
+    guac_socket_instruction_begin(socket);
+    guac_socket_write_chunk(socket, job->buffer, job->length, free);
+    guac_socket_instruction_end(socket);
+
+    return 0;
+
+}
+
+void guac_client_stream_images(guac_client* client, guac_socket* socket,
+        guac_client_image* images, int count) {
+
+    guac_client_image_state states[GUAC_CLIENT_MAX_IMAGE_BATCH];
+    guac_encode_job jobs[GUAC_CLIENT_MAX_IMAGE_BATCH];
+    guac_encode_pool* pool;
+    int batch_size;
+    int i;
+
+    /* Allocate image cache on first use */
+    if (client->image_cache_size > 0 && client->__image_cache == NULL) {
+
+        client->__image_cache = guac_image_cache_alloc(client,
+                client->image_cache_size);
+
+        /* Continue without caching if the cache cannot be allocated */
+        if (client->__image_cache == NULL) {
+            guac_client_log(client, GUAC_LOG_WARNING, "Unable to allocate "
+                    "image cache. Images will not be cached.");
+            client->image_cache_size = 0;
+        }
+
+    }
+
+    /* Allocate encoder on first use. Images are always encoded via the pool,
+     * even if no threads are needed beyond this one, such that the size and
+     * encoding time of each image can be measured. */
+    if (client->__encode_pool == NULL) {
+
+        if (client->encoder_threads > GUAC_CLIENT_MAX_ENCODER_THREADS)
+            client->encoder_threads = GUAC_CLIENT_MAX_ENCODER_THREADS;
+
+        if (client->encoder_threads > 1) {
+
+            client->__encode_pool =
+                guac_encode_pool_alloc(client->encoder_threads - 1);
+
+            /* Fall back to encoding serially if threads cannot be started */
+            if (client->__encode_pool == NULL) {
+                guac_client_log(client, GUAC_LOG_WARNING, "Unable to start "
+                        "%i image encoding threads: %s. Images will be "
+                        "encoded serially.", client->encoder_threads - 1,
+                        guac_status_string(guac_error));
+                client->encoder_threads = 1;
+            }
+
+        }
+
+        if (client->__encode_pool == NULL)
+            client->__encode_pool = guac_encode_pool_alloc(0);
+
+    }
+
+    pool = client->__encode_pool;
+
+    /* Apply current PNG settings to all threads */
+    if (pool != NULL) {
+        pool->png_compression_level = client->png_compression_level;
+        pool->png_compression_strategy = client->png_compression_strategy;
+        pool->png_filter = client->png_filter;
+    }
+
+    /* Without an encoder, simply stream each image in order */
+    if (pool == NULL) {
+        for (i = 0; i < count; i++) {
+            images[i].encoded_size = 0;
+            images[i].encode_time = 0;
+            guac_client_stream_image(client, socket, &images[i]);
+        }
+        return;
+    }
+
+    /* Entries found from here on must not be evicted until sent */
+    if (client->__image_cache != NULL)
+        guac_image_cache_begin(client->__image_cache);
+
+    /* Limit batches to enough work to keep all threads busy, including
+     * this thread */
+    batch_size = client->encoder_threads * 2;
+    if (batch_size < 2)
+        batch_size = 2;
+    else if (batch_size > GUAC_CLIENT_MAX_IMAGE_BATCH)
+        batch_size = GUAC_CLIENT_MAX_IMAGE_BATCH;
+
+    while (count > 0) {
+
+        int image_count = 0;
+        int job_count = 0;
+
+        /* Look up next batch of images, creating a job for each image
+         * which must be encoded */
+        while (image_count < count
+                && image_count < GUAC_CLIENT_MAX_IMAGE_BATCH
+                && job_count < batch_size) {
+
+            guac_client_image_state* state = &states[image_count];
+            guac_client_image_lookup(client, state, &images[image_count]);
+
+            if (state->cached == NULL) {
+
+                guac_stream* stream = guac_client_alloc_stream(client);
+
+                /* Images cannot be sent without streams */
+                if (stream == NULL) {
+                    guac_client_log(client, GUAC_LOG_WARNING, "No streams "
+                            "available for image. Image dropped.");
+                    state->cacheable = 0;
+                }
+
+                else {
+                    state->job = &jobs[job_count++];
+                    memset(state->job, 0, sizeof(guac_encode_job));
+                    state->job->image = state->image;
+                    state->job->stream = stream;
+                }
+
+            }
+
+            image_count++;
+
+        }
+
+        if (job_count > 0)
+            guac_encode_pool_run(pool, jobs, job_count);
+
+        /* Send each image in original order */
+        for (i = 0; i < image_count; i++) {
+
+            guac_client_image_state* state = &states[i];
+
+            /* Draw identical images from cache */
+            if (state->cached != NULL) {
+                guac_client_image_send_cached(socket, state);
+                continue;
+            }
+
+            /* Send encoded image, skipping images which could not be
+             * encoded */
+            if (state->job == NULL
+                    || guac_client_image_send_encoded(client, socket, state))
+                continue;
+
+            guac_client_image_store(client, socket, state);
+
+        }
+
+        /* Streams must not be reused until their "end" has been sent */
+        for (i = 0; i < job_count; i++)
+            guac_client_free_stream(client, jobs[i].stream);
+
+        images += image_count;
+        count -= image_count;
+
+    }
+
+}
+
 int guac_client_supports_webp(guac_client* client) {
 
 #ifdef ENABLE_WEBP
@@ -478,3 +890,33 @@ int guac_client_supports_webp(guac_client* client) {
 
 }
 
+int guac_client_supports_video(guac_client* client) {
+
+#ifdef ENABLE_VPX
+    char** mimetype = client->info.video_mimetypes;
+
+    /* Clients which do not support video at all provide no list */
+    if (mimetype == NULL)
+        return 0;
+
+    /* Search for WebM mimetype in list of supported video mimetypes */
+    while (*mimetype != NULL) {
+
+        /* If WebM mimetype found, no need to search further */
+        if (strcmp(*mimetype, GUAC_VIDEO_MIMETYPE) == 0)
+            return 1;
+
+        /* Next mimetype */
+        mimetype++;
+
+    }
+
+    /* Client does not support WebM */
+    return 0;
+#else
+    /* Support for video is completely absent */
+    return 0;
+#endif
+
+}
+
@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "client-constants.h"
+#include "congestion.h"
+#include "timestamp.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+guac_congestion* guac_congestion_alloc() {
+
+    guac_congestion* congestion = malloc(sizeof(guac_congestion));
+    if (congestion == NULL)
+        return NULL;
+
+    pthread_mutex_init(&(congestion->lock), NULL);
+
+    congestion->pending_start = 0;
+    congestion->pending_count = 0;
+    congestion->last_acknowledged = 0;
+
+    congestion->rtt = -1;
+    congestion->min_rtt = 0;
+    congestion->window_min_rtt = 0;
+    congestion->window_start = 0;
+
+    congestion->sent_bytes = 0;
+    congestion->sample_bytes = 0;
+    congestion->sample_sent_bytes = 0;
+    congestion->sample_start = 0;
+    congestion->throughput = 0;
+    congestion->output_rate = 0;
+
+    congestion->level = 0;
+
+    return congestion;
+
+}
+
+void guac_congestion_free(guac_congestion* congestion) {
+    pthread_mutex_destroy(&(congestion->lock));
+    free(congestion);
+}
+
+/**
+ * Updates the throughput and output rate estimates of the given congestion
+ * estimator, given the total number of bytes now known to have been received
+ * by the client. The lock of the congestion estimator must already be held.
+ *
+ * @param congestion
+ *     The congestion estimator to update.
+ *
+ * @param bytes
+ *     The total number of bytes known to have been received by the client.
+ *
+ * @param now
+ *     The current time.
+ */
+static void guac_congestion_delivered(guac_congestion* congestion,
+        uint64_t bytes, guac_timestamp now) {
+
+    int elapsed = now - congestion->sample_start;
+    int sample;
+    int output_sample;
+
+    /* Begin first sample */
+    if (congestion->sample_start == 0) {
+        congestion->sample_bytes = bytes;
+        congestion->sample_sent_bytes = congestion->sent_bytes;
+        congestion->sample_start = now;
+        return;
+    }
+
+    /* Continue sample until long enough to be meaningful */
+    if (elapsed < GUAC_CONGESTION_THROUGHPUT_INTERVAL)
+        return;
+
+    sample = (int) ((bytes - congestion->sample_bytes) * 1000 / elapsed);
+    output_sample = (int) ((congestion->sent_bytes
+                - congestion->sample_sent_bytes) * 1000 / elapsed);
+
+    /* Smooth throughput and output rate over several samples */
+    if (congestion->throughput == 0) {
+        congestion->throughput = sample;
+        congestion->output_rate = output_sample;
+    }
+    else {
+        congestion->throughput = (congestion->throughput * 3 + sample) / 4;
+        congestion->output_rate =
+            (congestion->output_rate * 3 + output_sample) / 4;
+    }
+
+    /* Begin next sample */
+    congestion->sample_bytes = bytes;
+    congestion->sample_sent_bytes = congestion->sent_bytes;
+    congestion->sample_start = now;
+
+}
+
+void guac_congestion_sent(guac_congestion* congestion,
+        guac_timestamp timestamp, uint64_t bytes) {
+
+    pthread_mutex_lock(&(congestion->lock));
+
+    congestion->sent_bytes = bytes;
+
+    /* The acknowledgement may arrive before the sync could be recorded */
+    if (timestamp <= congestion->last_acknowledged)
+        guac_congestion_delivered(congestion, bytes, guac_timestamp_current());
+
+    /* Otherwise, await acknowledgement if there is room to track it */
+    else if (congestion->pending_count < GUAC_CONGESTION_MAX_PENDING) {
+
+        int index = (congestion->pending_start + congestion->pending_count)
+                  % GUAC_CONGESTION_MAX_PENDING;
+
+        congestion->pending[index].timestamp = timestamp;
+        congestion->pending[index].bytes = bytes;
+        congestion->pending_count++;
+
+    }
+
+    pthread_mutex_unlock(&(congestion->lock));
+
+}
+
+void guac_congestion_acknowledged(guac_congestion* congestion,
+        guac_timestamp timestamp, guac_timestamp now) {
+
+    int rtt = now - timestamp;
+    int delay;
+
+    pthread_mutex_lock(&(congestion->lock));
+
+    /* Ignore repeated acknowledgements, which would overstate the RTT */
+    if (timestamp <= congestion->last_acknowledged) {
+        pthread_mutex_unlock(&(congestion->lock));
+        return;
+    }
+
+    congestion->last_acknowledged = timestamp;
+
+    /* Everything sent up to and including the acknowledged sync has been
+     * received, while anything sent before it need no longer be tracked */
+    while (congestion->pending_count > 0) {
+
+        guac_congestion_sync* sync =
+            &(congestion->pending[congestion->pending_start]);
+
+        if (sync->timestamp > timestamp)
+            break;
+
+        if (sync->timestamp == timestamp)
+            guac_congestion_delivered(congestion, sync->bytes, now);
+
+        congestion->pending_start = (congestion->pending_start + 1)
+                                  % GUAC_CONGESTION_MAX_PENDING;
+        congestion->pending_count--;
+
+    }
+
+    /* Smooth RTT, starting from the first sample */
+    if (congestion->rtt < 0) {
+        congestion->rtt = rtt;
+        congestion->min_rtt = rtt;
+        congestion->window_min_rtt = rtt;
+        congestion->window_start = now;
+    }
+    else
+        congestion->rtt = (congestion->rtt * 7 + rtt) / 8;
+
+    /* Track lowest RTT, carrying the lowest of each window into the next */
+    if (rtt < congestion->window_min_rtt)
+        congestion->window_min_rtt = rtt;
+
+    if (rtt < congestion->min_rtt)
+        congestion->min_rtt = rtt;
+
+    if (now - congestion->window_start >= GUAC_CONGESTION_MIN_RTT_WINDOW) {
+        congestion->min_rtt = congestion->window_min_rtt;
+        congestion->window_min_rtt = rtt;
+        congestion->window_start = now;
+    }
+
+    /* Back off quickly if output is queuing or taking too long to arrive,
+     * recovering slowly otherwise */
+    delay = congestion->rtt - congestion->min_rtt;
+    if (delay > GUAC_CONGESTION_HIGH_DELAY
+            || congestion->rtt > GUAC_CONGESTION_MAX_RTT) {
+
+        /* Hold the current level if the client is receiving data far faster
+         * than it is produced, as the queue is then already draining */
+        if (congestion->throughput > 0 && congestion->throughput
+                >= congestion->output_rate * GUAC_CONGESTION_DRAIN_FACTOR) {
+            pthread_mutex_unlock(&(congestion->lock));
+            return;
+        }
+
+        congestion->level += GUAC_CONGESTION_INCREASE + congestion->level / 2;
+        if (congestion->level > GUAC_CLIENT_MAX_CONGESTION)
+            congestion->level = GUAC_CLIENT_MAX_CONGESTION;
+    }
+
+    else if (delay < GUAC_CONGESTION_LOW_DELAY) {
+        congestion->level -= GUAC_CONGESTION_DECREASE;
+        if (congestion->level < 0)
+            congestion->level = 0;
+    }
+
+    pthread_mutex_unlock(&(congestion->lock));
+
+}
+
@@ -0,0 +1,276 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GUAC_CONGESTION_H
+#define GUAC_CONGESTION_H
+
+#include "config.h"
+
+#include "timestamp-types.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+/**
+ * The maximum number of unacknowledged "sync" instructions tracked at once.
+ * Instructions sent while this many are pending are not used to estimate
+ * throughput.
+ */
+#define GUAC_CONGESTION_MAX_PENDING 64
+
+/**
+ * The queuing delay, in milliseconds, below which the connection is
+ * considered uncongested, provided its round-trip time is also below
+ * GUAC_CONGESTION_MAX_RTT. Queuing delay is the amount by which the smoothed
+ * round-trip time exceeds the lowest round-trip time recently observed.
+ */
+#define GUAC_CONGESTION_LOW_DELAY 30
+
+/**
+ * The queuing delay, in milliseconds, above which the connection is
+ * considered congested.
+ */
+#define GUAC_CONGESTION_HIGH_DELAY 100
+
+/**
+ * The smoothed round-trip time, in milliseconds, above which the connection
+ * is considered congested regardless of the lowest round-trip time observed.
+ * As the first "sync" acknowledged may already have queued behind a full
+ * screen of image data, a connection may be congested from the start, in
+ * which case its queuing delay cannot be measured.
+ */
+#define GUAC_CONGESTION_MAX_RTT 250
+
+/**
+ * The amount the congestion level is raised by each acknowledgement received
+ * while the connection is congested, in addition to half the current level.
+ * Congestion is raised quickly so that output backs off before guacd stops
+ * handling server messages entirely.
+ */
+#define GUAC_CONGESTION_INCREASE 10
+
+/**
+ * The amount the congestion level is lowered by each acknowledgement
+ * received while the connection is uncongested. Congestion is lowered slowly
+ * so that quality is not restored only to immediately congest the connection
+ * again.
+ */
+#define GUAC_CONGESTION_DECREASE 2
+
+/**
+ * The number of milliseconds for which the lowest observed round-trip time
+ * is trusted. The lowest round-trip time of each window becomes the baseline
+ * of the next, such that the baseline follows changes in the route.
+ */
+#define GUAC_CONGESTION_MIN_RTT_WINDOW 10000
+
+/**
+ * The minimum number of milliseconds over which each throughput sample is
+ * measured.
+ */
+#define GUAC_CONGESTION_THROUGHPUT_INTERVAL 250
+
+/**
+ * The factor by which the throughput of a connection must exceed the rate
+ * at which output is produced for the connection to be considered to be
+ * draining. While a connection is draining, data queued earlier is being
+ * received far faster than new data is added, and the congestion level is
+ * not raised further even though the round-trip time remains high.
+ */
+#define GUAC_CONGESTION_DRAIN_FACTOR 2
+
+/**
+ * A "sync" instruction which has been sent but not yet acknowledged.
+ */
+typedef struct guac_congestion_sync {
+
+    /**
+     * The timestamp within the "sync" instruction.
+     */
+    guac_timestamp timestamp;
+
+    /**
+     * The total number of bytes written to the socket, including the "sync"
+     * instruction itself, as of the time the instruction was flushed.
+     */
+    uint64_t bytes;
+
+} guac_congestion_sync;
+
+/**
+ * Estimates the round-trip time, throughput, and congestion of a connection
+ * from acknowledgements of "sync" instructions. A connection is congested if
+ * its round-trip time rises significantly above the lowest recently observed,
+ * as happens when output is produced faster than the client can receive it
+ * and queues within the network, or if its round-trip time is simply too
+ * long for the session to remain interactive.
+ */
+typedef struct guac_congestion {
+
+    /**
+     * Lock which is acquired whenever this structure is accessed, as "sync"
+     * instructions are sent and acknowledged by different threads.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Ring buffer of all sent "sync" instructions which have not yet been
+     * acknowledged, oldest first.
+     */
+    guac_congestion_sync pending[GUAC_CONGESTION_MAX_PENDING];
+
+    /**
+     * The index of the oldest entry within pending.
+     */
+    int pending_start;
+
+    /**
+     * The number of entries within pending.
+     */
+    int pending_count;
+
+    /**
+     * The timestamp of the most recently acknowledged "sync" instruction.
+     * Acknowledgements of this or any earlier timestamp are duplicates and
+     * are ignored.
+     */
+    guac_timestamp last_acknowledged;
+
+    /**
+     * The smoothed round-trip time, in milliseconds, or -1 if no
+     * acknowledgement has yet been received.
+     */
+    int rtt;
+
+    /**
+     * The lowest round-trip time observed within the previous or current
+     * window, in milliseconds.
+     */
+    int min_rtt;
+
+    /**
+     * The lowest round-trip time observed within the current window, in
+     * milliseconds.
+     */
+    int window_min_rtt;
+
+    /**
+     * The time the current window of round-trip times began.
+     */
+    guac_timestamp window_start;
+
+    /**
+     * The total number of bytes written to the connection as of the most
+     * recently sent "sync" instruction.
+     */
+    uint64_t sent_bytes;
+
+    /**
+     * The total number of bytes known to have been received by the client
+     * as of the start of the current throughput sample.
+     */
+    uint64_t sample_bytes;
+
+    /**
+     * The total number of bytes written to the connection as of the start
+     * of the current throughput sample.
+     */
+    uint64_t sample_sent_bytes;
+
+    /**
+     * The time the current throughput sample began, or zero if no sample
+     * has begun.
+     */
+    guac_timestamp sample_start;
+
+    /**
+     * The smoothed rate at which the client has received data, in bytes per
+     * second, or zero if not yet known.
+     */
+    int throughput;
+
+    /**
+     * The smoothed rate at which data has been written to the connection
+     * over the same samples as throughput, in bytes per second, or zero if
+     * not yet known.
+     */
+    int output_rate;
+
+    /**
+     * The current level of congestion, from 0 to GUAC_CLIENT_MAX_CONGESTION
+     * inclusive.
+     */
+    int level;
+
+} guac_congestion;
+
+/**
+ * Allocates a new congestion estimator for a connection for which nothing
+ * has yet been sent.
+ *
+ * @return
+ *     A newly-allocated congestion estimator, or NULL if allocation fails.
+ */
+guac_congestion* guac_congestion_alloc();
+
+/**
+ * Frees the given congestion estimator.
+ *
+ * @param congestion
+ *     The congestion estimator to free.
+ */
+void guac_congestion_free(guac_congestion* congestion);
+
+/**
+ * Records that a "sync" instruction has been sent and flushed.
+ *
+ * @param congestion
+ *     The congestion estimator of the connection.
+ *
+ * @param timestamp
+ *     The timestamp within the "sync" instruction.
+ *
+ * @param bytes
+ *     The total number of bytes written to the connection, including the
+ *     "sync" instruction itself.
+ */
+void guac_congestion_sent(guac_congestion* congestion,
+        guac_timestamp timestamp, uint64_t bytes);
+
+/**
+ * Records that a "sync" instruction has been acknowledged, updating the
+ * round-trip time, throughput, and congestion level of the connection.
+ *
+ * @param congestion
+ *     The congestion estimator of the connection.
+ *
+ * @param timestamp
+ *     The timestamp within the acknowledged "sync" instruction.
+ *
+ * @param now
+ *     The current time.
+ */
+void guac_congestion_acknowledged(guac_congestion* congestion,
+        guac_timestamp timestamp, guac_timestamp now);
+
+#endif
+
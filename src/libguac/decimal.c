@@ -0,0 +1,188 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "decimal.h"
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * All two-digit decimal numbers from "00" through "99", concatenated.
+ */
+static const char guac_decimal_pairs[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+/**
+ * All powers of ten representable as a uint64_t.
+ */
+static const uint64_t guac_decimal_powers[] = {
+    1ULL,
+    10ULL,
+    100ULL,
+    1000ULL,
+    10000ULL,
+    100000ULL,
+    1000000ULL,
+    10000000ULL,
+    100000000ULL,
+    1000000000ULL,
+    10000000000ULL,
+    100000000000ULL,
+    1000000000000ULL,
+    10000000000000ULL,
+    100000000000000ULL,
+    1000000000000000ULL,
+    10000000000000000ULL,
+    100000000000000000ULL,
+    1000000000000000000ULL,
+    10000000000000000000ULL
+};
+
+/**
+ * Returns the number of decimal digits required to represent the given
+ * unsigned integer. The base-2 logarithm of the value is first scaled to an
+ * estimate of its base-10 logarithm (1233/4096 approximating log10(2)), and
+ * that estimate is corrected with a single comparison.
+ *
+ * @param value
+ *     The value to measure.
+ *
+ * @return
+ *     The number of decimal digits in the given value, which is at least one.
+ */
+static int guac_decimal_digits(uint64_t value) {
+
+    /* Zero has the same number of digits as one, as does any even value as
+     * the odd value following it */
+    uint64_t odd = value | 1;
+
+    int bits = 64 - __builtin_clzll(odd);
+    int estimate = (bits * 1233) >> 12;
+
+    return estimate + 1 - (odd < guac_decimal_powers[estimate]);
+
+}
+
+/**
+ * Writes the given number of decimal digits of the given unsigned integer to
+ * the given buffer, working backward from the last digit.
+ *
+ * @param buffer
+ *     The buffer to write to.
+ *
+ * @param value
+ *     The value to format.
+ *
+ * @param digits
+ *     The number of digits in the given value, as returned by
+ *     guac_decimal_digits().
+ */
+static void guac_decimal_write_digits(char* buffer, uint64_t value,
+        int digits) {
+
+    char* current = buffer + digits;
+
+    /* Write pairs of digits */
+    while (value >= 100) {
+        const char* pair = &guac_decimal_pairs[(value % 100) * 2];
+        value /= 100;
+        current -= 2;
+        current[0] = pair[0];
+        current[1] = pair[1];
+    }
+
+    /* Write remaining one or two digits */
+    if (value >= 10) {
+        const char* pair = &guac_decimal_pairs[value * 2];
+        current[-2] = pair[0];
+        current[-1] = pair[1];
+    }
+    else
+        current[-1] = '0' + value;
+
+}
+
+int guac_decimal_format(char* buffer, int64_t value) {
+
+    uint64_t magnitude = (uint64_t) value;
+    int negative = value < 0;
+    int digits;
+
+    /* Negate in unsigned arithmetic, such that INT64_MIN is handled */
+    if (negative) {
+        magnitude = 0 - magnitude;
+        *(buffer++) = '-';
+    }
+
+    digits = guac_decimal_digits(magnitude);
+    guac_decimal_write_digits(buffer, magnitude, digits);
+
+    return digits + negative;
+
+}
+
+int guac_decimal_format_element(char* buffer, int64_t value) {
+
+    uint64_t magnitude = (uint64_t) value;
+    int negative = value < 0;
+    int digits, length, prefix_length;
+
+    if (negative)
+        magnitude = 0 - magnitude;
+
+    /* Length prefix is known before any digits are written */
+    digits = guac_decimal_digits(magnitude);
+    length = digits + negative;
+
+    if (length >= 10) {
+        buffer[0] = '0' + length / 10;
+        buffer[1] = '0' + length % 10;
+        prefix_length = 2;
+    }
+    else {
+        buffer[0] = '0' + length;
+        prefix_length = 1;
+    }
+
+    buffer[prefix_length] = '.';
+    buffer += prefix_length + 1;
+
+    if (negative)
+        *(buffer++) = '-';
+
+    guac_decimal_write_digits(buffer, magnitude, digits);
+
+    return prefix_length + 1 + length;
+
+}
+
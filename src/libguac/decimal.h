@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GUAC_DECIMAL_H
+#define GUAC_DECIMAL_H
+
+#include "config.h"
+
+#include <stdint.h>
+
+/**
+ * The maximum number of characters required to represent any int64_t in
+ * decimal, including the sign.
+ */
+#define GUAC_DECIMAL_MAX_LENGTH 20
+
+/**
+ * The maximum number of characters required to represent any int64_t as a
+ * Guacamole protocol element, including its length prefix and the period
+ * separating that prefix from the value.
+ */
+#define GUAC_DECIMAL_MAX_ELEMENT_LENGTH (GUAC_DECIMAL_MAX_LENGTH + 3)
+
+/**
+ * Writes the decimal representation of the given integer to the given
+ * buffer. Digits are produced two at a time from a lookup table, and the
+ * number of digits is determined up front without division, such that each
+ * digit is written exactly once directly into its final position.
+ *
+ * @param buffer
+ *     The buffer to write to, which must have space for at least
+ *     GUAC_DECIMAL_MAX_LENGTH characters. No null terminator is written.
+ *
+ * @param value
+ *     The integer to format.
+ *
+ * @return
+ *     The number of characters written.
+ */
+int guac_decimal_format(char* buffer, int64_t value);
+
+/**
+ * Writes the given integer to the given buffer as a Guacamole protocol
+ * element, including its length prefix, in a single pass. For example, the
+ * value 1024 is written as "4.1024".
+ *
+ * @param buffer
+ *     The buffer to write to, which must have space for at least
+ *     GUAC_DECIMAL_MAX_ELEMENT_LENGTH characters. No null terminator is
+ *     written.
+ *
+ * @param value
+ *     The integer to format.
+ *
+ * @return
+ *     The number of characters written.
+ */
+int guac_decimal_format_element(char* buffer, int64_t value);
+
+#endif
+
@@ -36,6 +36,32 @@
 #include <stdlib.h>
 #include <string.h>
 
+struct guac_jpeg_encoder {
+
+    /**
+     * The libjpeg compression object, which is reused for each image.
+     */
+    struct jpeg_compress_struct cinfo;
+
+    /**
+     * The libjpeg error handler associated with cinfo.
+     */
+    struct jpeg_error_mgr jerr;
+
+#ifndef JCS_EXTENSIONS
+    /**
+     * Buffer receiving each scanline after conversion to RGB.
+     */
+    unsigned char* scanline;
+
+    /**
+     * The number of bytes allocated for scanline.
+     */
+    int scanline_size;
+#endif
+
+};
+
 /**
  * Extended version of the standard libjpeg jpeg_destination_mgr struct, which
  * provides access to the pointers to the output buffer and size. The values
@@ -167,8 +193,30 @@ static void jpeg_guac_dest(j_compress_ptr cinfo, guac_socket* socket,
 
 }
 
-int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface, int quality) {
+guac_jpeg_encoder* guac_jpeg_encoder_alloc() {
+
+    guac_jpeg_encoder* encoder = malloc(sizeof(guac_jpeg_encoder));
+    if (encoder == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for JPEG encoder";
+        return NULL;
+    }
+
+    /* Create compression object, to be reused for all images */
+    encoder->cinfo.err = jpeg_std_error(&encoder->jerr);
+    jpeg_create_compress(&encoder->cinfo);
+
+#ifndef JCS_EXTENSIONS
+    encoder->scanline = NULL;
+    encoder->scanline_size = 0;
+#endif
+
+    return encoder;
+
+}
+
+int guac_jpeg_encoder_write(guac_jpeg_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, cairo_surface_t* surface, int quality) {
 
     /* Get image surface properties and data */
     cairo_format_t format = cairo_image_surface_get_format(surface);
@@ -188,48 +236,59 @@ int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
     /* Flush pending operations to surface */
     cairo_surface_flush(surface);
 
-    /* Prepare JPEG bits */
-    struct jpeg_compress_struct cinfo;
-    struct jpeg_error_mgr jerr;
-    cinfo.err = jpeg_std_error(&jerr);
-    jpeg_create_compress(&cinfo);
+    /* Reuse JPEG bits of encoder */
+    j_compress_ptr cinfo = &encoder->cinfo;
 
     /* Write JPEG directly to given stream */
-    jpeg_guac_dest(&cinfo, socket, stream);
+    jpeg_guac_dest(cinfo, socket, stream);
 
-    cinfo.image_width = width; /* image width and height, in pixels */
-    cinfo.image_height = height;
-    cinfo.arith_code = TRUE;
+    cinfo->image_width = width; /* image width and height, in pixels */
+    cinfo->image_height = height;
+    cinfo->arith_code = TRUE;
 
 #ifdef JCS_EXTENSIONS
     /* The Turbo JPEG extentions allows us to use the Cairo surface
      * (BGRx) as input without converting it */
-    cinfo.input_components = 4;
-    cinfo.in_color_space = JCS_EXT_BGRX;
+    cinfo->input_components = 4;
+    cinfo->in_color_space = JCS_EXT_BGRX;
 #else
     /* Standard JPEG supports RGB as input so we will have to convert
      * the contents of the Cairo surface from (BGRx) to RGB */
-    cinfo.input_components = 3;
-    cinfo.in_color_space = JCS_RGB;
-
-    /* Create a buffer for the write scan line which is where we will
-     * put the converted pixels (BGRx -> RGB) */
-    int write_stride = cinfo.image_width * cinfo.input_components;
-    unsigned char *scanline_data = malloc(write_stride);
-    memset(scanline_data, 0, write_stride);
+    cinfo->input_components = 3;
+    cinfo->in_color_space = JCS_RGB;
+
+    /* Ensure the buffer for the write scan line, which is where we will
+     * put the converted pixels (BGRx -> RGB), is large enough */
+    int write_stride = cinfo->image_width * cinfo->input_components;
+    if (write_stride > encoder->scanline_size) {
+
+        unsigned char* scanline = realloc(encoder->scanline, write_stride);
+        if (scanline == NULL) {
+            guac_error = GUAC_STATUS_NO_MEMORY;
+            guac_error_message = "Could not allocate memory for JPEG "
+                "scanline";
+            return -1;
+        }
+
+        encoder->scanline = scanline;
+        encoder->scanline_size = write_stride;
+
+    }
+
+    unsigned char *scanline_data = encoder->scanline;
 #endif
 
     /* Initialize the JPEG compressor */
-    jpeg_set_defaults(&cinfo);
-    jpeg_set_quality(&cinfo, quality, TRUE /* limit to baseline-JPEG values */);
-    jpeg_start_compress(&cinfo, TRUE);
+    jpeg_set_defaults(cinfo);
+    jpeg_set_quality(cinfo, quality, TRUE /* limit to baseline-JPEG values */);
+    jpeg_start_compress(cinfo, TRUE);
 
     JSAMPROW row_pointer[1]; /* pointer to a single row */
 
     /* Write scanlines to be used in JPEG compression */
-    while (cinfo.next_scanline < cinfo.image_height) {
+    while (cinfo->next_scanline < cinfo->image_height) {
 
-        int row_offset = stride * cinfo.next_scanline;
+        int row_offset = stride * cinfo->next_scanline;
 
 #ifdef JCS_EXTENSIONS
         /* In Turbo JPEG we can use the raw BGRx scanline  */
@@ -253,19 +312,41 @@ int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
         row_pointer[0] = scanline_data;
 #endif
 
-        jpeg_write_scanlines(&cinfo, row_pointer, 1);
+        jpeg_write_scanlines(cinfo, row_pointer, 1);
     }
 
+    /* Finalize compression, leaving the compression object ready for the
+     * next image */
+    jpeg_finish_compress(cinfo);
+    return 0;
+
+}
+
+void guac_jpeg_encoder_free(guac_jpeg_encoder* encoder) {
+
+    jpeg_destroy_compress(&encoder->cinfo);
+
 #ifndef JCS_EXTENSIONS
-    free(scanline_data);
+    free(encoder->scanline);
 #endif
 
-    /* Finalize compression */
-    jpeg_finish_compress(&cinfo);
-
-    /* Clean up */
-    jpeg_destroy_compress(&cinfo);
-    return 0;
+    free(encoder);
 
 }
 
+int guac_jpeg_write(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, int quality) {
+
+    int result;
+
+    guac_jpeg_encoder* encoder = guac_jpeg_encoder_alloc();
+    if (encoder == NULL)
+        return -1;
+
+    result = guac_jpeg_encoder_write(encoder, socket, stream, surface,
+            quality);
+
+    guac_jpeg_encoder_free(encoder);
+    return result;
+
+}
@@ -30,9 +30,59 @@
 
 #include <cairo/cairo.h>
 
+/**
+ * Reusable state for encoding JPEG images, including the libjpeg compression
+ * object, which would otherwise be created and destroyed for each image. An
+ * encoder must not be used by more than one thread at a time.
+ */
+typedef struct guac_jpeg_encoder guac_jpeg_encoder;
+
+/**
+ * Allocates a new JPEG encoder.
+ *
+ * @return
+ *     A newly-allocated encoder, or NULL if allocation fails.
+ */
+guac_jpeg_encoder* guac_jpeg_encoder_alloc();
+
+/**
+ * Encodes the given surface as a JPEG using the given encoder, and sends the
+ * resulting data over the given stream and socket as blobs.
+ *
+ * @param encoder
+ *     The encoder to use.
+ *
+ * @param socket
+ *     The socket to send JPEG blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param surface
+ *     The Cairo surface to write to the given stream and socket as JPEG blobs.
+ *
+ * @param quality
+ *     JPEG image quality.
+ *
+ * @return
+ *     Zero if the encoding operation is successful, non-zero otherwise.
+ */
+int guac_jpeg_encoder_write(guac_jpeg_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, cairo_surface_t* surface, int quality);
+
+/**
+ * Frees the given encoder, destroying its compression object.
+ *
+ * @param encoder
+ *     The encoder to free.
+ */
+void guac_jpeg_encoder_free(guac_jpeg_encoder* encoder);
+
 /**
  * Encodes the given surface as a JPEG, and sends the resulting data over the
- * given stream and socket as blobs.
+ * given stream and socket as blobs. This is equivalent to encoding with a
+ * temporary encoder; callers which encode many images should allocate their
+ * own encoder with guac_jpeg_encoder_alloc().
  *
  * @param socket
  *     The socket to send JPEG blobs over.
@@ -40,6 +40,56 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <zlib.h>
+
+struct guac_png_encoder {
+
+    /**
+     * The palette of the image most recently encoded.
+     */
+    guac_palette palette;
+
+    /**
+     * The palette index of each pixel of the image being encoded, one byte
+     * per pixel, stored contiguously row by row.
+     */
+    png_byte* indices;
+
+    /**
+     * The number of bytes allocated for indices.
+     */
+    size_t indices_size;
+
+    /**
+     * Pointers to the start of each row within indices, as required by
+     * libpng.
+     */
+    png_byte** rows;
+
+    /**
+     * The number of entries allocated for rows.
+     */
+    int rows_size;
+
+    /**
+     * The zlib compression level to use, from 0 to 9, or
+     * Z_DEFAULT_COMPRESSION.
+     */
+    int compression_level;
+
+    /**
+     * The zlib compression strategy to use, such as Z_DEFAULT_STRATEGY or
+     * Z_RLE.
+     */
+    int compression_strategy;
+
+    /**
+     * The libpng row filters to use, as a bitwise OR of PNG_FILTER_*
+     * values, or -1 to let libpng choose.
+     */
+    int filters;
+
+};
 
 /**
  * Data describing the current write state of PNG data.
@@ -268,44 +318,230 @@ static void guac_png_flush_handler(png_structp png) {
 
 }
 
-int guac_png_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface) {
+guac_png_encoder* guac_png_encoder_alloc() {
 
-    png_structp png;
-    png_infop png_info;
-    png_byte** png_rows;
-    int bpp;
+    guac_png_encoder* encoder = malloc(sizeof(guac_png_encoder));
+    if (encoder == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for PNG encoder";
+        return NULL;
+    }
+
+    memset(&encoder->palette, 0, sizeof(encoder->palette));
+    encoder->indices = NULL;
+    encoder->indices_size = 0;
+    encoder->rows = NULL;
+    encoder->rows_size = 0;
+
+    guac_png_encoder_configure(encoder, GUAC_PNG_DEFAULT_COMPRESSION_LEVEL,
+            GUAC_PNG_DEFAULT_STRATEGY, GUAC_PNG_DEFAULT_FILTER);
+
+    return encoder;
+
+}
+
+void guac_png_encoder_configure(guac_png_encoder* encoder, int level,
+        guac_client_png_strategy strategy, guac_client_png_filter filter) {
+
+    /* Any out-of-range level selects the zlib default */
+    if (level < 0 || level > 9)
+        level = Z_DEFAULT_COMPRESSION;
+
+    encoder->compression_level = level;
+
+    switch (strategy) {
+
+        case GUAC_CLIENT_PNG_STRATEGY_FILTERED:
+            encoder->compression_strategy = Z_FILTERED;
+            break;
+
+        case GUAC_CLIENT_PNG_STRATEGY_HUFFMAN_ONLY:
+            encoder->compression_strategy = Z_HUFFMAN_ONLY;
+            break;
+
+        case GUAC_CLIENT_PNG_STRATEGY_RLE:
+            encoder->compression_strategy = Z_RLE;
+            break;
+
+        default:
+            encoder->compression_strategy = Z_DEFAULT_STRATEGY;
+
+    }
+
+    switch (filter) {
+
+        case GUAC_CLIENT_PNG_FILTER_NONE:
+            encoder->filters = PNG_FILTER_NONE;
+            break;
+
+        case GUAC_CLIENT_PNG_FILTER_SUB:
+            encoder->filters = PNG_FILTER_SUB;
+            break;
+
+        case GUAC_CLIENT_PNG_FILTER_UP:
+            encoder->filters = PNG_FILTER_UP;
+            break;
+
+        case GUAC_CLIENT_PNG_FILTER_ADAPTIVE:
+            encoder->filters = PNG_ALL_FILTERS;
+            break;
+
+        default:
+            encoder->filters = -1;
+
+    }
+
+}
+
+/**
+ * Ensures the index and row buffers of the given encoder are large enough
+ * for an image of the given dimensions, growing those buffers if necessary.
+ * Buffers are never shrunk, such that images of similar size are encoded
+ * without any further allocation.
+ *
+ * @param encoder
+ *     The encoder whose buffers should be checked.
+ *
+ * @param width
+ *     The width of the image to be encoded, in pixels.
+ *
+ * @param height
+ *     The height of the image to be encoded, in pixels.
+ *
+ * @return
+ *     Zero if the buffers are now large enough, non-zero if allocation
+ *     failed.
+ */
+static int guac_png_encoder_reserve(guac_png_encoder* encoder,
+        int width, int height) {
+
+    size_t indices_size = (size_t) width * height;
+
+    if (indices_size > encoder->indices_size) {
+
+        png_byte* indices = realloc(encoder->indices, indices_size);
+        if (indices == NULL)
+            return 1;
+
+        encoder->indices = indices;
+        encoder->indices_size = indices_size;
+
+    }
+
+    if (height > encoder->rows_size) {
+
+        png_byte** rows = realloc(encoder->rows, sizeof(png_byte*) * height);
+        if (rows == NULL)
+            return 1;
+
+        encoder->rows = rows;
+        encoder->rows_size = height;
+
+    }
+
+    return 0;
+
+}
+
+/**
+ * Packs each row of one-byte palette indices within the given encoder into
+ * the given number of bits per index, in place, as required by PNG for
+ * palettes of 16 or fewer colors.
+ *
+ * @param encoder
+ *     The encoder whose indices should be packed.
+ *
+ * @param width
+ *     The width of the image, in pixels.
+ *
+ * @param height
+ *     The height of the image, in pixels.
+ *
+ * @param bpp
+ *     The number of bits per index, which must be 1, 2 or 4.
+ */
+static void guac_png_encoder_pack(guac_png_encoder* encoder,
+        int width, int height, int bpp) {
 
     int x, y;
 
-    guac_png_write_state write_state;
+    int per_byte = 8 / bpp;
 
-    /* Get image surface properties and data */
-    cairo_format_t format = cairo_image_surface_get_format(surface);
-    int width = cairo_image_surface_get_width(surface);
-    int height = cairo_image_surface_get_height(surface);
-    int stride = cairo_image_surface_get_stride(surface);
-    unsigned char* data = cairo_image_surface_get_data(surface);
+    for (y = 0; y < height; y++) {
 
-    /* If not RGB24, use Cairo PNG writer */
-    if (format != CAIRO_FORMAT_RGB24 || data == NULL)
-        return guac_png_cairo_write(socket, stream, surface);
+        /* Packed data is never longer than the data it replaces */
+        png_byte* row = encoder->indices + (size_t) y * width;
+        png_byte* packed = row;
 
-    /* Flush pending operations to surface */
-    cairo_surface_flush(surface);
+        for (x = 0; x < width; x += per_byte) {
 
-    /* Attempt to build palette */
-    guac_palette* palette = guac_palette_alloc(surface);
+            int i;
+            int value = 0;
+            int shift = 8 - bpp;
 
-    /* If not possible, resort to Cairo PNG writer */
-    if (palette == NULL)
-        return guac_png_cairo_write(socket, stream, surface);
+            /* Most significant bits contain the leftmost pixel */
+            for (i = x; i < x + per_byte && i < width; i++) {
+                value |= row[i] << shift;
+                shift -= bpp;
+            }
 
-    /* Calculate BPP from palette size */
-    if      (palette->size <= 2)  bpp = 1;
-    else if (palette->size <= 4)  bpp = 2;
-    else if (palette->size <= 16) bpp = 4;
-    else                          bpp = 8;
+            *(packed++) = value;
+
+        }
+
+    }
+
+}
+
+/**
+ * Writes the given rows as a PNG using the settings of the given encoder,
+ * sending the resulting data over the given stream and socket as blobs.
+ *
+ * @param encoder
+ *     The encoder whose settings should be used.
+ *
+ * @param socket
+ *     The socket to send PNG blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param rows
+ *     The rows of the image, in the format described by the remaining
+ *     parameters.
+ *
+ * @param width
+ *     The width of the image, in pixels.
+ *
+ * @param height
+ *     The height of the image, in pixels.
+ *
+ * @param bit_depth
+ *     The bit depth of the PNG, as accepted by png_set_IHDR().
+ *
+ * @param color_type
+ *     The color type of the PNG, as accepted by png_set_IHDR().
+ *
+ * @param palette
+ *     The palette of the image if its color type is PNG_COLOR_TYPE_PALETTE,
+ *     NULL otherwise.
+ *
+ * @param transforms
+ *     The libpng transforms which convert the given rows into the format
+ *     of the PNG, as accepted by png_write_png().
+ *
+ * @return
+ *     Zero if the encoding operation is successful, non-zero otherwise.
+ */
+static int guac_png_encoder_write_rows(guac_png_encoder* encoder,
+        guac_socket* socket, guac_stream* stream, png_byte** rows,
+        int width, int height, int bit_depth, int color_type,
+        guac_palette* palette, int transforms) {
+
+    png_structp png;
+    png_infop png_info;
+
+    guac_png_write_state write_state;
 
     /* Set up PNG writer */
     png = png_create_write_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
@@ -341,29 +577,11 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
             guac_png_write_handler,
             guac_png_flush_handler);
 
-    /* Copy data from surface into PNG data */
-    png_rows = (png_byte**) malloc(sizeof(png_byte*) * height);
-    for (y=0; y<height; y++) {
-
-        /* Allocate new PNG row */
-        png_byte* row = (png_byte*) malloc(sizeof(png_byte) * width);
-        png_rows[y] = row;
-
-        /* Copy data from surface into current row */
-        for (x=0; x<width; x++) {
-
-            /* Get pixel color */
-            int color = ((uint32_t*) data)[x] & 0xFFFFFF;
-
-            /* Set index in row */
-            row[x] = guac_palette_find(palette, color);
-
-        }
-
-        /* Advance to next data row */
-        data += stride;
-
-    }
+    /* Apply compression settings */
+    png_set_compression_level(png, encoder->compression_level);
+    png_set_compression_strategy(png, encoder->compression_strategy);
+    if (encoder->filters != -1)
+        png_set_filter(png, PNG_FILTER_TYPE_BASE, encoder->filters);
 
     /* Write image info */
     png_set_IHDR(
@@ -371,34 +589,111 @@ int guac_png_write(guac_socket* socket, guac_stream* stream,
         png_info,
         width,
         height,
-        bpp,
-        PNG_COLOR_TYPE_PALETTE,
+        bit_depth,
+        color_type,
         PNG_INTERLACE_NONE,
         PNG_COMPRESSION_TYPE_DEFAULT,
         PNG_FILTER_TYPE_DEFAULT
     );
 
     /* Write palette */
-    png_set_PLTE(png, png_info, palette->colors, palette->size);
+    if (palette != NULL)
+        png_set_PLTE(png, png_info, palette->colors, palette->size);
 
     /* Write image */
-    png_set_rows(png, png_info, png_rows);
-    png_write_png(png, png_info, PNG_TRANSFORM_PACKING, NULL);
+    png_set_rows(png, png_info, rows);
+    png_write_png(png, png_info, transforms, NULL);
 
     /* Finish write */
     png_destroy_write_struct(&png, &png_info);
 
-    /* Free palette */
-    guac_palette_free(palette);
-
-    /* Free PNG data */
-    for (y=0; y<height; y++)
-        free(png_rows[y]);
-    free(png_rows);
-
     /* Ensure all data is written */
     guac_png_flush_data(&write_state);
     return 0;
 
 }
 
+int guac_png_encoder_write(guac_png_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, cairo_surface_t* surface) {
+
+    int bpp;
+    int y;
+
+    /* Get image surface properties and data */
+    cairo_format_t format = cairo_image_surface_get_format(surface);
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    unsigned char* data = cairo_image_surface_get_data(surface);
+
+    /* If not RGB24, use Cairo PNG writer */
+    if (format != CAIRO_FORMAT_RGB24 || data == NULL)
+        return guac_png_cairo_write(socket, stream, surface);
+
+    /* Flush pending operations to surface */
+    cairo_surface_flush(surface);
+
+    /* Ensure there is room for palette indices and row pointers */
+    if (guac_png_encoder_reserve(encoder, width, height)) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for PNG rows";
+        return -1;
+    }
+
+    png_byte** png_rows = encoder->rows;
+    guac_palette* palette = &encoder->palette;
+
+    /* Attempt to build palette, indexing each pixel as it is added */
+    if (guac_palette_index(palette, surface, encoder->indices)) {
+
+        /* If not possible, write the surface's own rows as RGB, converting
+         * each from BGRx as it is written */
+        for (y = 0; y < height; y++)
+            png_rows[y] = data + (size_t) y * stride;
+
+        return guac_png_encoder_write_rows(encoder, socket, stream, png_rows,
+                width, height, 8, PNG_COLOR_TYPE_RGB, NULL,
+                PNG_TRANSFORM_BGR | PNG_TRANSFORM_STRIP_FILLER_AFTER);
+
+    }
+
+    /* Calculate BPP from palette size */
+    if      (palette->size <= 2)  bpp = 1;
+    else if (palette->size <= 4)  bpp = 2;
+    else if (palette->size <= 16) bpp = 4;
+    else                          bpp = 8;
+
+    /* Pack indices to match BPP */
+    if (bpp < 8)
+        guac_png_encoder_pack(encoder, width, height, bpp);
+
+    for (y = 0; y < height; y++)
+        png_rows[y] = encoder->indices + (size_t) y * width;
+
+    return guac_png_encoder_write_rows(encoder, socket, stream, png_rows,
+            width, height, bpp, PNG_COLOR_TYPE_PALETTE, palette,
+            PNG_TRANSFORM_IDENTITY);
+
+}
+
+void guac_png_encoder_free(guac_png_encoder* encoder) {
+    free(encoder->rows);
+    free(encoder->indices);
+    free(encoder);
+}
+
+int guac_png_write(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface) {
+
+    int result;
+
+    guac_png_encoder* encoder = guac_png_encoder_alloc();
+    if (encoder == NULL)
+        return -1;
+
+    result = guac_png_encoder_write(encoder, socket, stream, surface);
+
+    guac_png_encoder_free(encoder);
+    return result;
+
+}
@@ -25,14 +25,99 @@
 
 #include "config.h"
 
+#include "client-types.h"
 #include "socket.h"
 #include "stream.h"
 
 #include <cairo/cairo.h>
 
+/**
+ * The zlib compression level used by default when encoding PNG images, where
+ * -1 selects zlib's own default.
+ */
+#define GUAC_PNG_DEFAULT_COMPRESSION_LEVEL -1
+
+/**
+ * The zlib compression strategy used by default when encoding PNG images.
+ */
+#define GUAC_PNG_DEFAULT_STRATEGY GUAC_CLIENT_PNG_STRATEGY_DEFAULT
+
+/**
+ * The row filter used by default when encoding PNG images.
+ */
+#define GUAC_PNG_DEFAULT_FILTER GUAC_CLIENT_PNG_FILTER_DEFAULT
+
+/**
+ * Reusable state for encoding PNG images, including the palette and the
+ * buffers of palette indices which would otherwise be allocated for each
+ * image. An encoder must not be used by more than one thread at a time.
+ */
+typedef struct guac_png_encoder guac_png_encoder;
+
+/**
+ * Allocates a new PNG encoder.
+ *
+ * @return
+ *     A newly-allocated encoder, or NULL if allocation fails.
+ */
+guac_png_encoder* guac_png_encoder_alloc();
+
+/**
+ * Sets the compression settings used by the given encoder for all following
+ * images. Newly-allocated encoders use GUAC_PNG_DEFAULT_COMPRESSION_LEVEL,
+ * GUAC_PNG_DEFAULT_STRATEGY and GUAC_PNG_DEFAULT_FILTER.
+ *
+ * @param encoder
+ *     The encoder to configure.
+ *
+ * @param level
+ *     The zlib compression level, from 0 (no compression) to 9 (best
+ *     compression), or -1 for zlib's default.
+ *
+ * @param strategy
+ *     The zlib compression strategy.
+ *
+ * @param filter
+ *     The row filter to apply before compression.
+ */
+void guac_png_encoder_configure(guac_png_encoder* encoder, int level,
+        guac_client_png_strategy strategy, guac_client_png_filter filter);
+
+/**
+ * Encodes the given surface as a PNG using the given encoder, and sends the
+ * resulting data over the given stream and socket as blobs.
+ *
+ * @param encoder
+ *     The encoder to use.
+ *
+ * @param socket
+ *     The socket to send PNG blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param surface
+ *     The Cairo surface to write to the given stream and socket as PNG blobs.
+ *
+ * @return
+ *     Zero if the encoding operation is successful, non-zero otherwise.
+ */
+int guac_png_encoder_write(guac_png_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, cairo_surface_t* surface);
+
+/**
+ * Frees the given encoder and all associated buffers.
+ *
+ * @param encoder
+ *     The encoder to free.
+ */
+void guac_png_encoder_free(guac_png_encoder* encoder);
+
 /**
  * Encodes the given surface as a PNG, and sends the resulting data over the
- * given stream and socket as blobs.
+ * given stream and socket as blobs. This is equivalent to encoding with a
+ * temporary encoder; callers which encode many images should allocate their
+ * own encoder with guac_png_encoder_alloc().
  *
  * @param socket
  *     The socket to send PNG blobs over.
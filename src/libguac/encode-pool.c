@@ -0,0 +1,398 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "client.h"
+#include "encode-jpeg.h"
+#include "encode-png.h"
+#include "encode-pool.h"
+#include "error.h"
+#include "protocol.h"
+#include "socket.h"
+#include "stream.h"
+#include "timestamp.h"
+
+#ifdef ENABLE_WEBP
+#include "encode-webp.h"
+#endif
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The initial size of the buffer allocated for the encoded instructions of
+ * each job, in bytes.
+ */
+#define GUAC_ENCODE_JOB_INITIAL_SIZE 8192
+
+/**
+ * Write handler for the private socket of each encoding thread, appending all
+ * data written to the buffer of the job currently associated with the socket.
+ * Allocation failures are recorded within the job rather than reported to
+ * the socket, such that the socket remains usable for later jobs.
+ */
+static ssize_t guac_encode_job_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guac_encode_job* job = (guac_encode_job*) socket->data;
+
+    /* Discard all further data once encoding has failed */
+    if (job->error)
+        return count;
+
+    /* Grow buffer as necessary */
+    if (job->length + count > job->size) {
+
+        int size = job->size ? job->size : GUAC_ENCODE_JOB_INITIAL_SIZE;
+        while (job->length + count > size)
+            size *= 2;
+
+        char* buffer = realloc(job->buffer, size);
+        if (buffer == NULL) {
+            job->error = 1;
+            return count;
+        }
+
+        job->buffer = buffer;
+        job->size = size;
+
+    }
+
+    memcpy(job->buffer + job->length, buf, count);
+    job->length += count;
+
+    return count;
+
+}
+
+/**
+ * Allocates a new encode context whose socket writes to the buffer of the
+ * job stored as its data. Each encoding thread has its own such context.
+ *
+ * @return
+ *     A newly-allocated context, or NULL if allocation fails.
+ */
+static guac_encode_context* guac_encode_context_alloc() {
+
+    guac_encode_context* context = calloc(1, sizeof(guac_encode_context));
+    if (context == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for encode context";
+        return NULL;
+    }
+
+    context->socket = guac_socket_alloc(0, NULL);
+    if (context->socket == NULL) {
+        free(context);
+        return NULL;
+    }
+
+    context->socket->write_handler = guac_encode_job_write_handler;
+    return context;
+
+}
+
+/**
+ * Frees the given encode context, along with its socket and any encoders
+ * allocated for it.
+ */
+static void guac_encode_context_free(guac_encode_context* context) {
+
+    if (context->png != NULL)
+        guac_png_encoder_free(context->png);
+
+    if (context->jpeg != NULL)
+        guac_jpeg_encoder_free(context->jpeg);
+
+#ifdef ENABLE_WEBP
+    if (context->webp != NULL)
+        guac_webp_encoder_free(context->webp);
+#endif
+
+    guac_socket_free(context->socket);
+    free(context);
+
+}
+
+/**
+ * Encodes the image of the given job as "img", "blob", and "end"
+ * instructions using the given context, which must have been allocated with
+ * guac_encode_context_alloc(), storing the result in the job's buffer. The
+ * encoder required for the image is allocated if not yet present within the
+ * context, and is configured using the settings of the given pool.
+ */
+static void guac_encode_job_run(guac_encode_pool* pool, guac_encode_job* job,
+        guac_encode_context* context) {
+
+    const guac_client_image* image = job->image;
+    guac_socket* socket = context->socket;
+    const char* mimetype;
+    int result;
+
+    uint64_t start = guac_timestamp_current_usec();
+
+#ifndef ENABLE_WEBP
+    /* As with guac_client_stream_webp(), WebP images are silently ignored if
+     * WebP support is not built in */
+    if (image->format == GUAC_CLIENT_IMAGE_WEBP)
+        return;
+#endif
+
+    socket->data = job;
+
+    switch (image->format) {
+
+        case GUAC_CLIENT_IMAGE_JPEG:
+            mimetype = "image/jpeg";
+            break;
+
+        case GUAC_CLIENT_IMAGE_WEBP:
+            mimetype = "image/webp";
+            break;
+
+        default:
+            mimetype = "image/png";
+
+    }
+
+    result = guac_protocol_send_img(socket, job->stream, image->mode,
+            image->layer, mimetype, image->x, image->y);
+
+    /* Write image data in requested format */
+    if (!result) {
+        switch (image->format) {
+
+            case GUAC_CLIENT_IMAGE_JPEG:
+                if (context->jpeg == NULL)
+                    context->jpeg = guac_jpeg_encoder_alloc();
+                if (context->jpeg == NULL) {
+                    result = 1;
+                    break;
+                }
+                result = guac_jpeg_encoder_write(context->jpeg, socket,
+                        job->stream, image->surface, image->quality);
+                break;
+
+#ifdef ENABLE_WEBP
+            case GUAC_CLIENT_IMAGE_WEBP:
+                if (context->webp == NULL)
+                    context->webp = guac_webp_encoder_alloc();
+                if (context->webp == NULL) {
+                    result = 1;
+                    break;
+                }
+                result = guac_webp_encoder_write(context->webp, socket,
+                        job->stream, image->surface, image->quality, 0);
+                break;
+#endif
+
+            default:
+                if (context->png == NULL)
+                    context->png = guac_png_encoder_alloc();
+                if (context->png == NULL) {
+                    result = 1;
+                    break;
+                }
+                guac_png_encoder_configure(context->png,
+                        pool->png_compression_level,
+                        pool->png_compression_strategy, pool->png_filter);
+                result = guac_png_encoder_write(context->png, socket,
+                        job->stream, image->surface);
+
+        }
+    }
+
+    if (!result)
+        result = guac_protocol_send_end(socket, job->stream);
+
+    /* Ensure all data is within the job's buffer before returning */
+    if (guac_socket_flush(socket) || result)
+        job->error = 1;
+
+    socket->data = NULL;
+    job->encode_time = guac_timestamp_current_usec() - start;
+
+}
+
+/**
+ * Claims and encodes jobs of the current batch using the given context until
+ * no unclaimed jobs remain. The lock of the given pool must be held when this
+ * function is invoked, and will be held when this function returns.
+ */
+static void guac_encode_pool_run_jobs(guac_encode_pool* pool,
+        guac_encode_context* context) {
+
+    while (pool->next_job < pool->job_count) {
+
+        guac_encode_job* job = &pool->jobs[pool->next_job++];
+
+        /* Encode without holding the lock */
+        pthread_mutex_unlock(&pool->lock);
+        guac_encode_job_run(pool, job, context);
+        pthread_mutex_lock(&pool->lock);
+
+        /* Wake the waiting caller if the batch is now complete */
+        if (--pool->pending == 0)
+            pthread_cond_signal(&pool->batch_complete);
+
+    }
+
+}
+
+/**
+ * The main loop of each worker thread, encoding jobs as each batch becomes
+ * available until the pool is shut down.
+ */
+static void* guac_encode_pool_thread(void* data) {
+
+    guac_encode_pool* pool = (guac_encode_pool*) data;
+
+    /* Without a context, leave all jobs to the remaining threads */
+    guac_encode_context* context = guac_encode_context_alloc();
+    if (context == NULL)
+        return NULL;
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (!pool->shutdown) {
+
+        /* Wait for work */
+        if (pool->next_job >= pool->job_count) {
+            pthread_cond_wait(&pool->job_available, &pool->lock);
+            continue;
+        }
+
+        guac_encode_pool_run_jobs(pool, context);
+
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    guac_encode_context_free(context);
+    return NULL;
+
+}
+
+guac_encode_pool* guac_encode_pool_alloc(int thread_count) {
+
+    int i;
+
+    guac_encode_pool* pool = calloc(1, sizeof(guac_encode_pool));
+    if (pool == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for encode pool";
+        return NULL;
+    }
+
+    pool->threads = malloc(sizeof(pthread_t) * thread_count);
+    if (pool->threads == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for encode pool";
+        free(pool);
+        return NULL;
+    }
+
+    /* Allocate context for use by the thread running each batch */
+    pool->context = guac_encode_context_alloc();
+    if (pool->context == NULL) {
+        free(pool->threads);
+        free(pool);
+        return NULL;
+    }
+
+    pool->png_compression_level = GUAC_PNG_DEFAULT_COMPRESSION_LEVEL;
+    pool->png_compression_strategy = GUAC_PNG_DEFAULT_STRATEGY;
+    pool->png_filter = GUAC_PNG_DEFAULT_FILTER;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->job_available, NULL);
+    pthread_cond_init(&pool->batch_complete, NULL);
+
+    /* Start worker threads, stopping any already started on failure */
+    for (i = 0; i < thread_count; i++) {
+
+        if (pthread_create(&pool->threads[i], NULL,
+                    guac_encode_pool_thread, pool)) {
+            guac_error = GUAC_STATUS_SEE_ERRNO;
+            guac_error_message = "Could not start encode pool thread";
+            guac_encode_pool_free(pool);
+            return NULL;
+        }
+
+        pool->thread_count++;
+
+    }
+
+    return pool;
+
+}
+
+void guac_encode_pool_run(guac_encode_pool* pool, guac_encode_job* jobs,
+        int count) {
+
+    pthread_mutex_lock(&pool->lock);
+
+    /* Publish batch */
+    pool->jobs = jobs;
+    pool->job_count = count;
+    pool->next_job = 0;
+    pool->pending = count;
+    pthread_cond_broadcast(&pool->job_available);
+
+    /* Help encode, then wait for any jobs still running elsewhere */
+    guac_encode_pool_run_jobs(pool, pool->context);
+    while (pool->pending > 0)
+        pthread_cond_wait(&pool->batch_complete, &pool->lock);
+
+    pool->jobs = NULL;
+    pool->job_count = 0;
+    pool->next_job = 0;
+
+    pthread_mutex_unlock(&pool->lock);
+
+}
+
+void guac_encode_pool_free(guac_encode_pool* pool) {
+
+    int i;
+
+    /* Signal all threads to exit */
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->job_available);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (i = 0; i < pool->thread_count; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_cond_destroy(&pool->batch_complete);
+    pthread_cond_destroy(&pool->job_available);
+    pthread_mutex_destroy(&pool->lock);
+
+    guac_encode_context_free(pool->context);
+    free(pool->threads);
+    free(pool);
+
+}
+
@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GUAC_ENCODE_POOL_H
+#define GUAC_ENCODE_POOL_H
+
+#include "config.h"
+
+#include "client.h"
+#include "encode-jpeg.h"
+#include "encode-png.h"
+#include "socket.h"
+#include "stream.h"
+
+#ifdef ENABLE_WEBP
+#include "encode-webp.h"
+#endif
+
+#include <pthread.h>
+
+/**
+ * A single image which must be encoded by a guac_encode_pool, along with the
+ * buffer which will receive the encoded "img", "blob", and "end"
+ * instructions.
+ */
+typedef struct guac_encode_job {
+
+    /**
+     * The image to encode.
+     */
+    const guac_client_image* image;
+
+    /**
+     * The stream to associate with the encoded instructions.
+     */
+    guac_stream* stream;
+
+    /**
+     * The encoded instructions, or NULL if nothing has yet been encoded.
+     * Once the job is complete, this buffer must be freed with free().
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes of encoded instructions within the buffer.
+     */
+    int length;
+
+    /**
+     * The number of bytes allocated for the buffer.
+     */
+    int size;
+
+    /**
+     * Non-zero if encoding failed, in which case the contents of the buffer
+     * are incomplete and must not be sent.
+     */
+    int error;
+
+    /**
+     * The time spent encoding the image, in microseconds.
+     */
+    int encode_time;
+
+} guac_encode_job;
+
+/**
+ * The socket and encoders used by a single thread of a guac_encode_pool.
+ * Encoders are allocated upon first use and reused for all later images,
+ * such that compressor state and scratch buffers are not rebuilt for each
+ * image.
+ */
+typedef struct guac_encode_context {
+
+    /**
+     * The socket which writes to the buffer of the job currently being
+     * encoded.
+     */
+    guac_socket* socket;
+
+    /**
+     * The PNG encoder of this context, or NULL if not yet allocated.
+     */
+    guac_png_encoder* png;
+
+    /**
+     * The JPEG encoder of this context, or NULL if not yet allocated.
+     */
+    guac_jpeg_encoder* jpeg;
+
+#ifdef ENABLE_WEBP
+    /**
+     * The WebP encoder of this context, or NULL if not yet allocated.
+     */
+    guac_webp_encoder* webp;
+#endif
+
+} guac_encode_context;
+
+/**
+ * A fixed set of threads which encode batches of images concurrently.
+ */
+typedef struct guac_encode_pool {
+
+    /**
+     * The worker threads of this pool.
+     */
+    pthread_t* threads;
+
+    /**
+     * The number of worker threads.
+     */
+    int thread_count;
+
+    /**
+     * The context used to encode jobs within the thread invoking
+     * guac_encode_pool_run(). Each worker thread has its own context.
+     */
+    guac_encode_context* context;
+
+    /**
+     * The zlib compression level to use for PNG images, as accepted by
+     * guac_png_encoder_configure(). This may only be changed while no batch
+     * is running.
+     */
+    int png_compression_level;
+
+    /**
+     * The zlib compression strategy to use for PNG images. This may only be
+     * changed while no batch is running.
+     */
+    guac_client_png_strategy png_compression_strategy;
+
+    /**
+     * The row filter to use for PNG images. This may only be changed while no
+     * batch is running.
+     */
+    guac_client_png_filter png_filter;
+
+    /**
+     * Lock which guards all remaining members of this pool.
+     */
+    pthread_mutex_t lock;
+
+    /**
+     * Signalled when new jobs are available, or when the pool is shutting
+     * down.
+     */
+    pthread_cond_t job_available;
+
+    /**
+     * Signalled when the last pending job of the current batch completes.
+     */
+    pthread_cond_t batch_complete;
+
+    /**
+     * The jobs of the current batch, or NULL if no batch is running.
+     */
+    guac_encode_job* jobs;
+
+    /**
+     * The number of jobs in the current batch.
+     */
+    int job_count;
+
+    /**
+     * The index of the next job of the current batch which has not yet been
+     * claimed by any thread.
+     */
+    int next_job;
+
+    /**
+     * The number of jobs of the current batch which have not yet completed.
+     */
+    int pending;
+
+    /**
+     * Non-zero if the worker threads should exit.
+     */
+    int shutdown;
+
+} guac_encode_pool;
+
+/**
+ * Allocates a new encode pool and starts its worker threads.
+ *
+ * @param thread_count
+ *     The number of worker threads to start. The thread which invokes
+ *     guac_encode_pool_run() also encodes images, thus this should be one
+ *     less than the desired level of parallelism.
+ *
+ * @return
+ *     A newly-allocated encode pool, or NULL if the pool could not be
+ *     allocated or its threads could not be started.
+ */
+guac_encode_pool* guac_encode_pool_alloc(int thread_count);
+
+/**
+ * Encodes each of the given jobs, returning only after all jobs have
+ * completed. The calling thread encodes jobs alongside the worker threads of
+ * the pool. Jobs may complete in any order. This function must not be
+ * invoked concurrently on the same pool.
+ *
+ * @param pool
+ *     The pool to use to encode the given jobs.
+ *
+ * @param jobs
+ *     The jobs to encode. The image and stream of each job must be set, and
+ *     all other members must be zero.
+ *
+ * @param count
+ *     The number of jobs in the given array.
+ */
+void guac_encode_pool_run(guac_encode_pool* pool, guac_encode_job* jobs,
+        int count);
+
+/**
+ * Stops all worker threads of the given pool, waiting for each to exit, and
+ * frees the pool, including the encoders of all threads.
+ *
+ * @param pool
+ *     The pool to free.
+ */
+void guac_encode_pool_free(guac_encode_pool* pool);
+
+#endif
+
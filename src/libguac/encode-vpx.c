@@ -0,0 +1,597 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "encode-vpx.h"
+#include "protocol.h"
+#include "stream.h"
+
+#include <cairo/cairo.h>
+#include <vpx/vp8cx.h>
+#include <vpx/vpx_encoder.h>
+#include <vpx/vpx_image.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The maximum number of bytes of WebM data to send within each blob.
+ */
+#define GUAC_VPX_BLOB_SIZE 6048
+
+/**
+ * The number of bytes reserved for the size of each WebM master element
+ * whose size is filled in once its contents have been written.
+ */
+#define GUAC_VPX_SIZE_LENGTH 8
+
+/**
+ * The number of pixels per kilobit per second of target bitrate.
+ */
+#define GUAC_VPX_PIXELS_PER_KBPS 384
+
+/**
+ * The minimum target bitrate, in kilobits per second.
+ */
+#define GUAC_VPX_MIN_KBPS 256
+
+/**
+ * The maximum number of frames between keyframes.
+ */
+#define GUAC_VPX_KEYFRAME_INTERVAL 120
+
+/**
+ * The VP8 speed setting, from 0 (slowest, best quality) to 16 (fastest).
+ * Video must be encoded in realtime, thus the fastest reasonable setting is
+ * used.
+ */
+#define GUAC_VPX_CPU_USED 12
+
+/**
+ * The maximum timecode of a WebM block relative to the start of its cluster,
+ * in milliseconds. Block timecodes are signed 16-bit integers.
+ */
+#define GUAC_VPX_MAX_BLOCK_TIMECODE 32767
+
+/**
+ * WebM (Matroska) element IDs, including their EBML length markers.
+ */
+#define GUAC_WEBM_EBML                0x1A45DFA3
+#define GUAC_WEBM_EBML_VERSION        0x4286
+#define GUAC_WEBM_EBML_READ_VERSION   0x42F7
+#define GUAC_WEBM_EBML_MAX_ID_LENGTH  0x42F2
+#define GUAC_WEBM_EBML_MAX_SIZE_LENGTH 0x42F3
+#define GUAC_WEBM_DOC_TYPE            0x4282
+#define GUAC_WEBM_DOC_TYPE_VERSION    0x4287
+#define GUAC_WEBM_DOC_TYPE_READ_VERSION 0x4285
+#define GUAC_WEBM_SEGMENT             0x18538067
+#define GUAC_WEBM_INFO                0x1549A966
+#define GUAC_WEBM_TIMECODE_SCALE      0x2AD7B1
+#define GUAC_WEBM_MUXING_APP          0x4D80
+#define GUAC_WEBM_WRITING_APP         0x5741
+#define GUAC_WEBM_TRACKS              0x1654AE6B
+#define GUAC_WEBM_TRACK_ENTRY         0xAE
+#define GUAC_WEBM_TRACK_NUMBER        0xD7
+#define GUAC_WEBM_TRACK_UID           0x73C5
+#define GUAC_WEBM_TRACK_TYPE          0x83
+#define GUAC_WEBM_CODEC_ID            0x86
+#define GUAC_WEBM_VIDEO               0xE0
+#define GUAC_WEBM_PIXEL_WIDTH         0xB0
+#define GUAC_WEBM_PIXEL_HEIGHT        0xBA
+#define GUAC_WEBM_CLUSTER             0x1F43B675
+#define GUAC_WEBM_TIMECODE            0xE7
+#define GUAC_WEBM_SIMPLE_BLOCK        0xA3
+
+struct guac_vpx_encoder {
+
+    /**
+     * The libvpx codec context.
+     */
+    vpx_codec_ctx_t codec;
+
+    /**
+     * The YUV image receiving each frame prior to encoding.
+     */
+    vpx_image_t* image;
+
+    /**
+     * The width of each frame, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of each frame, in pixels.
+     */
+    int height;
+
+    /**
+     * The number of frames encoded so far.
+     */
+    int frames;
+
+    /**
+     * Whether the WebM header has been appended to the buffer. The header is
+     * appended only once, before the first successfully-encoded frame.
+     */
+    int header_written;
+
+    /**
+     * The presentation time of the most recently encoded frame, in
+     * milliseconds.
+     */
+    int64_t last_timestamp;
+
+    /**
+     * The timecode of the current WebM cluster, in milliseconds, or -1 if no
+     * cluster has yet been started.
+     */
+    int64_t cluster_timecode;
+
+    /**
+     * Buffer of pending WebM data.
+     */
+    unsigned char* buffer;
+
+    /**
+     * The number of bytes currently stored in the buffer.
+     */
+    int length;
+
+    /**
+     * The number of bytes allocated for the buffer.
+     */
+    int size;
+
+};
+
+/**
+ * Appends the given data to the WebM buffer of the given encoder, growing
+ * the buffer as necessary.
+ *
+ * @param encoder
+ *     The encoder whose buffer should receive the data.
+ *
+ * @param data
+ *     The data to append.
+ *
+ * @param length
+ *     The number of bytes to append.
+ *
+ * @return
+ *     Zero on success, non-zero if the buffer could not be grown.
+ */
+static int guac_vpx_append(guac_vpx_encoder* encoder, const void* data,
+        int length) {
+
+    /* Grow buffer as necessary */
+    if (encoder->length + length > encoder->size) {
+
+        int size = encoder->size ? encoder->size : GUAC_VPX_BLOB_SIZE;
+        while (encoder->length + length > size)
+            size *= 2;
+
+        unsigned char* buffer = realloc(encoder->buffer, size);
+        if (buffer == NULL)
+            return 1;
+
+        encoder->buffer = buffer;
+        encoder->size = size;
+
+    }
+
+    memcpy(encoder->buffer + encoder->length, data, length);
+    encoder->length += length;
+    return 0;
+
+}
+
+/**
+ * Appends the given unsigned integer to the WebM buffer of the given encoder
+ * in big-endian byte order, using the given number of bytes.
+ */
+static int guac_vpx_append_uint(guac_vpx_encoder* encoder, uint64_t value,
+        int length) {
+
+    unsigned char bytes[8];
+    int i;
+
+    for (i = length - 1; i >= 0; i--) {
+        bytes[i] = value & 0xFF;
+        value >>= 8;
+    }
+
+    return guac_vpx_append(encoder, bytes, length);
+
+}
+
+/**
+ * Appends the given WebM element ID, which includes its own length marker.
+ */
+static int guac_vpx_append_id(guac_vpx_encoder* encoder, uint32_t id) {
+
+    int length = 1;
+
+    if (id > 0xFFFFFF) length = 4;
+    else if (id > 0xFFFF) length = 3;
+    else if (id > 0xFF) length = 2;
+
+    return guac_vpx_append_uint(encoder, id, length);
+
+}
+
+/**
+ * Appends the given element size as an EBML variable-length integer of
+ * GUAC_VPX_SIZE_LENGTH bytes.
+ */
+static int guac_vpx_append_size(guac_vpx_encoder* encoder, uint64_t size) {
+    return guac_vpx_append_uint(encoder,
+            (UINT64_C(1) << (7 * GUAC_VPX_SIZE_LENGTH)) | size,
+            GUAC_VPX_SIZE_LENGTH);
+}
+
+/**
+ * Appends a complete WebM element containing the given unsigned integer.
+ */
+static int guac_vpx_append_uint_element(guac_vpx_encoder* encoder,
+        uint32_t id, uint64_t value) {
+
+    return guac_vpx_append_id(encoder, id)
+        || guac_vpx_append_size(encoder, 8)
+        || guac_vpx_append_uint(encoder, value, 8);
+
+}
+
+/**
+ * Appends a complete WebM element containing the given string.
+ */
+static int guac_vpx_append_string_element(guac_vpx_encoder* encoder,
+        uint32_t id, const char* value) {
+
+    int length = strlen(value);
+
+    return guac_vpx_append_id(encoder, id)
+        || guac_vpx_append_size(encoder, length)
+        || guac_vpx_append(encoder, value, length);
+
+}
+
+/**
+ * Begins a WebM master element, returning the offset of its size within the
+ * buffer, which must later be passed to guac_vpx_end_element(). If the
+ * element's size cannot be known in advance, as is the case for the segment
+ * and clusters of a live stream, the element need not be ended.
+ *
+ * @return
+ *     The offset of the element's size within the buffer, or -1 if the
+ *     element could not be written.
+ */
+static int guac_vpx_begin_element(guac_vpx_encoder* encoder, uint32_t id) {
+
+    if (guac_vpx_append_id(encoder, id))
+        return -1;
+
+    int offset = encoder->length;
+
+    /* Reserve space for size, defaulting to "unknown" (all value bits
+     * set) */
+    if (guac_vpx_append_uint(encoder,
+                (UINT64_C(1) << (7 * GUAC_VPX_SIZE_LENGTH + 1)) - 1,
+                GUAC_VPX_SIZE_LENGTH))
+        return -1;
+
+    return offset;
+
+}
+
+/**
+ * Ends the WebM master element begun with guac_vpx_begin_element(),
+ * filling in its size.
+ */
+static void guac_vpx_end_element(guac_vpx_encoder* encoder, int offset) {
+
+    int length = encoder->length;
+    uint64_t size = length - offset - GUAC_VPX_SIZE_LENGTH;
+
+    /* Overwrite reserved size */
+    encoder->length = offset;
+    guac_vpx_append_size(encoder, size);
+    encoder->length = length;
+
+}
+
+/**
+ * Appends the WebM header, describing a single VP8 video track, to the
+ * buffer of the given encoder. The segment is left open, such that clusters
+ * of frames may follow indefinitely.
+ */
+static int guac_vpx_append_header(guac_vpx_encoder* encoder) {
+
+    int element, track, video;
+
+    /* EBML header */
+    if ((element = guac_vpx_begin_element(encoder, GUAC_WEBM_EBML)) < 0
+            || guac_vpx_append_uint_element(encoder, GUAC_WEBM_EBML_VERSION, 1)
+            || guac_vpx_append_uint_element(encoder, GUAC_WEBM_EBML_READ_VERSION, 1)
+            || guac_vpx_append_uint_element(encoder, GUAC_WEBM_EBML_MAX_ID_LENGTH, 4)
+            || guac_vpx_append_uint_element(encoder, GUAC_WEBM_EBML_MAX_SIZE_LENGTH, 8)
+            || guac_vpx_append_string_element(encoder, GUAC_WEBM_DOC_TYPE, "webm")
+            || guac_vpx_append_uint_element(encoder, GUAC_WEBM_DOC_TYPE_VERSION, 2)
+            || guac_vpx_append_uint_element(encoder, GUAC_WEBM_DOC_TYPE_READ_VERSION, 2))
+        return 1;
+    guac_vpx_end_element(encoder, element);
+
+    /* Segment of unknown size */
+    if (guac_vpx_begin_element(encoder, GUAC_WEBM_SEGMENT) < 0)
+        return 1;
+
+    /* Segment information, with millisecond timecodes */
+    if ((element = guac_vpx_begin_element(encoder, GUAC_WEBM_INFO)) < 0
+            || guac_vpx_append_uint_element(encoder, GUAC_WEBM_TIMECODE_SCALE, 1000000)
+            || guac_vpx_append_string_element(encoder, GUAC_WEBM_MUXING_APP, "libguac")
+            || guac_vpx_append_string_element(encoder, GUAC_WEBM_WRITING_APP, "libguac"))
+        return 1;
+    guac_vpx_end_element(encoder, element);
+
+    /* Single VP8 video track */
+    if ((element = guac_vpx_begin_element(encoder, GUAC_WEBM_TRACKS)) < 0
+            || (track = guac_vpx_begin_element(encoder, GUAC_WEBM_TRACK_ENTRY)) < 0
+            || guac_vpx_append_uint_element(encoder, GUAC_WEBM_TRACK_NUMBER, 1)
+            || guac_vpx_append_uint_element(encoder, GUAC_WEBM_TRACK_UID, 1)
+            || guac_vpx_append_uint_element(encoder, GUAC_WEBM_TRACK_TYPE, 1)
+            || guac_vpx_append_string_element(encoder, GUAC_WEBM_CODEC_ID, "V_VP8")
+            || (video = guac_vpx_begin_element(encoder, GUAC_WEBM_VIDEO)) < 0
+            || guac_vpx_append_uint_element(encoder, GUAC_WEBM_PIXEL_WIDTH, encoder->width)
+            || guac_vpx_append_uint_element(encoder, GUAC_WEBM_PIXEL_HEIGHT, encoder->height))
+        return 1;
+    guac_vpx_end_element(encoder, video);
+    guac_vpx_end_element(encoder, track);
+    guac_vpx_end_element(encoder, element);
+
+    return 0;
+
+}
+
+/**
+ * Appends the given encoded frame to the buffer of the given encoder as a
+ * WebM block, beginning a new cluster first if the frame is a keyframe or
+ * its timecode cannot be represented relative to the current cluster.
+ */
+static int guac_vpx_append_frame(guac_vpx_encoder* encoder,
+        const vpx_codec_cx_pkt_t* packet) {
+
+    int64_t timecode = packet->data.frame.pts;
+    int keyframe = packet->data.frame.flags & VPX_FRAME_IS_KEY;
+
+    /* Begin new cluster (of unknown size) if necessary */
+    if (keyframe || encoder->cluster_timecode < 0
+            || timecode - encoder->cluster_timecode
+                > GUAC_VPX_MAX_BLOCK_TIMECODE) {
+
+        if (guac_vpx_begin_element(encoder, GUAC_WEBM_CLUSTER) < 0
+                || guac_vpx_append_uint_element(encoder, GUAC_WEBM_TIMECODE,
+                    timecode))
+            return 1;
+
+        encoder->cluster_timecode = timecode;
+
+    }
+
+    /* Block header: track number, relative timecode, and flags */
+    unsigned char header[4];
+    int16_t relative = timecode - encoder->cluster_timecode;
+    header[0] = 0x81;
+    header[1] = (relative >> 8) & 0xFF;
+    header[2] = relative & 0xFF;
+    header[3] = keyframe ? 0x80 : 0x00;
+
+    return guac_vpx_append_id(encoder, GUAC_WEBM_SIMPLE_BLOCK)
+        || guac_vpx_append_size(encoder,
+                sizeof(header) + packet->data.frame.sz)
+        || guac_vpx_append(encoder, header, sizeof(header))
+        || guac_vpx_append(encoder, packet->data.frame.buf,
+                packet->data.frame.sz);
+
+}
+
+/**
+ * Converts the contents of the given Cairo surface to the YUV 4:2:0 image of
+ * the given encoder, using the BT.601 coefficients. Each chroma sample is
+ * taken from the upper-left pixel of its 2x2 block.
+ */
+static void guac_vpx_convert(guac_vpx_encoder* encoder,
+        cairo_surface_t* surface) {
+
+    vpx_image_t* image = encoder->image;
+
+    unsigned char* data = cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+
+    unsigned char* y_plane = image->planes[VPX_PLANE_Y];
+    unsigned char* u_plane = image->planes[VPX_PLANE_U];
+    unsigned char* v_plane = image->planes[VPX_PLANE_V];
+
+    int x, y;
+
+    for (y = 0; y < encoder->height; y++) {
+
+        uint32_t* row = (uint32_t*) (data + y * stride);
+        unsigned char* y_row = y_plane + y * image->stride[VPX_PLANE_Y];
+        unsigned char* u_row = u_plane + (y / 2) * image->stride[VPX_PLANE_U];
+        unsigned char* v_row = v_plane + (y / 2) * image->stride[VPX_PLANE_V];
+
+        for (x = 0; x < encoder->width; x++) {
+
+            uint32_t color = row[x];
+            int red   = (color >> 16) & 0xFF;
+            int green = (color >> 8)  & 0xFF;
+            int blue  =  color        & 0xFF;
+
+            y_row[x] = ((66 * red + 129 * green + 25 * blue + 128) >> 8) + 16;
+
+            /* Sample chroma once per 2x2 block */
+            if (!(x & 1) && !(y & 1)) {
+                u_row[x / 2] = ((-38 * red - 74 * green + 112 * blue + 128) >> 8) + 128;
+                v_row[x / 2] = ((112 * red - 94 * green - 18 * blue + 128) >> 8) + 128;
+            }
+
+        }
+
+    }
+
+}
+
+/**
+ * Sends the contents of the WebM buffer of the given encoder over the given
+ * stream and socket as blobs, emptying the buffer.
+ */
+static void guac_vpx_flush(guac_vpx_encoder* encoder, guac_socket* socket,
+        guac_stream* stream) {
+
+    int offset;
+
+    for (offset = 0; offset < encoder->length; offset += GUAC_VPX_BLOB_SIZE) {
+
+        int length = encoder->length - offset;
+        if (length > GUAC_VPX_BLOB_SIZE)
+            length = GUAC_VPX_BLOB_SIZE;
+
+        guac_protocol_send_blob(socket, stream, encoder->buffer + offset,
+                length);
+
+    }
+
+    encoder->length = 0;
+
+}
+
+guac_vpx_encoder* guac_vpx_encoder_alloc(int width, int height) {
+
+    vpx_codec_enc_cfg_t config;
+
+    guac_vpx_encoder* encoder = calloc(1, sizeof(guac_vpx_encoder));
+    if (encoder == NULL)
+        return NULL;
+
+    encoder->width = width;
+    encoder->height = height;
+    encoder->cluster_timecode = -1;
+
+    /* Configure for low-latency realtime encoding, with millisecond
+     * timestamps */
+    if (vpx_codec_enc_config_default(vpx_codec_vp8_cx(), &config, 0)) {
+        free(encoder);
+        return NULL;
+    }
+
+    config.g_w = width;
+    config.g_h = height;
+    config.g_timebase.num = 1;
+    config.g_timebase.den = 1000;
+    config.g_lag_in_frames = 0;
+    config.g_error_resilient = 1;
+    config.rc_end_usage = VPX_CBR;
+    config.rc_target_bitrate = width * height / GUAC_VPX_PIXELS_PER_KBPS;
+    config.kf_max_dist = GUAC_VPX_KEYFRAME_INTERVAL;
+
+    if (config.rc_target_bitrate < GUAC_VPX_MIN_KBPS)
+        config.rc_target_bitrate = GUAC_VPX_MIN_KBPS;
+
+    if (vpx_codec_enc_init(&encoder->codec, vpx_codec_vp8_cx(), &config, 0)) {
+        free(encoder);
+        return NULL;
+    }
+
+    vpx_codec_control(&encoder->codec, VP8E_SET_CPUUSED, GUAC_VPX_CPU_USED);
+
+    /* Allocate image receiving each converted frame */
+    encoder->image = vpx_img_alloc(NULL, VPX_IMG_FMT_I420, width, height, 1);
+    if (encoder->image == NULL) {
+        vpx_codec_destroy(&encoder->codec);
+        free(encoder);
+        return NULL;
+    }
+
+    return encoder;
+
+}
+
+int guac_vpx_encoder_write(guac_vpx_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, cairo_surface_t* surface, int timestamp) {
+
+    const vpx_codec_cx_pkt_t* packet;
+    vpx_codec_iter_t iter = NULL;
+
+    /* Presentation times must strictly increase */
+    int64_t pts = timestamp;
+    if (encoder->frames > 0 && pts <= encoder->last_timestamp)
+        pts = encoder->last_timestamp + 1;
+
+    unsigned long duration = encoder->frames > 0
+        ? pts - encoder->last_timestamp : 1;
+
+    guac_vpx_convert(encoder, surface);
+
+    if (vpx_codec_encode(&encoder->codec, encoder->image, pts, duration, 0,
+                VPX_DL_REALTIME))
+        return 1;
+
+    encoder->last_timestamp = pts;
+    encoder->frames++;
+
+    /* Begin stream with header, discarding any partial header on failure
+     * such that a later attempt does not write it twice */
+    if (!encoder->header_written) {
+
+        int length = encoder->length;
+        if (guac_vpx_append_header(encoder)) {
+            encoder->length = length;
+            return 1;
+        }
+
+        encoder->header_written = 1;
+
+    }
+
+    /* Append all resulting frames */
+    while ((packet = vpx_codec_get_cx_data(&encoder->codec, &iter)) != NULL) {
+        if (packet->kind == VPX_CODEC_CX_FRAME_PKT
+                && guac_vpx_append_frame(encoder, packet))
+            return 1;
+    }
+
+    guac_vpx_flush(encoder, socket, stream);
+    return 0;
+
+}
+
+void guac_vpx_encoder_free(guac_vpx_encoder* encoder) {
+
+    vpx_img_free(encoder->image);
+    vpx_codec_destroy(&encoder->codec);
+
+    free(encoder->buffer);
+    free(encoder);
+
+}
+
@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GUAC_ENCODE_VPX_H
+#define GUAC_ENCODE_VPX_H
+
+#include "config.h"
+
+#include "socket.h"
+#include "stream.h"
+
+#include <cairo/cairo.h>
+
+/**
+ * The state of a VP8 encoder producing a single WebM stream.
+ */
+typedef struct guac_vpx_encoder guac_vpx_encoder;
+
+/**
+ * Allocates a new VP8 encoder for frames of the given dimensions.
+ *
+ * @param width
+ *     The width of each frame, in pixels.
+ *
+ * @param height
+ *     The height of each frame, in pixels.
+ *
+ * @return
+ *     A newly-allocated encoder, or NULL if the encoder could not be
+ *     initialized.
+ */
+guac_vpx_encoder* guac_vpx_encoder_alloc(int width, int height);
+
+/**
+ * Encodes the given surface as the next frame of the WebM stream produced by
+ * the given encoder, sending the resulting data over the given stream and
+ * socket as blobs. The WebM header is sent before the first frame.
+ *
+ * @param encoder
+ *     The encoder to use.
+ *
+ * @param socket
+ *     The socket to send WebM blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param surface
+ *     The Cairo surface containing the frame, which must have the dimensions
+ *     given when the encoder was allocated.
+ *
+ * @param timestamp
+ *     The presentation time of the frame, in milliseconds, relative to the
+ *     first frame. Timestamps must not decrease.
+ *
+ * @return
+ *     Zero if the encoding operation is successful, non-zero otherwise.
+ */
+int guac_vpx_encoder_write(guac_vpx_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, cairo_surface_t* surface, int timestamp);
+
+/**
+ * Frees the given encoder and all associated resources.
+ *
+ * @param encoder
+ *     The encoder to free.
+ */
+void guac_vpx_encoder_free(guac_vpx_encoder* encoder);
+
+#endif
+
@@ -37,6 +37,17 @@
 #include <stdlib.h>
 #include <string.h>
 
+struct guac_webp_encoder {
+
+    /**
+     * Picture whose ARGB buffer is large enough for every image encoded so
+     * far. Each image is encoded from a view of the top-left corner of this
+     * picture.
+     */
+    WebPPicture picture;
+
+};
+
 /**
  * Structure which describes the current state of the WebP image writer.
  */
@@ -165,8 +176,71 @@ static int guac_webp_stream_write(const uint8_t* data, size_t data_size,
     return 1;
 }
 
-int guac_webp_write(guac_socket* socket, guac_stream* stream,
-        cairo_surface_t* surface, int quality, int lossless) {
+guac_webp_encoder* guac_webp_encoder_alloc() {
+
+    guac_webp_encoder* encoder = malloc(sizeof(guac_webp_encoder));
+    if (encoder == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for WebP encoder";
+        return NULL;
+    }
+
+    /* Picture buffer is allocated upon first use */
+    WebPPictureInit(&encoder->picture);
+    encoder->picture.use_argb = 1;
+
+    return encoder;
+
+}
+
+/**
+ * Ensures the picture of the given encoder is large enough for an image of
+ * the given dimensions, reallocating that picture if necessary. Pictures are
+ * never shrunk, such that images of similar size are encoded without any
+ * further allocation.
+ *
+ * @param encoder
+ *     The encoder whose picture should be checked.
+ *
+ * @param width
+ *     The width of the image to be encoded, in pixels.
+ *
+ * @param height
+ *     The height of the image to be encoded, in pixels.
+ *
+ * @return
+ *     Zero if the picture is now large enough, non-zero if allocation
+ *     failed.
+ */
+static int guac_webp_encoder_reserve(guac_webp_encoder* encoder,
+        int width, int height) {
+
+    WebPPicture* picture = &encoder->picture;
+
+    if (picture->argb != NULL
+            && width <= picture->width && height <= picture->height)
+        return 0;
+
+    /* Grow in both dimensions */
+    if (width < picture->width)
+        width = picture->width;
+
+    if (height < picture->height)
+        height = picture->height;
+
+    WebPPictureFree(picture);
+    WebPPictureInit(picture);
+    picture->use_argb = 1;
+    picture->width = width;
+    picture->height = height;
+
+    return !WebPPictureAlloc(picture);
+
+}
+
+int guac_webp_encoder_write(guac_webp_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, cairo_surface_t* surface, int quality,
+        int lossless) {
 
     guac_webp_stream_writer writer;
     WebPPicture picture;
@@ -203,14 +277,17 @@ int guac_webp_write(guac_socket* socket, guac_stream* stream,
     /* Validate configuration */
     WebPValidateConfig(&config);
 
-    /* Set up WebP picture */
-    WebPPictureInit(&picture);
-    picture.use_argb = 1;
-    picture.width = width;
-    picture.height = height;
+    /* Set up WebP picture as a view of the encoder's picture, which does not
+     * own the underlying ARGB buffer */
+    if (guac_webp_encoder_reserve(encoder, width, height)
+            || !WebPPictureView(&encoder->picture, 0, 0, width, height,
+                &picture)) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for WebP picture";
+        return -1;
+    }
 
-    /* Allocate and init writer */
-    WebPPictureAlloc(&picture);
+    /* Init writer */
     picture.writer = guac_webp_stream_write;
     picture.custom_ptr = &writer;
     guac_webp_stream_writer_init(&writer, socket, stream);
@@ -249,7 +326,8 @@ int guac_webp_write(guac_socket* socket, guac_stream* stream,
     /* Encode image */
     WebPEncode(&config, &picture);
 
-    /* Free picture */
+    /* Free any buffers allocated by the encoder for the view (such as YUV
+     * planes), leaving the encoder's own picture intact */
     WebPPictureFree(&picture);
 
     /* Ensure all data is written */
@@ -259,3 +337,24 @@ int guac_webp_write(guac_socket* socket, guac_stream* stream,
 
 }
 
+void guac_webp_encoder_free(guac_webp_encoder* encoder) {
+    WebPPictureFree(&encoder->picture);
+    free(encoder);
+}
+
+int guac_webp_write(guac_socket* socket, guac_stream* stream,
+        cairo_surface_t* surface, int quality, int lossless) {
+
+    int result;
+
+    guac_webp_encoder* encoder = guac_webp_encoder_alloc();
+    if (encoder == NULL)
+        return -1;
+
+    result = guac_webp_encoder_write(encoder, socket, stream, surface,
+            quality, lossless);
+
+    guac_webp_encoder_free(encoder);
+    return result;
+
+}
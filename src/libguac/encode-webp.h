@@ -30,9 +30,64 @@
 
 #include <cairo/cairo.h>
 
+/**
+ * Reusable state for encoding WebP images, including the picture buffer
+ * which would otherwise be allocated for each image. An encoder must not be
+ * used by more than one thread at a time.
+ */
+typedef struct guac_webp_encoder guac_webp_encoder;
+
+/**
+ * Allocates a new WebP encoder.
+ *
+ * @return
+ *     A newly-allocated encoder, or NULL if allocation fails.
+ */
+guac_webp_encoder* guac_webp_encoder_alloc();
+
+/**
+ * Encodes the given surface as a WebP using the given encoder, and sends the
+ * resulting data over the given stream and socket as blobs.
+ *
+ * @param encoder
+ *     The encoder to use.
+ *
+ * @param socket
+ *     The socket to send WebP blobs over.
+ *
+ * @param stream
+ *     The stream to associate with each blob.
+ *
+ * @param surface
+ *     The Cairo surface to write to the given stream and socket as WebP
+ *     blobs.
+ *
+ * @param quality
+ *     The WebP image quality to use, as accepted by guac_webp_write().
+ *
+ * @param lossless
+ *     Zero for a lossy image, non-zero for lossless.
+ *
+ * @return
+ *     Zero if the encoding operation is successful, non-zero otherwise.
+ */
+int guac_webp_encoder_write(guac_webp_encoder* encoder, guac_socket* socket,
+        guac_stream* stream, cairo_surface_t* surface, int quality,
+        int lossless);
+
+/**
+ * Frees the given encoder and its picture buffer.
+ *
+ * @param encoder
+ *     The encoder to free.
+ */
+void guac_webp_encoder_free(guac_webp_encoder* encoder);
+
 /**
  * Encodes the given surface as a WebP, and sends the resulting data over the
- * given stream and socket as blobs.
+ * given stream and socket as blobs. This is equivalent to encoding with a
+ * temporary encoder; callers which encode many images should allocate their
+ * own encoder with guac_webp_encoder_alloc().
  *
  * @param socket
  *     The socket to send WebP blobs over.
@@ -34,6 +34,18 @@
  */
 #define GUAC_CLIENT_MAX_STREAMS 64
 
+/**
+ * The maximum number of threads which may be used by any one guac_client to
+ * encode images in parallel. See guac_client_stream_images().
+ */
+#define GUAC_CLIENT_MAX_ENCODER_THREADS 64
+
+/**
+ * The highest level of congestion which may be reported for a guac_client.
+ * See the congestion member of guac_client.
+ */
+#define GUAC_CLIENT_MAX_CONGESTION 100
+
 /**
  * The index of a closed stream.
  */
@@ -82,6 +82,14 @@ typedef int guac_client_pipe_handler(guac_client* client, guac_stream* stream,
 typedef int guac_client_blob_handler(guac_client* client, guac_stream* stream,
         void* data, int length);
 
+/**
+ * Handler for portions of Guacamole stream blob events, called as the content
+ * of each blob is received. The final chunk of each blob is flagged such that
+ * the handler can acknowledge the blob once it has been received in full.
+ */
+typedef int guac_client_blob_chunk_handler(guac_client* client,
+        guac_stream* stream, void* data, int length, int final);
+
 /**
  * Handler for Guacamole stream ack events.
  */
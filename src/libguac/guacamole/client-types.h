@@ -93,5 +93,103 @@ typedef enum guac_client_log_level {
  */
 typedef struct guac_client_info guac_client_info;
 
+/**
+ * The image formats which may be used to stream image data via
+ * guac_client_stream_images().
+ */
+typedef enum guac_client_image_format {
+
+    /**
+     * Lossless PNG.
+     */
+    GUAC_CLIENT_IMAGE_PNG,
+
+    /**
+     * Lossy JPEG.
+     */
+    GUAC_CLIENT_IMAGE_JPEG,
+
+    /**
+     * Lossy WebP. Images of this format are only sent if WebP support was
+     * built in. See guac_client_supports_webp().
+     */
+    GUAC_CLIENT_IMAGE_WEBP
+
+} guac_client_image_format;
+
+/**
+ * The zlib compression strategies which may be used when encoding PNG
+ * images. See the documentation of zlib's deflateInit2() for details.
+ */
+typedef enum guac_client_png_strategy {
+
+    /**
+     * The default zlib strategy, suitable for most content.
+     */
+    GUAC_CLIENT_PNG_STRATEGY_DEFAULT,
+
+    /**
+     * Favors Huffman coding over string matching, suiting filtered
+     * photographic content (zlib's Z_FILTERED).
+     */
+    GUAC_CLIENT_PNG_STRATEGY_FILTERED,
+
+    /**
+     * Huffman coding only, without string matching (zlib's
+     * Z_HUFFMAN_ONLY).
+     */
+    GUAC_CLIENT_PNG_STRATEGY_HUFFMAN_ONLY,
+
+    /**
+     * Limits string matching to runs of identical bytes, which is much
+     * faster than the default strategy at the cost of larger images
+     * (zlib's Z_RLE).
+     */
+    GUAC_CLIENT_PNG_STRATEGY_RLE
+
+} guac_client_png_strategy;
+
+/**
+ * The row filters which may be used when encoding PNG images.
+ */
+typedef enum guac_client_png_filter {
+
+    /**
+     * Let libpng choose, which disables filtering for palette images and
+     * selects filters adaptively for all others.
+     */
+    GUAC_CLIENT_PNG_FILTER_DEFAULT,
+
+    /**
+     * No filtering. This is fastest, and usually best for palette images.
+     */
+    GUAC_CLIENT_PNG_FILTER_NONE,
+
+    /**
+     * Each byte is stored relative to the corresponding byte of the pixel to
+     * its left.
+     */
+    GUAC_CLIENT_PNG_FILTER_SUB,
+
+    /**
+     * Each byte is stored relative to the corresponding byte of the pixel
+     * above.
+     */
+    GUAC_CLIENT_PNG_FILTER_UP,
+
+    /**
+     * Each row is filtered using whichever of the standard PNG filters is
+     * estimated to compress best. This is slowest.
+     */
+    GUAC_CLIENT_PNG_FILTER_ADAPTIVE
+
+} guac_client_png_filter;
+
+/**
+ * A single image to be streamed as part of a batch of images by
+ * guac_client_stream_images().
+ */
+typedef struct guac_client_image guac_client_image;
+
 #endif
 
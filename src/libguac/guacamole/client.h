@@ -92,6 +92,64 @@ struct guac_client_info {
 
 };
 
+struct guac_client_image {
+
+    /**
+     * The format to encode this image as.
+     */
+    guac_client_image_format format;
+
+    /**
+     * The composite mode to use when rendering the image over its layer.
+     */
+    guac_composite_mode mode;
+
+    /**
+     * The destination layer.
+     */
+    const guac_layer* layer;
+
+    /**
+     * The X coordinate of the upper-left corner of the destination rectangle
+     * within the layer.
+     */
+    int x;
+
+    /**
+     * The Y coordinate of the upper-left corner of the destination rectangle
+     * within the layer.
+     */
+    int y;
+
+    /**
+     * A Cairo surface containing the image data to be streamed. The surface
+     * must not be modified until the image has been streamed.
+     */
+    cairo_surface_t* surface;
+
+    /**
+     * The image quality to use for lossy formats, which must be an integer
+     * value between 0 and 100 inclusive. Ignored for PNG.
+     */
+    int quality;
+
+    /**
+     * The number of bytes of instructions sent for this image, including
+     * the "img" and "end" instructions. This is set by
+     * guac_client_stream_images() once the image has been sent, and is zero
+     * if the image was not encoded, such as when drawn from the image cache.
+     */
+    int encoded_size;
+
+    /**
+     * The time spent encoding this image, in microseconds. This is set by
+     * guac_client_stream_images() once the image has been sent, and is zero
+     * if the image was not encoded.
+     */
+    int encode_time;
+
+};
+
 struct guac_client {
 
     /**
@@ -455,6 +513,22 @@ struct guac_client {
      */
     guac_object* __objects;
 
+    /**
+     * Buffer into which the chunks of the blob currently being received are
+     * reassembled, for streams whose handlers expect entire blobs.
+     */
+    char* __blob_buffer;
+
+    /**
+     * The number of bytes currently stored within __blob_buffer.
+     */
+    int __blob_length;
+
+    /**
+     * The number of bytes allocated for __blob_buffer.
+     */
+    int __blob_size;
+
     /**
      * The unique identifier allocated for the connection, which may
      * be used within the Guacamole protocol to refer to this connection.
@@ -479,6 +553,88 @@ struct guac_client {
      */
     char* keystrokes_path;
 
+    /**
+     * The number of threads which may be used to encode images in parallel
+     * via guac_client_stream_images(), including the calling thread. If one
+     * or less, images are encoded serially. Defaults to 1.
+     */
+    int encoder_threads;
+
+    /**
+     * The zlib compression level used for PNG images encoded by
+     * guac_client_stream_images(), from 0 (no compression) to 9 (best
+     * compression), or -1 to use zlib's default. Lower levels are faster.
+     * Defaults to -1.
+     */
+    int png_compression_level;
+
+    /**
+     * The zlib compression strategy used for PNG images encoded by
+     * guac_client_stream_images(). Defaults to
+     * GUAC_CLIENT_PNG_STRATEGY_DEFAULT.
+     */
+    guac_client_png_strategy png_compression_strategy;
+
+    /**
+     * The row filter used for PNG images encoded by
+     * guac_client_stream_images(). Defaults to
+     * GUAC_CLIENT_PNG_FILTER_DEFAULT.
+     */
+    guac_client_png_filter png_filter;
+
+    /**
+     * The pool of threads used to encode images in parallel, allocated on
+     * first use by guac_client_stream_images(). NULL if not yet allocated.
+     */
+    struct guac_encode_pool* __encode_pool;
+
+    /**
+     * The maximum number of bytes of client-side memory which may be used to
+     * cache images streamed via guac_client_stream_images(). Cached images
+     * are stored within client-side buffers, and later occurrences of the
+     * same image are drawn from those buffers with "copy" instructions
+     * rather than being encoded again. If zero, images are not cached.
+     * Defaults to zero.
+     */
+    int image_cache_size;
+
+    /**
+     * The cache of images previously streamed via
+     * guac_client_stream_images(), allocated on first use. NULL if not yet
+     * allocated.
+     */
+    struct guac_image_cache* __image_cache;
+
+    /**
+     * The smoothed round-trip time of the connection, in milliseconds, as
+     * measured by acknowledgements of "sync" instructions sent with
+     * guac_client_send_sync(). Zero if not yet known.
+     */
+    int rtt;
+
+    /**
+     * The rate at which the client has recently been receiving data, in
+     * bytes per second, as measured by acknowledgements of "sync"
+     * instructions sent with guac_client_send_sync(). Zero if not yet known.
+     */
+    int throughput;
+
+    /**
+     * The current level of congestion of the connection, from 0 to
+     * GUAC_CLIENT_MAX_CONGESTION inclusive. The connection is congested if
+     * output is being queued because it is produced faster than the client
+     * can receive it, in which case the quality of lossy images should be
+     * reduced and updates should be combined into fewer, larger frames.
+     * Zero, the default, indicates no congestion.
+     */
+    int congestion;
+
+    /**
+     * Estimator of the round-trip time, throughput, and congestion of the
+     * connection, or NULL if congestion could not be tracked.
+     */
+    struct guac_congestion* __congestion;
+
 };
 
 /**
@@ -498,9 +654,65 @@ void guac_client_free(guac_client* client);
 
 /**
  * Call the appropriate handler defined by the given client for the given
- * instruction. A comparison is made between the instruction opcode and the
- * initial handler lookup table defined in client-handlers.c. The intial
- * handlers will in turn call the client's handler (if defined).
+ * instruction. The opcode is looked up within the initial handler table
+ * defined in client-handlers.c. The intial handlers will in turn call the
+ * client's handler (if defined). The arguments are referenced, not copied,
+ * and thus may point directly into the buffer of a guac_parser.
+ *
+ * @param client
+ *     The proxy client whose handlers should be called.
+ *
+ * @param opcode
+ *     The opcode of the instruction received.
+ *
+ * @param argc
+ *     The number of arguments within argv.
+ *
+ * @param argv
+ *     The arguments of the instruction received.
+ *
+ * @return
+ *     Non-negative if the instruction was handled successfully, or negative
+ *     if an error occurred.
+ */
+int guac_client_dispatch_instruction(guac_client* client, const char* opcode,
+        int argc, char** argv);
+
+/**
+ * Passes a chunk of decoded blob content to the appropriate handler of the
+ * given input stream. This is intended to be called by a
+ * guac_parser_blob_handler, and allows blob content to be handled as it is
+ * received. If the stream has a blob_chunk_handler, that handler receives
+ * each chunk directly. Otherwise, chunks are reassembled and the stream's
+ * blob_handler (or the client's global blob_handler) is called once the final
+ * chunk has been received.
+ *
+ * @param client
+ *     The proxy client which received the blob content.
+ *
+ * @param stream_index
+ *     The index of the input stream the blob was sent along.
+ *
+ * @param data
+ *     The decoded content of the current chunk.
+ *
+ * @param length
+ *     The number of bytes within the current chunk.
+ *
+ * @param final
+ *     Non-zero if this is the last chunk of the blob, zero otherwise.
+ *
+ * @return
+ *     Non-negative if the chunk was handled successfully, or negative if an
+ *     error occurred.
+ */
+int guac_client_handle_blob_chunk(guac_client* client, int stream_index,
+        void* data, int length, int final);
+
+/**
+ * Call the appropriate handler defined by the given client for the given
+ * instruction. This is equivalent to guac_client_dispatch_instruction()
+ * called with the opcode and arguments of the given instruction.
  *
  * @param client
  *     The proxy client whose handlers should be called.
@@ -515,6 +727,42 @@ void guac_client_free(guac_client* client);
 int guac_client_handle_instruction(guac_client* client,
         guac_instruction* instruction);
 
+/**
+ * Sends a "sync" instruction bearing the current timestamp, flushing all
+ * pending output, and records that timestamp as the client's
+ * last_sent_timestamp. The amount of output preceding the instruction is
+ * noted, such that the round-trip time, throughput, and congestion of the
+ * connection can be updated once the client acknowledges it.
+ *
+ * @param client
+ *     The guac_client to send the "sync" instruction to.
+ *
+ * @return
+ *     Zero on success, or non-zero if an error occurs while sending the
+ *     instruction, in which case guac_error and guac_error_message are set
+ *     appropriately.
+ */
+int guac_client_send_sync(guac_client* client);
+
+/**
+ * Returns the number of milliseconds over which updates should be combined
+ * into a single frame, given the frame duration appropriate for an
+ * uncongested connection. The returned duration grows up to three times the
+ * given duration as the connection becomes congested, such that less
+ * frequent, larger frames are sent while the client is unable to keep up.
+ *
+ * @param client
+ *     The guac_client whose congestion should be taken into account.
+ *
+ * @param duration
+ *     The frame duration to use if the connection is not congested, in
+ *     milliseconds.
+ *
+ * @return
+ *     The frame duration to use, in milliseconds.
+ */
+int guac_client_get_frame_duration(guac_client* client, int duration);
+
 /**
  * Writes a message in the log used by the given client. The logger used will
  * normally be defined by guacd (or whichever program loads the proxy client)
@@ -773,6 +1021,44 @@ void guac_client_stream_webp(guac_client* client, guac_socket* socket,
         guac_composite_mode mode, const guac_layer* layer, int x, int y,
         cairo_surface_t* surface, int quality, int lossless);
 
+/**
+ * Streams each of the given images over its own image stream ("img"
+ * instruction), exactly as if guac_client_stream_png(),
+ * guac_client_stream_jpeg(), or guac_client_stream_webp() were invoked for
+ * each image in order. If the encoder_threads member of the given client is
+ * greater than one, the images are encoded concurrently by a pool of threads
+ * into private buffers, and the resulting instructions are then written to
+ * the given socket in the original order. Images are encoded losslessly only
+ * if their format is PNG.
+ *
+ * If the image_cache_size member of the given client is non-zero, opaque PNG
+ * images drawn with GUAC_COMP_OVER are also cached within client-side
+ * buffers, and any image identical to a cached image is drawn from the
+ * cache with a "copy" instruction instead of being encoded again. This
+ * function must not be invoked concurrently for the same client.
+ *
+ * The size and encoding time of each image are measured as it is sent, and
+ * stored within the encoded_size and encode_time members of that image,
+ * such that callers may choose formats based on actual results.
+ *
+ * @param client
+ *     The Guacamole client from which the image streams should be allocated.
+ *
+ * @param socket
+ *     The socket over which instructions associated with the image streams
+ *     should be sent.
+ *
+ * @param images
+ *     The images to stream, in the order their instructions should be sent.
+ *     The encoded_size and encode_time members of each image are updated
+ *     once the image has been sent.
+ *
+ * @param count
+ *     The number of images in the given array.
+ */
+void guac_client_stream_images(guac_client* client, guac_socket* socket,
+        guac_client_image* images, int count);
+
 /**
  * Returns whether the given client supports WebP. If the client does not
  * support WebP, or the server cannot encode WebP images, zero is returned.
@@ -786,6 +1072,22 @@ void guac_client_stream_webp(guac_client* client, guac_socket* socket,
  */
 int guac_client_supports_webp(guac_client* client);
 
+/**
+ * Returns whether the given client supports video streams as produced by
+ * guac_video_stream_alloc(). If the client does not support the video
+ * format used by libguac, or the server cannot encode video, zero is
+ * returned.
+ *
+ * @param client
+ *     The Guacamole client to check for video support.
+ *
+ * @return
+ *     Non-zero if the given client claims to support the video format used
+ *     by libguac and the server has been built with video support, zero
+ *     otherwise.
+ */
+int guac_client_supports_video(guac_client* client);
+
 /**
  * The default Guacamole client layer, layer 0.
  */
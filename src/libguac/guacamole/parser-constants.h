@@ -34,6 +34,14 @@
  */
 #define GUAC_INSTRUCTION_MAX_LENGTH 8192
 
+/**
+ * The maximum number of characters within the content of a blob instruction
+ * when that content is streamed to a guac_parser_blob_handler. As such
+ * content is never buffered in its entirety, this may be far larger than
+ * GUAC_INSTRUCTION_MAX_LENGTH.
+ */
+#define GUAC_PARSER_MAX_BLOB_LENGTH 1048576
+
 /**
  * The maximum number of digits to allow per length prefix.
  */
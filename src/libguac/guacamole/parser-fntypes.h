@@ -0,0 +1,68 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _GUAC_PARSER_FNTYPES_H
+#define _GUAC_PARSER_FNTYPES_H
+
+/**
+ * Function type definitions related to the guac_parser object.
+ *
+ * @file parser-fntypes.h
+ */
+
+#include "parser-types.h"
+
+/**
+ * Handler for the content of blob instructions, called as that content is
+ * received rather than once the entire instruction has been read. When set
+ * within a guac_parser, blob instructions are never returned by
+ * guac_parser_read(). Instead, the base64 content of each blob is decoded in
+ * place as it arrives and passed to this handler in one or more chunks.
+ *
+ * @param parser
+ *     The guac_parser reading the blob instruction.
+ *
+ * @param stream_index
+ *     The index of the stream the blob was sent along.
+ *
+ * @param data
+ *     The decoded data of the current chunk. This buffer is only valid for
+ *     the duration of the call.
+ *
+ * @param length
+ *     The number of bytes of decoded data within the current chunk, which
+ *     may be zero.
+ *
+ * @param final
+ *     Non-zero if this is the last chunk of the blob instruction, zero if
+ *     more chunks will follow.
+ *
+ * @return
+ *     Zero if the chunk was handled successfully, non-zero if an error
+ *     occurred, in which case guac_error should be set appropriately and
+ *     parsing will be aborted.
+ */
+typedef int guac_parser_blob_handler(guac_parser* parser, int stream_index,
+        void* data, int length, int final);
+
+#endif
+
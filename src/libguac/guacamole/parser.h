@@ -32,6 +32,7 @@
 
 #include "parser-types.h"
 #include "parser-constants.h"
+#include "parser-fntypes.h"
 #include "socket-types.h"
 
 struct guac_parser {
@@ -56,6 +57,36 @@ struct guac_parser {
      */
     guac_parse_state state;
 
+    /**
+     * Handler which receives the content of blob instructions as that
+     * content arrives. If NULL, blob instructions are parsed and returned
+     * like any other instruction.
+     */
+    guac_parser_blob_handler* blob_handler;
+
+    /**
+     * Arbitrary data for use by the blob handler.
+     */
+    void* data;
+
+    /**
+     * Non-zero if the content of the current element is being streamed to
+     * the blob handler rather than buffered.
+     */
+    int __blob_streaming;
+
+    /**
+     * The index of the stream associated with the blob currently being
+     * streamed, if any.
+     */
+    int __blob_stream_index;
+
+    /**
+     * Non-zero if the blob handler has reported an error, in which case
+     * guac_error has already been set by the handler.
+     */
+    int __blob_failed;
+
     /**
      * The length of the current element, if known.
      */
@@ -150,6 +181,10 @@ void guac_parser_free(guac_parser* parser);
  * from the guac_socket. Data from the internal buffer can be removed
  * and used elsewhere through guac_parser_shift().
  *
+ * If a blob handler is set, the content of any blob instructions read is
+ * passed to that handler as it arrives, and those instructions are not
+ * returned. Reading continues until some other instruction is complete.
+ *
  * If an error occurs reading the instruction, non-zero is returned,
  * and guac_error is set appropriately.
  *
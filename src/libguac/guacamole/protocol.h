@@ -351,7 +351,9 @@ int guac_protocol_send_pipe(guac_socket* socket, const guac_stream* stream,
 
 /**
  * Writes a block of data to the currently in-progress blob which was already
- * created.
+ * created. Blobs of streams having GUAC_STREAM_PRIORITY_BULK may be deferred
+ * behind all other output, as described by
+ * guac_socket_instruction_begin_bulk().
  *
  * If an error occurs sending the instruction, a non-zero value is
  * returned, and guac_error is set appropriately.
@@ -367,7 +369,8 @@ int guac_protocol_send_blob(guac_socket* socket, const guac_stream* stream,
         const void* data, int count);
 
 /**
- * Sends an end instruction over the given guac_socket connection.
+ * Sends an end instruction over the given guac_socket connection. If the
+ * stream has GUAC_STREAM_PRIORITY_BULK, any deferred blobs are sent first.
  *
  * If an error occurs sending the instruction, a non-zero value is
  * returned, and guac_error is set appropriately.
@@ -34,6 +34,72 @@
  */
 #define GUAC_SOCKET_OUTPUT_BUFFER_SIZE 8192
 
+/**
+ * The maximum number of segments (regions of the output buffer or chunks
+ * queued by reference) which may be pending output on a socket before the
+ * socket is automatically flushed.
+ */
+#define GUAC_SOCKET_MAX_SEGMENTS 64
+
+/**
+ * The minimum size of chunk, in bytes, which will be queued by reference by
+ * guac_socket_write_chunk(). Smaller chunks are simply copied into the output
+ * buffer.
+ */
+#define GUAC_SOCKET_MIN_CHUNK_SIZE 1024
+
+/**
+ * The maximum number of bytes which may be queued by reference on a socket
+ * before the socket is automatically flushed.
+ */
+#define GUAC_SOCKET_MAX_QUEUED_SIZE 131072
+
+/**
+ * The initial size of each per-thread staging buffer used to build
+ * instructions written to threadsafe sockets, in bytes. Staging buffers grow
+ * automatically as needed.
+ */
+#define GUAC_SOCKET_STAGING_BUFFER_SIZE 1024
+
+/**
+ * The maximum number of chunks which may be queued by reference within a
+ * single staged instruction. Any further chunks are copied.
+ */
+#define GUAC_SOCKET_MAX_STAGED_CHUNKS 8
+
+/**
+ * The maximum number of bytes of output which may be queued within a
+ * non-blocking socket, waiting for the connection to drain, before writes to
+ * that socket block.
+ */
+#define GUAC_SOCKET_MAX_BACKLOG 4194304
+
+/**
+ * The maximum number of milliseconds to wait for a non-blocking socket to
+ * accept more of its queued output, or for that output to finish being
+ * written once the socket is freed. If this time elapses, the client is
+ * assumed to have stopped reading, the socket is closed, and all queued
+ * output is discarded.
+ */
+#define GUAC_SOCKET_WRITE_TIMEOUT 15000
+
+/**
+ * The maximum number of bytes of unsent output which the kernel should hold
+ * for a socket opened with guac_socket_open() once it has been made
+ * non-blocking with guac_socket_require_nonblocking(), where the operating
+ * system supports limiting this. Output beyond this limit remains within the
+ * guac_socket, where it can be measured.
+ */
+#define GUAC_SOCKET_NOTSENT_LOWAT 131072
+
+/**
+ * The maximum number of bytes of bulk output which may be deferred within a
+ * non-blocking socket behind other output. Threads writing bulk instructions
+ * block once this much bulk output is waiting, and at most this much bulk
+ * output is written at once ahead of any later output.
+ */
+#define GUAC_SOCKET_MAX_BULK 65536
+
 /**
  * The number of milliseconds to wait between keep-alive pings on a socket
  * with keep-alive enabled.
@@ -31,6 +31,7 @@
 
 #include "socket-types.h"
 
+#include <sys/uio.h>
 #include <unistd.h>
 
 /**
@@ -59,6 +60,34 @@ typedef ssize_t guac_socket_read_handler(guac_socket* socket,
 typedef ssize_t guac_socket_write_handler(guac_socket* socket,
         const void* buf, size_t count);
 
+/**
+ * Generic handler for vectored socket write operations, modeled after the
+ * standard POSIX writev() function. When set within a guac_socket, a handler
+ * of this type will be called instead of the write handler when the socket
+ * is flushed, such that all pending output can be sent at once.
+ *
+ * @param socket The guac_socket being written to.
+ * @param iov The buffers containing the data to be written, in order.
+ * @param iovcnt The number of buffers in the iov array.
+ * @return The number of bytes written, or -1 if an error occurs. As with
+ *         writev(), fewer bytes than requested may be written. If no data
+ *         can be written without blocking, zero may be returned, in which
+ *         case the socket must also have a select_write handler which can
+ *         wait for data to be writable.
+ */
+typedef ssize_t guac_socket_writev_handler(guac_socket* socket,
+        const struct iovec* iov, int iovcnt);
+
+/**
+ * Handler which is called when a chunk of data queued for output with
+ * guac_socket_write_chunk() is no longer needed by the socket, either because
+ * it has been written or because the socket is being freed.
+ *
+ * @param chunk The chunk of data originally passed to
+ *              guac_socket_write_chunk().
+ */
+typedef void guac_socket_chunk_free_handler(void* chunk);
+
 /**
  * Generic handler for socket select operations, similar to the POSIX select()
  * function. When guac_socket_select() is called on a guac_socket, its
@@ -72,6 +101,41 @@ typedef ssize_t guac_socket_write_handler(guac_socket* socket,
  */
 typedef int guac_socket_select_handler(guac_socket* socket, int usec_timeout);
 
+/**
+ * Generic handler which waits until data can be written to a socket without
+ * blocking, similar to calling the POSIX select() function with a set of
+ * file descriptors to be written. This handler is invoked when the writev
+ * handler of a guac_socket reports that no data could be written.
+ *
+ * @param socket The guac_socket being selected.
+ * @param usec_timeout The maximum number of microseconds to wait, or -1 to
+ *                     potentially wait forever.
+ * @return Positive on success, zero if the timeout elapsed and data still
+ *         cannot be written, negative on error.
+ */
+typedef int guac_socket_select_write_handler(guac_socket* socket,
+        int usec_timeout);
+
+/**
+ * Generic handler which returns the number of bytes which have been written
+ * to a socket, but which the underlying transport has not yet begun to send,
+ * such as data waiting within the kernel's send buffer.
+ *
+ * @param socket The guac_socket being queried.
+ * @return The number of bytes written but not yet sent, or -1 if this
+ *         cannot be determined.
+ */
+typedef ssize_t guac_socket_pending_handler(guac_socket* socket);
+
+/**
+ * Generic handler which is invoked once a socket has been made non-blocking,
+ * allowing the underlying transport to be tuned for output which is queued
+ * within the guac_socket rather than within the transport.
+ *
+ * @param socket The guac_socket which is now non-blocking.
+ */
+typedef void guac_socket_nonblocking_handler(guac_socket* socket);
+
 /**
  * Generic handler for the closing of a socket, modeled after the standard
  * POSIX close() function. When set within a guac_socket, a handler of this type
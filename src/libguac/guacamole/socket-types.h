@@ -35,6 +35,13 @@
  */
 typedef struct guac_socket guac_socket;
 
+/**
+ * A contiguous range of data pending output on a guac_socket. Each segment
+ * refers either to a region of the socket's own output buffer or to a chunk
+ * of data queued by reference with guac_socket_write_chunk().
+ */
+typedef struct guac_socket_segment guac_socket_segment;
+
 /**
  * Possible current states of a guac_socket.
  */
@@ -39,6 +39,27 @@
 #include <unistd.h>
 #include <stdio.h>
 
+struct guac_socket_segment {
+
+    /**
+     * The first byte of data within this segment.
+     */
+    const char* data;
+
+    /**
+     * The number of bytes of data within this segment.
+     */
+    size_t length;
+
+    /**
+     * Handler which will be called with the data of this segment once the
+     * segment is no longer needed, or NULL if no handler need be called, as
+     * is the case for regions of the socket's own output buffer.
+     */
+    guac_socket_chunk_free_handler* free_handler;
+
+};
+
 struct guac_socket {
 
     /**
@@ -58,12 +79,41 @@ struct guac_socket {
      */
     guac_socket_write_handler* write_handler;
 
+    /**
+     * Handler which will be called whenever this socket is flushed, writing
+     * all pending output at once. If NULL, each pending segment of output is
+     * instead written separately with the write handler.
+     */
+    guac_socket_writev_handler* writev_handler;
+
     /**
      * Handler which will be called whenever guac_socket_select is invoked
      * on this socket.
      */
     guac_socket_select_handler* select_handler;
 
+    /**
+     * Handler which will be called to wait until data can be written to this
+     * socket, if the writev handler reports that no data can be written
+     * without blocking.
+     */
+    guac_socket_select_write_handler* select_write_handler;
+
+    /**
+     * Handler which will be called whenever guac_socket_get_backlog() is
+     * invoked on this socket, to determine how much written data has not yet
+     * been sent by the underlying transport. If NULL, all written data is
+     * assumed to be sent immediately.
+     */
+    guac_socket_pending_handler* pending_handler;
+
+    /**
+     * Handler which will be called once guac_socket_require_nonblocking()
+     * has made this socket non-blocking. If NULL, the underlying transport
+     * is left unchanged.
+     */
+    guac_socket_nonblocking_handler* nonblocking_handler;
+
     /**
      * Handler which will be called when the socket is free'd (closed).
      */
@@ -102,6 +152,30 @@ struct guac_socket {
      */
     char __out_buf[GUAC_SOCKET_OUTPUT_BUFFER_SIZE];
 
+    /**
+     * All segments of output pending since the last flush, in the order they
+     * must be written. Any data in the main write buffer beyond the end of
+     * the last segment referring to that buffer is written after all
+     * segments.
+     */
+    guac_socket_segment __segments[GUAC_SOCKET_MAX_SEGMENTS];
+
+    /**
+     * The number of segments currently pending within __segments.
+     */
+    int __segment_count;
+
+    /**
+     * The offset within the main write buffer of the first byte not yet
+     * covered by any pending segment.
+     */
+    int __segment_start;
+
+    /**
+     * The total number of bytes within chunks currently queued by reference.
+     */
+    size_t __queued;
+
     /**
      * Pointer to the first character of the current in-progress instruction
      * within the buffer.
@@ -137,6 +211,124 @@ struct guac_socket {
      */
     pthread_mutex_t __buffer_lock;
 
+    /**
+     * Whether each thread writing instructions to this threadsafe socket
+     * builds those instructions within its own staging buffer, committing
+     * each instruction to the main write buffer only once complete. If
+     * staging could not be enabled, instructions are instead serialized with
+     * __instruction_write_lock.
+     */
+    int __staging_enabled;
+
+    /**
+     * Key of the thread-specific staging buffer used by each thread writing
+     * instructions to this socket.
+     */
+    pthread_key_t __staging_key;
+
+    /**
+     * All staging buffers allocated for this socket, across all threads.
+     */
+    struct __guac_socket_staging* __staging_buffers;
+
+    /**
+     * The number of times a thread writing to this socket has had to wait
+     * for another thread to release the buffer lock (or the instruction lock,
+     * if staging is not enabled). This value is informational, and is only
+     * maintained for threadsafe sockets.
+     */
+    uint64_t lock_contention;
+
+    /**
+     * The total number of bytes written to this socket by its write or writev
+     * handlers, including only data which has actually been flushed. Data
+     * queued within the backlog of a non-blocking socket is counted only
+     * once the writer thread has written it. This value is informational.
+     */
+    uint64_t bytes_written;
+
+    /**
+     * Whether output which cannot be written immediately is queued within
+     * __backlog and written by a dedicated thread, rather than blocking the
+     * thread flushing the socket.
+     */
+    int __nonblocking;
+
+    /**
+     * Lock which is acquired whenever the backlog of a non-blocking socket is
+     * accessed.
+     */
+    pthread_mutex_t __backlog_lock;
+
+    /**
+     * Condition which is signalled whenever data is added to or removed from
+     * the backlog of a non-blocking socket, or the writer thread stops.
+     */
+    pthread_cond_t __backlog_modified;
+
+    /**
+     * Output which has been flushed but not yet written, in order. Data is
+     * only ever written from this buffer once all earlier data has been
+     * written.
+     */
+    char* __backlog;
+
+    /**
+     * The offset of the first unwritten byte within __backlog.
+     */
+    size_t __backlog_start;
+
+    /**
+     * The number of unwritten bytes within __backlog.
+     */
+    size_t __backlog_length;
+
+    /**
+     * The number of bytes allocated for __backlog.
+     */
+    size_t __backlog_size;
+
+    /**
+     * Whether the writer thread failed to write the backlog, in which case
+     * the backlog has been discarded and all further writes will fail.
+     */
+    int __backlog_error;
+
+    /**
+     * Whether the writer thread should continue running.
+     */
+    int __writer_running;
+
+    /**
+     * The thread writing the backlog of a non-blocking socket.
+     */
+    pthread_t __writer_thread;
+
+    /**
+     * Bulk output which has been written but deferred until all other output
+     * has been sent, in order. This buffer is guarded by the backlog lock,
+     * such that the writer thread can release it without waiting for the
+     * buffer lock.
+     */
+    char* __bulk;
+
+    /**
+     * The number of bytes of deferred bulk output within __bulk.
+     */
+    size_t __bulk_length;
+
+    /**
+     * The number of bytes allocated for __bulk.
+     */
+    size_t __bulk_size;
+
+    /**
+     * Condition which is signalled whenever deferred bulk output is released
+     * to the backlog, or discarded. This condition is used with the backlog
+     * lock.
+     */
+    pthread_cond_t __bulk_released;
+
     /**
      * Whether automatic keep-alive is enabled.
      */
@@ -193,10 +385,47 @@ void guac_socket_require_threadsafe(guac_socket* socket);
  */
 void guac_socket_require_keep_alive(guac_socket* socket);
 
+/**
+ * Declares that flushing the given socket must not block while the
+ * connection is backed up. Output which cannot be written immediately is
+ * instead queued within the socket and written by a dedicated thread as the
+ * connection drains, such that threads producing output are not held up by
+ * a slow client. Writes block only once more than GUAC_SOCKET_MAX_BACKLOG
+ * bytes are queued. Sockets lacking a writev or select_write handler, and
+ * sockets which are being dumped to a file, are unaffected.
+ *
+ * @param socket The guac_socket to declare as non-blocking.
+ */
+void guac_socket_require_nonblocking(guac_socket* socket);
+
+/**
+ * Returns the number of bytes which have been flushed to the given socket but
+ * which have not yet been sent, including both output queued within a
+ * non-blocking socket and output waiting within the underlying transport,
+ * if known. A growing backlog indicates that output is being produced faster
+ * than the client can receive it.
+ *
+ * @param socket The guac_socket to query.
+ * @return The number of bytes flushed but not yet sent.
+ */
+size_t guac_socket_get_backlog(guac_socket* socket);
+
+/**
+ * Returns the total number of bytes which have been flushed to the given
+ * socket, including output which has been written by the socket's handlers
+ * as well as output still queued within a non-blocking socket.
+ *
+ * @param socket The guac_socket to query.
+ * @return The total number of bytes flushed to the socket.
+ */
+uint64_t guac_socket_get_flushed(guac_socket* socket);
+
 /**
  * Marks the beginning of a Guacamole protocol instruction. If threadsafety
- * is enabled on the socket, other instructions will be blocked from sending
- * until this instruction is complete.
+ * is enabled on the socket, all data written by the current thread until the
+ * instruction is complete is built within a buffer specific to the current
+ * thread, without blocking other threads, and is then written to the socket
+ * atomically when guac_socket_instruction_end() is called.
  *
  * @param socket The guac_socket beginning an instruction.
  */
@@ -204,12 +433,44 @@ void guac_socket_instruction_begin(guac_socket* socket);
 
 /**
  * Marks the end of a Guacamole protocol instruction. If threadsafety
- * is enabled on the socket, other instructions will be allowed to send.
+ * is enabled on the socket, the complete instruction is written to the
+ * socket's buffer as a single, atomic operation. Any error encountered while
+ * doing so will also be reported by the next call to guac_socket_flush().
  *
  * @param socket The guac_socket ending an instruction.
  */
 void guac_socket_instruction_end(guac_socket* socket);
 
+/**
+ * Marks the beginning of a Guacamole protocol instruction which is part of a
+ * bulk transfer, such as a "blob" of a file download. Bulk instructions are
+ * staged exactly as with guac_socket_instruction_begin(), but if the socket
+ * is both threadsafe and non-blocking, the completed instruction is deferred
+ * until all other output has been sent, rather than being queued behind it.
+ * Deferred instructions are sent in the order written, and a thread writing
+ * a bulk instruction blocks once GUAC_SOCKET_MAX_BULK bytes are deferred. On
+ * all other sockets, this function is identical to
+ * guac_socket_instruction_begin(). The instruction must be ended with
+ * guac_socket_instruction_end().
+ *
+ * @param socket The guac_socket beginning a bulk instruction.
+ */
+void guac_socket_instruction_begin_bulk(guac_socket* socket);
+
+/**
+ * Releases all deferred bulk output of the given socket immediately, such
+ * that any instruction written afterwards follows that output. This must be
+ * called before an instruction which must not overtake earlier bulk
+ * instructions, such as the "end" of a bulk stream.
+ *
+ * If an error occurs while writing, a non-zero value is returned, and
+ * guac_error is set appropriately.
+ *
+ * @param socket The guac_socket whose deferred bulk output should be sent.
+ * @return Zero on success, or non-zero if an error occurs while writing.
+ */
+ssize_t guac_socket_flush_bulk(guac_socket* socket);
+
 /**
  * Marks the beginning of a socket's buffer modification. If threadsafety is
  * enabled on the socket, other functions which modify the buffer will be
@@ -292,6 +553,32 @@ ssize_t guac_socket_write_int(guac_socket* socket, int64_t i);
 */
 ssize_t guac_socket_write_string(guac_socket* socket, const char* str);
 
+/**
+ * Writes the given buffer to the given guac_socket object. Unlike
+ * guac_socket_write(), the data written may be buffered until the buffer is
+ * flushed automatically or manually, exactly as with
+ * guac_socket_write_string(), but the data need not be null-terminated. As
+ * with guac_socket_write_string(), any base64 data previously written must be
+ * flushed with guac_socket_flush_base64() first.
+ *
+ * If an error occurs while writing, a non-zero value is returned, and
+ * guac_error is set appropriately.
+ *
+ * @param socket
+ *     The guac_socket object to write to.
+ *
+ * @param buf
+ *     A buffer containing the data to write.
+ *
+ * @param count
+ *     The number of bytes to write.
+ *
+ * @return
+ *     Zero on success, or non-zero if an error occurs while writing.
+ */
+ssize_t guac_socket_write_buffered(guac_socket* socket, const void* buf,
+        size_t count);
+
 /**
  * Writes the given binary data to the given guac_socket object as base64-
  * encoded data. The data written may be buffered until the buffer is flushed
@@ -310,6 +597,32 @@ ssize_t guac_socket_write_string(guac_socket* socket, const char* str);
  */
 ssize_t guac_socket_write_base64(guac_socket* socket, const void* buf, size_t count);
 
+/**
+ * Writes the given chunk of data to the given guac_socket object without
+ * copying, queueing a reference to the chunk until the socket is flushed.
+ * Chunks smaller than GUAC_SOCKET_MIN_CHUNK_SIZE are instead copied into the
+ * socket's output buffer. In either case, the given free handler is invoked
+ * with the chunk once the socket no longer needs it, which may be before this
+ * function returns. The chunk must not be modified until then. Note that, as
+ * with guac_socket_write_string(), any base64 data previously written must be
+ * completed with guac_socket_flush_base64() prior to calling this function.
+ *
+ * If an error occurs while writing, a non-zero value is returned, and
+ * guac_error is set appropriately. The free handler is still invoked with
+ * the chunk, in this case no later than when the socket is freed.
+ *
+ * @param socket The guac_socket object to write to.
+ * @param chunk A buffer containing the data to write.
+ * @param count The number of bytes to write.
+ * @param free_handler The handler to invoke once the chunk is no longer
+ *                     needed, or NULL if no handler should be invoked, in
+ *                     which case the chunk must remain unmodified until the
+ *                     socket is next flushed.
+ * @return Zero on success, or non-zero if an error occurs while writing.
+ */
+ssize_t guac_socket_write_chunk(guac_socket* socket, const void* chunk,
+        size_t count, guac_socket_chunk_free_handler* free_handler);
+
 /**
  * Writes the given data to the specified socket. The data written is not
  * buffered, and will be sent immediately.
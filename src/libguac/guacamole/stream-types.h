@@ -34,5 +34,29 @@
  */
 typedef struct guac_stream guac_stream;
 
+/**
+ * The priority with which data sent along an outbound stream is scheduled
+ * relative to all other output.
+ */
+typedef enum guac_stream_priority {
+
+    /**
+     * Data is written immediately, in the order written. This is the default,
+     * and is required for any stream whose data affects or must keep pace
+     * with the display, such as images, video, audio, and the clipboard.
+     */
+    GUAC_STREAM_PRIORITY_INTERACTIVE = 0,
+
+    /**
+     * Data is part of a bulk transfer, such as a file download, print job,
+     * or pipe, which may be deferred behind all other output. Each blob is
+     * queued, and queued blobs are written only once all other output has
+     * been sent, in bounded slices, such that interactive updates are never
+     * stuck behind more than a small amount of bulk data.
+     */
+    GUAC_STREAM_PRIORITY_BULK
+
+} guac_stream_priority;
+
 #endif
 
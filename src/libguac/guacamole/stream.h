@@ -89,6 +89,30 @@ struct guac_stream {
      */
     guac_client_blob_handler* blob_handler;
 
+    /**
+     * Handler for portions of blob events sent by the Guacamole web-client.
+     * If set, this handler is called instead of blob_handler, receiving the
+     * content of each blob in one or more chunks as that content arrives,
+     * rather than only once the entire blob has been received.
+     *
+     * The handler takes a guac_stream which contains the stream index, an
+     * arbitrary buffer containing the current chunk, the length of that
+     * chunk, and a flag which is non-zero only for the last chunk of the
+     * blob. Blobs should be acknowledged only upon receiving that last chunk.
+     *
+     * Example:
+     * @code
+     *     int blob_chunk_handler(guac_client* client, guac_stream* stream,
+     *             void* data, int length, int final);
+     *
+     *     int my_file_handler(guac_client* client, guac_stream* stream,
+     *             char* mimetype, char* filename) {
+     *         stream->blob_chunk_handler = blob_chunk_handler;
+     *     }
+     * @endcode
+     */
+    guac_client_blob_chunk_handler* blob_chunk_handler;
+
     /**
      * Handler for stream end events sent by the Guacamole web-client.
      *
@@ -108,6 +132,14 @@ struct guac_stream {
      */
     guac_client_end_handler* end_handler;
 
+    /**
+     * The priority of data sent along this stream relative to all other
+     * output. Newly-allocated streams are GUAC_STREAM_PRIORITY_INTERACTIVE.
+     * Streams carrying bulk transfers should be given
+     * GUAC_STREAM_PRIORITY_BULK before any blobs are sent.
+     */
+    guac_stream_priority priority;
+
 };
 
 #endif
@@ -31,6 +31,8 @@
 
 #include "timestamp-types.h"
 
+#include <stdint.h>
+
 /**
  * Returns an arbitrary timestamp. The difference between return values of any
  * two calls is equal to the amount of time in milliseconds between those 
@@ -41,5 +43,17 @@
  */
 guac_timestamp guac_timestamp_current();
 
+/**
+ * Returns an arbitrary timestamp with microsecond resolution, intended for
+ * measuring short durations such as the time taken to encode an image. The
+ * difference between return values of any two calls is equal to the amount
+ * of time in microseconds between those calls. Where supported, this
+ * timestamp is monotonic, and is thus unaffected by changes to the system
+ * clock.
+ *
+ * @return An arbitrary microsecond timestamp.
+ */
+uint64_t guac_timestamp_current_usec();
+
 #endif
 
@@ -0,0 +1,151 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef __GUAC_VIDEO_H
+#define __GUAC_VIDEO_H
+
+/**
+ * Provides functions and structures used for streaming video.
+ *
+ * @file video.h
+ */
+
+#include "client-types.h"
+#include "layer-types.h"
+#include "socket-types.h"
+#include "stream-types.h"
+#include "timestamp-types.h"
+#include "video-types.h"
+
+#include <cairo/cairo.h>
+
+/**
+ * The mimetype of all video streamed by libguac: VP8 within a WebM
+ * container.
+ */
+#define GUAC_VIDEO_MIMETYPE "video/webm"
+
+struct guac_video_stream {
+
+    /**
+     * The client associated with this video stream.
+     */
+    guac_client* client;
+
+    /**
+     * The socket over which video data is sent.
+     */
+    guac_socket* socket;
+
+    /**
+     * The actual stream associated with this video stream.
+     */
+    guac_stream* stream;
+
+    /**
+     * The layer on which the video is played back.
+     */
+    const guac_layer* layer;
+
+    /**
+     * The width of each frame, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of each frame, in pixels.
+     */
+    int height;
+
+    /**
+     * The time at which the first frame was written, or zero if no frames
+     * have yet been written. The presentation time of each frame is
+     * relative to this time.
+     */
+    guac_timestamp start;
+
+    /**
+     * Encoder-specific state data.
+     */
+    void* data;
+
+};
+
+/**
+ * Allocates a new video stream which plays back on the given layer, sending
+ * the "video" instruction which begins the stream. Each frame written to the
+ * stream must have the given dimensions. Video streams are only available if
+ * the client supports video and libguac was built with video support (see
+ * guac_client_supports_video()).
+ *
+ * @param client
+ *     The guac_client for which this video stream is being allocated.
+ *
+ * @param socket
+ *     The socket over which the video should be sent.
+ *
+ * @param layer
+ *     The layer on which the video should be played back.
+ *
+ * @param width
+ *     The width of each frame, in pixels.
+ *
+ * @param height
+ *     The height of each frame, in pixels.
+ *
+ * @return
+ *     The newly allocated guac_video_stream, or NULL if no video stream
+ *     could be allocated due to lack of client or server support, or due to
+ *     an error in the encoder.
+ */
+guac_video_stream* guac_video_stream_alloc(guac_client* client,
+        guac_socket* socket, const guac_layer* layer, int width, int height);
+
+/**
+ * Encodes the given image as the next frame of the given video stream,
+ * sending the result over the stream. The frame is presented at the time it
+ * is written, relative to the first frame.
+ *
+ * @param video
+ *     The video stream to write to.
+ *
+ * @param frame
+ *     A Cairo surface containing the frame, which must have the dimensions
+ *     given when the video stream was allocated.
+ *
+ * @return
+ *     Zero if the frame was encoded and sent successfully, non-zero
+ *     otherwise.
+ */
+int guac_video_stream_write(guac_video_stream* video, cairo_surface_t* frame);
+
+/**
+ * Ends and frees the given video stream. The layer on which the video was
+ * played back is not freed.
+ *
+ * @param video
+ *     The guac_video_stream to free.
+ */
+void guac_video_stream_free(guac_video_stream* video);
+
+#endif
+
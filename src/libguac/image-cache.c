@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "client.h"
+#include "hash.h"
+#include "image-cache.h"
+#include "layer.h"
+#include "protocol.h"
+#include "socket.h"
+
+#include <cairo/cairo.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * Returns the number of bytes of client-side memory required to store an
+ * image of the given dimensions.
+ */
+static int guac_image_cache_size_of(int width, int height) {
+    return width * height * 4;
+}
+
+/**
+ * Removes the given entry from the LRU list of the given cache.
+ */
+static void guac_image_cache_unlink(guac_image_cache* cache,
+        guac_image_cache_entry* entry) {
+
+    if (entry->prev != NULL)
+        entry->prev->next = entry->next;
+    else
+        cache->head = entry->next;
+
+    if (entry->next != NULL)
+        entry->next->prev = entry->prev;
+    else
+        cache->tail = entry->prev;
+
+}
+
+/**
+ * Adds the given entry to the LRU list of the given cache as the most
+ * recently used entry, marking it as used within the current generation.
+ */
+static void guac_image_cache_touch(guac_image_cache* cache,
+        guac_image_cache_entry* entry) {
+
+    entry->prev = NULL;
+    entry->next = cache->head;
+
+    if (cache->head != NULL)
+        cache->head->prev = entry;
+    else
+        cache->tail = entry;
+
+    cache->head = entry;
+    entry->generation = cache->generation;
+
+}
+
+/**
+ * Removes the given entry from the given cache entirely, freeing its buffer
+ * and sending a "dispose" instruction over the given socket, if any.
+ */
+static void guac_image_cache_remove(guac_image_cache* cache,
+        guac_socket* socket, guac_image_cache_entry* entry) {
+
+    guac_image_cache_entry** current =
+        &cache->buckets[entry->hash % GUAC_IMAGE_CACHE_BUCKETS];
+
+    /* Remove from bucket */
+    while (*current != entry)
+        current = &(*current)->next_in_bucket;
+    *current = entry->next_in_bucket;
+
+    guac_image_cache_unlink(cache, entry);
+
+    if (socket != NULL)
+        guac_protocol_send_dispose(socket, entry->buffer);
+
+    guac_client_free_buffer(cache->client, entry->buffer);
+    cairo_surface_destroy(entry->surface);
+
+    cache->size -= entry->size;
+    free(entry);
+
+}
+
+/**
+ * Copies the contents of the given image into a newly-allocated image
+ * surface, or returns NULL if the copy cannot be allocated.
+ */
+static cairo_surface_t* guac_image_cache_copy(cairo_surface_t* surface) {
+
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+    unsigned char* data = cairo_image_surface_get_data(surface);
+
+    cairo_surface_t* copy = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            width, height);
+
+    if (cairo_surface_status(copy) != CAIRO_STATUS_SUCCESS) {
+        cairo_surface_destroy(copy);
+        return NULL;
+    }
+
+    int copy_stride = cairo_image_surface_get_stride(copy);
+    unsigned char* copy_data = cairo_image_surface_get_data(copy);
+    int y;
+
+    /* Copy image row by row */
+    cairo_surface_flush(copy);
+    for (y = 0; y < height; y++) {
+        memcpy(copy_data, data, width * 4);
+        copy_data += copy_stride;
+        data += stride;
+    }
+    cairo_surface_mark_dirty(copy);
+
+    return copy;
+
+}
+
+guac_image_cache* guac_image_cache_alloc(guac_client* client, int max_size) {
+
+    guac_image_cache* cache = calloc(1, sizeof(guac_image_cache));
+    if (cache == NULL)
+        return NULL;
+
+    cache->client = client;
+    cache->max_size = max_size;
+
+    return cache;
+
+}
+
+void guac_image_cache_free(guac_image_cache* cache) {
+
+    /* Free all entries without notifying the client */
+    while (cache->head != NULL)
+        guac_image_cache_remove(cache, NULL, cache->head);
+
+    free(cache);
+
+}
+
+void guac_image_cache_begin(guac_image_cache* cache) {
+    cache->generation++;
+}
+
+int guac_image_cache_accepts(guac_image_cache* cache,
+        cairo_surface_t* surface) {
+
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+
+    /* Cache only images large enough to be worthwhile, yet small enough
+     * that a single image cannot dominate the cache */
+    return width * height >= GUAC_IMAGE_CACHE_MIN_AREA
+        && guac_image_cache_size_of(width, height) <= cache->max_size / 4;
+
+}
+
+guac_image_cache_entry* guac_image_cache_lookup(guac_image_cache* cache,
+        cairo_surface_t* surface, unsigned int hash) {
+
+    guac_image_cache_entry* entry =
+        cache->buckets[hash % GUAC_IMAGE_CACHE_BUCKETS];
+
+    /* Search bucket for identical image */
+    while (entry != NULL) {
+
+        if (entry->hash == hash
+                && guac_surface_cmp(entry->surface, surface) == 0) {
+
+            /* Mark as most recently used */
+            guac_image_cache_unlink(cache, entry);
+            guac_image_cache_touch(cache, entry);
+
+            cache->hits++;
+            return entry;
+
+        }
+
+        entry = entry->next_in_bucket;
+
+    }
+
+    cache->misses++;
+    return NULL;
+
+}
+
+guac_image_cache_entry* guac_image_cache_add(guac_image_cache* cache,
+        guac_socket* socket, cairo_surface_t* surface, unsigned int hash,
+        int* created) {
+
+    guac_image_cache_entry* entry;
+    int width = cairo_image_surface_get_width(surface);
+    int height = cairo_image_surface_get_height(surface);
+    int size = guac_image_cache_size_of(width, height);
+    unsigned int bucket = hash % GUAC_IMAGE_CACHE_BUCKETS;
+
+    *created = 0;
+
+    /* Reuse existing entry if the same image was already added */
+    for (entry = cache->buckets[bucket]; entry != NULL;
+            entry = entry->next_in_bucket) {
+
+        if (entry->hash == hash
+                && guac_surface_cmp(entry->surface, surface) == 0) {
+            guac_image_cache_unlink(cache, entry);
+            guac_image_cache_touch(cache, entry);
+            return entry;
+        }
+
+    }
+
+    /* Evict least recently used entries until the image fits, never
+     * evicting entries which may still be referenced by the caller */
+    while (cache->size + size > cache->max_size) {
+
+        guac_image_cache_entry* victim = cache->tail;
+        if (victim == NULL || victim->generation == cache->generation)
+            return NULL;
+
+        guac_image_cache_remove(cache, socket, victim);
+        cache->evictions++;
+
+    }
+
+    entry = calloc(1, sizeof(guac_image_cache_entry));
+    if (entry == NULL)
+        return NULL;
+
+    entry->surface = guac_image_cache_copy(surface);
+    if (entry->surface == NULL) {
+        free(entry);
+        return NULL;
+    }
+
+    entry->buffer = guac_client_alloc_buffer(cache->client);
+    entry->hash = hash;
+    entry->width = width;
+    entry->height = height;
+    entry->size = size;
+
+    /* Add to bucket and LRU list */
+    entry->next_in_bucket = cache->buckets[bucket];
+    cache->buckets[bucket] = entry;
+    guac_image_cache_touch(cache, entry);
+    cache->size += size;
+
+    guac_protocol_send_size(socket, entry->buffer, width, height);
+
+    *created = 1;
+    return entry;
+
+}
+
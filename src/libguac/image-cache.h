@@ -0,0 +1,273 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef GUAC_IMAGE_CACHE_H
+#define GUAC_IMAGE_CACHE_H
+
+#include "config.h"
+
+#include "client.h"
+#include "layer.h"
+#include "socket.h"
+
+#include <cairo/cairo.h>
+
+/**
+ * The number of hash buckets within each image cache.
+ */
+#define GUAC_IMAGE_CACHE_BUCKETS 1024
+
+/**
+ * The smallest image which will be cached, in pixels. Smaller images are
+ * cheap enough to encode that caching them is not worth the additional
+ * client-side buffer.
+ */
+#define GUAC_IMAGE_CACHE_MIN_AREA 256
+
+/**
+ * A single image stored within an image cache, along with the client-side
+ * buffer containing a copy of that image.
+ */
+typedef struct guac_image_cache_entry {
+
+    /**
+     * The hash of the image, as returned by guac_hash_surface().
+     */
+    unsigned int hash;
+
+    /**
+     * A copy of the image, used to verify that images having the same hash
+     * are truly identical.
+     */
+    cairo_surface_t* surface;
+
+    /**
+     * The client-side buffer containing the image at its upper-left corner.
+     */
+    guac_layer* buffer;
+
+    /**
+     * The width of the image, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of the image, in pixels.
+     */
+    int height;
+
+    /**
+     * The number of bytes of client-side memory occupied by this image.
+     */
+    int size;
+
+    /**
+     * The value of the generation counter of the cache when this entry was
+     * last used.
+     */
+    unsigned int generation;
+
+    /**
+     * The next more recently used entry, or NULL if this is the most
+     * recently used entry.
+     */
+    struct guac_image_cache_entry* prev;
+
+    /**
+     * The next less recently used entry, or NULL if this is the least
+     * recently used entry.
+     */
+    struct guac_image_cache_entry* next;
+
+    /**
+     * The next entry within the same hash bucket, or NULL if this is the
+     * last entry of its bucket.
+     */
+    struct guac_image_cache_entry* next_in_bucket;
+
+} guac_image_cache_entry;
+
+/**
+ * A least-recently-used cache of images which have been sent to the client,
+ * each stored in its own client-side buffer such that later occurrences of
+ * the same image can be drawn with a "copy" instead of being re-encoded.
+ */
+typedef struct guac_image_cache {
+
+    /**
+     * The client whose buffers store the cached images.
+     */
+    guac_client* client;
+
+    /**
+     * The maximum number of bytes of client-side memory which may be
+     * occupied by cached images.
+     */
+    int max_size;
+
+    /**
+     * The number of bytes of client-side memory currently occupied by cached
+     * images.
+     */
+    int size;
+
+    /**
+     * All entries, grouped by hash.
+     */
+    guac_image_cache_entry* buckets[GUAC_IMAGE_CACHE_BUCKETS];
+
+    /**
+     * The most recently used entry, or NULL if the cache is empty.
+     */
+    guac_image_cache_entry* head;
+
+    /**
+     * The least recently used entry, or NULL if the cache is empty.
+     */
+    guac_image_cache_entry* tail;
+
+    /**
+     * Counter which is incremented by guac_image_cache_begin(). Entries used
+     * since the last increment are never evicted.
+     */
+    unsigned int generation;
+
+    /**
+     * The number of lookups which found a matching image.
+     */
+    int hits;
+
+    /**
+     * The number of lookups which did not find a matching image.
+     */
+    int misses;
+
+    /**
+     * The number of entries evicted to make room for others.
+     */
+    int evictions;
+
+} guac_image_cache;
+
+/**
+ * Allocates a new, empty image cache.
+ *
+ * @param client
+ *     The client whose buffers will store the cached images.
+ *
+ * @param max_size
+ *     The maximum number of bytes of client-side memory which may be
+ *     occupied by cached images.
+ *
+ * @return
+ *     A newly-allocated image cache, or NULL if allocation fails.
+ */
+guac_image_cache* guac_image_cache_alloc(guac_client* client, int max_size);
+
+/**
+ * Frees the given image cache, returning all of its buffers to the client.
+ * No instructions are sent.
+ *
+ * @param cache
+ *     The image cache to free.
+ */
+void guac_image_cache_free(guac_image_cache* cache);
+
+/**
+ * Marks the beginning of a new set of lookups and additions. Entries found
+ * or added after this call are not evicted until the next call.
+ *
+ * @param cache
+ *     The image cache to update.
+ */
+void guac_image_cache_begin(guac_image_cache* cache);
+
+/**
+ * Returns whether the given image is of a size that may be cached.
+ *
+ * @param cache
+ *     The image cache to test against.
+ *
+ * @param surface
+ *     The image to test.
+ *
+ * @return
+ *     Non-zero if the given image may be cached, zero otherwise.
+ */
+int guac_image_cache_accepts(guac_image_cache* cache,
+        cairo_surface_t* surface);
+
+/**
+ * Searches the cache for an image identical to the given image, updating the
+ * hit and miss counters accordingly. A matching entry becomes the most
+ * recently used entry.
+ *
+ * @param cache
+ *     The image cache to search.
+ *
+ * @param surface
+ *     The image to search for.
+ *
+ * @param hash
+ *     The hash of the given image, as returned by guac_hash_surface().
+ *
+ * @return
+ *     The entry containing an identical image, or NULL if there is no such
+ *     entry.
+ */
+guac_image_cache_entry* guac_image_cache_lookup(guac_image_cache* cache,
+        cairo_surface_t* surface, unsigned int hash);
+
+/**
+ * Adds a copy of the given image to the cache, evicting less recently used
+ * entries as needed and sending the instructions required to dispose of
+ * their buffers. The caller must populate the buffer of the returned entry
+ * with the image. If an identical image is already cached, that entry is
+ * returned instead.
+ *
+ * @param cache
+ *     The image cache to add to.
+ *
+ * @param socket
+ *     The socket over which any "dispose" or "size" instructions should be
+ *     sent.
+ *
+ * @param surface
+ *     The image to add.
+ *
+ * @param hash
+ *     The hash of the given image, as returned by guac_hash_surface().
+ *
+ * @param created
+ *     Set to non-zero if a new entry was created, and thus the buffer of the
+ *     returned entry does not yet contain the image, or zero otherwise.
+ *
+ * @return
+ *     The entry containing the given image, or NULL if the image could not
+ *     be cached.
+ */
+guac_image_cache_entry* guac_image_cache_add(guac_image_cache* cache,
+        guac_socket* socket, cairo_surface_t* surface, unsigned int hash,
+        int* created);
+
+#endif
+
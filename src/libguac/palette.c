@@ -31,76 +31,336 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifdef HAVE_X86_SIMD
+#include <immintrin.h>
+#endif
+
+/**
+ * The number of pixels sampled from throughout each image before that image
+ * is scanned in full. As sampled pixels are real pixels, an image whose
+ * samples alone contain more than 256 colors can be rejected without
+ * scanning the remainder of the image.
+ */
+#define GUAC_PALETTE_SAMPLES 1024
+
+/**
+ * The minimum number of pixels an image must contain for sampling to be
+ * worthwhile.
+ */
+#define GUAC_PALETTE_SAMPLE_THRESHOLD 16384
+
 guac_palette* guac_palette_alloc(cairo_surface_t* surface) {
 
-    int x, y;
+    /* Allocate palette */
+    guac_palette* palette = (guac_palette*) malloc(sizeof(guac_palette));
+    memset(palette, 0, sizeof(guac_palette));
+
+    /* Fail if too many colors */
+    if (guac_palette_build(palette, surface)) {
+        guac_palette_free(palette);
+        return NULL;
+    }
+
+    return palette;
+
+}
+
+/**
+ * Returns the index of the given color within the given palette, adding the
+ * color to the palette if not already present.
+ *
+ * @param palette
+ *     The palette to search.
+ *
+ * @param color
+ *     The color to search for, as a 24-bit RGB value.
+ *
+ * @return
+ *     The index of the given color, or -1 if the color is not present and
+ *     the palette is already full.
+ */
+static inline int guac_palette_insert(guac_palette* palette, int color) {
+
+    /* Calculate hash code */
+    int hash = ((color & 0xFFF000) >> 12) ^ (color & 0xFFF);
+
+    guac_palette_entry* entry;
+
+    /* Search for open palette entry */
+    for (;;) {
+
+        entry = &(palette->entries[hash]);
+
+        /* If we've found a free space, use it */
+        if (entry->index == 0) {
+
+            png_color* c;
+
+            /* Stop if already at capacity */
+            if (palette->size == 256)
+                return -1;
+
+            /* Store in palette */
+            c = &(palette->colors[palette->size]);
+            c->blue  = (color      ) & 0xFF;
+            c->green = (color >> 8 ) & 0xFF;
+            c->red   = (color >> 16) & 0xFF;
+
+            /* Add color to map */
+            palette->slots[palette->size] = hash;
+            entry->index = ++palette->size;
+            entry->color = color;
+
+            return entry->index - 1;
+
+        }
+
+        /* Otherwise, if already stored here, done */
+        if (entry->color == color)
+            return entry->index - 1;
+
+        /* Otherwise, collision. Move on to another bucket */
+        hash = (hash+1) & 0xFFF;
+
+    }
+
+}
+
+/**
+ * Adds the colors of the given range of pixels to the given palette, storing
+ * the palette index of each pixel if requested. Pixels identical to their
+ * predecessor reuse the index of that predecessor without searching the
+ * palette.
+ *
+ * @param palette
+ *     The palette to add colors to.
+ *
+ * @param row
+ *     The row of pixels containing the range.
+ *
+ * @param start
+ *     The index of the first pixel of the range.
+ *
+ * @param end
+ *     The index of the pixel immediately after the range.
+ *
+ * @param indices
+ *     The row of palette indices to populate, or NULL if indices are not
+ *     needed.
+ *
+ * @param last_color
+ *     The color of the pixel before the range, or -1 if none. Updated to the
+ *     color of the last pixel of the range.
+ *
+ * @param last_index
+ *     The palette index of last_color. Updated to the palette index of the
+ *     last pixel of the range.
+ *
+ * @return
+ *     Zero if all colors fit within the palette, -1 otherwise.
+ */
+static inline __attribute__((always_inline))
+int guac_palette_index_pixels(guac_palette* palette, const uint32_t* row,
+        int start, int end, unsigned char* indices, int* last_color,
+        int* last_index) {
+
+    int x;
+
+    for (x = start; x < end; x++) {
+
+        int color = row[x] & 0xFFFFFF;
+
+        /* Search palette only when color changes */
+        if (color != *last_color) {
+
+            int index = guac_palette_insert(palette, color);
+            if (index < 0)
+                return -1;
+
+            *last_color = color;
+            *last_index = index;
+
+        }
+
+        if (indices != NULL)
+            indices[x] = *last_index;
+
+    }
+
+    return 0;
+
+}
+
+#ifdef HAVE_X86_SIMD
+
+/*
+ * The vectorized implementations below compare groups of pixels against
+ * their predecessors, skipping the palette entirely for groups lying within
+ * a run of identical pixels, as is typical of UI content. Groups containing
+ * any change are handled by guac_palette_index_pixels(). Each returns the
+ * index of the first pixel not handled, or -1 if the palette overflowed.
+ */
+
+/**
+ * Indexes groups of four pixels using SSE4.1, starting with the second pixel
+ * of the row.
+ */
+__attribute__((target("sse4.1")))
+static int guac_palette_index_row_sse41(guac_palette* palette,
+        const uint32_t* row, int width, unsigned char* indices,
+        int* last_color, int* last_index) {
+
+    __m128i rgb = _mm_set1_epi32(0xFFFFFF);
+    int x;
+
+    for (x = 1; x + 4 <= width; x += 4) {
+
+        __m128i current = _mm_and_si128(rgb,
+                _mm_loadu_si128((const __m128i*) (row + x)));
+        __m128i previous = _mm_and_si128(rgb,
+                _mm_loadu_si128((const __m128i*) (row + x - 1)));
+
+        /* Skip palette for runs of identical pixels */
+        if (_mm_movemask_ps(_mm_castsi128_ps(
+                        _mm_cmpeq_epi32(current, previous))) == 0xF) {
+            if (indices != NULL)
+                memset(indices + x, *last_index, 4);
+            continue;
+        }
+
+        if (guac_palette_index_pixels(palette, row, x, x + 4, indices,
+                    last_color, last_index))
+            return -1;
+
+    }
+
+    return x;
+
+}
+
+/**
+ * Indexes groups of eight pixels using AVX2, starting with the second pixel
+ * of the row.
+ */
+__attribute__((target("avx2")))
+static int guac_palette_index_row_avx2(guac_palette* palette,
+        const uint32_t* row, int width, unsigned char* indices,
+        int* last_color, int* last_index) {
+
+    __m256i rgb = _mm256_set1_epi32(0xFFFFFF);
+    int x;
+
+    for (x = 1; x + 8 <= width; x += 8) {
+
+        __m256i current = _mm256_and_si256(rgb,
+                _mm256_loadu_si256((const __m256i*) (row + x)));
+        __m256i previous = _mm256_and_si256(rgb,
+                _mm256_loadu_si256((const __m256i*) (row + x - 1)));
+
+        /* Skip palette for runs of identical pixels */
+        if (_mm256_movemask_ps(_mm256_castsi256_ps(
+                        _mm256_cmpeq_epi32(current, previous))) == 0xFF) {
+            if (indices != NULL)
+                memset(indices + x, *last_index, 8);
+            continue;
+        }
+
+        if (guac_palette_index_pixels(palette, row, x, x + 8, indices,
+                    last_color, last_index))
+            return -1;
+
+    }
+
+    return x;
+
+}
+
+#endif
+
+int guac_palette_build(guac_palette* palette, cairo_surface_t* surface) {
+    return guac_palette_index(palette, surface, NULL);
+}
+
+int guac_palette_index(guac_palette* palette, cairo_surface_t* surface,
+        unsigned char* indices) {
+
+    int i, y;
 
     int width = cairo_image_surface_get_width(surface);
     int height = cairo_image_surface_get_height(surface);
     int stride = cairo_image_surface_get_stride(surface);
     unsigned char* data = cairo_image_surface_get_data(surface);
 
-    /* Allocate palette */
-    guac_palette* palette = (guac_palette*) malloc(sizeof(guac_palette));
-    memset(palette, 0, sizeof(guac_palette));
+    unsigned int pixels = (unsigned int) width * height;
 
-    for (y=0; y<height; y++) {
-        for (x=0; x<width; x++) {
+    /* Clear only those entries used by any previous build, such that
+     * palettes can be cheaply reused */
+    for (i = 0; i < palette->size; i++)
+        palette->entries[palette->slots[i]].index = 0;
 
-            /* Get pixel color */
-            int color = ((uint32_t*) data)[x] & 0xFFFFFF;
+    palette->size = 0;
 
-            /* Calculate hash code */
-            int hash = ((color & 0xFFF000) >> 12) ^ (color & 0xFFF);
+    /* Empty images need no colors */
+    if (width <= 0 || height <= 0)
+        return 0;
 
-            guac_palette_entry* entry;
+    /* Reject images with too many colors early by first adding pixels
+     * sampled from throughout the image */
+    if (pixels >= GUAC_PALETTE_SAMPLE_THRESHOLD) {
+        for (i = 0; i < GUAC_PALETTE_SAMPLES; i++) {
 
-            /* Search for open palette entry */
-            for (;;) {
-                
-                entry = &(palette->entries[hash]);
+            /* Scatter samples using Knuth's multiplicative hash */
+            unsigned int offset = (i * 2654435761u) % pixels;
+            const uint32_t* row = (const uint32_t*)
+                (data + (offset / width) * stride);
 
-                /* If we've found a free space, use it */
-                if (entry->index == 0) {
+            if (guac_palette_insert(palette,
+                        row[offset % width] & 0xFFFFFF) < 0)
+                return -1;
 
-                    png_color* c;
+        }
+    }
 
-                    /* Stop if already at capacity */
-                    if (palette->size == 256) {
-                        guac_palette_free(palette);
-                        return NULL;
-                    }
+    for (y = 0; y < height; y++) {
 
-                    /* Store in palette */
-                    c = &(palette->colors[palette->size]);
-                    c->blue  = (color      ) & 0xFF;
-                    c->green = (color >> 8 ) & 0xFF;
-                    c->red   = (color >> 16) & 0xFF;
+        const uint32_t* row = (const uint32_t*) data;
+        int last_color = -1;
+        int last_index = 0;
+        int x = 0;
 
-                    /* Add color to map */
-                    entry->index = ++palette->size;
-                    entry->color = color;
+        /* First pixel has no predecessor within the row */
+        if (guac_palette_index_pixels(palette, row, 0, 1, indices,
+                    &last_color, &last_index))
+            return -1;
 
-                    break;
+        x = 1;
 
-                }
+#ifdef HAVE_X86_SIMD
+        if (__builtin_cpu_supports("avx2"))
+            x = guac_palette_index_row_avx2(palette, row, width, indices,
+                    &last_color, &last_index);
 
-                /* Otherwise, if already stored here, done */
-                if (entry->color == color)
-                    break;
+        else if (__builtin_cpu_supports("sse4.1"))
+            x = guac_palette_index_row_sse41(palette, row, width, indices,
+                    &last_color, &last_index);
 
-                /* Otherwise, collision. Move on to another bucket */
-                hash = (hash+1) & 0xFFF;
+        if (x < 0)
+            return -1;
+#endif
 
-            }
-        }
+        /* Index remaining pixels */
+        if (guac_palette_index_pixels(palette, row, x, width, indices,
+                    &last_color, &last_index))
+            return -1;
 
         /* Advance to next data row */
         data += stride;
+        if (indices != NULL)
+            indices += width;
 
     }
 
-    return palette;
+    return 0;
 
 }
 
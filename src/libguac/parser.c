@@ -22,6 +22,7 @@
 
 #include "config.h"
 
+#include "base64.h"
 #include "error.h"
 #include "parser.h"
 #include "socket.h"
@@ -31,12 +32,174 @@
 #include <stdio.h>
 #include <string.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 static void guac_parser_reset(guac_parser* parser) {
     parser->opcode = NULL;
     parser->argc = 0;
     parser->state = GUAC_PARSE_LENGTH;
     parser->__elementc = 0;
     parser->__element_length = 0;
+    parser->__blob_streaming = 0;
+}
+
+/**
+ * Returns whether the element about to be parsed is the content of a blob
+ * instruction which should be streamed to the parser's blob handler. This is
+ * the case only if a blob handler is set and the opcode and stream index of
+ * a blob instruction have already been parsed.
+ *
+ * @param parser
+ *     The parser to test.
+ *
+ * @return
+ *     Non-zero if the next element should be streamed, zero otherwise.
+ */
+static int guac_parser_is_blob_content(guac_parser* parser) {
+    return parser->blob_handler != NULL
+        && parser->__elementc == 2
+        && strcmp(parser->__elementv[0], "blob") == 0;
+}
+
+/**
+ * Decodes as much of the streamed content of the current blob instruction as
+ * is available within the given buffer, passing the decoded data to the
+ * parser's blob handler. Until the end of the content and its terminating
+ * semicolon are available, only complete groups of four base64 characters are
+ * decoded. Once the final chunk has been handled, the parser is reset such
+ * that the next instruction may be read. Base64 content consists only of
+ * ASCII, thus each byte is treated as one character.
+ *
+ * @param parser
+ *     The parser whose current element is being streamed.
+ *
+ * @param buffer
+ *     The buffer containing the content of the current element. This buffer
+ *     will be overwritten with the decoded data.
+ *
+ * @param length
+ *     The number of bytes available within the buffer.
+ *
+ * @return
+ *     The number of bytes consumed, which may be zero if more data is needed
+ *     or an error occurs.
+ */
+static int guac_parser_stream_blob(guac_parser* parser, char* buffer,
+        int length) {
+
+    int remaining = parser->__element_length;
+    int final = length > remaining;
+    int consumed;
+    int decoded;
+
+    /* Decode only whole groups of characters until the end is reached */
+    if (final)
+        consumed = remaining;
+    else
+        consumed = length & ~0x3;
+
+    if (consumed == 0 && !final)
+        return 0;
+
+    /* Blob instructions have no further elements */
+    if (final && buffer[consumed] != ';') {
+        parser->state = GUAC_PARSE_ERROR;
+        return 0;
+    }
+
+    decoded = guac_base64_decode(buffer, consumed, (unsigned char*) buffer);
+
+    /* Pass decoded chunk to handler, aborting on failure */
+    if (parser->blob_handler(parser, parser->__blob_stream_index,
+                buffer, decoded, final)) {
+        parser->__blob_failed = 1;
+        parser->state = GUAC_PARSE_ERROR;
+        return 0;
+    }
+
+    parser->__element_length -= consumed;
+
+    /* Consume terminator, moving on to next instruction */
+    if (final) {
+        guac_parser_reset(parser);
+        consumed++;
+    }
+
+    return consumed;
+
+}
+
+/**
+ * Advances past as many complete characters of the current element's content
+ * as are available within the given buffer, up to the number of characters
+ * remaining in the element. The remaining length of the element is updated
+ * accordingly. Whole blocks of ASCII are skipped at once where SIMD is
+ * available, as the character count of such a block is simply its length in
+ * bytes. Blocks containing multibyte characters are walked one character at a
+ * time, exactly as guac_utf8_charsize() would define them.
+ *
+ * @param parser
+ *     The parser whose current element is being read.
+ *
+ * @param buffer
+ *     The buffer containing the content of the current element.
+ *
+ * @param length
+ *     The number of bytes available within the buffer.
+ *
+ * @return
+ *     The number of bytes skipped, which will not include any partial
+ *     character at the end of the buffer.
+ */
+static int guac_parser_skip_content(guac_parser* parser, char* buffer,
+        int length) {
+
+    char* current = buffer;
+    char* end = buffer + length;
+    int remaining = parser->__element_length;
+
+    while (remaining > 0 && current < end) {
+
+        char* block_end = end;
+
+#ifdef __SSE2__
+        if (remaining >= 16 && end - current >= 16) {
+
+            /* Skip entire block if every byte is ASCII */
+            __m128i block = _mm_loadu_si128((__m128i*) current);
+            if (_mm_movemask_epi8(block) == 0) {
+                current += 16;
+                remaining -= 16;
+                continue;
+            }
+
+            /* Otherwise, walk only this block before trying again */
+            block_end = current + 16;
+
+        }
+#endif
+
+        while (remaining > 0 && current < block_end) {
+
+            /* Stop if full character not present in buffer */
+            int char_length = guac_utf8_charsize((unsigned char) *current);
+            if (char_length > end - current) {
+                parser->__element_length = remaining;
+                return current - buffer;
+            }
+
+            current += char_length;
+            remaining--;
+
+        }
+
+    }
+
+    parser->__element_length = remaining;
+    return current - buffer;
+
 }
 
 guac_parser* guac_parser_alloc() {
@@ -53,6 +216,10 @@ guac_parser* guac_parser_alloc() {
     parser->__instructionbuf_unparsed_start = parser->__instructionbuf;
     parser->__instructionbuf_unparsed_end = parser->__instructionbuf;
 
+    parser->blob_handler = NULL;
+    parser->data = NULL;
+    parser->__blob_failed = 0;
+
     guac_parser_reset(parser);
     return parser;
 
@@ -74,6 +241,12 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
     if (parser->state == GUAC_PARSE_LENGTH) {
 
         int parsed_length = parser->__element_length;
+
+        /* Streamed blob content may exceed the usual maximum length */
+        int streaming = guac_parser_is_blob_content(parser);
+        int max_length = streaming ? GUAC_PARSER_MAX_BLOB_LENGTH
+                                   : GUAC_INSTRUCTION_MAX_LENGTH;
+
         while (bytes_parsed < length) {
 
             /* Pull next character */
@@ -81,12 +254,32 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
             bytes_parsed++;
 
             /* If digit, add to length */
-            if (c >= '0' && c <= '9')
+            if (c >= '0' && c <= '9') {
+
                 parsed_length = parsed_length*10 + c - '0';
 
+                /* Fail before length can overflow */
+                if (parsed_length > max_length) {
+                    parser->state = GUAC_PARSE_ERROR;
+                    return 0;
+                }
+
+            }
+
             /* If period, switch to parsing content */
             else if (c == '.') {
-                parser->__elementv[parser->__elementc++] = char_buffer;
+
+                /* Stream blob content rather than buffering it, retaining
+                 * only the stream index */
+                if (streaming) {
+                    parser->__blob_streaming = 1;
+                    parser->__blob_stream_index = atoi(parser->__elementv[1]);
+                    parser->__elementc = 0;
+                }
+
+                else
+                    parser->__elementv[parser->__elementc++] = char_buffer;
+
                 parser->state = GUAC_PARSE_CONTENT;
                 break;
             }
@@ -99,66 +292,53 @@ int guac_parser_append(guac_parser* parser, void* buffer, int length) {
 
         }
 
-        /* If too long, parse error */
-        if (parsed_length > GUAC_INSTRUCTION_MAX_LENGTH) {
-            parser->state = GUAC_PARSE_ERROR;
-            return 0;
-        }
-
         /* Save length */
         parser->__element_length = parsed_length;
 
     } /* end parse length */
 
+    /* Stream blob content directly to handler */
+    if (parser->state == GUAC_PARSE_CONTENT && parser->__blob_streaming)
+        return bytes_parsed + guac_parser_stream_blob(parser, char_buffer,
+                length - bytes_parsed);
+
     /* Parse element content */
     if (parser->state == GUAC_PARSE_CONTENT) {
 
-        while (bytes_parsed < length && parser->__element_length >= 0) {
+        /* Skip all available content of current element */
+        int skipped = guac_parser_skip_content(parser, char_buffer,
+                length - bytes_parsed);
 
-            /* Get length of current character */
-            char c = *char_buffer;
-            int char_length = guac_utf8_charsize((unsigned char) c);
+        char_buffer += skipped;
+        bytes_parsed += skipped;
 
-            /* If full character not present in buffer, stop now */
-            if (char_length + bytes_parsed > length)
-                break;
+        /* If end of element, handle terminator */
+        if (parser->__element_length == 0 && bytes_parsed < length) {
 
-            /* Record character as parsed */
-            bytes_parsed += char_length;
-
-            /* If end of element, handle terminator */
-            if (parser->__element_length == 0) {
-
-                *char_buffer = '\0';
-
-                /* If semicolon, store end-of-instruction */
-                if (c == ';') {
-                    parser->state = GUAC_PARSE_COMPLETE;
-                    parser->opcode = parser->__elementv[0];
-                    parser->argv = &(parser->__elementv[1]);
-                    parser->argc = parser->__elementc - 1;
-                    break;
-                }
-
-                /* If comma, move on to next element */
-                else if (c == ',') {
-                    parser->state = GUAC_PARSE_LENGTH;
-                    break;
-                }
+            /* Pull terminator */
+            char c = *char_buffer;
+            *char_buffer = '\0';
+            bytes_parsed++;
 
-                /* Otherwise, parse error */
-                else {
-                    parser->state = GUAC_PARSE_ERROR;
-                    return 0;
-                }
+            /* If semicolon, store end-of-instruction */
+            if (c == ';') {
+                parser->state = GUAC_PARSE_COMPLETE;
+                parser->opcode = parser->__elementv[0];
+                parser->argv = &(parser->__elementv[1]);
+                parser->argc = parser->__elementc - 1;
+            }
 
-            } /* end if end of element */
+            /* If comma, move on to next element */
+            else if (c == ',')
+                parser->state = GUAC_PARSE_LENGTH;
 
-            /* Advance to next character */
-            parser->__element_length--;
-            char_buffer += char_length;
+            /* Otherwise, parse error */
+            else {
+                parser->state = GUAC_PARSE_ERROR;
+                return 0;
+            }
 
-        }
+        } /* end if end of element */
 
     } /* end parse content */
 
@@ -221,6 +401,10 @@ int guac_parser_read(guac_parser* parser, guac_socket* socket, int usec_timeout)
 
             }
 
+            /* Preserve buffer state in case read fails or times out */
+            parser->__instructionbuf_unparsed_start = unparsed_start;
+            parser->__instructionbuf_unparsed_end = unparsed_end;
+
             /* No instruction yet? Get more data ... */
             retval = guac_socket_select(socket, usec_timeout);
             if (retval <= 0)
@@ -251,13 +435,25 @@ int guac_parser_read(guac_parser* parser, guac_socket* socket, int usec_timeout)
         }
 
         /* If data was parsed, advance buffer */
-        else
+        else {
+
             unparsed_start += parsed;
 
+            /* Data already parsed need not be retained if no elements
+             * reference it, as is the case for streamed blobs */
+            if (parser->__elementc == 0)
+                instr_start = unparsed_start;
+
+        }
+
     } /* end while parsing data */
 
-    /* Fail on error */
+    /* Fail on error, preserving any error set by the blob handler */
     if (parser->state == GUAC_PARSE_ERROR) {
+
+        if (parser->__blob_failed)
+            return -1;
+
         guac_error = GUAC_STATUS_PROTOCOL_ERROR;
         guac_error_message = "Instruction parse error";
         return -1;
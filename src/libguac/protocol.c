@@ -22,6 +22,8 @@
 
 #include "config.h"
 
+#include "base64.h"
+#include "decimal.h"
 #include "error.h"
 #include "layer.h"
 #include "object.h"
@@ -45,20 +47,84 @@
 
 /* Output formatting functions */
 
+/**
+ * The size of the buffer used to format instructions consisting of a fixed
+ * number of integer arguments, each of which occupies at most
+ * GUAC_DECIMAL_MAX_ELEMENT_LENGTH characters plus a separator. This is
+ * sufficient for the opcode and up to sixteen such arguments.
+ */
+#define GUAC_PROTOCOL_INT_INSTRUCTION_SIZE \
+    (32 + 16 * (GUAC_DECIMAL_MAX_ELEMENT_LENGTH + 1))
+
+/**
+ * Formats the given integer as a length-prefixed element followed by the
+ * given separator, returning a pointer to the character following the
+ * separator.
+ */
+static char* __guac_protocol_format_int(char* buffer, int64_t i,
+        char separator) {
+
+    buffer += guac_decimal_format_element(buffer, i);
+    *(buffer++) = separator;
+    return buffer;
+
+}
+
+/**
+ * Writes an entire instruction whose arguments are all integers using a
+ * single buffered write. The opcode must be given as its complete,
+ * length-prefixed element including the trailing comma, as produced by
+ * __guac_protocol_send_ints().
+ */
+static int __guac_protocol_send_int_instruction(guac_socket* socket,
+        const char* opcode, int opcode_length,
+        const int64_t* args, int argc) {
+
+    char buffer[GUAC_PROTOCOL_INT_INSTRUCTION_SIZE];
+    char* current = buffer + opcode_length;
+    int i;
+    int ret_val;
+
+    memcpy(buffer, opcode, opcode_length);
+
+    for (i = 0; i < argc; i++)
+        current = __guac_protocol_format_int(current, args[i],
+                i + 1 < argc ? ',' : ';');
+
+    guac_socket_instruction_begin(socket);
+    ret_val = guac_socket_write_buffered(socket, buffer, current - buffer);
+    guac_socket_instruction_end(socket);
+
+    return ret_val;
+
+}
+
+/**
+ * Writes an instruction consisting of the given opcode element (a string
+ * literal such as "4.copy,") and the given array of int64_t arguments. The
+ * lengths of both are determined at compile time.
+ */
+#define __guac_protocol_send_ints(socket, opcode, args)                       \
+    __guac_protocol_send_int_instruction(socket, opcode, sizeof(opcode) - 1, \
+            args, sizeof(args) / sizeof(args[0]))
+
 ssize_t __guac_socket_write_length_string(guac_socket* socket, const char* str) {
 
+    char prefix[GUAC_DECIMAL_MAX_LENGTH + 1];
+    int length = guac_decimal_format(prefix, guac_utf8_strlen(str));
+    prefix[length++] = '.';
+
     return
-           guac_socket_write_int(socket, guac_utf8_strlen(str))
-        || guac_socket_write_string(socket, ".")
+           guac_socket_write_buffered(socket, prefix, length)
         || guac_socket_write_string(socket, str);
 
 }
 
 ssize_t __guac_socket_write_length_int(guac_socket* socket, int64_t i) {
 
-    char buffer[128];
-    snprintf(buffer, sizeof(buffer), "%"PRIi64, i);
-    return __guac_socket_write_length_string(socket, buffer);
+    char buffer[GUAC_DECIMAL_MAX_ELEMENT_LENGTH];
+    int length = guac_decimal_format_element(buffer, i);
+    return guac_socket_write_buffered(socket, buffer, length);
 
 }
 
@@ -174,17 +240,24 @@ int guac_protocol_send_audio(guac_socket* socket, const guac_stream* stream,
 int guac_protocol_send_blob(guac_socket* socket, const guac_stream* stream,
         const void* data, int count) {
 
-    int base64_length = (count + 2) / 3 * 4;
-
+    char header[GUAC_PROTOCOL_INT_INSTRUCTION_SIZE];
+    char* current = header;
     int ret_val;
 
-    guac_socket_instruction_begin(socket);
+    /* Format opcode, stream index, and length prefix of data in one pass */
+    memcpy(current, "4.blob,", 7);
+    current = __guac_protocol_format_int(current + 7, stream->index, ',');
+    current += guac_decimal_format(current, (count + 2) / 3 * 4);
+    *(current++) = '.';
+
+    /* Defer blobs of bulk transfers behind all other output */
+    if (stream->priority == GUAC_STREAM_PRIORITY_BULK)
+        guac_socket_instruction_begin_bulk(socket);
+    else
+        guac_socket_instruction_begin(socket);
+
     ret_val =
-           guac_socket_write_string(socket, "4.blob,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || guac_socket_write_int(socket, base64_length)
-        || guac_socket_write_string(socket, ".")
+           guac_socket_write_buffered(socket, header, current - header)
         || guac_socket_write_base64(socket, data, count)
         || guac_socket_flush_base64(socket)
         || guac_socket_write_string(socket, ";");
@@ -220,26 +293,8 @@ int guac_protocol_send_cfill(guac_socket* socket,
         guac_composite_mode mode, const guac_layer* layer,
         int r, int g, int b, int a) {
 
-    int ret_val;
-
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "5.cfill,")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, r)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, g)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, b)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, a)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    int64_t args[] = { mode, layer->index, r, g, b, a };
+    return __guac_protocol_send_ints(socket, "5.cfill,", args);
 
 }
 
@@ -327,32 +382,12 @@ int guac_protocol_send_copy(guac_socket* socket,
         const guac_layer* srcl, int srcx, int srcy, int w, int h,
         guac_composite_mode mode, const guac_layer* dstl, int dstx, int dsty) {
 
-    int ret_val;
-
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.copy,")
-        || __guac_socket_write_length_int(socket, srcl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcy)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, w)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, h)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dsty)
-        || guac_socket_write_string(socket, ";");
+    int64_t args[] = {
+        srcl->index, srcx, srcy, w, h,
+        mode, dstl->index, dstx, dsty
+    };
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_send_ints(socket, "4.copy,", args);
 
 }
 
@@ -503,6 +538,11 @@ int guac_protocol_send_end(guac_socket* socket, const guac_stream* stream) {
 
     int ret_val;
 
+    /* The end of a bulk transfer must not overtake its deferred blobs */
+    if (stream->priority == GUAC_STREAM_PRIORITY_BULK
+            && guac_socket_flush_bulk(socket))
+        return -1;
+
     guac_socket_instruction_begin(socket);
     ret_val =
            guac_socket_write_string(socket, "3.end,")
@@ -781,23 +821,29 @@ int guac_protocol_send_img(guac_socket* socket, const guac_stream* stream,
         guac_composite_mode mode, const guac_layer* layer,
         const char* mimetype, int x, int y) {
 
+    char buffer[GUAC_PROTOCOL_INT_INSTRUCTION_SIZE];
+    char* current;
     int ret_val;
 
+    /* Format all integer arguments preceding the mimetype */
+    memcpy(buffer, "3.img,", 6);
+    current = __guac_protocol_format_int(buffer + 6, stream->index, ',');
+    current = __guac_protocol_format_int(current, mode, ',');
+    current = __guac_protocol_format_int(current, layer->index, ',');
+
     guac_socket_instruction_begin(socket);
     ret_val =
-           guac_socket_write_string(socket, "3.img,")
-        || __guac_socket_write_length_int(socket, stream->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, mode)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_string(socket, mimetype)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ";");
+           guac_socket_write_buffered(socket, buffer, current - buffer)
+        || __guac_socket_write_length_string(socket, mimetype);
+
+    /* Format all integer arguments following the mimetype */
+    if (!ret_val) {
+        current = buffer;
+        *(current++) = ',';
+        current = __guac_protocol_format_int(current, x, ',');
+        current = __guac_protocol_format_int(current, y, ';');
+        ret_val = guac_socket_write_buffered(socket, buffer, current - buffer);
+    }
 
     guac_socket_instruction_end(socket);
     return ret_val;
@@ -852,24 +898,8 @@ int guac_protocol_send_ready(guac_socket* socket, const char* id) {
 int guac_protocol_send_rect(guac_socket* socket,
         const guac_layer* layer, int x, int y, int width, int height) {
 
-    int ret_val;
-
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "4.rect,")
-        || __guac_socket_write_length_int(socket, layer->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, x)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, y)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, width)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, height)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    int64_t args[] = { layer->index, x, y, width, height };
+    return __guac_protocol_send_ints(socket, "4.rect,", args);
 
 }
 
@@ -983,16 +1013,8 @@ int guac_protocol_send_start(guac_socket* socket, const guac_layer* layer,
 
 int guac_protocol_send_sync(guac_socket* socket, guac_timestamp timestamp) {
 
-    int ret_val;
-
-    guac_socket_instruction_begin(socket);
-    ret_val = 
-           guac_socket_write_string(socket, "4.sync,")
-        || __guac_socket_write_length_int(socket, timestamp)
-        || guac_socket_write_string(socket, ";");
-
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    int64_t args[] = { timestamp };
+    return __guac_protocol_send_ints(socket, "4.sync,", args);
 
 }
 
@@ -1000,32 +1022,12 @@ int guac_protocol_send_transfer(guac_socket* socket,
         const guac_layer* srcl, int srcx, int srcy, int w, int h,
         guac_transfer_function fn, const guac_layer* dstl, int dstx, int dsty) {
 
-    int ret_val;
-
-    guac_socket_instruction_begin(socket);
-    ret_val =
-           guac_socket_write_string(socket, "8.transfer,")
-        || __guac_socket_write_length_int(socket, srcl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, srcy)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, w)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, h)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, fn)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstl->index)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dstx)
-        || guac_socket_write_string(socket, ",")
-        || __guac_socket_write_length_int(socket, dsty)
-        || guac_socket_write_string(socket, ";");
+    int64_t args[] = {
+        srcl->index, srcx, srcy, w, h,
+        fn, dstl->index, dstx, dsty
+    };
 
-    guac_socket_instruction_end(socket);
-    return ret_val;
+    return __guac_protocol_send_ints(socket, "8.transfer,", args);
 
 }
 
@@ -1094,62 +1096,11 @@ int guac_protocol_send_video(guac_socket* socket, const guac_stream* stream,
 
 }
 
-/**
- * Returns the value of a single base64 character.
- */
-static int __guac_base64_value(char c) {
-
-    if (c >= 'A' && c <= 'Z')
-        return c - 'A';
-
-    if (c >= 'a' && c <= 'z')
-        return c - 'a' + 26;
-
-    if (c >= '0' && c <= '9')
-        return c - '0' + 52;
-
-    if (c == '+')
-        return 62;
-
-    if (c == '/')
-        return 63;
-
-    return 0;
-
-}
-
 int guac_protocol_decode_base64(char* base64) {
 
-    char* input = base64;
-    char* output = base64;
-
-    int length = 0;
-    int bits_read = 0;
-    int value = 0;
-    char current;
-
-    /* For all characters in string */
-    while ((current = *(input++)) != 0) {
-
-        /* If we've reached padding, then we're done */
-        if (current == '=')
-            break;
-
-        /* Otherwise, shift on the latest 6 bits */
-        value = (value << 6) | __guac_base64_value(current);
-        bits_read += 6;
-
-        /* If we have at least one byte, write out the latest whole byte */
-        if (bits_read >= 8) {
-            *(output++) = (value >> (bits_read % 8)) & 0xFF;
-            bits_read -= 8;
-            length++;
-        }
-
-    }
-
-    /* Return number of bytes written */
-    return length;
+    /* Decode in-place, stopping at the end of the string or padding */
+    return guac_base64_decode(base64, strlen(base64),
+            (unsigned char*) base64);
 
 }
 
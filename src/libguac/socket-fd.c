@@ -25,6 +25,7 @@
 #include "error.h"
 #include "socket.h"
 
+#include <errno.h>
 #include <stddef.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -34,7 +35,16 @@
 #ifdef __MINGW32__
 #include <winsock2.h>
 #else
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/ioctl.h>
 #include <sys/select.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#endif
+
+#ifdef HAVE_SIOCOUTQNSD
+#include <linux/sockios.h>
 #endif
 
 typedef struct __guac_socket_fd_data {
@@ -84,6 +94,114 @@ ssize_t __guac_socket_fd_write_handler(guac_socket* socket,
     return retval;
 }
 
+#ifndef __MINGW32__
+ssize_t __guac_socket_fd_writev_handler(guac_socket* socket,
+        const struct iovec* iov, int iovcnt) {
+
+    __guac_socket_fd_data* data = (__guac_socket_fd_data*) socket->data;
+
+    struct msghdr message = {
+        .msg_iov    = (struct iovec*) iov,
+        .msg_iovlen = iovcnt
+    };
+
+    /* Write all buffers with a single call, without waiting for room */
+    ssize_t retval = sendmsg(data->fd, &message, MSG_DONTWAIT);
+
+    /* Descriptors other than sockets can only be written normally */
+    if (retval < 0 && errno == ENOTSOCK)
+        retval = writev(data->fd, iov, iovcnt);
+
+    /* Report that nothing could be written if the socket is full */
+    else if (retval < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        return 0;
+
+    /* Record errors in guac_error */
+    if (retval < 0) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Error writing data to socket";
+    }
+
+    return retval;
+}
+
+int __guac_socket_fd_select_write_handler(guac_socket* socket,
+        int usec_timeout) {
+
+    __guac_socket_fd_data* data = (__guac_socket_fd_data*) socket->data;
+
+    fd_set fds;
+    struct timeval timeout;
+    int retval;
+
+    FD_ZERO(&fds);
+    FD_SET(data->fd, &fds);
+
+    /* No timeout if usec_timeout is negative */
+    if (usec_timeout < 0)
+        retval = select(data->fd + 1, NULL, &fds, NULL, NULL);
+
+    /* Handle timeout if specified */
+    else {
+        timeout.tv_sec = usec_timeout/1000000;
+        timeout.tv_usec = usec_timeout%1000000;
+        retval = select(data->fd + 1, NULL, &fds, NULL, &timeout);
+    }
+
+    /* Properly set guac_error */
+    if (retval <  0) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Error while waiting to write to socket";
+    }
+
+    if (retval == 0) {
+        guac_error = GUAC_STATUS_TIMEOUT;
+        guac_error_message = "Timeout while waiting to write to socket";
+    }
+
+    return retval;
+
+}
+#endif
+
+#ifdef HAVE_SIOCOUTQNSD
+ssize_t __guac_socket_fd_pending_handler(guac_socket* socket) {
+
+    __guac_socket_fd_data* data = (__guac_socket_fd_data*) socket->data;
+    int pending;
+
+    /* Query data not yet sent from the kernel's send buffer */
+    if (ioctl(data->fd, SIOCOUTQNSD, &pending))
+        return -1;
+
+    return pending;
+
+}
+#endif
+
+#if defined(HAVE_TCP_NOTSENT_LOWAT) || defined(HAVE_SIOCOUTQNSD)
+void __guac_socket_fd_nonblocking_handler(guac_socket* socket) {
+
+#ifdef HAVE_TCP_NOTSENT_LOWAT
+    __guac_socket_fd_data* data = (__guac_socket_fd_data*) socket->data;
+    int lowat = GUAC_SOCKET_NOTSENT_LOWAT;
+
+    /* Hold only a limited amount of unsent output within the kernel, such
+     * that output backs up within the guac_socket, where it can be measured
+     * and where the sender can react to it. This has no effect on
+     * descriptors other than TCP sockets. */
+    setsockopt(data->fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &lowat,
+            sizeof(lowat));
+#endif
+
+#ifdef HAVE_SIOCOUTQNSD
+    /* Account for output waiting within the kernel as part of the backlog */
+    socket->pending_handler = __guac_socket_fd_pending_handler;
+#endif
+
+}
+#endif
+
 int __guac_socket_fd_select_handler(guac_socket* socket, int usec_timeout) {
 
     __guac_socket_fd_data* data = (__guac_socket_fd_data*) socket->data;
@@ -137,6 +255,18 @@ guac_socket* guac_socket_open(int fd, int dump_flag, char* dump_path) {
     socket->write_handler  = __guac_socket_fd_write_handler;
     socket->select_handler = __guac_socket_fd_select_handler;
 
+#ifndef __MINGW32__
+    /* Flush all pending output with a single writev() where available */
+    socket->writev_handler = __guac_socket_fd_writev_handler;
+    socket->select_write_handler = __guac_socket_fd_select_write_handler;
+#endif
+
+#if defined(HAVE_TCP_NOTSENT_LOWAT) || defined(HAVE_SIOCOUTQNSD)
+    /* Hold less unsent output within the kernel, and account for that
+     * output, only once non-blocking */
+    socket->nonblocking_handler = __guac_socket_fd_nonblocking_handler;
+#endif
+
     return socket;
 
 }
@@ -22,18 +22,23 @@
 
 #include "config.h"
 
+#include "base64.h"
+#include "decimal.h"
 #include "error.h"
 #include "protocol.h"
 #include "socket.h"
 #include "timestamp.h"
 #include "client.h"
 
+#include <errno.h>
 #include <inttypes.h>
 #include <pthread.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -45,6 +50,50 @@ char __guac_socket_BASE64_CHARACTERS[64] = {
     '8', '9', '+', '/'
 };
 
+/**
+ * Encodes the given triplet of bytes as four base64 characters, padding as
+ * necessary if the triplet is incomplete.
+ *
+ * @param output
+ *     The buffer which should receive the four base64 characters.
+ *
+ * @param a
+ *     The first byte of the triplet.
+ *
+ * @param b
+ *     The second byte of the triplet, or -1 if the triplet contains only one
+ *     byte.
+ *
+ * @param c
+ *     The third byte of the triplet, or -1 if the triplet contains fewer than
+ *     three bytes.
+ */
+static void __guac_socket_encode_base64_triplet(char* output,
+        int a, int b, int c) {
+
+    /* Byte 1 */
+    output[0] = __guac_socket_BASE64_CHARACTERS[(a & 0xFC) >> 2]; /* [AAAAAA]AABBBB BBBBCC CCCCCC */
+
+    if (b >= 0) {
+        output[1] = __guac_socket_BASE64_CHARACTERS[((a & 0x03) << 4) | ((b & 0xF0) >> 4)]; /* AAAAAA[AABBBB]BBBBCC CCCCCC */
+
+        if (c >= 0) {
+            output[2] = __guac_socket_BASE64_CHARACTERS[((b & 0x0F) << 2) | ((c & 0xC0) >> 6)]; /* AAAAAA AABBBB[BBBBCC]CCCCCC */
+            output[3] = __guac_socket_BASE64_CHARACTERS[c & 0x3F]; /* AAAAAA AABBBB BBBBCC[CCCCCC] */
+        }
+        else { 
+            output[2] = __guac_socket_BASE64_CHARACTERS[((b & 0x0F) << 2)]; /* AAAAAA AABBBB[BBBB--]------ */
+            output[3] = '='; /* AAAAAA AABBBB BBBB--[------] */
+        }
+    }
+    else {
+        output[1] = __guac_socket_BASE64_CHARACTERS[((a & 0x03) << 4)]; /* AAAAAA[AA----]------ ------ */
+        output[2] = '='; /* AAAAAA AA----[------]------ */
+        output[3] = '='; /* AAAAAA AA---- ------[------] */
+    }
+
+}
+
 static void* __guac_socket_keep_alive_thread(void* data) {
 
     /* Calculate sleep interval */
@@ -75,140 +124,1446 @@ static void* __guac_socket_keep_alive_thread(void* data) {
 
     return NULL;
 
-}
+}
+
+static ssize_t __guac_socket_write(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    /* Update timestamp of last write */
+    socket->last_write_timestamp = guac_timestamp_current();
+
+    /* If handler defined, call it. Otherwise, pretend everything was
+     * written. */
+    ssize_t written = count;
+    if (socket->write_handler)
+        written = socket->write_handler(socket, buf, count);
+
+    /* Track total output */
+    if (written > 0)
+        socket->bytes_written += written;
+
+    return written;
+
+}
+
+/**
+ * Advances the given array of buffers past the given number of bytes,
+ * skipping all buffers which have been completely written and adjusting the
+ * first buffer which has been only partially written.
+ *
+ * @param iov
+ *     Pointer to the first buffer not yet completely written. This pointer is
+ *     updated to point to the first buffer not completely written after the
+ *     given number of bytes.
+ *
+ * @param iovcnt
+ *     Pointer to the number of buffers remaining, which is updated to
+ *     exclude all completely-written buffers.
+ *
+ * @param written
+ *     The number of bytes written.
+ */
+static void __guac_socket_advance_iov(struct iovec** iov, int* iovcnt,
+        size_t written) {
+
+    struct iovec* current = *iov;
+
+    /* Skip past all completely-written buffers */
+    while (*iovcnt > 0 && written >= current->iov_len) {
+        written -= current->iov_len;
+        current++;
+        (*iovcnt)--;
+    }
+
+    /* Advance within any partially-written buffer */
+    if (*iovcnt > 0) {
+        current->iov_base = (char*) current->iov_base + written;
+        current->iov_len -= written;
+    }
+
+    *iov = current;
+
+}
+
+/**
+ * Appends the given data to the end of the backlog of the given non-blocking
+ * socket, growing the backlog as necessary. The backlog lock must already be
+ * held.
+ *
+ * @param socket
+ *     The guac_socket whose backlog should receive the data.
+ *
+ * @param buf
+ *     The data to append.
+ *
+ * @param count
+ *     The number of bytes to append.
+ *
+ * @return
+ *     Zero on success, or non-zero if memory could not be allocated.
+ */
+static int __guac_socket_backlog_append(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    size_t size = socket->__backlog_size;
+
+    /* Reclaim space before any data already written */
+    if (socket->__backlog_start > 0) {
+        memmove(socket->__backlog, socket->__backlog + socket->__backlog_start,
+                socket->__backlog_length);
+        socket->__backlog_start = 0;
+    }
+
+    /* Grow by doubling */
+    if (socket->__backlog_length + count > size) {
+
+        char* backlog;
+
+        if (size == 0)
+            size = GUAC_SOCKET_OUTPUT_BUFFER_SIZE;
+
+        while (socket->__backlog_length + count > size)
+            size *= 2;
+
+        backlog = realloc(socket->__backlog, size);
+        if (backlog == NULL)
+            return 1;
+
+        socket->__backlog = backlog;
+        socket->__backlog_size = size;
+
+    }
+
+    memcpy(socket->__backlog + socket->__backlog_length, buf, count);
+    socket->__backlog_length += count;
+    return 0;
+
+}
+
+/**
+ * Writes the given buffers to the given non-blocking socket, writing as much
+ * as possible immediately and queueing the remainder within the socket's
+ * backlog. Data is written immediately only if the backlog is empty, such
+ * that output is never reordered. If the backlog grows beyond
+ * GUAC_SOCKET_MAX_BACKLOG bytes, this function blocks until the backlog has
+ * drained below that size.
+ *
+ * @param socket
+ *     The non-blocking guac_socket to write to.
+ *
+ * @param iov
+ *     The buffers to write, in order. The contents of this array are
+ *     modified as data is written.
+ *
+ * @param iovcnt
+ *     The number of buffers in the iov array.
+ *
+ * @return
+ *     Zero on success, or non-zero if an error occurs while writing.
+ */
+static int __guac_socket_write_nonblocking(guac_socket* socket,
+        struct iovec* iov, int iovcnt) {
+
+    int queued = 0;
+    int i;
+
+    pthread_mutex_lock(&(socket->__backlog_lock));
+
+    /* Update timestamp of last write */
+    socket->last_write_timestamp = guac_timestamp_current();
+
+    /* Write directly only if nothing is waiting to be written first */
+    if (socket->__backlog_length == 0 && !socket->__backlog_error) {
+
+        ssize_t written = socket->writev_handler(socket, iov, iovcnt);
+        if (written == -1) {
+            pthread_mutex_unlock(&(socket->__backlog_lock));
+            return 1;
+        }
+
+        socket->bytes_written += written;
+        __guac_socket_advance_iov(&iov, &iovcnt, written);
+
+    }
+
+    /* Queue everything which could not be written */
+    for (i = 0; i < iovcnt && !socket->__backlog_error; i++) {
+
+        if (__guac_socket_backlog_append(socket, iov[i].iov_base,
+                    iov[i].iov_len)) {
+            pthread_mutex_unlock(&(socket->__backlog_lock));
+            guac_error = GUAC_STATUS_NO_MEMORY;
+            guac_error_message = "Could not queue data for writing";
+            return 1;
+        }
+
+        queued = 1;
+
+    }
+
+    /* Wake writer thread if there is anything new to write */
+    if (queued)
+        pthread_cond_broadcast(&(socket->__backlog_modified));
+
+    /* Block only once the backlog is too large */
+    while (socket->__backlog_length > GUAC_SOCKET_MAX_BACKLOG
+            && !socket->__backlog_error)
+        pthread_cond_wait(&(socket->__backlog_modified),
+                &(socket->__backlog_lock));
+
+    /* Report any failure of the writer thread */
+    if (socket->__backlog_error) {
+        pthread_mutex_unlock(&(socket->__backlog_lock));
+        guac_error = GUAC_STATUS_IO_ERROR;
+        guac_error_message = "Error writing queued data to socket";
+        return 1;
+    }
+
+    pthread_mutex_unlock(&(socket->__backlog_lock));
+    return 0;
+
+}
+
+/**
+ * Appends the given data to the deferred bulk output of the given socket,
+ * growing the buffer as necessary. The backlog lock must already be held.
+ *
+ * @param socket
+ *     The guac_socket whose deferred bulk output should receive the data.
+ *
+ * @param buf
+ *     The data to append.
+ *
+ * @param count
+ *     The number of bytes to append.
+ *
+ * @return
+ *     Zero on success, or non-zero if memory could not be allocated.
+ */
+static int __guac_socket_bulk_append(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    size_t size = socket->__bulk_size;
+
+    /* Grow by doubling */
+    if (socket->__bulk_length + count > size) {
+
+        char* bulk;
+
+        if (size == 0)
+            size = GUAC_SOCKET_OUTPUT_BUFFER_SIZE;
+
+        while (socket->__bulk_length + count > size)
+            size *= 2;
+
+        bulk = realloc(socket->__bulk, size);
+        if (bulk == NULL) {
+            guac_error = GUAC_STATUS_NO_MEMORY;
+            guac_error_message = "Could not defer bulk output";
+            return 1;
+        }
+
+        socket->__bulk = bulk;
+        socket->__bulk_size = size;
+
+    }
+
+    memcpy(socket->__bulk + socket->__bulk_length, buf, count);
+    socket->__bulk_length += count;
+    return 0;
+
+}
+
+/**
+ * Moves all deferred bulk output of the given non-blocking socket into its
+ * backlog, such that the writer thread writes that output next, unless other
+ * output is still waiting to be sent and the release is not forced. Deferred
+ * output is discarded if the socket has failed, such that threads waiting
+ * for room to defer further output are never blocked indefinitely. The
+ * backlog lock must already be held.
+ *
+ * @param socket
+ *     The non-blocking guac_socket whose deferred bulk output should be
+ *     queued.
+ *
+ * @param force
+ *     Non-zero if deferred bulk output should be queued even if other
+ *     output is still waiting to be sent, zero otherwise.
+ */
+static void __guac_socket_queue_bulk(guac_socket* socket, int force) {
+
+    /* Nothing to do if no bulk output is deferred */
+    if (socket->__bulk_length == 0)
+        return;
+
+    /* Continue deferring while other output remains */
+    if (!force && socket->__backlog_length > 0 && !socket->__backlog_error)
+        return;
+
+    /* Deferred output cannot be written if the socket has failed */
+    if (!socket->__backlog_error) {
+        if (__guac_socket_backlog_append(socket, socket->__bulk,
+                    socket->__bulk_length))
+            socket->__backlog_error = 1;
+    }
+
+    socket->__bulk_length = 0;
+    pthread_cond_broadcast(&(socket->__bulk_released));
+    pthread_cond_broadcast(&(socket->__backlog_modified));
+
+}
+
+/**
+ * Releases all deferred bulk output of the given non-blocking socket to the
+ * writer thread, unless other output is still waiting to be sent and the
+ * release is not forced. The buffer lock must already be held, such that
+ * output written afterwards follows the released output.
+ *
+ * @param socket
+ *     The non-blocking guac_socket whose deferred bulk output should be
+ *     released.
+ *
+ * @param force
+ *     Non-zero if deferred bulk output should be released even if other
+ *     output is still waiting to be sent, zero otherwise.
+ *
+ * @return
+ *     Zero on success, or non-zero if the socket has failed.
+ */
+static int __guac_socket_release_bulk(guac_socket* socket, int force) {
+
+    int failed;
+
+    pthread_mutex_lock(&(socket->__backlog_lock));
+    __guac_socket_queue_bulk(socket, force);
+    failed = socket->__backlog_error;
+    pthread_mutex_unlock(&(socket->__backlog_lock));
+
+    if (failed) {
+        guac_error = GUAC_STATUS_IO_ERROR;
+        guac_error_message = "Error writing queued data to socket";
+        return 1;
+    }
+
+    return 0;
+
+}
+
+/**
+ * Waits while GUAC_SOCKET_MAX_BULK or more bytes of bulk output are deferred
+ * within the given non-blocking socket. The buffer lock must not be held,
+ * such that other output is not held up while waiting.
+ *
+ * @param socket
+ *     The non-blocking guac_socket to wait for.
+ */
+static void __guac_socket_wait_bulk(guac_socket* socket) {
+
+    pthread_mutex_lock(&(socket->__backlog_lock));
+
+    while (socket->__bulk_length >= GUAC_SOCKET_MAX_BULK)
+        pthread_cond_wait(&(socket->__bulk_released),
+                &(socket->__backlog_lock));
+
+    pthread_mutex_unlock(&(socket->__backlog_lock));
+
+}
+
+/**
+ * Discards the backlog of the given non-blocking socket after the backlog
+ * could not be written, failing all further writes. The backlog lock must
+ * already be held.
+ *
+ * @param socket
+ *     The non-blocking guac_socket whose backlog should be discarded.
+ */
+static void __guac_socket_drop_backlog(guac_socket* socket) {
+
+    socket->__backlog_error = 1;
+    socket->__backlog_start = 0;
+    socket->__backlog_length = 0;
+    pthread_cond_broadcast(&(socket->__backlog_modified));
+
+}
+
+/**
+ * Writes the backlog of the given non-blocking socket as the connection
+ * drains, waiting for room to write without holding the backlog lock, such
+ * that further output can be queued in the meantime. The thread exits once
+ * __writer_running is cleared.
+ *
+ * @param data
+ *     The non-blocking guac_socket whose backlog should be written.
+ *
+ * @return
+ *     Always NULL.
+ */
+static void* __guac_socket_writer_thread(void* data) {
+
+    guac_socket* socket = (guac_socket*) data;
+
+    pthread_mutex_lock(&(socket->__backlog_lock));
+    while (socket->__writer_running) {
+
+        struct iovec iov;
+        ssize_t written;
+        int ready;
+
+        /* Wait for data to write */
+        if (socket->__backlog_length == 0) {
+            pthread_cond_wait(&(socket->__backlog_modified),
+                    &(socket->__backlog_lock));
+            continue;
+        }
+
+        iov.iov_base = socket->__backlog + socket->__backlog_start;
+        iov.iov_len = socket->__backlog_length;
+
+        /* On error, discard the backlog, failing all further writes */
+        written = socket->writev_handler(socket, &iov, 1);
+        if (written == -1) {
+            __guac_socket_drop_backlog(socket);
+            __guac_socket_queue_bulk(socket, 0);
+            continue;
+        }
+
+        /* Release space of everything written */
+        if (written > 0) {
+
+            socket->bytes_written += written;
+            socket->__backlog_start += written;
+            socket->__backlog_length -= written;
+            pthread_cond_broadcast(&(socket->__backlog_modified));
+
+            /* Send deferred bulk output once all other output is sent */
+            __guac_socket_queue_bulk(socket, 0);
+
+            continue;
+
+        }
+
+        /* Wait for room to write without blocking other writes */
+        pthread_mutex_unlock(&(socket->__backlog_lock));
+        ready = socket->select_write_handler(socket,
+                GUAC_SOCKET_WRITE_TIMEOUT * 1000);
+        pthread_mutex_lock(&(socket->__backlog_lock));
+
+        /* Give up on clients which have stopped reading entirely */
+        if (ready == 0) {
+            socket->state = GUAC_SOCKET_CLOSED;
+            __guac_socket_drop_backlog(socket);
+            __guac_socket_queue_bulk(socket, 0);
+        }
+
+    }
+    pthread_mutex_unlock(&(socket->__backlog_lock));
+
+    return NULL;
+
+}
+
+/**
+ * Waits for the backlog of the given non-blocking socket to be completely
+ * written, or for writing to fail, and stops the socket's writer thread. If
+ * the backlog is not written within GUAC_SOCKET_WRITE_TIMEOUT milliseconds,
+ * the socket is closed and the remainder of the backlog is discarded.
+ *
+ * @param socket
+ *     The non-blocking guac_socket whose writer thread should be stopped.
+ */
+static void __guac_socket_stop_writer(guac_socket* socket) {
+
+    guac_timestamp deadline = guac_timestamp_current()
+                            + GUAC_SOCKET_WRITE_TIMEOUT;
+
+    struct timespec abstime = {
+        .tv_sec  = deadline / 1000,
+        .tv_nsec = (deadline % 1000) * 1000000L
+    };
+
+    pthread_mutex_lock(&(socket->__backlog_lock));
+
+    /* Wait for all queued output to be written */
+    while (socket->__backlog_length > 0 && !socket->__backlog_error) {
+
+        /* Give up on clients which are not reading quickly enough */
+        if (pthread_cond_timedwait(&(socket->__backlog_modified),
+                    &(socket->__backlog_lock), &abstime) == ETIMEDOUT) {
+            socket->state = GUAC_SOCKET_CLOSED;
+            __guac_socket_drop_backlog(socket);
+        }
+
+    }
+
+    socket->__writer_running = 0;
+    pthread_cond_broadcast(&(socket->__backlog_modified));
+
+    pthread_mutex_unlock(&(socket->__backlog_lock));
+
+    pthread_join(socket->__writer_thread, NULL);
+    socket->__nonblocking = 0;
+
+}
+
+/**
+ * Ends the current run of data within the main write buffer, if any, adding
+ * that run as a new pending segment. The buffer lock must already be held,
+ * and there must be space for at least one more segment.
+ *
+ * @param socket
+ *     The guac_socket whose current run of buffered data should be added as
+ *     a segment.
+ */
+static void __guac_socket_end_buffer_segment(guac_socket* socket) {
+
+    guac_socket_segment* segment;
+
+    /* Nothing to do if no data has been buffered since the last segment */
+    if (socket->__written == socket->__segment_start)
+        return;
+
+    segment = &(socket->__segments[socket->__segment_count++]);
+    segment->data = socket->__out_buf + socket->__segment_start;
+    segment->length = socket->__written - socket->__segment_start;
+    segment->free_handler = NULL;
+
+    socket->__segment_start = socket->__written;
+
+}
+
+/**
+ * Releases all pending segments, invoking the free handlers of any queued
+ * chunks, and empties the main write buffer. The buffer lock must already be
+ * held, unless the socket is being freed.
+ *
+ * @param socket
+ *     The guac_socket whose pending segments should be released.
+ */
+static void __guac_socket_release_segments(guac_socket* socket) {
+
+    int i;
+
+    /* Free all queued chunks */
+    for (i = 0; i < socket->__segment_count; i++) {
+        guac_socket_segment* segment = &(socket->__segments[i]);
+        if (segment->free_handler != NULL)
+            segment->free_handler((void*) segment->data);
+    }
+
+    socket->__segment_count = 0;
+    socket->__segment_start = 0;
+    socket->__written = 0;
+    socket->__queued = 0;
+
+}
+
+/**
+ * Writes all pending output, including all pending segments and any data
+ * buffered since the last segment, using the writev handler if defined. The
+ * buffer lock must already be held.
+ *
+ * @param socket
+ *     The guac_socket to flush.
+ *
+ * @return
+ *     Zero on success, or non-zero if an error occurs while writing.
+ */
+static int __guac_socket_flush_segments(guac_socket* socket) {
+
+    struct iovec iov[GUAC_SOCKET_MAX_SEGMENTS + 1];
+    int iovcnt = 0;
+    int i;
+
+    /* Build list of all pending output, including trailing buffered data */
+    for (i = 0; i < socket->__segment_count; i++) {
+        iov[iovcnt].iov_base = (void*) socket->__segments[i].data;
+        iov[iovcnt].iov_len = socket->__segments[i].length;
+        iovcnt++;
+    }
+
+    if (socket->__written > socket->__segment_start) {
+        iov[iovcnt].iov_base = socket->__out_buf + socket->__segment_start;
+        iov[iovcnt].iov_len = socket->__written - socket->__segment_start;
+        iovcnt++;
+    }
+
+    /* Write without blocking if required, queueing anything unwritten */
+    if (socket->__nonblocking) {
+        if (__guac_socket_write_nonblocking(socket, iov, iovcnt))
+            return 1;
+    }
+
+    /* Write everything at once if possible (dumps are written per-segment) */
+    else if (socket->writev_handler != NULL
+            && socket->file_sock_dump == NULL) {
+
+        struct iovec* current = iov;
+
+        /* Update timestamp of last write */
+        socket->last_write_timestamp = guac_timestamp_current();
+
+        /* Write until completely written */
+        while (iovcnt > 0) {
+
+            /* Attempt to write, return on error */
+            ssize_t written = socket->writev_handler(socket, current, iovcnt);
+            if (written == -1)
+                return 1;
+
+            /* Wait for room if nothing could be written */
+            if (written == 0) {
+                if (socket->select_write_handler != NULL
+                        && socket->select_write_handler(socket, -1) < 0)
+                    return 1;
+                continue;
+            }
+
+            socket->bytes_written += written;
+            __guac_socket_advance_iov(&current, &iovcnt, written);
+
+        }
+
+    }
+
+    /* Otherwise, write each segment separately */
+    else {
+        for (i = 0; i < iovcnt; i++) {
+            if (guac_socket_write(socket, iov[i].iov_base, iov[i].iov_len))
+                return 1;
+        }
+    }
+
+    __guac_socket_release_segments(socket);
+    return 0;
+
+}
+
+/**
+ * Queues the given chunk of data for output by reference. If there is
+ * insufficient space for the chunk, all pending output is flushed first. If
+ * too much data has been queued, all pending output, including the chunk, is
+ * flushed after the chunk is queued. The buffer lock must already be held.
+ *
+ * @param socket
+ *     The guac_socket to queue the chunk on.
+ *
+ * @param chunk
+ *     The chunk of data to queue.
+ *
+ * @param count
+ *     The number of bytes in the chunk.
+ *
+ * @param free_handler
+ *     The handler to invoke once the chunk is no longer needed, or NULL if no
+ *     handler should be invoked.
+ *
+ * @return
+ *     Zero on success, or non-zero if an error occurs while writing.
+ */
+static int __guac_socket_queue_chunk(guac_socket* socket, const void* chunk,
+        size_t count, guac_socket_chunk_free_handler* free_handler) {
+
+    guac_socket_segment* segment;
+
+    /* Flush if there is no space for both the buffered data and the chunk */
+    if (socket->__segment_count > GUAC_SOCKET_MAX_SEGMENTS - 2
+            && __guac_socket_flush_segments(socket)) {
+
+        if (free_handler != NULL)
+            free_handler((void*) chunk);
+
+        return 1;
+
+    }
+
+    /* Queue chunk after all data buffered thus far */
+    __guac_socket_end_buffer_segment(socket);
+    segment = &(socket->__segments[socket->__segment_count++]);
+    segment->data = chunk;
+    segment->length = count;
+    segment->free_handler = free_handler;
+
+    /* Flush if too much data is queued */
+    socket->__queued += count;
+    if (socket->__queued >= GUAC_SOCKET_MAX_QUEUED_SIZE)
+        return __guac_socket_flush_segments(socket);
+
+    return 0;
+
+}
+
+/**
+ * Copies the given data into the main write buffer, flushing as necessary.
+ * The buffer lock must already be held.
+ *
+ * @param socket
+ *     The guac_socket to write to.
+ *
+ * @param buf
+ *     The data to write.
+ *
+ * @param count
+ *     The number of bytes to write.
+ *
+ * @return
+ *     Zero on success, or non-zero if an error occurs while writing.
+ */
+static int __guac_socket_write_buffered(guac_socket* socket,
+        const char* buf, size_t count) {
+
+    while (count > 0) {
+
+        /* Copy as much as will fit in the buffer */
+        size_t length = GUAC_SOCKET_OUTPUT_BUFFER_SIZE - socket->__written;
+        if (length > count)
+            length = count;
+
+        memcpy(socket->__out_buf + socket->__written, buf, length);
+        socket->__written += length;
+        buf += length;
+        count -= length;
+
+        /* Flush when necessary, return on error. Note that we must flush
+         * within 4 bytes of boundary because
+         * __guac_socket_write_base64_triplet ALWAYS writes four bytes, and
+         * would otherwise potentially overflow the buffer. */
+        if (socket->__written > GUAC_SOCKET_OUTPUT_BUFFER_SIZE - 4) {
+            if (__guac_socket_flush_segments(socket))
+                return 1;
+        }
+
+    }
+
+    return 0;
+
+}
+
+ssize_t guac_socket_write(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    const char* buffer = buf;
+
+    /* Never write around data queued by a non-blocking socket */
+    if (socket->__nonblocking) {
+        struct iovec iov = { .iov_base = (void*) buf, .iov_len = count };
+        return __guac_socket_write_nonblocking(socket, &iov, 1);
+    }
+
+    /* Write until completely written */
+    while (count > 0) {
+
+        /* Attempt to write, return on error */
+        int written = __guac_socket_write(socket, buffer, count);
+        if (written == -1)
+            return 1;
+
+        if (socket->file_sock_dump != NULL)
+        {
+            fprintf(socket->file_sock_dump, "[OUT %" PRId64 "] %s\n", guac_timestamp_current(), buffer);
+        }
+
+        /* Advance buffer as data written */
+        buffer += written;
+        count  -= written;
+    }
+
+    return 0;
+
+}
+
+ssize_t guac_socket_read(guac_socket* socket, void* buf, size_t count) {
+
+    ssize_t ret;
+
+    /* If handler defined, call it. */
+    if (socket->read_handler)
+    {
+        ret = socket->read_handler(socket, buf, count);
+
+        if (socket->file_sock_dump != NULL)
+        {
+            fprintf(socket->file_sock_dump, "[IN  %" PRId64 "] %s\n", guac_timestamp_current(), (char*)buf);
+        }
+
+        return ret;
+    }
+
+    /* Otherwise, pretend nothing was read. */
+    return 0;
+
+}
+
+int guac_socket_select(guac_socket* socket, int usec_timeout) {
+
+    /* Call select handler if defined */
+    if (socket->select_handler)
+        return socket->select_handler(socket, usec_timeout);
+
+    /* Otherwise, assume ready. */
+    return 1;
+
+}
+
+guac_socket* guac_socket_alloc(int dump_flag, char* dump_path) {
+
+    pthread_mutexattr_t lock_attributes;
+    guac_socket* socket = malloc(sizeof(guac_socket));
+    char f_name[2048];
+
+    /* If no memory available, return with error */
+    if (socket == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not allocate memory for socket";
+        return NULL;
+    }
+
+    socket->__ready = 0;
+    socket->__written = 0;
+    socket->__segment_count = 0;
+    socket->__segment_start = 0;
+    socket->__queued = 0;
+    socket->data = NULL;
+    socket->state = GUAC_SOCKET_OPEN;
+    socket->last_write_timestamp = guac_timestamp_current();
+
+    /* Init members */
+    socket->__instructionbuf_unparsed_start = socket->__instructionbuf;
+    socket->__instructionbuf_unparsed_end = socket->__instructionbuf;
+
+    /* Default to unsafe threading */
+    socket->__threadsafe_instructions = 0;
+    socket->__staging_enabled = 0;
+    socket->__staging_buffers = NULL;
+    socket->lock_contention = 0;
+    socket->bytes_written = 0;
+
+    /* Block while writing by default */
+    socket->__nonblocking = 0;
+    socket->__backlog = NULL;
+    socket->__backlog_start = 0;
+    socket->__backlog_length = 0;
+    socket->__backlog_size = 0;
+    socket->__backlog_error = 0;
+    socket->__writer_running = 0;
+    socket->__bulk = NULL;
+    socket->__bulk_length = 0;
+    socket->__bulk_size = 0;
+
+    /* No keep alive ping by default */
+    socket->__keep_alive_enabled = 0;
+
+    pthread_mutexattr_init(&lock_attributes);
+    pthread_mutexattr_setpshared(&lock_attributes, PTHREAD_PROCESS_SHARED);
+
+    pthread_mutex_init(&(socket->__instruction_write_lock), &lock_attributes);
+    pthread_mutex_init(&(socket->__buffer_lock),            &lock_attributes);
+    pthread_mutex_init(&(socket->__backlog_lock), NULL);
+    pthread_cond_init(&(socket->__backlog_modified), NULL);
+    pthread_cond_init(&(socket->__bulk_released), NULL);
+
+    /* No handlers yet */
+    socket->read_handler   = NULL;
+    socket->write_handler  = NULL;
+    socket->writev_handler = NULL;
+    socket->select_handler = NULL;
+    socket->select_write_handler = NULL;
+    socket->pending_handler = NULL;
+    socket->nonblocking_handler = NULL;
+    socket->free_handler   = NULL;
+
+    if (dump_flag)
+    {
+        sprintf(f_name, "%s/dump_%" PRId64 ".log", dump_path, socket->last_write_timestamp);
+        socket->file_sock_dump = fopen(f_name, "w");
+    }
+    else
+    {
+        socket->file_sock_dump = NULL;
+    }
+
+    return socket;
+
+}
+
+/**
+ * A chunk of data queued by reference within a staged instruction.
+ */
+typedef struct __guac_socket_staged_chunk {
+
+    /**
+     * The offset within the staging buffer at which this chunk was written.
+     * All staged data before this offset precedes the chunk.
+     */
+    size_t offset;
+
+    /**
+     * The chunk of data queued.
+     */
+    const void* data;
+
+    /**
+     * The number of bytes in the chunk.
+     */
+    size_t length;
+
+    /**
+     * The handler to invoke once the chunk is no longer needed, or NULL if no
+     * handler should be invoked.
+     */
+    guac_socket_chunk_free_handler* free_handler;
+
+} __guac_socket_staged_chunk;
+
+/**
+ * Buffer specific to a single thread and socket, in which instructions
+ * written by that thread are built before being committed to the socket as a
+ * whole.
+ */
+struct __guac_socket_staging {
+
+    /**
+     * The number of calls to guac_socket_instruction_begin() by the owning
+     * thread which have not yet been matched by calls to
+     * guac_socket_instruction_end(). Data is staged only while this value is
+     * non-zero.
+     */
+    int depth;
+
+    /**
+     * Whether the instruction being staged was begun with
+     * guac_socket_instruction_begin_bulk(), and should be deferred behind
+     * all other output once complete.
+     */
+    int bulk;
+
+    /**
+     * The data staged thus far.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes of data staged thus far.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes allocated for the staging buffer.
+     */
+    size_t size;
+
+    /**
+     * The number of bytes present in the staged base64 "ready" buffer.
+     */
+    int ready;
+
+    /**
+     * The staged base64 "ready" buffer, equivalent to the __ready_buf of the
+     * socket itself.
+     */
+    int ready_buf[3];
+
+    /**
+     * All chunks queued by reference within the staged data, in order.
+     */
+    __guac_socket_staged_chunk chunks[GUAC_SOCKET_MAX_STAGED_CHUNKS];
+
+    /**
+     * The number of chunks queued within the staged data.
+     */
+    int chunk_count;
+
+    /**
+     * The next staging buffer allocated for the same socket, or NULL if this
+     * is the last.
+     */
+    struct __guac_socket_staging* next;
+
+};
+
+/**
+ * Acquires the given lock of the given socket, recording whether the calling
+ * thread had to wait for another thread to release the lock.
+ *
+ * @param socket
+ *     The guac_socket owning the lock.
+ *
+ * @param lock
+ *     The lock to acquire.
+ */
+static void __guac_socket_lock(guac_socket* socket, pthread_mutex_t* lock) {
+
+    /* Wait for the lock only if it is currently held */
+    if (pthread_mutex_trylock(lock)) {
+        pthread_mutex_lock(lock);
+        socket->lock_contention++;
+    }
+
+}
+
+/**
+ * Returns the staging buffer of the current thread for the given socket, if
+ * the current thread is within an instruction which should be staged.
+ *
+ * @param socket
+ *     The guac_socket being written to.
+ *
+ * @return
+ *     The staging buffer receiving data written by the current thread, or
+ *     NULL if data should be written to the socket directly.
+ */
+static struct __guac_socket_staging* __guac_socket_get_staging(
+        guac_socket* socket) {
+
+    struct __guac_socket_staging* staging;
+
+    if (!socket->__staging_enabled)
+        return NULL;
+
+    staging = pthread_getspecific(socket->__staging_key);
+    if (staging == NULL || staging->depth == 0)
+        return NULL;
+
+    return staging;
+
+}
+
+/**
+ * Ensures the given staging buffer has space for at least the given number of
+ * additional bytes, growing the buffer as necessary.
+ *
+ * @param staging
+ *     The staging buffer to grow.
+ *
+ * @param length
+ *     The number of additional bytes which must fit within the buffer.
+ *
+ * @return
+ *     Zero on success, or non-zero if memory could not be allocated, in which
+ *     case guac_error is set appropriately.
+ */
+static int __guac_socket_staging_reserve(
+        struct __guac_socket_staging* staging, size_t length) {
+
+    size_t size = staging->size;
+    char* buffer;
+
+    if (staging->length + length <= size)
+        return 0;
+
+    /* Grow by doubling */
+    while (staging->length + length > size)
+        size *= 2;
+
+    buffer = realloc(staging->buffer, size);
+    if (buffer == NULL) {
+        guac_error = GUAC_STATUS_NO_MEMORY;
+        guac_error_message = "Could not grow socket staging buffer";
+        return 1;
+    }
+
+    staging->buffer = buffer;
+    staging->size = size;
+    return 0;
+
+}
+
+/**
+ * Appends the given data to the given staging buffer.
+ *
+ * @param staging
+ *     The staging buffer to append to.
+ *
+ * @param buf
+ *     The data to append.
+ *
+ * @param count
+ *     The number of bytes to append.
+ *
+ * @return
+ *     Zero on success, or non-zero if memory could not be allocated, in which
+ *     case guac_error is set appropriately.
+ */
+static int __guac_socket_staging_append(struct __guac_socket_staging* staging,
+        const void* buf, size_t count) {
+
+    if (__guac_socket_staging_reserve(staging, count))
+        return 1;
+
+    memcpy(staging->buffer + staging->length, buf, count);
+    staging->length += count;
+    return 0;
+
+}
+
+/**
+ * Appends the given chunk to the given staging buffer, queueing the chunk by
+ * reference if possible, and copying the chunk otherwise.
+ *
+ * @param staging
+ *     The staging buffer to append to.
+ *
+ * @param chunk
+ *     The chunk of data to append.
+ *
+ * @param count
+ *     The number of bytes in the chunk.
+ *
+ * @param free_handler
+ *     The handler to invoke once the chunk is no longer needed, or NULL if no
+ *     handler should be invoked.
+ *
+ * @return
+ *     Zero on success, or non-zero if memory could not be allocated, in which
+ *     case guac_error is set appropriately.
+ */
+static int __guac_socket_staging_append_chunk(
+        struct __guac_socket_staging* staging, const void* chunk,
+        size_t count, guac_socket_chunk_free_handler* free_handler) {
+
+    __guac_socket_staged_chunk* staged;
+    int retval;
+
+    /* Copy the chunk if it is small or no more chunks can be queued */
+    if (count < GUAC_SOCKET_MIN_CHUNK_SIZE
+            || staging->chunk_count == GUAC_SOCKET_MAX_STAGED_CHUNKS) {
+
+        retval = __guac_socket_staging_append(staging, chunk, count);
+
+        if (free_handler != NULL)
+            free_handler((void*) chunk);
+
+        return retval;
+
+    }
+
+    staged = &(staging->chunks[staging->chunk_count++]);
+    staged->offset = staging->length;
+    staged->data = chunk;
+    staged->length = count;
+    staged->free_handler = free_handler;
+
+    return 0;
+
+}
+
+/**
+ * Appends the given data to the given staging buffer as base64, buffering
+ * any incomplete triplet within the staging buffer's own "ready" buffer.
+ *
+ * @param staging
+ *     The staging buffer to append to.
+ *
+ * @param buf
+ *     The data to encode.
+ *
+ * @param count
+ *     The number of bytes to encode.
+ *
+ * @return
+ *     Zero on success, or non-zero if memory could not be allocated, in which
+ *     case guac_error is set appropriately.
+ */
+static int __guac_socket_staging_append_base64(
+        struct __guac_socket_staging* staging, const void* buf, size_t count) {
+
+    const unsigned char* char_buf = (const unsigned char*) buf;
+    const unsigned char* end = char_buf + count;
+
+    /* Complete any partial triplet left over from a previous write */
+    while (staging->ready > 0 && staging->ready < 3 && char_buf < end)
+        staging->ready_buf[staging->ready++] = *(char_buf++);
+
+    if (staging->ready == 3) {
+
+        if (__guac_socket_staging_reserve(staging, 4))
+            return 1;
+
+        __guac_socket_encode_base64_triplet(staging->buffer + staging->length,
+                staging->ready_buf[0], staging->ready_buf[1],
+                staging->ready_buf[2]);
+
+        staging->length += 4;
+        staging->ready = 0;
+
+    }
+
+    /* Encode all whole triplets, queueing large runs as separate chunks if
+     * possible */
+    if (end - char_buf >= 3) {
+
+        size_t triplets = (end - char_buf) / 3;
+        char* chunk = NULL;
+
+        if (triplets * 4 >= GUAC_SOCKET_MIN_CHUNK_SIZE
+                && staging->chunk_count < GUAC_SOCKET_MAX_STAGED_CHUNKS)
+            chunk = malloc(triplets * 4);
+
+        if (chunk != NULL) {
+            size_t length = guac_base64_encode(char_buf, triplets * 3, chunk);
+            __guac_socket_staging_append_chunk(staging, chunk, length, free);
+        }
+
+        else {
+
+            if (__guac_socket_staging_reserve(staging, triplets * 4))
+                return 1;
+
+            staging->length += guac_base64_encode(char_buf, triplets * 3,
+                    staging->buffer + staging->length);
+
+        }
+
+        char_buf += triplets * 3;
+
+    }
+
+    /* Buffer any remaining bytes until the triplet is complete */
+    while (char_buf < end)
+        staging->ready_buf[staging->ready++] = *(char_buf++);
+
+    return 0;
+
+}
+
+/**
+ * Appends any incomplete triplet within the given staging buffer's "ready"
+ * buffer as padded base64.
+ *
+ * @param staging
+ *     The staging buffer to flush.
+ *
+ * @return
+ *     Zero on success, or non-zero if memory could not be allocated, in which
+ *     case guac_error is set appropriately.
+ */
+static int __guac_socket_staging_flush_base64(
+        struct __guac_socket_staging* staging) {
+
+    if (staging->ready == 0)
+        return 0;
+
+    if (__guac_socket_staging_reserve(staging, 4))
+        return 1;
+
+    __guac_socket_encode_base64_triplet(staging->buffer + staging->length,
+            staging->ready_buf[0],
+            staging->ready > 1 ? staging->ready_buf[1] : -1,
+            -1);
+
+    staging->length += 4;
+    staging->ready = 0;
+    return 0;
+
+}
+
+/**
+ * Appends all data within the given staging buffer to the deferred bulk
+ * output of the given non-blocking socket, releasing all staged chunks, and
+ * empties the staging buffer. If the socket has no other output waiting,
+ * the deferred output is released to the writer thread immediately. The
+ * buffer lock must already be held.
+ *
+ * @param socket
+ *     The non-blocking guac_socket to write to.
+ *
+ * @param staging
+ *     The staging buffer to commit.
+ *
+ * @return
+ *     Zero on success, or non-zero if an error occurs while writing.
+ */
+static int __guac_socket_staging_defer(guac_socket* socket,
+        struct __guac_socket_staging* staging) {
+
+    size_t offset = 0;
+    int retval = 0;
+    int i;
 
-static ssize_t __guac_socket_write(guac_socket* socket,
-        const void* buf, size_t count) {
+    pthread_mutex_lock(&(socket->__backlog_lock));
 
-    /* Update timestamp of last write */
-    socket->last_write_timestamp = guac_timestamp_current();
+    /* Copy chunks along with the data surrounding them, as deferred output
+     * may outlive the chunks */
+    for (i = 0; i < staging->chunk_count; i++) {
 
-    /* If handler defined, call it. */
-    if (socket->write_handler)
-        return socket->write_handler(socket, buf, count);
+        __guac_socket_staged_chunk* staged = &(staging->chunks[i]);
 
-    /* Otherwise, pretend everything was written. */
-    return count;
+        if (!retval)
+            retval = __guac_socket_bulk_append(socket,
+                    staging->buffer + offset, staged->offset - offset)
+                || __guac_socket_bulk_append(socket, staged->data,
+                    staged->length);
 
-}
+        offset = staged->offset;
 
-ssize_t guac_socket_write(guac_socket* socket,
-        const void* buf, size_t count) {
+        if (staged->free_handler != NULL)
+            staged->free_handler((void*) staged->data);
 
-    const char* buffer = buf;
+    }
 
-    /* Write until completely written */
-    while (count > 0) {
+    if (!retval)
+        retval = __guac_socket_bulk_append(socket, staging->buffer + offset,
+                staging->length - offset);
 
-        /* Attempt to write, return on error */
-        int written = __guac_socket_write(socket, buffer, count);
-        if (written == -1)
-            return 1;
+    staging->length = 0;
+    staging->chunk_count = 0;
+    staging->ready = 0;
 
-        if (socket->file_sock_dump != NULL)
-        {
-            fprintf(socket->file_sock_dump, "[OUT %" PRId64 "] %s\n", guac_timestamp_current(), buffer);
-        }
+    /* Release immediately if nothing else is waiting */
+    __guac_socket_queue_bulk(socket, 0);
 
-        /* Advance buffer as data written */
-        buffer += written;
-        count  -= written;
+    if (!retval && socket->__backlog_error) {
+        guac_error = GUAC_STATUS_IO_ERROR;
+        guac_error_message = "Error writing queued data to socket";
+        retval = 1;
     }
 
-    return 0;
+    pthread_mutex_unlock(&(socket->__backlog_lock));
+    return retval;
 
 }
 
-ssize_t guac_socket_read(guac_socket* socket, void* buf, size_t count) {
-
-    ssize_t ret;
+/**
+ * Writes all data within the given staging buffer to the given socket as a
+ * single atomic operation, acquiring the buffer lock only once, and empties
+ * the staging buffer.
+ *
+ * @param socket
+ *     The guac_socket to write to.
+ *
+ * @param staging
+ *     The staging buffer to commit.
+ *
+ * @return
+ *     Zero on success, or non-zero if an error occurs while writing.
+ */
+static int __guac_socket_staging_commit(guac_socket* socket,
+        struct __guac_socket_staging* staging) {
 
-    /* If handler defined, call it. */
-    if (socket->read_handler)
-    {
-        ret = socket->read_handler(socket, buf, count);
+    size_t offset = 0;
+    int retval = 0;
+    int i;
 
-        if (socket->file_sock_dump != NULL)
-        {
-            fprintf(socket->file_sock_dump, "[IN  %" PRId64 "] %s\n", guac_timestamp_current(), (char*)buf);
-        }
+    __guac_socket_lock(socket, &(socket->__buffer_lock));
 
-        return ret;
+    /* Defer bulk instructions behind all other output, waiting only if too
+     * much is already deferred */
+    if (staging->bulk && socket->__nonblocking) {
+        retval = __guac_socket_staging_defer(socket, staging);
+        pthread_mutex_unlock(&(socket->__buffer_lock));
+        __guac_socket_wait_bulk(socket);
+        return retval;
     }
 
-    /* Otherwise, pretend nothing was read. */
-    return 0;
+    for (i = 0; i < staging->chunk_count; i++) {
 
-}
+        __guac_socket_staged_chunk* staged = &(staging->chunks[i]);
 
-int guac_socket_select(guac_socket* socket, int usec_timeout) {
+        /* On error, just release any remaining chunks */
+        if (retval) {
+            if (staged->free_handler != NULL)
+                staged->free_handler((void*) staged->data);
+            continue;
+        }
 
-    /* Call select handler if defined */
-    if (socket->select_handler)
-        return socket->select_handler(socket, usec_timeout);
+        /* Write data preceding the chunk */
+        retval = __guac_socket_write_buffered(socket, staging->buffer + offset,
+                staged->offset - offset);
+        offset = staged->offset;
 
-    /* Otherwise, assume ready. */
-    return 1;
+        /* Queue the chunk itself (the chunk is released even on error) */
+        if (retval) {
+            if (staged->free_handler != NULL)
+                staged->free_handler((void*) staged->data);
+        }
+        else
+            retval = __guac_socket_queue_chunk(socket, staged->data,
+                    staged->length, staged->free_handler);
 
-}
+    }
 
-guac_socket* guac_socket_alloc(int dump_flag, char* dump_path) {
+    /* Write any data following the last chunk */
+    if (!retval)
+        retval = __guac_socket_write_buffered(socket, staging->buffer + offset,
+                staging->length - offset);
 
-    pthread_mutexattr_t lock_attributes;
-    guac_socket* socket = malloc(sizeof(guac_socket));
-    char f_name[2048];
+    pthread_mutex_unlock(&(socket->__buffer_lock));
 
-    /* If no memory available, return with error */
-    if (socket == NULL) {
-        guac_error = GUAC_STATUS_NO_MEMORY;
-        guac_error_message = "Could not allocate memory for socket";
-        return NULL;
-    }
+    staging->length = 0;
+    staging->chunk_count = 0;
+    staging->ready = 0;
 
-    socket->__ready = 0;
-    socket->__written = 0;
-    socket->data = NULL;
-    socket->state = GUAC_SOCKET_OPEN;
-    socket->last_write_timestamp = guac_timestamp_current();
+    return retval;
 
-    /* Init members */
-    socket->__instructionbuf_unparsed_start = socket->__instructionbuf;
-    socket->__instructionbuf_unparsed_end = socket->__instructionbuf;
+}
 
-    /* Default to unsafe threading */
-    socket->__threadsafe_instructions = 0;
+/**
+ * Returns the staging buffer of the current thread for the given socket,
+ * allocating a new staging buffer if the current thread does not yet have
+ * one.
+ *
+ * @param socket
+ *     The guac_socket to retrieve the staging buffer of.
+ *
+ * @return
+ *     The staging buffer of the current thread, or NULL if a new buffer
+ *     could not be allocated.
+ */
+static struct __guac_socket_staging* __guac_socket_get_thread_staging(
+        guac_socket* socket) {
 
-    /* No keep alive ping by default */
-    socket->__keep_alive_enabled = 0;
+    struct __guac_socket_staging* staging =
+        pthread_getspecific(socket->__staging_key);
 
-    pthread_mutexattr_init(&lock_attributes);
-    pthread_mutexattr_setpshared(&lock_attributes, PTHREAD_PROCESS_SHARED);
+    /* Use existing staging buffer, if any */
+    if (staging != NULL)
+        return staging;
 
-    pthread_mutex_init(&(socket->__instruction_write_lock), &lock_attributes);
-    pthread_mutex_init(&(socket->__buffer_lock),            &lock_attributes);
-    
-    /* No handlers yet */
-    socket->read_handler   = NULL;
-    socket->write_handler  = NULL;
-    socket->select_handler = NULL;
-    socket->free_handler   = NULL;
+    staging = malloc(sizeof(struct __guac_socket_staging));
+    if (staging == NULL)
+        return NULL;
 
-    if (dump_flag)
-    {
-        sprintf(f_name, "%s/dump_%" PRId64 ".log", dump_path, socket->last_write_timestamp);
-        socket->file_sock_dump = fopen(f_name, "w");
+    staging->buffer = malloc(GUAC_SOCKET_STAGING_BUFFER_SIZE);
+    if (staging->buffer == NULL) {
+        free(staging);
+        return NULL;
     }
-    else
-    {
-        socket->file_sock_dump = NULL;
+
+    staging->depth = 0;
+    staging->bulk = 0;
+    staging->length = 0;
+    staging->size = GUAC_SOCKET_STAGING_BUFFER_SIZE;
+    staging->ready = 0;
+    staging->chunk_count = 0;
+
+    if (pthread_setspecific(socket->__staging_key, staging)) {
+        free(staging->buffer);
+        free(staging);
+        return NULL;
     }
 
-    return socket;
+    /* Track buffer such that it can be freed with the socket */
+    pthread_mutex_lock(&(socket->__buffer_lock));
+    staging->next = socket->__staging_buffers;
+    socket->__staging_buffers = staging;
+    pthread_mutex_unlock(&(socket->__buffer_lock));
+
+    return staging;
 
 }
 
 void guac_socket_require_threadsafe(guac_socket* socket) {
+
+    /* Nothing to do if already threadsafe */
+    if (socket->__threadsafe_instructions)
+        return;
+
+    /* Stage instructions within per-thread buffers if possible, falling back
+     * to serializing instructions with the instruction lock */
+    if (pthread_key_create(&(socket->__staging_key), NULL) == 0)
+        socket->__staging_enabled = 1;
+
     socket->__threadsafe_instructions = 1;
+
 }
 
 void guac_socket_require_keep_alive(guac_socket* socket) {
@@ -223,19 +1578,133 @@ void guac_socket_require_keep_alive(guac_socket* socket) {
 
 }
 
+void guac_socket_require_nonblocking(guac_socket* socket) {
+
+    /* Nothing to do if already non-blocking */
+    if (socket->__nonblocking)
+        return;
+
+    /* Output can only be queued if it is written all at once, and only
+     * written later if the socket can wait for room */
+    if (socket->writev_handler == NULL || socket->select_write_handler == NULL
+            || socket->file_sock_dump != NULL)
+        return;
+
+    /* Start writer thread */
+    socket->__writer_running = 1;
+    if (pthread_create(&(socket->__writer_thread), NULL,
+                __guac_socket_writer_thread, (void*) socket)) {
+        socket->__writer_running = 0;
+        return;
+    }
+
+    socket->__nonblocking = 1;
+
+    /* Allow transport to hold less output now that it can be queued */
+    if (socket->nonblocking_handler)
+        socket->nonblocking_handler(socket);
+
+}
+
+size_t guac_socket_get_backlog(guac_socket* socket) {
+
+    size_t backlog = 0;
+
+    /* Include output queued within the socket */
+    if (socket->__nonblocking) {
+        pthread_mutex_lock(&(socket->__backlog_lock));
+        backlog = socket->__backlog_length;
+        pthread_mutex_unlock(&(socket->__backlog_lock));
+    }
+
+    /* Include output not yet sent by the underlying transport, if known */
+    if (socket->pending_handler) {
+        ssize_t pending = socket->pending_handler(socket);
+        if (pending > 0)
+            backlog += pending;
+    }
+
+    return backlog;
+
+}
+
+uint64_t guac_socket_get_flushed(guac_socket* socket) {
+
+    uint64_t flushed;
+
+    /* Include output queued within the socket */
+    if (socket->__nonblocking) {
+        pthread_mutex_lock(&(socket->__backlog_lock));
+        flushed = socket->bytes_written + socket->__backlog_length;
+        pthread_mutex_unlock(&(socket->__backlog_lock));
+        return flushed;
+    }
+
+    return socket->bytes_written;
+
+}
+
 void guac_socket_instruction_begin(guac_socket* socket) {
 
-    /* Lock writes if threadsafety enabled */
-    if (socket->__threadsafe_instructions)
-        pthread_mutex_lock(&(socket->__instruction_write_lock));
+    struct __guac_socket_staging* staging;
+
+    /* Nothing to do if threadsafety is not enabled */
+    if (!socket->__threadsafe_instructions)
+        return;
+
+    /* Stage the instruction within the current thread's buffer if possible */
+    if (socket->__staging_enabled) {
+        staging = __guac_socket_get_thread_staging(socket);
+        if (staging != NULL) {
+            if (staging->depth++ == 0)
+                staging->bulk = 0;
+            return;
+        }
+    }
+
+    /* Otherwise, lock writes */
+    __guac_socket_lock(socket, &(socket->__instruction_write_lock));
+
+}
+
+void guac_socket_instruction_begin_bulk(guac_socket* socket) {
+
+    struct __guac_socket_staging* staging;
+
+    guac_socket_instruction_begin(socket);
+
+    /* Only an outermost staged instruction can be deferred as a whole */
+    staging = __guac_socket_get_staging(socket);
+    if (staging != NULL && staging->depth == 1)
+        staging->bulk = 1;
 
 }
 
 void guac_socket_instruction_end(guac_socket* socket) {
 
-    /* Unlock writes if threadsafety enabled */
-    if (socket->__threadsafe_instructions)
-        pthread_mutex_unlock(&(socket->__instruction_write_lock));
+    struct __guac_socket_staging* staging;
+
+    /* Nothing to do if threadsafety is not enabled */
+    if (!socket->__threadsafe_instructions)
+        return;
+
+    /* Commit staged instruction once complete */
+    if (socket->__staging_enabled) {
+        staging = pthread_getspecific(socket->__staging_key);
+        if (staging != NULL && staging->depth > 0) {
+
+            /* Errors are recorded in guac_error, and will be reported again
+             * upon flush */
+            if (--staging->depth == 0)
+                __guac_socket_staging_commit(socket, staging);
+
+            return;
+
+        }
+    }
+
+    /* Otherwise, unlock writes */
+    pthread_mutex_unlock(&(socket->__instruction_write_lock));
 
 }
 
@@ -243,7 +1712,7 @@ void guac_socket_update_buffer_begin(guac_socket* socket) {
 
     /* Lock if threadsafety enabled */
     if (socket->__threadsafe_instructions)
-        pthread_mutex_lock(&(socket->__buffer_lock));
+        __guac_socket_lock(socket, &(socket->__buffer_lock));
 
 }
 
@@ -257,11 +1726,24 @@ void guac_socket_update_buffer_end(guac_socket* socket) {
 
 void guac_socket_free(guac_socket* socket) {
 
+    /* Send deferred bulk output along with everything else, while the
+     * underlying transport is still usable */
+    guac_socket_flush_bulk(socket);
+    guac_socket_flush(socket);
+
+    /* Finish writing any queued output */
+    if (socket->__nonblocking)
+        __guac_socket_stop_writer(socket);
+
     /* Call free handler if defined */
     if (socket->free_handler)
         socket->free_handler(socket);
 
-    guac_socket_flush(socket);
+    free(socket->__backlog);
+    free(socket->__bulk);
+
+    /* Release any chunks which could not be written */
+    __guac_socket_release_segments(socket);
 
     /* Mark as closed */
     socket->state = GUAC_SOCKET_CLOSED;
@@ -270,7 +1752,29 @@ void guac_socket_free(guac_socket* socket) {
     if (socket->__keep_alive_enabled)
         pthread_join(socket->__keep_alive_thread, NULL);
 
+    /* Free all staging buffers */
+    if (socket->__staging_enabled) {
+
+        struct __guac_socket_staging* staging = socket->__staging_buffers;
+        while (staging != NULL) {
+
+            struct __guac_socket_staging* next = staging->next;
+
+            free(staging->buffer);
+            free(staging);
+
+            staging = next;
+
+        }
+
+        pthread_key_delete(socket->__staging_key);
+
+    }
+
     pthread_mutex_destroy(&(socket->__instruction_write_lock));
+    pthread_mutex_destroy(&(socket->__backlog_lock));
+    pthread_cond_destroy(&(socket->__backlog_modified));
+    pthread_cond_destroy(&(socket->__bulk_released));
 
     if (socket->file_sock_dump != NULL)
         fclose(socket->file_sock_dump);
@@ -279,77 +1783,79 @@ void guac_socket_free(guac_socket* socket) {
 
 ssize_t guac_socket_write_int(guac_socket* socket, int64_t i) {
 
-    char buffer[128];
-    snprintf(buffer, sizeof(buffer), "%"PRIi64, i);
-    return guac_socket_write_string(socket, buffer);
+    char buffer[GUAC_DECIMAL_MAX_LENGTH];
+    int length = guac_decimal_format(buffer, i);
+    return guac_socket_write_buffered(socket, buffer, length);
 
 }
 
 ssize_t guac_socket_write_string(guac_socket* socket, const char* str) {
+    return guac_socket_write_buffered(socket, str, strlen(str));
+}
+
+ssize_t guac_socket_write_buffered(guac_socket* socket, const void* buf,
+        size_t count) {
 
-    char* __out_buf = socket->__out_buf;
+    int retval;
+
+    /* Stage data if within a threadsafe instruction */
+    struct __guac_socket_staging* staging = __guac_socket_get_staging(socket);
+    if (staging != NULL)
+        return __guac_socket_staging_append(staging, buf, count);
 
     guac_socket_update_buffer_begin(socket);
+    retval = __guac_socket_write_buffered(socket, buf, count);
+    guac_socket_update_buffer_end(socket);
 
-    for (; *str != '\0'; str++) {
+    return retval;
 
-        __out_buf[socket->__written++] = *str; 
+}
 
-        /* Flush when necessary, return on error. Note that we must flush within 4 bytes of boundary because
-         * __guac_socket_write_base64_triplet ALWAYS writes four bytes, and would otherwise potentially overflow
-         * the buffer. */
-        if (socket->__written > GUAC_SOCKET_OUTPUT_BUFFER_SIZE - 4) {
+ssize_t guac_socket_write_chunk(guac_socket* socket, const void* chunk,
+        size_t count, guac_socket_chunk_free_handler* free_handler) {
 
-            if (guac_socket_write(socket, __out_buf, socket->__written)) {
-                guac_socket_update_buffer_end(socket);
-                return 1;
-            }
+    int retval;
 
-            socket->__written = 0;
+    /* Stage chunk if within a threadsafe instruction */
+    struct __guac_socket_staging* staging = __guac_socket_get_staging(socket);
+    if (staging != NULL)
+        return __guac_socket_staging_append_chunk(staging, chunk, count,
+                free_handler);
 
-        }
+    guac_socket_update_buffer_begin(socket);
+
+    /* Copy small chunks rather than queueing them */
+    if (count < GUAC_SOCKET_MIN_CHUNK_SIZE) {
+
+        retval = __guac_socket_write_buffered(socket, chunk, count);
+        guac_socket_update_buffer_end(socket);
+
+        if (free_handler != NULL)
+            free_handler((void*) chunk);
+
+        return retval;
 
     }
 
+    retval = __guac_socket_queue_chunk(socket, chunk, count, free_handler);
     guac_socket_update_buffer_end(socket);
-    return 0;
+
+    return retval;
 
 }
 
 ssize_t __guac_socket_write_base64_triplet(guac_socket* socket, int a, int b, int c) {
 
-    char* __out_buf = socket->__out_buf;
-
-    /* Byte 1 */
-    __out_buf[socket->__written++] = __guac_socket_BASE64_CHARACTERS[(a & 0xFC) >> 2]; /* [AAAAAA]AABBBB BBBBCC CCCCCC */
-
-    if (b >= 0) {
-        __out_buf[socket->__written++] = __guac_socket_BASE64_CHARACTERS[((a & 0x03) << 4) | ((b & 0xF0) >> 4)]; /* AAAAAA[AABBBB]BBBBCC CCCCCC */
-
-        if (c >= 0) {
-            __out_buf[socket->__written++] = __guac_socket_BASE64_CHARACTERS[((b & 0x0F) << 2) | ((c & 0xC0) >> 6)]; /* AAAAAA AABBBB[BBBBCC]CCCCCC */
-            __out_buf[socket->__written++] = __guac_socket_BASE64_CHARACTERS[c & 0x3F]; /* AAAAAA AABBBB BBBBCC[CCCCCC] */
-        }
-        else { 
-            __out_buf[socket->__written++] = __guac_socket_BASE64_CHARACTERS[((b & 0x0F) << 2)]; /* AAAAAA AABBBB[BBBB--]------ */
-            __out_buf[socket->__written++] = '='; /* AAAAAA AABBBB BBBB--[------] */
-        }
-    }
-    else {
-        __out_buf[socket->__written++] = __guac_socket_BASE64_CHARACTERS[((a & 0x03) << 4)]; /* AAAAAA[AA----]------ ------ */
-        __out_buf[socket->__written++] = '='; /* AAAAAA AA----[------]------ */
-        __out_buf[socket->__written++] = '='; /* AAAAAA AA---- ------[------] */
-    }
+    __guac_socket_encode_base64_triplet(socket->__out_buf + socket->__written,
+            a, b, c);
+    socket->__written += 4;
 
     /* At this point, 4 bytes have been socket->__written */
 
     /* Flush when necessary, return on error */
     if (socket->__written > GUAC_SOCKET_OUTPUT_BUFFER_SIZE - 4) {
-
-        if (guac_socket_write(socket, __out_buf, socket->__written))
+        if (__guac_socket_flush_segments(socket))
             return -1;
-
-        socket->__written = 0;
     }
 
     if (b < 0)
@@ -389,7 +1895,69 @@ ssize_t guac_socket_write_base64(guac_socket* socket, const void* buf, size_t co
     const unsigned char* char_buf = (const unsigned char*) buf;
     const unsigned char* end = char_buf + count;
 
+    /* Stage data if within a threadsafe instruction */
+    struct __guac_socket_staging* staging = __guac_socket_get_staging(socket);
+    if (staging != NULL)
+        return __guac_socket_staging_append_base64(staging, buf, count);
+
     guac_socket_update_buffer_begin(socket);
+
+    /* Complete any partial triplet left over from a previous write */
+    while (socket->__ready > 0 && char_buf < end) {
+
+        retval = __guac_socket_write_base64_byte(socket, *(char_buf++));
+        if (retval < 0) {
+            guac_socket_update_buffer_end(socket);
+            return retval;
+        }
+
+    }
+
+    /* Encode large runs of whole triplets into a separate chunk, queueing
+     * that chunk by reference */
+    if (end - char_buf >= GUAC_SOCKET_MIN_CHUNK_SIZE / 4 * 3) {
+
+        size_t triplets = (end - char_buf) / 3;
+        char* chunk = malloc(triplets * 4);
+
+        if (chunk != NULL) {
+
+            size_t length = guac_base64_encode(char_buf, triplets * 3, chunk);
+            char_buf += triplets * 3;
+
+            if (__guac_socket_queue_chunk(socket, chunk, length, free)) {
+                guac_socket_update_buffer_end(socket);
+                return -1;
+            }
+
+        }
+
+    }
+
+    /* Encode all other whole triplets directly into the output buffer */
+    while (end - char_buf >= 3) {
+
+        /* Encode as many triplets as will fit in the output buffer */
+        size_t triplets = (end - char_buf) / 3;
+        size_t available = (GUAC_SOCKET_OUTPUT_BUFFER_SIZE - socket->__written) / 4;
+        if (triplets > available)
+            triplets = available;
+
+        socket->__written += guac_base64_encode(char_buf, triplets * 3,
+                socket->__out_buf + socket->__written);
+        char_buf += triplets * 3;
+
+        /* Flush when necessary, return on error */
+        if (socket->__written > GUAC_SOCKET_OUTPUT_BUFFER_SIZE - 4) {
+            if (__guac_socket_flush_segments(socket)) {
+                guac_socket_update_buffer_end(socket);
+                return -1;
+            }
+        }
+
+    }
+
+    /* Buffer any remaining bytes until the triplet is complete */
     while (char_buf < end) {
 
         retval = __guac_socket_write_base64_byte(socket, *(char_buf++));
@@ -407,16 +1975,17 @@ ssize_t guac_socket_write_base64(guac_socket* socket, const void* buf, size_t co
 
 ssize_t guac_socket_flush(guac_socket* socket) {
 
-    /* Flush remaining bytes in buffer */
+    /* Flush remaining bytes in buffer and all queued chunks */
     guac_socket_update_buffer_begin(socket);
-    if (socket->__written > 0) {
-
-        if (guac_socket_write(socket, socket->__out_buf, socket->__written)) {
-            guac_socket_update_buffer_end(socket);
-            return 1;
-        }
+    if (__guac_socket_flush_segments(socket)) {
+        guac_socket_update_buffer_end(socket);
+        return 1;
+    }
 
-        socket->__written = 0;
+    /* Send deferred bulk output if everything else has been sent */
+    if (socket->__nonblocking && __guac_socket_release_bulk(socket, 0)) {
+        guac_socket_update_buffer_end(socket);
+        return 1;
     }
 
     guac_socket_update_buffer_end(socket);
@@ -424,10 +1993,31 @@ ssize_t guac_socket_flush(guac_socket* socket) {
 
 }
 
+ssize_t guac_socket_flush_bulk(guac_socket* socket) {
+
+    int retval = 0;
+
+    /* Only non-blocking sockets defer bulk output */
+    if (!socket->__nonblocking)
+        return 0;
+
+    guac_socket_update_buffer_begin(socket);
+    retval = __guac_socket_release_bulk(socket, 1);
+    guac_socket_update_buffer_end(socket);
+
+    return retval;
+
+}
+
 ssize_t guac_socket_flush_base64(guac_socket* socket) {
 
     int retval;
 
+    /* Stage data if within a threadsafe instruction */
+    struct __guac_socket_staging* staging = __guac_socket_get_staging(socket);
+    if (staging != NULL)
+        return __guac_socket_staging_flush_base64(staging);
+
     /* Flush triplet to output buffer */
     guac_socket_update_buffer_begin(socket);
     while (socket->__ready > 0) {
@@ -56,3 +56,29 @@ guac_timestamp guac_timestamp_current() {
 
 }
 
+uint64_t guac_timestamp_current_usec() {
+
+#ifdef HAVE_CLOCK_GETTIME
+
+    struct timespec current;
+
+    /* Get current time, unaffected by changes to the system clock */
+    clock_gettime(CLOCK_MONOTONIC, &current);
+
+    /* Calculate microseconds */
+    return (uint64_t) current.tv_sec * 1000000 + current.tv_nsec / 1000;
+
+#else
+
+    struct timeval current;
+
+    /* Get current time */
+    gettimeofday(&current, NULL);
+
+    /* Calculate microseconds */
+    return (uint64_t) current.tv_sec * 1000000 + current.tv_usec;
+
+#endif
+
+}
+
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#ifdef ENABLE_VPX
+#include "encode-vpx.h"
+#endif
+
+#include <guacamole/client.h>
+#include <guacamole/protocol.h>
+#include <guacamole/stream.h>
+#include <guacamole/timestamp.h>
+#include <guacamole/video.h>
+
+#include <stdlib.h>
+
+guac_video_stream* guac_video_stream_alloc(guac_client* client,
+        guac_socket* socket, const guac_layer* layer, int width, int height) {
+
+#ifdef ENABLE_VPX
+    guac_video_stream* video;
+    guac_vpx_encoder* encoder;
+
+    /* Video can only be sent if the client supports it */
+    if (!guac_client_supports_video(client))
+        return NULL;
+
+    encoder = guac_vpx_encoder_alloc(width, height);
+    if (encoder == NULL)
+        return NULL;
+
+    /* Allocate stream */
+    video = (guac_video_stream*) calloc(1, sizeof(guac_video_stream));
+    if (video == NULL) {
+        guac_vpx_encoder_free(encoder);
+        return NULL;
+    }
+
+    video->client = client;
+    video->socket = socket;
+    video->layer = layer;
+    video->width = width;
+    video->height = height;
+    video->data = encoder;
+    video->stream = guac_client_alloc_stream(client);
+
+    /* Begin video stream */
+    guac_protocol_send_video(socket, video->stream, layer,
+            GUAC_VIDEO_MIMETYPE);
+
+    return video;
+#else
+    /* Support for video is completely absent */
+    return NULL;
+#endif
+
+}
+
+int guac_video_stream_write(guac_video_stream* video, cairo_surface_t* frame) {
+
+#ifdef ENABLE_VPX
+    guac_timestamp now = guac_timestamp_current();
+
+    /* Frames are timed relative to the first */
+    if (video->start == 0)
+        video->start = now;
+
+    return guac_vpx_encoder_write((guac_vpx_encoder*) video->data,
+            video->socket, video->stream, frame, now - video->start);
+#else
+    return 1;
+#endif
+
+}
+
+void guac_video_stream_free(guac_video_stream* video) {
+
+#ifdef ENABLE_VPX
+    /* End stream */
+    guac_protocol_send_end(video->socket, video->stream);
+    guac_client_free_stream(video->client, video->stream);
+
+    guac_vpx_encoder_free((guac_vpx_encoder*) video->data);
+#endif
+
+    free(video);
+
+}
+
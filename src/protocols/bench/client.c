@@ -0,0 +1,200 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "client.h"
+#include "guac_handlers.h"
+#include "guac_surface.h"
+#include "workload.h"
+
+#include <guacamole/client.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+#include <limits.h>
+#include <stdlib.h>
+
+/**
+ * The smallest display width or height supported, in pixels.
+ */
+#define GUAC_BENCH_MIN_DIMENSION 64
+
+/**
+ * The largest display width or height supported, in pixels.
+ */
+#define GUAC_BENCH_MAX_DIMENSION 8192
+
+/* Client plugin arguments */
+const char* GUAC_CLIENT_ARGS[] = {
+    "workload",
+    "width",
+    "height",
+    "frame-rate",
+    "duration",
+    "encoder-threads",
+    NULL
+};
+
+enum BENCH_ARGS_IDX {
+
+    /**
+     * The name of the workload to run: "terminal", "drag", "video", or
+     * "idle". Optional. Defaults to "terminal".
+     */
+    IDX_WORKLOAD,
+
+    /**
+     * The width of the display, in pixels. Optional. Defaults to the optimal
+     * width of the connecting client.
+     */
+    IDX_WIDTH,
+
+    /**
+     * The height of the display, in pixels. Optional. Defaults to the optimal
+     * height of the connecting client.
+     */
+    IDX_HEIGHT,
+
+    /**
+     * The number of frames to render per second. Optional.
+     */
+    IDX_FRAME_RATE,
+
+    /**
+     * The number of seconds to run before disconnecting. Optional. By
+     * default, the workload runs until the user disconnects.
+     */
+    IDX_DURATION,
+
+    /**
+     * The number of threads to use to encode images. Optional. By default,
+     * the number of threads configured for guacd is used.
+     */
+    IDX_ENCODER_THREADS,
+
+    BENCH_ARGS_COUNT
+};
+
+/**
+ * Parses the given integer argument, returning the given default value if
+ * the argument is blank, and clamping the result to the given range.
+ */
+static int guac_bench_parse_int(const char* value, int default_value,
+        int min, int max) {
+
+    int parsed = default_value;
+
+    if (value[0] != '\0')
+        parsed = atoi(value);
+
+    if (parsed < min)
+        return min;
+
+    if (parsed > max)
+        return max;
+
+    return parsed;
+
+}
+
+int guac_client_init(guac_client* client, int argc, char** argv) {
+
+    guac_bench_client_data* client_data;
+    const guac_bench_workload* workload;
+    const char* workload_name;
+
+    if (argc != BENCH_ARGS_COUNT) {
+        guac_client_abort(client, GUAC_PROTOCOL_STATUS_SERVER_ERROR,
+                "Wrong number of arguments");
+        return -1;
+    }
+
+    /* Look up workload */
+    workload_name = argv[IDX_WORKLOAD];
+    if (workload_name[0] == '\0')
+        workload_name = GUAC_BENCH_DEFAULT_WORKLOAD;
+
+    workload = guac_bench_get_workload(workload_name);
+    if (workload == NULL) {
+        guac_client_abort(client, GUAC_PROTOCOL_STATUS_CLIENT_BAD_REQUEST,
+                "Unknown workload: \"%s\"", workload_name);
+        return -1;
+    }
+
+    /* Init client data */
+    client_data = calloc(1, sizeof(guac_bench_client_data));
+    client->data = client_data;
+
+    client_data->workload = workload;
+    client_data->random_state = 1;
+
+    client_data->width = guac_bench_parse_int(argv[IDX_WIDTH],
+            client->info.optimal_width,
+            GUAC_BENCH_MIN_DIMENSION, GUAC_BENCH_MAX_DIMENSION);
+
+    client_data->height = guac_bench_parse_int(argv[IDX_HEIGHT],
+            client->info.optimal_height,
+            GUAC_BENCH_MIN_DIMENSION, GUAC_BENCH_MAX_DIMENSION);
+
+    client_data->frame_rate = guac_bench_parse_int(argv[IDX_FRAME_RATE],
+            GUAC_BENCH_DEFAULT_FRAME_RATE, 1, GUAC_BENCH_MAX_FRAME_RATE);
+
+    client_data->duration = guac_bench_parse_int(argv[IDX_DURATION],
+            0, 0, INT_MAX / 1000);
+
+    client->encoder_threads = guac_bench_parse_int(argv[IDX_ENCODER_THREADS],
+            client->encoder_threads, 1, GUAC_CLIENT_MAX_ENCODER_THREADS);
+
+    guac_client_log(client, GUAC_LOG_INFO,
+            "Running \"%s\" workload at %ix%i, %i frames per second, "
+            "%i encoder thread(s)", workload->name, client_data->width,
+            client_data->height, client_data->frame_rate,
+            client->encoder_threads);
+
+    /* Set up display */
+    guac_protocol_send_name(client->socket, workload->name);
+    client_data->default_surface = guac_common_surface_alloc(client,
+            client->socket, GUAC_DEFAULT_LAYER,
+            client_data->width, client_data->height);
+
+    /* Set handlers before workload init such that partially-initialized
+     * data is still freed on failure */
+    client->handle_messages = guac_bench_client_handle_messages;
+    client->free_handler    = guac_bench_client_free_handler;
+
+    if (workload->init_handler(client)) {
+        guac_client_abort(client, GUAC_PROTOCOL_STATUS_SERVER_ERROR,
+                "Unable to initialize workload");
+        return -1;
+    }
+
+    guac_common_surface_flush(client_data->default_surface);
+    guac_socket_flush(client->socket);
+
+    client_data->start = guac_timestamp_current();
+
+    /* Success */
+    return 0;
+
+}
+
@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef GUAC_BENCH_CLIENT_H
+#define GUAC_BENCH_CLIENT_H
+
+#include "config.h"
+
+#include "guac_surface.h"
+#include "workload.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/timestamp.h>
+
+#include <stdint.h>
+
+/**
+ * The default number of frames to render per second.
+ */
+#define GUAC_BENCH_DEFAULT_FRAME_RATE 30
+
+/**
+ * The maximum number of frames to render per second.
+ */
+#define GUAC_BENCH_MAX_FRAME_RATE 1000
+
+/**
+ * The name of the workload to run if none is specified.
+ */
+#define GUAC_BENCH_DEFAULT_WORKLOAD "terminal"
+
+/**
+ * Bench-specific client data.
+ */
+typedef struct guac_bench_client_data {
+
+    /**
+     * The workload which renders each frame.
+     */
+    const guac_bench_workload* workload;
+
+    /**
+     * The width of the display, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of the display, in pixels.
+     */
+    int height;
+
+    /**
+     * The number of frames to render per second.
+     */
+    int frame_rate;
+
+    /**
+     * The number of seconds to run before ending the connection, or zero to
+     * run until the user disconnects.
+     */
+    int duration;
+
+    /**
+     * The surface backing the default layer.
+     */
+    guac_common_surface* default_surface;
+
+    /**
+     * Scratch image used by the workload for rendering new content, or NULL
+     * if the workload has not allocated one.
+     */
+    cairo_surface_t* scratch;
+
+    /**
+     * The time that the first frame was rendered.
+     */
+    guac_timestamp start;
+
+    /**
+     * The number of frames rendered thus far.
+     */
+    int frame;
+
+    /**
+     * The current location of any moving content, such as a dragged window.
+     */
+    int x;
+
+    /**
+     * The current location of any moving content, such as a dragged window.
+     */
+    int y;
+
+    /**
+     * The current state of the random number generator used for generated
+     * content.
+     */
+    uint32_t random_state;
+
+} guac_bench_client_data;
+
+#endif
+
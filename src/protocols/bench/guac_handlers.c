@@ -0,0 +1,104 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "client.h"
+#include "guac_handlers.h"
+#include "guac_surface.h"
+#include "workload.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/timestamp.h>
+
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * Sleeps for the given number of milliseconds.
+ */
+static void guac_bench_sleep(int millis) {
+
+    struct timespec sleep_period;
+
+    sleep_period.tv_sec =   millis / 1000;
+    sleep_period.tv_nsec = (millis % 1000) * 1000000L;
+
+    nanosleep(&sleep_period, NULL);
+
+}
+
+int guac_bench_client_handle_messages(guac_client* client) {
+
+    guac_bench_client_data* client_data =
+        (guac_bench_client_data*) client->data;
+
+    guac_timestamp now = guac_timestamp_current();
+    guac_timestamp elapsed = now - client_data->start;
+
+    /* Time at which the next frame is due, relative to start */
+    guac_timestamp due = (guac_timestamp) client_data->frame * 1000
+                       / client_data->frame_rate;
+
+    /* End connection once duration has elapsed */
+    if (client_data->duration > 0
+            && elapsed >= (guac_timestamp) client_data->duration * 1000) {
+        guac_client_log(client, GUAC_LOG_INFO,
+                "Workload complete after %i frames", client_data->frame);
+        guac_client_stop(client);
+        return 0;
+    }
+
+    /* Wait until next frame is due */
+    if (due > elapsed)
+        guac_bench_sleep(due - elapsed);
+
+    /* If more than a frame behind, such as while guacd awaits a sync from
+     * a slow client, drop the missed frames rather than rendering a burst */
+    else if (elapsed - due > 1000 / client_data->frame_rate)
+        client_data->frame = elapsed * client_data->frame_rate / 1000;
+
+    client_data->workload->frame_handler(client);
+    guac_common_surface_flush(client_data->default_surface);
+
+    client_data->frame++;
+    return 0;
+
+}
+
+int guac_bench_client_free_handler(guac_client* client) {
+
+    guac_bench_client_data* client_data =
+        (guac_bench_client_data*) client->data;
+
+    if (client_data->scratch != NULL)
+        cairo_surface_destroy(client_data->scratch);
+
+    if (client_data->default_surface != NULL)
+        guac_common_surface_free(client_data->default_surface);
+
+    free(client_data);
+    return 0;
+
+}
+
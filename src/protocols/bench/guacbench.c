@@ -0,0 +1,747 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+/*
+ * guacbench: a headless Guacamole client which opens any number of
+ * concurrent connections to guacd using the "bench" protocol, behaving as a
+ * well-behaved client (acknowledging each frame with a "sync") while
+ * recording the bytes, frames, and latency observed by each connection.
+ */
+
+#include "config.h"
+
+#include <guacamole/error.h>
+#include <guacamole/parser.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+#include <errno.h>
+#include <getopt.h>
+#include <inttypes.h>
+#include <netdb.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+/**
+ * The number of microseconds to wait for each instruction during the
+ * handshake before giving up.
+ */
+#define GUACBENCH_HANDSHAKE_TIMEOUT 15000000
+
+/**
+ * The number of microseconds to wait for each instruction once connected,
+ * after which the duration of the run is rechecked.
+ */
+#define GUACBENCH_READ_TIMEOUT 100000
+
+/**
+ * The size of the receive buffer of each connection, in bytes, while the
+ * rate at which data is read is limited. A small buffer ensures that data
+ * which cannot yet be read backs up to guacd, as it would over a slow link.
+ */
+#define GUACBENCH_LIMITED_RECEIVE_BUFFER 65536
+
+/**
+ * The number of times per second that data is read while the rate at which
+ * data is read is limited.
+ */
+#define GUACBENCH_LIMITED_READS_PER_SECOND 100
+
+/**
+ * The configuration shared by all sessions.
+ */
+typedef struct guacbench_config {
+
+    /**
+     * The hostname or address of guacd.
+     */
+    const char* host;
+
+    /**
+     * The port that guacd is listening on.
+     */
+    const char* port;
+
+    /**
+     * The number of concurrent sessions to run.
+     */
+    int sessions;
+
+    /**
+     * The number of seconds to run each session.
+     */
+    int duration;
+
+    /**
+     * The maximum rate at which each session reads data from guacd, in bytes
+     * per second, or zero if reads are not limited.
+     */
+    int bandwidth;
+
+    /**
+     * The value of each "bench" protocol argument, as a NULL-terminated
+     * array of name/value pairs.
+     */
+    const char* args[12];
+
+    /**
+     * The width of the display to request, as a string.
+     */
+    const char* width;
+
+    /**
+     * The height of the display to request, as a string.
+     */
+    const char* height;
+
+} guacbench_config;
+
+/**
+ * The state and results of a single session.
+ */
+typedef struct guacbench_session {
+
+    /**
+     * The configuration of this session.
+     */
+    const guacbench_config* config;
+
+    /**
+     * The thread running this session.
+     */
+    pthread_t thread;
+
+    /**
+     * The file descriptor of the connection to guacd.
+     */
+    int fd;
+
+    /**
+     * The total number of bytes received from guacd.
+     */
+    uint64_t bytes;
+
+    /**
+     * The time that the first data was received from guacd, or zero if no
+     * data has yet been received.
+     */
+    guac_timestamp read_start;
+
+    /**
+     * The total number of frames received (and acknowledged) from guacd.
+     */
+    int frames;
+
+    /**
+     * The sum of the latencies of all frames, in milliseconds. The latency of
+     * each frame is the difference between the time its "sync" was received
+     * and the timestamp within that "sync".
+     */
+    guac_timestamp latency_total;
+
+    /**
+     * The largest latency of any frame, in milliseconds.
+     */
+    guac_timestamp latency_max;
+
+    /**
+     * The number of milliseconds between receiving "ready" and the end of
+     * the session.
+     */
+    guac_timestamp elapsed;
+
+    /**
+     * Non-zero if this session failed.
+     */
+    int failed;
+
+} guacbench_session;
+
+/**
+ * Read handler which reads from the session connection, counting all bytes
+ * received.
+ */
+static ssize_t guacbench_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    guacbench_session* session = (guacbench_session*) socket->data;
+    int bandwidth = session->config->bandwidth;
+
+    /* Read in small pieces if limiting bandwidth */
+    if (bandwidth > 0) {
+        size_t limit = bandwidth / GUACBENCH_LIMITED_READS_PER_SECOND + 1;
+        if (count > limit)
+            count = limit;
+    }
+
+    ssize_t length = read(session->fd, buf, count);
+    if (length < 0) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Error reading data from guacd";
+        return -1;
+    }
+
+    if (session->read_start == 0)
+        session->read_start = guac_timestamp_current();
+
+    session->bytes += length;
+
+    /* Wait until the data read would have arrived over the limited link */
+    if (bandwidth > 0) {
+
+        guac_timestamp due = session->read_start
+                           + session->bytes * 1000 / bandwidth;
+
+        guac_timestamp now = guac_timestamp_current();
+        if (due > now) {
+            struct timespec delay = {
+                .tv_sec  =  (due - now) / 1000,
+                .tv_nsec = ((due - now) % 1000) * 1000000L
+            };
+            nanosleep(&delay, NULL);
+        }
+
+    }
+
+    return length;
+
+}
+
+/**
+ * Write handler which writes all given data to the session connection.
+ */
+static ssize_t guacbench_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    guacbench_session* session = (guacbench_session*) socket->data;
+    const char* current = (const char*) buf;
+    size_t remaining = count;
+
+    while (remaining > 0) {
+
+        ssize_t written = write(session->fd, current, remaining);
+        if (written < 0) {
+            guac_error = GUAC_STATUS_SEE_ERRNO;
+            guac_error_message = "Error writing data to guacd";
+            return -1;
+        }
+
+        current += written;
+        remaining -= written;
+
+    }
+
+    return count;
+
+}
+
+/**
+ * Select handler which waits for data on the session connection.
+ */
+static int guacbench_select_handler(guac_socket* socket, int usec_timeout) {
+
+    guacbench_session* session = (guacbench_session*) socket->data;
+    struct pollfd fds = { .fd = session->fd, .events = POLLIN };
+
+    int retval = poll(&fds, 1, usec_timeout / 1000);
+    if (retval < 0) {
+        guac_error = GUAC_STATUS_SEE_ERRNO;
+        guac_error_message = "Error while waiting for data from guacd";
+        return -1;
+    }
+
+    if (retval == 0) {
+        guac_error = GUAC_STATUS_TIMEOUT;
+        guac_error_message = "Timeout while waiting for data from guacd";
+    }
+
+    return retval;
+
+}
+
+/**
+ * Opens a TCP connection to guacd, returning the file descriptor of the
+ * connection, or -1 if the connection could not be opened.
+ */
+static int guacbench_connect(const guacbench_config* config) {
+
+    struct addrinfo hints = {
+        .ai_family   = AF_UNSPEC,
+        .ai_socktype = SOCK_STREAM,
+        .ai_protocol = IPPROTO_TCP
+    };
+
+    struct addrinfo* addresses;
+    struct addrinfo* current;
+    int fd = -1;
+
+    int retval = getaddrinfo(config->host, config->port, &hints, &addresses);
+    if (retval) {
+        fprintf(stderr, "Unable to resolve \"%s\": %s\n", config->host,
+                gai_strerror(retval));
+        return -1;
+    }
+
+    /* Use first address which accepts the connection */
+    for (current = addresses; current != NULL; current = current->ai_next) {
+
+        fd = socket(current->ai_family, current->ai_socktype,
+                current->ai_protocol);
+        if (fd < 0)
+            continue;
+
+        /* Let unread data back up to guacd if limiting bandwidth */
+        if (config->bandwidth > 0) {
+            int size = GUACBENCH_LIMITED_RECEIVE_BUFFER;
+            setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size));
+        }
+
+        if (connect(fd, current->ai_addr, current->ai_addrlen) == 0)
+            break;
+
+        close(fd);
+        fd = -1;
+
+    }
+
+    if (fd < 0)
+        fprintf(stderr, "Unable to connect to guacd at %s:%s: %s\n",
+                config->host, config->port, strerror(errno));
+
+    freeaddrinfo(addresses);
+    return fd;
+
+}
+
+/**
+ * Sends an instruction having the given opcode and arguments. All values
+ * must be ASCII, such that their lengths in bytes are also their lengths in
+ * characters.
+ */
+static int guacbench_send(guac_socket* socket, const char* opcode,
+        int argc, const char** argv) {
+
+    int i;
+
+    if (guac_socket_write_int(socket, strlen(opcode))
+            || guac_socket_write_string(socket, ".")
+            || guac_socket_write_string(socket, opcode))
+        return -1;
+
+    for (i = 0; i < argc; i++) {
+        if (guac_socket_write_string(socket, ",")
+                || guac_socket_write_int(socket, strlen(argv[i]))
+                || guac_socket_write_string(socket, ".")
+                || guac_socket_write_string(socket, argv[i]))
+            return -1;
+    }
+
+    return guac_socket_write_string(socket, ";");
+
+}
+
+/**
+ * Returns the value of the protocol argument having the given name, or an
+ * empty string if no value was specified.
+ */
+static const char* guacbench_get_arg(const guacbench_config* config,
+        const char* name) {
+
+    const char* const* current = config->args;
+
+    while (*current != NULL) {
+
+        if (strcmp(current[0], name) == 0)
+            return current[1];
+
+        current += 2;
+    }
+
+    return "";
+
+}
+
+/**
+ * Performs the Guacamole protocol handshake, selecting the "bench" protocol
+ * and providing the configured arguments.
+ */
+static int guacbench_handshake(guacbench_session* session,
+        guac_parser* parser, guac_socket* socket) {
+
+    const guacbench_config* config = session->config;
+
+    const char* select[] = { "bench" };
+    const char* size[] = { config->width, config->height, "96" };
+    const char* image[] = { "image/png", "image/jpeg", "image/webp" };
+    const char* connect[16];
+
+    int i;
+
+    /* Select protocol and await argument names */
+    if (guacbench_send(socket, "select", 1, select)
+            || guac_socket_flush(socket)
+            || guac_parser_expect(parser, socket,
+                GUACBENCH_HANDSHAKE_TIMEOUT, "args"))
+        return 1;
+
+    if (parser->argc > (int) (sizeof(connect) / sizeof(connect[0]))) {
+        guac_error = GUAC_STATUS_PROTOCOL_ERROR;
+        guac_error_message = "Too many protocol arguments";
+        return 1;
+    }
+
+    /* Provide value for each requested argument */
+    for (i = 0; i < parser->argc; i++)
+        connect[i] = guacbench_get_arg(config, parser->argv[i]);
+
+    /* Complete handshake and await connection ID */
+    if (guacbench_send(socket, "size", 3, size)
+            || guacbench_send(socket, "audio", 0, NULL)
+            || guacbench_send(socket, "video", 0, NULL)
+            || guacbench_send(socket, "image", 3, image)
+            || guacbench_send(socket, "connect", parser->argc, connect)
+            || guac_socket_flush(socket)
+            || guac_parser_expect(parser, socket,
+                GUACBENCH_HANDSHAKE_TIMEOUT, "ready"))
+        return 1;
+
+    return 0;
+
+}
+
+/**
+ * Receives and acknowledges frames until the configured duration has
+ * elapsed, guacd disconnects, or an error occurs.
+ */
+static int guacbench_receive(guacbench_session* session,
+        guac_parser* parser, guac_socket* socket) {
+
+    guac_timestamp start = guac_timestamp_current();
+    guac_timestamp end = start + (guac_timestamp) session->config->duration
+                                                * 1000;
+
+    guac_timestamp now;
+    int closed = 0;
+    int result = 0;
+
+    while ((now = guac_timestamp_current()) < end) {
+
+        /* Recheck duration periodically while idle */
+        if (guac_parser_read(parser, socket, GUACBENCH_READ_TIMEOUT)) {
+
+            if (guac_error == GUAC_STATUS_TIMEOUT)
+                continue;
+
+            /* guacd may simply close the connection once finished */
+            if (guac_error == GUAC_STATUS_CLOSED) {
+                closed = 1;
+                break;
+            }
+
+            result = 1;
+            break;
+
+        }
+
+        /* Acknowledge each frame, recording its latency */
+        if (strcmp(parser->opcode, "sync") == 0 && parser->argc >= 1) {
+
+            guac_timestamp timestamp = strtoll(parser->argv[0], NULL, 10);
+            guac_timestamp latency = guac_timestamp_current() - timestamp;
+
+            session->frames++;
+            session->latency_total += latency;
+            if (latency > session->latency_max)
+                session->latency_max = latency;
+
+            if (guac_protocol_send_sync(socket, timestamp)
+                    || guac_socket_flush(socket)) {
+                result = 1;
+                break;
+            }
+
+        }
+
+        /* Stop if guacd has ended the connection */
+        else if (strcmp(parser->opcode, "error") == 0
+                || strcmp(parser->opcode, "disconnect") == 0) {
+            closed = 1;
+            break;
+        }
+
+    }
+
+    session->elapsed = guac_timestamp_current() - start;
+
+    /* Disconnect cleanly if still connected */
+    if (!result && !closed) {
+        guacbench_send(socket, "disconnect", 0, NULL);
+        guac_socket_flush(socket);
+    }
+
+    return result;
+
+}
+
+/**
+ * Runs a single session from start to finish.
+ */
+static void* guacbench_session_thread(void* data) {
+
+    guacbench_session* session = (guacbench_session*) data;
+    guac_socket* socket;
+    guac_parser* parser;
+
+    session->fd = guacbench_connect(session->config);
+    if (session->fd < 0) {
+        session->failed = 1;
+        return NULL;
+    }
+
+    socket = guac_socket_alloc(0, NULL);
+    parser = guac_parser_alloc();
+
+    socket->data = session;
+    socket->read_handler   = guacbench_read_handler;
+    socket->write_handler  = guacbench_write_handler;
+    socket->select_handler = guacbench_select_handler;
+
+    if (guacbench_handshake(session, parser, socket)) {
+        fprintf(stderr, "Handshake failed: %s\n",
+                guac_status_string(guac_error));
+        session->failed = 1;
+    }
+
+    else if (guacbench_receive(session, parser, socket)) {
+        fprintf(stderr, "Session failed: %s\n",
+                guac_status_string(guac_error));
+        session->failed = 1;
+    }
+
+    guac_parser_free(parser);
+    guac_socket_free(socket);
+    close(session->fd);
+
+    return NULL;
+
+}
+
+/**
+ * Prints a single line of results.
+ */
+static void guacbench_print(const char* name, uint64_t bytes, int frames,
+        guac_timestamp elapsed, double fps, guac_timestamp latency_total,
+        guac_timestamp latency_max) {
+
+    double seconds = elapsed / 1000.0;
+
+    printf("%s\t%" PRIu64 "\t%i\t%.3f\t%.3f\t%.2f\t%.2f\t%" PRId64 "\n",
+            name, bytes, frames, seconds,
+            seconds > 0 ? bytes / seconds / 1000000.0 : 0.0, fps,
+            frames > 0 ? (double) latency_total / frames : 0.0,
+            latency_max);
+
+}
+
+/**
+ * Prints usage information for this program to STDERR.
+ */
+static void guacbench_usage(const char* program) {
+    fprintf(stderr, "Usage: %s [-h HOST] [-p PORT] [-n SESSIONS] "
+            "[-t SECONDS] [-w WORKLOAD] [-W WIDTH] [-H HEIGHT] "
+            "[-r FRAME_RATE] [-e ENCODER_THREADS] "
+            "[-b KILOBYTES_PER_SECOND]\n", program);
+}
+
+int main(int argc, char** argv) {
+
+    guacbench_config config = {
+        .host     = "localhost",
+        .port     = "4822",
+        .sessions = 1,
+        .duration = 10,
+        .width    = "1024",
+        .height   = "768"
+    };
+
+    const char* workload = "terminal";
+    const char* frame_rate = "";
+    const char* encoder_threads = "";
+
+    guacbench_session* sessions;
+    uint64_t total_bytes = 0;
+    int total_frames = 0;
+    guac_timestamp total_latency = 0;
+    guac_timestamp max_latency = 0;
+    guac_timestamp max_elapsed = 0;
+    double total_fps = 0;
+    int failures = 0;
+
+    int opt;
+    int i;
+
+    while ((opt = getopt(argc, argv, "h:p:n:t:w:W:H:r:e:b:")) != -1) {
+
+        /* -h: guacd host */
+        if (opt == 'h')
+            config.host = optarg;
+
+        /* -p: guacd port */
+        else if (opt == 'p')
+            config.port = optarg;
+
+        /* -n: Number of concurrent sessions */
+        else if (opt == 'n')
+            config.sessions = atoi(optarg);
+
+        /* -t: Duration of each session */
+        else if (opt == 't')
+            config.duration = atoi(optarg);
+
+        /* -w: Workload */
+        else if (opt == 'w')
+            workload = optarg;
+
+        /* -W: Display width */
+        else if (opt == 'W')
+            config.width = optarg;
+
+        /* -H: Display height */
+        else if (opt == 'H')
+            config.height = optarg;
+
+        /* -r: Frame rate */
+        else if (opt == 'r')
+            frame_rate = optarg;
+
+        /* -e: Image encoding threads */
+        else if (opt == 'e')
+            encoder_threads = optarg;
+
+        /* -b: Simulated link bandwidth */
+        else if (opt == 'b')
+            config.bandwidth = atoi(optarg) * 1000;
+
+        else {
+            guacbench_usage(argv[0]);
+            return 1;
+        }
+
+    }
+
+    if (config.sessions <= 0 || config.duration <= 0
+            || config.bandwidth < 0) {
+        guacbench_usage(argv[0]);
+        return 1;
+    }
+
+    /* Write failures are handled through errno, not signals */
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Arguments of the "bench" protocol */
+    config.args[0]  = "workload";        config.args[1] = workload;
+    config.args[2]  = "width";           config.args[3] = config.width;
+    config.args[4]  = "height";          config.args[5] = config.height;
+    config.args[6]  = "frame-rate";      config.args[7] = frame_rate;
+    config.args[8]  = "encoder-threads"; config.args[9] = encoder_threads;
+    config.args[10] = NULL;
+
+    sessions = calloc(config.sessions, sizeof(guacbench_session));
+
+    /* Start all sessions at once */
+    for (i = 0; i < config.sessions; i++) {
+
+        sessions[i].config = &config;
+
+        if (pthread_create(&sessions[i].thread, NULL,
+                    guacbench_session_thread, &sessions[i])) {
+            fprintf(stderr, "Unable to start session %i\n", i);
+            config.sessions = i;
+            break;
+        }
+
+    }
+
+    /* Results are tab-separated, with comment lines beginning with "#" */
+    printf("# workload=%s width=%s height=%s sessions=%i bandwidth=%i\n",
+            workload, config.width, config.height, config.sessions,
+            config.bandwidth);
+    printf("# session\tbytes\tframes\tseconds\tmb_per_s\tfps"
+            "\tlatency_avg_ms\tlatency_max_ms\n");
+
+    for (i = 0; i < config.sessions; i++) {
+
+        char name[16];
+        guacbench_session* session = &sessions[i];
+        double fps;
+
+        pthread_join(session->thread, NULL);
+
+        if (session->failed) {
+            failures++;
+            continue;
+        }
+
+        fps = session->elapsed > 0
+            ? session->frames * 1000.0 / session->elapsed : 0.0;
+
+        snprintf(name, sizeof(name), "%i", i);
+        guacbench_print(name, session->bytes, session->frames,
+                session->elapsed, fps, session->latency_total,
+                session->latency_max);
+
+        total_bytes += session->bytes;
+        total_frames += session->frames;
+        total_latency += session->latency_total;
+        total_fps += fps;
+
+        if (session->latency_max > max_latency)
+            max_latency = session->latency_max;
+
+        if (session->elapsed > max_elapsed)
+            max_elapsed = session->elapsed;
+
+    }
+
+    /* Aggregate throughput and frame rate across all sessions */
+    guacbench_print("total", total_bytes, total_frames, max_elapsed,
+            total_fps, total_latency, max_latency);
+
+    if (failures)
+        fprintf(stderr, "%i of %i sessions failed\n", failures,
+                config.sessions);
+
+    free(sessions);
+    return failures != 0;
+
+}
+
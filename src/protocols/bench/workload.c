@@ -0,0 +1,394 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "client.h"
+#include "guac_surface.h"
+#include "workload.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The width of each character of generated text, in pixels.
+ */
+#define GUAC_BENCH_CHAR_WIDTH 8
+
+/**
+ * The height of each line of generated text, in pixels.
+ */
+#define GUAC_BENCH_LINE_HEIGHT 16
+
+/**
+ * The height of the title bar of generated windows, in pixels.
+ */
+#define GUAC_BENCH_TITLE_HEIGHT 24
+
+/**
+ * The number of pixels a dragged window moves horizontally each frame.
+ */
+#define GUAC_BENCH_DRAG_STEP_X 8
+
+/**
+ * The number of pixels a dragged window moves vertically each frame.
+ */
+#define GUAC_BENCH_DRAG_STEP_Y 4
+
+/**
+ * The colour of the desktop background, as RGB components.
+ */
+#define GUAC_BENCH_DESKTOP_RED   0x30
+#define GUAC_BENCH_DESKTOP_GREEN 0x5A
+#define GUAC_BENCH_DESKTOP_BLUE  0x8C
+
+/**
+ * Returns the next value of a simple linear congruential generator, such
+ * that generated content is identical across runs and platforms.
+ *
+ * @param state
+ *     The current state of the generator, which will be updated.
+ *
+ * @return
+ *     The next pseudo-random value, between 0 and 65535 inclusive.
+ */
+static unsigned int guac_bench_random(uint32_t* state) {
+    *state = *state * 1103515245 + 12345;
+    return (*state >> 16) & 0xFFFF;
+}
+
+/**
+ * Fills the given rectangle of an RGB24 image with a single colour.
+ */
+static void guac_bench_fill(cairo_surface_t* image, int x, int y, int w,
+        int h, uint32_t color) {
+
+    unsigned char* data = cairo_image_surface_get_data(image);
+    int stride = cairo_image_surface_get_stride(image);
+    int dx, dy;
+
+    for (dy = y; dy < y + h; dy++) {
+        uint32_t* row = (uint32_t*) (data + dy * stride);
+        for (dx = x; dx < x + w; dx++)
+            row[dx] = color;
+    }
+
+}
+
+/**
+ * Renders a line of pseudo-random text into the given RGB24 image. Each
+ * glyph is a random arrangement of vertical and horizontal strokes, and lines
+ * and words vary in length, approximating the structure of real text.
+ */
+static void guac_bench_render_text(cairo_surface_t* image, int x, int y,
+        int width, uint32_t foreground, uint32_t highlight,
+        uint32_t* random_state) {
+
+    unsigned char* data = cairo_image_surface_get_data(image);
+    int stride = cairo_image_surface_get_stride(image);
+
+    int length = guac_bench_random(random_state) % (width + 1);
+    uint32_t color = foreground;
+    int cx;
+
+    for (cx = x; cx + GUAC_BENCH_CHAR_WIDTH <= x + length;
+            cx += GUAC_BENCH_CHAR_WIDTH) {
+
+        int i, j;
+        unsigned int strokes = guac_bench_random(random_state);
+
+        /* Occasionally break words, switching colour */
+        if ((strokes & 0x7) == 0) {
+            color = (strokes & 0x18) ? foreground : highlight;
+            continue;
+        }
+
+        /* Draw 6x10 glyph within 8x16 cell */
+        for (j = 0; j < 10; j++) {
+
+            uint32_t* row = (uint32_t*) (data + (y + 3 + j) * stride);
+
+            for (i = 0; i < 6; i++) {
+
+                if (((strokes >> (i + 3)) & 0x1)
+                        || (j == 0 && (strokes & 0x200))
+                        || (j == 5 && (strokes & 0x400))
+                        || (j == 9 && (strokes & 0x800)))
+                    row[cx + 1 + i] = color;
+
+            }
+
+        }
+
+    }
+
+}
+
+/**
+ * Returns the position along a path which bounces back and forth between
+ * zero and the given range.
+ */
+static int guac_bench_bounce(int position, int range) {
+
+    int period = range * 2;
+
+    if (range <= 0)
+        return 0;
+
+    position %= period;
+    if (position > range)
+        return period - position;
+
+    return position;
+
+}
+
+/**
+ * Allocates the scratch image, returning non-zero if allocation fails.
+ */
+static int guac_bench_alloc_scratch(guac_bench_client_data* data,
+        int width, int height) {
+
+    data->scratch = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            width, height);
+
+    return cairo_surface_status(data->scratch) != CAIRO_STATUS_SUCCESS;
+
+}
+
+static int guac_bench_terminal_init(guac_client* client) {
+
+    guac_bench_client_data* data = (guac_bench_client_data*) client->data;
+
+    if (guac_bench_alloc_scratch(data, data->width, GUAC_BENCH_LINE_HEIGHT))
+        return 1;
+
+    guac_common_surface_rect(data->default_surface, 0, 0,
+            data->width, data->height, 0x00, 0x00, 0x00);
+
+    return 0;
+
+}
+
+static void guac_bench_terminal_frame(guac_client* client) {
+
+    guac_bench_client_data* data = (guac_bench_client_data*) client->data;
+    guac_common_surface* surface = data->default_surface;
+
+    int bottom = data->height - GUAC_BENCH_LINE_HEIGHT;
+
+    /* Scroll up by one line */
+    guac_common_surface_copy(surface, 0, GUAC_BENCH_LINE_HEIGHT,
+            data->width, bottom, surface, 0, 0);
+
+    /* Render new line at bottom */
+    guac_bench_fill(data->scratch, 0, 0, data->width,
+            GUAC_BENCH_LINE_HEIGHT, 0x000000);
+    guac_bench_render_text(data->scratch, 0, 0, data->width, 0xC0C0C0,
+            0x4E9A06, &data->random_state);
+
+    cairo_surface_mark_dirty(data->scratch);
+    guac_common_surface_draw(surface, 0, bottom, data->scratch);
+
+}
+
+static int guac_bench_window_init(guac_client* client) {
+
+    guac_bench_client_data* data = (guac_bench_client_data*) client->data;
+
+    int width = data->width / 2;
+    int height = data->height / 2;
+    int y;
+
+    if (guac_bench_alloc_scratch(data, width, height))
+        return 1;
+
+    /* Title bar and body */
+    guac_bench_fill(data->scratch, 0, 0, width, GUAC_BENCH_TITLE_HEIGHT,
+            0x3465A4);
+    guac_bench_fill(data->scratch, 0, GUAC_BENCH_TITLE_HEIGHT, width,
+            height - GUAC_BENCH_TITLE_HEIGHT, 0xFFFFFF);
+
+    /* Text within body */
+    for (y = GUAC_BENCH_TITLE_HEIGHT;
+            y + GUAC_BENCH_LINE_HEIGHT <= height;
+            y += GUAC_BENCH_LINE_HEIGHT)
+        guac_bench_render_text(data->scratch, 0, y, width, 0x202020,
+                0xA40000, &data->random_state);
+
+    cairo_surface_mark_dirty(data->scratch);
+
+    /* Draw window on desktop */
+    guac_common_surface_rect(data->default_surface, 0, 0,
+            data->width, data->height, GUAC_BENCH_DESKTOP_RED,
+            GUAC_BENCH_DESKTOP_GREEN, GUAC_BENCH_DESKTOP_BLUE);
+
+    data->x = 0;
+    data->y = 0;
+    guac_common_surface_draw(data->default_surface, data->x, data->y,
+            data->scratch);
+
+    return 0;
+
+}
+
+static void guac_bench_drag_frame(guac_client* client) {
+
+    guac_bench_client_data* data = (guac_bench_client_data*) client->data;
+    guac_common_surface* surface = data->default_surface;
+
+    int width = cairo_image_surface_get_width(data->scratch);
+    int height = cairo_image_surface_get_height(data->scratch);
+
+    int x = guac_bench_bounce(data->frame * GUAC_BENCH_DRAG_STEP_X,
+            data->width - width);
+    int y = guac_bench_bounce(data->frame * GUAC_BENCH_DRAG_STEP_Y,
+            data->height - height);
+
+    int dx = x - data->x;
+    int dy = y - data->y;
+
+    /* Move window */
+    guac_common_surface_copy(surface, data->x, data->y, width, height,
+            surface, x, y);
+
+    /* Repaint desktop exposed horizontally */
+    if (dx > 0)
+        guac_common_surface_rect(surface, data->x, data->y, dx, height,
+                GUAC_BENCH_DESKTOP_RED, GUAC_BENCH_DESKTOP_GREEN,
+                GUAC_BENCH_DESKTOP_BLUE);
+    else if (dx < 0)
+        guac_common_surface_rect(surface, x + width, data->y, -dx, height,
+                GUAC_BENCH_DESKTOP_RED, GUAC_BENCH_DESKTOP_GREEN,
+                GUAC_BENCH_DESKTOP_BLUE);
+
+    /* Repaint desktop exposed vertically */
+    if (dy > 0)
+        guac_common_surface_rect(surface, data->x, data->y, width, dy,
+                GUAC_BENCH_DESKTOP_RED, GUAC_BENCH_DESKTOP_GREEN,
+                GUAC_BENCH_DESKTOP_BLUE);
+    else if (dy < 0)
+        guac_common_surface_rect(surface, data->x, y + height, width, -dy,
+                GUAC_BENCH_DESKTOP_RED, GUAC_BENCH_DESKTOP_GREEN,
+                GUAC_BENCH_DESKTOP_BLUE);
+
+    data->x = x;
+    data->y = y;
+
+}
+
+static int guac_bench_video_init(guac_client* client) {
+
+    guac_bench_client_data* data = (guac_bench_client_data*) client->data;
+    return guac_bench_alloc_scratch(data, data->width, data->height);
+
+}
+
+static void guac_bench_video_frame(guac_client* client) {
+
+    guac_bench_client_data* data = (guac_bench_client_data*) client->data;
+
+    unsigned char* buffer = cairo_image_surface_get_data(data->scratch);
+    int stride = cairo_image_surface_get_stride(data->scratch);
+    int x, y;
+
+    /* Moving pattern with noise, such that every pixel changes */
+    for (y = 0; y < data->height; y++) {
+
+        uint32_t* row = (uint32_t*) (buffer + y * stride);
+
+        for (x = 0; x < data->width; x++) {
+
+            int noise = guac_bench_random(&data->random_state) & 0x1F;
+            int red   = ((x + data->frame * 4) ^ y) & 0xFF;
+            int green = ((y + data->frame * 2) ^ x) & 0xFF;
+            int blue  = (x + y + data->frame) & 0xFF;
+
+            row[x] = (((red   + noise) & 0xFF) << 16)
+                   | (((green + noise) & 0xFF) << 8)
+                   |  ((blue  + noise) & 0xFF);
+
+        }
+
+    }
+
+    cairo_surface_mark_dirty(data->scratch);
+    guac_common_surface_draw(data->default_surface, 0, 0, data->scratch);
+
+}
+
+static void guac_bench_idle_frame(guac_client* client) {
+
+    guac_bench_client_data* data = (guac_bench_client_data*) client->data;
+
+    /* Blink cursor twice per second */
+    int period = data->frame_rate / 2;
+    if (period < 1)
+        period = 1;
+
+    if (data->frame % period != 0)
+        return;
+
+    /* Cursor sits at the beginning of the first line of the window body */
+    if ((data->frame / period) % 2)
+        guac_common_surface_rect(data->default_surface,
+                0, GUAC_BENCH_TITLE_HEIGHT,
+                GUAC_BENCH_CHAR_WIDTH, GUAC_BENCH_LINE_HEIGHT,
+                0x20, 0x20, 0x20);
+    else
+        guac_common_surface_rect(data->default_surface,
+                0, GUAC_BENCH_TITLE_HEIGHT,
+                GUAC_BENCH_CHAR_WIDTH, GUAC_BENCH_LINE_HEIGHT,
+                0xFF, 0xFF, 0xFF);
+
+}
+
+/**
+ * All available workloads.
+ */
+static const guac_bench_workload guac_bench_workloads[] = {
+    { "terminal", guac_bench_terminal_init, guac_bench_terminal_frame },
+    { "drag",     guac_bench_window_init,   guac_bench_drag_frame     },
+    { "video",    guac_bench_video_init,    guac_bench_video_frame    },
+    { "idle",     guac_bench_window_init,   guac_bench_idle_frame     },
+    { NULL }
+};
+
+const guac_bench_workload* guac_bench_get_workload(const char* name) {
+
+    const guac_bench_workload* current = guac_bench_workloads;
+
+    while (current->name != NULL) {
+
+        if (strcmp(current->name, name) == 0)
+            return current;
+
+        current++;
+    }
+
+    return NULL;
+
+}
+
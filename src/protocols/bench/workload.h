@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef GUAC_BENCH_WORKLOAD_H
+#define GUAC_BENCH_WORKLOAD_H
+
+#include "config.h"
+
+#include <guacamole/client.h>
+
+/**
+ * Handler which prepares the display for a workload, drawing any initial
+ * content and allocating any scratch image the workload requires.
+ *
+ * @param client
+ *     The client whose display should be prepared.
+ *
+ * @return
+ *     Zero on success, non-zero if the workload could not be initialized.
+ */
+typedef int guac_bench_workload_init_handler(guac_client* client);
+
+/**
+ * Handler which renders a single frame of a workload to the default surface.
+ * The surface is flushed after the handler returns.
+ *
+ * @param client
+ *     The client whose display should be updated.
+ */
+typedef void guac_bench_workload_frame_handler(guac_client* client);
+
+/**
+ * A synthetic workload, rendering scripted content which approximates a
+ * particular kind of real-world screen activity.
+ */
+typedef struct guac_bench_workload {
+
+    /**
+     * The name of this workload, as given in the "workload" argument.
+     */
+    const char* name;
+
+    /**
+     * Handler which prepares the display before the first frame.
+     */
+    guac_bench_workload_init_handler* init_handler;
+
+    /**
+     * Handler which renders each frame.
+     */
+    guac_bench_workload_frame_handler* frame_handler;
+
+} guac_bench_workload;
+
+/**
+ * Returns the workload having the given name. Valid names are "terminal"
+ * (continuously scrolling text), "drag" (a window dragged across the
+ * desktop), "video" (full-screen, constantly-changing noise), and "idle"
+ * (a desktop on which only a cursor blinks).
+ *
+ * @param name
+ *     The name of the workload to return.
+ *
+ * @return
+ *     The workload having the given name, or NULL if no such workload
+ *     exists.
+ */
+const guac_bench_workload* guac_bench_get_workload(const char* name);
+
+#endif
+
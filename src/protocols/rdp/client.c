@@ -131,6 +131,7 @@ const char* GUAC_CLIENT_ARGS[] = {
     "enable-menu-animations",
     "preconnection-id",
     "preconnection-blob",
+    "encoder-threads",
 
 #ifdef ENABLE_COMMON_SSH
     "enable-sftp",
@@ -182,6 +183,7 @@ enum RDP_ARGS_IDX {
     IDX_ENABLE_MENU_ANIMATIONS,
     IDX_PRECONNECTION_ID,
     IDX_PRECONNECTION_BLOB,
+    IDX_ENCODER_THREADS,
 
 #ifdef ENABLE_COMMON_SSH
     IDX_ENABLE_SFTP,
@@ -816,6 +818,10 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
     }
 #endif
 
+    /* Override number of image encoding threads, if specified */
+    if (argv[IDX_ENCODER_THREADS][0] != '\0')
+        client->encoder_threads = atoi(argv[IDX_ENCODER_THREADS]);
+
     /* Audio enable/disable */
     guac_client_data->settings.audio_enabled =
         (strcmp(argv[IDX_DISABLE_AUDIO], "true") != 0);
@@ -278,7 +278,8 @@ int rdp_guac_client_handle_messages(guac_client* client) {
 
         /* Calculate time remaining in frame */
         frame_end = guac_timestamp_current();
-        frame_remaining = frame_start + GUAC_RDP_FRAME_DURATION - frame_end;
+        frame_remaining = frame_start + guac_client_get_frame_duration(client,
+                GUAC_RDP_FRAME_DURATION) - frame_end;
 
         /* Wait again if frame remaining */
         if (frame_remaining > 0)
@@ -30,6 +30,7 @@
 #include <freerdp/utils/svc_plugin.h>
 #include <guacamole/client.h>
 #include <guacamole/protocol.h>
+#include <guacamole/stream.h>
 
 #ifdef ENABLE_WINPR
 #include <winpr/stream.h>
@@ -383,6 +384,7 @@ void guac_rdpdr_register_printer(guac_rdpdrPlugin* rdpdr) {
     /* Init data */
     printer_data = malloc(sizeof(guac_rdpdr_printer_data));
     printer_data->stream = guac_client_alloc_stream(rdpdr->client);
+    printer_data->stream->priority = GUAC_STREAM_PRIORITY_BULK;
     device->data = printer_data;
 
 }
@@ -32,6 +32,7 @@
 #include <guacamole/client.h>
 #include <guacamole/protocol.h>
 #include <guacamole/socket.h>
+#include <guacamole/stream.h>
 
 #ifdef ENABLE_WINPR
 #include <winpr/stream.h>
@@ -97,6 +98,7 @@ void guac_svc_process_connect(rdpSvcPlugin* plugin) {
 
     /* Create pipe */
     svc->output_pipe = guac_client_alloc_stream(svc->client);
+    svc->output_pipe->priority = GUAC_STREAM_PRIORITY_BULK;
     guac_protocol_send_pipe(svc->client->socket, svc->output_pipe,
             "application/octet-stream", svc->name);
 
@@ -116,8 +116,9 @@ int guac_rdp_upload_file_handler(guac_client* client, guac_stream* stream,
     rdp_stream->type = GUAC_RDP_UPLOAD_STREAM;
     rdp_stream->upload_status.offset = 0;
     rdp_stream->upload_status.file_id = file_id;
+    rdp_stream->upload_status.failed = 0;
     stream->data = rdp_stream;
-    stream->blob_handler = guac_rdp_upload_blob_handler;
+    stream->blob_chunk_handler = guac_rdp_upload_blob_handler;
     stream->end_handler = guac_rdp_upload_end_handler;
 
     guac_protocol_send_ack(client->socket, stream, "OK (STREAM BEGIN)",
@@ -177,7 +178,7 @@ int guac_rdp_clipboard_handler(guac_client* client, guac_stream* stream,
 }
 
 int guac_rdp_upload_blob_handler(guac_client* client, guac_stream* stream,
-        void* data, int length) {
+        void* data, int length, int final) {
 
     int bytes_written;
     guac_rdp_stream* rdp_stream = (guac_rdp_stream*) stream->data;
@@ -185,14 +186,19 @@ int guac_rdp_upload_blob_handler(guac_client* client, guac_stream* stream,
     /* Get filesystem, return error if no filesystem 0*/
     guac_rdp_fs* fs = ((rdp_guac_client_data*) client->data)->filesystem;
     if (fs == NULL) {
-        guac_protocol_send_ack(client->socket, stream, "FAIL (NO FS)",
-                GUAC_PROTOCOL_STATUS_SERVER_ERROR);
-        guac_socket_flush(client->socket);
+
+        /* Acknowledge only once entire blob is received */
+        if (final) {
+            guac_protocol_send_ack(client->socket, stream, "FAIL (NO FS)",
+                    GUAC_PROTOCOL_STATUS_SERVER_ERROR);
+            guac_socket_flush(client->socket);
+        }
+
         return 0;
     }
 
-    /* Write entire block */
-    while (length > 0) {
+    /* Write entire chunk, unless part of this blob has already failed */
+    while (length > 0 && !rdp_stream->upload_status.failed) {
 
         /* Attempt write */
         bytes_written = guac_rdp_fs_write(fs,
@@ -200,13 +206,10 @@ int guac_rdp_upload_blob_handler(guac_client* client, guac_stream* stream,
                 rdp_stream->upload_status.offset,
                 data, length);
 
-        /* On error, abort */
+        /* On error, discard remainder of blob */
         if (bytes_written < 0) {
-            guac_protocol_send_ack(client->socket, stream,
-                    "FAIL (BAD WRITE)",
-                    GUAC_PROTOCOL_STATUS_CLIENT_FORBIDDEN);
-            guac_socket_flush(client->socket);
-            return 0;
+            rdp_stream->upload_status.failed = 1;
+            break;
         }
 
         /* Update counters */
@@ -216,6 +219,20 @@ int guac_rdp_upload_blob_handler(guac_client* client, guac_stream* stream,
 
     }
 
+    /* Acknowledge only once entire blob is received */
+    if (!final)
+        return 0;
+
+    /* Report any failure, allowing the next blob to be attempted */
+    if (rdp_stream->upload_status.failed) {
+        rdp_stream->upload_status.failed = 0;
+        guac_protocol_send_ack(client->socket, stream,
+                "FAIL (BAD WRITE)",
+                GUAC_PROTOCOL_STATUS_CLIENT_FORBIDDEN);
+        guac_socket_flush(client->socket);
+        return 0;
+    }
+
     guac_protocol_send_ack(client->socket, stream, "OK (DATA RECEIVED)",
             GUAC_PROTOCOL_STATUS_SUCCESS);
     guac_socket_flush(client->socket);
@@ -516,6 +533,7 @@ int guac_rdp_download_get_handler(guac_client* client, guac_object* object,
         guac_stream* stream = guac_client_alloc_stream(client);
         stream->data = rdp_stream;
         stream->ack_handler = guac_rdp_download_ack_handler;
+        stream->priority = GUAC_STREAM_PRIORITY_BULK;
 
         /* Associate new stream with get request */
         guac_protocol_send_body(client->socket, object, stream,
@@ -556,10 +574,11 @@ int guac_rdp_upload_put_handler(guac_client* client, guac_object* object,
     rdp_stream->type = GUAC_RDP_UPLOAD_STREAM;
     rdp_stream->upload_status.offset = 0;
     rdp_stream->upload_status.file_id = file_id;
+    rdp_stream->upload_status.failed = 0;
 
     /* Allocate stream, init for file upload */
     stream->data = rdp_stream;
-    stream->blob_handler = guac_rdp_upload_blob_handler;
+    stream->blob_chunk_handler = guac_rdp_upload_blob_handler;
     stream->end_handler = guac_rdp_upload_end_handler;
 
     /* Acknowledge stream creation */
@@ -67,6 +67,12 @@ typedef struct guac_rdp_upload_status {
      */
     int file_id;
 
+    /**
+     * Non-zero if writing any part of the blob currently being received has
+     * failed, in which case the remainder of that blob is discarded.
+     */
+    int failed;
+
 } guac_rdp_upload_status;
 
 /**
@@ -179,10 +185,12 @@ int guac_rdp_clipboard_handler(guac_client* client, guac_stream* stream,
         char* mimetype);
 
 /**
- * Handler for stream data related to file uploads.
+ * Handler for stream data related to file uploads. Data is written as each
+ * chunk of a blob arrives, and the blob is acknowledged once its final chunk
+ * has been received.
  */
 int guac_rdp_upload_blob_handler(guac_client* client, guac_stream* stream,
-        void* data, int length);
+        void* data, int length, int final);
 
 /**
  * Handler for stream data related to static virtual channels.
@@ -62,6 +62,7 @@ const char* GUAC_CLIENT_ARGS[] = {
     "cursor",
     "autoretry",
     "clipboard-encoding",
+    "encoder-threads",
 
 #ifdef ENABLE_VNC_REPEATER
     "dest-host",
@@ -104,6 +105,7 @@ enum VNC_ARGS_IDX {
     IDX_CURSOR,
     IDX_AUTORETRY,
     IDX_CLIPBOARD_ENCODING,
+    IDX_ENCODER_THREADS,
 
 #ifdef ENABLE_VNC_REPEATER
     IDX_DEST_HOST,
@@ -342,6 +344,10 @@ int guac_client_init(guac_client* client, int argc, char** argv) {
     else
         retries_remaining = 0; 
 
+    /* Override number of image encoding threads, if specified */
+    if (argv[IDX_ENCODER_THREADS][0] != '\0')
+        client->encoder_threads = atoi(argv[IDX_ENCODER_THREADS]);
+
 #ifdef ENABLE_VNC_LISTEN
     /* Set reverse-connection flag */
     guac_client_data->reverse_connect =
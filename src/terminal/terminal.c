@@ -473,7 +473,9 @@ int guac_terminal_render_frame(guac_terminal* terminal) {
 
             /* Calculate time remaining in frame */
             frame_end = guac_timestamp_current();
-            frame_remaining = frame_start + GUAC_TERMINAL_FRAME_DURATION
+            frame_remaining = frame_start
+                            + guac_client_get_frame_duration(client,
+                                    GUAC_TERMINAL_FRAME_DURATION)
                             - frame_end;
 
             /* Wait again if frame remaining */
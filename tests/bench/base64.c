@@ -0,0 +1,181 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "base64.h"
+#include "bench.h"
+
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The sizes of data to encode and decode, in bytes. Each is a multiple of
+ * three, such that encoded data has no padding.
+ */
+static const size_t bench_base64_sizes[] = { 48, 4095, 65535 };
+
+/**
+ * The state shared by all base64 benchmarks of a particular size.
+ */
+typedef struct bench_base64_data {
+
+    /**
+     * The socket to write encoded data to.
+     */
+    guac_socket* socket;
+
+    /**
+     * The raw, unencoded data.
+     */
+    unsigned char* raw;
+
+    /**
+     * The number of bytes of raw data.
+     */
+    size_t raw_length;
+
+    /**
+     * The base64 encoding of the raw data, null-terminated.
+     */
+    char* encoded;
+
+    /**
+     * The number of characters of encoded data, excluding the null
+     * terminator.
+     */
+    size_t encoded_length;
+
+    /**
+     * Buffer large enough to receive either the raw or encoded data,
+     * including null terminator.
+     */
+    char* output;
+
+} bench_base64_data;
+
+/**
+ * Encodes the raw data into the output buffer.
+ */
+static size_t bench_base64_encode(void* data) {
+
+    bench_base64_data* bench = (bench_base64_data*) data;
+
+    guac_base64_encode(bench->raw, bench->raw_length, bench->output);
+    return bench->raw_length;
+
+}
+
+/**
+ * Encodes the raw data to the in-memory socket.
+ */
+static size_t bench_base64_encode_socket(void* data) {
+
+    bench_base64_data* bench = (bench_base64_data*) data;
+
+    guac_socket_write_base64(bench->socket, bench->raw, bench->raw_length);
+    guac_socket_flush_base64(bench->socket);
+    return bench->raw_length;
+
+}
+
+/**
+ * Decodes the encoded data into the output buffer.
+ */
+static size_t bench_base64_decode(void* data) {
+
+    bench_base64_data* bench = (bench_base64_data*) data;
+
+    guac_base64_decode(bench->encoded, bench->encoded_length,
+            (unsigned char*) bench->output);
+    return bench->encoded_length;
+
+}
+
+/**
+ * Decodes a copy of the encoded data in-place, as would be done with the
+ * contents of a received instruction. The cost of the copy is included.
+ */
+static size_t bench_base64_decode_protocol(void* data) {
+
+    bench_base64_data* bench = (bench_base64_data*) data;
+
+    memcpy(bench->output, bench->encoded, bench->encoded_length + 1);
+    guac_protocol_decode_base64(bench->output);
+    return bench->encoded_length;
+
+}
+
+void bench_base64() {
+
+    unsigned int i;
+
+    for (i = 0; i < sizeof(bench_base64_sizes) / sizeof(size_t); i++) {
+
+        size_t j;
+        char name[64];
+
+        bench_base64_data bench;
+        bench.raw_length = bench_base64_sizes[i];
+        bench.encoded_length = bench.raw_length / 3 * 4;
+
+        bench.socket = bench_socket_alloc(NULL, 0);
+        bench.raw = malloc(bench.raw_length);
+        bench.encoded = malloc(bench.encoded_length + 1);
+        bench.output = malloc(bench.encoded_length + 1);
+
+        /* Generate arbitrary data covering all byte values */
+        for (j = 0; j < bench.raw_length; j++)
+            bench.raw[j] = (j * 7 + (j >> 8)) & 0xFF;
+
+        guac_base64_encode(bench.raw, bench.raw_length, bench.encoded);
+        bench.encoded[bench.encoded_length] = '\0';
+
+        snprintf(name, sizeof(name), "base64/encode/%i",
+                (int) bench.raw_length);
+        bench_run(name, bench_base64_encode, &bench);
+
+        snprintf(name, sizeof(name), "base64/encode-socket/%i",
+                (int) bench.raw_length);
+        bench_run(name, bench_base64_encode_socket, &bench);
+
+        snprintf(name, sizeof(name), "base64/decode/%i",
+                (int) bench.raw_length);
+        bench_run(name, bench_base64_decode, &bench);
+
+        snprintf(name, sizeof(name), "base64/decode-protocol/%i",
+                (int) bench.raw_length);
+        bench_run(name, bench_base64_decode_protocol, &bench);
+
+        guac_socket_free(bench.socket);
+        free(bench.raw);
+        free(bench.encoded);
+        free(bench.output);
+
+    }
+
+}
+
@@ -0,0 +1,182 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#ifndef _GUAC_BENCH_H
+#define _GUAC_BENCH_H
+
+#include "config.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/socket.h>
+
+#include <stddef.h>
+
+/**
+ * The width of all generated benchmark content, in pixels.
+ */
+#define BENCH_CONTENT_WIDTH 256
+
+/**
+ * The height of all generated benchmark content, in pixels.
+ */
+#define BENCH_CONTENT_HEIGHT 256
+
+/**
+ * A single operation to be benchmarked. The operation will be invoked
+ * repeatedly, and must leave any state it touches ready for another
+ * invocation.
+ *
+ * @param data
+ *     Arbitrary data which was given to bench_run() along with this
+ *     operation.
+ *
+ * @return
+ *     The number of bytes processed by a single invocation of this operation,
+ *     used to calculate throughput, or zero if throughput is not meaningful
+ *     for this operation.
+ */
+typedef size_t bench_operation(void* data);
+
+/**
+ * The types of representative screen content that can be generated with
+ * bench_content_alloc().
+ */
+typedef enum bench_content_type {
+
+    /**
+     * Dark text on a light background, with a coloured title bar, as would
+     * be seen in a typical terminal or document window. Contains few colours
+     * and many sharp edges.
+     */
+    BENCH_CONTENT_TEXT,
+
+    /**
+     * Photographic content: smooth variation combined with fine noise, such
+     * that nearly every pixel is unique.
+     */
+    BENCH_CONTENT_PHOTO,
+
+    /**
+     * A smooth diagonal gradient, as would be seen in window decorations or
+     * desktop backgrounds.
+     */
+    BENCH_CONTENT_GRADIENT
+
+} bench_content_type;
+
+/**
+ * Runs the given operation repeatedly until at least the configured minimum
+ * amount of time has elapsed, printing a single line of results to STDOUT.
+ * Benchmarks whose names do not match the filter given on the command line
+ * are skipped.
+ *
+ * @param name
+ *     The unique name of the benchmark, such as "base64/encode/4096". Names
+ *     are stable between releases, such that results can be compared.
+ *
+ * @param operation
+ *     The operation to benchmark.
+ *
+ * @param data
+ *     Arbitrary data to pass to each invocation of the operation.
+ */
+void bench_run(const char* name, bench_operation* operation, void* data);
+
+/**
+ * Returns whether the benchmark having the given name would be run, such that
+ * expensive setup for skipped benchmarks can be avoided.
+ *
+ * @param name
+ *     The name of the benchmark to test.
+ *
+ * @return
+ *     Non-zero if the benchmark will be run, zero otherwise.
+ */
+int bench_enabled(const char* name);
+
+/**
+ * Allocates a new in-memory guac_socket. All data written to the socket is
+ * counted and discarded. If input is given, reads from the socket replay
+ * that input endlessly, wrapping back to the beginning once the end is
+ * reached, such that the same instructions can be read any number of times.
+ *
+ * @param input
+ *     The data to replay when reading from the socket, or NULL if the socket
+ *     will only be written to.
+ *
+ * @param length
+ *     The number of bytes of input to replay.
+ *
+ * @return
+ *     A newly-allocated guac_socket, which must eventually be freed with
+ *     guac_socket_free().
+ */
+guac_socket* bench_socket_alloc(const char* input, size_t length);
+
+/**
+ * Returns the total number of bytes written to the given in-memory socket,
+ * flushing the socket first such that any buffered data is included.
+ *
+ * @param socket
+ *     A socket allocated with bench_socket_alloc().
+ *
+ * @return
+ *     The total number of bytes written to the socket since allocation.
+ */
+size_t bench_socket_written(guac_socket* socket);
+
+/**
+ * Allocates a new Cairo surface containing generated content of the given
+ * type. The content is generated deterministically, such that results are
+ * comparable between runs and between machines.
+ *
+ * @param type
+ *     The type of content to generate.
+ *
+ * @return
+ *     A newly-allocated RGB24 image surface which is BENCH_CONTENT_WIDTH by
+ *     BENCH_CONTENT_HEIGHT pixels, which must eventually be freed with
+ *     cairo_surface_destroy().
+ */
+cairo_surface_t* bench_content_alloc(bench_content_type type);
+
+/**
+ * Returns the name of the given content type, for use within benchmark
+ * names.
+ *
+ * @param type
+ *     The type of content.
+ *
+ * @return
+ *     The name of the given content type, such as "text".
+ */
+const char* bench_content_name(bench_content_type type);
+
+void bench_base64();
+void bench_image();
+void bench_instruction();
+void bench_protocol();
+void bench_surface();
+
+#endif
+
@@ -0,0 +1,197 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "bench.h"
+
+#include <getopt.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/**
+ * The default minimum amount of time to spend running each benchmark, in
+ * milliseconds.
+ */
+#define BENCH_DEFAULT_MIN_TIME 500
+
+/**
+ * The maximum factor by which the number of iterations may grow between
+ * calibration runs of the same benchmark.
+ */
+#define BENCH_MAX_GROWTH 100
+
+/**
+ * The minimum amount of time to spend running each benchmark, in seconds.
+ */
+static double bench_min_time = BENCH_DEFAULT_MIN_TIME / 1000.0;
+
+/**
+ * The name prefixes of all benchmarks which should be run. If empty, all
+ * benchmarks are run.
+ */
+static char** bench_filters = NULL;
+
+/**
+ * The number of entries in bench_filters.
+ */
+static int bench_filter_count = 0;
+
+/**
+ * Returns the current value of a monotonic clock, in seconds.
+ *
+ * @return
+ *     The current value of a monotonic clock, in seconds.
+ */
+static double bench_now() {
+
+    struct timespec current;
+    clock_gettime(CLOCK_MONOTONIC, &current);
+
+    return current.tv_sec + current.tv_nsec / 1000000000.0;
+
+}
+
+int bench_enabled(const char* name) {
+
+    int i;
+
+    /* All benchmarks are run if no filters are given */
+    if (bench_filter_count == 0)
+        return 1;
+
+    for (i = 0; i < bench_filter_count; i++) {
+        if (strncmp(name, bench_filters[i], strlen(bench_filters[i])) == 0)
+            return 1;
+    }
+
+    return 0;
+
+}
+
+void bench_run(const char* name, bench_operation* operation, void* data) {
+
+    uint64_t iterations = 1;
+    uint64_t bytes;
+    double elapsed;
+
+    if (!bench_enabled(name))
+        return;
+
+    for (;;) {
+
+        uint64_t i;
+        uint64_t next;
+        double start = bench_now();
+
+        bytes = 0;
+        for (i = 0; i < iterations; i++)
+            bytes += operation(data);
+
+        elapsed = bench_now() - start;
+        if (elapsed >= bench_min_time)
+            break;
+
+        /* Aim slightly beyond the minimum time, based on the time taken by
+         * this run, but do not trust very short runs too far */
+        if (elapsed > 0)
+            next = iterations * (bench_min_time * 1.2 / elapsed);
+        else
+            next = iterations * BENCH_MAX_GROWTH;
+
+        if (next > iterations * BENCH_MAX_GROWTH)
+            next = iterations * BENCH_MAX_GROWTH;
+
+        if (next <= iterations)
+            next = iterations + 1;
+
+        iterations = next;
+
+    }
+
+    printf("%s\t%" PRIu64 "\t%.1f\t%.2f\n", name, iterations,
+            elapsed * 1000000000.0 / iterations,
+            bytes / elapsed / 1000000.0);
+
+    fflush(stdout);
+
+}
+
+/**
+ * Prints usage information for this program to STDERR.
+ *
+ * @param program
+ *     The name of this program, as given in argv[0].
+ */
+static void bench_usage(const char* program) {
+    fprintf(stderr, "Usage: %s [-t MILLISECONDS] [NAME_PREFIX...]\n",
+            program);
+}
+
+int main(int argc, char** argv) {
+
+    int opt;
+
+    while ((opt = getopt(argc, argv, "t:")) != -1) {
+
+        /* Minimum time per benchmark */
+        if (opt == 't') {
+
+            int min_time = atoi(optarg);
+            if (min_time <= 0) {
+                fprintf(stderr, "Invalid time: \"%s\"\n", optarg);
+                return 1;
+            }
+
+            bench_min_time = min_time / 1000.0;
+
+        }
+
+        else {
+            bench_usage(argv[0]);
+            return 1;
+        }
+
+    }
+
+    /* All remaining arguments are name prefixes */
+    bench_filters = &(argv[optind]);
+    bench_filter_count = argc - optind;
+
+    /* Results are tab-separated, with comment lines beginning with "#" */
+    printf("# " PACKAGE_NAME " " PACKAGE_VERSION "\n");
+    printf("# name\titerations\tns_per_op\tmb_per_s\n");
+
+    bench_base64();
+    bench_protocol();
+    bench_instruction();
+    bench_image();
+    bench_surface();
+
+    return 0;
+
+}
+
@@ -0,0 +1,272 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "bench.h"
+
+#include <cairo/cairo.h>
+
+#include <math.h>
+#include <stdint.h>
+
+/**
+ * The width of each character cell of generated text, in pixels.
+ */
+#define BENCH_CHAR_WIDTH 7
+
+/**
+ * The height of each line of generated text, in pixels.
+ */
+#define BENCH_CHAR_HEIGHT 14
+
+/**
+ * The height of the title bar drawn above generated text, in pixels.
+ */
+#define BENCH_TITLE_HEIGHT 20
+
+/**
+ * Returns the next value of a simple linear congruential generator. A fixed
+ * generator is used rather than rand() such that generated content is
+ * identical on all platforms.
+ *
+ * @param state
+ *     The current state of the generator, which will be updated.
+ *
+ * @return
+ *     The next pseudo-random value, between 0 and 65535 inclusive.
+ */
+static unsigned int bench_random(uint32_t* state) {
+    *state = *state * 1103515245 + 12345;
+    return (*state >> 16) & 0xFFFF;
+}
+
+/**
+ * Sets the pixel at the given coordinates within the given surface data.
+ */
+static void bench_set_pixel(unsigned char* data, int stride, int x, int y,
+        uint32_t color) {
+    ((uint32_t*) (data + y * stride))[x] = color;
+}
+
+/**
+ * Fills the given rectangle within the given surface data with a single
+ * colour.
+ */
+static void bench_fill(unsigned char* data, int stride, int x, int y,
+        int w, int h, uint32_t color) {
+
+    int dx, dy;
+
+    for (dy = y; dy < y + h; dy++) {
+        for (dx = x; dx < x + w; dx++)
+            bench_set_pixel(data, stride, dx, dy, color);
+    }
+
+}
+
+/**
+ * Draws a single pseudo-random glyph within the character cell at the given
+ * coordinates. Each glyph is a 5x9 bitmap of vertical and horizontal strokes,
+ * with lighter pixels along its edges approximating anti-aliasing.
+ */
+static void bench_draw_glyph(unsigned char* data, int stride, int x, int y,
+        uint32_t color, uint32_t edge, uint32_t* state) {
+
+    int i, j;
+    unsigned int strokes = bench_random(state);
+
+    for (i = 0; i < 5; i++) {
+        for (j = 0; j < 9; j++) {
+
+            /* Vertical strokes along columns, horizontal strokes along the
+             * top, middle, and bottom rows */
+            int ink = ((strokes >> i) & 0x1)
+                   || (j == 0 && (strokes & 0x20))
+                   || (j == 4 && (strokes & 0x40))
+                   || (j == 8 && (strokes & 0x80));
+
+            if (ink)
+                bench_set_pixel(data, stride, x + 1 + i, y + 3 + j, color);
+            else if (i == 4 && (strokes & 0x100))
+                bench_set_pixel(data, stride, x + 1 + i, y + 3 + j, edge);
+
+        }
+    }
+
+}
+
+/**
+ * Draws lines of pseudo-random text within the given surface data.
+ */
+static void bench_draw_text(unsigned char* data, int stride) {
+
+    int x, y;
+    uint32_t state = 1;
+
+    /* Background and title bar */
+    bench_fill(data, stride, 0, 0, BENCH_CONTENT_WIDTH, BENCH_CONTENT_HEIGHT,
+            0xFFFFFF);
+    bench_fill(data, stride, 0, 0, BENCH_CONTENT_WIDTH, BENCH_TITLE_HEIGHT,
+            0x3465A4);
+
+    for (y = BENCH_TITLE_HEIGHT;
+            y + BENCH_CHAR_HEIGHT <= BENCH_CONTENT_HEIGHT;
+            y += BENCH_CHAR_HEIGHT) {
+
+        /* Lines vary in length, as would typical text */
+        int length = bench_random(&state) % BENCH_CONTENT_WIDTH;
+
+        /* Alternate between plain and highlighted words */
+        uint32_t color = 0x202020;
+        uint32_t edge = 0x909090;
+
+        for (x = 0; x + BENCH_CHAR_WIDTH <= length; x += BENCH_CHAR_WIDTH) {
+
+            unsigned int choice = bench_random(&state) % 8;
+
+            /* Word break */
+            if (choice == 0) {
+                if (bench_random(&state) % 4 == 0) {
+                    color = 0xA40000;
+                    edge = 0xD09090;
+                }
+                else {
+                    color = 0x202020;
+                    edge = 0x909090;
+                }
+                continue;
+            }
+
+            bench_draw_glyph(data, stride, x, y, color, edge, &state);
+
+        }
+
+    }
+
+}
+
+/**
+ * Draws photo-like content within the given surface data, combining smooth
+ * variations in colour with fine noise.
+ */
+static void bench_draw_photo(unsigned char* data, int stride) {
+
+    int x, y;
+    uint32_t state = 2;
+
+    for (y = 0; y < BENCH_CONTENT_HEIGHT; y++) {
+        for (x = 0; x < BENCH_CONTENT_WIDTH; x++) {
+
+            int noise = bench_random(&state) % 33 - 16;
+
+            int red   = 128 + 60 * sin(x / 23.0) + 40 * cos((x + y) / 37.0);
+            int green = 128 + 50 * sin(y / 19.0) + 40 * cos((x - y) / 29.0);
+            int blue  = 128 + 70 * cos(x / 31.0) * sin(y / 41.0);
+
+            red   += noise;
+            green += noise;
+            blue  += noise;
+
+            /* Clamp to valid range */
+            if (red   < 0) red   = 0; else if (red   > 255) red   = 255;
+            if (green < 0) green = 0; else if (green > 255) green = 255;
+            if (blue  < 0) blue  = 0; else if (blue  > 255) blue  = 255;
+
+            bench_set_pixel(data, stride, x, y,
+                    (red << 16) | (green << 8) | blue);
+
+        }
+    }
+
+}
+
+/**
+ * Draws a smooth diagonal gradient on the given Cairo surface.
+ */
+static void bench_draw_gradient(cairo_surface_t* surface) {
+
+    cairo_t* cairo = cairo_create(surface);
+    cairo_pattern_t* gradient = cairo_pattern_create_linear(0, 0,
+            BENCH_CONTENT_WIDTH, BENCH_CONTENT_HEIGHT);
+
+    cairo_pattern_add_color_stop_rgb(gradient, 0.0, 0.125, 0.290, 0.529);
+    cairo_pattern_add_color_stop_rgb(gradient, 1.0, 0.933, 0.933, 0.925);
+
+    cairo_set_source(cairo, gradient);
+    cairo_paint(cairo);
+
+    cairo_pattern_destroy(gradient);
+    cairo_destroy(cairo);
+
+}
+
+cairo_surface_t* bench_content_alloc(bench_content_type type) {
+
+    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            BENCH_CONTENT_WIDTH, BENCH_CONTENT_HEIGHT);
+
+    unsigned char* data = cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+
+    cairo_surface_flush(surface);
+
+    switch (type) {
+
+        case BENCH_CONTENT_TEXT:
+            bench_draw_text(data, stride);
+            break;
+
+        case BENCH_CONTENT_PHOTO:
+            bench_draw_photo(data, stride);
+            break;
+
+        case BENCH_CONTENT_GRADIENT:
+            bench_draw_gradient(surface);
+            break;
+
+    }
+
+    cairo_surface_mark_dirty(surface);
+    return surface;
+
+}
+
+const char* bench_content_name(bench_content_type type) {
+
+    switch (type) {
+
+        case BENCH_CONTENT_TEXT:
+            return "text";
+
+        case BENCH_CONTENT_PHOTO:
+            return "photo";
+
+        case BENCH_CONTENT_GRADIENT:
+            return "gradient";
+
+    }
+
+    return "unknown";
+
+}
+
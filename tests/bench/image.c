@@ -0,0 +1,221 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "bench.h"
+#include "encode-jpeg.h"
+#include "encode-png.h"
+#include "palette.h"
+
+#ifdef ENABLE_WEBP
+#include "encode-webp.h"
+#endif
+
+#include <cairo/cairo.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+
+#include <stdio.h>
+
+/**
+ * The quality to use for all lossy encoding.
+ */
+#define BENCH_IMAGE_QUALITY 90
+
+/**
+ * The state shared by all image encoding benchmarks.
+ */
+typedef struct bench_image_data {
+
+    /**
+     * The socket to write all encoded images to.
+     */
+    guac_socket* socket;
+
+    /**
+     * The stream to associate with all encoded images.
+     */
+    guac_stream stream;
+
+    /**
+     * The content to encode.
+     */
+    cairo_surface_t* surface;
+
+    /**
+     * The encoder to use for all PNG images.
+     */
+    guac_png_encoder* png;
+
+    /**
+     * The encoder to use for all JPEG images.
+     */
+    guac_jpeg_encoder* jpeg;
+
+#ifdef ENABLE_WEBP
+    /**
+     * The encoder to use for all WebP images.
+     */
+    guac_webp_encoder* webp;
+#endif
+
+} bench_image_data;
+
+/**
+ * Returns the number of bytes of raw image data within the given surface,
+ * against which all image throughput is measured.
+ */
+static size_t bench_image_size(cairo_surface_t* surface) {
+    return cairo_image_surface_get_width(surface)
+         * cairo_image_surface_get_height(surface) * 4;
+}
+
+/**
+ * Builds (and frees) a palette for the content, if the content contains few
+ * enough colours.
+ */
+static size_t bench_image_palette(void* data) {
+
+    bench_image_data* bench = (bench_image_data*) data;
+
+    guac_palette* palette = guac_palette_alloc(bench->surface);
+    if (palette != NULL)
+        guac_palette_free(palette);
+
+    return bench_image_size(bench->surface);
+
+}
+
+/**
+ * Encodes the content as PNG.
+ */
+static size_t bench_image_png(void* data) {
+
+    bench_image_data* bench = (bench_image_data*) data;
+
+    guac_png_encoder_write(bench->png, bench->socket, &bench->stream,
+            bench->surface);
+    return bench_image_size(bench->surface);
+
+}
+
+/**
+ * Encodes the content as PNG using the fastest zlib level and strategy
+ * suitable for UI content.
+ */
+static size_t bench_image_png_rle(void* data) {
+
+    bench_image_data* bench = (bench_image_data*) data;
+
+    guac_png_encoder_configure(bench->png, 1, GUAC_CLIENT_PNG_STRATEGY_RLE,
+            GUAC_CLIENT_PNG_FILTER_DEFAULT);
+    guac_png_encoder_write(bench->png, bench->socket, &bench->stream,
+            bench->surface);
+    guac_png_encoder_configure(bench->png, GUAC_PNG_DEFAULT_COMPRESSION_LEVEL,
+            GUAC_PNG_DEFAULT_STRATEGY, GUAC_PNG_DEFAULT_FILTER);
+
+    return bench_image_size(bench->surface);
+
+}
+
+/**
+ * Encodes the content as JPEG.
+ */
+static size_t bench_image_jpeg(void* data) {
+
+    bench_image_data* bench = (bench_image_data*) data;
+
+    guac_jpeg_encoder_write(bench->jpeg, bench->socket, &bench->stream,
+            bench->surface, BENCH_IMAGE_QUALITY);
+    return bench_image_size(bench->surface);
+
+}
+
+#ifdef ENABLE_WEBP
+/**
+ * Encodes the content as lossy WebP.
+ */
+static size_t bench_image_webp(void* data) {
+
+    bench_image_data* bench = (bench_image_data*) data;
+
+    guac_webp_encoder_write(bench->webp, bench->socket, &bench->stream,
+            bench->surface, BENCH_IMAGE_QUALITY, 0);
+    return bench_image_size(bench->surface);
+
+}
+#endif
+
+void bench_image() {
+
+    bench_content_type type;
+    bench_image_data bench;
+
+    bench.socket = bench_socket_alloc(NULL, 0);
+    bench.stream.index = 3;
+
+    /* Reuse encoders across all images, as the encode pool does */
+    bench.png = guac_png_encoder_alloc();
+    bench.jpeg = guac_jpeg_encoder_alloc();
+#ifdef ENABLE_WEBP
+    bench.webp = guac_webp_encoder_alloc();
+#endif
+
+    for (type = BENCH_CONTENT_TEXT; type <= BENCH_CONTENT_GRADIENT; type++) {
+
+        char name[64];
+        const char* content = bench_content_name(type);
+
+        bench.surface = bench_content_alloc(type);
+
+        snprintf(name, sizeof(name), "image/palette/%s", content);
+        bench_run(name, bench_image_palette, &bench);
+
+        snprintf(name, sizeof(name), "image/png/%s", content);
+        bench_run(name, bench_image_png, &bench);
+
+        snprintf(name, sizeof(name), "image/png-rle/%s", content);
+        bench_run(name, bench_image_png_rle, &bench);
+
+        snprintf(name, sizeof(name), "image/jpeg/%s", content);
+        bench_run(name, bench_image_jpeg, &bench);
+
+#ifdef ENABLE_WEBP
+        snprintf(name, sizeof(name), "image/webp/%s", content);
+        bench_run(name, bench_image_webp, &bench);
+#endif
+
+        cairo_surface_destroy(bench.surface);
+
+    }
+
+    guac_png_encoder_free(bench.png);
+    guac_jpeg_encoder_free(bench.jpeg);
+#ifdef ENABLE_WEBP
+    guac_webp_encoder_free(bench.webp);
+#endif
+
+    guac_socket_free(bench.socket);
+
+}
+
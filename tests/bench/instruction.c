@@ -0,0 +1,171 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "bench.h"
+
+#include <guacamole/instruction.h>
+#include <guacamole/parser.h>
+#include <guacamole/socket.h>
+
+#include <stdio.h>
+#include <string.h>
+
+/**
+ * The number of base64 characters within each benchmarked blob.
+ */
+#define BENCH_INSTRUCTION_BLOB_LENGTH 4096
+
+/**
+ * The state shared by all instruction parsing benchmarks.
+ */
+typedef struct bench_instruction_data {
+
+    /**
+     * An in-memory socket which endlessly replays the instruction data.
+     */
+    guac_socket* socket;
+
+    /**
+     * The parser to use for guac_parser_read() benchmarks.
+     */
+    guac_parser* parser;
+
+    /**
+     * The number of bytes replayed by the socket, which must be exactly
+     * the amount of data consumed by a single benchmarked operation.
+     */
+    size_t length;
+
+} bench_instruction_data;
+
+/**
+ * Reads and frees a single instruction with guac_instruction_read().
+ */
+static size_t bench_instruction_read(void* data) {
+
+    bench_instruction_data* bench = (bench_instruction_data*) data;
+
+    guac_instruction* instruction = guac_instruction_read(bench->socket,
+            1000000);
+    if (instruction != NULL)
+        guac_instruction_free(instruction);
+
+    return bench->length;
+
+}
+
+/**
+ * Reads a single instruction with guac_parser_read().
+ */
+static size_t bench_parser_read(void* data) {
+
+    bench_instruction_data* bench = (bench_instruction_data*) data;
+
+    guac_parser_read(bench->parser, bench->socket, 1000000);
+    return bench->length;
+
+}
+
+/**
+ * Blob handler which accepts and ignores all blob content.
+ */
+static int bench_parser_blob_handler(guac_parser* parser, int stream_index,
+        void* data, int length, int final) {
+    return 0;
+}
+
+/**
+ * Benchmarks reading the given instructions both with guac_instruction_read()
+ * and with guac_parser_read().
+ *
+ * @param name
+ *     The name of the instruction data, to be included in benchmark names.
+ *
+ * @param instructions
+ *     The data to read, which must be exactly one instruction unless the
+ *     blob handler is set.
+ *
+ * @param streamed
+ *     Non-zero if blob content should be streamed to a blob handler when
+ *     reading with guac_parser_read(), zero otherwise.
+ */
+static void bench_instruction_run(const char* name, const char* instructions,
+        int streamed) {
+
+    char bench_name[64];
+    bench_instruction_data bench;
+    bench.length = strlen(instructions);
+
+    /* The older instruction reader cannot stream blobs */
+    if (!streamed) {
+        snprintf(bench_name, sizeof(bench_name), "instruction/read/%s", name);
+        if (bench_enabled(bench_name)) {
+            bench.socket = bench_socket_alloc(instructions, bench.length);
+            bench_run(bench_name, bench_instruction_read, &bench);
+            guac_socket_free(bench.socket);
+        }
+    }
+
+    snprintf(bench_name, sizeof(bench_name), "parser/read/%s", name);
+    if (bench_enabled(bench_name)) {
+
+        bench.socket = bench_socket_alloc(instructions, bench.length);
+        bench.parser = guac_parser_alloc();
+
+        if (streamed)
+            bench.parser->blob_handler = bench_parser_blob_handler;
+
+        bench_run(bench_name, bench_parser_read, &bench);
+
+        guac_parser_free(bench.parser);
+        guac_socket_free(bench.socket);
+
+    }
+
+}
+
+void bench_instruction() {
+
+    static char blob[BENCH_INSTRUCTION_BLOB_LENGTH + 32];
+    static char streamed_blob[sizeof(blob) + 32];
+
+    int length = sprintf(blob, "4.blob,1.3,%i.",
+            BENCH_INSTRUCTION_BLOB_LENGTH);
+
+    /* Arbitrary base64 content */
+    memset(blob + length, 'A', BENCH_INSTRUCTION_BLOB_LENGTH);
+    strcpy(blob + length + BENCH_INSTRUCTION_BLOB_LENGTH, ";");
+
+    /* Streamed blobs are only returned through the blob handler, and thus
+     * must be followed by another instruction */
+    sprintf(streamed_blob, "%s4.sync,13.1456789012345;", blob);
+
+    bench_instruction_run("sync", "4.sync,13.1456789012345;", 0);
+    bench_instruction_run("mouse", "5.mouse,3.512,3.384,1.1;", 0);
+    bench_instruction_run("key", "3.key,5.65307,1.1;", 0);
+    bench_instruction_run("blob", blob, 0);
+    bench_instruction_run("blob-streamed", streamed_blob, 1);
+
+}
+
@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "bench.h"
+
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+
+#include <string.h>
+
+/**
+ * The number of bytes of data sent within each benchmarked blob.
+ */
+#define BENCH_PROTOCOL_BLOB_SIZE 6048
+
+typedef struct bench_protocol_data bench_protocol_data;
+
+/**
+ * Sends a single instruction to the in-memory socket of the given benchmark.
+ */
+typedef void bench_protocol_send(bench_protocol_data* bench);
+
+/**
+ * The state shared by all protocol benchmarks.
+ */
+struct bench_protocol_data {
+
+    /**
+     * The socket to send all instructions to.
+     */
+    guac_socket* socket;
+
+    /**
+     * The stream to use for all stream-related instructions.
+     */
+    guac_stream stream;
+
+    /**
+     * A layer other than the default layer.
+     */
+    guac_layer layer;
+
+    /**
+     * Arbitrary data to send within blobs.
+     */
+    char blob[BENCH_PROTOCOL_BLOB_SIZE];
+
+    /**
+     * The function which sends the instruction currently being benchmarked.
+     */
+    bench_protocol_send* send;
+
+    /**
+     * The number of bytes written by each call to send.
+     */
+    size_t length;
+
+};
+
+static void bench_protocol_send_sync(bench_protocol_data* bench) {
+    guac_protocol_send_sync(bench->socket, 1456789012345);
+}
+
+static void bench_protocol_send_copy(bench_protocol_data* bench) {
+    guac_protocol_send_copy(bench->socket, &bench->layer, 0, 16, 1024, 752,
+            GUAC_COMP_OVER, GUAC_DEFAULT_LAYER, 0, 0);
+}
+
+static void bench_protocol_send_rect(bench_protocol_data* bench) {
+    guac_protocol_send_rect(bench->socket, GUAC_DEFAULT_LAYER,
+            320, 240, 64, 16);
+}
+
+static void bench_protocol_send_cfill(bench_protocol_data* bench) {
+    guac_protocol_send_cfill(bench->socket, GUAC_COMP_OVER,
+            GUAC_DEFAULT_LAYER, 0x34, 0x65, 0xA4, 0xFF);
+}
+
+static void bench_protocol_send_img(bench_protocol_data* bench) {
+    guac_protocol_send_img(bench->socket, &bench->stream, GUAC_COMP_OVER,
+            GUAC_DEFAULT_LAYER, "image/png", 320, 240);
+}
+
+static void bench_protocol_send_blob(bench_protocol_data* bench) {
+    guac_protocol_send_blob(bench->socket, &bench->stream, bench->blob,
+            sizeof(bench->blob));
+}
+
+static void bench_protocol_send_end(bench_protocol_data* bench) {
+    guac_protocol_send_end(bench->socket, &bench->stream);
+}
+
+/**
+ * Sends the current instruction, returning the number of bytes it occupies
+ * on the wire.
+ */
+static size_t bench_protocol_operation(void* data) {
+
+    bench_protocol_data* bench = (bench_protocol_data*) data;
+
+    bench->send(bench);
+    return bench->length;
+
+}
+
+/**
+ * Benchmarks sending the instruction sent by the given function. The length
+ * of the instruction is measured by sending it once prior to benchmarking.
+ */
+static void bench_protocol_run(bench_protocol_data* bench, const char* name,
+        bench_protocol_send* send) {
+
+    size_t written;
+
+    if (!bench_enabled(name))
+        return;
+
+    written = bench_socket_written(bench->socket);
+    send(bench);
+
+    bench->send = send;
+    bench->length = bench_socket_written(bench->socket) - written;
+
+    bench_run(name, bench_protocol_operation, bench);
+
+}
+
+void bench_protocol() {
+
+    static bench_protocol_data bench;
+
+    bench.socket = bench_socket_alloc(NULL, 0);
+    bench.stream.index = 3;
+    bench.layer.index = 1;
+    memset(bench.blob, 'x', sizeof(bench.blob));
+
+    bench_protocol_run(&bench, "protocol/sync",  bench_protocol_send_sync);
+    bench_protocol_run(&bench, "protocol/copy",  bench_protocol_send_copy);
+    bench_protocol_run(&bench, "protocol/rect",  bench_protocol_send_rect);
+    bench_protocol_run(&bench, "protocol/cfill", bench_protocol_send_cfill);
+    bench_protocol_run(&bench, "protocol/img",   bench_protocol_send_img);
+    bench_protocol_run(&bench, "protocol/blob",  bench_protocol_send_blob);
+    bench_protocol_run(&bench, "protocol/end",   bench_protocol_send_end);
+
+    guac_socket_free(bench.socket);
+
+}
+
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "bench.h"
+
+#include <guacamole/socket.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * The state of an in-memory benchmark socket.
+ */
+typedef struct bench_socket_data {
+
+    /**
+     * The data to replay when reading, or NULL if the socket cannot be read.
+     */
+    const char* input;
+
+    /**
+     * The number of bytes of input.
+     */
+    size_t length;
+
+    /**
+     * The offset within the input of the next byte to be read.
+     */
+    size_t offset;
+
+    /**
+     * The total number of bytes written to the socket.
+     */
+    size_t written;
+
+} bench_socket_data;
+
+/**
+ * Read handler which replays the socket input endlessly, filling as much of
+ * the given buffer as possible, as would a busy network connection.
+ */
+static ssize_t bench_socket_read_handler(guac_socket* socket,
+        void* buf, size_t count) {
+
+    bench_socket_data* data = (bench_socket_data*) socket->data;
+    char* current = (char*) buf;
+    size_t remaining = count;
+
+    /* Behave as a closed connection if there is nothing to replay */
+    if (data->input == NULL || data->length == 0)
+        return 0;
+
+    while (remaining > 0) {
+
+        /* Read no further than the end of the input */
+        size_t available = data->length - data->offset;
+        if (available > remaining)
+            available = remaining;
+
+        memcpy(current, data->input + data->offset, available);
+        current += available;
+        remaining -= available;
+
+        /* Wrap back to the beginning once all input is read */
+        data->offset += available;
+        if (data->offset == data->length)
+            data->offset = 0;
+
+    }
+
+    return count;
+
+}
+
+/**
+ * Write handler which counts and discards all data written.
+ */
+static ssize_t bench_socket_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    bench_socket_data* data = (bench_socket_data*) socket->data;
+    data->written += count;
+
+    return count;
+
+}
+
+/**
+ * Free handler which frees the state of the in-memory socket. As the free
+ * handler is invoked before the socket is finally flushed, any pending output
+ * is flushed here while the state is still valid.
+ */
+static int bench_socket_free_handler(guac_socket* socket) {
+
+    guac_socket_flush(socket);
+
+    free(socket->data);
+    socket->data = NULL;
+
+    return 0;
+
+}
+
+guac_socket* bench_socket_alloc(const char* input, size_t length) {
+
+    guac_socket* socket;
+    bench_socket_data* data = calloc(1, sizeof(bench_socket_data));
+    if (data == NULL)
+        return NULL;
+
+    socket = guac_socket_alloc(0, NULL);
+    if (socket == NULL) {
+        free(data);
+        return NULL;
+    }
+
+    data->input = input;
+    data->length = length;
+
+    socket->data = data;
+    socket->read_handler = bench_socket_read_handler;
+    socket->write_handler = bench_socket_write_handler;
+    socket->free_handler = bench_socket_free_handler;
+
+    return socket;
+
+}
+
+size_t bench_socket_written(guac_socket* socket) {
+
+    bench_socket_data* data = (bench_socket_data*) socket->data;
+
+    guac_socket_flush(socket);
+    return data->written;
+
+}
+
@@ -0,0 +1,394 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "bench.h"
+#include "guac_surface.h"
+
+#include <cairo/cairo.h>
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * The width of the benchmarked surface, in pixels.
+ */
+#define BENCH_SURFACE_WIDTH 1024
+
+/**
+ * The height of the benchmarked surface, in pixels.
+ */
+#define BENCH_SURFACE_HEIGHT 768
+
+/**
+ * The width of full-HD frames, in pixels.
+ */
+#define BENCH_FRAME_WIDTH 1920
+
+/**
+ * The height of full-HD frames, in pixels.
+ */
+#define BENCH_FRAME_HEIGHT 1080
+
+/**
+ * The state shared by all surface benchmarks.
+ */
+typedef struct bench_surface_data {
+
+    /**
+     * The surface being drawn to.
+     */
+    guac_common_surface* surface;
+
+    /**
+     * Two variants of the same content. As guac_common_surface ignores draws
+     * which do not change the surface, each draw alternates between these
+     * variants.
+     */
+    cairo_surface_t* content[2];
+
+    /**
+     * The index of the content variant to draw next.
+     */
+    int current;
+
+} bench_surface_data;
+
+/**
+ * The state shared by all full-HD copy benchmarks.
+ */
+typedef struct bench_surface_copy_data {
+
+    /**
+     * The surface being copied to.
+     */
+    guac_common_surface* surface;
+
+    /**
+     * Two surfaces containing different variants of the same content, each
+     * copied in turn.
+     */
+    guac_common_surface* sources[2];
+
+    /**
+     * The index of the source surface to copy next.
+     */
+    int current;
+
+} bench_surface_copy_data;
+
+/**
+ * Allocates a copy of the given content with all colours inverted, such
+ * that every pixel differs from the original while the content remains
+ * equally complex.
+ */
+static cairo_surface_t* bench_surface_invert(cairo_surface_t* content) {
+
+    int x, y;
+
+    int width = cairo_image_surface_get_width(content);
+    int height = cairo_image_surface_get_height(content);
+    int stride = cairo_image_surface_get_stride(content);
+    unsigned char* data = cairo_image_surface_get_data(content);
+
+    cairo_surface_t* inverted = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            width, height);
+
+    int inverted_stride = cairo_image_surface_get_stride(inverted);
+    unsigned char* inverted_data = cairo_image_surface_get_data(inverted);
+
+    cairo_surface_flush(inverted);
+
+    for (y = 0; y < height; y++) {
+
+        uint32_t* src = (uint32_t*) (data + y * stride);
+        uint32_t* dst = (uint32_t*) (inverted_data + y * inverted_stride);
+
+        for (x = 0; x < width; x++)
+            dst[x] = src[x] ^ 0xFFFFFF;
+
+    }
+
+    cairo_surface_mark_dirty(inverted);
+    return inverted;
+
+}
+
+/**
+ * Allocates a full-HD frame consisting of the given content repeated as
+ * many times as necessary.
+ */
+static cairo_surface_t* bench_surface_frame(cairo_surface_t* content) {
+
+    int x, y;
+
+    int width = cairo_image_surface_get_width(content);
+    int height = cairo_image_surface_get_height(content);
+    int stride = cairo_image_surface_get_stride(content);
+    unsigned char* data = cairo_image_surface_get_data(content);
+
+    cairo_surface_t* frame = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            BENCH_FRAME_WIDTH, BENCH_FRAME_HEIGHT);
+
+    int frame_stride = cairo_image_surface_get_stride(frame);
+    unsigned char* frame_data = cairo_image_surface_get_data(frame);
+
+    cairo_surface_flush(frame);
+
+    for (y = 0; y < BENCH_FRAME_HEIGHT; y++) {
+
+        uint32_t* src = (uint32_t*) (data + (y % height) * stride);
+        uint32_t* dst = (uint32_t*) (frame_data + y * frame_stride);
+
+        for (x = 0; x < BENCH_FRAME_WIDTH; x++)
+            dst[x] = src[x % width];
+
+    }
+
+    cairo_surface_mark_dirty(frame);
+    return frame;
+
+}
+
+/**
+ * Draws the next content variant to the surface without flushing.
+ */
+static size_t bench_surface_draw(void* data) {
+
+    bench_surface_data* bench = (bench_surface_data*) data;
+    cairo_surface_t* content = bench->content[bench->current];
+
+    guac_common_surface_draw(bench->surface, 0, 0, content);
+    bench->current ^= 1;
+
+    return cairo_image_surface_get_width(content)
+         * cairo_image_surface_get_height(content) * 4;
+
+}
+
+/**
+ * Draws the next content variant to the surface and flushes the surface,
+ * encoding the change.
+ */
+static size_t bench_surface_draw_flush(void* data) {
+
+    bench_surface_data* bench = (bench_surface_data*) data;
+
+    size_t length = bench_surface_draw(bench);
+    guac_common_surface_flush(bench->surface);
+
+    return length;
+
+}
+
+/**
+ * Draws the same content to the surface without flushing. After the first
+ * draw, the surface never changes, thus this measures only the cost of
+ * detecting that nothing has changed.
+ */
+static size_t bench_surface_redraw(void* data) {
+
+    bench_surface_data* bench = (bench_surface_data*) data;
+    cairo_surface_t* content = bench->content[0];
+
+    guac_common_surface_draw(bench->surface, 0, 0, content);
+
+    return cairo_image_surface_get_width(content)
+         * cairo_image_surface_get_height(content) * 4;
+
+}
+
+/**
+ * Fills the entire surface with alternating colours without flushing.
+ */
+static size_t bench_surface_fill(void* data) {
+
+    bench_surface_data* bench = (bench_surface_data*) data;
+    int shade = bench->current ? 0xFF : 0x00;
+
+    guac_common_surface_rect(bench->surface, 0, 0,
+            BENCH_FRAME_WIDTH, BENCH_FRAME_HEIGHT, shade, shade, shade);
+    bench->current ^= 1;
+
+    return BENCH_FRAME_WIDTH * BENCH_FRAME_HEIGHT * 4;
+
+}
+
+/**
+ * Copies the entire contents of the next source surface to the destination
+ * surface without flushing.
+ */
+static size_t bench_surface_copy(void* data) {
+
+    bench_surface_copy_data* bench = (bench_surface_copy_data*) data;
+
+    guac_common_surface_copy(bench->sources[bench->current], 0, 0,
+            BENCH_FRAME_WIDTH, BENCH_FRAME_HEIGHT, bench->surface, 0, 0);
+    bench->current ^= 1;
+
+    return BENCH_FRAME_WIDTH * BENCH_FRAME_HEIGHT * 4;
+
+}
+
+/**
+ * Combines the entire contents of the first source surface with the
+ * destination surface using XOR, without flushing. As XOR is its own inverse,
+ * every pixel changes with each call.
+ */
+static size_t bench_surface_xor(void* data) {
+
+    bench_surface_copy_data* bench = (bench_surface_copy_data*) data;
+
+    guac_common_surface_transfer(bench->sources[0], 0, 0,
+            BENCH_FRAME_WIDTH, BENCH_FRAME_HEIGHT, GUAC_TRANSFER_BINARY_XOR,
+            bench->surface, 0, 0);
+
+    return BENCH_FRAME_WIDTH * BENCH_FRAME_HEIGHT * 4;
+
+}
+
+/**
+ * Runs the benchmarks which update an entire full-HD surface, without
+ * flushing, measuring the cost of determining which pixels changed.
+ */
+static void bench_surface_frames(guac_client* client, guac_socket* socket) {
+
+    int i;
+    bench_surface_data bench;
+    bench_surface_copy_data copy;
+
+    cairo_surface_t* content = bench_content_alloc(BENCH_CONTENT_TEXT);
+    cairo_surface_t* inverted = bench_surface_invert(content);
+
+    bench.content[0] = bench_surface_frame(content);
+    bench.content[1] = bench_surface_frame(inverted);
+    bench.current = 0;
+
+    cairo_surface_destroy(content);
+    cairo_surface_destroy(inverted);
+
+    /* Redraw of identical frame, where nothing changes */
+    if (bench_enabled("surface/frame/unchanged")) {
+        bench.surface = guac_common_surface_alloc(client, socket,
+                GUAC_DEFAULT_LAYER, BENCH_FRAME_WIDTH, BENCH_FRAME_HEIGHT);
+        bench_run("surface/frame/unchanged", bench_surface_redraw, &bench);
+        guac_common_surface_free(bench.surface);
+    }
+
+    /* Draw of frames where every pixel changes */
+    if (bench_enabled("surface/frame/changed")) {
+        bench.surface = guac_common_surface_alloc(client, socket,
+                GUAC_DEFAULT_LAYER, BENCH_FRAME_WIDTH, BENCH_FRAME_HEIGHT);
+        bench_run("surface/frame/changed", bench_surface_draw, &bench);
+        guac_common_surface_free(bench.surface);
+    }
+
+    /* Solid fill of entire frame */
+    if (bench_enabled("surface/frame/rect")) {
+        bench.surface = guac_common_surface_alloc(client, socket,
+                GUAC_DEFAULT_LAYER, BENCH_FRAME_WIDTH, BENCH_FRAME_HEIGHT);
+        bench_run("surface/frame/rect", bench_surface_fill, &bench);
+        guac_common_surface_free(bench.surface);
+    }
+
+    /* Copy and binary transfer of entire frame from another surface */
+    if (bench_enabled("surface/frame/copy")
+            || bench_enabled("surface/frame/xor")) {
+
+        copy.surface = guac_common_surface_alloc(client, socket,
+                GUAC_DEFAULT_LAYER, BENCH_FRAME_WIDTH, BENCH_FRAME_HEIGHT);
+        copy.current = 0;
+
+        for (i = 0; i < 2; i++) {
+            copy.sources[i] = guac_common_surface_alloc(client, socket,
+                    GUAC_DEFAULT_LAYER, BENCH_FRAME_WIDTH, BENCH_FRAME_HEIGHT);
+            guac_common_surface_draw(copy.sources[i], 0, 0, bench.content[i]);
+        }
+
+        bench_run("surface/frame/copy", bench_surface_copy, &copy);
+        bench_run("surface/frame/xor", bench_surface_xor, &copy);
+
+        for (i = 0; i < 2; i++)
+            guac_common_surface_free(copy.sources[i]);
+
+        guac_common_surface_free(copy.surface);
+
+    }
+
+    cairo_surface_destroy(bench.content[0]);
+    cairo_surface_destroy(bench.content[1]);
+
+}
+
+void bench_surface() {
+
+    bench_content_type type;
+    bench_surface_data bench;
+
+    guac_socket* socket = bench_socket_alloc(NULL, 0);
+    guac_client* client = guac_client_alloc();
+    client->socket = socket;
+
+    for (type = BENCH_CONTENT_TEXT; type <= BENCH_CONTENT_GRADIENT; type++) {
+
+        char name[64];
+        const char* content = bench_content_name(type);
+
+        bench.content[0] = bench_content_alloc(type);
+        bench.content[1] = bench_surface_invert(bench.content[0]);
+        bench.current = 0;
+
+        /* Draw alone, measuring only the update of the surface itself */
+        snprintf(name, sizeof(name), "surface/draw/%s", content);
+        if (bench_enabled(name)) {
+            bench.surface = guac_common_surface_alloc(client, socket,
+                    GUAC_DEFAULT_LAYER, BENCH_SURFACE_WIDTH,
+                    BENCH_SURFACE_HEIGHT);
+            bench_run(name, bench_surface_draw, &bench);
+            guac_common_surface_free(bench.surface);
+        }
+
+        /* Draw followed by flush, including choice of encoding */
+        snprintf(name, sizeof(name), "surface/draw-flush/%s", content);
+        if (bench_enabled(name)) {
+            bench.surface = guac_common_surface_alloc(client, socket,
+                    GUAC_DEFAULT_LAYER, BENCH_SURFACE_WIDTH,
+                    BENCH_SURFACE_HEIGHT);
+            bench_run(name, bench_surface_draw_flush, &bench);
+            guac_common_surface_free(bench.surface);
+        }
+
+        cairo_surface_destroy(bench.content[0]);
+        cairo_surface_destroy(bench.content[1]);
+
+    }
+
+    bench_surface_frames(client, socket);
+
+    guac_client_free(client);
+    guac_socket_free(socket);
+
+}
+
@@ -48,6 +48,13 @@ int register_client_suite() {
     if (
         CU_add_test(suite, "layer-pool", test_layer_pool) == NULL
      || CU_add_test(suite, "buffer-pool", test_buffer_pool) == NULL
+     || CU_add_test(suite, "stream-images", test_stream_images) == NULL
+     || CU_add_test(suite, "image-cache", test_image_cache) == NULL
+     || CU_add_test(suite, "congestion", test_congestion) == NULL
+     || CU_add_test(suite, "congestion-drain", test_congestion_drain) == NULL
+     || CU_add_test(suite, "encoder-reuse", test_encoder_reuse) == NULL
+     || CU_add_test(suite, "png-encode", test_png_encode) == NULL
+     || CU_add_test(suite, "video-stream", test_video_stream) == NULL
        ) {
         CU_cleanup_registry();
         return CU_get_error();
@@ -30,6 +30,13 @@ int register_client_suite();
 
 void test_layer_pool();
 void test_buffer_pool();
+void test_stream_images();
+void test_image_cache();
+void test_congestion();
+void test_congestion_drain();
+void test_encoder_reuse();
+void test_png_encode();
+void test_video_stream();
 
 #endif
 
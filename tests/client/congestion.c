@@ -0,0 +1,223 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "client_suite.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+/**
+ * The number of bytes written between the two syncs used to measure
+ * throughput.
+ */
+#define TEST_CONGESTION_BYTES 30000
+
+/**
+ * Write handler which discards all data written to the test socket.
+ */
+static ssize_t test_congestion_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+    return count;
+}
+
+/**
+ * Sleeps for the given number of milliseconds.
+ */
+static void test_congestion_sleep(int millis) {
+
+    struct timespec period = {
+        .tv_sec  =  millis / 1000,
+        .tv_nsec = (millis % 1000) * 1000000L
+    };
+
+    nanosleep(&period, NULL);
+
+}
+
+/**
+ * Acknowledges the sync having the given timestamp.
+ */
+static void test_congestion_sync(guac_client* client,
+        guac_timestamp timestamp) {
+
+    char value[32];
+    char* argv[] = { value };
+
+    snprintf(value, sizeof(value), "%" PRId64, timestamp);
+    CU_ASSERT_EQUAL(guac_client_dispatch_instruction(client, "sync", 1, argv),
+            0);
+
+}
+
+/**
+ * Acknowledges a sync as if it had been sent the given number of
+ * milliseconds ago, returning the timestamp acknowledged. As each
+ * acknowledgement must be of a newer sync than the last, at least one
+ * millisecond passes before the acknowledgement is sent.
+ */
+static guac_timestamp test_congestion_ack(guac_client* client, int rtt) {
+
+    test_congestion_sleep(1);
+
+    client->last_sent_timestamp = guac_timestamp_current();
+    test_congestion_sync(client, client->last_sent_timestamp - rtt);
+
+    return client->last_sent_timestamp - rtt;
+
+}
+
+void test_congestion() {
+
+    char data[TEST_CONGESTION_BYTES];
+    guac_timestamp congested = 0;
+    int i;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = guac_socket_alloc(0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+    socket->write_handler = test_congestion_write_handler;
+    client->socket = socket;
+
+    /* A fast, steady connection is not congested */
+    for (i = 0; i < 20; i++)
+        test_congestion_ack(client, 10);
+
+    CU_ASSERT_EQUAL(client->rtt, 10);
+    CU_ASSERT_EQUAL(client->congestion, 0);
+    CU_ASSERT_EQUAL(guac_client_get_frame_duration(client, 40), 40);
+
+    /* Congestion must be recognized quickly once output queues, beginning
+     * with syncs sent after those already acknowledged */
+    test_congestion_sleep(400);
+    for (i = 0; i < 20 && client->congestion < GUAC_CLIENT_MAX_CONGESTION;
+            i++)
+        congested = test_congestion_ack(client, 400);
+
+    CU_ASSERT_EQUAL(client->congestion, GUAC_CLIENT_MAX_CONGESTION);
+    CU_ASSERT_EQUAL(guac_client_get_frame_duration(client, 40), 120);
+
+    /* Congestion must subside once the queue drains */
+    for (i = 0; i < 200 && client->congestion > 0; i++)
+        test_congestion_ack(client, 10);
+
+    CU_ASSERT_EQUAL(client->congestion, 0);
+
+    /* Repeated acknowledgements must not be mistaken for delay */
+    test_congestion_sync(client, congested);
+    CU_ASSERT(client->rtt < 40);
+
+    /* Throughput must reflect data acknowledged over time */
+    CU_ASSERT_EQUAL_FATAL(guac_client_send_sync(client), 0);
+    test_congestion_sync(client, client->last_sent_timestamp);
+    test_congestion_sleep(300);
+
+    memset(data, 'x', sizeof(data));
+    guac_socket_write(socket, data, sizeof(data));
+    CU_ASSERT_EQUAL_FATAL(guac_client_send_sync(client), 0);
+    test_congestion_sync(client, client->last_sent_timestamp);
+
+    CU_ASSERT(client->throughput > TEST_CONGESTION_BYTES * 1000 / 600);
+    CU_ASSERT(client->throughput <= TEST_CONGESTION_BYTES * 1000 / 300 + 1000);
+
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
+
+void test_congestion_drain() {
+
+    char data[TEST_CONGESTION_BYTES];
+    guac_timestamp queued;
+    guac_timestamp drained;
+    int i;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = guac_socket_alloc(0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+    socket->write_handler = test_congestion_write_handler;
+    client->socket = socket;
+
+    for (i = 0; i < 20; i++)
+        test_congestion_ack(client, 10);
+
+    /* Queue data behind a sync, such that it is received only after the
+     * throughput sample begins */
+    CU_ASSERT_EQUAL_FATAL(guac_client_send_sync(client), 0);
+    queued = client->last_sent_timestamp;
+    test_congestion_sleep(1);
+
+    memset(data, 'x', sizeof(data));
+    guac_socket_write(socket, data, sizeof(data));
+    CU_ASSERT_EQUAL_FATAL(guac_client_send_sync(client), 0);
+    drained = client->last_sent_timestamp;
+
+    test_congestion_sync(client, queued);
+    test_congestion_sleep(300);
+    test_congestion_sync(client, drained);
+
+    /* Nothing new has been produced while the queued data was received */
+    CU_ASSERT(client->throughput > TEST_CONGESTION_BYTES * 1000 / 600);
+
+    /* The round-trip time remains high while the queue drains, but
+     * congestion must not be raised while the client is receiving data far
+     * faster than it is produced */
+    test_congestion_sleep(400);
+    for (i = 0; i < 20; i++)
+        test_congestion_ack(client, 400);
+
+    CU_ASSERT(client->rtt > 250);
+    CU_ASSERT_EQUAL(client->congestion, 0);
+
+    /* Congestion must be raised once output keeps pace with throughput */
+    for (i = 0; i < 4; i++) {
+        test_congestion_sleep(260);
+        guac_socket_write(socket, data, sizeof(data));
+        CU_ASSERT_EQUAL_FATAL(guac_client_send_sync(client), 0);
+        test_congestion_sync(client, client->last_sent_timestamp);
+    }
+
+    test_congestion_sleep(400);
+    for (i = 0; i < 20 && client->congestion < GUAC_CLIENT_MAX_CONGESTION;
+            i++)
+        test_congestion_ack(client, 400);
+
+    CU_ASSERT_EQUAL(client->congestion, GUAC_CLIENT_MAX_CONGESTION);
+
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
@@ -0,0 +1,202 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "config.h"
+
+#include "client_suite.h"
+#include "common/capture_socket.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+/**
+ * An image streamed by the test, described by its format, dimensions, and
+ * the number of distinct colors within it.
+ */
+typedef struct test_reuse_image {
+
+    /**
+     * The format to stream the image as.
+     */
+    guac_client_image_format format;
+
+    /**
+     * The width of the image, in pixels.
+     */
+    int width;
+
+    /**
+     * The height of the image, in pixels.
+     */
+    int height;
+
+    /**
+     * The number of distinct colors within the image.
+     */
+    int colors;
+
+} test_reuse_image;
+
+/**
+ * Images streamed in order through a single encoder context, alternating
+ * between formats and growing and shrinking, such that any state left over
+ * from one image would affect the next.
+ */
+static const test_reuse_image test_reuse_images[] = {
+    { GUAC_CLIENT_IMAGE_PNG,  64,  64,  2    },
+    { GUAC_CLIENT_IMAGE_PNG,  131, 131, 300  },
+    { GUAC_CLIENT_IMAGE_PNG,  3,   5,   3    },
+    { GUAC_CLIENT_IMAGE_JPEG, 200, 17,  1000 },
+    { GUAC_CLIENT_IMAGE_PNG,  131, 131, 256  },
+    { GUAC_CLIENT_IMAGE_JPEG, 1,   1,   1    },
+    { GUAC_CLIENT_IMAGE_PNG,  67,  9,   17   },
+    { GUAC_CLIENT_IMAGE_JPEG, 96,  160, 1000 },
+#ifdef ENABLE_WEBP
+    { GUAC_CLIENT_IMAGE_WEBP, 131, 131, 1000 },
+    { GUAC_CLIENT_IMAGE_WEBP, 7,   3,   5    },
+    { GUAC_CLIENT_IMAGE_PNG,  13,  7,   5    },
+    { GUAC_CLIENT_IMAGE_WEBP, 64,  48,  300  },
+#endif
+    { GUAC_CLIENT_IMAGE_PNG,  1,   1,   1    }
+};
+
+/**
+ * Allocates a new RGB24 image having the dimensions of the given
+ * description and filled with the given number of colors, each repeated
+ * for short runs of pixels.
+ */
+static cairo_surface_t* test_reuse_create(const test_reuse_image* desc) {
+
+    int x, y;
+
+    cairo_surface_t* surface = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            desc->width, desc->height);
+
+    unsigned char* data = cairo_image_surface_get_data(surface);
+    int stride = cairo_image_surface_get_stride(surface);
+
+    for (y = 0; y < desc->height; y++) {
+
+        uint32_t* row = (uint32_t*) (data + y * stride);
+
+        for (x = 0; x < desc->width; x++) {
+            int color = ((y * desc->width + x) / 3) % desc->colors;
+            row[x] = ((uint32_t) color * 0x9E3779B1u) & 0xFFFFFF;
+        }
+
+    }
+
+    cairo_surface_mark_dirty(surface);
+    return surface;
+
+}
+
+/**
+ * Streams the given image using guac_client_stream_png(),
+ * guac_client_stream_jpeg(), or guac_client_stream_webp(), each of which
+ * encodes using freshly-allocated encoder state.
+ */
+static void test_reuse_stream_fresh(guac_client* client, guac_socket* socket,
+        const guac_client_image* image) {
+
+    switch (image->format) {
+
+        case GUAC_CLIENT_IMAGE_JPEG:
+            guac_client_stream_jpeg(client, socket, image->mode, image->layer,
+                    image->x, image->y, image->surface, image->quality);
+            break;
+
+        case GUAC_CLIENT_IMAGE_WEBP:
+            guac_client_stream_webp(client, socket, image->mode, image->layer,
+                    image->x, image->y, image->surface, image->quality, 0);
+            break;
+
+        default:
+            guac_client_stream_png(client, socket, image->mode, image->layer,
+                    image->x, image->y, image->surface);
+
+    }
+
+}
+
+void test_encoder_reuse() {
+
+    int count = sizeof(test_reuse_images) / sizeof(test_reuse_images[0]);
+    int i;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = test_capture_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* Encode all images within this thread, using one encoder context */
+    client->encoder_threads = 1;
+
+    for (i = 0; i < count; i++) {
+
+        guac_client_image image = {
+            .format  = test_reuse_images[i].format,
+            .mode    = GUAC_COMP_OVER,
+            .layer   = GUAC_DEFAULT_LAYER,
+            .x       = i,
+            .y       = 0,
+            .surface = test_reuse_create(&test_reuse_images[i]),
+            .quality = 90
+        };
+
+        /* Stream image using the reused context of the encode pool */
+        test_capture_reset();
+        guac_client_stream_images(client, socket, &image, 1);
+        guac_socket_flush(socket);
+
+        CU_ASSERT_FATAL(test_capture_output_length > 0);
+        size_t length = test_capture_output_length;
+        char* reused = malloc(length);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(reused);
+        memcpy(reused, test_capture_output, length);
+
+        /* The same image encoded from scratch must be identical */
+        test_capture_reset();
+        test_reuse_stream_fresh(client, socket, &image);
+        guac_socket_flush(socket);
+
+        CU_ASSERT(test_capture_equals(reused, length));
+
+        free(reused);
+        cairo_surface_destroy(image.surface);
+
+    }
+
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
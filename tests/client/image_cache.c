@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "client_suite.h"
+#include "common/capture_socket.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+
+/**
+ * The width and height of each test image, in pixels.
+ */
+#define TEST_CACHE_IMAGE_SIZE 32
+
+/**
+ * The number of bytes of client-side memory required by each test image.
+ */
+#define TEST_CACHE_IMAGE_BYTES \
+    (TEST_CACHE_IMAGE_SIZE * TEST_CACHE_IMAGE_SIZE * 4)
+
+/**
+ * Flushes the test socket, returning the number of instructions having the
+ * given opcode within the data written since the last image was streamed.
+ */
+static int test_cache_count(guac_socket* socket, const char* opcode) {
+
+    const char* current = test_capture_output;
+    int count = 0;
+
+    guac_socket_flush(socket);
+
+    /* Instructions begin at the start of output or after a semicolon */
+    while (current != NULL && *current != '\0') {
+
+        const char* name = strchr(current, '.') + 1;
+        if (strncmp(name, opcode, strlen(opcode)) == 0
+                && name[strlen(opcode)] == ',')
+            count++;
+
+        current = strchr(current, ';');
+        if (current != NULL)
+            current++;
+
+    }
+
+    return count;
+
+}
+
+/**
+ * Streams the given image using the given client and socket, returning the
+ * number of instructions having the given opcode that were sent as a result.
+ */
+static int test_cache_stream(guac_client* client, guac_socket* socket,
+        cairo_surface_t* surface, const char* opcode) {
+
+    guac_client_image image = {
+        .format  = GUAC_CLIENT_IMAGE_PNG,
+        .mode    = GUAC_COMP_OVER,
+        .layer   = GUAC_DEFAULT_LAYER,
+        .x       = 0,
+        .y       = 0,
+        .surface = surface
+    };
+
+    test_capture_reset();
+
+    guac_client_stream_images(client, socket, &image, 1);
+    return test_cache_count(socket, opcode);
+
+}
+
+void test_image_cache() {
+
+    cairo_surface_t* surfaces[5];
+    int i;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = test_capture_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* Allow exactly four images to be cached */
+    client->image_cache_size = TEST_CACHE_IMAGE_BYTES * 4;
+
+    /* Generate distinct solid images */
+    for (i = 0; i < 5; i++) {
+
+        surfaces[i] = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+                TEST_CACHE_IMAGE_SIZE, TEST_CACHE_IMAGE_SIZE);
+
+        cairo_t* cairo = cairo_create(surfaces[i]);
+        cairo_set_source_rgb(cairo, i / 5.0, 0.0, 1.0);
+        cairo_paint(cairo);
+        cairo_destroy(cairo);
+
+    }
+
+    /* First occurrence must be sent as an image */
+    CU_ASSERT_EQUAL(test_cache_stream(client, socket, surfaces[0], "img"), 1);
+
+    /* Repeated image must be copied from cache */
+    CU_ASSERT_EQUAL(test_cache_stream(client, socket, surfaces[0], "img"), 0);
+    CU_ASSERT_EQUAL(test_cache_count(socket, "copy"), 1);
+
+    /* Fill cache, evicting the least recently used image once full */
+    for (i = 1; i < 4; i++)
+        CU_ASSERT_EQUAL(test_cache_stream(client, socket, surfaces[i],
+                    "dispose"), 0);
+
+    CU_ASSERT_EQUAL(test_cache_stream(client, socket, surfaces[4],
+                "dispose"), 1);
+
+    /* Evicted image must be sent again */
+    CU_ASSERT_EQUAL(test_cache_stream(client, socket, surfaces[0], "img"), 1);
+
+    /* Most recently used images must remain cached */
+    CU_ASSERT_EQUAL(test_cache_stream(client, socket, surfaces[4], "img"), 0);
+
+    for (i = 0; i < 5; i++)
+        cairo_surface_destroy(surfaces[i]);
+
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
@@ -0,0 +1,325 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "config.h"
+
+#include "client_suite.h"
+#include "common/capture_socket.h"
+
+#include <setjmp.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <png.h>
+
+/**
+ * The maximum number of instructions parsed from the output of each image.
+ */
+#define TEST_PNG_MAX_INSTRUCTIONS 1024
+
+/**
+ * The width of images large enough for colors to be sampled before the
+ * image is scanned in full. This is deliberately not a multiple of 4 or 8.
+ */
+#define TEST_PNG_LARGE_SIZE 131
+
+/**
+ * Instructions parsed from the output of the most recent image.
+ */
+static test_capture_instruction
+    test_png_instructions[TEST_PNG_MAX_INSTRUCTIONS];
+
+/**
+ * PNG data reassembled from the blobs of the most recent image.
+ */
+typedef struct test_png_data {
+
+    /**
+     * The PNG data, or NULL if no data has been received.
+     */
+    unsigned char* buffer;
+
+    /**
+     * The number of bytes of PNG data.
+     */
+    size_t length;
+
+    /**
+     * The number of bytes already read by libpng.
+     */
+    size_t offset;
+
+} test_png_data;
+
+/**
+ * Read function for libpng which reads from the test_png_data associated
+ * with the given read structure.
+ */
+static void test_png_read(png_structp png, png_bytep data, png_size_t length) {
+
+    test_png_data* png_data = (test_png_data*) png_get_io_ptr(png);
+
+    if (length > png_data->length - png_data->offset)
+        png_error(png, "Read beyond end of PNG data");
+
+    memcpy(data, png_data->buffer + png_data->offset, length);
+    png_data->offset += length;
+
+}
+
+/**
+ * Returns an arbitrary 24-bit color unique to the given index. The unused
+ * upper byte of the returned pixel varies, as it must be ignored.
+ */
+static uint32_t test_png_color(int index) {
+    return (((uint32_t) index * 0x9E3779B1u) & 0xFFFFFF)
+         | ((index & 1) ? 0xFF000000 : 0);
+}
+
+/**
+ * Sends the given RGB24 image as PNG using guac_client_stream_png(), then
+ * decodes the PNG sent, verifying that every pixel matches the image
+ * exactly. The PNG must use a palette if and only if expect_palette is
+ * non-zero, in which case it must also use the given bit depth.
+ */
+static void test_png_verify(guac_client* client, guac_socket* socket,
+        const uint32_t* pixels, int width, int height, int expect_palette,
+        int expect_depth) {
+
+    test_png_data png_data = { NULL, 0, 0 };
+    png_structp png = NULL;
+    png_infop info = NULL;
+    png_bytep* rows = NULL;
+    int count, i, x, y;
+
+    cairo_surface_t* image = cairo_image_surface_create_for_data(
+            (unsigned char*) pixels, CAIRO_FORMAT_RGB24, width, height,
+            width * 4);
+
+    test_capture_reset();
+    guac_client_stream_png(client, socket, GUAC_COMP_OVER,
+            GUAC_DEFAULT_LAYER, 0, 0, image);
+    guac_socket_flush(socket);
+    cairo_surface_destroy(image);
+
+    count = test_capture_parse(test_png_instructions,
+            TEST_PNG_MAX_INSTRUCTIONS);
+    CU_ASSERT_FATAL(count > 0);
+
+    /* Reassemble PNG from the decoded contents of each blob */
+    for (i = 0; i < count; i++) {
+
+        test_capture_instruction* instruction = &test_png_instructions[i];
+
+        if (strcmp(instruction->opcode, "blob") != 0)
+            continue;
+
+        CU_ASSERT_EQUAL_FATAL(instruction->argc, 2);
+
+        char* blob = (char*) instruction->argv[1];
+        int length = guac_protocol_decode_base64(blob);
+
+        png_data.buffer = realloc(png_data.buffer, png_data.length + length);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(png_data.buffer);
+
+        memcpy(png_data.buffer + png_data.length, blob, length);
+        png_data.length += length;
+
+    }
+
+    CU_ASSERT_FATAL(png_data.length > 8);
+    CU_ASSERT_FATAL(png_sig_cmp(png_data.buffer, 0, 8) == 0);
+
+    png = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(png);
+
+    info = png_create_info_struct(png);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(info);
+
+    if (setjmp(png_jmpbuf(png))) {
+        CU_FAIL("PNG could not be decoded");
+        goto done;
+    }
+
+    png_set_read_fn(png, &png_data, test_png_read);
+    png_read_info(png, info);
+
+    CU_ASSERT_EQUAL(png_get_image_width(png, info), width);
+    CU_ASSERT_EQUAL(png_get_image_height(png, info), height);
+
+    if (expect_palette) {
+        CU_ASSERT_EQUAL(png_get_color_type(png, info),
+                PNG_COLOR_TYPE_PALETTE);
+        CU_ASSERT_EQUAL(png_get_bit_depth(png, info), expect_depth);
+    }
+    else
+        CU_ASSERT_NOT_EQUAL(png_get_color_type(png, info),
+                PNG_COLOR_TYPE_PALETTE);
+
+    /* Decode all images to 8-bit RGB */
+    png_set_expand(png);
+    png_set_strip_16(png);
+    png_set_strip_alpha(png);
+    png_set_gray_to_rgb(png);
+    png_read_update_info(png, info);
+
+    CU_ASSERT_EQUAL_FATAL(png_get_rowbytes(png, info), width * 3);
+
+    rows = calloc(height, sizeof(png_bytep));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(rows);
+
+    for (y = 0; y < height; y++) {
+        rows[y] = malloc(width * 3);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(rows[y]);
+    }
+
+    png_read_image(png, rows);
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++) {
+
+            uint32_t pixel = pixels[y * width + x] & 0xFFFFFF;
+            png_bytep decoded = rows[y] + x * 3;
+
+            if (decoded[0] != ((pixel >> 16) & 0xFF)
+                    || decoded[1] != ((pixel >> 8) & 0xFF)
+                    || decoded[2] != (pixel & 0xFF)) {
+                CU_FAIL("Decoded pixel differs from original");
+                goto done;
+            }
+
+        }
+    }
+
+done:
+
+    if (rows != NULL) {
+        for (y = 0; y < height; y++)
+            free(rows[y]);
+        free(rows);
+    }
+
+    png_destroy_read_struct(&png, &info, NULL);
+    free(png_data.buffer);
+
+}
+
+/**
+ * Fills the given image with the given number of distinct colors, each
+ * repeated for runs of the given number of pixels, such that runs are split
+ * across row boundaries and the groups of pixels compared at once.
+ */
+static void test_png_fill(uint32_t* pixels, int width, int height,
+        int colors, int run) {
+
+    int i;
+
+    for (i = 0; i < width * height; i++)
+        pixels[i] = test_png_color((i / run) % colors);
+
+}
+
+void test_png_encode() {
+
+    const int widths[] = { 1, 3, 5, 7, 9, 13, 31, 33, 67 };
+    const int colors[] = { 1, 2, 3, 4, 5, 16, 17, 255, 256 };
+    const int depths[] = { 1, 1, 2, 2, 4, 4,  8,  8,   8 };
+    const int runs[] = { 1, 3, 40 };
+
+    int size = TEST_PNG_LARGE_SIZE * TEST_PNG_LARGE_SIZE;
+    int i, j, k;
+
+    uint32_t* pixels = malloc(size * sizeof(uint32_t));
+    CU_ASSERT_PTR_NOT_NULL_FATAL(pixels);
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = test_capture_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* Small images of every palette size, including widths which are not a
+     * multiple of the number of pixels packed into each byte */
+    for (i = 0; i < sizeof(widths) / sizeof(widths[0]); i++) {
+        for (j = 0; j < sizeof(colors) / sizeof(colors[0]); j++) {
+            for (k = 0; k < sizeof(runs) / sizeof(runs[0]); k++) {
+
+                int height = 7;
+
+                /* Ensure there are enough pixels for every color */
+                while (widths[i] * height < colors[j] * runs[k])
+                    height += 7;
+
+                test_png_fill(pixels, widths[i], height, colors[j], runs[k]);
+                test_png_verify(client, socket, pixels, widths[i], height,
+                        1, depths[j]);
+
+            }
+        }
+    }
+
+    /* Too many colors for a palette */
+    test_png_fill(pixels, 29, 11, 257, 1);
+    test_png_verify(client, socket, pixels, 29, 11, 0, 8);
+
+    /* Large images are sampled before being scanned in full. A palette
+     * which is exactly full must still be used. */
+    test_png_fill(pixels, TEST_PNG_LARGE_SIZE, TEST_PNG_LARGE_SIZE, 256, 5);
+    test_png_verify(client, socket, pixels, TEST_PNG_LARGE_SIZE,
+            TEST_PNG_LARGE_SIZE, 1, 8);
+
+    /* Large images with too many colors throughout are rejected */
+    test_png_fill(pixels, TEST_PNG_LARGE_SIZE, TEST_PNG_LARGE_SIZE, 300, 1);
+    test_png_verify(client, socket, pixels, TEST_PNG_LARGE_SIZE,
+            TEST_PNG_LARGE_SIZE, 0, 8);
+
+    /* Large images whose samples fit within a palette, but whose last row
+     * adds enough colors that the image as a whole does not */
+    test_png_fill(pixels, TEST_PNG_LARGE_SIZE, TEST_PNG_LARGE_SIZE, 200, 3);
+    for (i = 0; i < 100; i++)
+        pixels[size - 1 - i] = test_png_color(1000 + i);
+
+    test_png_verify(client, socket, pixels, TEST_PNG_LARGE_SIZE,
+            TEST_PNG_LARGE_SIZE, 0, 8);
+
+    /* The same image is not rejected if its last row adds only enough
+     * colors to exactly fill the palette */
+    test_png_fill(pixels, TEST_PNG_LARGE_SIZE, TEST_PNG_LARGE_SIZE, 200, 3);
+    for (i = 0; i < 56; i++)
+        pixels[size - 1 - i] = test_png_color(1000 + i);
+
+    test_png_verify(client, socket, pixels, TEST_PNG_LARGE_SIZE,
+            TEST_PNG_LARGE_SIZE, 1, 8);
+
+    guac_socket_free(socket);
+    guac_client_free(client);
+    free(pixels);
+
+}
@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "client_suite.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+
+/**
+ * The number of images streamed by each test.
+ */
+#define TEST_IMAGE_COUNT 12
+
+/**
+ * The width and height of each test image, in pixels.
+ */
+#define TEST_IMAGE_SIZE 64
+
+/**
+ * All data written to a test socket.
+ */
+typedef struct test_image_output {
+
+    /**
+     * The data written, or NULL if nothing has yet been written.
+     */
+    char* buffer;
+
+    /**
+     * The number of bytes written.
+     */
+    size_t length;
+
+} test_image_output;
+
+/**
+ * Write handler which appends all data written to the test_image_output
+ * associated with the socket.
+ */
+static ssize_t test_image_write_handler(guac_socket* socket,
+        const void* buf, size_t count) {
+
+    test_image_output* output = (test_image_output*) socket->data;
+
+    char* buffer = realloc(output->buffer, output->length + count);
+    if (buffer == NULL)
+        return -1;
+
+    memcpy(buffer + output->length, buf, count);
+    output->buffer = buffer;
+    output->length += count;
+    return count;
+
+}
+
+/**
+ * Removes the first argument of each instruction within the given output,
+ * which for "img", "blob", and "end" is the stream index, such that outputs
+ * can be compared regardless of which streams were allocated. All data
+ * written is assumed to be ASCII.
+ */
+static void test_image_strip_streams(test_image_output* output) {
+
+    char* current = output->buffer;
+    char* end = output->buffer + output->length;
+    char* stripped = output->buffer;
+    int element = 0;
+
+    while (current < end) {
+
+        char* start = current;
+
+        /* Skip element length and value */
+        int length = strtol(current, &current, 10);
+        current += length + 2;
+
+        /* Keep all but the first argument */
+        if (element != 1) {
+            memmove(stripped, start, current - start);
+            stripped += current - start;
+        }
+
+        /* Instructions are terminated by semicolons */
+        if (current[-1] == ';')
+            element = 0;
+        else
+            element++;
+
+    }
+
+    output->length = stripped - output->buffer;
+
+}
+
+/**
+ * Streams the given images using a new client configured with the given
+ * number of encoder threads, storing everything written in the given output.
+ */
+static void test_image_stream(guac_client_image* images, int threads,
+        test_image_output* output) {
+
+    int i;
+    size_t encoded = 0;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = guac_socket_alloc(0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    socket->data = output;
+    socket->write_handler = test_image_write_handler;
+
+    /* Stream all images twice, such that the encoding threads are reused */
+    client->encoder_threads = threads;
+    guac_client_stream_images(client, socket, images, TEST_IMAGE_COUNT);
+
+    /* The measured size of each image must account for all data sent */
+    guac_socket_flush(socket);
+    for (i = 0; i < TEST_IMAGE_COUNT; i++) {
+        CU_ASSERT(images[i].encoded_size > 0);
+        CU_ASSERT(images[i].encode_time >= 0);
+        encoded += images[i].encoded_size;
+    }
+    CU_ASSERT_EQUAL(encoded, output->length);
+
+    guac_client_stream_images(client, socket, images, TEST_IMAGE_COUNT);
+
+    /* All streams must have been freed */
+    CU_ASSERT_EQUAL(guac_client_alloc_stream(client)->index, 0);
+
+    guac_socket_flush(socket);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
+void test_stream_images() {
+
+    guac_client_image images[TEST_IMAGE_COUNT];
+    test_image_output serial = { NULL, 0 };
+    test_image_output parallel = { NULL, 0 };
+    int i;
+
+    /* Generate distinct images, alternating between PNG and JPEG */
+    for (i = 0; i < TEST_IMAGE_COUNT; i++) {
+
+        cairo_surface_t* surface = cairo_image_surface_create(
+                CAIRO_FORMAT_RGB24, TEST_IMAGE_SIZE, TEST_IMAGE_SIZE);
+        cairo_t* cairo = cairo_create(surface);
+
+        cairo_set_source_rgb(cairo, i / (double) TEST_IMAGE_COUNT, 0.5, 0.25);
+        cairo_paint(cairo);
+        cairo_set_source_rgb(cairo, 1.0, 1.0, 1.0);
+        cairo_rectangle(cairo, i, i, TEST_IMAGE_SIZE / 2, 4);
+        cairo_fill(cairo);
+        cairo_destroy(cairo);
+
+        images[i].format = (i % 2) ? GUAC_CLIENT_IMAGE_JPEG
+                                   : GUAC_CLIENT_IMAGE_PNG;
+        images[i].mode = GUAC_COMP_OVER;
+        images[i].layer = GUAC_DEFAULT_LAYER;
+        images[i].x = i * TEST_IMAGE_SIZE;
+        images[i].y = 0;
+        images[i].surface = surface;
+        images[i].quality = 90;
+
+    }
+
+    test_image_stream(images, 1, &serial);
+    test_image_stream(images, 4, &parallel);
+
+    /* Output must begin with the first image */
+    CU_ASSERT_FATAL(serial.length > 0);
+    CU_ASSERT(strncmp(serial.buffer, "3.img,1.0,2.14,1.0,9.image/png,1.0,1.0;",
+                39) == 0);
+
+    /* Parallel encoding must produce exactly the same images, in order */
+    test_image_strip_streams(&serial);
+    test_image_strip_streams(&parallel);
+    CU_ASSERT_EQUAL_FATAL(parallel.length, serial.length);
+    CU_ASSERT(memcmp(parallel.buffer, serial.buffer, serial.length) == 0);
+
+    for (i = 0; i < TEST_IMAGE_COUNT; i++)
+        cairo_surface_destroy(images[i].surface);
+
+    free(serial.buffer);
+    free(parallel.buffer);
+
+}
+
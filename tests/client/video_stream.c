@@ -0,0 +1,246 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "client_suite.h"
+#include "common/capture_socket.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/video.h>
+
+/**
+ * The width of each frame, in pixels. This is deliberately odd, such that the
+ * chroma planes of the encoder do not evenly divide the frame.
+ */
+#define TEST_VIDEO_WIDTH 61
+
+/**
+ * The height of each frame, in pixels. This is deliberately odd, such that
+ * the chroma planes of the encoder do not evenly divide the frame.
+ */
+#define TEST_VIDEO_HEIGHT 35
+
+#ifdef ENABLE_VPX
+/**
+ * The number of frames written to the test video stream.
+ */
+#define TEST_VIDEO_FRAMES 8
+
+/**
+ * The four-byte ID of the EBML header which begins every WebM stream.
+ */
+static const unsigned char test_video_ebml[] = { 0x1A, 0x45, 0xDF, 0xA3 };
+
+/**
+ * The four-byte ID of a WebM cluster.
+ */
+static const unsigned char test_video_cluster[] = { 0x1F, 0x43, 0xB6, 0x75 };
+
+/**
+ * The three-byte start code present within every VP8 keyframe.
+ */
+static const unsigned char test_video_vp8_start[] = { 0x9D, 0x01, 0x2A };
+
+/**
+ * Verifies that the first cluster of the given WebM stream begins with a
+ * SimpleBlock containing a VP8 keyframe of the test frame dimensions. Every
+ * element size written by the encoder is eight bytes long, thus the cluster
+ * is laid out as its ID and size (12 bytes), its timecode element (17 bytes),
+ * then the ID and size of the SimpleBlock (9 bytes) followed by the four-byte
+ * block header and the VP8 frame itself.
+ */
+static void test_video_verify_keyframe(const unsigned char* webm,
+        size_t length) {
+
+    const unsigned char* cluster = NULL;
+    const unsigned char* frame;
+    size_t offset;
+
+    for (offset = 0; offset + sizeof(test_video_cluster) <= length; offset++) {
+        if (memcmp(webm + offset, test_video_cluster,
+                    sizeof(test_video_cluster)) == 0) {
+            cluster = webm + offset;
+            break;
+        }
+    }
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(cluster);
+    CU_ASSERT_FATAL(offset + 12 + 17 + 9 + 4 + 10 <= length);
+
+    /* Cluster timecode, followed by the SimpleBlock of track 1 */
+    CU_ASSERT_EQUAL(cluster[12], 0xE7);
+    CU_ASSERT_EQUAL(cluster[29], 0xA3);
+    CU_ASSERT_EQUAL(cluster[38], 0x81);
+
+    /* Block must be flagged as a keyframe */
+    CU_ASSERT_EQUAL(cluster[41] & 0x80, 0x80);
+
+    /* VP8 frame tag must denote a keyframe (bit 0 clear) */
+    frame = cluster + 42;
+    CU_ASSERT_EQUAL(frame[0] & 0x01, 0);
+    CU_ASSERT(memcmp(frame + 3, test_video_vp8_start,
+                sizeof(test_video_vp8_start)) == 0);
+
+    /* Dimensions are 14-bit little-endian values (upper 2 bits are scale) */
+    CU_ASSERT_EQUAL((frame[6] | (frame[7] << 8)) & 0x3FFF, TEST_VIDEO_WIDTH);
+    CU_ASSERT_EQUAL((frame[8] | (frame[9] << 8)) & 0x3FFF, TEST_VIDEO_HEIGHT);
+
+}
+
+/**
+ * Decodes the data of every "blob" instruction within the captured output,
+ * in order, storing the result in the given buffer and returning the number
+ * of bytes decoded. The number of "video" instructions is stored in the
+ * given int. The captured output is modified in the process.
+ */
+static size_t test_video_extract(unsigned char* data, size_t size,
+        int* videos) {
+
+    char* current = test_capture_output;
+    char* end = test_capture_output + test_capture_output_length;
+    const char* opcode = NULL;
+    size_t decoded = 0;
+    int element = 0;
+
+    *videos = 0;
+
+    while (current < end) {
+
+        /* Read element length and value */
+        int length = strtol(current, &current, 10);
+        char* value = current + 1;
+        char terminator = value[length];
+        current = value + length + 1;
+
+        if (element == 0) {
+            opcode = value;
+            if (strncmp(opcode, "video,", 6) == 0)
+                (*videos)++;
+        }
+
+        /* Decode the data of each blob in place */
+        else if (element == 2 && strncmp(opcode, "blob,", 5) == 0) {
+
+            value[length] = '\0';
+            length = guac_protocol_decode_base64(value);
+
+            if (decoded + length <= size) {
+                memcpy(data + decoded, value, length);
+                decoded += length;
+            }
+
+        }
+
+        /* Instructions are terminated by semicolons */
+        if (terminator == ';')
+            element = 0;
+        else
+            element++;
+
+    }
+
+    return decoded;
+
+}
+#endif
+
+void test_video_stream() {
+
+    char* mimetypes[] = { "video/webm", NULL };
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+    client->info.video_mimetypes = mimetypes;
+
+    guac_socket* socket = test_capture_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_video_stream* video = guac_video_stream_alloc(client, socket,
+            GUAC_DEFAULT_LAYER, TEST_VIDEO_WIDTH, TEST_VIDEO_HEIGHT);
+
+#ifdef ENABLE_VPX
+    static unsigned char webm[1048576];
+    size_t length;
+    size_t offset;
+    int headers = 0;
+    int videos;
+    int i;
+
+    CU_ASSERT_PTR_NOT_NULL_FATAL(video);
+
+    cairo_surface_t* frame = cairo_image_surface_create(CAIRO_FORMAT_RGB24,
+            TEST_VIDEO_WIDTH, TEST_VIDEO_HEIGHT);
+
+    /* Write frames of changing content */
+    for (i = 0; i < TEST_VIDEO_FRAMES; i++) {
+
+        cairo_t* cairo = cairo_create(frame);
+        cairo_set_source_rgb(cairo, 0.0, i / (double) TEST_VIDEO_FRAMES, 1.0);
+        cairo_rectangle(cairo, i * 4, i * 4, 16, 16);
+        cairo_fill(cairo);
+        cairo_destroy(cairo);
+
+        CU_ASSERT_EQUAL(guac_video_stream_write(video, frame), 0);
+
+    }
+
+    guac_video_stream_free(video);
+    cairo_surface_destroy(frame);
+    guac_socket_flush(socket);
+
+    /* The stream must be a single WebM stream, declared once */
+    length = test_video_extract(webm, sizeof(webm), &videos);
+    CU_ASSERT_EQUAL(videos, 1);
+    CU_ASSERT_FATAL(length > sizeof(test_video_ebml));
+    CU_ASSERT(memcmp(webm, test_video_ebml, sizeof(test_video_ebml)) == 0);
+
+    for (offset = 0; offset + sizeof(test_video_ebml) <= length; offset++) {
+        if (memcmp(webm + offset, test_video_ebml,
+                    sizeof(test_video_ebml)) == 0)
+            headers++;
+    }
+
+    CU_ASSERT_EQUAL(headers, 1);
+
+    /* The stream must begin with a real VP8 keyframe */
+    test_video_verify_keyframe(webm, length);
+#else
+    /* Video cannot be streamed without an encoder */
+    CU_ASSERT_PTR_NULL(video);
+#endif
+
+    guac_socket_free(socket);
+
+    client->info.video_mimetypes = NULL;
+    guac_client_free(client);
+
+}
+
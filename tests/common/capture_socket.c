@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "capture_socket.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include <guacamole/socket.h>
+
+char test_capture_output[TEST_CAPTURE_SOCKET_SIZE];
+
+size_t test_capture_output_length;
+
+guac_socket* test_capture_socket_alloc() {
+
+    guac_socket* socket = guac_socket_alloc(0, NULL);
+    if (socket != NULL)
+        socket->write_handler = test_capture_write_handler;
+
+    test_capture_reset();
+    return socket;
+
+}
+
+void test_capture_reset() {
+    test_capture_output_length = 0;
+    test_capture_output[0] = '\0';
+}
+
+ssize_t test_capture_write_handler(guac_socket* socket, const void* buf,
+        size_t count) {
+
+    /* Fail if the output buffer (and its null terminator) would overflow */
+    if (test_capture_output_length + count >= sizeof(test_capture_output))
+        return -1;
+
+    memcpy(test_capture_output + test_capture_output_length, buf, count);
+    test_capture_output_length += count;
+    test_capture_output[test_capture_output_length] = '\0';
+    return count;
+
+}
+
+int test_capture_equals(const void* expected, size_t length) {
+    return test_capture_output_length == length
+        && memcmp(test_capture_output, expected, length) == 0;
+}
+
+int test_capture_parse(test_capture_instruction* instructions, int max) {
+
+    char* current = test_capture_output;
+    char* end = test_capture_output + test_capture_output_length;
+    int count = 0;
+
+    while (current < end && count < max) {
+
+        test_capture_instruction* instruction = &instructions[count];
+        int element = 0;
+        char terminator;
+
+        instruction->argc = 0;
+
+        do {
+
+            /* Each element is prefixed with its length, which is equal to
+             * its size in bytes as only ASCII is written by the tests */
+            long length = strtol(current, &current, 10);
+            if (*current != '.' || length < 0 || length >= end - current)
+                return -1;
+
+            char* value = current + 1;
+            current = value + length + 1;
+
+            /* Each element is followed by a comma or semicolon */
+            terminator = value[length];
+            if (terminator != ',' && terminator != ';')
+                return -1;
+
+            value[length] = '\0';
+
+            if (element++ == 0)
+                instruction->opcode = value;
+            else if (instruction->argc < TEST_CAPTURE_MAX_ARGS)
+                instruction->argv[instruction->argc++] = value;
+
+        } while (terminator == ',');
+
+        count++;
+
+    }
+
+    return count;
+
+}
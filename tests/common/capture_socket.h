@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#ifndef _GUAC_TEST_CAPTURE_SOCKET_H
+#define _GUAC_TEST_CAPTURE_SOCKET_H
+
+/**
+ * In-memory guac_socket shared by unit tests which verify the exact data
+ * written to a socket.
+ *
+ * @file capture_socket.h
+ */
+
+#include "config.h"
+
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <guacamole/socket.h>
+
+/**
+ * The maximum number of bytes which may be written to a capture socket
+ * between resets. Writes beyond this limit fail.
+ */
+#define TEST_CAPTURE_SOCKET_SIZE (8 * 1024 * 1024)
+
+/**
+ * The maximum number of arguments of any instruction parsed by
+ * test_capture_parse(). Any further arguments are ignored.
+ */
+#define TEST_CAPTURE_MAX_ARGS 16
+
+/**
+ * A single instruction parsed from the captured output.
+ */
+typedef struct test_capture_instruction {
+
+    /**
+     * The opcode of the instruction.
+     */
+    const char* opcode;
+
+    /**
+     * The number of arguments of the instruction, excluding any beyond
+     * TEST_CAPTURE_MAX_ARGS.
+     */
+    int argc;
+
+    /**
+     * The arguments of the instruction, in order.
+     */
+    const char* argv[TEST_CAPTURE_MAX_ARGS];
+
+} test_capture_instruction;
+
+/**
+ * Buffer receiving all data written to any capture socket since the last
+ * reset. The data written is always followed by a null character.
+ */
+extern char test_capture_output[TEST_CAPTURE_SOCKET_SIZE];
+
+/**
+ * The number of bytes written to any capture socket since the last reset.
+ */
+extern size_t test_capture_output_length;
+
+/**
+ * Allocates a new in-memory socket whose output is appended to
+ * test_capture_output, discarding any output captured previously.
+ *
+ * @return
+ *     A newly-allocated guac_socket, or NULL if allocation fails.
+ */
+guac_socket* test_capture_socket_alloc();
+
+/**
+ * Discards all output captured thus far.
+ */
+void test_capture_reset();
+
+/**
+ * Write handler which appends all data written to the given socket to
+ * test_capture_output. This handler is installed by
+ * test_capture_socket_alloc(), and may also be called by other handlers of
+ * the same socket.
+ *
+ * @param socket
+ *     The socket being written to.
+ *
+ * @param buf
+ *     The data to write.
+ *
+ * @param count
+ *     The number of bytes to write.
+ *
+ * @return
+ *     The number of bytes written, or -1 if test_capture_output would
+ *     overflow.
+ */
+ssize_t test_capture_write_handler(guac_socket* socket, const void* buf,
+        size_t count);
+
+/**
+ * Returns whether the output captured since the last reset is exactly the
+ * given data.
+ *
+ * @param expected
+ *     The data expected.
+ *
+ * @param length
+ *     The number of bytes of data expected.
+ *
+ * @return
+ *     Non-zero if the captured output is identical to the given data, zero
+ *     otherwise.
+ */
+int test_capture_equals(const void* expected, size_t length);
+
+/**
+ * Parses the instructions captured since the last reset. The elements of each
+ * instruction are null-terminated in place, thus the captured output is
+ * modified and can be parsed only once.
+ *
+ * @param instructions
+ *     An array which will receive the parsed instructions, in the order they
+ *     were written.
+ *
+ * @param max
+ *     The number of instructions which may be stored in the given array.
+ *     Any further instructions are not parsed.
+ *
+ * @return
+ *     The number of instructions stored in the given array, or -1 if the
+ *     captured output is not a series of valid instructions.
+ */
+int test_capture_parse(test_capture_instruction* instructions, int max);
+
+#endif
+
@@ -49,6 +49,14 @@ int register_common_suite() {
         CU_add_test(suite, "guac-iconv", test_guac_iconv)  == NULL
      || CU_add_test(suite, "guac-string", test_guac_string) == NULL
      || CU_add_test(suite, "guac-rect", test_guac_rect) == NULL
+     || CU_add_test(suite, "guac-surface-row", test_guac_surface_row) == NULL
+     || CU_add_test(suite, "guac-surface-motion", test_guac_surface_motion) == NULL
+     || CU_add_test(suite, "guac-surface-tiles", test_guac_surface_tiles) == NULL
+     || CU_add_test(suite, "guac-surface-solids", test_guac_surface_solids) == NULL
+     || CU_add_test(suite, "guac-surface-atlas", test_guac_surface_atlas) == NULL
+     || CU_add_test(suite, "guac-surface-split", test_guac_surface_split) == NULL
+     || CU_add_test(suite, "guac-surface-trial", test_guac_surface_trial) == NULL
+     || CU_add_test(suite, "guac-surface-refine", test_guac_surface_refine) == NULL
        ) {
         CU_cleanup_registry();
         return CU_get_error();
@@ -54,5 +54,51 @@ void test_guac_iconv();
  */
 void test_guac_rect();
 
+/**
+ * Unit test for the row operations used by guac_common_surface.
+ */
+void test_guac_surface_row();
+
+/**
+ * Unit test for detection of scrolled or moved content within
+ * guac_common_surface.
+ */
+void test_guac_surface_motion();
+
+/**
+ * Unit test for the tracking of dirty regions within guac_common_surface.
+ */
+void test_guac_surface_tiles();
+
+/**
+ * Unit test for the detection of solid-color content within
+ * guac_common_surface.
+ */
+void test_guac_surface_solids();
+
+/**
+ * Unit test for the packing of small updates into a single atlas image
+ * within guac_common_surface.
+ */
+void test_guac_surface_atlas();
+
+/**
+ * Unit test for the splitting of updates mixing photographic and synthetic
+ * content within guac_common_surface.
+ */
+void test_guac_surface_split();
+
+/**
+ * Unit test for the choice of image format by trial encodes within
+ * guac_common_surface.
+ */
+void test_guac_surface_trial();
+
+/**
+ * Unit test for the lossless refinement of lossy regions within
+ * guac_common_surface.
+ */
+void test_guac_surface_refine();
+
 #endif
 
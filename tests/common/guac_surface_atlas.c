@@ -0,0 +1,268 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "common/capture_socket.h"
+#include "common_suite.h"
+#include "guac_rect.h"
+#include "guac_surface.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+
+/**
+ * The width and height of the test surface, in pixels.
+ */
+#define TEST_ATLAS_SIZE 640
+
+/**
+ * The width and height of each small update, in pixels.
+ */
+#define TEST_ATLAS_GLYPH_SIZE 8
+
+/**
+ * The number of small updates drawn before each flush, which is more than
+ * GUAC_COMMON_SURFACE_ATLAS_THRESHOLD.
+ */
+#define TEST_ATLAS_GLYPHS 10
+
+/**
+ * The maximum number of instructions parsed from the output of each flush.
+ */
+#define TEST_ATLAS_MAX_INSTRUCTIONS 256
+
+/**
+ * Instructions parsed from the output of the most recent flush.
+ */
+static test_capture_instruction
+    test_atlas_instructions[TEST_ATLAS_MAX_INSTRUCTIONS];
+
+/**
+ * Returns the location of the small update having the given index. Updates
+ * are spaced far enough apart that they are never combined.
+ */
+static void test_atlas_location(int index, int* x, int* y) {
+    *x = (index % 5) * 128 + 7;
+    *y = (index / 5) * 128 + 9;
+}
+
+/**
+ * Draws TEST_ATLAS_GLYPHS small updates of arbitrary, many-colored content
+ * to the given surface, then flushes the surface, returning the number of
+ * instructions sent.
+ */
+static int test_atlas_draw(guac_common_surface* surface, uint32_t seed) {
+
+    uint32_t pixels[TEST_ATLAS_GLYPH_SIZE * TEST_ATLAS_GLYPH_SIZE];
+    int i, j, x, y;
+
+    test_capture_reset();
+
+    for (i = 0; i < TEST_ATLAS_GLYPHS; i++) {
+
+        for (j = 0; j < TEST_ATLAS_GLYPH_SIZE * TEST_ATLAS_GLYPH_SIZE; j++) {
+            seed = seed * 1103515245 + 12345;
+            pixels[j] = (seed >> 8) | 0xFF000000;
+        }
+
+        cairo_surface_t* image = cairo_image_surface_create_for_data(
+                (unsigned char*) pixels, CAIRO_FORMAT_RGB24,
+                TEST_ATLAS_GLYPH_SIZE, TEST_ATLAS_GLYPH_SIZE,
+                TEST_ATLAS_GLYPH_SIZE * 4);
+
+        test_atlas_location(i, &x, &y);
+        guac_common_surface_draw(surface, x, y, image);
+        cairo_surface_destroy(image);
+
+    }
+
+    guac_common_surface_flush(surface);
+    guac_socket_flush(surface->socket);
+
+    return test_capture_parse(test_atlas_instructions,
+            TEST_ATLAS_MAX_INSTRUCTIONS);
+
+}
+
+/**
+ * Returns the index of the small update drawn at the given location, or -1
+ * if no update was drawn there.
+ */
+static int test_atlas_find(int x, int y) {
+
+    int i, glyph_x, glyph_y;
+
+    for (i = 0; i < TEST_ATLAS_GLYPHS; i++) {
+        test_atlas_location(i, &glyph_x, &glyph_y);
+        if (glyph_x == x && glyph_y == y)
+            return i;
+    }
+
+    return -1;
+
+}
+
+void test_guac_surface_atlas() {
+
+    guac_common_rect pieces[TEST_ATLAS_GLYPHS];
+    int placed[TEST_ATLAS_GLYPHS];
+    char atlas_layer[16];
+
+    int count, i, j, index;
+    int images, copies;
+
+    /* Pieces which are never copied from the atlas remain empty */
+    memset(pieces, 0, sizeof(pieces));
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = test_capture_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_common_surface* surface = guac_common_surface_alloc(client, socket,
+            GUAC_DEFAULT_LAYER, TEST_ATLAS_SIZE, TEST_ATLAS_SIZE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+    CU_ASSERT_EQUAL(surface->atlas_threshold,
+            GUAC_COMMON_SURFACE_ATLAS_THRESHOLD);
+
+    /*
+     * Test packing of many small updates into a single image
+     */
+    count = test_atlas_draw(surface, 1);
+    CU_ASSERT_FATAL(count > 0);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface->atlas_buffer);
+    CU_ASSERT(surface->atlas_buffer->index < 0);
+
+    sprintf(atlas_layer, "%i", surface->atlas_buffer->index);
+    memset(placed, 0, sizeof(placed));
+    images = copies = 0;
+
+    for (i = 0; i < count; i++) {
+
+        test_capture_instruction* instruction = &test_atlas_instructions[i];
+
+        /* The atlas must be the only image, drawn to the atlas buffer */
+        if (strcmp(instruction->opcode, "img") == 0) {
+            CU_ASSERT_EQUAL_FATAL(instruction->argc, 6);
+            CU_ASSERT_STRING_EQUAL(instruction->argv[2], atlas_layer);
+            CU_ASSERT_STRING_EQUAL(instruction->argv[3], "image/png");
+            CU_ASSERT_EQUAL(copies, 0);
+            images++;
+        }
+
+        if (strcmp(instruction->opcode, "copy") != 0)
+            continue;
+
+        /* Each piece must be copied from the atlas into place */
+        CU_ASSERT_EQUAL_FATAL(instruction->argc, 9);
+        CU_ASSERT_STRING_EQUAL(instruction->argv[0], atlas_layer);
+        CU_ASSERT_STRING_EQUAL(instruction->argv[6], "0");
+
+        index = test_atlas_find(atoi(instruction->argv[7]),
+                atoi(instruction->argv[8]));
+        CU_ASSERT(index >= 0);
+        if (index >= 0) {
+
+            CU_ASSERT_EQUAL(placed[index], 0);
+            placed[index] = 1;
+
+            guac_common_rect_init(&pieces[index], atoi(instruction->argv[1]),
+                    atoi(instruction->argv[2]), atoi(instruction->argv[3]),
+                    atoi(instruction->argv[4]));
+
+            CU_ASSERT_EQUAL(pieces[index].width, TEST_ATLAS_GLYPH_SIZE);
+            CU_ASSERT_EQUAL(pieces[index].height, TEST_ATLAS_GLYPH_SIZE);
+
+        }
+
+        copies++;
+
+    }
+
+    CU_ASSERT_EQUAL(images, 1);
+    CU_ASSERT_EQUAL_FATAL(copies, TEST_ATLAS_GLYPHS);
+
+    /* Every update must be placed, without overlap within the atlas */
+    for (i = 0; i < TEST_ATLAS_GLYPHS; i++) {
+        CU_ASSERT_FATAL(placed[i]);
+        CU_ASSERT(pieces[i].x >= 0 && pieces[i].y >= 0);
+        for (j = i + 1; j < TEST_ATLAS_GLYPHS; j++)
+            CU_ASSERT(pieces[i].x + pieces[i].width <= pieces[j].x
+                   || pieces[j].x + pieces[j].width <= pieces[i].x
+                   || pieces[i].y + pieces[i].height <= pieces[j].y
+                   || pieces[j].y + pieces[j].height <= pieces[i].y);
+    }
+
+    /*
+     * Test that updates are sent as separate images if there are too few
+     * to be worth packing, or if packing is disabled
+     */
+    for (j = 0; j < 2; j++) {
+
+        surface->atlas_threshold = (j == 0) ? TEST_ATLAS_GLYPHS + 1 : 0;
+        count = test_atlas_draw(surface, 2 + j);
+        CU_ASSERT_FATAL(count > 0);
+
+        memset(placed, 0, sizeof(placed));
+        images = 0;
+
+        for (i = 0; i < count; i++) {
+
+            test_capture_instruction* instruction = &test_atlas_instructions[i];
+
+            CU_ASSERT_STRING_NOT_EQUAL(instruction->opcode, "copy");
+            if (strcmp(instruction->opcode, "img") != 0)
+                continue;
+
+            /* Each update must be drawn directly in place */
+            CU_ASSERT_EQUAL_FATAL(instruction->argc, 6);
+            CU_ASSERT_STRING_EQUAL(instruction->argv[2], "0");
+
+            index = test_atlas_find(atoi(instruction->argv[4]),
+                    atoi(instruction->argv[5]));
+            CU_ASSERT(index >= 0);
+            if (index >= 0) {
+                CU_ASSERT_EQUAL(placed[index], 0);
+                placed[index] = 1;
+            }
+            images++;
+
+        }
+
+        CU_ASSERT_EQUAL(images, TEST_ATLAS_GLYPHS);
+
+    }
+
+    guac_common_surface_free(surface);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
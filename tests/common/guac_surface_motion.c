@@ -0,0 +1,247 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "common/capture_socket.h"
+#include "common_suite.h"
+#include "guac_surface.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+
+/**
+ * The width and height of the test surface, in pixels.
+ */
+#define TEST_MOTION_SIZE 256
+
+/**
+ * The number of rows or columns by which content is scrolled.
+ */
+#define TEST_MOTION_SHIFT 32
+
+/**
+ * The maximum number of instructions parsed from the output of each flush.
+ */
+#define TEST_MOTION_MAX_INSTRUCTIONS 1024
+
+/**
+ * Instructions parsed from the output of the most recent flush.
+ */
+static test_capture_instruction test_motion_instructions[TEST_MOTION_MAX_INSTRUCTIONS];
+
+/**
+ * Fills the given image with arbitrary opaque pixels, such that no two rows
+ * or columns are alike.
+ */
+static void test_motion_generate(uint32_t* pixels, uint32_t seed) {
+
+    int i;
+
+    for (i = 0; i < TEST_MOTION_SIZE * TEST_MOTION_SIZE; i++) {
+        seed = seed * 1103515245 + 12345;
+        pixels[i] = (seed >> 8) | 0xFF000000;
+    }
+
+}
+
+/**
+ * Draws the given image over the entire given surface and flushes the
+ * surface, returning the number of instructions sent by the flush.
+ */
+static int test_motion_draw(guac_common_surface* surface, uint32_t* pixels) {
+
+    cairo_surface_t* image = cairo_image_surface_create_for_data(
+            (unsigned char*) pixels, CAIRO_FORMAT_RGB24, TEST_MOTION_SIZE,
+            TEST_MOTION_SIZE, TEST_MOTION_SIZE * 4);
+
+    test_capture_reset();
+
+    guac_common_surface_draw(surface, 0, 0, image);
+    guac_common_surface_flush(surface);
+    guac_socket_flush(surface->socket);
+
+    cairo_surface_destroy(image);
+
+    return test_capture_parse(test_motion_instructions,
+            TEST_MOTION_MAX_INSTRUCTIONS);
+
+}
+
+/**
+ * Verifies that the given number of instructions, sent by a flush, include
+ * exactly one "copy" within the default layer having the given source and
+ * destination rectangles, sent before any image. If the width given is zero,
+ * verifies that nothing was copied.
+ */
+static void test_motion_verify_copy(int count, int sx, int sy, int w, int h,
+        int dx, int dy) {
+
+    int copies = 0;
+    int images = 0;
+    int i;
+
+    CU_ASSERT_FATAL(count > 0);
+
+    for (i = 0; i < count; i++) {
+
+        test_capture_instruction* instruction = &test_motion_instructions[i];
+
+        if (strcmp(instruction->opcode, "img") == 0)
+            images++;
+
+        if (strcmp(instruction->opcode, "copy") != 0)
+            continue;
+
+        /* Moved content must be in place before new content is drawn */
+        CU_ASSERT_EQUAL(images, 0);
+        CU_ASSERT_EQUAL_FATAL(instruction->argc, 9);
+
+        CU_ASSERT_STRING_EQUAL(instruction->argv[0], "0");
+        CU_ASSERT_EQUAL(atoi(instruction->argv[1]), sx);
+        CU_ASSERT_EQUAL(atoi(instruction->argv[2]), sy);
+        CU_ASSERT_EQUAL(atoi(instruction->argv[3]), w);
+        CU_ASSERT_EQUAL(atoi(instruction->argv[4]), h);
+        CU_ASSERT_STRING_EQUAL(instruction->argv[6], "0");
+        CU_ASSERT_EQUAL(atoi(instruction->argv[7]), dx);
+        CU_ASSERT_EQUAL(atoi(instruction->argv[8]), dy);
+
+        copies++;
+
+    }
+
+    CU_ASSERT_EQUAL(copies, w > 0 ? 1 : 0);
+
+}
+
+/**
+ * Verifies that the backing buffer of the given surface contains exactly the
+ * given image, ignoring alpha.
+ */
+static void test_motion_verify_buffer(guac_common_surface* surface,
+        const uint32_t* pixels) {
+
+    int x, y;
+
+    for (y = 0; y < TEST_MOTION_SIZE; y++) {
+
+        const uint32_t* row = (const uint32_t*) (surface->buffer
+                + y * surface->stride);
+
+        for (x = 0; x < TEST_MOTION_SIZE; x++) {
+            if ((row[x] | 0xFF000000) != pixels[y * TEST_MOTION_SIZE + x]) {
+                CU_FAIL("Backing buffer differs from content drawn");
+                return;
+            }
+        }
+
+    }
+
+}
+
+void test_guac_surface_motion() {
+
+    static uint32_t old_pixels[TEST_MOTION_SIZE * TEST_MOTION_SIZE];
+    static uint32_t new_pixels[TEST_MOTION_SIZE * TEST_MOTION_SIZE];
+
+    int count, y;
+    int moved = TEST_MOTION_SIZE - TEST_MOTION_SHIFT;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = test_capture_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_common_surface* surface = guac_common_surface_alloc(client, socket,
+            GUAC_DEFAULT_LAYER, TEST_MOTION_SIZE, TEST_MOTION_SIZE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+
+    /* Content entirely unlike the current content is never copied */
+    test_motion_generate(old_pixels, 1);
+    count = test_motion_draw(surface, old_pixels);
+    test_motion_verify_copy(count, 0, 0, 0, 0, 0, 0);
+    test_motion_verify_buffer(surface, old_pixels);
+    CU_ASSERT_EQUAL(surface->moved_bytes, 0);
+
+    /*
+     * Test vertical scrolling, exposing new rows at the bottom
+     */
+    test_motion_generate(new_pixels, 2);
+    memcpy(new_pixels, old_pixels + TEST_MOTION_SHIFT * TEST_MOTION_SIZE,
+            moved * TEST_MOTION_SIZE * sizeof(uint32_t));
+
+    count = test_motion_draw(surface, new_pixels);
+    test_motion_verify_copy(count, 0, TEST_MOTION_SHIFT, TEST_MOTION_SIZE,
+            moved, 0, 0);
+    test_motion_verify_buffer(surface, new_pixels);
+    CU_ASSERT_EQUAL(surface->moved_bytes, TEST_MOTION_SIZE * moved * 4);
+
+    /*
+     * Test horizontal scrolling, exposing new columns at the right
+     */
+    memcpy(old_pixels, new_pixels, sizeof(old_pixels));
+    test_motion_generate(new_pixels, 3);
+    for (y = 0; y < TEST_MOTION_SIZE; y++)
+        memcpy(new_pixels + y * TEST_MOTION_SIZE,
+                old_pixels + y * TEST_MOTION_SIZE + TEST_MOTION_SHIFT,
+                moved * sizeof(uint32_t));
+
+    surface->moved_bytes = 0;
+    count = test_motion_draw(surface, new_pixels);
+    test_motion_verify_copy(count, TEST_MOTION_SHIFT, 0, moved,
+            TEST_MOTION_SIZE, 0, 0);
+    test_motion_verify_buffer(surface, new_pixels);
+    CU_ASSERT_EQUAL(surface->moved_bytes, moved * TEST_MOTION_SIZE * 4);
+
+    /*
+     * Test scrolling downwards where one moved row (originally row 100) also
+     * differs in a pixel which does not contribute to row hashes. Only the
+     * longest run of rows which truly match, those following that row, may
+     * be copied.
+     */
+    memcpy(old_pixels, new_pixels, sizeof(old_pixels));
+    test_motion_generate(new_pixels, 4);
+    memcpy(new_pixels + TEST_MOTION_SHIFT * TEST_MOTION_SIZE, old_pixels,
+            moved * TEST_MOTION_SIZE * sizeof(uint32_t));
+    new_pixels[(TEST_MOTION_SHIFT + 100) * TEST_MOTION_SIZE + 40] ^= 0xFFFFFF;
+
+    surface->moved_bytes = 0;
+    count = test_motion_draw(surface, new_pixels);
+    test_motion_verify_copy(count, 0, 101, TEST_MOTION_SIZE,
+            moved - 101, 0, TEST_MOTION_SHIFT + 101);
+    test_motion_verify_buffer(surface, new_pixels);
+    CU_ASSERT_EQUAL(surface->moved_bytes,
+            TEST_MOTION_SIZE * (moved - 101) * 4);
+
+    guac_common_surface_free(surface);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
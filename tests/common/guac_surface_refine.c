@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "common/capture_socket.h"
+#include "common_suite.h"
+#include "guac_surface.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+/**
+ * The maximum number of instructions parsed from the output of each flush.
+ */
+#define TEST_REFINE_MAX_INSTRUCTIONS 256
+
+/**
+ * The age, in milliseconds, of updates which should be considered old enough
+ * for refinement.
+ */
+#define TEST_REFINE_QUIET_AGE 1000
+
+/**
+ * Instructions parsed from the output of the most recent flush.
+ */
+static test_capture_instruction
+    test_refine_instructions[TEST_REFINE_MAX_INSTRUCTIONS];
+
+/**
+ * Marks the given heat map cell as containing lossy content which was last
+ * updated at the given time.
+ */
+static void test_refine_mark(guac_common_surface_heat_cell* heat_cell,
+        guac_timestamp updated) {
+
+    int i;
+
+    for (i = 0; i < GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE; i++)
+        heat_cell->history[i] = updated;
+
+    heat_cell->oldest_entry = 0;
+    heat_cell->lossy = 1;
+
+}
+
+/**
+ * Flushes the given surface, verifying that the output consists of exactly
+ * the given number of PNG images at the given locations, in order.
+ */
+static void test_refine_verify(guac_common_surface* surface,
+        int expected_count, const int* x, const int* y) {
+
+    int count, i, images = 0;
+
+    test_capture_reset();
+    guac_common_surface_flush(surface);
+    guac_socket_flush(surface->socket);
+
+    count = test_capture_parse(test_refine_instructions,
+            TEST_REFINE_MAX_INSTRUCTIONS);
+    CU_ASSERT_FATAL(count >= 0);
+
+    for (i = 0; i < count; i++) {
+
+        test_capture_instruction* instruction = &test_refine_instructions[i];
+
+        if (strcmp(instruction->opcode, "img") != 0)
+            continue;
+
+        CU_ASSERT_EQUAL_FATAL(instruction->argc, 6);
+        CU_ASSERT_STRING_EQUAL(instruction->argv[2], "0");
+        CU_ASSERT_STRING_EQUAL(instruction->argv[3], "image/png");
+
+        if (images < expected_count) {
+            CU_ASSERT_EQUAL(atoi(instruction->argv[4]), x[images]);
+            CU_ASSERT_EQUAL(atoi(instruction->argv[5]), y[images]);
+        }
+
+        images++;
+
+    }
+
+    CU_ASSERT_EQUAL(images, expected_count);
+
+}
+
+/**
+ * Returns the number of heat map cells of the given surface which are still
+ * marked as containing lossy content.
+ */
+static int test_refine_lossy_cells(guac_common_surface* surface) {
+
+    int cells = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width)
+              * GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->height);
+    int i, count = 0;
+
+    for (i = 0; i < cells; i++) {
+        if (surface->heat_map[i].lossy)
+            count++;
+    }
+
+    return count;
+
+}
+
+void test_guac_surface_refine() {
+
+    guac_timestamp now;
+    int i;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = test_capture_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* Surface two heat map cells wide and one cell high */
+    guac_common_surface* surface = guac_common_surface_alloc(client, socket,
+            GUAC_DEFAULT_LAYER, 128, 64);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+
+    /*
+     * Test that quiet lossy cells are re-sent together as a single PNG, and
+     * only once
+     */
+    {
+        const int x[] = { 0 };
+        const int y[] = { 0 };
+
+        now = guac_timestamp_current();
+        test_refine_mark(&surface->heat_map[0], now - TEST_REFINE_QUIET_AGE);
+        test_refine_mark(&surface->heat_map[1], now - TEST_REFINE_QUIET_AGE);
+
+        test_refine_verify(surface, 1, x, y);
+        CU_ASSERT_EQUAL(test_refine_lossy_cells(surface), 0);
+
+        test_refine_verify(surface, 0, NULL, NULL);
+    }
+
+    /*
+     * Test that recently-updated cells are not refined
+     */
+    {
+        const int x[] = { 64 };
+        const int y[] = { 0 };
+
+        now = guac_timestamp_current();
+        test_refine_mark(&surface->heat_map[0], now);
+        test_refine_mark(&surface->heat_map[1], now - TEST_REFINE_QUIET_AGE);
+
+        test_refine_verify(surface, 1, x, y);
+        CU_ASSERT_EQUAL(surface->heat_map[0].lossy, 1);
+        CU_ASSERT_EQUAL(surface->heat_map[1].lossy, 0);
+    }
+
+    guac_common_surface_free(surface);
+
+    /* Surface five heat map cells wide and four cells high, more than can
+     * be refined by a single flush */
+    surface = guac_common_surface_alloc(client, socket,
+            GUAC_DEFAULT_LAYER, 320, 256);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+
+    /*
+     * Test that refinement is spread across flushes, continuing where the
+     * previous flush stopped
+     */
+    {
+        const int first_x[] = { 0,  0,   0,   0 };
+        const int first_y[] = { 0, 64, 128, 192 };
+        const int second_x[] = {  64 };
+        const int second_y[] = { 192 };
+
+        now = guac_timestamp_current();
+        for (i = 0; i < 20; i++)
+            test_refine_mark(&surface->heat_map[i],
+                    now - TEST_REFINE_QUIET_AGE);
+
+        test_refine_verify(surface, 4, first_x, first_y);
+        CU_ASSERT_EQUAL(test_refine_lossy_cells(surface), 4);
+
+        test_refine_verify(surface, 1, second_x, second_y);
+        CU_ASSERT_EQUAL(test_refine_lossy_cells(surface), 0);
+    }
+
+    /*
+     * Test that less is refined while congested
+     */
+    {
+        const int x[] = { 0 };
+        const int y[] = { 0 };
+
+        client->congestion = GUAC_CLIENT_MAX_CONGESTION;
+
+        now = guac_timestamp_current();
+        for (i = 0; i < 20; i++)
+            test_refine_mark(&surface->heat_map[i],
+                    now - TEST_REFINE_QUIET_AGE);
+
+        test_refine_verify(surface, 1, x, y);
+        CU_ASSERT_EQUAL(test_refine_lossy_cells(surface), 16);
+
+        client->congestion = 0;
+    }
+
+    guac_common_surface_free(surface);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
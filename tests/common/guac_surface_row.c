@@ -0,0 +1,220 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "common_suite.h"
+#include "guac_surface_row.h"
+
+#include <stdint.h>
+#include <string.h>
+#include <CUnit/Basic.h>
+
+/**
+ * The widest row tested, in pixels. Rows of every width up to this value are
+ * tested, covering both whole vectors of pixels and any remainder.
+ */
+#define TEST_ROW_MAX_WIDTH 37
+
+/**
+ * Fills the given row with arbitrary pixels, including some which are fully
+ * transparent.
+ */
+static void test_row_generate(uint32_t* row, int width, uint32_t seed) {
+
+    int x;
+
+    for (x = 0; x < width; x++) {
+        seed = seed * 1103515245 + 12345;
+        row[x] = seed;
+        if (x % 5 == 0)
+            row[x] &= 0x00FFFFFF;
+    }
+
+}
+
+/**
+ * Verifies that the given row has the expected content, and that the
+ * changed range reported for that row matches the pixels that differ
+ * between the original and expected content.
+ */
+static void test_row_verify(const uint32_t* original, const uint32_t* expected,
+        const uint32_t* row, int width, int changed, int first, int last) {
+
+    int x;
+    int expected_first = -1;
+    int expected_last = -1;
+
+    for (x = 0; x < width; x++) {
+        if (original[x] != expected[x]) {
+            if (expected_first < 0) expected_first = x;
+            expected_last = x;
+        }
+    }
+
+    CU_ASSERT(memcmp(row, expected, width * sizeof(uint32_t)) == 0);
+    CU_ASSERT_EQUAL(changed, expected_first >= 0);
+
+    if (changed) {
+        CU_ASSERT_EQUAL(first, expected_first);
+        CU_ASSERT_EQUAL(last, expected_last);
+    }
+
+}
+
+/**
+ * Applies the given transfer function to a single pixel, exactly as defined
+ * by the Guacamole protocol. Black, like every other color drawn to a
+ * surface, is opaque.
+ */
+static uint32_t test_row_transfer_pixel(guac_transfer_function op,
+        uint32_t src, uint32_t dst) {
+
+    switch (op) {
+        case GUAC_TRANSFER_BINARY_BLACK:     return 0xFF000000;
+        case GUAC_TRANSFER_BINARY_WHITE:     return 0xFFFFFFFF;
+        case GUAC_TRANSFER_BINARY_SRC:       return src;
+        case GUAC_TRANSFER_BINARY_DEST:      return dst;
+        case GUAC_TRANSFER_BINARY_NSRC:      return ~src;
+        case GUAC_TRANSFER_BINARY_NDEST:     return ~dst;
+        case GUAC_TRANSFER_BINARY_AND:       return dst & src;
+        case GUAC_TRANSFER_BINARY_NAND:      return ~(dst & src);
+        case GUAC_TRANSFER_BINARY_OR:        return dst | src;
+        case GUAC_TRANSFER_BINARY_NOR:       return ~(dst | src);
+        case GUAC_TRANSFER_BINARY_XOR:       return dst ^ src;
+        case GUAC_TRANSFER_BINARY_XNOR:      return ~(dst ^ src);
+        case GUAC_TRANSFER_BINARY_NSRC_AND:  return dst & ~src;
+        case GUAC_TRANSFER_BINARY_NSRC_NAND: return ~(dst & ~src);
+        case GUAC_TRANSFER_BINARY_NSRC_OR:   return dst | ~src;
+        case GUAC_TRANSFER_BINARY_NSRC_NOR:  return ~(dst | ~src);
+    }
+
+    return dst;
+
+}
+
+void test_guac_surface_row() {
+
+    uint32_t src[TEST_ROW_MAX_WIDTH];
+    uint32_t original[TEST_ROW_MAX_WIDTH];
+    uint32_t expected[TEST_ROW_MAX_WIDTH];
+    uint32_t row[TEST_ROW_MAX_WIDTH];
+
+    int width, x, changed, first, last;
+    guac_transfer_function op;
+
+    for (width = 1; width <= TEST_ROW_MAX_WIDTH; width++) {
+
+        test_row_generate(src, width, width);
+
+        /* Destination differs from source only in a few pixels */
+        for (x = 0; x < width; x++)
+            original[x] = src[x] | 0xFF000000;
+        original[width / 3] ^= 0x00FF00;
+        original[width - 1] ^= 0x0000FF;
+
+        /*
+         * Test put of opaque data
+         */
+        memcpy(row, original, width * sizeof(uint32_t));
+        for (x = 0; x < width; x++)
+            expected[x] = src[x] | 0xFF000000;
+
+        changed = guac_common_surface_row_put(row, src, width, 1,
+                &first, &last);
+        test_row_verify(original, expected, row, width, changed, first, last);
+
+        /* Repeating the same put must change nothing */
+        changed = guac_common_surface_row_put(row, src, width, 1,
+                &first, &last);
+        CU_ASSERT_EQUAL(changed, 0);
+
+        /*
+         * Test put of data with transparent pixels
+         */
+        test_row_generate(original, width, ~width);
+        memcpy(row, original, width * sizeof(uint32_t));
+        for (x = 0; x < width; x++)
+            expected[x] = (src[x] & 0xFF000000)
+                ? (src[x] | 0xFF000000) : original[x];
+
+        changed = guac_common_surface_row_put(row, src, width, 0,
+                &first, &last);
+        test_row_verify(original, expected, row, width, changed, first, last);
+
+        /*
+         * Test fill
+         */
+        memcpy(row, original, width * sizeof(uint32_t));
+        for (x = 0; x < width; x++)
+            expected[x] = 0xFF123456;
+
+        changed = guac_common_surface_row_fill(row, 0xFF123456, width,
+                &first, &last);
+        test_row_verify(original, expected, row, width, changed, first, last);
+
+        /*
+         * Test copy, which must preserve alpha
+         */
+        memcpy(row, original, width * sizeof(uint32_t));
+        memcpy(expected, src, width * sizeof(uint32_t));
+
+        changed = guac_common_surface_row_copy(row, src, width,
+                &first, &last);
+        test_row_verify(original, expected, row, width, changed, first, last);
+
+        /*
+         * Test every transfer function
+         */
+        for (op = GUAC_TRANSFER_BINARY_BLACK; op <= GUAC_TRANSFER_BINARY_WHITE;
+                op++) {
+
+            memcpy(row, original, width * sizeof(uint32_t));
+            for (x = 0; x < width; x++)
+                expected[x] = test_row_transfer_pixel(op, src[x], original[x]);
+
+            changed = guac_common_surface_row_transfer(row, src, width, op,
+                    &first, &last);
+            test_row_verify(original, expected, row, width, changed,
+                    first, last);
+
+        }
+
+    }
+
+    /*
+     * Test copy within a single row, with the destination preceding the
+     * source
+     */
+    test_row_generate(original, TEST_ROW_MAX_WIDTH, 42);
+    memcpy(row, original, sizeof(row));
+    memcpy(expected, original, sizeof(expected));
+    memmove(expected, expected + 3,
+            (TEST_ROW_MAX_WIDTH - 3) * sizeof(uint32_t));
+
+    changed = guac_common_surface_row_copy(row, row + 3,
+            TEST_ROW_MAX_WIDTH - 3, &first, &last);
+    test_row_verify(original, expected, row, TEST_ROW_MAX_WIDTH - 3,
+            changed, first, last);
+
+}
+
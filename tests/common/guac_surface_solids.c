@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "common/capture_socket.h"
+#include "common_suite.h"
+#include "guac_surface.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+
+/**
+ * The width and height of the test surface, in pixels.
+ */
+#define TEST_SOLIDS_SIZE 256
+
+/**
+ * The maximum number of instructions parsed from the output of each flush.
+ */
+#define TEST_SOLIDS_MAX_INSTRUCTIONS 64
+
+/**
+ * The maximum number of solid-color rectangles that a dirty rectangle may be
+ * decomposed into, matching the limit within guac_surface.c.
+ */
+#define TEST_SOLIDS_MAX_RECTS 8
+
+/**
+ * A solid-color rectangle sent via "rect" and "cfill" instructions.
+ */
+typedef struct test_solids_rect {
+
+    /**
+     * The area filled.
+     */
+    int x, y, width, height;
+
+    /**
+     * The fill color, with the red component in the most significant of the
+     * lower three bytes.
+     */
+    uint32_t color;
+
+} test_solids_rect;
+
+/**
+ * Instructions parsed from the output of the most recent flush.
+ */
+static test_capture_instruction test_solids_instructions[TEST_SOLIDS_MAX_INSTRUCTIONS];
+
+/**
+ * Solid-color rectangles sent by the most recent flush.
+ */
+static test_solids_rect test_solids_rects[TEST_SOLIDS_MAX_INSTRUCTIONS];
+
+/**
+ * Draws the given image to the given surface at the given location and
+ * flushes the surface. The solid-color rectangles sent are stored in
+ * test_solids_rects, and their number returned, while the number of images
+ * sent is stored in the given int.
+ */
+static int test_solids_draw(guac_common_surface* surface, uint32_t* pixels,
+        int x, int y, int width, int height, int* images) {
+
+    int count, i;
+    int rects = 0;
+
+    cairo_surface_t* image = cairo_image_surface_create_for_data(
+            (unsigned char*) pixels, CAIRO_FORMAT_RGB24, width, height,
+            width * 4);
+
+    test_capture_reset();
+
+    guac_common_surface_draw(surface, x, y, image);
+    guac_common_surface_flush(surface);
+    guac_socket_flush(surface->socket);
+
+    cairo_surface_destroy(image);
+
+    count = test_capture_parse(test_solids_instructions,
+            TEST_SOLIDS_MAX_INSTRUCTIONS);
+    CU_ASSERT_FATAL(count > 0);
+
+    *images = 0;
+
+    for (i = 0; i < count; i++) {
+
+        test_capture_instruction* instruction = &test_solids_instructions[i];
+
+        if (strcmp(instruction->opcode, "img") == 0)
+            (*images)++;
+
+        if (strcmp(instruction->opcode, "rect") != 0)
+            continue;
+
+        /* Each rect must be immediately filled with an opaque color */
+        CU_ASSERT_EQUAL_FATAL(instruction->argc, 5);
+        CU_ASSERT_FATAL(i + 1 < count);
+
+        test_capture_instruction* fill = &test_solids_instructions[i + 1];
+        CU_ASSERT_STRING_EQUAL_FATAL(fill->opcode, "cfill");
+        CU_ASSERT_EQUAL_FATAL(fill->argc, 6);
+        CU_ASSERT_STRING_EQUAL(fill->argv[5], "255");
+
+        test_solids_rect* rect = &test_solids_rects[rects++];
+        rect->x      = atoi(instruction->argv[1]);
+        rect->y      = atoi(instruction->argv[2]);
+        rect->width  = atoi(instruction->argv[3]);
+        rect->height = atoi(instruction->argv[4]);
+        rect->color  = (atoi(fill->argv[2]) << 16)
+                     | (atoi(fill->argv[3]) << 8)
+                     |  atoi(fill->argv[4]);
+
+    }
+
+    return rects;
+
+}
+
+/**
+ * Verifies that the given rectangle was sent by the most recent flush, among
+ * the given number of rectangles sent.
+ */
+static void test_solids_verify(int rects, int x, int y, int width, int height,
+        uint32_t color) {
+
+    int i;
+
+    for (i = 0; i < rects; i++) {
+
+        const test_solids_rect* rect = &test_solids_rects[i];
+
+        if (rect->x == x && rect->y == y && rect->width == width
+                && rect->height == height) {
+            CU_ASSERT_EQUAL(rect->color, color);
+            return;
+        }
+
+    }
+
+    CU_FAIL("Expected solid-color rectangle was not sent");
+
+}
+
+/**
+ * Fills the given image with vertical stripes of the given width, each a
+ * different color.
+ */
+static void test_solids_stripes(uint32_t* pixels, int width, int height,
+        int stripe_width) {
+
+    int x, y;
+
+    for (y = 0; y < height; y++) {
+        for (x = 0; x < width; x++)
+            pixels[y * width + x] = 0xFF000000
+                                  | (0x102030 * (x / stripe_width + 1));
+    }
+
+}
+
+void test_guac_surface_solids() {
+
+    static uint32_t pixels[TEST_SOLIDS_SIZE * TEST_SOLIDS_SIZE];
+
+    int images, rects, i;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = test_capture_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_common_surface* surface = guac_common_surface_alloc(client, socket,
+            GUAC_DEFAULT_LAYER, TEST_SOLIDS_SIZE, TEST_SOLIDS_SIZE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+
+    /*
+     * Test a single color spanning several tiles, which must be sent as a
+     * single rectangle
+     */
+    for (i = 0; i < 100 * 80; i++)
+        pixels[i] = 0xFF123456;
+
+    rects = test_solids_draw(surface, pixels, 0, 0, 100, 80, &images);
+    CU_ASSERT_EQUAL(images, 0);
+    CU_ASSERT_EQUAL(rects, 1);
+    test_solids_verify(rects, 0, 0, 100, 80, 0x123456);
+
+    /*
+     * Test two colors, side by side
+     */
+    for (i = 0; i < 100 * 80; i++)
+        pixels[i] = (i % 100 < 50) ? 0xFFFF0000 : 0xFF0000FF;
+
+    rects = test_solids_draw(surface, pixels, 0, 100, 100, 80, &images);
+    CU_ASSERT_EQUAL(images, 0);
+    CU_ASSERT_EQUAL(rects, 2);
+    test_solids_verify(rects,  0, 100, 50, 80, 0xFF0000);
+    test_solids_verify(rects, 50, 100, 50, 80, 0x0000FF);
+
+    /*
+     * Test the largest number of colors which are still sent as solid-color
+     * rectangles
+     */
+    test_solids_stripes(pixels, TEST_SOLIDS_MAX_RECTS * 10, 40, 10);
+    rects = test_solids_draw(surface, pixels, 150, 0,
+            TEST_SOLIDS_MAX_RECTS * 10, 40, &images);
+    CU_ASSERT_EQUAL(images, 0);
+    CU_ASSERT_EQUAL(rects, TEST_SOLIDS_MAX_RECTS);
+
+    for (i = 0; i < TEST_SOLIDS_MAX_RECTS; i++)
+        test_solids_verify(rects, 150 + i * 10, 0, 10, 40,
+                0x102030 * (i + 1));
+
+    /*
+     * Test content with one color too many, which must be sent as an image
+     */
+    test_solids_stripes(pixels, (TEST_SOLIDS_MAX_RECTS + 1) * 10, 40, 10);
+    rects = test_solids_draw(surface, pixels, 150, 200,
+            (TEST_SOLIDS_MAX_RECTS + 1) * 10, 40, &images);
+    CU_ASSERT_EQUAL(images, 1);
+    CU_ASSERT_EQUAL(rects, 0);
+
+    guac_common_surface_free(surface);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
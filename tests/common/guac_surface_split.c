@@ -0,0 +1,257 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "common/capture_socket.h"
+#include "common_suite.h"
+#include "guac_surface.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+/**
+ * The width of the test surface, in pixels. The test surface is two heat map
+ * cells high and four heat map cells wide, the left half of which may
+ * contain photographic content.
+ */
+#define TEST_SPLIT_WIDTH 256
+
+/**
+ * The height of the test surface, in pixels.
+ */
+#define TEST_SPLIT_HEIGHT 128
+
+/**
+ * The maximum number of instructions parsed from the output of each flush.
+ */
+#define TEST_SPLIT_MAX_INSTRUCTIONS 256
+
+/**
+ * Instructions parsed from the output of the most recent flush.
+ */
+static test_capture_instruction
+    test_split_instructions[TEST_SPLIT_MAX_INSTRUCTIONS];
+
+/**
+ * Pixels drawn to the entire test surface by each update.
+ */
+static uint32_t test_split_pixels[TEST_SPLIT_WIDTH * TEST_SPLIT_HEIGHT];
+
+/**
+ * Marks every heat map cell of the given surface as having been updated
+ * frequently up until now, and as having been measured to be cheaper to
+ * send as JPEG than as PNG, such that JPEG will be chosen for the next
+ * update without further measurement.
+ */
+static void test_split_seed(guac_common_surface* surface) {
+
+    guac_timestamp now = guac_timestamp_current();
+    int cells = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width)
+              * GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->height);
+    int i, j;
+
+    for (i = 0; i < cells; i++) {
+
+        guac_common_surface_heat_cell* heat_cell = &surface->heat_map[i];
+
+        for (j = 0; j < GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE; j++)
+            heat_cell->history[j] = now
+                - (GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE - 1 - j) * 10;
+
+        heat_cell->oldest_entry = 0;
+        heat_cell->choices_since_trial = 0;
+
+        heat_cell->costs[GUAC_CLIENT_IMAGE_PNG].bytes = 1.0;
+        heat_cell->costs[GUAC_CLIENT_IMAGE_PNG].time = 1.0;
+        heat_cell->costs[GUAC_CLIENT_IMAGE_PNG].measured = 1;
+
+        heat_cell->costs[GUAC_CLIENT_IMAGE_JPEG].bytes = 0.1;
+        heat_cell->costs[GUAC_CLIENT_IMAGE_JPEG].time = 1.0;
+        heat_cell->costs[GUAC_CLIENT_IMAGE_JPEG].measured = 1;
+
+    }
+
+}
+
+/**
+ * Draws content to the entire given surface, then flushes the surface,
+ * returning the number of instructions sent. Columns of pixels left of the
+ * given boundary receive many-colored noise, while all others receive a
+ * checkerboard of two colors derived from the given seed.
+ */
+static int test_split_draw(guac_common_surface* surface, int boundary,
+        uint32_t seed) {
+
+    /* Vary both colors of the checkerboard such that no part of one update
+     * can be mistaken for motion of another */
+    uint32_t light = 0xFF808080 + seed * 0x010203;
+    uint32_t dark = 0xFF000000 + seed * 0x030201;
+    int x, y;
+
+    for (y = 0; y < TEST_SPLIT_HEIGHT; y++) {
+        for (x = 0; x < TEST_SPLIT_WIDTH; x++) {
+
+            uint32_t* pixel = &test_split_pixels[y * TEST_SPLIT_WIDTH + x];
+
+            seed = seed * 1103515245 + 12345;
+            if (x < boundary)
+                *pixel = (seed >> 8) | 0xFF000000;
+            else
+                *pixel = ((x + y) % 2) ? dark : light;
+
+        }
+    }
+
+    cairo_surface_t* image = cairo_image_surface_create_for_data(
+            (unsigned char*) test_split_pixels, CAIRO_FORMAT_RGB24,
+            TEST_SPLIT_WIDTH, TEST_SPLIT_HEIGHT, TEST_SPLIT_WIDTH * 4);
+
+    test_capture_reset();
+    test_split_seed(surface);
+
+    guac_common_surface_draw(surface, 0, 0, image);
+    cairo_surface_destroy(image);
+
+    guac_common_surface_flush(surface);
+    guac_socket_flush(surface->socket);
+
+    return test_capture_parse(test_split_instructions,
+            TEST_SPLIT_MAX_INSTRUCTIONS);
+
+}
+
+/**
+ * Verifies that the output of the most recent flush consists of exactly the
+ * given number of images having the given mimetypes and locations, in order.
+ */
+static void test_split_verify(int count, int expected_count,
+        const char** mimetypes, const int* x, const int* y) {
+
+    int i, images = 0;
+
+    for (i = 0; i < count; i++) {
+
+        test_capture_instruction* instruction = &test_split_instructions[i];
+
+        if (strcmp(instruction->opcode, "img") != 0)
+            continue;
+
+        CU_ASSERT_EQUAL_FATAL(instruction->argc, 6);
+        CU_ASSERT_STRING_EQUAL(instruction->argv[2], "0");
+
+        if (images < expected_count) {
+            CU_ASSERT_STRING_EQUAL(instruction->argv[3], mimetypes[images]);
+            CU_ASSERT_EQUAL(atoi(instruction->argv[4]), x[images]);
+            CU_ASSERT_EQUAL(atoi(instruction->argv[5]), y[images]);
+        }
+
+        images++;
+
+    }
+
+    CU_ASSERT_EQUAL(images, expected_count);
+
+}
+
+void test_guac_surface_split() {
+
+    int count, i;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = test_capture_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_common_surface* surface = guac_common_surface_alloc(client, socket,
+            GUAC_DEFAULT_LAYER, TEST_SPLIT_WIDTH, TEST_SPLIT_HEIGHT);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+
+    int heat_width = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width);
+    int heat_height = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->height);
+    CU_ASSERT_EQUAL_FATAL(heat_width * heat_height, 8);
+
+    /*
+     * Test that mixed content is split along cell boundaries, sending only
+     * the photographic half as JPEG
+     */
+    {
+        const char* mimetypes[] = { "image/jpeg", "image/png" };
+        const int x[] = { 0,   128 };
+        const int y[] = { 0,     0 };
+
+        count = test_split_draw(surface, 128, 1);
+        CU_ASSERT_FATAL(count > 0);
+        test_split_verify(count, 2, mimetypes, x, y);
+
+        for (i = 0; i < heat_width * heat_height; i++)
+            CU_ASSERT_EQUAL(surface->heat_map[i].lossy,
+                    (i % heat_width) < 2);
+    }
+
+    /*
+     * Test that content containing only a few colors is sent entirely as
+     * PNG, even though JPEG is cheaper, replacing any lossy content
+     */
+    {
+        const char* mimetypes[] = { "image/png" };
+        const int x[] = { 0 };
+        const int y[] = { 0 };
+
+        count = test_split_draw(surface, 0, 2);
+        CU_ASSERT_FATAL(count > 0);
+        test_split_verify(count, 1, mimetypes, x, y);
+
+        for (i = 0; i < heat_width * heat_height; i++)
+            CU_ASSERT_EQUAL(surface->heat_map[i].lossy, 0);
+    }
+
+    /*
+     * Test that photographic content is sent entirely as JPEG
+     */
+    {
+        const char* mimetypes[] = { "image/jpeg" };
+        const int x[] = { 0 };
+        const int y[] = { 0 };
+
+        count = test_split_draw(surface, TEST_SPLIT_WIDTH, 3);
+        CU_ASSERT_FATAL(count > 0);
+        test_split_verify(count, 1, mimetypes, x, y);
+
+        for (i = 0; i < heat_width * heat_height; i++)
+            CU_ASSERT_EQUAL(surface->heat_map[i].lossy, 1);
+    }
+
+    guac_common_surface_free(surface);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
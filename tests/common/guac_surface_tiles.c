@@ -0,0 +1,245 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "common/capture_socket.h"
+#include "common_suite.h"
+#include "guac_rect.h"
+#include "guac_surface.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+
+/**
+ * The width and height of the test surface, in pixels.
+ */
+#define TEST_TILES_SIZE 512
+
+/**
+ * The number of tiles along each side of the test surface.
+ */
+#define TEST_TILES_DIMENSION \
+    GUAC_COMMON_SURFACE_HEAT_DIMENSION(TEST_TILES_SIZE)
+
+/**
+ * The maximum number of instructions parsed from the output of each flush.
+ */
+#define TEST_TILES_MAX_INSTRUCTIONS 1024
+
+/**
+ * A solid-color update drawn to the test surface.
+ */
+typedef struct test_tiles_update {
+
+    /**
+     * The area updated.
+     */
+    int x, y, width, height;
+
+    /**
+     * The color drawn, as red, green, and blue components.
+     */
+    int red, green, blue;
+
+} test_tiles_update;
+
+/**
+ * Small updates scattered across the test surface. The third update spans
+ * two columns of tiles, and the fourth spans two rows of tiles. The last two
+ * updates lie within adjacent tiles, but are too far apart to be worth
+ * combining.
+ */
+static const test_tiles_update test_tiles_updates[] = {
+    {  10,  10, 8, 8, 0xFF, 0x00, 0x00 },
+    { 400, 400, 8, 8, 0x00, 0x00, 0xFF },
+    {  60, 100, 8, 8, 0x00, 0xFF, 0x00 },
+    { 200,  60, 8, 8, 0x80, 0x40, 0x20 },
+    { 322,   2, 2, 2, 0x10, 0x20, 0x30 },
+    { 444,  60, 2, 2, 0x30, 0x20, 0x10 }
+};
+
+/**
+ * The number of updates within test_tiles_updates.
+ */
+#define TEST_TILES_UPDATES \
+    ((int) (sizeof(test_tiles_updates) / sizeof(test_tiles_update)))
+
+/**
+ * Instructions parsed from the output of the most recent flush.
+ */
+static test_capture_instruction test_tiles_instructions[TEST_TILES_MAX_INSTRUCTIONS];
+
+/**
+ * Draws the given solid-color update to the given surface as an image.
+ */
+static void test_tiles_draw(guac_common_surface* surface,
+        const test_tiles_update* update) {
+
+    int i;
+
+    uint32_t* pixels = malloc(update->width * update->height * 4);
+    for (i = 0; i < update->width * update->height; i++)
+        pixels[i] = 0xFF000000 | (update->red << 16) | (update->green << 8)
+                  | update->blue;
+
+    cairo_surface_t* image = cairo_image_surface_create_for_data(
+            (unsigned char*) pixels, CAIRO_FORMAT_RGB24, update->width,
+            update->height, update->width * 4);
+
+    guac_common_surface_draw(surface, update->x, update->y, image);
+
+    cairo_surface_destroy(image);
+    free(pixels);
+
+}
+
+/**
+ * Returns the dirty rectangle of the tile at the given column and row of the
+ * given surface.
+ */
+static const guac_common_rect* test_tiles_get(guac_common_surface* surface,
+        int x, int y) {
+    return &surface->dirty_tiles[y * TEST_TILES_DIMENSION + x];
+}
+
+/**
+ * Verifies that the given tile has the given dirty rectangle.
+ */
+static void test_tiles_verify(const guac_common_rect* tile, int x, int y,
+        int width, int height) {
+    CU_ASSERT_EQUAL(tile->x, x);
+    CU_ASSERT_EQUAL(tile->y, y);
+    CU_ASSERT_EQUAL(tile->width, width);
+    CU_ASSERT_EQUAL(tile->height, height);
+}
+
+/**
+ * Verifies that exactly the given number of tiles of the given surface are
+ * dirty.
+ */
+static void test_tiles_verify_count(guac_common_surface* surface,
+        int expected) {
+
+    int i;
+    int dirty = 0;
+
+    for (i = 0; i < TEST_TILES_DIMENSION * TEST_TILES_DIMENSION; i++) {
+        if (surface->dirty_tiles[i].width > 0)
+            dirty++;
+    }
+
+    CU_ASSERT_EQUAL(dirty, expected);
+
+}
+
+void test_guac_surface_tiles() {
+
+    int count, i, j;
+    int rects = 0;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = test_capture_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_common_surface* surface = guac_common_surface_alloc(client, socket,
+            GUAC_DEFAULT_LAYER, TEST_TILES_SIZE, TEST_TILES_SIZE);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+
+    for (i = 0; i < TEST_TILES_UPDATES; i++)
+        test_tiles_draw(surface, &test_tiles_updates[i]);
+
+    /* Each update must be tracked only within the tiles it touches */
+    CU_ASSERT(surface->dirty);
+    test_tiles_verify_count(surface, 8);
+    test_tiles_verify(test_tiles_get(surface, 0, 0),  10,  10, 8, 8);
+    test_tiles_verify(test_tiles_get(surface, 6, 6), 400, 400, 8, 8);
+    test_tiles_verify(test_tiles_get(surface, 0, 1),  60, 100, 4, 8);
+    test_tiles_verify(test_tiles_get(surface, 1, 1),  64, 100, 4, 8);
+    test_tiles_verify(test_tiles_get(surface, 3, 0), 200,  60, 8, 4);
+    test_tiles_verify(test_tiles_get(surface, 3, 1), 200,  64, 8, 4);
+    test_tiles_verify(test_tiles_get(surface, 5, 0), 322,   2, 2, 2);
+    test_tiles_verify(test_tiles_get(surface, 6, 0), 444,  60, 2, 2);
+
+    /* Dirty rect remains the bounds of all updates */
+    test_tiles_verify(&surface->dirty_rect, 10, 2, 436, 406);
+
+    test_capture_reset();
+    guac_common_surface_flush(surface);
+    guac_socket_flush(socket);
+
+    count = test_capture_parse(test_tiles_instructions,
+            TEST_TILES_MAX_INSTRUCTIONS);
+    CU_ASSERT_FATAL(count > 0);
+
+    /* Each update must be sent separately and exactly, rather than as part
+     * of some larger combined update */
+    for (i = 0; i < count; i++) {
+
+        test_capture_instruction* instruction = &test_tiles_instructions[i];
+
+        CU_ASSERT_STRING_NOT_EQUAL(instruction->opcode, "img");
+        if (strcmp(instruction->opcode, "rect") != 0)
+            continue;
+
+        CU_ASSERT_EQUAL_FATAL(instruction->argc, 5);
+        rects++;
+
+        for (j = 0; j < TEST_TILES_UPDATES; j++) {
+            const test_tiles_update* update = &test_tiles_updates[j];
+            if (atoi(instruction->argv[1]) == update->x
+                    && atoi(instruction->argv[2]) == update->y
+                    && atoi(instruction->argv[3]) == update->width
+                    && atoi(instruction->argv[4]) == update->height)
+                break;
+        }
+
+        CU_ASSERT(j < TEST_TILES_UPDATES);
+
+    }
+
+    CU_ASSERT_EQUAL(rects, TEST_TILES_UPDATES);
+
+    /* All tiles must be clean once flushed */
+    CU_ASSERT(!surface->dirty);
+    test_tiles_verify_count(surface, 0);
+
+    /* A clean surface sends nothing */
+    test_capture_reset();
+    guac_common_surface_flush(surface);
+    guac_socket_flush(socket);
+    CU_ASSERT_EQUAL(test_capture_output_length, 0);
+
+    guac_common_surface_free(surface);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
+
@@ -0,0 +1,240 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+
+#include "config.h"
+
+#include "common/capture_socket.h"
+#include "common_suite.h"
+#include "guac_surface.h"
+
+#include <stdint.h>
+#include <string.h>
+
+#include <cairo/cairo.h>
+#include <CUnit/Basic.h>
+#include <guacamole/client.h>
+#include <guacamole/socket.h>
+#include <guacamole/timestamp.h>
+
+/**
+ * The width of the test surface, in pixels. The test surface is two heat map
+ * cells high and four heat map cells wide.
+ */
+#define TEST_TRIAL_WIDTH 256
+
+/**
+ * The height of the test surface, in pixels.
+ */
+#define TEST_TRIAL_HEIGHT 128
+
+/**
+ * The maximum number of instructions parsed from the output of each flush.
+ */
+#define TEST_TRIAL_MAX_INSTRUCTIONS 256
+
+/**
+ * Instructions parsed from the output of the most recent flush.
+ */
+static test_capture_instruction
+    test_trial_instructions[TEST_TRIAL_MAX_INSTRUCTIONS];
+
+/**
+ * Pixels drawn to the entire test surface by each update.
+ */
+static uint32_t test_trial_pixels[TEST_TRIAL_WIDTH * TEST_TRIAL_HEIGHT];
+
+/**
+ * Marks every heat map cell of the given surface as having been updated
+ * frequently up until now, such that lossy formats are considered, and sets
+ * the measured per-pixel size of PNG and JPEG images within each cell to the
+ * given values. If either size is zero, that format is instead marked as not
+ * yet measured. All statistics of the surface are reset.
+ */
+static void test_trial_seed(guac_common_surface* surface, double png_bytes,
+        double jpeg_bytes) {
+
+    guac_timestamp now = guac_timestamp_current();
+    int cells = GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->width)
+              * GUAC_COMMON_SURFACE_HEAT_DIMENSION(surface->height);
+    int i, j;
+
+    for (i = 0; i < cells; i++) {
+
+        guac_common_surface_heat_cell* heat_cell = &surface->heat_map[i];
+
+        for (j = 0; j < GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE; j++)
+            heat_cell->history[j] = now
+                - (GUAC_COMMON_SURFACE_HEAT_CELL_HISTORY_SIZE - 1 - j) * 10;
+
+        heat_cell->oldest_entry = 0;
+        heat_cell->choices_since_trial = 0;
+
+        heat_cell->costs[GUAC_CLIENT_IMAGE_PNG].bytes = png_bytes;
+        heat_cell->costs[GUAC_CLIENT_IMAGE_PNG].time = 1.0;
+        heat_cell->costs[GUAC_CLIENT_IMAGE_PNG].measured = png_bytes > 0;
+
+        heat_cell->costs[GUAC_CLIENT_IMAGE_JPEG].bytes = jpeg_bytes;
+        heat_cell->costs[GUAC_CLIENT_IMAGE_JPEG].time = 1.0;
+        heat_cell->costs[GUAC_CLIENT_IMAGE_JPEG].measured = jpeg_bytes > 0;
+
+    }
+
+    memset(surface->format_stats, 0, sizeof(surface->format_stats));
+
+}
+
+/**
+ * Draws many-colored noise derived from the given seed to the entire given
+ * surface, then flushes the surface. The single image sent must have the
+ * given mimetype, or, if NULL, any mimetype, which is returned.
+ */
+static const char* test_trial_draw(guac_common_surface* surface,
+        uint32_t seed, const char* mimetype) {
+
+    const char* sent = NULL;
+    int count, i, images = 0;
+
+    for (i = 0; i < TEST_TRIAL_WIDTH * TEST_TRIAL_HEIGHT; i++) {
+        seed = seed * 1103515245 + 12345;
+        test_trial_pixels[i] = (seed >> 8) | 0xFF000000;
+    }
+
+    cairo_surface_t* image = cairo_image_surface_create_for_data(
+            (unsigned char*) test_trial_pixels, CAIRO_FORMAT_RGB24,
+            TEST_TRIAL_WIDTH, TEST_TRIAL_HEIGHT, TEST_TRIAL_WIDTH * 4);
+
+    test_capture_reset();
+
+    guac_common_surface_draw(surface, 0, 0, image);
+    cairo_surface_destroy(image);
+
+    guac_common_surface_flush(surface);
+    guac_socket_flush(surface->socket);
+
+    count = test_capture_parse(test_trial_instructions,
+            TEST_TRIAL_MAX_INSTRUCTIONS);
+    CU_ASSERT(count > 0);
+
+    for (i = 0; i < count; i++) {
+
+        test_capture_instruction* instruction = &test_trial_instructions[i];
+
+        if (strcmp(instruction->opcode, "img") != 0)
+            continue;
+
+        CU_ASSERT_EQUAL_FATAL(instruction->argc, 6);
+        CU_ASSERT_STRING_EQUAL(instruction->argv[4], "0");
+        CU_ASSERT_STRING_EQUAL(instruction->argv[5], "0");
+
+        sent = instruction->argv[3];
+        if (mimetype != NULL)
+            CU_ASSERT_STRING_EQUAL(sent, mimetype);
+
+        images++;
+
+    }
+
+    CU_ASSERT_EQUAL(images, 1);
+    return sent;
+
+}
+
+/**
+ * Returns the cost of the given format measured within the first heat map
+ * cell of the given surface.
+ */
+static double test_trial_cost(guac_common_surface* surface,
+        guac_client_image_format format) {
+
+    guac_common_surface_format_cost* cost =
+        &surface->heat_map[0].costs[format];
+
+    CU_ASSERT(cost->measured);
+    return cost->bytes * cost->time;
+
+}
+
+void test_guac_surface_trial() {
+
+    guac_client_image_format chosen, other;
+    const char* sent;
+
+    guac_client* client = guac_client_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(client);
+
+    guac_socket* socket = test_capture_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_common_surface* surface = guac_common_surface_alloc(client, socket,
+            GUAC_DEFAULT_LAYER, TEST_TRIAL_WIDTH, TEST_TRIAL_HEIGHT);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(surface);
+
+    guac_common_surface_format_stats* stats = surface->format_stats;
+
+    /* The format measured to be cheaper is chosen without further trials */
+    test_trial_seed(surface, 1.0, 0.1);
+    test_trial_draw(surface, 1, "image/jpeg");
+    CU_ASSERT_EQUAL(stats[GUAC_CLIENT_IMAGE_JPEG].images, 1);
+    CU_ASSERT_EQUAL(stats[GUAC_CLIENT_IMAGE_JPEG].trials, 0);
+    CU_ASSERT_EQUAL(stats[GUAC_CLIENT_IMAGE_PNG].trials, 0);
+
+    test_trial_seed(surface, 0.1, 1.0);
+    test_trial_draw(surface, 2, "image/png");
+    CU_ASSERT_EQUAL(stats[GUAC_CLIENT_IMAGE_PNG].images, 1);
+    CU_ASSERT_EQUAL(stats[GUAC_CLIENT_IMAGE_PNG].trials, 0);
+    CU_ASSERT_EQUAL(stats[GUAC_CLIENT_IMAGE_JPEG].trials, 0);
+
+    /* Unmeasured formats are trialled, and the cheapest of those measured
+     * is sent using the output of its trial rather than encoded again */
+    test_trial_seed(surface, 0, 0);
+    sent = test_trial_draw(surface, 3, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(sent);
+
+    if (strcmp(sent, "image/jpeg") == 0) {
+        chosen = GUAC_CLIENT_IMAGE_JPEG;
+        other = GUAC_CLIENT_IMAGE_PNG;
+    }
+    else {
+        CU_ASSERT_STRING_EQUAL(sent, "image/png");
+        chosen = GUAC_CLIENT_IMAGE_PNG;
+        other = GUAC_CLIENT_IMAGE_JPEG;
+    }
+
+    CU_ASSERT(test_trial_cost(surface, chosen)
+            <= test_trial_cost(surface, other));
+
+    CU_ASSERT_EQUAL(stats[chosen].images, 1);
+    CU_ASSERT_EQUAL(stats[chosen].trials, 0);
+    CU_ASSERT_EQUAL(stats[other].images, 0);
+    CU_ASSERT_EQUAL(stats[other].trials, 1);
+
+    /* Only the trialled format was measured without being sent */
+    CU_ASSERT(stats[chosen].bytes > 0);
+    CU_ASSERT(stats[chosen].pixels
+            == TEST_TRIAL_WIDTH * TEST_TRIAL_HEIGHT);
+
+    guac_common_surface_free(surface);
+    guac_socket_free(socket);
+    guac_client_free(client);
+
+}
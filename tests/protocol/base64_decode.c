@@ -26,11 +26,86 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <CUnit/Basic.h>
 #include <guacamole/protocol.h>
 
+/**
+ * The base64 alphabet, used to generate long test strings.
+ */
+static const char test_base64_characters[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * Decodes the given base64 string one character at a time, the same as the
+ * original character-oriented implementation of
+ * guac_protocol_decode_base64(), returning the number of bytes written.
+ * Characters outside the base64 alphabet are interpreted as zero.
+ */
+static int test_base64_reference_decode(const char* base64, char* output) {
+
+    int length = 0;
+    int bits_read = 0;
+    int value = 0;
+    char current;
+
+    while ((current = *(base64++)) != 0 && current != '=') {
+
+        const char* found = memchr(test_base64_characters, current,
+                sizeof(test_base64_characters));
+
+        value = ((value << 6) | (found != NULL ? found - test_base64_characters : 0))
+              & 0x3FFF;
+        bits_read += 6;
+
+        if (bits_read >= 8) {
+            output[length++] = (value >> (bits_read - 8)) & 0xFF;
+            bits_read -= 8;
+        }
+
+    }
+
+    return length;
+
+}
+
+/**
+ * Verifies that long base64 strings, including strings containing
+ * characters outside the base64 alphabet, decode identically to the
+ * character-oriented reference implementation.
+ */
+static void test_base64_decode_long() {
+
+    char base64[4099];
+    char expected[sizeof(base64)];
+    int expected_length;
+    int length;
+    int i;
+
+    srand(0xB64);
+    for (length = 0; length < (int) sizeof(base64); length += 97) {
+
+        /* Generate arbitrary valid base64 */
+        for (i = 0; i < length; i++)
+            base64[i] = test_base64_characters[rand() % 64];
+
+        /* Corrupt every other string with a few invalid characters */
+        if (length > 0 && (length / 97) % 2)
+            for (i = 0; i < 3; i++)
+                base64[rand() % length] = "!\x80 ~"[i];
+
+        base64[length] = '\0';
+
+        expected_length = test_base64_reference_decode(base64, expected);
+        CU_ASSERT_EQUAL(guac_protocol_decode_base64(base64), expected_length);
+        CU_ASSERT_NSTRING_EQUAL(base64, expected, expected_length);
+
+    }
+
+}
+
 void test_base64_decode() {
 
     /* Test strings */
@@ -58,5 +133,8 @@ void test_base64_decode() {
     CU_ASSERT_EQUAL(guac_protocol_decode_base64(invalid1), 0);
     CU_ASSERT_EQUAL(guac_protocol_decode_base64(invalid2), 0);
 
+    /* Test strings long enough to be decoded in bulk */
+    test_base64_decode_long();
+
 }
 
@@ -0,0 +1,133 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "common/capture_socket.h"
+#include "suite.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/socket.h>
+
+/**
+ * The base64 alphabet, used to produce the reference encoding.
+ */
+static const char test_base64_characters[64] =
+    "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+/**
+ * Encodes the given data as base64 one byte at a time, the same as the
+ * original byte-oriented implementation of guac_socket_write_base64(),
+ * returning the number of characters written.
+ */
+static size_t test_base64_reference_encode(const unsigned char* data,
+        size_t length, char* output) {
+
+    char* current = output;
+    size_t i;
+
+    for (i = 0; i < length; i += 3) {
+
+        int a = data[i];
+        int b = (i + 1 < length) ? data[i + 1] : -1;
+        int c = (i + 2 < length) ? data[i + 2] : -1;
+
+        *(current++) = test_base64_characters[a >> 2];
+
+        if (b >= 0) {
+            *(current++) = test_base64_characters[((a & 0x03) << 4) | (b >> 4)];
+
+            if (c >= 0) {
+                *(current++) = test_base64_characters[((b & 0x0F) << 2) | (c >> 6)];
+                *(current++) = test_base64_characters[c & 0x3F];
+            }
+            else {
+                *(current++) = test_base64_characters[(b & 0x0F) << 2];
+                *(current++) = '=';
+            }
+        }
+        else {
+            *(current++) = test_base64_characters[(a & 0x03) << 4];
+            *(current++) = '=';
+            *(current++) = '=';
+        }
+
+    }
+
+    return current - output;
+
+}
+
+void test_base64_encode() {
+
+    unsigned char data[40000];
+    char expected[65536];
+    size_t expected_length;
+
+    size_t length;
+    size_t i;
+
+    /* Generate arbitrary data covering all byte values */
+    srand(0xB64);
+    for (i = 0; i < sizeof(data); i++)
+        data[i] = rand();
+
+    /* Test all short lengths, and a few long enough to span several flushes
+     * of the output buffer */
+    for (length = 0; length <= sizeof(data); length += (length < 100) ? 1 : 9973) {
+
+        size_t offset = 0;
+        size_t chunk = 1;
+
+        guac_socket* socket = test_capture_socket_alloc();
+        CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+        /* Write data in chunks of varying size, such that partial triplets
+         * must be carried between writes */
+        while (offset < length) {
+
+            if (chunk > length - offset)
+                chunk = length - offset;
+
+            CU_ASSERT_EQUAL(guac_socket_write_base64(socket,
+                        data + offset, chunk), 0);
+
+            offset += chunk;
+            chunk = chunk * 7 + 1;
+
+        }
+
+        CU_ASSERT_EQUAL(guac_socket_flush_base64(socket), 0);
+        CU_ASSERT_EQUAL(guac_socket_flush(socket), 0);
+        guac_socket_free(socket);
+
+        /* Output must be identical to the byte-oriented encoder */
+        expected_length = test_base64_reference_encode(data, length, expected);
+        CU_ASSERT(test_capture_equals(expected, expected_length));
+
+    }
+
+}
+
@@ -0,0 +1,159 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "suite.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+
+/**
+ * The number of bytes written to the test socket ahead of all instructions,
+ * well beyond the capacity of the kernel's buffers for a socket which is not
+ * being read.
+ */
+#define TEST_BULK_FILLER_SIZE 1048576
+
+/**
+ * The size of the buffer receiving all data written to the test socket.
+ */
+#define TEST_BULK_RECEIVED_SIZE (TEST_BULK_FILLER_SIZE + 4096)
+
+/**
+ * Returns the offset of the first occurrence of the given string within the
+ * given buffer at or after the given offset, or -1 if there is no such
+ * occurrence.
+ */
+static int test_bulk_find(const char* buffer, size_t length, size_t offset,
+        const char* str) {
+
+    size_t str_length = strlen(str);
+
+    for (; offset + str_length <= length; offset++) {
+        if (memcmp(buffer + offset, str, str_length) == 0)
+            return offset;
+    }
+
+    return -1;
+
+}
+
+void test_bulk_write() {
+
+    static char filler[TEST_BULK_FILLER_SIZE];
+    static char received[TEST_BULK_RECEIVED_SIZE];
+    const char* end = "3.end,1.1;";
+    size_t length = 0;
+    int sync, first, second, third, last;
+    int fds[2];
+
+    guac_stream stream = {
+        .index = 1,
+        .priority = GUAC_STREAM_PRIORITY_BULK
+    };
+
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    guac_socket* socket = guac_socket_open(fds[0], 0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+    guac_socket_require_threadsafe(socket);
+    guac_socket_require_nonblocking(socket);
+
+    /* Back up the connection such that output must be queued */
+    memset(filler, 'x', sizeof(filler));
+    CU_ASSERT_EQUAL_FATAL(guac_socket_write_buffered(socket, filler,
+                sizeof(filler)), 0);
+    CU_ASSERT_EQUAL_FATAL(guac_socket_flush(socket), 0);
+    CU_ASSERT(guac_socket_get_backlog(socket) > 0);
+
+    /* Write bulk data before an interactive instruction */
+    CU_ASSERT_EQUAL(guac_protocol_send_blob(socket, &stream, "abc", 3), 0);
+    CU_ASSERT_EQUAL(guac_protocol_send_blob(socket, &stream, "def", 3), 0);
+    CU_ASSERT_EQUAL(guac_protocol_send_blob(socket, &stream, "ghi", 3), 0);
+    CU_ASSERT_EQUAL(guac_protocol_send_sync(socket, 12345), 0);
+    CU_ASSERT_EQUAL(guac_socket_flush(socket), 0);
+
+    /* Ending the stream must send all of its data */
+    CU_ASSERT_EQUAL(guac_protocol_send_end(socket, &stream), 0);
+    CU_ASSERT_EQUAL(guac_socket_flush(socket), 0);
+
+    /* Read everything through the end of the stream */
+    while (length < strlen(end) || memcmp(received + length - strlen(end),
+                end, strlen(end)) != 0) {
+        ssize_t retval = read(fds[1], received + length,
+                sizeof(received) - length);
+        CU_ASSERT_FATAL(retval > 0);
+        length += retval;
+    }
+
+    CU_ASSERT_EQUAL(length, TEST_BULK_FILLER_SIZE + 15 + 3 * 18 + 10);
+
+    /* The interactive instruction must overtake the bulk data, while the
+     * bulk data must remain in order ahead of the end of the stream */
+    sync   = test_bulk_find(received, length, 0, "4.sync,5.12345;");
+    first  = test_bulk_find(received, length, 0, "4.blob,1.1,4.YWJj;");
+    second = test_bulk_find(received, length, 0, "4.blob,1.1,4.ZGVm;");
+    third  = test_bulk_find(received, length, 0, "4.blob,1.1,4.Z2hp;");
+    last   = test_bulk_find(received, length, 0, end);
+
+    CU_ASSERT_EQUAL(sync, TEST_BULK_FILLER_SIZE);
+    CU_ASSERT(first > sync);
+    CU_ASSERT(second > first);
+    CU_ASSERT(third > second);
+    CU_ASSERT(last > third);
+
+    /* Back up the connection again */
+    CU_ASSERT_EQUAL_FATAL(guac_socket_write_buffered(socket, filler,
+                sizeof(filler)), 0);
+    CU_ASSERT_EQUAL_FATAL(guac_socket_flush(socket), 0);
+
+    /* Deferred bulk data must be sent once everything else has been sent,
+     * even if nothing further is written */
+    CU_ASSERT_EQUAL(guac_protocol_send_blob(socket, &stream, "jkl", 3), 0);
+    CU_ASSERT_EQUAL(guac_socket_flush(socket), 0);
+
+    length = 0;
+    while (length < TEST_BULK_FILLER_SIZE + 18) {
+        ssize_t retval = read(fds[1], received + length,
+                sizeof(received) - length);
+        CU_ASSERT_FATAL(retval > 0);
+        length += retval;
+    }
+
+    CU_ASSERT_EQUAL(length, TEST_BULK_FILLER_SIZE + 18);
+    CU_ASSERT_EQUAL(test_bulk_find(received, length, 0,
+                "4.blob,1.1,4.amts;"), TEST_BULK_FILLER_SIZE);
+
+    guac_socket_free(socket);
+    close(fds[0]);
+    close(fds[1]);
+
+}
+
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "common/capture_socket.h"
+#include "suite.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/socket.h>
+
+/**
+ * The number of times the writev handler of the test socket was invoked.
+ */
+static int test_chunk_writev_calls;
+
+/**
+ * The number of times test_chunk_free_handler() was invoked.
+ */
+static int test_chunk_frees;
+
+/**
+ * Writev handler which appends all data written to the test socket to
+ * test_capture_output, writing at most half of the requested data per call to
+ * exercise handling of partial writes.
+ */
+static ssize_t test_chunk_writev_handler(guac_socket* socket,
+        const struct iovec* iov, int iovcnt) {
+
+    size_t total = 0;
+    size_t limit;
+    int i;
+
+    test_chunk_writev_calls++;
+
+    for (i = 0; i < iovcnt; i++)
+        total += iov[i].iov_len;
+
+    limit = (total + 1) / 2;
+    total = 0;
+
+    for (i = 0; i < iovcnt && total < limit; i++) {
+
+        size_t length = iov[i].iov_len;
+        if (length > limit - total)
+            length = limit - total;
+
+        if (test_capture_write_handler(socket, iov[i].iov_base,
+                    length) < 0)
+            return -1;
+
+        total += length;
+
+    }
+
+    return total;
+
+}
+
+/**
+ * Chunk free handler which counts the number of chunks freed.
+ */
+static void test_chunk_free_handler(void* chunk) {
+    test_chunk_frees++;
+}
+
+/**
+ * Writes a mix of strings, small chunks, and large chunks to a new test
+ * socket, verifying that everything is written in order.
+ *
+ * @param vectored
+ *     Non-zero if the test socket should have a writev handler, zero if all
+ *     data should be written through the write handler.
+ */
+static void test_chunk_write_socket(int vectored) {
+
+    static char large[5000];
+    static char expected[65536];
+    size_t expected_length = 0;
+
+    guac_socket* socket = test_capture_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    if (vectored)
+        socket->writev_handler = test_chunk_writev_handler;
+
+    test_chunk_writev_calls = 0;
+    test_chunk_frees = 0;
+
+    memset(large, 'x', sizeof(large));
+
+    /* Buffered data before a queued chunk */
+    CU_ASSERT_EQUAL(guac_socket_write_string(socket, "4.blob,"), 0);
+    CU_ASSERT_EQUAL(guac_socket_write_chunk(socket, large, sizeof(large),
+                test_chunk_free_handler), 0);
+    CU_ASSERT_EQUAL(guac_socket_write_string(socket, ";"), 0);
+
+    /* Small chunks are copied and freed immediately */
+    CU_ASSERT_EQUAL(guac_socket_write_chunk(socket, "small",  5,
+                test_chunk_free_handler), 0);
+    CU_ASSERT_EQUAL(test_chunk_frees, 1);
+
+    /* Queued chunk with no free handler */
+    CU_ASSERT_EQUAL(guac_socket_write_chunk(socket, large, sizeof(large),
+                NULL), 0);
+
+    /* Nothing should be written until flushed */
+    CU_ASSERT_EQUAL(test_capture_output_length, 0);
+    CU_ASSERT_EQUAL(guac_socket_flush(socket), 0);
+    CU_ASSERT_EQUAL(test_chunk_frees, 2);
+
+    /* All pending output must be written at once if possible */
+    if (vectored)
+        CU_ASSERT(test_chunk_writev_calls > 0);
+
+    memcpy(expected + expected_length, "4.blob,", 7);
+    expected_length += 7;
+    memcpy(expected + expected_length, large, sizeof(large));
+    expected_length += sizeof(large);
+    memcpy(expected + expected_length, ";small", 6);
+    expected_length += 6;
+    memcpy(expected + expected_length, large, sizeof(large));
+    expected_length += sizeof(large);
+
+    CU_ASSERT(test_capture_equals(expected, expected_length));
+
+    guac_socket_free(socket);
+
+}
+
+void test_chunk_write() {
+    test_chunk_write_socket(0);
+    test_chunk_write_socket(1);
+}
+
@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "common/capture_socket.h"
+#include "suite.h"
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/layer.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+
+void test_int_write() {
+
+    char expected[65536];
+    char* current = expected;
+    int i;
+
+    guac_layer layer = { .index = -1 };
+    guac_stream stream = { .index = 7 };
+
+    /* Values around every power of ten, and the extremes of int64_t */
+    int64_t values[64];
+    int count = 0;
+    int64_t power = 1;
+
+    guac_socket* socket;
+
+    for (i = 0; i < 18; i++) {
+        values[count++] = power - 1;
+        values[count++] = power;
+        values[count++] = -power;
+        power *= 10;
+    }
+
+    values[count++] = INT64_MAX;
+    values[count++] = INT64_MIN;
+
+    socket = test_capture_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* Integers must be written exactly as printf() would write them */
+    for (i = 0; i < count; i++) {
+        CU_ASSERT_EQUAL(guac_socket_write_int(socket, values[i]), 0);
+        current += sprintf(current, "%" PRIi64 ",", values[i]);
+        CU_ASSERT_EQUAL(guac_socket_write_string(socket, ","), 0);
+    }
+
+    CU_ASSERT_EQUAL(guac_socket_flush(socket), 0);
+    CU_ASSERT(test_capture_equals(expected, current - expected));
+    guac_socket_free(socket);
+
+    /* Fixed-shape instructions must have correct length prefixes */
+    socket = test_capture_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    guac_protocol_send_copy(socket, &layer, 0, 10, 100, 1000,
+            GUAC_COMP_OVER, &layer, -5, 123456789);
+    guac_protocol_send_rect(socket, &layer, 9, 99, 999, 9999);
+    guac_protocol_send_img(socket, &stream, GUAC_COMP_OVER, &layer,
+            "image/png", 1, -1);
+    guac_protocol_send_blob(socket, &stream, "abcd", 4);
+    CU_ASSERT_EQUAL(guac_socket_flush(socket), 0);
+
+    strcpy(expected,
+            "4.copy,2.-1,1.0,2.10,3.100,4.1000,2.14,2.-1,2.-5,9.123456789;"
+            "4.rect,2.-1,1.9,2.99,3.999,4.9999;"
+            "3.img,1.7,2.14,2.-1,9.image/png,1.1,2.-1;"
+            "4.blob,1.7,8.YWJjZA==;");
+
+    CU_ASSERT(test_capture_equals(expected, strlen(expected)));
+    guac_socket_free(socket);
+
+}
+
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "suite.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/socket.h>
+
+/**
+ * The number of bytes written to the test socket.
+ */
+#define TEST_TIMEOUT_SIZE 4096
+
+/**
+ * The timeout most recently requested from the select_write handler of the
+ * test socket, in microseconds.
+ */
+static int test_timeout_requested;
+
+/**
+ * Writev handler for a socket whose client has stopped reading, never
+ * accepting any data.
+ */
+static ssize_t test_timeout_writev_handler(guac_socket* socket,
+        const struct iovec* iov, int iovcnt) {
+    return 0;
+}
+
+/**
+ * Select_write handler for a socket whose client has stopped reading,
+ * reporting immediately that the timeout has elapsed without room becoming
+ * available.
+ */
+static int test_timeout_select_write_handler(guac_socket* socket,
+        int usec_timeout) {
+    test_timeout_requested = usec_timeout;
+    return 0;
+}
+
+void test_nonblocking_stall() {
+
+    static char data[TEST_TIMEOUT_SIZE];
+    int i;
+
+    struct timespec interval = {
+        .tv_sec  = 0,
+        .tv_nsec = 10000000L
+    };
+
+    guac_socket* socket = guac_socket_alloc(0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    socket->writev_handler = test_timeout_writev_handler;
+    socket->select_write_handler = test_timeout_select_write_handler;
+    guac_socket_require_nonblocking(socket);
+
+    /* Output is queued even though none can be written */
+    memset(data, 'x', sizeof(data));
+    test_timeout_requested = -1;
+    CU_ASSERT_EQUAL_FATAL(guac_socket_write_buffered(socket, data,
+                sizeof(data)), 0);
+    CU_ASSERT_EQUAL_FATAL(guac_socket_flush(socket), 0);
+
+    /* Once the wait for room times out, the socket must be closed */
+    for (i = 0; i < 100 && socket->state != GUAC_SOCKET_CLOSED; i++)
+        nanosleep(&interval, NULL);
+
+    CU_ASSERT_EQUAL(socket->state, GUAC_SOCKET_CLOSED);
+    CU_ASSERT_EQUAL(test_timeout_requested, GUAC_SOCKET_WRITE_TIMEOUT * 1000);
+
+    /* Queued output must be discarded, failing all further writes */
+    CU_ASSERT_EQUAL(guac_socket_get_backlog(socket), 0);
+    guac_socket_write_buffered(socket, data, sizeof(data));
+    CU_ASSERT_NOT_EQUAL(guac_socket_flush(socket), 0);
+
+    /* Freeing the socket must not wait for the discarded output */
+    guac_socket_free(socket);
+
+}
+
@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "suite.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/socket.h>
+
+/**
+ * The number of bytes written to the test socket, well beyond the capacity of
+ * the kernel's buffers for a socket which is not being read.
+ */
+#define TEST_NONBLOCKING_SIZE 1048576
+
+/**
+ * The size of each chunk written to the test socket.
+ */
+#define TEST_NONBLOCKING_CHUNK_SIZE 4096
+
+void test_nonblocking_write() {
+
+    static char expected[TEST_NONBLOCKING_SIZE];
+    static char received[TEST_NONBLOCKING_SIZE];
+    size_t length = 0;
+    size_t offset;
+    int fds[2];
+    int i;
+
+    struct timespec interval = {
+        .tv_sec  = 0,
+        .tv_nsec = 10000000L
+    };
+
+    CU_ASSERT_EQUAL_FATAL(socketpair(AF_UNIX, SOCK_STREAM, 0, fds), 0);
+
+    guac_socket* socket = guac_socket_open(fds[0], 0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    /* Output within the kernel is only counted once non-blocking */
+    CU_ASSERT_PTR_NULL(socket->pending_handler);
+    guac_socket_require_nonblocking(socket);
+#ifdef HAVE_SIOCOUTQNSD
+    CU_ASSERT_PTR_NOT_NULL(socket->pending_handler);
+#endif
+
+    /* Vary data such that any reordering would be detected */
+    for (offset = 0; offset < TEST_NONBLOCKING_SIZE; offset++)
+        expected[offset] = 'a' + (offset * 7 + offset / 4093) % 26;
+
+    /* Everything must be accepted even though nothing is being read */
+    for (offset = 0; offset < TEST_NONBLOCKING_SIZE;
+            offset += TEST_NONBLOCKING_CHUNK_SIZE)
+        CU_ASSERT_EQUAL_FATAL(guac_socket_write_buffered(socket,
+                    expected + offset, TEST_NONBLOCKING_CHUNK_SIZE), 0);
+
+    CU_ASSERT_EQUAL_FATAL(guac_socket_flush(socket), 0);
+
+    /* The data which could not be sent must be queued */
+    CU_ASSERT(guac_socket_get_backlog(socket) > 0);
+    CU_ASSERT(guac_socket_get_backlog(socket) <= TEST_NONBLOCKING_SIZE);
+
+    /* Queued data is flushed, but is not counted as written until sent */
+    CU_ASSERT_EQUAL(guac_socket_get_flushed(socket), TEST_NONBLOCKING_SIZE);
+    CU_ASSERT(socket->bytes_written < TEST_NONBLOCKING_SIZE);
+
+    /* All data must arrive intact and in order once read */
+    while (length < TEST_NONBLOCKING_SIZE) {
+        ssize_t retval = read(fds[1], received + length,
+                TEST_NONBLOCKING_SIZE - length);
+        CU_ASSERT_FATAL(retval > 0);
+        length += retval;
+    }
+
+    CU_ASSERT_NSTRING_EQUAL(received, expected, TEST_NONBLOCKING_SIZE);
+
+    /* The backlog must be empty once everything is received */
+    for (i = 0; i < 100 && guac_socket_get_backlog(socket) > 0; i++)
+        nanosleep(&interval, NULL);
+
+    CU_ASSERT_EQUAL(guac_socket_get_backlog(socket), 0);
+    CU_ASSERT_EQUAL(socket->bytes_written, TEST_NONBLOCKING_SIZE);
+
+    guac_socket_free(socket);
+    close(fds[0]);
+    close(fds[1]);
+
+}
+
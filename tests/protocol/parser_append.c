@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "suite.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/parser.h>
+
+/**
+ * An element long enough to span several SIMD blocks, mixing runs of ASCII
+ * with multibyte characters. This element is 88 characters long.
+ */
+#define LONG_ELEMENT                                    \
+    "0123456789abcdefghijklmnopqrstuvwxyz0123456789"    \
+    UTF8_8 "ABCDEFGHIJKLMNOPQRSTUVWXYZ" UTF8_8
+
+/**
+ * Test instruction containing short, long, and multibyte elements, followed
+ * by the start of another instruction which must not be parsed.
+ */
+#define TEST_INSTRUCTION \
+    "4.test,88." LONG_ELEMENT ",8." UTF8_8 ",0.;5.mouse"
+
+/**
+ * Verifies that the given parser contains the completely-parsed contents of
+ * TEST_INSTRUCTION.
+ */
+static void verify_instruction(guac_parser* parser) {
+
+    CU_ASSERT_EQUAL_FATAL(parser->state, GUAC_PARSE_COMPLETE);
+    CU_ASSERT_EQUAL_FATAL(parser->argc, 3);
+
+    CU_ASSERT_STRING_EQUAL(parser->opcode,  "test");
+    CU_ASSERT_STRING_EQUAL(parser->argv[0], LONG_ELEMENT);
+    CU_ASSERT_STRING_EQUAL(parser->argv[1], UTF8_8);
+    CU_ASSERT_STRING_EQUAL(parser->argv[2], "");
+
+}
+
+void test_parser_append() {
+
+    char buffer[] = TEST_INSTRUCTION;
+    int length = strlen(buffer);
+    int expected = length - strlen("5.mouse");
+
+    char* current = buffer;
+    int parsed = 0;
+    int available;
+
+    guac_parser* parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    /* Parse entire instruction with all data available */
+    while (parser->state != GUAC_PARSE_COMPLETE
+            && parser->state != GUAC_PARSE_ERROR) {
+
+        int appended = guac_parser_append(parser, current, length - parsed);
+        if (appended == 0)
+            break;
+
+        current += appended;
+        parsed += appended;
+
+    }
+
+    CU_ASSERT_EQUAL(parsed, expected);
+    verify_instruction(parser);
+    guac_parser_free(parser);
+
+    /* Parse same instruction, revealing only one byte at a time */
+    strcpy(buffer, TEST_INSTRUCTION);
+    parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    current = buffer;
+    parsed = 0;
+    for (available = 1; available <= length; available++) {
+
+        /* Partial characters must never be consumed */
+        int appended = guac_parser_append(parser, current, available - parsed);
+        CU_ASSERT_FATAL(appended <= available - parsed);
+
+        current += appended;
+        parsed += appended;
+
+        if (parser->state == GUAC_PARSE_COMPLETE
+                || parser->state == GUAC_PARSE_ERROR)
+            break;
+
+    }
+
+    CU_ASSERT_EQUAL(parsed, expected);
+    verify_instruction(parser);
+    guac_parser_free(parser);
+
+    /* Content not terminated by a comma or semicolon is an error */
+    strcpy(buffer, "4.test,3.abcd;");
+    parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+
+    current = buffer;
+    while (parser->state != GUAC_PARSE_ERROR) {
+        int appended = guac_parser_append(parser, current, strlen(current));
+        if (appended == 0)
+            break;
+        current += appended;
+    }
+
+    CU_ASSERT_EQUAL(parser->state, GUAC_PARSE_ERROR);
+    guac_parser_free(parser);
+
+}
+
@@ -0,0 +1,214 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "suite.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/parser.h>
+#include <guacamole/socket.h>
+
+/**
+ * The number of bytes of data sent within the test blob. The base64 encoding
+ * of this data is far longer than both GUAC_INSTRUCTION_MAX_LENGTH and the
+ * parser's internal buffer.
+ */
+#define TEST_BLOB_LENGTH 60000
+
+/**
+ * The maximum number of bytes returned by each call to the read handler of
+ * the test socket. This is deliberately not a multiple of four, such that
+ * base64 content is split at arbitrary points.
+ */
+#define TEST_READ_SIZE 997
+
+/**
+ * The complete protocol data read by the test socket.
+ */
+static char* test_input;
+
+/**
+ * The total length of test_input, in bytes.
+ */
+static int test_input_length;
+
+/**
+ * The number of bytes of test_input read thus far.
+ */
+static int test_input_offset;
+
+/**
+ * Buffer receiving all blob data passed to test_blob_handler().
+ */
+static unsigned char test_received[TEST_BLOB_LENGTH];
+
+/**
+ * The number of bytes received by test_blob_handler().
+ */
+static int test_received_length;
+
+/**
+ * The number of final chunks received by test_blob_handler().
+ */
+static int test_final_chunks;
+
+/**
+ * Read handler which returns the contents of test_input, at most
+ * TEST_READ_SIZE bytes at a time.
+ */
+static ssize_t test_read_handler(guac_socket* socket, void* buf,
+        size_t count) {
+
+    int remaining = test_input_length - test_input_offset;
+
+    if (count > TEST_READ_SIZE)
+        count = TEST_READ_SIZE;
+
+    if (count > remaining)
+        count = remaining;
+
+    memcpy(buf, test_input + test_input_offset, count);
+    test_input_offset += count;
+    return count;
+
+}
+
+/**
+ * Blob handler which appends all received data to test_received.
+ */
+static int test_blob_handler(guac_parser* parser, int stream_index,
+        void* data, int length, int final) {
+
+    CU_ASSERT_EQUAL(stream_index, 3);
+    CU_ASSERT_PTR_EQUAL(parser->data, &test_received);
+
+    /* Fail if more data is received than was sent */
+    if (test_received_length + length > TEST_BLOB_LENGTH)
+        return 1;
+
+    memcpy(test_received + test_received_length, data, length);
+    test_received_length += length;
+
+    if (final)
+        test_final_chunks++;
+
+    return 0;
+
+}
+
+/**
+ * Writes the base64 encoding of the given data to the given buffer, returning
+ * the number of characters written.
+ */
+static int test_encode_base64(const unsigned char* data, int length,
+        char* output) {
+
+    static const char characters[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    int i;
+    char* current = output;
+
+    for (i = 0; i < length; i += 3) {
+
+        int a = data[i];
+        int b = i + 1 < length ? data[i + 1] : 0;
+        int c = i + 2 < length ? data[i + 2] : 0;
+
+        *(current++) = characters[a >> 2];
+        *(current++) = characters[((a & 0x03) << 4) | (b >> 4)];
+        *(current++) = i + 1 < length ? characters[((b & 0x0F) << 2) | (c >> 6)] : '=';
+        *(current++) = i + 2 < length ? characters[c & 0x3F] : '=';
+
+    }
+
+    return current - output;
+
+}
+
+void test_parser_blob() {
+
+    unsigned char* data;
+    char* current;
+    int i;
+
+    guac_socket* socket;
+    guac_parser* parser;
+
+    /* Generate arbitrary test data */
+    data = malloc(TEST_BLOB_LENGTH);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(data);
+    for (i = 0; i < TEST_BLOB_LENGTH; i++)
+        data[i] = (i * 31 + (i >> 8)) & 0xFF;
+
+    /* Build test input: a sync, a large blob, and an end */
+    test_input = malloc(TEST_BLOB_LENGTH * 2);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(test_input);
+
+    current = test_input;
+    current += sprintf(current, "4.sync,2.42;4.blob,1.3,%i.",
+            (TEST_BLOB_LENGTH + 2) / 3 * 4);
+    current += test_encode_base64(data, TEST_BLOB_LENGTH, current);
+    current += sprintf(current, ";3.end,1.3;");
+
+    test_input_length = current - test_input;
+    test_input_offset = 0;
+    test_received_length = 0;
+    test_final_chunks = 0;
+
+    socket = guac_socket_alloc(0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+    socket->read_handler = test_read_handler;
+
+    parser = guac_parser_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(parser);
+    parser->blob_handler = test_blob_handler;
+    parser->data = &test_received;
+
+    /* Instructions other than blob are returned as usual */
+    CU_ASSERT_EQUAL_FATAL(guac_parser_read(parser, socket, 0), 0);
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "sync");
+    CU_ASSERT_EQUAL_FATAL(parser->argc, 1);
+    CU_ASSERT_STRING_EQUAL(parser->argv[0], "42");
+
+    /* Blob is streamed to handler, not returned */
+    CU_ASSERT_EQUAL_FATAL(guac_parser_read(parser, socket, 0), 0);
+    CU_ASSERT_STRING_EQUAL(parser->opcode, "end");
+    CU_ASSERT_EQUAL_FATAL(parser->argc, 1);
+    CU_ASSERT_STRING_EQUAL(parser->argv[0], "3");
+
+    /* All data must have been received exactly once */
+    CU_ASSERT_EQUAL(test_final_chunks, 1);
+    CU_ASSERT_EQUAL_FATAL(test_received_length, TEST_BLOB_LENGTH);
+    CU_ASSERT(memcmp(test_received, data, TEST_BLOB_LENGTH) == 0);
+
+    guac_parser_free(parser);
+    guac_socket_free(socket);
+    free(test_input);
+    free(data);
+
+}
+
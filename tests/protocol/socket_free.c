@@ -0,0 +1,157 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "suite.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/protocol.h>
+#include <guacamole/socket.h>
+#include <guacamole/stream.h>
+
+/**
+ * The number of bytes of ordinary output written to the test socket.
+ */
+#define TEST_FREE_SIZE 4096
+
+/**
+ * The length of the "blob" instruction written to the test socket as bulk
+ * output.
+ */
+#define TEST_FREE_BLOB_LENGTH 18
+
+/**
+ * Whether the test socket currently accepts writes.
+ */
+static int test_free_writable;
+
+/**
+ * Whether the free handler of the test socket has been called.
+ */
+static int test_free_freed;
+
+/**
+ * The number of bytes written by the test socket before its free handler
+ * was called.
+ */
+static size_t test_free_written;
+
+/**
+ * Writev handler which accepts all data once test_free_writable is set,
+ * counting the bytes written, and accepts nothing before then.
+ */
+static ssize_t test_free_writev_handler(guac_socket* socket,
+        const struct iovec* iov, int iovcnt) {
+
+    ssize_t written = 0;
+    int i;
+
+    /* Nothing may be written through a freed transport */
+    CU_ASSERT(!test_free_freed);
+
+    if (!test_free_writable)
+        return 0;
+
+    for (i = 0; i < iovcnt; i++)
+        written += iov[i].iov_len;
+
+    test_free_written += written;
+    return written;
+
+}
+
+/**
+ * Select_write handler which briefly waits before reporting that data may
+ * be written.
+ */
+static int test_free_select_write_handler(guac_socket* socket,
+        int usec_timeout) {
+
+    struct timespec interval = {
+        .tv_sec  = 0,
+        .tv_nsec = 1000000L
+    };
+
+    nanosleep(&interval, NULL);
+    return 1;
+
+}
+
+/**
+ * Free handler which records that the underlying transport is no longer
+ * usable.
+ */
+static int test_free_free_handler(guac_socket* socket) {
+    test_free_freed = 1;
+    return 0;
+}
+
+void test_socket_free() {
+
+    static char data[TEST_FREE_SIZE];
+
+    guac_stream stream = {
+        .index = 1,
+        .priority = GUAC_STREAM_PRIORITY_BULK
+    };
+
+    guac_socket* socket = guac_socket_alloc(0, NULL);
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+
+    socket->writev_handler = test_free_writev_handler;
+    socket->select_write_handler = test_free_select_write_handler;
+    socket->free_handler = test_free_free_handler;
+    guac_socket_require_threadsafe(socket);
+    guac_socket_require_nonblocking(socket);
+
+    test_free_writable = 0;
+    test_free_freed = 0;
+    test_free_written = 0;
+
+    /* Queue output which cannot yet be written */
+    memset(data, 'x', sizeof(data));
+    CU_ASSERT_EQUAL_FATAL(guac_socket_write_buffered(socket, data,
+                sizeof(data)), 0);
+    CU_ASSERT_EQUAL_FATAL(guac_socket_flush(socket), 0);
+
+    /* Defer bulk output behind the queued output, leaving further output
+     * within the buffer */
+    CU_ASSERT_EQUAL(guac_protocol_send_blob(socket, &stream, "abc", 3), 0);
+    CU_ASSERT_EQUAL_FATAL(guac_socket_write_buffered(socket, data,
+                sizeof(data)), 0);
+
+    /* All output must be written before the transport is freed */
+    test_free_writable = 1;
+    guac_socket_free(socket);
+
+    CU_ASSERT(test_free_freed);
+    CU_ASSERT_EQUAL(test_free_written,
+            TEST_FREE_SIZE * 2 + TEST_FREE_BLOB_LENGTH);
+
+}
+
@@ -47,10 +47,20 @@ int register_protocol_suite() {
     /* Add tests */
     if (
         CU_add_test(suite, "base64-decode", test_base64_decode) == NULL
+     || CU_add_test(suite, "base64-encode", test_base64_encode) == NULL
+     || CU_add_test(suite, "bulk-write", test_bulk_write) == NULL
+     || CU_add_test(suite, "chunk-write", test_chunk_write) == NULL
      || CU_add_test(suite, "instruction-parse", test_instruction_parse) == NULL
      || CU_add_test(suite, "instruction-read", test_instruction_read) == NULL
      || CU_add_test(suite, "instruction-write", test_instruction_write) == NULL
+     || CU_add_test(suite, "int-write", test_int_write) == NULL
      || CU_add_test(suite, "nest-write", test_nest_write) == NULL
+     || CU_add_test(suite, "nonblocking-stall", test_nonblocking_stall) == NULL
+     || CU_add_test(suite, "nonblocking-write", test_nonblocking_write) == NULL
+     || CU_add_test(suite, "parser-append", test_parser_append) == NULL
+     || CU_add_test(suite, "parser-blob", test_parser_blob) == NULL
+     || CU_add_test(suite, "socket-free", test_socket_free) == NULL
+     || CU_add_test(suite, "threadsafe-write", test_threadsafe_write) == NULL
        ) {
         CU_cleanup_registry();
         return CU_get_error();
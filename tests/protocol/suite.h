@@ -37,10 +37,20 @@
 int register_protocol_suite();
 
 void test_base64_decode();
+void test_base64_encode();
+void test_bulk_write();
+void test_chunk_write();
 void test_instruction_parse();
 void test_instruction_read();
 void test_instruction_write();
+void test_int_write();
 void test_nest_write();
+void test_nonblocking_stall();
+void test_nonblocking_write();
+void test_parser_append();
+void test_parser_blob();
+void test_socket_free();
+void test_threadsafe_write();
 
 #endif
 
@@ -0,0 +1,163 @@
+/*
+ * Copyright (C) 2016 Glyptodon LLC
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN
+ * THE SOFTWARE.
+ */
+
+#include "config.h"
+
+#include "common/capture_socket.h"
+#include "suite.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <CUnit/Basic.h>
+#include <guacamole/socket.h>
+
+/**
+ * The number of threads concurrently writing to the test socket.
+ */
+#define TEST_THREADSAFE_THREADS 4
+
+/**
+ * The number of instructions written by each thread.
+ */
+#define TEST_THREADSAFE_INSTRUCTIONS 500
+
+/**
+ * Data passed to each writing thread.
+ */
+typedef struct test_threadsafe_thread_data {
+
+    /**
+     * The index of the thread.
+     */
+    int index;
+
+    /**
+     * The socket to write to.
+     */
+    guac_socket* socket;
+
+} test_threadsafe_thread_data;
+
+/**
+ * Writes TEST_THREADSAFE_INSTRUCTIONS instructions to the given socket, each
+ * consisting of the index of the writing thread, the instruction number, and
+ * a base64 payload of varying length (up to several kilobytes). Each
+ * instruction is written in many small pieces, such that instructions from
+ * different threads would be interleaved if not written atomically.
+ */
+static void* test_threadsafe_thread(void* data) {
+
+    test_threadsafe_thread_data* thread_data =
+        (test_threadsafe_thread_data*) data;
+
+    guac_socket* socket = thread_data->socket;
+    int thread = thread_data->index;
+
+    unsigned char payload[4000];
+    int i;
+
+    memset(payload, thread, sizeof(payload));
+
+    for (i = 0; i < TEST_THREADSAFE_INSTRUCTIONS; i++) {
+
+        int length = (i * 37) % sizeof(payload);
+
+        guac_socket_instruction_begin(socket);
+        guac_socket_write_string(socket, "4.test,");
+        guac_socket_write_int(socket, thread);
+        guac_socket_write_string(socket, ",");
+        guac_socket_write_int(socket, i);
+        guac_socket_write_string(socket, ",");
+        guac_socket_write_base64(socket, payload, length / 2);
+        guac_socket_write_base64(socket, payload, length - length / 2);
+        guac_socket_flush_base64(socket);
+        guac_socket_write_string(socket, ";");
+        guac_socket_instruction_end(socket);
+
+    }
+
+    return NULL;
+
+}
+
+void test_threadsafe_write() {
+
+    pthread_t threads[TEST_THREADSAFE_THREADS];
+    test_threadsafe_thread_data thread_data[TEST_THREADSAFE_THREADS];
+
+    int next_instruction[TEST_THREADSAFE_THREADS] = { 0 };
+    char* current;
+    char* end;
+    int i;
+
+    guac_socket* socket = test_capture_socket_alloc();
+    CU_ASSERT_PTR_NOT_NULL_FATAL(socket);
+    guac_socket_require_threadsafe(socket);
+
+    /* Write from all threads concurrently */
+    for (i = 0; i < TEST_THREADSAFE_THREADS; i++) {
+        thread_data[i].index = i;
+        thread_data[i].socket = socket;
+        CU_ASSERT_EQUAL_FATAL(pthread_create(&threads[i], NULL,
+                    test_threadsafe_thread, &thread_data[i]), 0);
+    }
+
+    for (i = 0; i < TEST_THREADSAFE_THREADS; i++)
+        pthread_join(threads[i], NULL);
+
+    CU_ASSERT_EQUAL(guac_socket_flush(socket), 0);
+
+    /* Verify each instruction was written intact and in order */
+    current = test_capture_output;
+    end = test_capture_output + test_capture_output_length;
+    while (current < end) {
+
+        int thread, instruction, consumed;
+        char* terminator = memchr(current, ';', end - current);
+        CU_ASSERT_PTR_NOT_NULL_FATAL(terminator);
+
+        CU_ASSERT_EQUAL_FATAL(sscanf(current, "4.test,%d,%d,%n",
+                    &thread, &instruction, &consumed), 2);
+        CU_ASSERT_FATAL(thread >= 0 && thread < TEST_THREADSAFE_THREADS);
+        CU_ASSERT_EQUAL(instruction, next_instruction[thread]);
+        next_instruction[thread] = instruction + 1;
+
+        /* Payload must consist solely of base64 from the same instruction */
+        current += consumed;
+        CU_ASSERT_EQUAL(strspn(current, "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+                    "abcdefghijklmnopqrstuvwxyz0123456789+/="),
+                (size_t) (terminator - current));
+
+        current = terminator + 1;
+
+    }
+
+    for (i = 0; i < TEST_THREADSAFE_THREADS; i++)
+        CU_ASSERT_EQUAL(next_instruction[i], TEST_THREADSAFE_INSTRUCTIONS);
+
+    guac_socket_free(socket);
+
+}
+